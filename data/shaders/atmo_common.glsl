@@ -2,6 +2,16 @@
 #define ATMO_COMMON_GLSLI_
 #include "common.glsl"
 
+// The atmosphere is rendered from LUTs, after Hillaire 2020 ("A Scalable and Production Ready Sky
+// and Atmosphere Rendering Technique"):
+// - the transmittance LUT (`atmo_lut.comp`): optical depths to the top of the atmosphere,
+// - the multiple scattering LUT (`atmo_multiscatter.comp`): light scattered more than once,
+// - the sky-view LUT (`atmo_sky_view.comp`): radiance along every direction from the camera,
+// - the aerial perspective volume (`atmo_aerial.comp`): radiance from the camera up to every depth.
+// The first two are computed once per planet, the last two every frame.
+// Everything is in the atmosphere's own space: the planet is at the origin, the atmosphere's radius is 1.
+// The parameterizations are mirrored in `atmosphere.c`, which tests them (see `--test-atmosphere`).
+
 vec2 intersect_ray_sphere(
 	vec3 sphere_center,
 	float sphere_radius,
@@ -35,4 +45,326 @@ float compute_density(
 	return exp(-h * falloff) * (1.0 - h);
 }
 
+// modified from https://www.shadertoy.com/view/lslXDr thank you GLtracy
+// `c` is the cosine between the view direction and the direction *from* the sun.
+
+// Mie (g ∈ (-0.75, -0.999))
+//       3(1 - g²)            1 + c²
+// F = ------------- × -------------------
+//      8π(2 + g²)      (1 + g² - 2gc)¹⋅⁵
+float phase_mie(float g, float c, float cc) {
+	float gg = g * g;
+
+	float a = (1.0 - gg) * (1.0 + cc);
+
+	float b = 1.0 + gg - 2.0 * g * c;
+	b *= sqrt(b);
+	b *= 2.0 + gg;
+
+	return (3.0 / 8.0 / PI) * a / b;
+}
+
+// Rayleigh (g = 0)
+// F = 3/16π × (1 + c²)
+float phase_ray(float cc) {
+	return (3.0/(16.0 * PI)) * (1.0 + cc);
+}
+
+struct AtmoMedium {
+	float planet_radius;
+	/// x=Rayleigh, y=Mie
+	vec2 falloffs;
+	/// The Rayleigh scattering (and extinction) coefficients at the surface.
+	vec3 k_ray;
+	float k_mie;
+	float k_mie_ext;
+};
+
+AtmoMedium atmo_medium(AtmosphereUniforms u) {
+	return AtmoMedium(u.planet.w, vec2(u.coefs_ray.w, u.coefs_mie.w), u.coefs_ray.xyz, u.coefs_mie.x, u.coefs_mie.x * u.coefs_mie.y);
+}
+
+AtmoMedium atmo_medium(AtmosphereLutConsts c) {
+	return AtmoMedium(c.planet_radius, c.falloffs, c.coefs_ray.xyz, c.coefs_mie.x, c.coefs_mie.x * c.coefs_mie.y);
+}
+
+/// The Rayleigh and Mie densities at `p`.
+vec2 atmo_density(AtmoMedium m, vec3 p) {
+	float atmo_height = 1.0 - m.planet_radius;
+	return vec2(
+		compute_density(p, m.falloffs.x, m.planet_radius, atmo_height),
+		compute_density(p, m.falloffs.y, m.planet_radius, atmo_height)
+	);
+}
+
+vec3 atmo_extinction(AtmoMedium m, vec2 density) {
+	return m.k_ray * density.x + m.k_mie_ext * density.y;
+}
+
+/// X: cosine of the zenith angle (1 on the left), Y: height above the surface (0-1).
+vec2 atmo_transmittance_lut_uv(AtmoMedium m, vec3 p, vec3 dir) {
+	float r = length(p);
+	float h = clamp((r - m.planet_radius) / (1.0 - m.planet_radius), 0.0, 1.0);
+	return vec2(0.5 - 0.5 * dot(p / r, dir), h);
+}
+
+/// The transmittance from `p` to the sun (or to anything outside the atmosphere in direction `sun`).
+vec3 atmo_sun_transmittance(AtmoMedium m, sampler2D transmittance_lut, vec3 p, vec3 sun) {
+	vec2 optical_depth = textureLod(transmittance_lut, atmo_transmittance_lut_uv(m, p, sun), 0.0).xy;
+	return exp(-atmo_extinction(m, optical_depth));
+}
+
+/// X: cosine of the sun's zenith angle (-1 on the left), Y: height above the surface (0-1).
+vec2 atmo_multiscatter_lut_uv(AtmoMedium m, vec3 p, vec3 sun) {
+	float r = length(p);
+	float h = clamp((r - m.planet_radius) / (1.0 - m.planet_radius), 0.0, 1.0);
+	return vec2(0.5 + 0.5 * dot(p / r, sun), h);
+}
+
+/// Add the light scattered toward the camera in the `dt` long step around `p` to `radiance`,
+/// and attenuate `throughput` (the transmittance from the camera) by the step.
+/// `phases` are the Rayleigh and Mie phase functions for the view direction.
+/// The light is integrated analytically over the step, assuming the medium is constant in it.
+void atmo_scatter_step(
+	AtmoMedium m,
+	sampler2D transmittance_lut,
+	sampler2D multiscatter_lut,
+	vec3 p,
+	vec3 sun,
+	vec2 phases,
+	float dt,
+	inout vec3 radiance,
+	inout vec3 throughput
+) {
+	vec2 density = atmo_density(m, p);
+	vec3 scattering_ray = m.k_ray * density.x;
+	vec3 scattering_mie = vec3(m.k_mie * density.y);
+	vec3 extinction = max(atmo_extinction(m, density), vec3(1e-7));
+	vec3 sun_transmittance = atmo_sun_transmittance(m, transmittance_lut, p, sun);
+	vec3 multiscatter = textureLod(multiscatter_lut, atmo_multiscatter_lut_uv(m, p, sun), 0.0).rgb;
+	vec3 source
+		= (scattering_ray * phases.x + scattering_mie * phases.y) * sun_transmittance
+		+ (scattering_ray + scattering_mie) * multiscatter;
+	vec3 step_transmittance = exp(-extinction * dt);
+	radiance += throughput * source * (1.0 - step_transmittance) / extinction;
+	throughput *= step_transmittance;
+}
+
+/// The phase functions for a view direction at cosine `c` from the direction *to* the sun.
+vec2 atmo_phases(float mie_g, float c) {
+	return vec2(phase_ray(c * c), phase_mie(mie_g, -c, c * c));
+}
+
+/// The sky-view LUT is around the camera's zenith (`up`): its X is the azimuth from the sun's side
+/// (0-π), and its Y is the angle from the nadir. The lower half is the directions that hit the
+/// planet, the upper half the ones that only go through the atmosphere, each with more texels near
+/// the horizon. From outside the atmosphere, only the directions that hit it are in the LUT.
+/// `sun_side` is perpendicular to `up`, toward the sun.
+void atmo_sky_view_basis(vec3 up, vec3 sun, out vec3 sun_side, out vec3 other_side) {
+	vec3 s = sun - up * dot(sun, up);
+	if (dot(s, s) < 1e-8) s = cross(up, abs(up.x) < 0.9 ? vec3(1.0, 0.0, 0.0) : vec3(0.0, 1.0, 0.0));
+	sun_side = normalize(s);
+	other_side = cross(up, sun_side);
+}
+
+/// The angles from the nadir of the horizon and of the atmosphere's edge, for a camera at `distance`.
+vec2 atmo_sky_view_angles(float planet_radius, float distance) {
+	distance = max(distance, planet_radius * 1.00001);
+	float horizon = asin(planet_radius / distance);
+	float edge = distance > 1.0 ? asin(1.0 / distance) : PI;
+	return vec2(horizon, max(edge, horizon * 1.00001));
+}
+
+/// The angle from the nadir for the LUT's Y (0-1, not the texture coordinate).
+float atmo_sky_view_nadir_angle(vec2 angles, float y) {
+	if (y < 0.5) {
+		float s = 1.0 - 2.0 * y;
+		return angles.x * (1.0 - s * s);
+	}
+	float s = 2.0 * y - 1.0;
+	return angles.x + (angles.y - angles.x) * s * s;
+}
+
+/// The LUT's Y (0-1) for an angle from the nadir.
+float atmo_sky_view_y(vec2 angles, float nadir_angle) {
+	if (nadir_angle < angles.x) return 0.5 - 0.5 * sqrt(max(1.0 - nadir_angle / angles.x, 0.0));
+	return 0.5 + 0.5 * sqrt(clamp((nadir_angle - angles.x) / (angles.y - angles.x), 0.0, 1.0));
+}
+
+/// The view ray through the texture coordinate `uv` of a camera with the axes and near plane
+/// of `GlobalUniforms`, up to the near plane (`znear` away along the camera's forward axis).
+vec3 atmo_near_plane_ray(vec4 camera_right, vec4 camera_up, float znear, vec2 uv) {
+	vec2 ray_ndc = vec2(uv.x, 1.0 - uv.y) * 2.0 - 1.0;
+	return cross(camera_right.xyz, camera_up.xyz) * znear
+		+ camera_up.xyz * ray_ndc.y * camera_up.w
+		+ camera_right.xyz * ray_ndc.x * camera_right.w;
+}
+
+/// The direction of the view ray through the texture coordinate `uv`, in the atmosphere's space.
+vec3 atmo_view_ray(GlobalUniforms g, vec2 uv) {
+	return normalize(atmo_near_plane_ray(g.camera_right, g.camera_up, g.camera.w, uv));
+}
+
+/// The aerial perspective volume's slices split each view ray's path through the atmosphere, from
+/// where it enters it (the camera, if it's inside) to where it leaves it or hits the planet, evenly.
+/// That is the depth `w` (0-1) of the distance `t` along a path from `entry` to `end`.
+float atmo_aerial_w(float entry, float end, float t) {
+	return clamp((t - entry) / (end - entry), 0.0, 1.0);
+}
+
+/// The distance along the view ray, in the atmosphere's space, of a depth buffer value.
+float atmo_depth(GlobalUniforms g, AtmosphereUniforms a, float depth) {
+	return g.camera.w / depth / a.scale_factor / 0.5;
+}
+
+// The frame's LUTs are shared by the visible atmospheres, each has a slot in them (`a.camera.w`):
+// a layer of the sky-view LUTs, and a tile of the aerial perspective volumes, which are side by side
+// in one volume `ATMO_AERIAL_TILES` tiles across and down.
+
+/// `PSHINE_ATMO_AERIAL_TILES` in `atmosphere.h`.
+const uint ATMO_AERIAL_TILES = 4;
+
+/// The column and row of the atmosphere's tile of the aerial perspective volumes.
+uvec2 atmo_aerial_tile(AtmosphereUniforms a) {
+	uint slot = uint(a.camera.w);
+	return uvec2(slot % ATMO_AERIAL_TILES, slot / ATMO_AERIAL_TILES);
+}
+
+/// The radiance (RGB) and mean transmittance (A) from the camera up to the geometry at `depth`,
+/// in front of it.
+vec4 atmo_sample_aerial(AtmosphereUniforms a, sampler3D aerial_luts, vec2 uv, float entry, float end, float depth) {
+	float w = atmo_aerial_w(entry, end, depth);
+	vec3 size = vec3(textureSize(aerial_luts, 0));
+	float slice_count = size.z;
+	// clamped to the tile's edge texels, so the neighbours don't bleed in.
+	vec2 tile_size = size.xy / float(ATMO_AERIAL_TILES);
+	vec2 tile_uv = clamp((uv - a.aerial_rect.xy) / a.aerial_rect.zw, 0.5 / tile_size, 1.0 - 0.5 / tile_size);
+	vec2 xy = (vec2(atmo_aerial_tile(a)) + tile_uv) / float(ATMO_AERIAL_TILES);
+	vec4 l = textureLod(aerial_luts, vec3(xy, w - 0.5 / slice_count), 0.0);
+	// the first slice fades in from nothing at the camera.
+	float fade = min(w * slice_count, 1.0);
+	return vec4(l.rgb * fade, mix(1.0, l.a, fade));
+}
+
+/// The radiance (RGB) and mean transmittance (A) through the whole atmosphere along `dir`.
+vec4 atmo_sample_sky_view(AtmosphereUniforms a, sampler2DArray sky_view_luts, vec3 dir) {
+	vec3 position = a.camera.xyz;
+	float distance = length(position);
+	vec3 up = position / distance, sun_side, other_side;
+	atmo_sky_view_basis(up, a.sun, sun_side, other_side);
+	float nadir_angle = acos(clamp(-dot(dir, up), -1.0, 1.0));
+	vec3 flat_dir = dir - up * dot(dir, up);
+	float azimuth = atan(abs(dot(flat_dir, other_side)), dot(flat_dir, sun_side));
+	vec2 xy = vec2(azimuth / PI, atmo_sky_view_y(atmo_sky_view_angles(a.planet.w, distance), nadir_angle));
+	// the texels are on the edges of the parameterization.
+	vec2 size = vec2(textureSize(sky_view_luts, 0).xy);
+	return textureLod(sky_view_luts, vec3((0.5 + xy * (size - 1.0)) / size, a.camera.w), 0.0);
+}
+
+/// The atmosphere's light in front of the geometry `depth` away along the view ray through `uv`:
+/// the radiance times the atmosphere's intensity (RGB), and the mean transmittance (A).
+/// The aerial perspective volume in front of geometry inside the atmosphere, the sky-view LUT
+/// everywhere else. `entry` is where the ray enters the atmosphere, in the scene's (scaled) space,
+/// or `MAX_FLOAT` if the atmosphere isn't in front of the geometry.
+vec4 atmo_light(
+	GlobalUniforms g,
+	AtmosphereUniforms a,
+	sampler2DArray sky_view_luts,
+	sampler3D aerial_luts,
+	vec2 uv,
+	float depth,
+	out float entry
+) {
+	vec3 ray_dir = atmo_view_ray(g, uv);
+	vec2 atmo_hit = intersect_ray_sphere(a.planet.xyz, a.radius, a.camera.xyz, ray_dir);
+	entry = MAX_FLOAT;
+	if (atmo_hit.x == MAX_FLOAT || depth <= atmo_hit.x) return vec4(0.0, 0.0, 0.0, 1.0);
+	entry = atmo_hit.x * a.scale_factor;
+
+	vec2 surface_hit = intersect_ray_sphere(a.planet.xyz, a.planet.w, a.camera.xyz, ray_dir);
+	float t_end = min(atmo_hit.x + atmo_hit.y, surface_hit.x);
+	vec4 light = depth < t_end
+		? atmo_sample_aerial(a, aerial_luts, uv, atmo_hit.x, t_end, depth)
+		: atmo_sample_sky_view(a, sky_view_luts, ray_dir);
+	return vec4(light.rgb * a.intensity, light.a);
+}
+
+// Every visible atmosphere is composited in one pass (`atmo.frag`, or `atmo_half.comp` at half
+// resolution), from a storage buffer of their uniforms (`ATMOSPHERE_BATCH`). Each pixel adds up the
+// atmospheres its view ray enters, from the farthest to the closest.
+
+/// The most atmospheres composited at once, `PSHINE_ATMO_MAX_BATCH` in `atmosphere.h`.
+const uint ATMO_MAX_BATCH = 16;
+
+/// The atmospheres along a view ray, sorted by where the ray enters them, closest first.
+struct AtmoLayers {
+	uint count;
+	float entries[ATMO_MAX_BATCH];
+	vec4 lights[ATMO_MAX_BATCH];
+};
+
+/// Add an atmosphere's `atmo_light` to the ones along the ray, unless it isn't in front of the geometry.
+void atmo_add_layer(inout AtmoLayers layers, float entry, vec4 light) {
+	if (entry == MAX_FLOAT) return;
+	uint i = layers.count++;
+	for (; i > 0 && layers.entries[i - 1] > entry; --i) {
+		layers.entries[i] = layers.entries[i - 1];
+		layers.lights[i] = layers.lights[i - 1];
+	}
+	layers.entries[i] = entry;
+	layers.lights[i] = light;
+}
+
+/// The radiance (RGB) and transmittance (A) of all the atmospheres along the ray together, each
+/// seen through the ones in front of it.
+vec4 atmo_composite_layers(AtmoLayers layers) {
+	vec4 light = vec4(0.0, 0.0, 0.0, 1.0);
+	for (uint i = layers.count; i > 0; --i) {
+		vec4 layer = layers.lights[i - 1];
+		light = vec4(light.rgb * layer.a + layer.rgb, light.a * layer.a);
+	}
+	return light;
+}
+
+// Half-resolution rendering (`atmo_half.comp`, `atmo_resolve.comp` and `atmo_upsample.frag`):
+// each texel of the half-resolution target stands for a block of `divisor`² pixels, and is
+// rendered at one of them each frame, in turn. The block's depth is its closest pixel's, and a pixel
+// of another surface is swapped for the closest one, so every sample of a texel is of one surface.
+// The samples are accumulated over frames by reprojecting the last frame's target, then upsampled
+// with the texels of the same surface as each pixel. Mirrored in `atmosphere.c`
+// (see `--test-atmosphere-half-res`).
+
+/// How much two depth buffer values can differ, relative to the larger one, and still be of one surface.
+const float ATMO_SURFACE_TOLERANCE = 0.1;
+
+bool atmo_same_surface(float a, float b) {
+	return abs(a - b) <= ATMO_SURFACE_TOLERANCE * max(a, b);
+}
+
+/// The size of the half-resolution target, for `half_res.extent` pixels. The target can be larger.
+ivec2 atmo_half_res_size(AtmosphereHalfResUniforms half_res) {
+	return (ivec2(half_res.extent) + int(half_res.divisor) - 1) / int(half_res.divisor);
+}
+
+/// The depth buffer value of the closest pixel of the block of `texel`, which is put in `closest`.
+/// Only the top left `extent` of the depth buffer is rendered in.
+float atmo_block_depth(sampler2D depth_buffer, ivec2 extent, ivec2 texel, uint divisor, out ivec2 closest) {
+	ivec2 last = extent - 1;
+	ivec2 origin = texel * int(divisor);
+	float block_depth = -1.0;
+	closest = min(origin, last);
+	for (uint y = 0; y < divisor; ++y) {
+		for (uint x = 0; x < divisor; ++x) {
+			ivec2 pixel = min(origin + ivec2(x, y), last);
+			// reverse Z: closer is larger.
+			float depth = texelFetch(depth_buffer, pixel, 0).r;
+			if (depth > block_depth) {
+				block_depth = depth;
+				closest = pixel;
+			}
+		}
+	}
+	return block_depth;
+}
+
 #endif // ATMO_COMMON_GLSLI_
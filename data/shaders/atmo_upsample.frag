@@ -0,0 +1,54 @@
+#version 450 core
+#extension GL_ARB_shading_language_include: enable
+#pragma shader_stage(fragment)
+#include "common.glsl"
+#include "atmo_common.glsl"
+
+// Composites the half-resolution atmosphere (`atmo_resolve.comp`) over the scene: each pixel
+// takes the bilinear weights of the four texels around it, but only from the texels of its own
+// surface, or the nearest one in depth if there is none (Shopf et al. 2009).
+
+layout (set = 0, binding = 0) uniform readonly BUFFER(AtmosphereHalfResUniforms, half_res);
+layout (set = 0, binding = 1) uniform SAMPLER(_2D, u_light);
+layout (set = 0, binding = 2) uniform SAMPLER(_2D, u_light_depth);
+
+layout (location = 0) out vec4 o_col;
+layout (location = 0) in vec2 i_uv;
+layout (input_attachment_index = 0, set = 0, binding = 3) uniform SUBPASS_INPUT(u_input_color);
+layout (input_attachment_index = 1, set = 0, binding = 4) uniform SUBPASS_INPUT(u_input_depth);
+layout (input_attachment_index = 2, set = 0, binding = 5) uniform SUBPASS_INPUT(u_input_diffuse_o);
+
+void main() {
+	vec4 color = subpassLoad(u_input_color).rgba + subpassLoad(u_input_diffuse_o).rgba;
+	float depth = subpassLoad(u_input_depth).r;
+
+	ivec2 last = atmo_half_res_size(half_res) - 1;
+	// the texel centers are at whole coordinates.
+	vec2 p = gl_FragCoord.xy / float(half_res.divisor) - 0.5;
+	ivec2 base = ivec2(floor(p));
+	vec2 f = p - vec2(base);
+
+	vec4 light = vec4(0.0);
+	float weight = 0.0;
+	vec4 nearest = vec4(0.0, 0.0, 0.0, 1.0);
+	float nearest_diff = MAX_FLOAT;
+	for (int y = 0; y <= 1; ++y) {
+		for (int x = 0; x <= 1; ++x) {
+			ivec2 texel = clamp(base + ivec2(x, y), ivec2(0), last);
+			vec4 s = texelFetch(u_light, texel, 0);
+			float d = texelFetch(u_light_depth, texel, 0).r;
+			if (atmo_same_surface(d, depth)) {
+				float w = (x == 0 ? 1.0 - f.x : f.x) * (y == 0 ? 1.0 - f.y : f.y) + 1e-4;
+				light += s * w;
+				weight += w;
+			}
+			float diff = abs(d - depth);
+			if (diff < nearest_diff) {
+				nearest = s;
+				nearest_diff = diff;
+			}
+		}
+	}
+	light = weight > 0.0 ? light / weight : nearest;
+	o_col = vec4(color.rgb * light.a + light.rgb, 1.0);
+}
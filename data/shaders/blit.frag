@@ -11,7 +11,11 @@ layout (location = 0) in vec2 i_uv;
 layout (set = 0, binding = 0) uniform sampler2D u_color;
 // layout (set = 0, binding = 1, r32f) uniform readonly image2D u_depth;
 
-layout (push_constant) uniform BUFFER(GraphicsSettingsConsts, u_consts);
+layout (push_constant) uniform _TonemapConsts {
+	GraphicsSettingsConsts u_consts;
+	/// The part of `u_color` the scene is rendered in, see `vulkan_renderer::render_scale`.
+	vec2 u_uv_scale;
+};
 
 // https://64.github.io/tonemapping/#uncharted-2
 vec3 uncharted2_tonemap_partial(vec3 x) {
@@ -37,7 +41,9 @@ float random2d(vec2 uv) {
 }
 
 void main() {
-	vec4 col0 = texelFetch(u_color, ivec2(gl_FragCoord.xy), 0);
+	// upscaled from the top left of the color image, without filtering in what's outside of it.
+	vec2 half_texel = 0.5 / vec2(textureSize(u_color, 0));
+	vec4 col0 = textureLod(u_color, min(i_uv * u_uv_scale, u_uv_scale - half_texel), 0.0);
 	o_col = vec4(uncharted2_filmic(col0.rgb), col0.a);
   o_col += vec4(vec3(mix(-1.0, 1.0, random2d(i_uv)) * 0.5 / 1024.0), 0.0);
 }
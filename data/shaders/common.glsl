@@ -5,10 +5,16 @@ const float MAX_FLOAT = 3.402823466e+38;
 const float PI = 3.14159265358979;
 const float EPSILON = 1.19e-07;
 
+/// The shadow map's cascades, a 2x2 atlas (`PSHINE_SHADOW_CASCADE_COUNT` in `shadows.h`).
+const uint SHADOW_CASCADE_COUNT = 4;
+
 #define BUFFER(S, name) _Uniform_##S { S name; }
+/// A storage buffer of `S`s, one per instance (indexed with `gl_InstanceIndex`).
+#define INSTANCES(S, name) _Instances_##S { S name[]; }
 #define SAMPLER(T, name) T name
 #define _1D sampler1D
 #define _2D sampler2D
+#define _2D_ARRAY sampler2DArray
 #define _3D sampler3D
 #define _CUBE samplerCube
 #define SUBPASS_INPUT(name) subpassInput name
@@ -21,26 +27,55 @@ struct GlobalUniforms {
 	mat4 inv_view;
 	mat4 inv_proj;
 	mat4 local_view;
+	mat4 shadow_proj[SHADOW_CASCADE_COUNT]; // from positions relative to the render origin to each cascade's clip space
+	vec4 shadow_splits; // the view depth each cascade ends at
+	vec4 shadow_biases; // each cascade's texel in its depth units
 };
 
 struct AtmosphereUniforms {
 	vec4 planet;     // xyz, w=radius
 	vec4 coefs_ray;  // xyz=k_ray, w=falloff_ray
 	vec4 coefs_mie;  // x=k_mie, y=k_mie_ext, z=g, w=falloff_mie
-	vec4 camera;     // xyz, w=_
+	vec4 camera;     // xyz, w=the planet's slot in the frame's LUTs (see `atmo_aerial_tile`)
+	vec4 aerial_rect; // the screen rect (xy=min, zw=size, in uv) of the aerial perspective volume
 	float radius;
-	uint optical_depth_samples;
-	uint scatter_point_samples;
+	uint sky_view_samples;
+	uint aerial_samples; // per slice
 	float intensity;
 	vec3 sun;
 	float scale_factor; // scs_size / scale_factor = atmo_size.
 };
 
+/// Every visible atmosphere, for the atmosphere pass (see `atmo_common.glsl`).
+#define ATMOSPHERE_BATCH(name) _AtmosphereBatch { uint name##_count; AtmosphereUniforms name[]; }
+
+/// For the half-resolution atmosphere, see `atmo_common.glsl`.
+struct AtmosphereHalfResUniforms {
+	vec4 prev_camera;       // xyz=the last frame's camera, relative to this one's, w=1 if there is a history
+	vec4 prev_camera_right; // the last frame's `GlobalUniforms::camera_right`
+	vec4 prev_camera_up;    // the last frame's `GlobalUniforms::camera_up`
+	uvec2 jitter;           // the pixel of each block rendered this frame
+	uint divisor;           // the size of the blocks
+	float blend;            // this frame's weight in the history
+	uvec2 extent;           // the pixels rendered, in the top left of the depth buffer
+};
+
+/// For the per-planet atmosphere LUTs, see `atmo_lut.comp` and `atmo_multiscatter.comp`.
+struct AtmosphereLutConsts {
+	vec4 coefs_ray;  // xyz=k_ray
+	vec4 coefs_mie;  // x=k_mie, y=k_mie_ext
+	float planet_radius;
+	float atmo_height;
+	vec2 falloffs;
+	uint samples;
+};
+
 struct StaticMeshUniforms {
 	mat4 proj;
 	mat4 model_view;
 	mat4 model;
 	vec4 sun;
+	float lod_morph; // 0=i_position, 1=i_morph_target
 };
 
 struct StdMeshUniforms {
@@ -48,12 +83,15 @@ struct StdMeshUniforms {
 	mat4 model_view;
 	mat4 model;
 	mat4 unscaled_model;
-	mat4x4 shadow_model_view;
-	mat4x4 shadow_proj;
 	vec4 sun;
 	vec4 rel_cam_pos;
 };
 
+/// For the shadow pass, one cascade at a time.
+struct ShadowCascadeConsts {
+	mat4 proj; // `GlobalUniforms::shadow_proj` of the cascade
+};
+
 struct MaterialUniforms {
 	vec4 color;
 	vec3 view_dir;
@@ -92,7 +92,6 @@ vec3 gbuffer_light() {
 	if (i_depth < 0.0001) return i_color0.rgb;
 
 	float shadow_factor = clamp(i_emissive_s.a, 0.0, 1.0);
-	shadow_factor = 0.0;
 	// return vec3(i_emissive_s.a);
 	// return vec3(shadow_factor);
 	// float i_shadow = texture(u_shadow, i_uv).r;
@@ -13,6 +13,7 @@
 layout (location = 0) in vec3 i_position;
 layout (location = 1) in vec2 i_normal_oct;
 layout (location = 2) in float i_tangent_dia;
+layout (location = 3) in vec3 i_morph_target; // position on the coarser LOD
 
 layout (location = 0) out vec3 o_normal;
 
@@ -57,7 +58,7 @@ float calculate_height_at(float lat, float lon) {
 
 void main() {
 	o_normal = oct_to_float32x3(i_normal_oct);
-	vec3 position = i_position;
+	vec3 position = mix(i_position, i_morph_target, mesh.lod_morph);
 	vec3 dir = normalize(position);
 	float lat, lon;
 	vec3 norm;
@@ -17,7 +17,7 @@ layout (location = 2) in vec2 i_texcoord;
 layout (location = 3) in vec3 i_tbn_tangent;
 layout (location = 4) in vec3 i_tbn_bitangent;
 layout (location = 5) in vec3 i_tbn_normal;
-layout (location = 6) in vec4 i_shadow_fragcoord;
+layout (location = 6) in vec3 i_shadow_position;
 layout (location = 7) in vec4 i_fragcoord;
 // layout (location = 3) in vec3 i_tangent_sun_dir;
 // layout (location = 4) in vec3 i_tangent_cam_pos;
@@ -26,7 +26,7 @@ layout (location = 7) in vec4 i_fragcoord;
 
 layout (set = 0, binding = 0) uniform readonly BUFFER(GlobalUniforms, global);
 layout (set = 1, binding = 0) uniform readonly BUFFER(StdMaterialUniforms, material);
-layout (set = 2, binding = 0) uniform readonly BUFFER(StdMeshUniforms, mesh);
+layout (set = 2, binding = 0) readonly buffer INSTANCES(StdMeshUniforms, meshes);
 layout (set = 1, binding = 1) uniform SAMPLER(_2D, texture_diffuse);
 layout (set = 1, binding = 2) uniform SAMPLER(_2D, texture_ao_rough_metal);
 layout (set = 1, binding = 3) uniform SAMPLER(_2D, texture_normal);
@@ -55,20 +55,16 @@ float linearize_depth(float depth) {
 	return global.camera.w / depth;
 }
 
-float sample_3x3_tent(sampler2D i_tex, vec2 uv) {
-	vec2 o = vec2(1.0, 1.0) / vec2(textureSize(i_tex, 0));
-	float a = texture(i_tex, uv + vec2(-o.x,  o.y)).r;
-	float b = texture(i_tex, uv + vec2(   0,  o.y)).r;
-	float c = texture(i_tex, uv + vec2( o.x,  o.y)).r;
-	float d = texture(i_tex, uv + vec2(-o.x,    0)).r;
-	float e = texture(i_tex, uv + vec2(   0,    0)).r;
-	float f = texture(i_tex, uv + vec2( o.x,    0)).r;
-	float g = texture(i_tex, uv + vec2(-o.x, -o.y)).r;
-	float h = texture(i_tex, uv + vec2(   0, -o.y)).r;
-	float i = texture(i_tex, uv + vec2( o.x, -o.y)).r;
-
-	return ((a + c + g + i) + (b + d + f + h) * 2.0 + e * 4.0) / 16.0;
-	return e;
+/// How much of the 3x3 texels around `texel` are lit at `depth` (the map keeps the depths nearest to the light).
+float sample_3x3_tent(sampler2D i_tex, ivec2 texel, float depth) {
+	float lit = 0.0;
+	for (int y = -1; y <= 1; ++y) {
+		for (int x = -1; x <= 1; ++x) {
+			float weight = (2.0 - abs(float(x))) * (2.0 - abs(float(y)));
+			lit += weight * float(depth >= texelFetch(i_tex, texel + ivec2(x, y), 0).r);
+		}
+	}
+	return lit / 16.0;
 }
 
 // float fetch_shadow_map(vec2 pos) {
@@ -78,14 +74,23 @@ float sample_3x3_tent(sampler2D i_tex, vec2 uv) {
 // 	return res;
 // }
 
+/// 1 where lit, 0 in shadow. Beyond the last cascade everything is lit.
 float compute_shadow(out vec3 extra, in vec3 normal) {
-	vec3 shadow_coord = i_shadow_fragcoord.xyz / i_shadow_fragcoord.w;
-	float shadow_depth = sample_3x3_tent(shadow_map, shadow_coord.xy * 0.5 + 0.5);
-	shadow_depth = 1.0 / (1 - shadow_depth) - 1.0;
-	float current_depth = i_shadow_fragcoord.z / i_shadow_fragcoord.w;
+	// `i_fragcoord.w` is the view depth.
+	uint cascade = 0;
+	while (cascade < SHADOW_CASCADE_COUNT && i_fragcoord.w > global.shadow_splits[cascade]) ++cascade;
+	if (cascade == SHADOW_CASCADE_COUNT) return 1.0;
+
+	vec3 shadow_coord = (global.shadow_proj[cascade] * vec4(i_shadow_position, 1.0)).xyz;
 	extra = shadow_coord;
-	float bias = clamp(0.01 * (-dot(global.sun.xyz, normal)), 0.0, 0.01);
-	return float(current_depth - bias > shadow_depth);
+	int size = textureSize(shadow_map, 0).x / 2;
+	ivec2 tile = ivec2(cascade % 2, cascade / 2) * size;
+	// the tent's taps stay inside the cascade's tile.
+	ivec2 texel = clamp(ivec2((shadow_coord.xy * 0.5 + 0.5) * float(size)), ivec2(1), ivec2(size - 2));
+	// a texel's worth of depth, more where the surface is steep to the light.
+	float n_dot_l = clamp(dot(global.sun.xyz, normal), 0.1, 1.0);
+	float bias = global.shadow_biases[cascade] * (1.0 + sqrt(1.0 - n_dot_l * n_dot_l) / n_dot_l);
+	return sample_3x3_tent(shadow_map, tile + texel, shadow_coord.z + bias);
 }
 
 void main() {
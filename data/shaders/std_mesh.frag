@@ -17,7 +17,7 @@ layout (location = 6) in vec3 i_tangent_normal;
 
 layout (set = 0, binding = 0) uniform readonly BUFFER(GlobalUniforms, global);
 layout (set = 1, binding = 0) uniform readonly BUFFER(StdMaterialUniforms, material);
-layout (set = 2, binding = 0) uniform readonly BUFFER(StdMeshUniforms, mesh);
+layout (set = 2, binding = 0) readonly buffer INSTANCES(StdMeshUniforms, meshes);
 layout (set = 1, binding = 1) uniform SAMPLER(_2D, texture_diffuse);
 layout (set = 1, binding = 2) uniform SAMPLER(_2D, texture_ao_rough_metal);
 layout (set = 1, binding = 3) uniform SAMPLER(_2D, texture_normal);
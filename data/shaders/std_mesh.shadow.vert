@@ -9,11 +9,10 @@ layout (location = 3) in vec2 i_texcoord;
 
 layout (location = 0) out vec4 o_clip_pos;
 
-layout (set = 0, binding = 0) uniform readonly BUFFER(StdMeshUniforms, mesh);
+layout (set = 0, binding = 0) readonly buffer INSTANCES(StdMeshUniforms, meshes);
+layout (push_constant) uniform BUFFER(ShadowCascadeConsts, cascade);
 
 void main() {
-	vec4 clip_pos = mesh.shadow_proj * mesh.shadow_model_view * vec4(i_position, 1.0);
-	clip_pos.z = 1.0 - 1.0 / (1.0 + clip_pos.z);
-	// inverse: z = 1 / (1 - z') - 1
-	gl_Position = o_clip_pos = clip_pos;
+	StdMeshUniforms mesh = meshes[gl_InstanceIndex];
+	gl_Position = o_clip_pos = cascade.proj * mesh.model * vec4(i_position, 1.0);
 }
@@ -15,7 +15,7 @@ layout (location = 2) out vec2 o_texcoord;
 layout (location = 3) out vec3 o_tbn_tangent;
 layout (location = 4) out vec3 o_tbn_bitangent;
 layout (location = 5) out vec3 o_tbn_normal;
-layout (location = 6) out vec4 o_shadow_fragcoord;
+layout (location = 6) out vec3 o_shadow_position; // relative to the render origin
 layout (location = 7) out vec4 o_fragcoord;
 
 // layout (location = 3) out vec3 o_tangent_sun_dir;
@@ -24,7 +24,7 @@ layout (location = 7) out vec4 o_fragcoord;
 // layout (location = 6) out vec3 o_tangent_normal;
 
 layout (set = 0, binding = 0) uniform readonly BUFFER(GlobalUniforms, global);
-layout (set = 2, binding = 0) uniform readonly BUFFER(StdMeshUniforms, mesh);
+layout (set = 2, binding = 0) readonly buffer INSTANCES(StdMeshUniforms, meshes);
 
 vec2 sign_not_zero(vec2 v) {
 	return vec2(
@@ -70,8 +70,11 @@ vec3 decode_tangent(vec3 normal, float diamond_tangent) {
 }
 
 void main() {
+	StdMeshUniforms mesh = meshes[gl_InstanceIndex];
 	o_normal = oct_to_float32x3(i_normal_oct);
-	vec3 tangent = decode_tangent(o_normal, i_tangent_dia);
+	// the sign is the bitangent sign, the magnitude the diamond plus 1 (see `encode_signed_tangent`).
+	float bitangent_sign = i_tangent_dia < 0.0 ? -1.0 : 1.0;
+	vec3 tangent = decode_tangent(o_normal, abs(i_tangent_dia) - 1.0);
 	o_texcoord = i_texcoord;
 
 	// mat3 unscaled_model = transpose(inverse(mat3(mesh.unscaled_model)));
@@ -81,13 +84,12 @@ void main() {
 	vec3 T = normalize((mesh.unscaled_model * vec4(tangent, 0.0)).xyz);
 	vec3 N = normalize((mesh.unscaled_model * vec4(o_normal, 0.0)).xyz);
 	T = normalize(T - dot(T, N) * N);
-	vec3 B = cross(N, T);
+	vec3 B = cross(N, T) * bitangent_sign;
 	o_tbn_tangent = T;
 	o_tbn_bitangent = B;
 	o_tbn_normal = N;
 
-	o_shadow_fragcoord = mesh.shadow_proj * mesh.shadow_model_view * vec4(i_position, 1.0);
-	// o_shadow_fragcoord.z = 1.0 - 1.0 / (o_shadow_fragcoord.z + 1.0);
+	o_shadow_position = (mesh.model * vec4(i_position, 1.0)).xyz;
 
 	// mat3 TBN = mat3(T, B, N);
 	// o_tbn = TBN;
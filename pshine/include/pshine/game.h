@@ -106,6 +106,8 @@ struct pshine_surface_info {
 	char *lights_texture_path_own;
 	char *spec_texture_path_own;
 	char *heightmap_texture_path_own;
+	/// The height of a white heightmap texel, in m. If 0, the terrain is a perfect sphere.
+	double heightmap_scale;
 };
 
 enum pshine_environment_projection_type {
@@ -117,6 +119,8 @@ struct pshine_environment_info {
 	enum pshine_environment_projection_type type;
 };
 
+struct pshine_height_pyramid;
+
 struct pshine_celestial_body {
 	enum pshine_celestial_body_type type;
 	struct pshine_celestial_body *parent_ref;
@@ -172,6 +176,9 @@ struct pshine_celestial_body {
 
 	/// Name of parent_ref, used during initialization, might be invalid.
 	char *tmp_parent_ref_name_own;
+
+	/// The terrain heights for collisions, `nullptr` if the surface is flat.
+	struct pshine_height_pyramid *height_pyramid_own;
 };
 
 struct pshine_named_constituent {
@@ -267,6 +274,9 @@ struct pshine_ship {
 	double closest_body_distance;
 	struct pshine_celestial_body *closest_body;
 
+	/// Height above the terrain of `closest_body`, in meters.
+	double closest_body_altitude;
+
 	bool is_warp_safe;
 };
 
@@ -279,6 +289,7 @@ typedef struct { pshine_unorm32 x, y; } pshine_unorm32x2;
 
 struct pshine_static_mesh_vertex {
 	float position[3];
+	/// The diamond-encoded tangent plus 1, negated if the bitangent is `-cross(normal, tangent)`.
 	float tangent_dia;
 	float normal_oct[2];
 	float texcoord[2];
@@ -288,6 +299,9 @@ struct pshine_planet_vertex {
 	float position[3];
 	float tangent_dia;
 	float normal_oct[2];
+	/// The position of this vertex on the next coarser LOD's surface,
+	/// the vertex shader blends towards it before the LOD switches (geomorphing).
+	float morph_target[3];
 };
 
 enum pshine_vertex_type {
@@ -317,10 +331,28 @@ void pshine_generate_planet_mesh(
 	size_t lod
 );
 
+enum pshine_present_mode {
+	/// Wait for the vertical blank, always supported.
+	PSHINE_PRESENT_MODE_FIFO,
+	/// Replace the image waiting for the vertical blank, without tearing.
+	PSHINE_PRESENT_MODE_MAILBOX,
+	/// Present right away, which can tear.
+	PSHINE_PRESENT_MODE_IMMEDIATE,
+	PSHINE_PRESENT_MODE_COUNT_,
+};
+
+#define PSHINE_MAX_FRAMES_IN_FLIGHT 4
+
 struct pshine_render_settings {
 	bool render_ships;
 	bool do_bloom;
 	uint32_t window_width, window_height;
+	/// How many frames the CPU can record ahead of the GPU, 1 to `PSHINE_MAX_FRAMES_IN_FLIGHT`.
+	uint32_t frames_in_flight;
+	/// FIFO is used instead if the surface doesn't support it.
+	enum pshine_present_mode present_mode;
+	/// Wait for the last frame to be on screen before reading the input (needs `VK_KHR_present_wait`).
+	bool low_latency;
 };
 
 struct pshine_renderer {
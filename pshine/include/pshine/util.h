@@ -155,6 +155,31 @@ void pshine_set_cwd_to_exe();
 // in KiB
 size_t pshine_get_mem_usage();
 
+/// Number of logical CPU cores, at least 1.
+size_t pshine_get_cpu_count();
+
+typedef struct pshine_thread_ *pshine_thread;
+
+/// Start a new thread that runs `fn(user)`.
+pshine_thread pshine_thread_start(void (*fn)(void *user), void *user);
+
+/// Wait for the thread to finish, and free it.
+void pshine_thread_join(pshine_thread thread);
+
+typedef struct pshine_semaphore_ *pshine_semaphore;
+
+/// Create a counting semaphore with `count` permits.
+pshine_semaphore pshine_semaphore_create(uint32_t count);
+
+/// Free the semaphore, nobody may be waiting on it.
+void pshine_semaphore_destroy(pshine_semaphore sem);
+
+/// Add `count` permits, waking up as many waiting threads.
+void pshine_semaphore_post(pshine_semaphore sem, uint32_t count);
+
+/// Wait for a permit and take it.
+void pshine_semaphore_wait(pshine_semaphore sem);
+
 typedef void (*pshine_rbuf_item_deinit_fn)(void *item, void *user);
 
 /// A ring buffer
@@ -0,0 +1,1196 @@
+#include "atmosphere.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "psmath.h"
+
+void pshine_atmo_screen_rect(
+	const double position[static 3],
+	const double right[static 3],
+	const double up[static 3],
+	const double forward[static 3],
+	double tan_x,
+	double tan_y,
+	const double center[static 3],
+	double radius,
+	float rect[static 4]
+) {
+	double3 c = double3sub(double3vs(center), double3vs(position));
+	double z = double3dot(c, double3vs(forward));
+	double ndc_min[2] = { -1.0, -1.0 }, ndc_max[2] = { 1.0, 1.0 };
+	if (z > radius) {
+		const double *axes[2] = { right, up };
+		double tans[2] = { tan_x, tan_y };
+		for (size_t i = 0; i < 2; ++i) {
+			// the sphere's silhouette in the plane of this axis and the forward one is between
+			// the two tangents from the camera, `delta` on either side of the center.
+			double x = double3dot(c, double3vs(axes[i]));
+			double angle = atan2(x, z), delta = asin(fmin(radius / sqrt(x * x + z * z), 1.0));
+			ndc_min[i] = fmax(tan(angle - delta) / tans[i], -1.0);
+			ndc_max[i] = fmin(tan(angle + delta) / tans[i], 1.0);
+			if (ndc_max[i] < ndc_min[i]) ndc_max[i] = ndc_min[i];
+		}
+	}
+	// NDC Y is up, texture coordinates go down.
+	rect[0] = (float)(ndc_min[0] * 0.5 + 0.5);
+	rect[1] = (float)(0.5 - ndc_max[1] * 0.5);
+	rect[2] = (float)((ndc_max[0] - ndc_min[0]) * 0.5);
+	rect[3] = (float)((ndc_max[1] - ndc_min[1]) * 0.5);
+}
+
+size_t pshine_atmo_pixel_rects(
+	size_t count,
+	const float rects[][4],
+	uint32_t width,
+	uint32_t height,
+	uint32_t out[][4]
+) {
+	// `x0, y0, x1, y1` until the end.
+	size_t out_count = 0;
+	for (size_t i = 0; i < count; ++i) {
+		uint32_t bounds[4] = {
+			(uint32_t)fmax(floor(rects[i][0] * (double)width), 0.0),
+			(uint32_t)fmax(floor(rects[i][1] * (double)height), 0.0),
+			(uint32_t)fmin(ceil((rects[i][0] + rects[i][2]) * (double)width), width),
+			(uint32_t)fmin(ceil((rects[i][1] + rects[i][3]) * (double)height), height),
+		};
+		if (bounds[0] >= bounds[2] || bounds[1] >= bounds[3]) continue;
+		memcpy(out[out_count++], bounds, sizeof(bounds));
+	}
+	// the bounds of two rectangles can overlap a third one that neither did.
+	for (bool merged = true; merged;) {
+		merged = false;
+		for (size_t i = 0; i < out_count; ++i) {
+			for (size_t j = i + 1; j < out_count; ++j) {
+				uint32_t *a = out[i], *b = out[j];
+				if (a[0] >= b[2] || b[0] >= a[2] || a[1] >= b[3] || b[1] >= a[3]) continue;
+				a[0] = a[0] < b[0] ? a[0] : b[0];
+				a[1] = a[1] < b[1] ? a[1] : b[1];
+				a[2] = a[2] > b[2] ? a[2] : b[2];
+				a[3] = a[3] > b[3] ? a[3] : b[3];
+				// the last one takes `j`'s place, and is checked next.
+				memcpy(out[j--], out[--out_count], sizeof(*out));
+				merged = true;
+			}
+		}
+	}
+	for (size_t i = 0; i < out_count; ++i) {
+		out[i][2] -= out[i][0];
+		out[i][3] -= out[i][1];
+	}
+	return out_count;
+}
+
+void pshine_atmo_jitter(size_t frame, uint32_t divisor, uint32_t jitter[static 2]) {
+	uint32_t n = frame % (divisor * divisor);
+	for (uint32_t y = 0; y < divisor; ++y) {
+		for (uint32_t x = 0; x < divisor; ++x) {
+			// M(2k) is 4 M(k) of the low bits of `x, y` plus M(2) of their high bit, so the lowest
+			// bits make the highest digit.
+			uint32_t value = 0;
+			for (uint32_t bit = 1; bit < divisor; bit <<= 1) {
+				uint32_t bx = !!(x & bit), by = !!(y & bit);
+				value = value * 4 + 2 * (bx ^ by) + by;
+			}
+			if (value == n) {
+				jitter[0] = x;
+				jitter[1] = y;
+				return;
+			}
+		}
+	}
+	jitter[0] = jitter[1] = 0;
+}
+
+// The rest mirrors the shaders, function by function (see `atmo_common.glsl`), in doubles.
+
+static const double MAX_DISTANCE = 3.402823466e+38;
+
+struct atmo_medium {
+	double planet_radius;
+	double falloffs[2];
+	double3 k_ray;
+	double k_mie;
+	double k_mie_ext;
+	double mie_g;
+};
+
+/// An RGBA texture with linear filtering and clamped coordinates.
+struct test_lut {
+	uint32_t width, height, depth;
+	float (*texels_own)[4];
+};
+
+static struct test_lut make_test_lut(uint32_t width, uint32_t height, uint32_t depth) {
+	return (struct test_lut){
+		width, height, depth,
+		calloc((size_t)width * height * depth, sizeof(float[4])),
+	};
+}
+
+static float *test_lut_texel(const struct test_lut *lut, uint32_t x, uint32_t y, uint32_t z) {
+	return lut->texels_own[((size_t)z * lut->height + y) * lut->width + x];
+}
+
+static void sample_test_lut(const struct test_lut *lut, double u, double v, double w, double out[static 4]) {
+	double coords[3] = { u * lut->width - 0.5, v * lut->height - 0.5, w * lut->depth - 0.5 };
+	uint32_t sizes[3] = { lut->width, lut->height, lut->depth };
+	uint32_t i0[3], i1[3];
+	double f[3];
+	for (size_t k = 0; k < 3; ++k) {
+		double c = clampd(coords[k], 0.0, sizes[k] - 1.0);
+		i0[k] = (uint32_t)c;
+		i1[k] = i0[k] + 1 < sizes[k] ? i0[k] + 1 : i0[k];
+		f[k] = c - i0[k];
+	}
+	for (size_t c = 0; c < 4; ++c) out[c] = 0.0;
+	for (uint32_t corner = 0; corner < 8; ++corner) {
+		double weight = 1.0;
+		uint32_t idx[3];
+		for (size_t k = 0; k < 3; ++k) {
+			bool upper = (corner >> k) & 1;
+			idx[k] = upper ? i1[k] : i0[k];
+			weight *= upper ? f[k] : 1.0 - f[k];
+		}
+		const float *texel = test_lut_texel(lut, idx[0], idx[1], idx[2]);
+		for (size_t c = 0; c < 4; ++c) out[c] += weight * texel[c];
+	}
+}
+
+static double2 intersect_ray_sphere(double sphere_radius, double3 ray_origin, double3 ray_dir) {
+	double b = double3dot(ray_origin, ray_dir);
+	double c = double3dot(ray_origin, ray_origin) - sphere_radius * sphere_radius;
+	double d = b * b - c;
+	if (d >= 0.0) {
+		double s = sqrt(d);
+		double near = fmax(0.0, -b - s);
+		double far = -b + s;
+		if (far >= 0.0) return double2xy(near, far - near);
+	}
+	return double2xy(MAX_DISTANCE, 0.0);
+}
+
+static double compute_density(double3 rel_pos, double falloff, double planet_radius, double atmo_height) {
+	double h = fmax(double3mag(rel_pos) - planet_radius, 0.0) / atmo_height;
+	return exp(-h * falloff) * (1.0 - h);
+}
+
+static double phase_mie(double g, double c, double cc) {
+	double gg = g * g;
+	double a = (1.0 - gg) * (1.0 + cc);
+	double b = 1.0 + gg - 2.0 * g * c;
+	b *= sqrt(b);
+	b *= 2.0 + gg;
+	return (3.0 / 8.0 / π) * a / b;
+}
+
+static double phase_ray(double cc) {
+	return (3.0 / (16.0 * π)) * (1.0 + cc);
+}
+
+static double2 atmo_density(const struct atmo_medium *m, double3 p) {
+	double atmo_height = 1.0 - m->planet_radius;
+	return double2xy(
+		compute_density(p, m->falloffs[0], m->planet_radius, atmo_height),
+		compute_density(p, m->falloffs[1], m->planet_radius, atmo_height)
+	);
+}
+
+static double3 atmo_extinction(const struct atmo_medium *m, double2 density) {
+	return double3add(double3mul(m->k_ray, density.x), double3v(m->k_mie_ext * density.y));
+}
+
+static double3 double3exp_neg(double3 v) {
+	return double3xyz(exp(-v.x), exp(-v.y), exp(-v.z));
+}
+
+static double3 double3mulv(double3 a, double3 b) {
+	return double3xyz(a.x * b.x, a.y * b.y, a.z * b.z);
+}
+
+/// `atmo_lut.comp`
+static void compute_transmittance_lut(const struct atmo_medium *m, uint32_t samples, struct test_lut *lut) {
+	double atmo_height = 1.0 - m->planet_radius;
+	for (uint32_t y = 0; y < lut->height; ++y) {
+		for (uint32_t x = 0; x < lut->width; ++x) {
+			double zen = (x + 0.5) / lut->width * 2.0 - 1.0;
+			double alt = (y + 0.5) / lut->height * atmo_height;
+			double3 ray_start = double3xyz(0.0, alt + m->planet_radius, 0.0);
+			double3 ray_dir = double3neg(double3norm(double3xyz(sqrt(1.0 - zen * zen), zen, 0.0)));
+			double ray_len = intersect_ray_sphere(1.0, ray_start, ray_dir).y;
+			double step_len = ray_len / samples;
+			double2 sum = double2v0();
+			double3 p = ray_start;
+			for (uint32_t i = 0; i < samples; ++i, p = double3add(p, double3mul(ray_dir, step_len))) {
+				sum = double2add(sum, atmo_density(m, p));
+			}
+			float *texel = test_lut_texel(lut, x, y, 0);
+			texel[0] = (float)(sum.x * step_len);
+			texel[1] = (float)(sum.y * step_len);
+		}
+	}
+}
+
+static double atmo_height_of(const struct atmo_medium *m, double r) {
+	return clampd((r - m->planet_radius) / (1.0 - m->planet_radius), 0.0, 1.0);
+}
+
+static double3 atmo_sun_transmittance(const struct atmo_medium *m, const struct test_lut *lut, double3 p, double3 sun) {
+	double r = double3mag(p);
+	double od[4];
+	sample_test_lut(lut, 0.5 - 0.5 * double3dot(double3div(p, r), sun), atmo_height_of(m, r), 0.5, od);
+	return double3exp_neg(atmo_extinction(m, double2xy(od[0], od[1])));
+}
+
+static double3 atmo_multiscatter(const struct atmo_medium *m, const struct test_lut *lut, double3 p, double3 sun) {
+	double r = double3mag(p);
+	double ms[4];
+	sample_test_lut(lut, 0.5 + 0.5 * double3dot(double3div(p, r), sun), atmo_height_of(m, r), 0.5, ms);
+	return double3xyz(ms[0], ms[1], ms[2]);
+}
+
+/// `atmo_scatter_step`. Without `transmittance_lut`, the sun's transmittance is integrated.
+static void atmo_scatter_step(
+	const struct atmo_medium *m,
+	const struct test_lut *transmittance_lut,
+	const struct test_lut *multiscatter_lut,
+	double3 p,
+	double3 sun,
+	double2 phases,
+	double dt,
+	double3 *radiance,
+	double3 *throughput
+) {
+	double2 density = atmo_density(m, p);
+	double3 scattering_ray = double3mul(m->k_ray, density.x);
+	double3 scattering_mie = double3v(m->k_mie * density.y);
+	double3 extinction = double3max(atmo_extinction(m, density), double3v(1e-7));
+	double3 sun_transmittance;
+	if (transmittance_lut) {
+		sun_transmittance = atmo_sun_transmittance(m, transmittance_lut, p, sun);
+	} else {
+		enum : uint32_t { SUN_SAMPLES = 150 };
+		double sun_len = intersect_ray_sphere(1.0, p, sun).y / SUN_SAMPLES;
+		double2 optical_depth = double2v0();
+		for (uint32_t i = 0; i < SUN_SAMPLES; ++i)
+			optical_depth = double2add(optical_depth, atmo_density(m, double3add(p, double3mul(sun, (i + 0.5) * sun_len))));
+		sun_transmittance = double3exp_neg(atmo_extinction(m, double2mul(optical_depth, sun_len)));
+	}
+	double3 multiscatter = atmo_multiscatter(m, multiscatter_lut, p, sun);
+	double3 source = double3add(
+		double3mulv(double3add(double3mul(scattering_ray, phases.x), double3mul(scattering_mie, phases.y)), sun_transmittance),
+		double3mulv(double3add(scattering_ray, scattering_mie), multiscatter)
+	);
+	double3 step_transmittance = double3exp_neg(double3mul(extinction, dt));
+	double3 integral = double3xyz(
+		(1.0 - step_transmittance.x) / extinction.x,
+		(1.0 - step_transmittance.y) / extinction.y,
+		(1.0 - step_transmittance.z) / extinction.z
+	);
+	*radiance = double3add(*radiance, double3mulv(double3mulv(*throughput, source), integral));
+	*throughput = double3mulv(*throughput, step_transmittance);
+}
+
+static double2 atmo_phases(double mie_g, double c) {
+	return double2xy(phase_ray(c * c), phase_mie(mie_g, -c, c * c));
+}
+
+enum : uint32_t {
+	MULTISCATTER_ELEVATIONS = 128,
+	MULTISCATTER_AZIMUTHS = 4,
+	MULTISCATTER_SAMPLES = 20,
+};
+
+/// A texel of `atmo_multiscatter.comp`, at height `h` (0 to 1) with the sun at `mu` (the cosine of its
+/// zenith angle), from `elevations` by `azimuths` rays of `samples` steps each.
+static double3 atmo_multiscatter_texel(
+	const struct atmo_medium *m,
+	const struct test_lut *transmittance_lut,
+	double mu,
+	double h,
+	uint32_t elevations,
+	uint32_t azimuths,
+	uint32_t samples
+) {
+	double3 p = double3xyz(0.0, m->planet_radius + h * (1.0 - m->planet_radius), 0.0);
+	double3 sun = double3xyz(sqrt(fmax(1.0 - mu * mu, 0.0)), mu, 0.0);
+	double3 radiance = double3v0(), transfer = double3v0();
+	for (uint32_t i = 0; i < elevations * azimuths; ++i) {
+		double cos_theta = 1.0 - 2.0 * (i / azimuths + 0.5) / elevations;
+		double sin_theta = sqrt(fmax(1.0 - cos_theta * cos_theta, 0.0));
+		double phi = 2.0 * π * (i % azimuths + 0.5) / azimuths;
+		double3 dir = double3xyz(sin_theta * cos(phi), cos_theta, sin_theta * sin(phi));
+		double t_max = intersect_ray_sphere(1.0, p, dir).y;
+		double2 ground = intersect_ray_sphere(m->planet_radius, p, dir);
+		if (ground.x < MAX_DISTANCE) t_max = fmin(t_max, ground.x);
+		double dt = t_max / samples;
+		double3 throughput = double3v(1.0);
+		for (uint32_t s = 0; s < samples; ++s) {
+			double3 q = double3add(p, double3mul(dir, (s + 0.5) * dt));
+			double2 density = atmo_density(m, q);
+			double3 scattering = double3add(double3mul(m->k_ray, density.x), double3v(m->k_mie * density.y));
+			double3 extinction = double3max(atmo_extinction(m, density), double3v(1e-7));
+			double3 step_transmittance = double3exp_neg(double3mul(extinction, dt));
+			double3 integral = double3mulv(double3mulv(throughput, scattering), double3xyz(
+				(1.0 - step_transmittance.x) / extinction.x,
+				(1.0 - step_transmittance.y) / extinction.y,
+				(1.0 - step_transmittance.z) / extinction.z
+			));
+			double3 sun_transmittance = atmo_sun_transmittance(m, transmittance_lut, q, sun);
+			radiance = double3add(radiance, double3mul(double3mulv(integral, sun_transmittance), 1.0 / (4.0 * π)));
+			transfer = double3add(transfer, integral);
+			throughput = double3mulv(throughput, step_transmittance);
+		}
+	}
+	double n = elevations * azimuths;
+	radiance = double3div(radiance, n);
+	transfer = double3div(transfer, n);
+	return double3xyz(
+		radiance.x / (1.0 - fmin(transfer.x, 0.99)),
+		radiance.y / (1.0 - fmin(transfer.y, 0.99)),
+		radiance.z / (1.0 - fmin(transfer.z, 0.99))
+	);
+}
+
+/// `atmo_multiscatter.comp`
+static void compute_multiscatter_lut(const struct atmo_medium *m, const struct test_lut *transmittance_lut, struct test_lut *lut) {
+	for (uint32_t y = 0; y < lut->height; ++y) {
+		for (uint32_t x = 0; x < lut->width; ++x) {
+			double mu = (x + 0.5) / lut->width * 2.0 - 1.0;
+			double h = (y + 0.5) / lut->height;
+			double3 ms = atmo_multiscatter_texel(m, transmittance_lut, mu, h,
+				MULTISCATTER_ELEVATIONS, MULTISCATTER_AZIMUTHS, MULTISCATTER_SAMPLES);
+			float *texel = test_lut_texel(lut, x, y, 0);
+			texel[0] = (float)ms.x;
+			texel[1] = (float)ms.y;
+			texel[2] = (float)ms.z;
+		}
+	}
+}
+
+static void atmo_sky_view_basis(double3 up, double3 sun, double3 *sun_side, double3 *other_side) {
+	double3 s = double3sub(sun, double3mul(up, double3dot(sun, up)));
+	if (double3dot(s, s) < 1e-8) s = double3cross(up, fabs(up.x) < 0.9 ? double3xyz(1, 0, 0) : double3xyz(0, 1, 0));
+	*sun_side = double3norm(s);
+	*other_side = double3cross(up, *sun_side);
+}
+
+static double2 atmo_sky_view_angles(double planet_radius, double distance) {
+	distance = fmax(distance, planet_radius * 1.00001);
+	double horizon = asin(planet_radius / distance);
+	double edge = distance > 1.0 ? asin(1.0 / distance) : π;
+	return double2xy(horizon, fmax(edge, horizon * 1.00001));
+}
+
+static double atmo_sky_view_nadir_angle(double2 angles, double y) {
+	if (y < 0.5) {
+		double s = 1.0 - 2.0 * y;
+		return angles.x * (1.0 - s * s);
+	}
+	double s = 2.0 * y - 1.0;
+	return angles.x + (angles.y - angles.x) * s * s;
+}
+
+static double atmo_sky_view_y(double2 angles, double nadir_angle) {
+	if (nadir_angle < angles.x) return 0.5 - 0.5 * sqrt(fmax(1.0 - nadir_angle / angles.x, 0.0));
+	return 0.5 + 0.5 * sqrt(clampd((nadir_angle - angles.x) / (angles.y - angles.x), 0.0, 1.0));
+}
+
+static double atmo_aerial_w(double entry, double end, double t) {
+	return clampd((t - entry) / (end - entry), 0.0, 1.0);
+}
+
+/// A camera looking at the planet, in the atmosphere's space.
+struct test_view {
+	double3 position, right, up, forward;
+	double tan_x, tan_y;
+	double3 sun;
+	float aerial_rect[4];
+};
+
+/// `atmo_near_plane_ray`, with the near plane 1 away.
+static double3 test_view_near_plane_ray(const struct test_view *view, double u, double v) {
+	double2 ndc = double2xy(u * 2.0 - 1.0, 1.0 - v * 2.0);
+	return double3add(view->forward, double3add(
+		double3mul(view->up, ndc.y * view->tan_y),
+		double3mul(view->right, ndc.x * view->tan_x)
+	));
+}
+
+/// `atmo_view_ray`
+static double3 test_view_ray(const struct test_view *view, double u, double v) {
+	return double3norm(test_view_near_plane_ray(view, u, v));
+}
+
+/// The light along a ray from `origin` through the atmosphere, up to `t_max`: the in-scattered
+/// radiance, and the mean transmittance.
+static void ray_march(
+	const struct atmo_medium *m,
+	const struct test_lut *transmittance_lut,
+	const struct test_lut *multiscatter_lut,
+	double3 origin,
+	double3 dir,
+	double3 sun,
+	double t_min,
+	double t_max,
+	uint32_t samples,
+	double3 *radiance,
+	double3 *throughput
+) {
+	double2 phases = atmo_phases(m->mie_g, double3dot(dir, sun));
+	double dt = (t_max - t_min) / samples;
+	for (uint32_t s = 0; s < samples && dt > 0.0; ++s) {
+		double3 p = double3add(origin, double3mul(dir, t_min + (s + 0.5) * dt));
+		atmo_scatter_step(m, transmittance_lut, multiscatter_lut, p, sun, phases, dt, radiance, throughput);
+	}
+}
+
+/// `atmo_sky_view.comp`
+static void compute_sky_view_lut(
+	const struct atmo_medium *m,
+	const struct test_lut *transmittance_lut,
+	const struct test_lut *multiscatter_lut,
+	const struct test_view *view,
+	struct test_lut *lut
+) {
+	double distance = double3mag(view->position);
+	double3 up = double3div(view->position, distance), sun_side, other_side;
+	atmo_sky_view_basis(up, view->sun, &sun_side, &other_side);
+	double2 angles = atmo_sky_view_angles(m->planet_radius, distance);
+	for (uint32_t y = 0; y < lut->height; ++y) {
+		for (uint32_t x = 0; x < lut->width; ++x) {
+			double azimuth = π * x / (lut->width - 1.0);
+			double nadir_angle = atmo_sky_view_nadir_angle(angles, y / (lut->height - 1.0));
+			double3 dir = double3add(double3mul(up, -cos(nadir_angle)), double3mul(double3add(
+				double3mul(sun_side, cos(azimuth)),
+				double3mul(other_side, sin(azimuth))
+			), sin(nadir_angle)));
+			double2 atmo_hit = intersect_ray_sphere(1.0, view->position, dir);
+			double2 ground_hit = intersect_ray_sphere(m->planet_radius, view->position, dir);
+			double3 radiance = double3v0(), throughput = double3v(1.0);
+			if (atmo_hit.x < MAX_DISTANCE) {
+				// from inside the atmosphere, most of the light comes from close to the camera,
+				// so the steps get longer away from it.
+				bool inside = distance < 1.0;
+				double2 phases = atmo_phases(m->mie_g, double3dot(dir, view->sun));
+				double path_len = fmin(atmo_hit.x + atmo_hit.y, ground_hit.x) - atmo_hit.x;
+				for (uint32_t s = 0; s < PSHINE_ATMO_SKY_VIEW_SAMPLES; ++s) {
+					double t0 = (double)s / PSHINE_ATMO_SKY_VIEW_SAMPLES, t1 = (s + 1.0) / PSHINE_ATMO_SKY_VIEW_SAMPLES;
+					if (inside) t0 *= t0, t1 *= t1;
+					t0 *= path_len;
+					t1 *= path_len;
+					double3 p = double3add(view->position, double3mul(dir, atmo_hit.x + 0.5 * (t0 + t1)));
+					atmo_scatter_step(m, transmittance_lut, multiscatter_lut, p, view->sun, phases, t1 - t0,
+						&radiance, &throughput);
+				}
+			}
+			float *texel = test_lut_texel(lut, x, y, 0);
+			texel[0] = (float)radiance.x;
+			texel[1] = (float)radiance.y;
+			texel[2] = (float)radiance.z;
+			texel[3] = (float)((throughput.x + throughput.y + throughput.z) / 3.0);
+		}
+	}
+}
+
+/// `atmo_aerial.comp`
+static void compute_aerial_lut(
+	const struct atmo_medium *m,
+	const struct test_lut *transmittance_lut,
+	const struct test_lut *multiscatter_lut,
+	const struct test_view *view,
+	struct test_lut *lut
+) {
+	for (uint32_t y = 0; y < lut->height; ++y) {
+		for (uint32_t x = 0; x < lut->width; ++x) {
+			double3 dir = test_view_ray(view,
+				view->aerial_rect[0] + view->aerial_rect[2] * (x + 0.5) / lut->width,
+				view->aerial_rect[1] + view->aerial_rect[3] * (y + 0.5) / lut->height);
+			double2 atmo_hit = intersect_ray_sphere(1.0, view->position, dir);
+			double t_end = fmin(atmo_hit.x + atmo_hit.y, intersect_ray_sphere(m->planet_radius, view->position, dir).x);
+			double slice_len = (t_end - atmo_hit.x) / lut->depth;
+			double3 radiance = double3v0(), throughput = double3v(1.0);
+			for (uint32_t z = 0; z < lut->depth; ++z) {
+				if (atmo_hit.x < MAX_DISTANCE) {
+					ray_march(m, transmittance_lut, multiscatter_lut, view->position, dir, view->sun,
+						atmo_hit.x + z * slice_len, atmo_hit.x + (z + 1) * slice_len, PSHINE_ATMO_AERIAL_SAMPLES,
+						&radiance, &throughput);
+				}
+				float *texel = test_lut_texel(lut, x, y, z);
+				texel[0] = (float)radiance.x;
+				texel[1] = (float)radiance.y;
+				texel[2] = (float)radiance.z;
+				texel[3] = (float)((throughput.x + throughput.y + throughput.z) / 3.0);
+			}
+		}
+	}
+}
+
+/// `atmo.frag`: the radiance and mean transmittance along the ray through `(u, v)`, up to `depth` away.
+/// With `sky_view_lut` and `aerial_lut` from the LUTs, otherwise by ray marching.
+static void composite(
+	const struct atmo_medium *m,
+	const struct test_lut *multiscatter_lut,
+	const struct test_lut *sky_view_lut,
+	const struct test_lut *aerial_lut,
+	const struct test_view *view,
+	double u,
+	double v,
+	double depth,
+	double3 *radiance,
+	double *transmittance
+) {
+	*radiance = double3v0();
+	*transmittance = 1.0;
+	double3 dir = test_view_ray(view, u, v);
+	double2 atmo_hit = intersect_ray_sphere(1.0, view->position, dir);
+	if (atmo_hit.x == MAX_DISTANCE || depth <= atmo_hit.x) return;
+	double2 surface_hit = intersect_ray_sphere(m->planet_radius, view->position, dir);
+	double t_end = fmin(atmo_hit.x + atmo_hit.y, surface_hit.x);
+
+	if (!sky_view_lut) {
+		enum : uint32_t { REFERENCE_SAMPLES = 1000 };
+		double3 throughput = double3v(1.0);
+		ray_march(m, nullptr, multiscatter_lut, view->position, dir, view->sun,
+			atmo_hit.x, fmin(t_end, depth), REFERENCE_SAMPLES, radiance, &throughput);
+		*transmittance = (throughput.x + throughput.y + throughput.z) / 3.0;
+		return;
+	}
+
+	double texel[4];
+	double distance = double3mag(view->position);
+	if (depth < t_end) {
+		double w = atmo_aerial_w(atmo_hit.x, t_end, depth);
+		sample_test_lut(aerial_lut,
+			(u - view->aerial_rect[0]) / view->aerial_rect[2],
+			(v - view->aerial_rect[1]) / view->aerial_rect[3],
+			w - 0.5 / aerial_lut->depth, texel);
+		// the first slice fades in from nothing at the camera.
+		double fade = fmin(w * aerial_lut->depth, 1.0);
+		*radiance = double3mul(double3xyz(texel[0], texel[1], texel[2]), fade);
+		*transmittance = 1.0 + (texel[3] - 1.0) * fade;
+	} else {
+		double3 up = double3div(view->position, distance), sun_side, other_side;
+		atmo_sky_view_basis(up, view->sun, &sun_side, &other_side);
+		double nadir_angle = acos(clampd(-double3dot(dir, up), -1.0, 1.0));
+		double3 flat = double3sub(dir, double3mul(up, double3dot(dir, up)));
+		double azimuth = atan2(fabs(double3dot(flat, other_side)), double3dot(flat, sun_side));
+		double x = azimuth / π, y = atmo_sky_view_y(atmo_sky_view_angles(m->planet_radius, distance), nadir_angle);
+		sample_test_lut(sky_view_lut,
+			(0.5 + x * (sky_view_lut->width - 1.0)) / sky_view_lut->width,
+			(0.5 + y * (sky_view_lut->height - 1.0)) / sky_view_lut->height,
+			0.5, texel);
+		*radiance = double3xyz(texel[0], texel[1], texel[2]);
+		*transmittance = texel[3];
+	}
+}
+
+static double3 test_random_unit(struct pshine_pcg64_state *rng) {
+	for (;;) {
+		double3 v = double3xyz(
+			pshine_pcg64_random_double(rng) * 2.0 - 1.0,
+			pshine_pcg64_random_double(rng) * 2.0 - 1.0,
+			pshine_pcg64_random_double(rng) * 2.0 - 1.0
+		);
+		double m = double3mag2(v);
+		if (m > 1e-6 && m <= 1.0) return double3div(v, sqrt(m));
+	}
+}
+
+enum : size_t { TEST_MAX_RAY_COUNT = 100 };
+
+struct test_errors {
+	size_t count;
+	double radiance[TEST_MAX_RAY_COUNT];
+	double transmittance[TEST_MAX_RAY_COUNT];
+};
+
+static int compare_doubles(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+/// Sorts `xs`.
+static double percentile(double *xs, size_t count, double p) {
+	qsort(xs, count, sizeof(*xs), compare_doubles);
+	return xs[(size_t)(p * (count - 1) + 0.5)];
+}
+
+bool pshine_test_atmosphere() {
+	// Earth's and Venus's atmospheres from `data/celestial/solar`, in the atmosphere's space.
+	struct {
+		const char *name;
+		struct atmo_medium medium;
+	} atmospheres[] = {
+		{ "thin", {
+			.planet_radius = 6'371.0 / 6'471.0,
+			.falloffs = { 13.5, 18.0 },
+			.k_ray = { 3.8, 13.5, 33.1 },
+			.k_mie = 20.1,
+			.k_mie_ext = 20.1 * 1.1,
+			.mie_g = -0.87,
+		} },
+		{ "thick", {
+			.planet_radius = 6'051.8 / 6'310.755,
+			.falloffs = { 4.5, 2.0 },
+			.k_ray = { 433.8, 423.5, 423.1 },
+			.k_mie = 20.1,
+			.k_mie_ext = 20.1 * 1.1,
+			.mie_g = -0.87,
+		} },
+	};
+	// from the ground to far away, in atmosphere heights above the surface.
+	const double camera_heights[] = { 0.05, 0.5, 3.0, 100.0 };
+	enum : size_t { SKY_RAY_COUNT = TEST_MAX_RAY_COUNT, AERIAL_RAY_COUNT = TEST_MAX_RAY_COUNT };
+	const double MAX_MEAN_ERROR = 0.02, MAX_P90_ERROR = 0.03, MAX_P90_TRANSMITTANCE_ERROR = 0.06;
+	// The transmittance LUT is smaller than the renderer's, to keep this quick.
+	enum : uint32_t { TRANSMITTANCE_LUT_SIZE = 256, TRANSMITTANCE_SAMPLES = 1024 };
+	// The reference rays use the multiscattering LUT too, so it is checked on its own against points
+	// with many more rays and steps.
+	enum : uint32_t {
+		MULTISCATTER_POINT_COUNT = 32,
+		REFERENCE_MULTISCATTER_ELEVATIONS = 256,
+		REFERENCE_MULTISCATTER_AZIMUTHS = 16,
+		REFERENCE_MULTISCATTER_SAMPLES = 40,
+	};
+
+	struct pshine_pcg64_state rng;
+	pshine_pcg64_init(&rng, 0x853c49e6748fea9b, 0xda3e39cb94b95bdb);
+	struct test_lut transmittance_lut = make_test_lut(TRANSMITTANCE_LUT_SIZE, TRANSMITTANCE_LUT_SIZE, 1);
+	struct test_lut multiscatter_lut = make_test_lut(PSHINE_ATMO_MULTISCATTER_LUT_SIZE, PSHINE_ATMO_MULTISCATTER_LUT_SIZE, 1);
+	struct test_lut sky_view_lut = make_test_lut(PSHINE_ATMO_SKY_VIEW_LUT_WIDTH, PSHINE_ATMO_SKY_VIEW_LUT_HEIGHT, 1);
+	struct test_lut aerial_lut = make_test_lut(PSHINE_ATMO_AERIAL_LUT_SIZE, PSHINE_ATMO_AERIAL_LUT_SIZE, PSHINE_ATMO_AERIAL_LUT_SIZE);
+
+	bool ok = true;
+	for (size_t i = 0; i < sizeof(atmospheres) / sizeof(*atmospheres); ++i) {
+		const struct atmo_medium *m = &atmospheres[i].medium;
+		compute_transmittance_lut(m, TRANSMITTANCE_SAMPLES, &transmittance_lut);
+		compute_multiscatter_lut(m, &transmittance_lut, &multiscatter_lut);
+
+		// Like the radiance below, relative to the brightest reference point.
+		{
+			double max_multiscatter = 0.0;
+			double multiscatter_errors[MULTISCATTER_POINT_COUNT];
+			for (size_t k = 0; k < MULTISCATTER_POINT_COUNT; ++k) {
+				double mu = 2.0 * pshine_pcg64_random_double(&rng) - 1.0, h = pshine_pcg64_random_double(&rng);
+				double3 ref = atmo_multiscatter_texel(m, &transmittance_lut, mu, h,
+					REFERENCE_MULTISCATTER_ELEVATIONS, REFERENCE_MULTISCATTER_AZIMUTHS, REFERENCE_MULTISCATTER_SAMPLES);
+				double lut[4];
+				sample_test_lut(&multiscatter_lut, 0.5 + 0.5 * mu, h, 0.5, lut);
+				multiscatter_errors[k] = fmax(fmax(fabs(lut[0] - ref.x), fabs(lut[1] - ref.y)), fabs(lut[2] - ref.z));
+				max_multiscatter = fmax(max_multiscatter, fmax(fmax(ref.x, ref.y), ref.z));
+			}
+			double mean = 0.0;
+			for (size_t k = 0; k < MULTISCATTER_POINT_COUNT; ++k) mean += (multiscatter_errors[k] /= max_multiscatter);
+			mean /= MULTISCATTER_POINT_COUNT;
+			double p90 = percentile(multiscatter_errors, MULTISCATTER_POINT_COUNT, 0.9);
+			bool multiscatter_ok = mean < MAX_MEAN_ERROR && p90 < MAX_P90_ERROR;
+			PSHINE_INFO(
+				"atmosphere: %s, %u multiscattering points: error %.2f%% mean, %.2f%% p90%s",
+				atmospheres[i].name, (unsigned)MULTISCATTER_POINT_COUNT, mean * 100.0, p90 * 100.0,
+				multiscatter_ok ? "" : " FAILED"
+			);
+			ok = ok && multiscatter_ok;
+		}
+
+		for (size_t j = 0; j < sizeof(camera_heights) / sizeof(*camera_heights); ++j) {
+			struct test_view view = {
+				.position = double3mul(test_random_unit(&rng), m->planet_radius + camera_heights[j] * (1.0 - m->planet_radius)),
+				.tan_y = tan(30.0 * π / 180.0),
+			};
+			view.tan_x = view.tan_y * 16.0 / 9.0;
+			// look at the horizon from inside the atmosphere, and at the planet from outside,
+			// with the sun from a bit under the horizon to high up.
+			double distance = double3mag(view.position);
+			double3 up = double3div(view.position, distance);
+			double3 side = double3norm(double3cross(up, test_random_unit(&rng)));
+			double sun_elevation = -0.1 + 1.1 * pshine_pcg64_random_double(&rng);
+			view.sun = double3add(double3mul(up, sin(sun_elevation)), double3mul(double3norm(double3cross(up, side)), cos(sun_elevation)));
+			view.forward = distance < 1.0
+				? double3norm(double3sub(side, double3mul(up, 0.1)))
+				: double3neg(up);
+			view.right = double3norm(double3cross(view.forward, up));
+			if (distance >= 1.0) view.right = side;
+			view.up = double3cross(view.right, view.forward);
+			pshine_atmo_screen_rect(view.position.vs, view.right.vs, view.up.vs, view.forward.vs, view.tan_x, view.tan_y,
+				(double[3]){ 0.0, 0.0, 0.0 }, 1.0, view.aerial_rect);
+
+			// the rectangle contains every point of the atmosphere on the screen.
+			size_t outside_rect_count = 0;
+			for (size_t k = 0; k < 1000; ++k) {
+				double3 rel = double3sub(test_random_unit(&rng), view.position);
+				double z = double3dot(rel, view.forward);
+				if (z <= 0.0) continue;
+				double x = double3dot(rel, view.right) / z / view.tan_x, y = double3dot(rel, view.up) / z / view.tan_y;
+				if (fabs(x) > 1.0 || fabs(y) > 1.0) continue;
+				double u = x * 0.5 + 0.5, v = 0.5 - y * 0.5;
+				if (u < view.aerial_rect[0] - 1e-5 || u > view.aerial_rect[0] + view.aerial_rect[2] + 1e-5
+					|| v < view.aerial_rect[1] - 1e-5 || v > view.aerial_rect[1] + view.aerial_rect[3] + 1e-5)
+					++outside_rect_count;
+			}
+			if (outside_rect_count > 0) {
+				PSHINE_INFO(
+					"atmosphere: %s, %.2f heights up: %zu points outside of the screen rect FAILED",
+					atmospheres[i].name, camera_heights[j], outside_rect_count
+				);
+				ok = false;
+			}
+
+			compute_sky_view_lut(m, &transmittance_lut, &multiscatter_lut, &view, &sky_view_lut);
+			compute_aerial_lut(m, &transmittance_lut, &multiscatter_lut, &view, &aerial_lut);
+
+			// The radiance errors are relative to the brightest reference ray, which is what the eye adapts to.
+			// A few rays near the horizon or the atmosphere's edge are off by more, where the LUTs
+			// have a sharp edge between two texels, so the percentiles are checked instead of the maximum.
+			double max_radiance = 0.0;
+			struct test_errors errors[2] = {}; // the sky, and in front of the ground
+			for (size_t k = 0; k < SKY_RAY_COUNT + AERIAL_RAY_COUNT; ++k) {
+				bool aerial = k >= SKY_RAY_COUNT;
+				double u = view.aerial_rect[0] + view.aerial_rect[2] * pshine_pcg64_random_double(&rng);
+				double v = view.aerial_rect[1] + view.aerial_rect[3] * pshine_pcg64_random_double(&rng);
+				double3 dir = test_view_ray(&view, u, v);
+				double2 atmo_hit = intersect_ray_sphere(1.0, view.position, dir);
+				if (atmo_hit.x == MAX_DISTANCE) continue;
+				double depth = MAX_DISTANCE;
+				if (aerial) {
+					double2 surface_hit = intersect_ray_sphere(m->planet_radius, view.position, dir);
+					double t_end = fmin(atmo_hit.x + atmo_hit.y, surface_hit.x);
+					depth = atmo_hit.x + (t_end - atmo_hit.x) * pshine_pcg64_random_double(&rng);
+				}
+				double3 lut_radiance, ref_radiance;
+				double lut_transmittance, ref_transmittance;
+				composite(m, &multiscatter_lut, &sky_view_lut, &aerial_lut, &view, u, v, depth,
+					&lut_radiance, &lut_transmittance);
+				composite(m, &multiscatter_lut, nullptr, nullptr, &view, u, v, depth,
+					&ref_radiance, &ref_transmittance);
+				double3 diff = double3sub(lut_radiance, ref_radiance);
+				struct test_errors *e = &errors[aerial];
+				e->radiance[e->count] = fmax(fmax(fabs(diff.x), fabs(diff.y)), fabs(diff.z));
+				e->transmittance[e->count] = fabs(lut_transmittance - ref_transmittance);
+				++e->count;
+				max_radiance = fmax(max_radiance, fmax(fmax(ref_radiance.x, ref_radiance.y), ref_radiance.z));
+			}
+			bool case_ok = errors[0].count > 0;
+			for (size_t k = 0; k < 2; ++k) {
+				struct test_errors *e = &errors[k];
+				if (e->count == 0) continue;
+				double mean = 0.0;
+				for (size_t l = 0; l < e->count; ++l) mean += (e->radiance[l] /= max_radiance);
+				mean /= e->count;
+				double radiance_p90 = percentile(e->radiance, e->count, 0.9);
+				double transmittance_p90 = percentile(e->transmittance, e->count, 0.9);
+				bool errors_ok = mean < MAX_MEAN_ERROR && radiance_p90 < MAX_P90_ERROR
+					&& transmittance_p90 < MAX_P90_TRANSMITTANCE_ERROR;
+				PSHINE_INFO(
+					"atmosphere: %s, %.2f heights up, %zu rays %s: radiance error %.2f%% mean, %.2f%% p90, "
+					"transmittance error %.4f p90%s",
+					atmospheres[i].name, camera_heights[j], e->count, k == 0 ? "to the sky" : "in front of the ground",
+					mean * 100.0, radiance_p90 * 100.0, transmittance_p90, errors_ok ? "" : " FAILED"
+				);
+				case_ok = case_ok && errors_ok;
+			}
+			ok = ok && case_ok;
+		}
+	}
+
+	// the atmospheres are drawn in their merged screen rectangles, which have to cover every pixel
+	// whose center is in one of the atmospheres' rectangles, and no pixel twice.
+	enum : uint32_t { RECT_SCREEN_WIDTH = 160, RECT_SCREEN_HEIGHT = 90, RECT_SET_COUNT = 200 };
+	size_t uncovered_count = 0, overdrawn_count = 0, merged_count = 0;
+	for (size_t i = 0; i < RECT_SET_COUNT; ++i) {
+		size_t count = 1 + pshine_pcg64_random_uint64(&rng) % PSHINE_ATMO_MAX_BATCH;
+		float rects[PSHINE_ATMO_MAX_BATCH][4];
+		for (size_t j = 0; j < count; ++j) {
+			// mostly small, like distant planets, with a few close ones.
+			double size = pow(pshine_pcg64_random_double(&rng), 3.0);
+			rects[j][2] = (float)size;
+			rects[j][3] = (float)(size * (0.5 + pshine_pcg64_random_double(&rng)));
+			if (rects[j][3] > 1.0f) rects[j][3] = 1.0f;
+			rects[j][0] = (float)((1.0 - rects[j][2]) * pshine_pcg64_random_double(&rng));
+			rects[j][1] = (float)((1.0 - rects[j][3]) * pshine_pcg64_random_double(&rng));
+		}
+		uint32_t pixel_rects[PSHINE_ATMO_MAX_BATCH][4];
+		size_t pixel_rect_count = pshine_atmo_pixel_rects(count, (const float (*)[4])rects,
+			RECT_SCREEN_WIDTH, RECT_SCREEN_HEIGHT, pixel_rects);
+		merged_count += count - pixel_rect_count;
+		for (uint32_t y = 0; y < RECT_SCREEN_HEIGHT; ++y) {
+			for (uint32_t x = 0; x < RECT_SCREEN_WIDTH; ++x) {
+				double u = (x + 0.5) / RECT_SCREEN_WIDTH, v = (y + 0.5) / RECT_SCREEN_HEIGHT;
+				bool inside = false;
+				for (size_t j = 0; j < count; ++j) {
+					inside = inside || (u >= rects[j][0] && u <= rects[j][0] + rects[j][2]
+						&& v >= rects[j][1] && v <= rects[j][1] + rects[j][3]);
+				}
+				size_t drawn = 0;
+				for (size_t j = 0; j < pixel_rect_count; ++j) {
+					const uint32_t *rect = pixel_rects[j];
+					drawn += x >= rect[0] && x < rect[0] + rect[2] && y >= rect[1] && y < rect[1] + rect[3];
+				}
+				uncovered_count += inside && drawn == 0;
+				overdrawn_count += drawn > 1;
+			}
+		}
+	}
+	bool rects_ok = uncovered_count == 0 && overdrawn_count == 0;
+	PSHINE_INFO(
+		"atmosphere: %u sets of screen rects, %zu merged: %zu pixels not drawn, %zu drawn twice%s",
+		(unsigned)RECT_SET_COUNT, merged_count, uncovered_count, overdrawn_count, rects_ok ? "" : " FAILED"
+	);
+	ok = ok && rects_ok;
+
+	free(transmittance_lut.texels_own);
+	free(multiscatter_lut.texels_own);
+	free(sky_view_lut.texels_own);
+	free(aerial_lut.texels_own);
+	return ok;
+}
+
+// The half-resolution atmosphere, see `atmo_common.glsl`.
+
+/// `ATMO_SURFACE_TOLERANCE`
+static const double TEST_SURFACE_TOLERANCE = 0.1;
+
+/// `atmo_same_surface`
+static bool atmo_same_surface(double a, double b) {
+	return fabs(a - b) <= TEST_SURFACE_TOLERANCE * fmax(a, b);
+}
+
+/// `atmo_block_depth`, on a depth buffer in the first channel of `depths`.
+static double atmo_block_depth(const struct test_lut *depths, uint32_t tx, uint32_t ty, uint32_t divisor, uint32_t closest[static 2]) {
+	double block_depth = -1.0;
+	for (uint32_t y = 0; y < divisor; ++y) {
+		for (uint32_t x = 0; x < divisor; ++x) {
+			uint32_t px = tx * divisor + x < depths->width ? tx * divisor + x : depths->width - 1;
+			uint32_t py = ty * divisor + y < depths->height ? ty * divisor + y : depths->height - 1;
+			double depth = test_lut_texel(depths, px, py, 0)[0];
+			if (depth > block_depth) {
+				block_depth = depth;
+				closest[0] = px;
+				closest[1] = py;
+			}
+		}
+	}
+	return block_depth;
+}
+
+/// `AtmosphereHalfResUniforms`, with the near plane 1 away.
+struct test_half_res {
+	double3 prev_camera;
+	bool has_history;
+	const struct test_view *prev_view;
+	uint32_t jitter[2];
+	uint32_t divisor;
+	double blend;
+};
+
+/// The test scene: a planet, and a small sphere in front of the camera. The depth buffer values
+/// (reverse Z, with the near plane 1 away) go in the first channel of `depths`, the distances
+/// along the view rays in the second, and the scene's colors in `colors`.
+struct test_scene {
+	double3 occluder_center;
+	double occluder_radius;
+};
+
+static void render_test_scene(
+	const struct atmo_medium *m,
+	const struct test_scene *scene,
+	const struct test_view *view,
+	struct test_lut *depths,
+	struct test_lut *colors
+) {
+	for (uint32_t y = 0; y < depths->height; ++y) {
+		for (uint32_t x = 0; x < depths->width; ++x) {
+			double u = (x + 0.5) / depths->width, v = (y + 0.5) / depths->height;
+			double3 ray = test_view_near_plane_ray(view, u, v);
+			double3 dir = double3norm(ray);
+			double t_planet = intersect_ray_sphere(m->planet_radius, view->position, dir).x;
+			double t_occluder = intersect_ray_sphere(scene->occluder_radius,
+				double3sub(view->position, scene->occluder_center), dir).x;
+			double t = fmin(t_planet, t_occluder);
+			float *depth = test_lut_texel(depths, x, y, 0), *color = test_lut_texel(colors, x, y, 0);
+			depth[0] = t < MAX_DISTANCE ? (float)(double3mag(ray) / t) : 0.0f;
+			depth[1] = (float)t;
+			float c = t == MAX_DISTANCE ? 0.0f : t_occluder < t_planet ? 0.05f : 0.01f;
+			color[0] = color[1] = color[2] = c;
+			color[3] = 1.0f;
+		}
+	}
+}
+
+/// `atmo_half.comp`, for the only planet.
+static void render_half_res_light(
+	const struct atmo_medium *m,
+	const struct test_lut *multiscatter_lut,
+	const struct test_lut *sky_view_lut,
+	const struct test_lut *aerial_lut,
+	const struct test_view *view,
+	const struct test_half_res *half_res,
+	const struct test_lut *depths,
+	struct test_lut *light
+) {
+	for (uint32_t ty = 0; ty < light->height; ++ty) {
+		for (uint32_t tx = 0; tx < light->width; ++tx) {
+			uint32_t closest[2];
+			double block_depth = atmo_block_depth(depths, tx, ty, half_res->divisor, closest);
+			uint32_t px = tx * half_res->divisor + half_res->jitter[0], py = ty * half_res->divisor + half_res->jitter[1];
+			if (px >= depths->width) px = depths->width - 1;
+			if (py >= depths->height) py = depths->height - 1;
+			if (!atmo_same_surface(test_lut_texel(depths, px, py, 0)[0], block_depth)) {
+				px = closest[0];
+				py = closest[1];
+			}
+			double3 radiance;
+			double transmittance;
+			composite(m, multiscatter_lut, sky_view_lut, aerial_lut, view,
+				(px + 0.5) / depths->width, (py + 0.5) / depths->height, test_lut_texel(depths, px, py, 0)[1],
+				&radiance, &transmittance);
+			float *texel = test_lut_texel(light, tx, ty, 0);
+			texel[0] = (float)radiance.x;
+			texel[1] = (float)radiance.y;
+			texel[2] = (float)radiance.z;
+			texel[3] = (float)transmittance;
+		}
+	}
+}
+
+/// `atmo_resolve.comp`: the history's depths are in `history_depths`' first channel.
+static void resolve_half_res_light(
+	const struct test_view *view,
+	const struct test_half_res *half_res,
+	const struct test_lut *depths,
+	const struct test_lut *light,
+	const struct test_lut *prev_history,
+	const struct test_lut *prev_history_depths,
+	struct test_lut *history,
+	struct test_lut *history_depths
+) {
+	const struct test_view *prev = half_res->prev_view;
+	for (uint32_t ty = 0; ty < light->height; ++ty) {
+		for (uint32_t tx = 0; tx < light->width; ++tx) {
+			uint32_t closest[2];
+			double block_depth = atmo_block_depth(depths, tx, ty, half_res->divisor, closest);
+			const float *current = test_lut_texel(light, tx, ty, 0);
+			double result[4] = { current[0], current[1], current[2], current[3] };
+
+			double u = (tx + 0.5) * half_res->divisor / depths->width, v = (ty + 0.5) * half_res->divisor / depths->height;
+			double3 p = test_view_near_plane_ray(view, u, v);
+			if (block_depth > 0.0) p = double3sub(double3div(p, block_depth), half_res->prev_camera);
+
+			double prev_z = double3dot(p, prev->forward);
+			double prev_u = double3dot(p, prev->right) / prev->tan_x / prev_z * 0.5 + 0.5;
+			double prev_v = 0.5 - double3dot(p, prev->up) / prev->tan_y / prev_z * 0.5;
+			bool on_screen = prev_z > 0.0 && prev_u >= 0.0 && prev_u <= 1.0 && prev_v >= 0.0 && prev_v <= 1.0;
+			if (half_res->has_history && on_screen) {
+				double prev_depth = block_depth > 0.0 ? 1.0 / prev_z : 0.0;
+				uint32_t px = (uint32_t)(prev_u * light->width), py = (uint32_t)(prev_v * light->height);
+				if (px >= light->width) px = light->width - 1;
+				if (py >= light->height) py = light->height - 1;
+				if (atmo_same_surface(test_lut_texel(prev_history_depths, px, py, 0)[0], prev_depth)) {
+					double lo[4], hi[4];
+					for (size_t c = 0; c < 4; ++c) lo[c] = hi[c] = current[c];
+					for (int y = -1; y <= 1; ++y) {
+						for (int x = -1; x <= 1; ++x) {
+							int nx = (int)tx + x, ny = (int)ty + y;
+							nx = nx < 0 ? 0 : nx >= (int)light->width ? (int)light->width - 1 : nx;
+							ny = ny < 0 ? 0 : ny >= (int)light->height ? (int)light->height - 1 : ny;
+							const float *s = test_lut_texel(light, nx, ny, 0);
+							for (size_t c = 0; c < 4; ++c) {
+								lo[c] = fmin(lo[c], s[c]);
+								hi[c] = fmax(hi[c], s[c]);
+							}
+						}
+					}
+					double h[4];
+					sample_test_lut(prev_history, prev_u, prev_v, 0.5, h);
+					for (size_t c = 0; c < 4; ++c) {
+						double clamped = clampd(h[c], lo[c], hi[c]);
+						result[c] = clamped + (current[c] - clamped) * half_res->blend;
+					}
+				}
+			}
+
+			float *texel = test_lut_texel(history, tx, ty, 0);
+			for (size_t c = 0; c < 4; ++c) texel[c] = (float)result[c];
+			test_lut_texel(history_depths, tx, ty, 0)[0] = (float)block_depth;
+		}
+	}
+}
+
+/// `atmo_upsample.frag`: the atmosphere's radiance and transmittance at the pixel `x, y`.
+static void upsample_half_res_light(
+	const struct test_half_res *half_res,
+	const struct test_lut *history,
+	const struct test_lut *history_depths,
+	double depth,
+	uint32_t x,
+	uint32_t y,
+	double out[static 4]
+) {
+	double px = (x + 0.5) / half_res->divisor - 0.5, py = (y + 0.5) / half_res->divisor - 0.5;
+	int bx = (int)floor(px), by = (int)floor(py);
+	double fx = px - bx, fy = py - by;
+	double light[4] = {}, weight = 0.0;
+	double nearest[4] = { 0.0, 0.0, 0.0, 1.0 }, nearest_diff = MAX_DISTANCE;
+	for (int j = 0; j <= 1; ++j) {
+		for (int i = 0; i <= 1; ++i) {
+			int tx = bx + i, ty = by + j;
+			tx = tx < 0 ? 0 : tx >= (int)history->width ? (int)history->width - 1 : tx;
+			ty = ty < 0 ? 0 : ty >= (int)history->height ? (int)history->height - 1 : ty;
+			const float *s = test_lut_texel(history, tx, ty, 0);
+			double d = test_lut_texel(history_depths, tx, ty, 0)[0];
+			if (atmo_same_surface(d, depth)) {
+				double w = (i == 0 ? 1.0 - fx : fx) * (j == 0 ? 1.0 - fy : fy) + 1e-4;
+				for (size_t c = 0; c < 4; ++c) light[c] += s[c] * w;
+				weight += w;
+			}
+			if (fabs(d - depth) < nearest_diff) {
+				for (size_t c = 0; c < 4; ++c) nearest[c] = s[c];
+				nearest_diff = fabs(d - depth);
+			}
+		}
+	}
+	for (size_t c = 0; c < 4; ++c) out[c] = weight > 0.0 ? light[c] / weight : nearest[c];
+}
+
+/// Rotate `v` around the unit vector `axis`.
+static double3 test_rotate(double3 v, double3 axis, double angle) {
+	double c = cos(angle), s = sin(angle);
+	return double3add(double3add(double3mul(v, c), double3mul(double3cross(axis, v), s)),
+		double3mul(axis, double3dot(axis, v) * (1.0 - c)));
+}
+
+bool pshine_test_atmosphere_half_res() {
+	// Earth's atmosphere, see `pshine_test_atmosphere`.
+	const struct atmo_medium medium = {
+		.planet_radius = 6'371.0 / 6'471.0,
+		.falloffs = { 13.5, 18.0 },
+		.k_ray = { 3.8, 13.5, 33.1 },
+		.k_mie = 20.1,
+		.k_mie_ext = 20.1 * 1.1,
+		.mie_g = -0.87,
+	};
+	const struct atmo_medium *m = &medium;
+	enum : uint32_t {
+		WIDTH = 320,
+		HEIGHT = 180,
+		FRAME_COUNT = 16,
+		TRANSMITTANCE_LUT_SIZE = 256,
+		TRANSMITTANCE_SAMPLES = 1024,
+	};
+	// The camera turns about half a pixel, and moves about a hundred meters, each frame.
+	const double TURN_PER_FRAME = 0.003, MOVE_PER_FRAME = 2e-5;
+	const double MAX_MEAN_ERROR = 0.001, MAX_P99_ERROR = 0.02;
+	const uint32_t divisor = PSHINE_ATMO_RESOLUTION_DIVISOR;
+	const uint32_t half_width = (WIDTH + divisor - 1) / divisor, half_height = (HEIGHT + divisor - 1) / divisor;
+
+	struct test_lut transmittance_lut = make_test_lut(TRANSMITTANCE_LUT_SIZE, TRANSMITTANCE_LUT_SIZE, 1);
+	struct test_lut multiscatter_lut = make_test_lut(PSHINE_ATMO_MULTISCATTER_LUT_SIZE, PSHINE_ATMO_MULTISCATTER_LUT_SIZE, 1);
+	struct test_lut sky_view_lut = make_test_lut(PSHINE_ATMO_SKY_VIEW_LUT_WIDTH, PSHINE_ATMO_SKY_VIEW_LUT_HEIGHT, 1);
+	struct test_lut aerial_lut = make_test_lut(PSHINE_ATMO_AERIAL_LUT_SIZE, PSHINE_ATMO_AERIAL_LUT_SIZE, PSHINE_ATMO_AERIAL_LUT_SIZE);
+	struct test_lut depths = make_test_lut(WIDTH, HEIGHT, 1), colors = make_test_lut(WIDTH, HEIGHT, 1);
+	struct test_lut light = make_test_lut(half_width, half_height, 1);
+	struct test_lut histories[2] = {
+		make_test_lut(half_width, half_height, 1),
+		make_test_lut(half_width, half_height, 1),
+	};
+	struct test_lut history_depths[2] = {
+		make_test_lut(half_width, half_height, 1),
+		make_test_lut(half_width, half_height, 1),
+	};
+	compute_transmittance_lut(m, TRANSMITTANCE_SAMPLES, &transmittance_lut);
+	compute_multiscatter_lut(m, &transmittance_lut, &multiscatter_lut);
+
+	// A bit above the ground, looking at the horizon with the sun low in front, and a sphere
+	// (a few kilometers across, a hundred away) on the horizon for sharp depth edges.
+	double3 up = double3xyz(0.0, 1.0, 0.0);
+	struct test_view view = {
+		.position = double3mul(up, m->planet_radius + 0.02 * (1.0 - m->planet_radius)),
+		.forward = double3norm(double3xyz(0.0, -0.02, 1.0)),
+		.tan_y = tan(30.0 * π / 180.0),
+		.sun = double3norm(double3xyz(0.3, 0.15, 1.0)),
+	};
+	view.tan_x = view.tan_y * WIDTH / HEIGHT;
+	view.right = double3norm(double3cross(view.forward, up));
+	view.up = double3cross(view.right, view.forward);
+	struct test_scene scene = {
+		.occluder_center = double3add(view.position, double3add(double3mul(view.forward, 0.015), double3mul(view.right, 0.003))),
+		.occluder_radius = 0.0004,
+	};
+
+	struct test_view prev_view = view;
+	for (uint32_t frame = 0; frame < FRAME_COUNT; ++frame) {
+		if (frame > 0) {
+			view.position = double3add(view.position, double3mul(view.forward, MOVE_PER_FRAME));
+			view.forward = test_rotate(view.forward, up, TURN_PER_FRAME);
+			view.right = test_rotate(view.right, up, TURN_PER_FRAME);
+			view.up = test_rotate(view.up, up, TURN_PER_FRAME);
+		}
+		pshine_atmo_screen_rect(view.position.vs, view.right.vs, view.up.vs, view.forward.vs, view.tan_x, view.tan_y,
+			(double[3]){ 0.0, 0.0, 0.0 }, 1.0, view.aerial_rect);
+		compute_sky_view_lut(m, &transmittance_lut, &multiscatter_lut, &view, &sky_view_lut);
+		compute_aerial_lut(m, &transmittance_lut, &multiscatter_lut, &view, &aerial_lut);
+		render_test_scene(m, &scene, &view, &depths, &colors);
+
+		struct test_half_res half_res = {
+			.prev_camera = double3sub(prev_view.position, view.position),
+			.has_history = frame > 0,
+			.prev_view = &prev_view,
+			.divisor = divisor,
+			.blend = 1.0 / PSHINE_ATMO_HISTORY_FRAMES,
+		};
+		pshine_atmo_jitter(frame, divisor, half_res.jitter);
+		render_half_res_light(m, &multiscatter_lut, &sky_view_lut, &aerial_lut, &view, &half_res, &depths, &light);
+		resolve_half_res_light(&view, &half_res, &depths, &light,
+			&histories[(frame + 1) % 2], &history_depths[(frame + 1) % 2],
+			&histories[frame % 2], &history_depths[frame % 2]);
+		prev_view = view;
+
+		if (frame + 1 < FRAME_COUNT) continue;
+
+		// The errors are relative to the brightest pixel of the full-resolution image.
+		double *errors = calloc(WIDTH * HEIGHT, sizeof(double));
+		double max_radiance = 0.0;
+		for (uint32_t y = 0; y < HEIGHT; ++y) {
+			for (uint32_t x = 0; x < WIDTH; ++x) {
+				const float *depth = test_lut_texel(&depths, x, y, 0), *color = test_lut_texel(&colors, x, y, 0);
+				double3 radiance;
+				double transmittance;
+				composite(m, &multiscatter_lut, &sky_view_lut, &aerial_lut, &view,
+					(x + 0.5) / WIDTH, (y + 0.5) / HEIGHT, depth[1], &radiance, &transmittance);
+				double half[4];
+				upsample_half_res_light(&half_res, &histories[frame % 2], &history_depths[frame % 2], depth[0], x, y, half);
+				double error = 0.0;
+				for (size_t c = 0; c < 3; ++c) {
+					double full = color[c] * transmittance + radiance.vs[c];
+					error = fmax(error, fabs(color[c] * half[3] + half[c] - full));
+					max_radiance = fmax(max_radiance, full);
+				}
+				errors[y * WIDTH + x] = error;
+			}
+		}
+		double mean = 0.0;
+		for (size_t i = 0; i < WIDTH * HEIGHT; ++i) mean += (errors[i] /= max_radiance);
+		mean /= WIDTH * HEIGHT;
+		double p99 = percentile(errors, WIDTH * HEIGHT, 0.99);
+		free(errors);
+		bool ok = mean < MAX_MEAN_ERROR && p99 < MAX_P99_ERROR;
+		PSHINE_INFO(
+			"atmosphere: 1/%u resolution, %u frames: difference to full resolution %.3f%% mean, %.2f%% p99%s",
+			divisor, FRAME_COUNT, mean * 100.0, p99 * 100.0, ok ? "" : " FAILED"
+		);
+
+		free(transmittance_lut.texels_own);
+		free(multiscatter_lut.texels_own);
+		free(sky_view_lut.texels_own);
+		free(aerial_lut.texels_own);
+		free(depths.texels_own);
+		free(colors.texels_own);
+		free(light.texels_own);
+		for (size_t i = 0; i < 2; ++i) {
+			free(histories[i].texels_own);
+			free(history_depths[i].texels_own);
+		}
+		return ok;
+	}
+	return false;
+}
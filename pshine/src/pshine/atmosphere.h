@@ -0,0 +1,77 @@
+#ifndef PSHINE_ATMOSPHERE_H_
+#define PSHINE_ATMOSPHERE_H_
+#include <pshine/util.h>
+
+// Atmosphere LUT sizes and parameterizations (see `atmo_common.glsl`), and the aerial perspective's screen rectangle.
+
+enum : uint32_t {
+	PSHINE_ATMO_TRANSMITTANCE_LUT_SIZE = 1024,
+	PSHINE_ATMO_MULTISCATTER_LUT_SIZE = 32,
+	PSHINE_ATMO_SKY_VIEW_LUT_WIDTH = 192,
+	PSHINE_ATMO_SKY_VIEW_LUT_HEIGHT = 108,
+	/// The width, height and slice count of the aerial perspective volume.
+	PSHINE_ATMO_AERIAL_LUT_SIZE = 32,
+	/// The ray march steps of a sky-view LUT texel.
+	PSHINE_ATMO_SKY_VIEW_SAMPLES = 40,
+	/// The ray march steps of an aerial perspective slice.
+	PSHINE_ATMO_AERIAL_SAMPLES = 4,
+	/// The half-resolution atmosphere's texels are blocks of this many pixels squared (a power of two).
+	PSHINE_ATMO_RESOLUTION_DIVISOR = 2,
+	/// The half-resolution atmosphere's history weighs about as much as this many frames.
+	PSHINE_ATMO_HISTORY_FRAMES = 8,
+	/// The most atmospheres drawn in a frame, all composited in one pass (`ATMO_MAX_BATCH` in `atmo_common.glsl`).
+	/// If more are visible, the smallest on screen are left out.
+	PSHINE_ATMO_MAX_BATCH = 16,
+	/// The drawn atmospheres' aerial perspective volumes are tiles of one volume, this many across and down
+	/// (`ATMO_AERIAL_TILES` in `atmo_common.glsl`). Their sky-view LUTs are layers of one array.
+	PSHINE_ATMO_AERIAL_TILES = 4,
+};
+
+static_assert(PSHINE_ATMO_AERIAL_TILES * PSHINE_ATMO_AERIAL_TILES >= PSHINE_ATMO_MAX_BATCH,
+	"every drawn atmosphere needs an aerial perspective tile");
+
+static_assert((PSHINE_ATMO_RESOLUTION_DIVISOR & (PSHINE_ATMO_RESOLUTION_DIVISOR - 1)) == 0,
+	"the resolution divisor must be a power of two");
+
+/// The screen rectangle (`x, y, width, height` in texture coordinates, Y down) containing the
+/// sphere's projection, for a camera at `position` with the axes of `pshine_make_cull_frustum`
+/// and `tan_x` and `tan_y` the tangents of its half fields of view. The whole screen if the
+/// sphere isn't entirely in front of the camera.
+void pshine_atmo_screen_rect(
+	const double position[static 3],
+	const double right[static 3],
+	const double up[static 3],
+	const double forward[static 3],
+	double tan_x,
+	double tan_y,
+	const double center[static 3],
+	double radius,
+	float rect[static 4]
+);
+
+/// The pixels (`x, y, width, height`) of the screen rectangles `rects` (as from `pshine_atmo_screen_rect`)
+/// on a `width` by `height` screen, the overlapping ones merged into their bounds until none overlap,
+/// so no pixel is drawn twice. Empty ones are dropped. Returns how many are put in `out`, at most `count`.
+size_t pshine_atmo_pixel_rects(
+	size_t count,
+	const float rects[][4],
+	uint32_t width,
+	uint32_t height,
+	uint32_t out[][4]
+);
+
+/// The pixel (`x, y`) of each block of the half-resolution atmosphere that is rendered on frame
+/// `frame`: each of the block's pixels once every `divisor`² frames, in the order of a Bayer matrix.
+void pshine_atmo_jitter(size_t frame, uint32_t divisor, uint32_t jitter[static 2]);
+
+/// Check the multiscattering LUT against many more rays, the sky-view LUT and the aerial perspective
+/// volume, built with the shaders' parameterizations, against ray marching every direction, and the
+/// screen rectangles the atmospheres are drawn in.
+/// Logs the errors and returns false if they're too large.
+bool pshine_test_atmosphere();
+
+/// Render a few frames of a moving camera with the half-resolution atmosphere, and check the last
+/// one against the full-resolution path. Logs the differences and returns false if they're too large.
+bool pshine_test_atmosphere_half_res();
+
+#endif // PSHINE_ATMOSPHERE_H_
@@ -0,0 +1,210 @@
+#include "culling.h"
+#include <math.h>
+#include "psmath.h"
+
+static inline double4 make_plane(double3 normal, double3 point) {
+	normal = double3norm(normal);
+	return double4xyz3w(normal, -double3dot(normal, point));
+}
+
+void pshine_make_cull_frustum(
+	struct pshine_cull_frustum *frustum,
+	const double position[static 3],
+	const double right[static 3],
+	const double up[static 3],
+	const double forward[static 3],
+	double fov_y,
+	double aspect,
+	double znear
+) {
+	double3 p = double3vs(position), x = double3vs(right), y = double3vs(up), z = double3vs(forward);
+	double tan_y = tan(fov_y * 0.5 * π / 180.0), tan_x = tan_y * aspect;
+	double3 zx = double3mul(z, tan_x), zy = double3mul(z, tan_y);
+	double4 planes[5] = {
+		make_plane(double3add(zx, x), p),
+		make_plane(double3sub(zx, x), p),
+		make_plane(double3add(zy, y), p),
+		make_plane(double3sub(zy, y), p),
+		make_plane(z, double3add(p, double3mul(z, znear))),
+	};
+	for (size_t i = 0; i < 5; ++i) memcpy(frustum->planes[i], planes[i].vs, sizeof(frustum->planes[i]));
+}
+
+bool pshine_cull_sphere_in_frustum(const struct pshine_cull_frustum *frustum, const struct pshine_cull_sphere *sphere) {
+	for (size_t i = 0; i < 5; ++i) {
+		const double *n = frustum->planes[i];
+		double distance = n[0] * sphere->center[0] + n[1] * sphere->center[1] + n[2] * sphere->center[2] + n[3];
+		if (distance < -sphere->radius) return false;
+	}
+	return true;
+}
+
+bool pshine_cull_sphere_occluded(
+	const double camera[static 3],
+	const struct pshine_cull_sphere *occluder,
+	const struct pshine_cull_sphere *sphere
+) {
+	double3 c = double3vs(camera);
+	double3 to_occluder = double3sub(double3vs(occluder->center), c);
+	double3 to_sphere = double3sub(double3vs(sphere->center), c);
+	double occluder_distance = double3mag(to_occluder), sphere_distance = double3mag(to_sphere);
+	double R = occluder->radius;
+	if (occluder_distance <= R || sphere_distance <= sphere->radius) return false;
+
+	// the sphere's farthest angle from the occluder's center must be within the silhouette cone.
+	double cone_angle = asin(R / occluder_distance);
+	double sphere_angle = asin(sphere->radius / sphere_distance);
+	double cos_between = double3dot(to_occluder, to_sphere) / (occluder_distance * sphere_distance);
+	double angle = acos(clampd(cos_between, -1.0, 1.0)) + sphere_angle;
+	if (angle > cone_angle) return false;
+
+	// along a ray at `angle` from the center, the occluder starts at `entry`, and it starts nearer
+	// on rays closer to the center. So all of the sphere is hidden if its nearest point is beyond `entry`.
+	double s = occluder_distance * sin(angle);
+	double entry = occluder_distance * cos(angle) - sqrt(fmax(R * R - s * s, 0.0));
+	return sphere_distance - sphere->radius >= entry;
+}
+
+void pshine_cull_spheres(
+	const struct pshine_cull_frustum *frustum,
+	const double camera[static 3],
+	size_t occluder_count,
+	const struct pshine_cull_sphere *occluders,
+	size_t sphere_count,
+	const struct pshine_cull_sphere *spheres,
+	bool *visible,
+	struct pshine_cull_stats *stats
+) {
+	for (size_t i = 0; i < sphere_count; ++i) {
+		const struct pshine_cull_sphere *sphere = &spheres[i];
+		++stats->tested;
+		visible[i] = pshine_cull_sphere_in_frustum(frustum, sphere);
+		if (!visible[i]) {
+			++stats->frustum_culled;
+			continue;
+		}
+		for (size_t j = 0; j < occluder_count; ++j) {
+			const struct pshine_cull_sphere *occluder = &occluders[j];
+			double3 between = double3sub(double3vs(occluder->center), double3vs(sphere->center));
+			if (double3mag(between) + occluder->radius <= sphere->radius) continue;
+			if (pshine_cull_sphere_occluded(camera, occluder, sphere)) {
+				visible[i] = false;
+				++stats->occlusion_culled;
+				break;
+			}
+		}
+	}
+}
+
+/// Whether `p` is inside the frustum of `pshine_make_cull_frustum` with the same arguments.
+static bool test_point_in_frustum(double3 p, double3 camera, double tan_x, double tan_y, double znear) {
+	// the test camera looks down +Z with +X right and +Y up.
+	double3 q = double3sub(p, camera);
+	return q.z >= znear && fabs(q.x) <= q.z * tan_x && fabs(q.y) <= q.z * tan_y;
+}
+
+/// Whether the segment from `camera` to `p` passes through the occluder before reaching `p`.
+static bool test_point_occluded(double3 p, double3 camera, const struct pshine_cull_sphere *occluder) {
+	double3 d = double3sub(p, camera);
+	double length = double3mag(d);
+	d = double3div(d, length);
+	double3 oc = double3sub(camera, double3vs(occluder->center));
+	double b = double3dot(oc, d), c = double3dot(oc, oc) - occluder->radius * occluder->radius;
+	double discriminant = b * b - c;
+	if (discriminant < 0.0) return false;
+	double entry = -b - sqrt(discriminant);
+	return entry >= 0.0 && entry <= length;
+}
+
+static double3 test_random_unit(struct pshine_pcg64_state *rng) {
+	for (;;) {
+		double3 v = double3xyz(
+			pshine_pcg64_random_double(rng) * 2.0 - 1.0,
+			pshine_pcg64_random_double(rng) * 2.0 - 1.0,
+			pshine_pcg64_random_double(rng) * 2.0 - 1.0
+		);
+		double m = double3mag2(v);
+		if (m > 1e-6 && m <= 1.0) return double3div(v, sqrt(m));
+	}
+}
+
+bool pshine_test_culling() {
+	const double camera[3] = { 0.0, 0.0, 0.0 };
+	const double fov_y = 60.0, aspect = 16.0 / 9.0, znear = 0.01;
+	struct pshine_cull_frustum frustum;
+	pshine_make_cull_frustum(&frustum, camera, (double[3]){ 1, 0, 0 }, (double[3]){ 0, 1, 0 }, (double[3]){ 0, 0, 1 },
+		fov_y, aspect, znear);
+	double tan_y = tan(fov_y * 0.5 * π / 180.0), tan_x = tan_y * aspect;
+
+	bool ok = true;
+	struct {
+		const char *name;
+		struct pshine_cull_sphere occluder, sphere;
+		bool visible;
+	} cases[] = {
+		{ "in front", { { 0, 0, -100 }, 1 }, { { 0, 0, 10 }, 1 }, true },
+		{ "behind the camera", { { 0, 0, -100 }, 1 }, { { 0, 0, -10 }, 1 }, false },
+		{ "straddling the near plane", { { 0, 0, -100 }, 1 }, { { 0, 0, -0.5 }, 1 }, true },
+		{ "left of the frustum", { { 0, 0, -100 }, 1 }, { { -30, 0, 10 }, 1 }, false },
+		{ "above the frustum", { { 0, 0, -100 }, 1 }, { { 0, 30, 10 }, 1 }, false },
+		{ "touching the right edge", { { 0, 0, -100 }, 1 }, { { 10 * tan_x + 1.1, 0, 10 }, 1 }, true },
+		{ "behind a planet", { { 0, 0, 100 }, 10 }, { { 0, 0, 200 }, 5 }, false },
+		{ "in front of a planet", { { 0, 0, 100 }, 10 }, { { 0, 0, 50 }, 5 }, true },
+		{ "peeking past a planet", { { 0, 0, 100 }, 10 }, { { 12, 0, 120 }, 5 }, true },
+		// the planet's silhouette is 5.74° from its center.
+		{ "just inside the silhouette", { { 0, 0, 100 }, 10 }, { { 9.068, 0, 129.68 }, 1 }, false },
+		{ "just outside the silhouette", { { 0, 0, 100 }, 10 }, { { 14.72, 0, 129.16 }, 1 }, true },
+		{ "a planet's own atmosphere", { { 0, 0, 100 }, 10 }, { { 0, 0, 100 }, 11 }, true },
+		{ "camera inside the planet", { { 0, 0, 0 }, 10 }, { { 0, 0, 200 }, 5 }, true },
+	};
+	for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); ++i) {
+		bool visible;
+		struct pshine_cull_stats stats = {};
+		pshine_cull_spheres(&frustum, camera, 1, &cases[i].occluder, 1, &cases[i].sphere, &visible, &stats);
+		if (visible != cases[i].visible) {
+			PSHINE_ERROR("culling: %s: expected %s", cases[i].name, cases[i].visible ? "visible" : "culled");
+			ok = false;
+		}
+	}
+
+	// Random spheres against a random occluder: a culled sphere must have no visible sample point.
+	struct pshine_pcg64_state rng;
+	pshine_pcg64_init(&rng, 0x853c49e6748fea9b, 0xda3e39cb94b95bdb);
+	struct pshine_cull_stats stats = {};
+	size_t wrongly_culled = 0;
+	enum : size_t { SPHERE_COUNT = 20'000, SAMPLE_COUNT = 64 };
+	for (size_t i = 0; i < SPHERE_COUNT; ++i) {
+		struct pshine_cull_sphere occluder = { .radius = 1.0 + 10.0 * pshine_pcg64_random_double(&rng) };
+		double3 occluder_center = double3add(double3xyz(0, 0, 40), double3mul(test_random_unit(&rng), 30.0));
+		memcpy(occluder.center, occluder_center.vs, sizeof(occluder.center));
+		struct pshine_cull_sphere sphere = { .radius = 0.1 + 5.0 * pshine_pcg64_random_double(&rng) };
+		// every other sphere is around the occluder's shadow, so that many are (partly) hidden.
+		double3 sphere_center = i % 2 == 0
+			? double3add(double3xyz(0, 0, 40), double3mul(test_random_unit(&rng), 80.0))
+			: double3add(double3mul(occluder_center, 1.2 + pshine_pcg64_random_double(&rng)),
+				double3mul(test_random_unit(&rng), occluder.radius * 1.5));
+		memcpy(sphere.center, sphere_center.vs, sizeof(sphere.center));
+
+		bool visible;
+		pshine_cull_spheres(&frustum, camera, 1, &occluder, 1, &sphere, &visible, &stats);
+		if (visible) continue;
+		for (size_t k = 0; k < SAMPLE_COUNT; ++k) {
+			// points on the surface and inside.
+			double3 p = double3add(sphere_center,
+				double3mul(test_random_unit(&rng), sphere.radius * (k % 2 == 0 ? 1.0 : pshine_pcg64_random_double(&rng))));
+			if (
+				test_point_in_frustum(p, double3vs(camera), tan_x, tan_y, znear) &&
+				!test_point_occluded(p, double3vs(camera), &occluder)
+			) {
+				++wrongly_culled;
+				break;
+			}
+		}
+	}
+	ok = ok && wrongly_culled == 0;
+	PSHINE_INFO(
+		"culling: %zu random spheres, %zu frustum culled, %zu occlusion culled, %zu wrongly culled%s",
+		stats.tested, stats.frustum_culled, stats.occlusion_culled, wrongly_culled, ok ? "" : " FAILED"
+	);
+	return ok;
+}
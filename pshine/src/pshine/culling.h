@@ -0,0 +1,66 @@
+#ifndef PSHINE_CULLING_H_
+#define PSHINE_CULLING_H_
+#include <pshine/util.h>
+
+// Frustum and horizon culling of bounding spheres.
+
+struct pshine_cull_sphere {
+	double center[3];
+	double radius;
+};
+
+/// The inward-pointing planes (`dot(n, p) + d ≥ 0` inside) of a perspective frustum:
+/// left, right, bottom, top and near. The projection has no far plane.
+struct pshine_cull_frustum {
+	double planes[5][4];
+};
+
+/// `right`, `up` and `forward` are the camera's (orthonormal) axes, `fov_y` is the vertical
+/// field of view in degrees and `aspect` is width over height.
+void pshine_make_cull_frustum(
+	struct pshine_cull_frustum *frustum,
+	const double position[static 3],
+	const double right[static 3],
+	const double up[static 3],
+	const double forward[static 3],
+	double fov_y,
+	double aspect,
+	double znear
+);
+
+/// False if the sphere is entirely outside the frustum. Conservative near the frustum's
+/// edges, where a sphere can be outside while not entirely behind any single plane.
+bool pshine_cull_sphere_in_frustum(const struct pshine_cull_frustum *frustum, const struct pshine_cull_sphere *sphere);
+
+/// True if `occluder` hides all of `sphere` from `camera`: the sphere is within the occluder's
+/// silhouette cone and no nearer than the silhouette. Never true when the camera is inside the occluder.
+bool pshine_cull_sphere_occluded(
+	const double camera[static 3],
+	const struct pshine_cull_sphere *occluder,
+	const struct pshine_cull_sphere *sphere
+);
+
+struct pshine_cull_stats {
+	size_t tested;
+	size_t frustum_culled;
+	size_t occlusion_culled;
+};
+
+/// Set `visible[i]` for every sphere, and add to the stats. A sphere that contains an occluder
+/// (like a body's bounds contain its own surface) is never hidden by it.
+void pshine_cull_spheres(
+	const struct pshine_cull_frustum *frustum,
+	const double camera[static 3],
+	size_t occluder_count,
+	const struct pshine_cull_sphere *occluders,
+	size_t sphere_count,
+	const struct pshine_cull_sphere *spheres,
+	bool *visible,
+	struct pshine_cull_stats *stats
+);
+
+/// Check the frustum and occlusion tests against known configurations and against brute-force
+/// sampling of random spheres. Logs the results and returns false on failure.
+bool pshine_test_culling();
+
+#endif // PSHINE_CULLING_H_
@@ -129,6 +129,7 @@ static struct pshine_celestial_body *load_celestial_body(
 		READ_STR_FIELD(stab, "lights_texture_path", body->surface.lights_texture_path_own);
 		READ_STR_FIELD(stab, "bump_texture_path", body->surface.bump_texture_path_own);
 		READ_STR_FIELD(stab, "heightmap_texture_path", body->surface.heightmap_texture_path_own);
+		READ_FIELD(stab, "heightmap_scale", body->surface.heightmap_scale, double, d);
 	}
 
 	body->rings.has_rings = false;
@@ -256,6 +257,29 @@ void load_game_config(struct pshine_game *game, const char *fpath) {
 		if (window_width.ok) game->renderer->settings.window_width = window_width.u.i;
 		struct toml_datum_t window_height = toml_int_in(gtab, "window_height");
 		if (window_height.ok) game->renderer->settings.window_height = window_height.u.i;
+		struct toml_datum_t frames_in_flight = toml_int_in(gtab, "frames_in_flight");
+		if (frames_in_flight.ok) {
+			if (frames_in_flight.u.i >= 1 && frames_in_flight.u.i <= PSHINE_MAX_FRAMES_IN_FLIGHT)
+				game->renderer->settings.frames_in_flight = frames_in_flight.u.i;
+			else
+				PSHINE_ERROR("game config game.frames_in_flight: must be from 1 to %d, keeping %u.",
+					PSHINE_MAX_FRAMES_IN_FLIGHT, game->renderer->settings.frames_in_flight);
+		}
+		struct toml_datum_t present_mode = toml_string_in(gtab, "present_mode");
+		if (present_mode.ok) {
+			if (strcmp(present_mode.u.s, "fifo") == 0)
+				game->renderer->settings.present_mode = PSHINE_PRESENT_MODE_FIFO;
+			else if (strcmp(present_mode.u.s, "mailbox") == 0)
+				game->renderer->settings.present_mode = PSHINE_PRESENT_MODE_MAILBOX;
+			else if (strcmp(present_mode.u.s, "immediate") == 0)
+				game->renderer->settings.present_mode = PSHINE_PRESENT_MODE_IMMEDIATE;
+			else
+				PSHINE_ERROR("game config game.present_mode: unknown value '%s', "
+					"expected fifo, mailbox or immediate.", present_mode.u.s);
+			free(present_mode.u.s);
+		}
+		struct toml_datum_t low_latency = toml_bool_in(gtab, "low_latency");
+		if (low_latency.ok) game->renderer->settings.low_latency = low_latency.u.b;
 	}
 	toml_table_t *wtab = toml_table_in(tab, "world");
 	if (wtab == nullptr) {
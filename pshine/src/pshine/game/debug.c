@@ -1,4 +1,6 @@
 #include "game.h"
+#include "noise.h"
+#include "heightfield.h"
 #include <dcimgui/dcimgui.h>
 
 static void spectrometry_imgui(struct pshine_game *game, float actual_delta_time) {
@@ -214,6 +216,92 @@ static void science_imgui(struct pshine_game *game, float actual_delta_time) {
 	ImGui_End();
 }
 
+static void terrain_noise_imgui() {
+	static bool initialized = false;
+	static struct pshine_crater_field craters;
+	static struct pshine_surface_layer layers[3];
+	static int thread_count = 0;
+	static int tile_size = 256;
+	static double samples_per_second = 0.0;
+	static int crater_grid_width = 256;
+	static struct pshine_crater_benchmark crater_results[3];
+	static int pyramid_resolution = 1024;
+	static struct pshine_height_pyramid_test_results pyramid_results;
+	if (ImGui_Begin("Terrain Noise", nullptr, 0)) {
+		ImGui_SliderInt("Threads", &thread_count, 0, 64);
+		ImGui_SetItemTooltip("The number of worker threads, 0 means one per core.");
+		ImGui_SliderInt("Tile Size", &tile_size, 16, 1024);
+		if (ImGui_Button("Benchmark")) {
+			if (!initialized) {
+				pshine_init_kj621_surface(&craters, layers);
+				initialized = true;
+			}
+			struct pshine_surface surface = { .layer_count = 3, .layers = layers };
+			samples_per_second = pshine_benchmark_height_tiles(&surface, 16, (uint32_t)tile_size, (size_t)thread_count);
+			PSHINE_INFO("terrain noise: %.0f samples/s", samples_per_second);
+		}
+		ImGui_Text("%.3f M samples/s", samples_per_second / 1'000'000.0);
+
+		ImGui_SeparatorText("Craters");
+		ImGui_SliderInt("Grid Width", &crater_grid_width, 64, 2048);
+		if (ImGui_Button("Benchmark Craters")) {
+			const size_t crater_counts[] = { 1'000, 10'000, 100'000 };
+			for (size_t i = 0; i < 3; ++i) {
+				crater_results[i] = pshine_benchmark_craters(
+					crater_counts[i],
+					(uint32_t)crater_grid_width,
+					(uint32_t)crater_grid_width / 2
+				);
+				PSHINE_INFO(
+					"craters: %zu, build %.3fs, brute force %.3fs, indexed %.3fs, %zu mismatches",
+					crater_results[i].crater_count,
+					crater_results[i].build_seconds,
+					crater_results[i].brute_force_seconds,
+					crater_results[i].indexed_seconds,
+					crater_results[i].mismatch_count
+				);
+			}
+		}
+		for (size_t i = 0; i < 3; ++i) {
+			if (crater_results[i].crater_count == 0) continue;
+			ImGui_Text(
+				"%zu craters: %.3fs -> %.3fs (%.1fx), %zu mismatches",
+				crater_results[i].crater_count,
+				crater_results[i].brute_force_seconds,
+				crater_results[i].indexed_seconds,
+				crater_results[i].brute_force_seconds / crater_results[i].indexed_seconds,
+				crater_results[i].mismatch_count
+			);
+		}
+
+		ImGui_SeparatorText("Terrain Queries");
+		ImGui_SliderInt("Heightmap Width", &pyramid_resolution, 64, 4096);
+		if (ImGui_Button("Test Queries")) {
+			pyramid_results = pshine_test_height_pyramid((uint32_t)pyramid_resolution, 500);
+			pshine_log_height_pyramid_test(&pyramid_results);
+		}
+		if (pyramid_results.ray_count != 0) {
+			ImGui_Text("Ray failures: %zu/%zu", pyramid_results.ray_failures, pyramid_results.ray_count);
+			ImGui_Text(
+				"Max error: %.3fm (tolerance %.3fm)",
+				pyramid_results.max_analytic_error,
+				pyramid_results.analytic_tolerance
+			);
+			ImGui_Text(
+				"Altitude failures: %zu, max height failures: %zu",
+				pyramid_results.altitude_failures,
+				pyramid_results.max_height_failures
+			);
+			ImGui_Text(
+				"%.1fk rays/s, %.3f M altitudes/s",
+				pyramid_results.rays_per_second / 1'000.0,
+				pyramid_results.altitudes_per_second / 1'000'000.0
+			);
+		}
+	}
+	ImGui_End();
+}
+
 void draw_debug_windows(struct pshine_game *game, float actual_delta_time) {
 #define SCSd3_WCSd3(wcs) (double3mul((wcs), PSHINE_SCS_FACTOR))
 #define SCSd3_WCSp3(wcs) SCSd3_WCSd3(double3vs((wcs).values))
@@ -407,6 +495,7 @@ void draw_debug_windows(struct pshine_game *game, float actual_delta_time) {
 		struct pshine_ship *ship = &game->ships.ptr[0];
 		ImGui_Text("Max Velocity: %.1fm/s", ship->current_max_velocity);
 		ImGui_Text("Velocity: %.1fm/s", ship->velocity);
+		ImGui_Text("Altitude: %.1fm", ship->closest_body_altitude);
 		ImGui_Text("Warp: %s", ship->is_in_warp ? "Active" : ship->is_warp_safe ? "Safe" : "Unsafe");
 		float warp_factor = ship->warp_factor;
 		ImGui_SliderFloat("Warp Factor", &warp_factor, 0.1, 100.0);
@@ -521,6 +610,7 @@ void draw_debug_windows(struct pshine_game *game, float actual_delta_time) {
 	ImGui_End();
 
 	science_imgui(game, actual_delta_time);
+	terrain_noise_imgui();
 
 	eximgui_end_frame();
 }
@@ -1,5 +1,6 @@
 #include <string.h>
 #include "game.h"
+#include "heightfield.h"
 #include <pshine/perf.h>
 #include <pshine/util.h>
 #include <dcimgui/dcimgui.h>
@@ -151,6 +152,23 @@ static void init_star_system(struct pshine_game *game, struct pshine_star_system
 			create_orbit_points(system->bodies_own[i], 1000);
 		}
 	}
+
+	for (size_t i = 0; i < system->body_count; ++i) {
+		struct pshine_celestial_body *b = system->bodies_own[i];
+		if (b->surface.heightmap_texture_path_own == nullptr || b->surface.heightmap_scale == 0.0) continue;
+		b->height_pyramid_own = calloc(1, sizeof(struct pshine_height_pyramid));
+		// a few km per sample is plenty for collisions.
+		if (!pshine_load_height_pyramid(
+			b->height_pyramid_own,
+			b->surface.heightmap_texture_path_own,
+			b->radius,
+			b->surface.heightmap_scale,
+			4096
+		)) {
+			free(b->height_pyramid_own);
+			b->height_pyramid_own = nullptr;
+		}
+	}
 }
 
 void sleep_job(struct pshine_job *job) {
@@ -172,6 +190,8 @@ void pshine_init_game(struct pshine_game *game) {
 	game->renderer->settings.render_ships = true;
 	game->renderer->settings.window_width = 1920;
 	game->renderer->settings.window_height = 1080;
+	game->renderer->settings.frames_in_flight = 2;
+	game->renderer->settings.present_mode = PSHINE_PRESENT_MODE_FIFO;
 
 	for (size_t i = 0; i < 1; ++i) {
 		size_t idx = PSHINE_DYNA_ALLOC(game->jobs);
@@ -216,6 +236,23 @@ void pshine_init_game(struct pshine_game *game) {
 		game->ships.ptr[idx].warp_factor = 100.0;
 	}
 
+	// A grid of copies of the first ship around it, for measuring the cost of drawing many ships.
+	if (pshine_check_has_option("--bench-ships")) {
+		enum : size_t { BENCH_SHIP_COUNT = 10'000, BENCH_GRID_SIDE = 22 };
+		const double spacing = 60.0 * PSHINE_SCS_SCALE;
+		for (size_t i = 0; i < BENCH_SHIP_COUNT; ++i) {
+			size_t idx = PSHINE_DYNA_ALLOC(game->ships);
+			struct pshine_ship *first = &game->ships.ptr[0], *ship = &game->ships.ptr[idx];
+			*ship = *first;
+			ship->name_own = pshine_format_string("Benchmark ship #%zu", i + 1);
+			ship->callcode_own = pshine_strdup(first->callcode_own);
+			ship->model_file_own = pshine_strdup(first->model_file_own);
+			ship->position.xyz.x += ((double)(i % BENCH_GRID_SIDE) - BENCH_GRID_SIDE / 2) * spacing;
+			ship->position.xyz.y += ((double)(i / BENCH_GRID_SIDE % BENCH_GRID_SIDE) - BENCH_GRID_SIDE / 2) * spacing;
+			ship->position.xyz.z += ((double)(i / (BENCH_GRID_SIDE * BENCH_GRID_SIDE)) + 1.0) * spacing;
+		}
+	}
+
 	if (game->star_system_count <= 0) {
 		PSHINE_PANIC("No star systems present, there's nothing to show; exiting.");
 	}
@@ -277,6 +314,10 @@ static void deinit_star_system(struct pshine_game *game, struct pshine_star_syst
 		FREE_IF_NOTNULL(b->tmp_parent_ref_name_own);
 		FREE_IF_NOTNULL(b->orbit.cached_points_own);
 #undef FREE_IF_NOTNULL
+		if (b->height_pyramid_own != nullptr) {
+			pshine_free_height_pyramid(b->height_pyramid_own);
+			free(b->height_pyramid_own);
+		}
 		free(b);
 	}
 	free(system->bodies_own);
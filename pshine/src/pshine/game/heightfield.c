@@ -0,0 +1,711 @@
+#include "heightfield.h"
+#include <pshine/game.h>
+#include <math.h>
+#include <float.h>
+#include <stb_image.h>
+
+static constexpr double π = 3.14159265358979323846;
+
+/// Stack size of the ray traversal, enough for 4 children per level plus the top level.
+enum : size_t { HEIGHTFIELD_STACK_SIZE = 256 };
+
+/// The top level has at most this many cells in each direction.
+enum : uint32_t { HEIGHTFIELD_TOP_SIZE = 4 };
+
+static inline double sample_to_height(const struct pshine_height_pyramid *pyramid, double s) {
+	return s * (pyramid->height_scale / 65535.0);
+}
+
+static inline uint32_t level_width(const struct pshine_height_pyramid *pyramid, uint32_t level) {
+	return level == 0 ? pyramid->width : pyramid->levels_own[level - 1].width;
+}
+
+static inline uint32_t level_height(const struct pshine_height_pyramid *pyramid, uint32_t level) {
+	return level == 0 ? pyramid->height - 1 : pyramid->levels_own[level - 1].height;
+}
+
+/// Min and max sample of a cell, level 0 is computed from the samples.
+static inline void cell_min_max(
+	const struct pshine_height_pyramid *pyramid,
+	uint32_t level,
+	uint32_t i,
+	uint32_t j,
+	uint16_t *out_min,
+	uint16_t *out_max
+) {
+	if (level == 0) {
+		uint32_t w = pyramid->width, i1 = (i + 1) % w;
+		const uint16_t *r0 = &pyramid->samples_own[(size_t)j * w], *r1 = r0 + w;
+		uint16_t a = r0[i], b = r0[i1], c = r1[i], d = r1[i1];
+		uint16_t lo = a < b ? a : b, hi = a > b ? a : b;
+		lo = c < lo ? c : lo; hi = c > hi ? c : hi;
+		lo = d < lo ? d : lo; hi = d > hi ? d : hi;
+		*out_min = lo;
+		*out_max = hi;
+		return;
+	}
+	const struct pshine_height_pyramid_level *l = &pyramid->levels_own[level - 1];
+	const uint16_t *mm = &l->min_max_own[((size_t)j * l->width + i) * 2];
+	*out_min = mm[0];
+	*out_max = mm[1];
+}
+
+void pshine_body_rotation_matrix(const struct pshine_celestial_body *body, double m[static 3][3]) {
+	const double *axis = body->rotation_axis.values;
+	double len = sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+	double x = axis[0] / len, y = axis[1] / len, z = axis[2] / len;
+	double c = cos(body->rotation), s = sin(body->rotation), C = 1.0 - c;
+	m[0][0] = c + C * x * x;
+	m[0][1] = C * x * y + s * z;
+	m[0][2] = C * x * z - s * y;
+	m[1][0] = C * y * x - s * z;
+	m[1][1] = c + C * y * y;
+	m[1][2] = C * y * z + s * x;
+	m[2][0] = C * z * x + s * y;
+	m[2][1] = C * z * y - s * x;
+	m[2][2] = c + C * z * z;
+}
+
+void pshine_body_local_vector(const struct pshine_celestial_body *body, const double v[static 3], double out[static 3]) {
+	// the inverse of a rotation is its transpose.
+	double m[3][3];
+	pshine_body_rotation_matrix(body, m);
+	double r[3];
+	for (int i = 0; i < 3; ++i) r[i] = m[i][0] * v[0] + m[i][1] * v[1] + m[i][2] * v[2];
+	memcpy(out, r, sizeof(r));
+}
+
+void pshine_build_height_pyramid(
+	struct pshine_height_pyramid *pyramid,
+	double radius,
+	double height_scale,
+	uint32_t width,
+	uint32_t height,
+	const uint16_t *samples
+) {
+	PSHINE_CHECK(width >= 1 && height >= 2, "a height pyramid needs at least 1x2 samples");
+	*pyramid = (struct pshine_height_pyramid){
+		.radius = radius,
+		.height_scale = height_scale,
+		.width = width,
+		.height = height,
+	};
+	pyramid->samples_own = malloc((size_t)width * height * sizeof(uint16_t));
+	memcpy(pyramid->samples_own, samples, (size_t)width * height * sizeof(uint16_t));
+
+	uint32_t level_count = 1;
+	for (uint32_t w = width, h = height - 1; w > HEIGHTFIELD_TOP_SIZE || h > HEIGHTFIELD_TOP_SIZE; ++level_count) {
+		w = (w + 1) / 2;
+		h = (h + 1) / 2;
+	}
+	pyramid->level_count = level_count;
+	pyramid->levels_own = calloc(level_count, sizeof(struct pshine_height_pyramid_level));
+	for (uint32_t level = 1; level < level_count; ++level) {
+		uint32_t src_w = level_width(pyramid, level - 1), src_h = level_height(pyramid, level - 1);
+		struct pshine_height_pyramid_level *l = &pyramid->levels_own[level - 1];
+		l->width = (src_w + 1) / 2;
+		l->height = (src_h + 1) / 2;
+		l->min_max_own = malloc((size_t)l->width * l->height * 2 * sizeof(uint16_t));
+		for (uint32_t j = 0; j < l->height; ++j) {
+			for (uint32_t i = 0; i < l->width; ++i) {
+				uint16_t lo = UINT16_MAX, hi = 0;
+				for (uint32_t k = 0; k < 4; ++k) {
+					uint32_t ci = i * 2 + (k & 1), cj = j * 2 + (k >> 1);
+					if (ci >= src_w || cj >= src_h) continue;
+					uint16_t a, b;
+					cell_min_max(pyramid, level - 1, ci, cj, &a, &b);
+					lo = a < lo ? a : lo;
+					hi = b > hi ? b : hi;
+				}
+				l->min_max_own[((size_t)j * l->width + i) * 2 + 0] = lo;
+				l->min_max_own[((size_t)j * l->width + i) * 2 + 1] = hi;
+			}
+		}
+	}
+}
+
+bool pshine_load_height_pyramid(
+	struct pshine_height_pyramid *pyramid,
+	const char *path,
+	double radius,
+	double height_scale,
+	uint32_t max_width
+) {
+	int width = 0, height = 0, channels = 0;
+	uint16_t *data = stbi_load_16(path, &width, &height, &channels, 1);
+	if (data == nullptr) {
+		PSHINE_ERROR("Failed to load heightmap '%s': %s", path, stbi_failure_reason());
+		return false;
+	}
+	// box filter by an integer factor, the texture is only used for collisions.
+	uint32_t factor = 1;
+	while ((uint32_t)width / factor > max_width && (uint32_t)height / (factor * 2) >= 2) factor *= 2;
+	uint32_t w = (uint32_t)width / factor, h = (uint32_t)height / factor;
+	uint16_t *samples = data;
+	if (factor > 1) {
+		samples = malloc((size_t)w * h * sizeof(uint16_t));
+		for (uint32_t j = 0; j < h; ++j) {
+			for (uint32_t i = 0; i < w; ++i) {
+				uint64_t sum = 0;
+				for (uint32_t y = 0; y < factor; ++y)
+					for (uint32_t x = 0; x < factor; ++x)
+						sum += data[(size_t)(j * factor + y) * width + i * factor + x];
+				samples[(size_t)j * w + i] = (uint16_t)(sum / ((uint64_t)factor * factor));
+			}
+		}
+	}
+	pshine_build_height_pyramid(pyramid, radius, height_scale, w, h, samples);
+	if (samples != data) free(samples);
+	stbi_image_free(data);
+	PSHINE_DEBUG("Loaded heightmap '%s': %ux%u samples, %u levels", path, w, h, pyramid->level_count);
+	return true;
+}
+
+void pshine_free_height_pyramid(struct pshine_height_pyramid *pyramid) {
+	for (uint32_t level = 1; level < pyramid->level_count; ++level)
+		free(pyramid->levels_own[level - 1].min_max_own);
+	free(pyramid->levels_own);
+	free(pyramid->samples_own);
+	*pyramid = (struct pshine_height_pyramid){};
+}
+
+/// Continuous sample coordinates of a direction: `s` wraps around, `t` is in [0, height - 1].
+static inline void direction_to_sample(
+	const struct pshine_height_pyramid *pyramid,
+	const double p[static 3],
+	double *s,
+	double *t
+) {
+	double len = sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+	double u = atan2(p[2], p[0]) / (2.0 * π);
+	double v = acos(fmin(fmax(p[1] / len, -1.0), 1.0)) / π;
+	u -= floor(u);
+	*s = u * pyramid->width - 0.5;
+	if (*s < 0.0) *s += pyramid->width;
+	*t = fmin(fmax(v * pyramid->height - 0.5, 0.0), (double)(pyramid->height - 1));
+}
+
+double pshine_height_pyramid_height(const struct pshine_height_pyramid *pyramid, const double p[static 3]) {
+	double s, t;
+	direction_to_sample(pyramid, p, &s, &t);
+	uint32_t w = pyramid->width;
+	uint32_t i = (uint32_t)s, j = (uint32_t)t;
+	if (i >= w) i = w - 1;
+	if (j > pyramid->height - 2) j = pyramid->height - 2;
+	double fs = s - i, ft = t - j;
+	uint32_t i1 = (i + 1) % w;
+	const uint16_t *r0 = &pyramid->samples_own[(size_t)j * w], *r1 = r0 + w;
+	double h0 = r0[i] + (r0[i1] - (double)r0[i]) * fs;
+	double h1 = r1[i] + (r1[i1] - (double)r1[i]) * fs;
+	return sample_to_height(pyramid, h0 + (h1 - h0) * ft);
+}
+
+double pshine_height_pyramid_altitude(const struct pshine_height_pyramid *pyramid, const double p[static 3]) {
+	double len = sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+	return len - pyramid->radius - pshine_height_pyramid_height(pyramid, p);
+}
+
+/// The longitude (sample-center based, may exceed 2π) and colatitude ranges of a cell.
+static inline void cell_bounds(
+	const struct pshine_height_pyramid *pyramid,
+	uint32_t level,
+	uint32_t i,
+	uint32_t j,
+	double *lon0,
+	double *lon1,
+	double *colat0,
+	double *colat1
+) {
+	uint32_t w = pyramid->width, cell_rows = pyramid->height - 1;
+	uint32_t i0 = i << level, i1 = (i + 1) << level;
+	uint32_t j0 = j << level, j1 = (j + 1) << level;
+	if (i1 > w) i1 = w;
+	if (j1 > cell_rows) j1 = cell_rows;
+	*lon0 = 2.0 * π * (i0 + 0.5) / w;
+	*lon1 = 2.0 * π * (i1 + 0.5) / w;
+	// the first and last rows also cover the poles (where `t` is clamped).
+	*colat0 = j0 == 0 ? 0.0 : π * (j0 + 0.5) / pyramid->height;
+	*colat1 = j1 == cell_rows ? π : π * (j1 + 0.5) / pyramid->height;
+}
+
+/// The center direction of a cell and the cosine of the largest angle between it and the cell.
+static inline double cell_cone(double lon0, double lon1, double colat0, double colat1, double center[static 3]) {
+	double lon_c = (lon0 + lon1) * 0.5, colat_c = (colat0 + colat1) * 0.5;
+	double half_lon = (lon1 - lon0) * 0.5;
+	center[0] = sin(colat_c) * cos(lon_c);
+	center[1] = cos(colat_c);
+	center[2] = sin(colat_c) * sin(lon_c);
+	if (half_lon >= π) return -1.0;
+	// cos θ = cos c_c cos c + sin c_c sin c cos Δlon is smallest at the largest Δlon,
+	// and then it's `m cos(c - φ)` in the colatitude.
+	double a = cos(colat_c), b = sin(colat_c) * cos(half_lon);
+	double cos_min = fmin(a * cos(colat0) + b * sin(colat0), a * cos(colat1) + b * sin(colat1));
+	double φ = atan2(b, a);
+	if ((colat0 <= φ + π && φ + π <= colat1) || (colat0 <= φ - π && φ - π <= colat1))
+		cos_min = -sqrt(a * a + b * b);
+	return cos_min;
+}
+
+/// A sphere containing everything in the cell between the radii `r0` and `r1`.
+static inline void cell_bounding_sphere(
+	const double center_dir[static 3],
+	double cos_angle,
+	double r0,
+	double r1,
+	double sphere_center[static 3],
+	double *sphere_radius
+) {
+	// any m ≥ 0 works, for a point at angle θ ≤ α and radius r the distance
+	// is sqrt(r² + m² - 2rm cos θ), which is largest at θ = α and r = r0 or r1.
+	double m = cos_angle > 0.0 ? (r0 + r1) * 0.5 * cos_angle : 0.0;
+	double d0 = r0 * r0 + m * m - 2.0 * r0 * m * cos_angle;
+	double d1 = r1 * r1 + m * m - 2.0 * r1 * m * cos_angle;
+	sphere_center[0] = center_dir[0] * m;
+	sphere_center[1] = center_dir[1] * m;
+	sphere_center[2] = center_dir[2] * m;
+	*sphere_radius = sqrt(fmax(d0, d1)) * (1.0 + 1e-9) + 1e-6;
+}
+
+/// The range of `t` where the ray is inside the sphere, false if it misses.
+static inline bool ray_sphere(
+	const double origin[static 3],
+	const double dir[static 3],
+	const double center[static 3],
+	double radius,
+	double *t0,
+	double *t1
+) {
+	double oc[3] = { origin[0] - center[0], origin[1] - center[1], origin[2] - center[2] };
+	double b = oc[0] * dir[0] + oc[1] * dir[1] + oc[2] * dir[2];
+	double c = oc[0] * oc[0] + oc[1] * oc[1] + oc[2] * oc[2] - radius * radius;
+	double d = b * b - c;
+	if (d < 0.0) return false;
+	double s = sqrt(d);
+	*t0 = -b - s;
+	*t1 = -b + s;
+	return *t1 >= 0.0;
+}
+
+struct heightfield_node {
+	uint32_t level, i, j;
+	double t0, t1;
+};
+
+static inline bool node_bounds(
+	const struct pshine_height_pyramid *pyramid,
+	const double origin[static 3],
+	const double dir[static 3],
+	uint32_t level,
+	uint32_t i,
+	uint32_t j,
+	struct heightfield_node *out
+) {
+	double lon0, lon1, colat0, colat1, center_dir[3], center[3], radius;
+	cell_bounds(pyramid, level, i, j, &lon0, &lon1, &colat0, &colat1);
+	double cos_angle = cell_cone(lon0, lon1, colat0, colat1, center_dir);
+	uint16_t lo, hi;
+	cell_min_max(pyramid, level, i, j, &lo, &hi);
+	double r0 = pyramid->radius + sample_to_height(pyramid, lo);
+	double r1 = pyramid->radius + sample_to_height(pyramid, hi);
+	cell_bounding_sphere(center_dir, cos_angle, r0, r1, center, &radius);
+	*out = (struct heightfield_node){ .level = level, .i = i, .j = j };
+	return ray_sphere(origin, dir, center, radius, &out->t0, &out->t1);
+}
+
+static inline double ray_altitude(
+	const struct pshine_height_pyramid *pyramid,
+	const double origin[static 3],
+	const double dir[static 3],
+	double t
+) {
+	double p[3] = { origin[0] + dir[0] * t, origin[1] + dir[1] * t, origin[2] + dir[2] * t };
+	return pshine_height_pyramid_altitude(pyramid, p);
+}
+
+/// March a (short) ray segment inside a sample cell's bounds and refine the first crossing.
+static bool leaf_raycast(
+	const struct pshine_height_pyramid *pyramid,
+	const double origin[static 3],
+	const double dir[static 3],
+	double t0,
+	double t1,
+	double *t_hit
+) {
+	enum { STEPS = 8, REFINE_STEPS = 24 };
+	double prev_t = t0, prev_a = ray_altitude(pyramid, origin, dir, t0);
+	if (prev_a <= 0.0) {
+		*t_hit = t0;
+		return true;
+	}
+	for (int k = 1; k <= STEPS; ++k) {
+		double t = t0 + (t1 - t0) * k / STEPS;
+		double a = ray_altitude(pyramid, origin, dir, t);
+		if (a <= 0.0) {
+			double lo = prev_t, hi = t;
+			for (int r = 0; r < REFINE_STEPS; ++r) {
+				double mid = (lo + hi) * 0.5;
+				if (ray_altitude(pyramid, origin, dir, mid) <= 0.0) hi = mid;
+				else lo = mid;
+			}
+			*t_hit = hi;
+			return true;
+		}
+		prev_t = t;
+		prev_a = a;
+	}
+	return false;
+}
+
+bool pshine_height_pyramid_raycast(
+	const struct pshine_height_pyramid *pyramid,
+	const double origin[static 3],
+	const double dir[static 3],
+	double t_max,
+	double *t_hit
+) {
+	double best = t_max;
+	bool hit = false;
+	if (pshine_height_pyramid_altitude(pyramid, origin) <= 0.0) {
+		*t_hit = 0.0;
+		return true;
+	}
+
+	struct heightfield_node stack[HEIGHTFIELD_STACK_SIZE];
+	size_t stack_size = 0;
+	uint32_t top = pyramid->level_count - 1;
+	for (uint32_t j = 0; j < level_height(pyramid, top); ++j) {
+		for (uint32_t i = 0; i < level_width(pyramid, top); ++i) {
+			struct heightfield_node node;
+			if (node_bounds(pyramid, origin, dir, top, i, j, &node) && node.t0 <= best)
+				stack[stack_size++] = node;
+		}
+	}
+
+	while (stack_size > 0) {
+		struct heightfield_node node = stack[--stack_size];
+		// every hit inside the node is at t ≥ t0.
+		if (node.t0 > best) continue;
+		double t0 = node.t0 > 0.0 ? node.t0 : 0.0;
+		double t1 = node.t1 < best ? node.t1 : best;
+		if (t0 > t1) continue;
+		if (node.level == 0) {
+			double t;
+			if (leaf_raycast(pyramid, origin, dir, t0, t1, &t) && t <= best) {
+				best = t;
+				hit = true;
+			}
+			continue;
+		}
+		struct heightfield_node children[4];
+		size_t child_count = 0;
+		uint32_t w = level_width(pyramid, node.level - 1), h = level_height(pyramid, node.level - 1);
+		for (uint32_t k = 0; k < 4; ++k) {
+			uint32_t ci = node.i * 2 + (k & 1), cj = node.j * 2 + (k >> 1);
+			if (ci >= w || cj >= h) continue;
+			struct heightfield_node child;
+			if (node_bounds(pyramid, origin, dir, node.level - 1, ci, cj, &child) && child.t0 <= best)
+				children[child_count++] = child;
+		}
+		// push the farthest first, so that the nearest one is visited next.
+		for (size_t a = 1; a < child_count; ++a) {
+			for (size_t b = a; b > 0 && children[b - 1].t0 < children[b].t0; --b) {
+				struct heightfield_node tmp = children[b];
+				children[b] = children[b - 1];
+				children[b - 1] = tmp;
+			}
+		}
+		PSHINE_CHECK(stack_size + child_count <= HEIGHTFIELD_STACK_SIZE, "height pyramid stack overflow");
+		for (size_t c = 0; c < child_count; ++c) stack[stack_size++] = children[c];
+	}
+
+	if (hit) *t_hit = best;
+	return hit;
+}
+
+/// The maximum of the cells that intersect the cap, descending only where it can exceed `best`.
+static void max_height_visit(
+	const struct pshine_height_pyramid *pyramid,
+	const double dir[static 3],
+	double cos_cap,
+	double sin_cap,
+	uint32_t level,
+	uint32_t i,
+	uint32_t j,
+	uint16_t *best
+) {
+	uint16_t lo, hi;
+	cell_min_max(pyramid, level, i, j, &lo, &hi);
+	if (hi <= *best) return;
+	double lon0, lon1, colat0, colat1, center[3];
+	cell_bounds(pyramid, level, i, j, &lon0, &lon1, &colat0, &colat1);
+	double cos_cell = cell_cone(lon0, lon1, colat0, colat1, center);
+	// the cell's cone and the cap overlap if the angle between them is at most the sum of the angles.
+	double cos_between = center[0] * dir[0] + center[1] * dir[1] + center[2] * dir[2];
+	double sin_cell = sqrt(fmax(0.0, 1.0 - cos_cell * cos_cell));
+	double cos_sum = cos_cell * cos_cap - sin_cell * sin_cap;
+	bool sum_over_π = acos(fmax(-1.0, fmin(1.0, cos_cell))) + acos(fmax(-1.0, fmin(1.0, cos_cap))) >= π;
+	if (!sum_over_π && cos_between < cos_sum - 1e-12) return;
+	if (level == 0) {
+		*best = hi;
+		return;
+	}
+	uint32_t w = level_width(pyramid, level - 1), h = level_height(pyramid, level - 1);
+	for (uint32_t k = 0; k < 4; ++k) {
+		uint32_t ci = i * 2 + (k & 1), cj = j * 2 + (k >> 1);
+		if (ci < w && cj < h) max_height_visit(pyramid, dir, cos_cap, sin_cap, level - 1, ci, cj, best);
+	}
+}
+
+double pshine_height_pyramid_max_height(
+	const struct pshine_height_pyramid *pyramid,
+	const double p[static 3],
+	double angle
+) {
+	double len = sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+	double dir[3] = { p[0] / len, p[1] / len, p[2] / len };
+	// the sample under `p` is a lower bound, which prunes most of the pyramid right away.
+	uint16_t best = 0;
+	if (pyramid->height_scale > 0.0) {
+		double under = pshine_height_pyramid_height(pyramid, p) / (pyramid->height_scale / 65535.0);
+		best = (uint16_t)fmin(65535.0, fmax(0.0, floor(under)));
+	}
+	angle = fmin(angle, π);
+	double cos_cap = cos(angle), sin_cap = sin(angle);
+	uint32_t top = pyramid->level_count - 1;
+	for (uint32_t j = 0; j < level_height(pyramid, top); ++j)
+		for (uint32_t i = 0; i < level_width(pyramid, top); ++i)
+			max_height_visit(pyramid, dir, cos_cap, sin_cap, top, i, j, &best);
+	return sample_to_height(pyramid, best);
+}
+
+// Tests
+
+/// Smooth bumps, as a function of the direction (so it's continuous at the poles and the seam).
+static double test_bumps(const double d[static 3]) {
+	double x = d[0], y = d[1], z = d[2];
+	return 0.5 + 0.25 * sin(3.0 * x + 1.0) * cos(2.0 * z) + 0.2 * y * y * x;
+}
+
+static void test_fill_samples(uint32_t width, uint32_t height, uint16_t *samples, bool bumps) {
+	for (uint32_t j = 0; j < height; ++j) {
+		double colat = π * (j + 0.5) / height;
+		for (uint32_t i = 0; i < width; ++i) {
+			double lon = 2.0 * π * (i + 0.5) / width;
+			double d[3] = { sin(colat) * cos(lon), cos(colat), sin(colat) * sin(lon) };
+			double v = bumps ? test_bumps(d) : 0.5;
+			samples[(size_t)j * width + i] = (uint16_t)lround(fmin(fmax(v, 0.0), 1.0) * 65535.0);
+		}
+	}
+}
+
+/// Reference: march in small steps from the origin.
+static bool test_brute_force_raycast(
+	const struct pshine_height_pyramid *pyramid,
+	const double origin[static 3],
+	const double dir[static 3],
+	double t_max,
+	double step,
+	double *t_hit
+) {
+	double prev = 0.0;
+	if (ray_altitude(pyramid, origin, dir, 0.0) <= 0.0) {
+		*t_hit = 0.0;
+		return true;
+	}
+	for (double t = step; prev < t_max; t += step) {
+		if (t > t_max) t = t_max;
+		if (ray_altitude(pyramid, origin, dir, t) <= 0.0) {
+			double lo = prev, hi = t;
+			for (int r = 0; r < 48; ++r) {
+				double mid = (lo + hi) * 0.5;
+				if (ray_altitude(pyramid, origin, dir, mid) <= 0.0) hi = mid;
+				else lo = mid;
+			}
+			*t_hit = hi;
+			return true;
+		}
+		prev = t;
+	}
+	return false;
+}
+
+static void test_random_direction(struct pshine_pcg32_state *rng, double out[static 3]) {
+	double z = pshine_pcg32_random_uint32(rng) / 4294967296.0 * 2.0 - 1.0;
+	double a = pshine_pcg32_random_uint32(rng) / 4294967296.0 * 2.0 * π;
+	double r = sqrt(1.0 - z * z);
+	out[0] = r * cos(a);
+	out[1] = z;
+	out[2] = r * sin(a);
+}
+
+struct pshine_height_pyramid_test_results pshine_test_height_pyramid(uint32_t resolution, size_t ray_count) {
+	struct pshine_height_pyramid_test_results results = { .ray_count = ray_count * 2 };
+	struct pshine_pcg32_state rng;
+	pshine_pcg32_init(&rng, 1234);
+	const double radius = 1000.0, height_scale = 100.0;
+	uint32_t width = resolution, height = resolution / 2;
+	uint16_t *samples = malloc((size_t)width * height * sizeof(uint16_t));
+	struct pshine_height_pyramid pyramid;
+
+	// 1. A constant height: the terrain is a sphere, so the hits are analytic.
+	// 2. Smooth bumps: the hits must match a brute-force march over the same samples,
+	//    and lie on the analytic terrain up to the interpolation error.
+	double sample_spacing = 2.0 * π * radius / width;
+	results.analytic_tolerance = height_scale * 2.0 / 65535.0 + height_scale * 0.5 * pow(2.0 * π / width, 2.0) * 16.0;
+	for (int terrain = 0; terrain < 2; ++terrain) {
+		bool bumps = terrain == 1;
+		test_fill_samples(width, height, samples, bumps);
+		pshine_build_height_pyramid(&pyramid, radius, height_scale, width, height, samples);
+		double sphere_radius = radius + sample_to_height(&pyramid, samples[0]);
+		for (size_t k = 0; k < ray_count; ++k) {
+			// from 1.1-2 radii out, towards a random point near the surface (some miss).
+			double from[3], to[3];
+			test_random_direction(&rng, from);
+			test_random_direction(&rng, to);
+			double dist = radius * (1.1 + pshine_pcg32_random_uint32(&rng) / 4294967296.0 * 0.9);
+			double target = radius * (0.9 + pshine_pcg32_random_uint32(&rng) / 4294967296.0 * 0.3);
+			double origin[3] = { from[0] * dist, from[1] * dist, from[2] * dist };
+			double dir[3] = { to[0] * target - origin[0], to[1] * target - origin[1], to[2] * target - origin[2] };
+			double len = sqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+			dir[0] /= len; dir[1] /= len; dir[2] /= len;
+			double t_max = dist * 2.0;
+
+			double t = 0.0;
+			bool hit = pshine_height_pyramid_raycast(&pyramid, origin, dir, t_max, &t);
+			double t_ref = 0.0;
+			bool hit_ref;
+			if (bumps) {
+				hit_ref = test_brute_force_raycast(&pyramid, origin, dir, t_max, sample_spacing * 0.05, &t_ref);
+			} else {
+				double zero[3] = {}, t_far;
+				hit_ref = ray_sphere(origin, dir, zero, sphere_radius, &t_ref, &t_far) && t_ref <= t_max;
+			}
+			// rays that only graze the terrain may legitimately differ.
+			bool grazing = false;
+			if (hit != hit_ref || (hit && fabs(t - t_ref) > 1e-6 * radius)) {
+				double tg = hit ? t : t_ref;
+				double p[3] = { origin[0] + dir[0] * tg, origin[1] + dir[1] * tg, origin[2] + dir[2] * tg };
+				double plen = sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+				double cos_incidence = fabs(p[0] * dir[0] + p[1] * dir[1] + p[2] * dir[2]) / plen;
+				grazing = cos_incidence < 0.02;
+				if (!grazing) ++results.ray_failures;
+			}
+			if (hit && !grazing) {
+				double p[3] = { origin[0] + dir[0] * t, origin[1] + dir[1] * t, origin[2] + dir[2] * t };
+				double plen = sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+				double d[3] = { p[0] / plen, p[1] / plen, p[2] / plen };
+				double analytic = bumps ? fmin(fmax(test_bumps(d), 0.0), 1.0) * height_scale : sphere_radius - radius;
+				double err = fabs(plen - radius - analytic);
+				if (err > results.max_analytic_error) results.max_analytic_error = err;
+			}
+
+			// the altitude of the origin, and the max height around it.
+			double expected = sqrt(origin[0] * origin[0] + origin[1] * origin[1] + origin[2] * origin[2])
+				- radius - pshine_height_pyramid_height(&pyramid, origin);
+			if (fabs(pshine_height_pyramid_altitude(&pyramid, origin) - expected) > 1e-9 * radius)
+				++results.altitude_failures;
+			double angle = 0.05 + pshine_pcg32_random_uint32(&rng) / 4294967296.0 * 0.2;
+			double max_height = pshine_height_pyramid_max_height(&pyramid, origin, angle);
+			for (int s = 0; s < 64; ++s) {
+				// random points in the cap must be at most `max_height`.
+				double q[3];
+				test_random_direction(&rng, q);
+				double scale = angle * (pshine_pcg32_random_uint32(&rng) / 4294967296.0);
+				q[0] = from[0] + q[0] * scale;
+				q[1] = from[1] + q[1] * scale;
+				q[2] = from[2] + q[2] * scale;
+				double qlen = sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2]);
+				double c = (q[0] * from[0] + q[1] * from[1] + q[2] * from[2]) / qlen;
+				if (c < cos(angle)) continue;
+				if (pshine_height_pyramid_height(&pyramid, q) > max_height + 1e-9) {
+					++results.max_height_failures;
+					break;
+				}
+			}
+		}
+		if (bumps) {
+			struct pshine_timeval start = pshine_timeval_now();
+			size_t bench_count = ray_count * 16, hits = 0;
+			for (size_t k = 0; k < bench_count; ++k) {
+				double from[3], to[3];
+				test_random_direction(&rng, from);
+				test_random_direction(&rng, to);
+				double origin[3] = { from[0] * radius * 1.5, from[1] * radius * 1.5, from[2] * radius * 1.5 };
+				double dir[3] = { to[0] * radius - origin[0], to[1] * radius - origin[1], to[2] * radius - origin[2] };
+				double len = sqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+				dir[0] /= len; dir[1] /= len; dir[2] /= len;
+				double t;
+				hits += pshine_height_pyramid_raycast(&pyramid, origin, dir, radius * 3.0, &t);
+			}
+			struct pshine_timeval delta = pshine_timeval_delta(start, pshine_timeval_now());
+			results.rays_per_second = bench_count / ((double)delta.sec + (double)delta.nsec * 1e-9);
+			PSHINE_DEBUG("height pyramid benchmark: %zu/%zu rays hit", hits, bench_count);
+
+			start = pshine_timeval_now();
+			double sum = 0.0;
+			for (size_t k = 0; k < bench_count * 16; ++k) {
+				double p[3];
+				test_random_direction(&rng, p);
+				p[0] *= radius * 1.01; p[1] *= radius * 1.01; p[2] *= radius * 1.01;
+				sum += pshine_height_pyramid_altitude(&pyramid, p);
+			}
+			delta = pshine_timeval_delta(start, pshine_timeval_now());
+			results.altitudes_per_second = bench_count * 16 / ((double)delta.sec + (double)delta.nsec * 1e-9);
+			PSHINE_DEBUG("height pyramid benchmark: mean altitude %f", sum / (bench_count * 16));
+		}
+		pshine_free_height_pyramid(&pyramid);
+	}
+	free(samples);
+
+	// the renderer's model matrix rotates the local frame into the world, `pshine_body_local_vector` must undo it.
+	for (size_t k = 0; k < ray_count; ++k) {
+		struct pshine_celestial_body body = { .rotation = pshine_pcg32_random_uint32(&rng) / 4294967296.0 * 2.0 * π };
+		test_random_direction(&rng, body.rotation_axis.values);
+		double local[3], world[3], back[3], m[3][3];
+		test_random_direction(&rng, local);
+		pshine_body_rotation_matrix(&body, m);
+		for (int i = 0; i < 3; ++i) world[i] = m[0][i] * local[0] + m[1][i] * local[1] + m[2][i] * local[2];
+		pshine_body_local_vector(&body, world, back);
+		double err = fabs(back[0] - local[0]) + fabs(back[1] - local[1]) + fabs(back[2] - local[2]);
+		if (err > 1e-12) ++results.frame_failures;
+	}
+	{
+		// a quarter turn around +Y takes +X to -Z, like the model matrix always did.
+		struct pshine_celestial_body body = { .rotation_axis.values = { 0.0, 1.0, 0.0 }, .rotation = π / 2.0 };
+		double back[3];
+		pshine_body_local_vector(&body, (double[3]){ 0.0, 0.0, -1.0 }, back);
+		if (fabs(back[0] - 1.0) + fabs(back[1]) + fabs(back[2]) > 1e-12) ++results.frame_failures;
+	}
+	return results;
+}
+
+bool pshine_height_pyramid_test_passed(const struct pshine_height_pyramid_test_results *results) {
+	return results->ray_failures == 0
+		&& results->max_analytic_error <= results->analytic_tolerance
+		&& results->altitude_failures == 0
+		&& results->max_height_failures == 0
+		&& results->frame_failures == 0;
+}
+
+void pshine_log_height_pyramid_test(const struct pshine_height_pyramid_test_results *results) {
+	PSHINE_INFO(
+		"terrain queries: %zu/%zu ray failures, max error %.3fm (tolerance %.3fm), %zu altitude failures, "
+		"%zu max height failures, %zu frame failures, %.0f rays/s, %.0f altitudes/s%s",
+		results->ray_failures,
+		results->ray_count,
+		results->max_analytic_error,
+		results->analytic_tolerance,
+		results->altitude_failures,
+		results->max_height_failures,
+		results->frame_failures,
+		results->rays_per_second,
+		results->altitudes_per_second,
+		pshine_height_pyramid_test_passed(results) ? "" : " FAILED"
+	);
+}
+
+bool pshine_check_height_pyramid(uint32_t resolution, size_t ray_count) {
+	struct pshine_height_pyramid_test_results results = pshine_test_height_pyramid(resolution, ray_count);
+	pshine_log_height_pyramid_test(&results);
+	return pshine_height_pyramid_test_passed(&results);
+}
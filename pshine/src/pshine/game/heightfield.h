@@ -0,0 +1,118 @@
+#ifndef PSHINE_GAME_HEIGHTFIELD_H_
+#define PSHINE_GAME_HEIGHTFIELD_H_
+#include <pshine/util.h>
+
+// Terrain heights of a celestial body for the CPU side (ship collisions, altitude).
+// The heights are an equirectangular grid with the same mapping as the heightmap
+// texture in `mesh.vert`: `u = atan2(z, x) / 2π`, `v = acos(y) / π`, sampled at texel
+// centers and interpolated bilinearly. On top of it is a min/max pyramid, so that
+// ray and proximity queries can skip the parts of the sphere they can't touch.
+// All positions are in the body's local (unrotated) frame, in meters.
+
+struct pshine_celestial_body;
+
+/// The body's rotation, the upper left of its model matrix (see `write_game_frame_data`), column-major
+/// (`m[column][row]`): the local vector `v` is `m * v` in the world.
+void pshine_body_rotation_matrix(const struct pshine_celestial_body *body, double m[static 3][3]);
+
+/// Undo the body's rotation, so that `v` (relative to the body) is in its local frame. `out` may be `v`.
+void pshine_body_local_vector(const struct pshine_celestial_body *body, const double v[static 3], double out[static 3]);
+
+/// Cell `(i, j)` of level `l` covers the `2^l × 2^l` sample cells (quads between
+/// 4 neighbouring samples) starting at `(i * 2^l, j * 2^l)`.
+struct pshine_height_pyramid_level {
+	uint32_t width, height;
+	/// `width * height` ⟨min, max⟩ pairs, in sample units.
+	uint16_t *min_max_own;
+};
+
+struct pshine_height_pyramid {
+	/// The radius of the zero height, in m.
+	double radius;
+	/// The height of a sample value of 65535, in m.
+	double height_scale;
+	/// `width` samples around the equator, `height` from the north (+Y) to the south pole.
+	uint32_t width, height;
+	uint16_t *samples_own;
+	/// Level 0 (the sample cells) isn't stored, `levels_own[0]` is level 1.
+	uint32_t level_count;
+	struct pshine_height_pyramid_level *levels_own;
+};
+
+/// Build the pyramid from `width * height` row-major samples (0 to 65535), which are copied.
+void pshine_build_height_pyramid(
+	struct pshine_height_pyramid *pyramid,
+	double radius,
+	double height_scale,
+	uint32_t width,
+	uint32_t height,
+	const uint16_t *samples
+);
+
+/// Load the samples from a (8 or 16 bit) heightmap image, box-filtering it down to at most `max_width` wide.
+/// Returns false if the image couldn't be loaded.
+bool pshine_load_height_pyramid(
+	struct pshine_height_pyramid *pyramid,
+	const char *path,
+	double radius,
+	double height_scale,
+	uint32_t max_width
+);
+
+void pshine_free_height_pyramid(struct pshine_height_pyramid *pyramid);
+
+/// The terrain height (above `radius`) in the direction of `p`.
+double pshine_height_pyramid_height(const struct pshine_height_pyramid *pyramid, const double p[static 3]);
+
+/// The height of `p` above the terrain directly below it (negative if it's underground).
+double pshine_height_pyramid_altitude(const struct pshine_height_pyramid *pyramid, const double p[static 3]);
+
+/// An upper bound of the terrain height within `angle` radians of the direction of `p`,
+/// at most one sample cell's relief above the exact value.
+double pshine_height_pyramid_max_height(
+	const struct pshine_height_pyramid *pyramid,
+	const double p[static 3],
+	double angle
+);
+
+/// Find the first point where the ray `origin + t * dir` (`dir` normalized), `0 ≤ t ≤ t_max`,
+/// hits the terrain. Returns false if there's no hit, otherwise stores the distance in `*t_hit`.
+/// If the origin is underground, the hit is at `t = 0`.
+bool pshine_height_pyramid_raycast(
+	const struct pshine_height_pyramid *pyramid,
+	const double origin[static 3],
+	const double dir[static 3],
+	double t_max,
+	double *t_hit
+);
+
+struct pshine_height_pyramid_test_results {
+	size_t ray_count;
+	/// Rays whose hit differs from a brute-force march over the same heights.
+	size_t ray_failures;
+	/// The largest difference between the hit point's altitude and the analytic terrain, in m.
+	double max_analytic_error;
+	/// The bound `max_analytic_error` is checked against.
+	double analytic_tolerance;
+	size_t altitude_failures;
+	size_t max_height_failures;
+	/// Local vectors that don't come back from the world through `pshine_body_local_vector`.
+	size_t frame_failures;
+	double rays_per_second;
+	double altitudes_per_second;
+};
+
+/// Check the queries against analytic terrain (a constant height and smooth bumps) and the body's
+/// local frame against its model matrix, then benchmark the queries.
+/// `resolution` is the width of the generated heightmaps.
+struct pshine_height_pyramid_test_results pshine_test_height_pyramid(uint32_t resolution, size_t ray_count);
+
+/// No failures, and the analytic error is within the tolerance.
+bool pshine_height_pyramid_test_passed(const struct pshine_height_pyramid_test_results *results);
+
+void pshine_log_height_pyramid_test(const struct pshine_height_pyramid_test_results *results);
+
+/// Run `pshine_test_height_pyramid`, log the results and return false on failure (`--test-height-pyramid`).
+bool pshine_check_height_pyramid(uint32_t resolution, size_t ray_count);
+
+#endif // PSHINE_GAME_HEIGHTFIELD_H_
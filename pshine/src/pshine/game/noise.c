@@ -0,0 +1,1208 @@
+#include "noise.h"
+#include <math.h>
+#include <stdatomic.h>
+
+// The results have to match surfgen bit-for-bit, which doesn't contract a * b + c into FMAs.
+#pragma STDC FP_CONTRACT OFF
+
+static constexpr double π = 3.14159265358979323846;
+
+static inline uint32_t noise_hash(uint32_t seed, int32_t x, int32_t y, int32_t z) {
+	uint32_t h = seed;
+	h ^= (uint32_t)x * 0x8da6b343u;
+	h ^= (uint32_t)y * 0xd8163841u;
+	h ^= (uint32_t)z * 0xcb1ab31fu;
+	h ^= h >> 16;
+	h *= 0x7feb352du;
+	h ^= h >> 15;
+	h *= 0x846ca68bu;
+	h ^= h >> 16;
+	return h;
+}
+
+/// One of the 12 cube edge directions (and 4 repeated), dotted with ⟨x,y,z⟩.
+static inline double noise_grad(uint32_t h, double x, double y, double z) {
+	h &= 15;
+	double u = h < 8 ? x : y;
+	double v = h < 4 ? y : (h == 12 || h == 14 ? x : z);
+	return ((h & 1) ? -u : u) + ((h & 2) ? -v : v);
+}
+
+static inline double noise_fade(double t) {
+	return t * t * t * (t * (t * 6.0 - 15.0) + 10.0);
+}
+
+static inline double noise_lerp(double a, double b, double t) {
+	return a + t * (b - a);
+}
+
+static inline double noise_perlin(uint32_t seed, double x, double y, double z) {
+	double fx = floor(x), fy = floor(y), fz = floor(z);
+	int32_t ix = (int32_t)fx, iy = (int32_t)fy, iz = (int32_t)fz;
+	x -= fx; y -= fy; z -= fz;
+	double u = noise_fade(x), v = noise_fade(y), w = noise_fade(z);
+	double
+		n000 = noise_grad(noise_hash(seed, ix,     iy,     iz    ), x,       y,       z      ),
+		n100 = noise_grad(noise_hash(seed, ix + 1, iy,     iz    ), x - 1.0, y,       z      ),
+		n010 = noise_grad(noise_hash(seed, ix,     iy + 1, iz    ), x,       y - 1.0, z      ),
+		n110 = noise_grad(noise_hash(seed, ix + 1, iy + 1, iz    ), x - 1.0, y - 1.0, z      ),
+		n001 = noise_grad(noise_hash(seed, ix,     iy,     iz + 1), x,       y,       z - 1.0),
+		n101 = noise_grad(noise_hash(seed, ix + 1, iy,     iz + 1), x - 1.0, y,       z - 1.0),
+		n011 = noise_grad(noise_hash(seed, ix,     iy + 1, iz + 1), x,       y - 1.0, z - 1.0),
+		n111 = noise_grad(noise_hash(seed, ix + 1, iy + 1, iz + 1), x - 1.0, y - 1.0, z - 1.0);
+	return noise_lerp(
+		noise_lerp(noise_lerp(n000, n100, u), noise_lerp(n010, n110, u), v),
+		noise_lerp(noise_lerp(n001, n101, u), noise_lerp(n011, n111, u), v),
+		w
+	);
+}
+
+double pshine_noise_perlin(uint32_t seed, double x, double y, double z) {
+	return noise_perlin(seed, x, y, z);
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+// `noise_perlin` on all the lanes at once, in GCC/Clang vector types. It does the same operations
+// (branches become masks), so the results are the same bits.
+
+typedef double noise_f64xl __attribute__((vector_size(PSHINE_NOISE_LANES * sizeof(double))));
+typedef int64_t noise_i64xl __attribute__((vector_size(PSHINE_NOISE_LANES * sizeof(int64_t))));
+typedef uint64_t noise_u64xl __attribute__((vector_size(PSHINE_NOISE_LANES * sizeof(uint64_t))));
+typedef int32_t noise_i32xl __attribute__((vector_size(PSHINE_NOISE_LANES * sizeof(int32_t))));
+typedef uint32_t noise_u32xl __attribute__((vector_size(PSHINE_NOISE_LANES * sizeof(uint32_t))));
+
+// always inlined, so the vectors never have to be passed in memory.
+#define NOISE_LANES_FN static inline __attribute__((__always_inline__))
+
+NOISE_LANES_FN noise_u32xl noise_hash_lanes(uint32_t seed, noise_i32xl x, noise_i32xl y, noise_i32xl z) {
+	noise_u32xl h = (noise_u32xl){} + seed;
+	h ^= (noise_u32xl)x * 0x8da6b343u;
+	h ^= (noise_u32xl)y * 0xd8163841u;
+	h ^= (noise_u32xl)z * 0xcb1ab31fu;
+	h ^= h >> 16;
+	h *= 0x7feb352du;
+	h ^= h >> 15;
+	h *= 0x846ca68bu;
+	h ^= h >> 16;
+	return h;
+}
+
+NOISE_LANES_FN noise_f64xl noise_grad_lanes(noise_u32xl h32, noise_f64xl x, noise_f64xl y, noise_f64xl z) {
+	noise_u64xl h = __builtin_convertvector(h32 & 15u, noise_u64xl);
+	noise_u64xl xb = (noise_u64xl)x, yb = (noise_u64xl)y, zb = (noise_u64xl)z;
+	noise_u64xl u_is_x = (noise_u64xl)(h < 8), v_is_y = (noise_u64xl)(h < 4);
+	noise_u64xl v_is_x = ~v_is_y & (noise_u64xl)((h == 12) | (h == 14));
+	noise_u64xl u = (xb & u_is_x) | (yb & ~u_is_x);
+	noise_u64xl v = (yb & v_is_y) | (xb & v_is_x) | (zb & ~(v_is_y | v_is_x));
+	// negating is flipping the sign bit.
+	u ^= (h & 1) << 63;
+	v ^= (h & 2) << 62;
+	return (noise_f64xl)u + (noise_f64xl)v;
+}
+
+/// Replaces `x` with `x - floor(x)` and returns `floor(x)`.
+NOISE_LANES_FN noise_i32xl noise_floor_lanes(noise_f64xl *x) {
+	noise_i32xl i = __builtin_convertvector(*x, noise_i32xl);
+	// the conversion truncates, which rounds negative numbers up.
+	i += __builtin_convertvector(__builtin_convertvector(i, noise_f64xl) > *x, noise_i32xl);
+	// + 0.0 turns -0.0 into 0.0, like `x - floor(x)` does.
+	*x = *x - __builtin_convertvector(i, noise_f64xl) + 0.0;
+	return i;
+}
+
+NOISE_LANES_FN noise_f64xl noise_fade_lanes(noise_f64xl t) {
+	return t * t * t * (t * (t * 6.0 - 15.0) + 10.0);
+}
+
+NOISE_LANES_FN noise_f64xl noise_lerp_lanes(noise_f64xl a, noise_f64xl b, noise_f64xl t) {
+	return a + t * (b - a);
+}
+
+NOISE_LANES_FN noise_f64xl noise_perlin_vector(uint32_t seed, noise_f64xl x, noise_f64xl y, noise_f64xl z) {
+	noise_i32xl ix = noise_floor_lanes(&x), iy = noise_floor_lanes(&y), iz = noise_floor_lanes(&z);
+	noise_f64xl u = noise_fade_lanes(x), v = noise_fade_lanes(y), w = noise_fade_lanes(z);
+	noise_f64xl
+		n000 = noise_grad_lanes(noise_hash_lanes(seed, ix,     iy,     iz    ), x,       y,       z      ),
+		n100 = noise_grad_lanes(noise_hash_lanes(seed, ix + 1, iy,     iz    ), x - 1.0, y,       z      ),
+		n010 = noise_grad_lanes(noise_hash_lanes(seed, ix,     iy + 1, iz    ), x,       y - 1.0, z      ),
+		n110 = noise_grad_lanes(noise_hash_lanes(seed, ix + 1, iy + 1, iz    ), x - 1.0, y - 1.0, z      ),
+		n001 = noise_grad_lanes(noise_hash_lanes(seed, ix,     iy,     iz + 1), x,       y,       z - 1.0),
+		n101 = noise_grad_lanes(noise_hash_lanes(seed, ix + 1, iy,     iz + 1), x - 1.0, y,       z - 1.0),
+		n011 = noise_grad_lanes(noise_hash_lanes(seed, ix,     iy + 1, iz + 1), x,       y - 1.0, z - 1.0),
+		n111 = noise_grad_lanes(noise_hash_lanes(seed, ix + 1, iy + 1, iz + 1), x - 1.0, y - 1.0, z - 1.0);
+	return noise_lerp_lanes(
+		noise_lerp_lanes(noise_lerp_lanes(n000, n100, u), noise_lerp_lanes(n010, n110, u), v),
+		noise_lerp_lanes(noise_lerp_lanes(n001, n101, u), noise_lerp_lanes(n011, n111, u), v),
+		w
+	);
+}
+#undef NOISE_LANES_FN
+#endif
+
+/// `noise_perlin` on the first `n` of `PSHINE_NOISE_LANES` points; the other lanes of `out` are zeros.
+/// A partial group goes through the scalar path, so single points don't pay for the whole vector.
+static inline void noise_perlin_lanes(
+	uint32_t seed,
+	size_t n,
+	const double xs[static PSHINE_NOISE_LANES],
+	const double ys[static PSHINE_NOISE_LANES],
+	const double zs[static PSHINE_NOISE_LANES],
+	double out[static PSHINE_NOISE_LANES]
+) {
+#if defined(__GNUC__) || defined(__clang__)
+	if (n < PSHINE_NOISE_LANES) {
+		for (size_t l = 0; l < PSHINE_NOISE_LANES; ++l) out[l] = l < n ? noise_perlin(seed, xs[l], ys[l], zs[l]) : 0.0;
+		return;
+	}
+	noise_f64xl x, y, z;
+	memcpy(&x, xs, sizeof(x));
+	memcpy(&y, ys, sizeof(y));
+	memcpy(&z, zs, sizeof(z));
+	noise_f64xl r = noise_perlin_vector(seed, x, y, z);
+	memcpy(out, &r, sizeof(r));
+#else
+	for (size_t l = 0; l < PSHINE_NOISE_LANES; ++l) out[l] = l < n ? noise_perlin(seed, xs[l], ys[l], zs[l]) : 0.0;
+#endif
+}
+
+static inline double fractal_amplitude_sum(const struct pshine_noise_fractal_params *params) {
+	double sum = 0.0, amp = 1.0;
+	for (uint32_t o = 0; o < params->octaves; ++o) {
+		sum += amp;
+		amp *= params->persistence;
+	}
+	return sum;
+}
+
+double pshine_noise_fbm(const struct pshine_noise_fractal_params *params, double x, double y, double z) {
+	double r = 0.0;
+	pshine_noise_fbm_batch(params, 1, &x, &y, &z, &r);
+	return r;
+}
+
+double pshine_noise_ridged(const struct pshine_noise_fractal_params *params, double x, double y, double z) {
+	double r = 0.0;
+	pshine_noise_ridged_batch(params, 1, &x, &y, &z, &r);
+	return r;
+}
+
+void pshine_noise_fbm_batch(
+	const struct pshine_noise_fractal_params *params,
+	size_t count,
+	const double *xs,
+	const double *ys,
+	const double *zs,
+	double *out
+) {
+	double inv_amp_sum = 1.0 / fractal_amplitude_sum(params);
+	for (size_t i = 0; i < count; i += PSHINE_NOISE_LANES) {
+		size_t n = count - i < PSHINE_NOISE_LANES ? count - i : PSHINE_NOISE_LANES;
+		// the unused lanes are zeros.
+		double px[PSHINE_NOISE_LANES] = {}, py[PSHINE_NOISE_LANES] = {}, pz[PSHINE_NOISE_LANES] = {};
+		double acc[PSHINE_NOISE_LANES] = {}, v[PSHINE_NOISE_LANES];
+		for (size_t l = 0; l < n; ++l) {
+			px[l] = xs[i + l] * params->frequency;
+			py[l] = ys[i + l] * params->frequency;
+			pz[l] = zs[i + l] * params->frequency;
+		}
+		double amp = 1.0;
+		for (uint32_t o = 0; o < params->octaves; ++o) {
+			noise_perlin_lanes(params->seed + o, n, px, py, pz, v);
+			for (size_t l = 0; l < PSHINE_NOISE_LANES; ++l) {
+				acc[l] += v[l] * amp;
+				px[l] *= params->lacunarity;
+				py[l] *= params->lacunarity;
+				pz[l] *= params->lacunarity;
+			}
+			amp *= params->persistence;
+		}
+		for (size_t l = 0; l < n; ++l) out[i + l] = acc[l] * inv_amp_sum;
+	}
+}
+
+void pshine_noise_ridged_batch(
+	const struct pshine_noise_fractal_params *params,
+	size_t count,
+	const double *xs,
+	const double *ys,
+	const double *zs,
+	double *out
+) {
+	double inv_amp_sum = 1.0 / fractal_amplitude_sum(params);
+	for (size_t i = 0; i < count; i += PSHINE_NOISE_LANES) {
+		size_t n = count - i < PSHINE_NOISE_LANES ? count - i : PSHINE_NOISE_LANES;
+		double px[PSHINE_NOISE_LANES] = {}, py[PSHINE_NOISE_LANES] = {}, pz[PSHINE_NOISE_LANES] = {};
+		double acc[PSHINE_NOISE_LANES] = {}, weight[PSHINE_NOISE_LANES], v[PSHINE_NOISE_LANES];
+		for (size_t l = 0; l < PSHINE_NOISE_LANES; ++l) weight[l] = 1.0;
+		for (size_t l = 0; l < n; ++l) {
+			px[l] = xs[i + l] * params->frequency;
+			py[l] = ys[i + l] * params->frequency;
+			pz[l] = zs[i + l] * params->frequency;
+		}
+		double amp = 1.0;
+		for (uint32_t o = 0; o < params->octaves; ++o) {
+			noise_perlin_lanes(params->seed + o, n, px, py, pz, v);
+			for (size_t l = 0; l < PSHINE_NOISE_LANES; ++l) {
+				double signal = 1.0 - fabs(v[l]);
+				signal *= signal;
+				signal *= weight[l];
+				double w = signal / params->attenuation;
+				weight[l] = w < 0.0 ? 0.0 : w > 1.0 ? 1.0 : w;
+				acc[l] += signal * amp;
+				px[l] *= params->lacunarity;
+				py[l] *= params->lacunarity;
+				pz[l] *= params->lacunarity;
+			}
+			amp *= params->persistence;
+		}
+		for (size_t l = 0; l < n; ++l) out[i + l] = acc[l] * inv_amp_sum * 2.0 - 1.0;
+	}
+}
+
+// OpenSimplex, ported from the `noise` crate (0.9, with rand 0.8 and rand_xorshift 0.3).
+
+/// rand_xorshift's `XorShiftRng`.
+struct noise_xorshift {
+	uint32_t x, y, z, w;
+};
+
+static inline uint32_t noise_xorshift_next(struct noise_xorshift *rng) {
+	uint32_t t = rng->x ^ (rng->x << 11);
+	rng->x = rng->y;
+	rng->y = rng->z;
+	rng->z = rng->w;
+	rng->w = rng->w ^ (rng->w >> 19) ^ (t ^ (t >> 8));
+	return rng->w;
+}
+
+/// rand's `gen_range(0..bound)` for `u32`: the high half of a widening multiply, rejecting the low
+/// halves that would make it biased.
+static inline uint32_t noise_xorshift_below(struct noise_xorshift *rng, uint32_t bound) {
+	uint32_t zone = (bound << __builtin_clz(bound)) - 1;
+	for (;;) {
+		uint64_t m = (uint64_t)noise_xorshift_next(rng) * bound;
+		if ((uint32_t)m <= zone) return (uint32_t)(m >> 32);
+	}
+}
+
+void pshine_init_noise_permutation_table(struct pshine_noise_permutation_table *table, uint32_t seed) {
+	// the 16-byte seed is 1, then the seed three times (little-endian), and a zero seed isn't special.
+	struct noise_xorshift rng = { .x = 1, .y = seed, .z = seed, .w = seed };
+	for (uint32_t i = 0; i < 256; ++i) table->values[i] = (uint8_t)i;
+	// rand's `shuffle`.
+	for (uint32_t i = 255; i > 0; --i) {
+		uint32_t j = noise_xorshift_below(&rng, i + 1);
+		uint8_t t = table->values[i];
+		table->values[i] = table->values[j];
+		table->values[j] = t;
+	}
+}
+
+static inline uint32_t noise_permutation_hash(const struct pshine_noise_permutation_table *table, int64_t x, int64_t y, int64_t z) {
+	return table->values[table->values[table->values[x & 0xff] ^ (y & 0xff)] ^ (z & 0xff)];
+}
+
+/// compiler-rt's `__powidf2`, which Rust's `powi` calls: the result depends on the order of the multiplications.
+static inline double noise_powi(double a, int32_t b) {
+	bool recip = b < 0;
+	uint32_t n = recip ? -(uint32_t)b : (uint32_t)b;
+	double r = 1.0;
+	for (;;) {
+		if (n & 1) r *= a;
+		n >>= 1;
+		if (n == 0) break;
+		a *= a;
+	}
+	return recip ? 1.0 / r : r;
+}
+
+/// The 12 cube edge directions twice, then the 8 corners, all normalized.
+static constexpr double NOISE_GRAD3[32][3] = {
+#define D 0.70710678118654752440
+	{  D,  D, 0 }, { -D,  D, 0 }, {  D, -D, 0 }, { -D, -D, 0 },
+	{  D, 0,  D }, { -D, 0,  D }, {  D, 0, -D }, { -D, 0, -D },
+	{ 0,  D,  D }, { 0, -D,  D }, { 0,  D, -D }, { 0, -D, -D },
+	{  D,  D, 0 }, { -D,  D, 0 }, {  D, -D, 0 }, { -D, -D, 0 },
+	{  D, 0,  D }, { -D, 0,  D }, {  D, 0, -D }, { -D, 0, -D },
+	{ 0,  D,  D }, { 0, -D,  D }, { 0,  D, -D }, { 0, -D, -D },
+#undef D
+#define D 0.5773502691896258
+	{  D,  D,  D }, { -D,  D,  D }, {  D, -D,  D }, { -D, -D,  D },
+	{  D,  D, -D }, { -D,  D, -D }, {  D, -D, -D }, { -D, -D, -D },
+#undef D
+};
+
+static constexpr double NOISE_STRETCH_3D = -1.0 / 6.0;
+static constexpr double NOISE_SQUISH_3D = 1.0 / 3.0;
+
+/// The contribution of the lattice vertex `floor + offset`.
+static inline double noise_open_simplex_vertex(
+	const struct pshine_noise_permutation_table *table,
+	const double floor[static 3],
+	const double rel[static 3],
+	double ox,
+	double oy,
+	double oz
+) {
+	double squish = NOISE_SQUISH_3D * (ox + oy + oz);
+	double dx = rel[0] - squish - ox, dy = rel[1] - squish - oy, dz = rel[2] - squish - oz;
+	double attn = 2.0 - (dx * dx + dy * dy + dz * dz);
+	if (!(attn > 0.0)) return 0.0;
+	const double *g = NOISE_GRAD3[noise_permutation_hash(
+		table, (int64_t)(floor[0] + ox), (int64_t)(floor[1] + oy), (int64_t)(floor[2] + oz)
+	) % 32];
+	return noise_powi(attn, 4) * (dx * g[0] + dy * g[1] + dz * g[2]);
+}
+
+double pshine_noise_open_simplex(const struct pshine_noise_permutation_table *table, double x, double y, double z) {
+	// place the point on the simplectic honeycomb, and find the rhombohedron it's in.
+	double stretch = (x + y + z) * NOISE_STRETCH_3D;
+	double sx = x + stretch, sy = y + stretch, sz = z + stretch;
+	double floor3[3] = { floor(sx), floor(sy), floor(sz) };
+	double squish = (floor3[0] + floor3[1] + floor3[2]) * NOISE_SQUISH_3D;
+	double rel[3] = { x - (floor3[0] + squish), y - (floor3[1] + squish), z - (floor3[2] + squish) };
+	double region = (sx - floor3[0]) + (sy - floor3[1]) + (sz - floor3[2]);
+	double value = 0.0;
+	if (region <= 1.0) {
+		// the tetrahedron at (0, 0, 0).
+		value += noise_open_simplex_vertex(table, floor3, rel, 0.0, 0.0, 0.0);
+		value += noise_open_simplex_vertex(table, floor3, rel, 1.0, 0.0, 0.0);
+		value += noise_open_simplex_vertex(table, floor3, rel, 0.0, 1.0, 0.0);
+		value += noise_open_simplex_vertex(table, floor3, rel, 0.0, 0.0, 1.0);
+	} else if (region >= 2.0) {
+		// the tetrahedron at (1, 1, 1).
+		value += noise_open_simplex_vertex(table, floor3, rel, 1.0, 1.0, 0.0);
+		value += noise_open_simplex_vertex(table, floor3, rel, 1.0, 0.0, 1.0);
+		value += noise_open_simplex_vertex(table, floor3, rel, 0.0, 1.0, 1.0);
+		value += noise_open_simplex_vertex(table, floor3, rel, 1.0, 1.0, 1.0);
+	} else {
+		// the octahedron between them.
+		value += noise_open_simplex_vertex(table, floor3, rel, 1.0, 0.0, 0.0);
+		value += noise_open_simplex_vertex(table, floor3, rel, 0.0, 1.0, 0.0);
+		value += noise_open_simplex_vertex(table, floor3, rel, 0.0, 0.0, 1.0);
+		value += noise_open_simplex_vertex(table, floor3, rel, 1.0, 1.0, 0.0);
+		value += noise_open_simplex_vertex(table, floor3, rel, 1.0, 0.0, 1.0);
+		value += noise_open_simplex_vertex(table, floor3, rel, 0.0, 1.0, 1.0);
+	}
+	return value * (1.0 / 14.0);
+}
+
+void pshine_init_ridged_multi(struct pshine_ridged_multi *noise, const struct pshine_noise_fractal_params *params) {
+	PSHINE_CHECK(params->octaves <= PSHINE_RIDGED_MULTI_MAX_OCTAVES, "too many ridged multifractal octaves");
+	noise->params = *params;
+	double sum = 0.0;
+	for (uint32_t o = 0; o < params->octaves; ++o) sum += noise_powi(params->persistence, (int32_t)o);
+	noise->scale_factor = 1.0 / sum;
+	for (uint32_t o = 0; o < params->octaves; ++o) pshine_init_noise_permutation_table(&noise->tables[o], params->seed + o);
+}
+
+double pshine_noise_ridged_multi(const struct pshine_ridged_multi *noise, double x, double y, double z) {
+	double r = 0.0;
+	pshine_noise_ridged_multi_batch(noise, 1, &x, &y, &z, &r);
+	return r;
+}
+
+void pshine_noise_ridged_multi_batch(
+	const struct pshine_ridged_multi *noise,
+	size_t count,
+	const double *xs,
+	const double *ys,
+	const double *zs,
+	double *out
+) {
+	const struct pshine_noise_fractal_params *params = &noise->params;
+	for (size_t i = 0; i < count; i += PSHINE_NOISE_LANES) {
+		size_t n = count - i < PSHINE_NOISE_LANES ? count - i : PSHINE_NOISE_LANES;
+		double px[PSHINE_NOISE_LANES], py[PSHINE_NOISE_LANES], pz[PSHINE_NOISE_LANES];
+		double acc[PSHINE_NOISE_LANES], weight[PSHINE_NOISE_LANES];
+		for (size_t l = 0; l < n; ++l) {
+			px[l] = xs[i + l] * params->frequency;
+			py[l] = ys[i + l] * params->frequency;
+			pz[l] = zs[i + l] * params->frequency;
+			acc[l] = 0.0;
+			weight[l] = 1.0;
+		}
+		for (uint32_t o = 0; o < params->octaves; ++o) {
+			double amp = noise_powi(params->persistence, (int32_t)o);
+			for (size_t l = 0; l < n; ++l) {
+				double signal = 1.0 - fabs(pshine_noise_open_simplex(&noise->tables[o], px[l], py[l], pz[l]));
+				signal *= signal;
+				signal *= weight[l];
+				double w = signal / params->attenuation;
+				weight[l] = w < 0.0 ? 0.0 : w > 1.0 ? 1.0 : w;
+				acc[l] += signal * amp;
+				px[l] *= params->lacunarity;
+				py[l] *= params->lacunarity;
+				pz[l] *= params->lacunarity;
+			}
+		}
+		for (size_t l = 0; l < n; ++l) out[i + l] = acc[l] * noise->scale_factor * 2.0 - 1.0;
+	}
+}
+
+// Craters
+
+/// Uniform in [0, 1) with 53 bits of precision.
+static inline double noise_random_double(struct pshine_pcg32_state *rng) {
+	uint32_t a = pshine_pcg32_random_uint32(rng) >> 5;
+	uint32_t b = pshine_pcg32_random_uint32(rng) >> 6;
+	return ((double)a * 67108864.0 + (double)b) * 0x1.0p-53;
+}
+
+static inline double noise_random_range(struct pshine_pcg32_state *rng, double min, double max) {
+	return min + (max - min) * noise_random_double(rng);
+}
+
+void pshine_generate_craters(
+	struct pshine_crater_field *field,
+	size_t crater_count,
+	const struct pshine_bombardment_config *config,
+	uint64_t seed
+) {
+	struct pshine_pcg32_state rng;
+	pshine_pcg32_init(&rng, seed);
+	field->crater_count = crater_count;
+	field->craters_own = calloc(crater_count, sizeof(struct pshine_crater));
+	field->index = (struct pshine_crater_index){};
+	for (size_t i = 0; i < crater_count; ++i) {
+		double lat = noise_random_range(&rng, -1.0, 1.0);
+		lat = pow(fabs(lat), config->lat_bias) * (lat < 0.0 ? -1.0 : 1.0)
+			* (1.0 - config->lat_clearance) * π / 2.0;
+		double lon = noise_random_range(&rng, -π, π);
+		double radius = pow(noise_random_range(&rng, config->radius_min, config->radius_max), config->radius_bias);
+		double depth = noise_random_range(&rng, config->depth_min, config->depth_max);
+		double steepness = noise_random_range(&rng, config->steepness_min, config->steepness_max);
+		double r = cos(lat);
+		field->craters_own[i] = (struct pshine_crater){
+			.pos = { r * cos(lon), sin(lat), r * sin(lon) },
+			.radius = radius,
+			.floor_height = -depth,
+			.steepness = steepness,
+			.k1 = 0.5,
+			.k2 = -0.3,
+		};
+	}
+	pshine_build_crater_index(field);
+}
+
+static void free_crater_index(struct pshine_crater_index *index) {
+	free(index->cell_offsets_own);
+	free(index->crater_indices_own);
+	*index = (struct pshine_crater_index){};
+}
+
+void pshine_free_craters(struct pshine_crater_field *field) {
+	free_crater_index(&field->index);
+	free(field->craters_own);
+	field->craters_own = nullptr;
+	field->crater_count = 0;
+}
+
+// Crater index
+
+/// Point on the cube face `face` (major axis `face / 2`, negative if `face` is odd) at ⟨u,v⟩ ∈ [-1,1]².
+static inline void crater_index_face_point(uint32_t face, double u, double v, double out[static 3]) {
+	uint32_t a = face / 2;
+	out[a] = face % 2 == 0 ? 1.0 : -1.0;
+	out[(a + 1) % 3] = u;
+	out[(a + 2) % 3] = v;
+	double inv_len = 1.0 / sqrt(out[0] * out[0] + out[1] * out[1] + out[2] * out[2]);
+	out[0] *= inv_len;
+	out[1] *= inv_len;
+	out[2] *= inv_len;
+}
+
+static inline double crater_index_dist(const double a[static 3], const double b[static 3]) {
+	double dx = a[0] - b[0], dy = a[1] - b[1], dz = a[2] - b[2];
+	return sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+/// Returns the cell of the finest level that contains the direction of ⟨x,y,z⟩,
+/// as ⟨face, i, j⟩.
+static inline void crater_index_cell(
+	const struct pshine_crater_index *index,
+	double x,
+	double y,
+	double z,
+	uint32_t out[static 3]
+) {
+	double p[3] = { x, y, z };
+	double ax = fabs(x), ay = fabs(y), az = fabs(z);
+	uint32_t a = ax >= ay && ax >= az ? 0 : ay >= az ? 1 : 2;
+	double inv_major = 1.0 / fabs(p[a]);
+	uint32_t res = 1u << (index->level_count - 1);
+	double n = res;
+	double fu = floor((p[(a + 1) % 3] * inv_major + 1.0) * 0.5 * n);
+	double fv = floor((p[(a + 2) % 3] * inv_major + 1.0) * 0.5 * n);
+	out[0] = a * 2 + (p[a] < 0.0 ? 1 : 0);
+	out[1] = fu < 0.0 ? 0 : fu >= n ? res - 1 : (uint32_t)fu;
+	out[2] = fv < 0.0 ? 0 : fv >= n ? res - 1 : (uint32_t)fv;
+}
+
+/// The first cell of `level`, levels are stored coarsest first.
+static inline size_t crater_index_level_base(uint32_t level) {
+	// 6 * (1 + 4 + ... + 4^(level-1))
+	return 2 * (((size_t)1 << (2 * level)) - 1);
+}
+
+struct crater_index_build {
+	struct pshine_crater_index *index;
+	/// The level that the current crater is inserted at.
+	uint32_t target_level;
+	/// Per-cell counts in the first pass, per-cell write positions in the second.
+	uint32_t *cursors;
+	bool fill;
+};
+
+/// Descends the cell quadtree of `face`, visiting the cells at `b->target_level` that the crater may overlap.
+static void crater_index_visit(
+	struct crater_index_build *b,
+	uint32_t crater_idx,
+	const double pos[static 3],
+	double reach,
+	uint32_t face,
+	uint32_t level,
+	uint32_t i,
+	uint32_t j
+) {
+	double size = 2.0 / (double)(1u << level);
+	double u0 = -1.0 + i * size, v0 = -1.0 + j * size;
+	double center[3], corner[3];
+	crater_index_face_point(face, u0 + size * 0.5, v0 + size * 0.5, center);
+	// the cell's edges are great circle arcs, so its farthest point from the center is a corner.
+	double radius = 0.0;
+	for (uint32_t k = 0; k < 4; ++k) {
+		crater_index_face_point(face, u0 + size * (k & 1), v0 + size * (k >> 1), corner);
+		double d = crater_index_dist(center, corner);
+		if (d > radius) radius = d;
+	}
+	// the slack covers the rounding errors in `pos`, the cell corners, and `reach`.
+	if (crater_index_dist(center, pos) > reach + radius + 1e-9) return;
+	if (level == b->target_level) {
+		uint32_t n = 1u << level;
+		size_t cell = crater_index_level_base(level) + ((size_t)face * n + j) * n + i;
+		if (b->fill) b->index->crater_indices_own[b->cursors[cell]++] = crater_idx;
+		else ++b->cursors[cell];
+		return;
+	}
+	for (uint32_t k = 0; k < 4; ++k)
+		crater_index_visit(b, crater_idx, pos, reach, face, level + 1, i * 2 + (k & 1), j * 2 + (k >> 1));
+}
+
+/// The largest distance between `pos` and the direction of a point that is at most `radius` away from `pos`.
+static inline double crater_index_reach(double radius) {
+	// the ball around `pos` (on the unit sphere) subtends an angle of asin(radius), or contains the origin.
+	if (radius >= 1.0) return 2.0;
+	return radius / cos(asin(radius) * 0.5);
+}
+
+void pshine_build_crater_index(struct pshine_crater_field *field) {
+	free_crater_index(&field->index);
+	struct pshine_crater_index *index = &field->index;
+	// the finest level has about one cell per crater.
+	uint32_t level_count = 2;
+	while (level_count < PSHINE_CRATER_INDEX_MAX_LEVELS && 6ull << (2 * (level_count - 1)) < field->crater_count)
+		++level_count;
+	index->level_count = level_count;
+	size_t cell_count = crater_index_level_base(level_count);
+	index->cell_offsets_own = calloc(cell_count + 1, sizeof(uint32_t));
+
+	struct crater_index_build b = {
+		.index = index,
+		.cursors = calloc(cell_count, sizeof(uint32_t)),
+	};
+	for (int pass = 0; pass < 2; ++pass) {
+		b.fill = pass == 1;
+		// craters are visited in order, so the per-cell lists come out sorted.
+		for (size_t c = 0; c < field->crater_count; ++c) {
+			const struct pshine_crater *crater = &field->craters_own[c];
+			double reach = crater_index_reach(crater->radius);
+			// the finest level where the crater is at most half a cell wide (a cell is `2 / 2^level`
+			// wide in face coordinates), so it only overlaps a few cells.
+			b.target_level = 0;
+			while (b.target_level + 1 < level_count && reach * (double)(2u << b.target_level) <= 1.0)
+				++b.target_level;
+			for (uint32_t face = 0; face < 6; ++face)
+				crater_index_visit(&b, (uint32_t)c, crater->pos, reach, face, 0, 0, 0);
+		}
+		if (pass == 0) {
+			for (size_t cell = 0; cell < cell_count; ++cell) {
+				index->cell_offsets_own[cell + 1] = index->cell_offsets_own[cell] + b.cursors[cell];
+				b.cursors[cell] = index->cell_offsets_own[cell];
+			}
+			index->crater_indices_own = calloc(index->cell_offsets_own[cell_count] + 1, sizeof(uint32_t));
+		}
+	}
+	free(b.cursors);
+}
+
+/// Polynomial smooth minimum, `k < 0` gives a smooth maximum.
+static inline double noise_smin(double a, double b, double k) {
+	double h = 0.5 + 0.5 * (a - b) / k;
+	h = h < 0.0 ? 0.0 : h > 1.0 ? 1.0 : h;
+	return a * (1.0 - h) + b * h - k * h * (1.0 - h);
+}
+
+double pshine_crater_shape(const struct pshine_crater *crater, double d) {
+	double bowl = 4.0 * pow(d, crater->steepness + 1.0) - 1.0;
+	double edge = (d - 1.0) * (d - 1.0);
+	return noise_smin(noise_smin(bowl, edge, crater->k1), crater->floor_height, crater->k2);
+}
+
+double pshine_craters_eval(const struct pshine_crater_field *field, double x, double y, double z) {
+	double r = 0.0;
+	pshine_craters_eval_batch(field, 1, &x, &y, &z, &r);
+	return r;
+}
+
+/// Adds `crater` to the `n` samples' sums, if they're in it.
+static inline void crater_eval_lanes(
+	const struct pshine_crater *crater,
+	size_t n,
+	const double *xs,
+	const double *ys,
+	const double *zs,
+	double acc[static PSHINE_NOISE_LANES]
+) {
+	double r2 = crater->radius * crater->radius;
+	for (size_t l = 0; l < n; ++l) {
+		double dx = crater->pos[0] - xs[l];
+		double dy = crater->pos[1] - ys[l];
+		double dz = crater->pos[2] - zs[l];
+		double d2 = dx * dx + dy * dy + dz * dz;
+		if (d2 <= r2) acc[l] += pshine_crater_shape(crater, sqrt(d2) / crater->radius);
+	}
+}
+
+/// One cell's crater list, see `pshine_craters_eval_batch`.
+struct crater_index_list {
+	size_t cell;
+	const uint32_t *it, *end;
+};
+
+void pshine_craters_eval_batch(
+	const struct pshine_crater_field *field,
+	size_t count,
+	const double *xs,
+	const double *ys,
+	const double *zs,
+	double *out
+) {
+	const struct pshine_crater_index *index = &field->index;
+	if (index->level_count == 0) {
+		pshine_craters_eval_brute_force_batch(field, count, xs, ys, zs, out);
+		return;
+	}
+	for (size_t i = 0; i < count; i += PSHINE_NOISE_LANES) {
+		size_t n = count - i < PSHINE_NOISE_LANES ? count - i : PSHINE_NOISE_LANES;
+		// the lists of every lane's cell at every level, each cell once.
+		struct crater_index_list lists[PSHINE_NOISE_LANES * PSHINE_CRATER_INDEX_MAX_LEVELS];
+		size_t list_count = 0;
+		bool has_origin = false;
+		for (size_t l = 0; l < n; ++l) {
+			double x = xs[i + l], y = ys[i + l], z = zs[i + l];
+			// the origin has no direction, every crater may reach it.
+			if (x == 0.0 && y == 0.0 && z == 0.0) {
+				has_origin = true;
+				break;
+			}
+			uint32_t cell[3];
+			crater_index_cell(index, x, y, z, cell);
+			for (uint32_t level = 0; level < index->level_count; ++level) {
+				uint32_t shift = index->level_count - 1 - level, res = 1u << level;
+				size_t c = crater_index_level_base(level) + ((size_t)cell[0] * res + (cell[2] >> shift)) * res + (cell[1] >> shift);
+				bool seen = false;
+				for (size_t k = 0; k < list_count && !seen; ++k) seen = lists[k].cell == c;
+				if (seen || index->cell_offsets_own[c] == index->cell_offsets_own[c + 1]) continue;
+				lists[list_count++] = (struct crater_index_list){
+					.cell = c,
+					.it = &index->crater_indices_own[index->cell_offsets_own[c]],
+					.end = &index->crater_indices_own[index->cell_offsets_own[c + 1]],
+				};
+			}
+		}
+		if (has_origin) {
+			pshine_craters_eval_brute_force_batch(field, n, &xs[i], &ys[i], &zs[i], &out[i]);
+			continue;
+		}
+		// the lists are in increasing order, so merging them sums the craters in the same order
+		// as the brute-force version (the skipped ones contribute nothing to any lane).
+		double acc[PSHINE_NOISE_LANES] = {};
+		for (;;) {
+			uint32_t next = UINT32_MAX;
+			for (size_t k = 0; k < list_count; ++k)
+				if (lists[k].it != lists[k].end && *lists[k].it < next) next = *lists[k].it;
+			if (next == UINT32_MAX) break;
+			for (size_t k = 0; k < list_count; ++k)
+				if (lists[k].it != lists[k].end && *lists[k].it == next) ++lists[k].it;
+			crater_eval_lanes(&field->craters_own[next], n, &xs[i], &ys[i], &zs[i], acc);
+		}
+		for (size_t l = 0; l < n; ++l) out[i + l] = acc[l];
+	}
+}
+
+void pshine_craters_eval_brute_force_batch(
+	const struct pshine_crater_field *field,
+	size_t count,
+	const double *xs,
+	const double *ys,
+	const double *zs,
+	double *out
+) {
+	for (size_t i = 0; i < count; i += PSHINE_NOISE_LANES) {
+		size_t n = count - i < PSHINE_NOISE_LANES ? count - i : PSHINE_NOISE_LANES;
+		double acc[PSHINE_NOISE_LANES] = {};
+		for (size_t c = 0; c < field->crater_count; ++c)
+			crater_eval_lanes(&field->craters_own[c], n, &xs[i], &ys[i], &zs[i], acc);
+		for (size_t l = 0; l < n; ++l) out[i + l] = acc[l];
+	}
+}
+
+// Surfaces
+
+static void surface_layer_eval_batch(
+	const struct pshine_surface_layer *layer,
+	size_t n,
+	const double *xs,
+	const double *ys,
+	const double *zs,
+	double *out
+) {
+	double px[PSHINE_NOISE_LANES], py[PSHINE_NOISE_LANES], pz[PSHINE_NOISE_LANES], v[PSHINE_NOISE_LANES];
+	for (size_t l = 0; l < n; ++l) {
+		px[l] = xs[l];
+		py[l] = ys[l];
+		pz[l] = zs[l];
+	}
+	if (layer->warp_strength != 0.0) {
+		double wx[PSHINE_NOISE_LANES] = {}, wy[PSHINE_NOISE_LANES] = {}, wz[PSHINE_NOISE_LANES] = {};
+		double dx[PSHINE_NOISE_LANES], dy[PSHINE_NOISE_LANES], dz[PSHINE_NOISE_LANES];
+		for (size_t l = 0; l < n; ++l) {
+			wx[l] = xs[l] * layer->warp_frequency;
+			wy[l] = ys[l] * layer->warp_frequency;
+			wz[l] = zs[l] * layer->warp_frequency;
+		}
+		noise_perlin_lanes(layer->warp_seed * 69u, n, wx, wy, wz, dx);
+		noise_perlin_lanes(layer->warp_seed * 123u, n, wx, wy, wz, dy);
+		noise_perlin_lanes(layer->warp_seed * 231u, n, wx, wy, wz, dz);
+		for (size_t l = 0; l < n; ++l) {
+			px[l] += dx[l] * layer->warp_strength;
+			py[l] += dy[l] * layer->warp_strength;
+			pz[l] += dz[l] * layer->warp_strength;
+		}
+	}
+	for (size_t l = 0; l < n; ++l) {
+		px[l] *= layer->point_scale;
+		py[l] *= layer->point_scale;
+		pz[l] *= layer->point_scale;
+	}
+	switch (layer->kind) {
+	case PSHINE_SURFACE_LAYER_FBM: pshine_noise_fbm_batch(&layer->fractal, n, px, py, pz, v); break;
+	case PSHINE_SURFACE_LAYER_RIDGED: pshine_noise_ridged_batch(&layer->fractal, n, px, py, pz, v); break;
+	case PSHINE_SURFACE_LAYER_CRATERS: pshine_craters_eval_batch(layer->craters, n, px, py, pz, v); break;
+	case PSHINE_SURFACE_LAYER_RIDGED_MULTI: pshine_noise_ridged_multi_batch(layer->ridged_multi, n, px, py, pz, v); break;
+	default: PSHINE_PANIC("Unknown surface layer kind: %u", layer->kind);
+	}
+	for (size_t l = 0; l < n; ++l) {
+		double x = v[l] * layer->pre_scale + layer->pre_bias;
+		if (layer->exponent != 0.0) x = pow(fabs((x + 1.0) / 2.0), layer->exponent) * 2.0 - 1.0;
+		out[l] += x * layer->scale + layer->bias;
+	}
+}
+
+double pshine_surface_height(const struct pshine_surface *surface, double x, double y, double z) {
+	double r = 0.0;
+	pshine_surface_height_batch(surface, 1, &x, &y, &z, &r);
+	return r;
+}
+
+void pshine_surface_height_batch(
+	const struct pshine_surface *surface,
+	size_t count,
+	const double *xs,
+	const double *ys,
+	const double *zs,
+	double *out
+) {
+	for (size_t i = 0; i < count; i += PSHINE_NOISE_LANES) {
+		size_t n = count - i < PSHINE_NOISE_LANES ? count - i : PSHINE_NOISE_LANES;
+		for (size_t l = 0; l < n; ++l) out[i + l] = 0.0;
+		for (size_t j = 0; j < surface->layer_count; ++j)
+			surface_layer_eval_batch(&surface->layers[j], n, xs + i, ys + i, zs + i, out + i);
+	}
+}
+
+// Height tiles
+
+static void generate_height_tile(const struct pshine_surface *surface, struct pshine_height_tile *tile) {
+	double *xs = calloc(tile->width * 4, sizeof(double));
+	double *ys = xs + tile->width, *zs = ys + tile->width, *hs = zs + tile->width;
+	double colat_step = (tile->colat_max - tile->colat_min) / tile->height;
+	double lon_step = (tile->lon_max - tile->lon_min) / tile->width;
+	for (uint32_t y = 0; y < tile->height; ++y) {
+		double colat = tile->colat_min + y * colat_step;
+		double sin_colat = sin(colat), cos_colat = cos(colat);
+		for (uint32_t x = 0; x < tile->width; ++x) {
+			double lon = tile->lon_min + x * lon_step;
+			xs[x] = sin_colat * cos(lon);
+			ys[x] = cos_colat;
+			zs[x] = sin_colat * sin(lon);
+		}
+		pshine_surface_height_batch(surface, tile->width, xs, ys, zs, hs);
+		for (uint32_t x = 0; x < tile->width; ++x)
+			tile->heights[(size_t)y * tile->width + x] = (float)hs[x];
+	}
+	free(xs);
+}
+
+struct height_tile_work {
+	const struct pshine_surface *surface;
+	size_t tile_count;
+	struct pshine_height_tile *tiles;
+	atomic_size_t next_tile;
+};
+
+static void height_tile_worker(void *user) {
+	struct height_tile_work *work = user;
+	for (;;) {
+		size_t i = atomic_fetch_add(&work->next_tile, 1);
+		if (i >= work->tile_count) break;
+		generate_height_tile(work->surface, &work->tiles[i]);
+	}
+}
+
+void pshine_generate_height_tiles(
+	const struct pshine_surface *surface,
+	size_t tile_count,
+	struct pshine_height_tile *tiles,
+	size_t thread_count
+) {
+	if (thread_count == 0) thread_count = pshine_get_cpu_count();
+	if (thread_count > tile_count) thread_count = tile_count;
+	struct height_tile_work work = {
+		.surface = surface,
+		.tile_count = tile_count,
+		.tiles = tiles,
+	};
+	atomic_init(&work.next_tile, 0);
+	if (thread_count <= 1) {
+		height_tile_worker(&work);
+		return;
+	}
+	pshine_thread *threads = calloc(thread_count, sizeof(pshine_thread));
+	for (size_t i = 0; i < thread_count; ++i)
+		threads[i] = pshine_thread_start(&height_tile_worker, &work);
+	for (size_t i = 0; i < thread_count; ++i)
+		pshine_thread_join(threads[i]);
+	free(threads);
+}
+
+double pshine_benchmark_height_tiles(
+	const struct pshine_surface *surface,
+	size_t tile_count,
+	uint32_t tile_size,
+	size_t thread_count
+) {
+	struct pshine_height_tile *tiles = calloc(tile_count, sizeof(*tiles));
+	float *heights = calloc(tile_count * tile_size * tile_size, sizeof(float));
+	for (size_t i = 0; i < tile_count; ++i) {
+		// spread the tiles over the sphere in bands of longitude.
+		double lon = 2.0 * π * i / tile_count;
+		tiles[i] = (struct pshine_height_tile){
+			.colat_min = 0.0,
+			.colat_max = π,
+			.lon_min = lon,
+			.lon_max = lon + 2.0 * π / tile_count,
+			.width = tile_size,
+			.height = tile_size,
+			.heights = heights + i * tile_size * tile_size,
+		};
+	}
+	struct pshine_timeval start = pshine_timeval_now();
+	pshine_generate_height_tiles(surface, tile_count, tiles, thread_count);
+	struct pshine_timeval delta = pshine_timeval_delta(start, pshine_timeval_now());
+	free(heights);
+	free(tiles);
+	double secs = (double)delta.sec + (double)delta.nsec * 1e-9;
+	return (double)tile_count * tile_size * tile_size / secs;
+}
+
+struct pshine_crater_benchmark pshine_benchmark_craters(size_t crater_count, uint32_t width, uint32_t height) {
+	struct pshine_crater_benchmark result = { .crater_count = crater_count, .sample_count = (size_t)width * height };
+	struct pshine_crater_field field;
+	struct pshine_bombardment_config bombardment = PSHINE_DEFAULT_BOMBARDMENT_CONFIG;
+	bombardment.radius_bias = 5.2;
+	bombardment.radius_min = 0.01;
+	bombardment.radius_max = 0.9;
+	struct pshine_timeval start = pshine_timeval_now();
+	pshine_generate_craters(&field, crater_count, &bombardment, 382);
+	struct pshine_timeval delta = pshine_timeval_delta(start, pshine_timeval_now());
+	result.build_seconds = (double)delta.sec + (double)delta.nsec * 1e-9;
+
+	double *buf = calloc(result.sample_count * 5, sizeof(double));
+	double *xs = buf, *ys = xs + result.sample_count, *zs = ys + result.sample_count;
+	double *brute = zs + result.sample_count, *indexed = brute + result.sample_count;
+	for (uint32_t j = 0; j < height; ++j) {
+		double colat = (j + 0.5) / height * π;
+		for (uint32_t i = 0; i < width; ++i) {
+			double lon = (i + 0.5) / width * 2.0 * π - π;
+			size_t k = (size_t)j * width + i;
+			xs[k] = sin(colat) * cos(lon);
+			ys[k] = cos(colat);
+			zs[k] = sin(colat) * sin(lon);
+		}
+	}
+
+	start = pshine_timeval_now();
+	pshine_craters_eval_brute_force_batch(&field, result.sample_count, xs, ys, zs, brute);
+	delta = pshine_timeval_delta(start, pshine_timeval_now());
+	result.brute_force_seconds = (double)delta.sec + (double)delta.nsec * 1e-9;
+
+	start = pshine_timeval_now();
+	pshine_craters_eval_batch(&field, result.sample_count, xs, ys, zs, indexed);
+	delta = pshine_timeval_delta(start, pshine_timeval_now());
+	result.indexed_seconds = (double)delta.sec + (double)delta.nsec * 1e-9;
+
+	for (size_t k = 0; k < result.sample_count; ++k)
+		if (memcmp(&brute[k], &indexed[k], sizeof(double)) != 0) ++result.mismatch_count;
+
+	free(buf);
+	pshine_free_craters(&field);
+	return result;
+}
+
+void pshine_init_kj621_surface(struct pshine_crater_field *craters, struct pshine_surface_layer layers[static 3]) {
+	struct pshine_bombardment_config bombardment = PSHINE_DEFAULT_BOMBARDMENT_CONFIG;
+	bombardment.radius_bias = 5.2;
+	bombardment.radius_min = 0.01;
+	bombardment.radius_max = 0.9;
+	pshine_generate_craters(craters, 1024, &bombardment, 382);
+	layers[0] = (struct pshine_surface_layer){
+		.kind = PSHINE_SURFACE_LAYER_FBM,
+		.fractal = { .seed = 2232, .octaves = 10, .frequency = 0.9, .lacunarity = 1.8, .persistence = 0.8 },
+		.warp_seed = 2, .warp_strength = 20.0, .warp_frequency = 0.01,
+		.point_scale = 1.0,
+		.pre_scale = 0.5, .pre_bias = 0.5,
+		.exponent = 2.0,
+		.scale = 1.0,
+	};
+	layers[1] = (struct pshine_surface_layer){
+		.kind = PSHINE_SURFACE_LAYER_RIDGED,
+		.fractal = {
+			.seed = 5442, .octaves = 6, .frequency = 1.0,
+			.lacunarity = 1.49, .persistence = 0.5, .attenuation = 0.64,
+		},
+		.warp_seed = 4312, .warp_strength = 10.0, .warp_frequency = 0.02,
+		.point_scale = 1.0,
+		.pre_scale = 1.0,
+		.scale = 0.5,
+	};
+	layers[2] = (struct pshine_surface_layer){
+		.kind = PSHINE_SURFACE_LAYER_CRATERS,
+		.craters = craters,
+		.warp_seed = 382, .warp_strength = 0.003, .warp_frequency = 50.0,
+		.point_scale = 1.0,
+		.pre_scale = 1.0,
+		.scale = 0.3,
+	};
+}
+
+void pshine_init_kj631_ridges(struct pshine_ridged_multi *noise, struct pshine_surface_layer *layer) {
+	struct pshine_noise_fractal_params params = PSHINE_RIDGED_MULTI_DEFAULT_PARAMS;
+	params.seed = 95834;
+	params.persistence = 1.8;
+	pshine_init_ridged_multi(noise, &params);
+	*layer = (struct pshine_surface_layer){
+		.kind = PSHINE_SURFACE_LAYER_RIDGED_MULTI,
+		.ridged_multi = noise,
+		.point_scale = 8.0,
+		.pre_scale = 1.0,
+		.scale = -0.2,
+	};
+}
+
+/// Parses one line of surfgen's exported vectors, every value is the hex bits of a double.
+static bool parse_terrain_vector(const char *line, size_t count, double *out) {
+	for (size_t i = 0; i < count; ++i) {
+		char *end;
+		uint64_t bits = strtoull(line, &end, 16);
+		if (end == line) return false;
+		memcpy(&out[i], &bits, sizeof(double));
+		line = end;
+	}
+	return true;
+}
+
+/// Checks OpenSimplex and the ridges of `KJ631` and `KJ62`, see `pshine_test_terrain`.
+static bool test_open_simplex(const char *vectors_path) {
+	FILE *fin = fopen(vectors_path, "r");
+	if (fin == nullptr) {
+		PSHINE_ERROR("terrain: could not open '%s'", vectors_path);
+		return false;
+	}
+	struct pshine_noise_permutation_table table;
+	pshine_init_noise_permutation_table(&table, 95834);
+	static struct pshine_ridged_multi kj631, kj62;
+	struct pshine_surface_layer kj631_layer;
+	pshine_init_kj631_ridges(&kj631, &kj631_layer);
+	struct pshine_noise_fractal_params kj62_params = PSHINE_RIDGED_MULTI_DEFAULT_PARAMS;
+	kj62_params.seed = 382721;
+	kj62_params.frequency = 1.2;
+	kj62_params.lacunarity = 2.29;
+	kj62_params.persistence = 0.5;
+	kj62_params.attenuation = 0.54;
+	pshine_init_ridged_multi(&kj62, &kj62_params);
+
+	enum : size_t { COLUMN_COUNT = 3 };
+	static const char *column_names[COLUMN_COUNT] = { "open simplex", "KJ631 ridges", "KJ62 ridges" };
+	// LLVM constant-folds Rust's `powi` with `pow`, which rounds differently than the multiplications
+	// it does at runtime, so surfgen's octave weights can be off by an ulp depending on what got inlined.
+	static const double tolerances[COLUMN_COUNT] = { 0.0, 1e-14, 1e-14 };
+	size_t point_count = 0, mismatch_counts[COLUMN_COUNT] = {};
+	double max_errors[COLUMN_COUNT] = {};
+	bool ok = true;
+	char line[512];
+	while (fgets(line, sizeof line, fin) != nullptr) {
+		if (line[0] == '#' || line[0] == '\n') continue;
+		double v[3 + COLUMN_COUNT];
+		if (!parse_terrain_vector(line, 3 + COLUMN_COUNT, v)) {
+			PSHINE_ERROR("terrain: bad line %zu in '%s'", point_count, vectors_path);
+			ok = false;
+			break;
+		}
+		double batched[2];
+		pshine_noise_ridged_multi_batch(&kj631, 1, &v[0], &v[1], &v[2], &batched[0]);
+		pshine_noise_ridged_multi_batch(&kj62, 1, &v[0], &v[1], &v[2], &batched[1]);
+		double got[COLUMN_COUNT][2] = {
+			{ pshine_noise_open_simplex(&table, v[0], v[1], v[2]) },
+			{ pshine_noise_ridged_multi(&kj631, v[0], v[1], v[2]), batched[0] },
+			{ pshine_noise_ridged_multi(&kj62, v[0], v[1], v[2]), batched[1] },
+		};
+		got[0][1] = got[0][0];
+		for (size_t c = 0; c < COLUMN_COUNT; ++c) {
+			double want = v[3 + c];
+			double error = fmax(fabs(got[c][0] - want), fabs(got[c][1] - want));
+			bool exact = memcmp(&got[c][0], &want, sizeof(double)) == 0 && memcmp(&got[c][1], &want, sizeof(double)) == 0;
+			if (tolerances[c] == 0.0 ? !exact : !(error <= tolerances[c])) ++mismatch_counts[c];
+			max_errors[c] = fmax(max_errors[c], error);
+		}
+		++point_count;
+	}
+	fclose(fin);
+	ok = ok && point_count != 0;
+	for (size_t c = 0; c < COLUMN_COUNT; ++c) {
+		PSHINE_INFO(
+			"terrain: %s: %zu/%zu points differ from surfgen, max error %g%s",
+			column_names[c], mismatch_counts[c], point_count, max_errors[c], mismatch_counts[c] == 0 ? "" : " FAILED"
+		);
+		ok = ok && mismatch_counts[c] == 0;
+	}
+	return ok;
+}
+
+/// Checks the noise functions and the KJ621 surface, see `pshine_test_terrain`.
+static bool test_kj621(const char *vectors_path) {
+	FILE *fin = fopen(vectors_path, "r");
+	if (fin == nullptr) {
+		PSHINE_ERROR("terrain: could not open '%s'", vectors_path);
+		return false;
+	}
+	struct pshine_crater_field craters;
+	struct pshine_surface_layer layers[3];
+	pshine_init_kj621_surface(&craters, layers);
+	struct pshine_surface surface = { .layer_count = 3, .layers = layers };
+
+	enum : size_t { COLUMN_COUNT = 5, MAX_POINT_COUNT = 4'096 };
+	static const char *column_names[COLUMN_COUNT] = { "perlin", "fbm", "ridged", "craters", "height" };
+	// the same values are expected from the single-point and the batched functions.
+	double *buf = calloc(MAX_POINT_COUNT * (3 + COLUMN_COUNT * 2), sizeof(double));
+	double *xs = buf, *ys = xs + MAX_POINT_COUNT, *zs = ys + MAX_POINT_COUNT;
+	double *expected = zs + MAX_POINT_COUNT, *batched = expected + MAX_POINT_COUNT * COLUMN_COUNT;
+	size_t point_count = 0;
+	bool ok = true;
+	char line[512];
+	while (fgets(line, sizeof line, fin) != nullptr) {
+		if (line[0] == '#' || line[0] == '\n') continue;
+		double v[8];
+		if (point_count == MAX_POINT_COUNT || !parse_terrain_vector(line, 8, v)) {
+			PSHINE_ERROR("terrain: bad line %zu in '%s'", point_count, vectors_path);
+			ok = false;
+			break;
+		}
+		xs[point_count] = v[0];
+		ys[point_count] = v[1];
+		zs[point_count] = v[2];
+		for (size_t c = 0; c < COLUMN_COUNT; ++c) expected[c * MAX_POINT_COUNT + point_count] = v[3 + c];
+		++point_count;
+	}
+	fclose(fin);
+	ok = ok && point_count != 0;
+
+	pshine_noise_fbm_batch(&layers[0].fractal, point_count, xs, ys, zs, batched + 1 * MAX_POINT_COUNT);
+	pshine_noise_ridged_batch(&layers[1].fractal, point_count, xs, ys, zs, batched + 2 * MAX_POINT_COUNT);
+	pshine_craters_eval_batch(&craters, point_count, xs, ys, zs, batched + 3 * MAX_POINT_COUNT);
+	pshine_surface_height_batch(&surface, point_count, xs, ys, zs, batched + 4 * MAX_POINT_COUNT);
+	for (size_t c = 0; c < COLUMN_COUNT; ++c) {
+		size_t mismatch_count = 0;
+		double max_error = 0.0;
+		for (size_t i = 0; i < point_count; ++i) {
+			double x = xs[i], y = ys[i], z = zs[i];
+			double single = c == 0 ? pshine_noise_perlin(layers[0].fractal.seed, x, y, z)
+				: c == 1 ? pshine_noise_fbm(&layers[0].fractal, x, y, z)
+				: c == 2 ? pshine_noise_ridged(&layers[1].fractal, x, y, z)
+				: c == 3 ? pshine_craters_eval(&craters, x, y, z)
+				: pshine_surface_height(&surface, x, y, z);
+			// there's no batched perlin, the single-point one is checked twice.
+			double batch = c == 0 ? single : batched[c * MAX_POINT_COUNT + i];
+			double want = expected[c * MAX_POINT_COUNT + i];
+			// both sides are built without FMA contraction, so they should agree to the bit.
+			if (memcmp(&single, &want, sizeof(double)) != 0 || memcmp(&batch, &want, sizeof(double)) != 0)
+				++mismatch_count;
+			max_error = fmax(max_error, fmax(fabs(single - want), fabs(batch - want)));
+		}
+		PSHINE_INFO(
+			"terrain: %s: %zu/%zu points differ from surfgen, max error %g%s",
+			column_names[c], mismatch_count, point_count, max_error, mismatch_count == 0 ? "" : " FAILED"
+		);
+		ok = ok && mismatch_count == 0;
+	}
+
+	free(buf);
+	pshine_free_craters(&craters);
+	return ok;
+}
+
+bool pshine_test_terrain(const char *kj621_vectors_path, const char *open_simplex_vectors_path) {
+	bool ok = test_kj621(kj621_vectors_path);
+	return test_open_simplex(open_simplex_vectors_path) && ok;
+}
+
+bool pshine_bench_terrain(size_t thread_count) {
+	struct pshine_crater_field craters;
+	struct pshine_surface_layer layers[3];
+	pshine_init_kj621_surface(&craters, layers);
+	struct pshine_surface surface = { .layer_count = 3, .layers = layers };
+	for (uint32_t tile_size = 64; tile_size <= 512; tile_size *= 2) {
+		double samples_per_second = pshine_benchmark_height_tiles(&surface, 16, tile_size, thread_count);
+		PSHINE_INFO("terrain: 16 tiles of %u², %.3f M samples/s", tile_size, samples_per_second / 1'000'000.0);
+	}
+	pshine_free_craters(&craters);
+
+	bool ok = true;
+	const size_t crater_counts[] = { 1'000, 10'000, 100'000 };
+	for (size_t i = 0; i < sizeof(crater_counts) / sizeof(*crater_counts); ++i) {
+		struct pshine_crater_benchmark result = pshine_benchmark_craters(crater_counts[i], 256, 128);
+		PSHINE_INFO(
+			"terrain: %zu craters, build %.3fs, brute force %.3fs, indexed %.3fs (%.1fx), %zu mismatches%s",
+			result.crater_count,
+			result.build_seconds,
+			result.brute_force_seconds,
+			result.indexed_seconds,
+			result.brute_force_seconds / result.indexed_seconds,
+			result.mismatch_count,
+			result.mismatch_count == 0 ? "" : " FAILED"
+		);
+		ok = ok && result.mismatch_count == 0;
+	}
+	return ok;
+}
@@ -0,0 +1,295 @@
+#ifndef PSHINE_GAME_NOISE_H_
+#define PSHINE_GAME_NOISE_H_
+#include <pshine/util.h>
+
+// Procedural surface noise, evaluated at runtime.
+// `surfgen/src/shared.rs` is a line-by-line port of this file: for the
+// same parameters and seeds both produce the same values, so surfaces baked
+// offline match the ones generated at runtime.
+
+/// The number of samples that the batched functions process together.
+/// With GCC and Clang the gradient noise evaluates all of them at once in vector registers.
+enum : size_t { PSHINE_NOISE_LANES = 8 };
+
+/// Parameters of a multi-octave noise. Octave `i` uses the seed `seed + i`.
+struct pshine_noise_fractal_params {
+	uint32_t seed;
+	uint32_t octaves;
+	double frequency;
+	double lacunarity;
+	double persistence;
+	/// Only used by ridged noise.
+	double attenuation;
+};
+
+/// Gradient noise, roughly in [-1, 1].
+double pshine_noise_perlin(uint32_t seed, double x, double y, double z);
+
+/// Fractal Brownian motion over `pshine_noise_perlin`, normalized to roughly [-1, 1].
+double pshine_noise_fbm(const struct pshine_noise_fractal_params *params, double x, double y, double z);
+
+/// Ridged multifractal noise, normalized to roughly [-1, 1].
+double pshine_noise_ridged(const struct pshine_noise_fractal_params *params, double x, double y, double z);
+
+void pshine_noise_fbm_batch(
+	const struct pshine_noise_fractal_params *params,
+	size_t count,
+	const double *xs,
+	const double *ys,
+	const double *zs,
+	double *out
+);
+
+void pshine_noise_ridged_batch(
+	const struct pshine_noise_fractal_params *params,
+	size_t count,
+	const double *xs,
+	const double *ys,
+	const double *zs,
+	double *out
+);
+
+/// The `noise` crate's `PermutationTable`: 0..255 shuffled by its XorShift generator.
+struct pshine_noise_permutation_table {
+	uint8_t values[256];
+};
+
+/// Same as `noise::PermutationTable::new(seed)`.
+void pshine_init_noise_permutation_table(struct pshine_noise_permutation_table *table, uint32_t seed);
+
+/// The `noise` crate's 3D OpenSimplex, roughly in [-1, 1]. Same as `noise::OpenSimplex::new(seed).get(...)`
+/// with the table made from `seed`.
+double pshine_noise_open_simplex(const struct pshine_noise_permutation_table *table, double x, double y, double z);
+
+enum : size_t { PSHINE_RIDGED_MULTI_MAX_OCTAVES = 32 };
+
+/// The `noise` crate's `RidgedMulti<OpenSimplex>`, which surfgen's presets use. Unlike `pshine_noise_ridged`,
+/// octave `i` is weighted by `persistence^i` and the sum is normalized by the sum of those weights.
+struct pshine_ridged_multi {
+	struct pshine_noise_fractal_params params;
+	double scale_factor;
+	/// One per octave, made from the seeds `params.seed + i`.
+	struct pshine_noise_permutation_table tables[PSHINE_RIDGED_MULTI_MAX_OCTAVES];
+};
+
+/// `noise::RidgedMulti::new`'s defaults.
+static constexpr struct pshine_noise_fractal_params PSHINE_RIDGED_MULTI_DEFAULT_PARAMS = {
+	.seed = 1,
+	.octaves = 6,
+	.frequency = 1.0,
+	.lacunarity = 3.14159265358979323846 * 2.0 / 3.0,
+	.persistence = 1.0,
+	.attenuation = 2.0,
+};
+
+void pshine_init_ridged_multi(struct pshine_ridged_multi *noise, const struct pshine_noise_fractal_params *params);
+
+double pshine_noise_ridged_multi(const struct pshine_ridged_multi *noise, double x, double y, double z);
+
+void pshine_noise_ridged_multi_batch(
+	const struct pshine_ridged_multi *noise,
+	size_t count,
+	const double *xs,
+	const double *ys,
+	const double *zs,
+	double *out
+);
+
+/// A single crater, see `pshine_crater_shape`.
+struct pshine_crater {
+	/// On the unit sphere.
+	double pos[3];
+	/// The radius (in unit sphere units).
+	double radius;
+	/// Negative, the height of the flat crater floor.
+	double floor_height;
+	double steepness;
+	/// Smoothing between the bowl and the rim.
+	double k1;
+	/// Smoothing between the bowl and the floor.
+	double k2;
+};
+
+enum : size_t { PSHINE_CRATER_INDEX_MAX_LEVELS = 9 };
+
+/// A cube-sphere quadtree of crater lists, looked up by the direction of the point.
+/// Each crater is stored in the cells of the finest level where it's at most half
+/// a cell wide, larger craters at coarser levels. Each cell lists its craters in
+/// increasing order, so merging a point's lists visits the craters in the field's order.
+struct pshine_crater_index {
+	/// 0 if there's no index. Level `l` has `6 * 4^l` cells.
+	uint32_t level_count;
+	/// One offset into `crater_indices_own` per cell (coarsest level first), plus the end.
+	uint32_t *cell_offsets_own;
+	uint32_t *crater_indices_own;
+};
+
+struct pshine_crater_field {
+	size_t crater_count;
+	struct pshine_crater *craters_own;
+	struct pshine_crater_index index;
+};
+
+/// Same as surfgen's `BombardmentConfig`.
+struct pshine_bombardment_config {
+	double radius_min, radius_max;
+	double radius_bias;
+	double lat_bias;
+	double lat_clearance;
+	double depth_min, depth_max;
+	double steepness_min, steepness_max;
+};
+
+static constexpr struct pshine_bombardment_config PSHINE_DEFAULT_BOMBARDMENT_CONFIG = {
+	.radius_min = 0.02, .radius_max = 0.95,
+	.radius_bias = 2.3,
+	.lat_bias = 1.7,
+	.lat_clearance = 0.05,
+	.depth_min = 0.05, .depth_max = 0.8,
+	.steepness_min = 0.9, .steepness_max = 1.1,
+};
+
+/// Place `crater_count` random craters and build the index. The RNG is PCG32 seeded with `seed`.
+void pshine_generate_craters(
+	struct pshine_crater_field *field,
+	size_t crater_count,
+	const struct pshine_bombardment_config *config,
+	uint64_t seed
+);
+
+void pshine_free_craters(struct pshine_crater_field *field);
+
+/// (Re)build the field's index, e.g. after the craters were modified.
+/// The craters keep their order, which is the order they're summed in.
+void pshine_build_crater_index(struct pshine_crater_field *field);
+
+/// The height of a crater at the normalized distance `d` (0 at the center, 1 at the rim).
+double pshine_crater_shape(const struct pshine_crater *crater, double d);
+
+/// The sum of all crater heights at a point. Uses the index if there is one,
+/// the result is exactly the same as `pshine_craters_eval_brute_force_batch`.
+double pshine_craters_eval(const struct pshine_crater_field *field, double x, double y, double z);
+
+/// Evaluates every crater at every point, ignoring the index.
+void pshine_craters_eval_brute_force_batch(
+	const struct pshine_crater_field *field,
+	size_t count,
+	const double *xs,
+	const double *ys,
+	const double *zs,
+	double *out
+);
+
+void pshine_craters_eval_batch(
+	const struct pshine_crater_field *field,
+	size_t count,
+	const double *xs,
+	const double *ys,
+	const double *zs,
+	double *out
+);
+
+enum pshine_surface_layer_kind : uint32_t {
+	PSHINE_SURFACE_LAYER_FBM,
+	PSHINE_SURFACE_LAYER_RIDGED,
+	PSHINE_SURFACE_LAYER_CRATERS,
+	PSHINE_SURFACE_LAYER_RIDGED_MULTI,
+};
+
+/// One additive layer of a surface. The value at a point `p` is computed as:
+/// ```
+/// p' = p + warp_strength * perlin3(warp_seed * {69, 123, 231}, p * warp_frequency)
+/// v = noise(p' * point_scale) * pre_scale + pre_bias
+/// if exponent != 0: v = |(v + 1) / 2|^exponent * 2 - 1
+/// v = v * scale + bias
+/// ```
+struct pshine_surface_layer {
+	enum pshine_surface_layer_kind kind;
+	/// For `PSHINE_SURFACE_LAYER_FBM` and `PSHINE_SURFACE_LAYER_RIDGED`.
+	struct pshine_noise_fractal_params fractal;
+	/// For `PSHINE_SURFACE_LAYER_CRATERS`.
+	const struct pshine_crater_field *craters;
+	/// For `PSHINE_SURFACE_LAYER_RIDGED_MULTI`.
+	const struct pshine_ridged_multi *ridged_multi;
+	uint32_t warp_seed;
+	double warp_strength;
+	double warp_frequency;
+	double point_scale;
+	double pre_scale, pre_bias;
+	double exponent;
+	double scale, bias;
+};
+
+struct pshine_surface {
+	size_t layer_count;
+	const struct pshine_surface_layer *layers;
+};
+
+/// The height of the surface at a point on the unit sphere.
+double pshine_surface_height(const struct pshine_surface *surface, double x, double y, double z);
+
+void pshine_surface_height_batch(
+	const struct pshine_surface *surface,
+	size_t count,
+	const double *xs,
+	const double *ys,
+	const double *zs,
+	double *out
+);
+
+/// An equirectangular tile of surface heights. The mapping is the same as surfgen's:
+/// `x = sin(colat) cos(lon), y = cos(colat), z = sin(colat) sin(lon)`.
+struct pshine_height_tile {
+	double colat_min, colat_max;
+	double lon_min, lon_max;
+	uint32_t width, height;
+	/// `width * height` values, row-major. Allocated by the caller.
+	float *heights;
+};
+
+/// Fill the tiles' heights using `thread_count` worker threads (0 means one per core).
+void pshine_generate_height_tiles(
+	const struct pshine_surface *surface,
+	size_t tile_count,
+	struct pshine_height_tile *tiles,
+	size_t thread_count
+);
+
+/// Generate `tile_count` tiles of `tile_size`² samples and return the throughput in samples per second.
+double pshine_benchmark_height_tiles(
+	const struct pshine_surface *surface,
+	size_t tile_count,
+	uint32_t tile_size,
+	size_t thread_count
+);
+
+struct pshine_crater_benchmark {
+	size_t crater_count;
+	size_t sample_count;
+	double build_seconds;
+	double brute_force_seconds;
+	double indexed_seconds;
+	/// Samples where the indexed result isn't bit-identical to brute force, should be 0.
+	size_t mismatch_count;
+};
+
+/// Evaluate `crater_count` craters (distributed like surfgen's `SharedKJ621`) over
+/// a `width`×`height` equirectangular grid, both with and without the index.
+struct pshine_crater_benchmark pshine_benchmark_craters(size_t crater_count, uint32_t width, uint32_t height);
+
+/// The layers of surfgen's `SharedKJ621`, `layers[2]` uses `craters`.
+void pshine_init_kj621_surface(struct pshine_crater_field *craters, struct pshine_surface_layer layers[static 3]);
+
+/// The last layer of surfgen's `KJ631`, its OpenSimplex ridges.
+void pshine_init_kj631_ridges(struct pshine_ridged_multi *noise, struct pshine_surface_layer *layer);
+
+/// Compare the noise functions and the KJ621 surface (single-point and batched) against the values
+/// written by `surfgen --export-terrain-vectors`, and OpenSimplex and the `KJ631` and `KJ62` ridges
+/// against `surfgen --export-open-simplex-vectors`. Logs the results and returns false on any difference.
+bool pshine_test_terrain(const char *kj621_vectors_path, const char *open_simplex_vectors_path);
+
+/// Log the KJ621 surface's throughput at a few tile sizes, and the crater benchmark at 1k, 10k and
+/// 100k craters. Returns false if the crater index doesn't match brute force.
+bool pshine_bench_terrain(size_t thread_count);
+
+#endif // PSHINE_GAME_NOISE_H_
@@ -1,4 +1,5 @@
 #include "game.h"
+#include "heightfield.h"
 #include <float.h>
 #include <pshine/audio.h>
 
@@ -23,6 +24,33 @@ static double sphere_ray_intersection(
 	return __builtin_inf();
 }
 
+/// `v` (relative to the body) in the frame of its heightmap.
+static double3 body_local_vector(const struct pshine_celestial_body *body, double3 v) {
+	pshine_body_local_vector(body, v.vs, v.vs);
+	return v;
+}
+
+/// How far the ship can move along `dir` before it's `clearance` meters from the terrain.
+static double terrain_travel_limit(
+	const struct pshine_celestial_body *body,
+	double3 ship_pos,
+	double3 dir,
+	double travel,
+	double clearance
+) {
+	const struct pshine_height_pyramid *terrain = body->height_pyramid_own;
+	double3 p = body_local_vector(body, double3sub(ship_pos, double3vs(body->position.values)));
+	double dist = double3mag(p);
+	double reach = travel + clearance;
+	// everything the ship can reach is within this angle, if it stays above the highest peak there, we're fine.
+	double angle = reach < dist ? asin(reach / dist) : π;
+	if (dist - reach > terrain->radius + pshine_height_pyramid_max_height(terrain, p.vs, angle)) return travel;
+	double3 d = body_local_vector(body, dir);
+	double t;
+	if (!pshine_height_pyramid_raycast(terrain, p.vs, d.vs, reach, &t)) return travel;
+	return maxd(0.0, t - clearance);
+}
+
 void update_ship(struct pshine_game *game, struct pshine_ship *ship, float delta_time) {
 	{
 		double min_dist = DBL_MAX;
@@ -135,7 +163,30 @@ void update_ship(struct pshine_game *game, struct pshine_ship *ship, float delta
 	if (!ship->is_warp_safe) ship->is_in_warp = false;
 	{
 		float3 delta = floatRapply(ship_orient, float3xyz(0, 0, 1));
-		ship_pos = double3add(ship_pos, double3mul(double3_float3(delta), ship->velocity * (double)delta_time));
+		double travel = ship->velocity * (double)delta_time;
+		if (!ship->is_in_warp && ship->closest_body->height_pyramid_own != nullptr && travel > 0.0) {
+			static const double terrain_clearance = 10.0; // m
+			double limit = terrain_travel_limit(
+				ship->closest_body,
+				ship_pos,
+				double3_float3(delta),
+				travel,
+				terrain_clearance
+			);
+			if (limit < travel) {
+				travel = limit;
+				ship->velocity = 0.0;
+			}
+		}
+		ship_pos = double3add(ship_pos, double3mul(double3_float3(delta), travel));
+	}
+	if (ship->closest_body->height_pyramid_own != nullptr) {
+		double3 p = double3sub(ship_pos, double3vs(ship->closest_body->position.values));
+		p = body_local_vector(ship->closest_body, p);
+		ship->closest_body_altitude = pshine_height_pyramid_altitude(ship->closest_body->height_pyramid_own, p.vs);
+	} else {
+		ship->closest_body_altitude = double3mag(double3sub(ship_pos, double3vs(ship->closest_body->position.values)))
+			- ship->closest_body->radius;
 	}
 	*(double3*)ship->position.values = ship_pos;
 	*(floatR*)ship->orientation.values = ship_orient;
@@ -33,7 +33,54 @@ static inline planet_vertex spheregen_vtxlerp(
 	};
 }
 
-void generate_sphere_mesh(size_t n, struct pshine_mesh_data *m) {
+/// Vertex `k` of row `j` of an octahedron face (apex `a`, base `b`-`c`) subdivided `n` times.
+static inline float3 spheregen_face_vertex(float3 a, float3 b, float3 c, uint32_t j, uint32_t k, size_t n) {
+	if (j == 0) return a;
+	float3 l = spheregen_float3lerp(a, b, (float)j / n);
+	float3 r = spheregen_float3lerp(a, c, (float)j / n);
+	return spheregen_float3lerp(l, r, (float)k / j);
+}
+
+/// The point at face parameters `s` (apex to base) and `t` (`b` to `c`) as it
+/// is rasterized by a mesh with `n` subdivisions, i.e. on the flat triangle of
+/// that mesh which contains it. Used as the geomorph target for finer meshes.
+static float3 spheregen_face_point(float3 a, float3 b, float3 c, float s, float t, size_t n) {
+	float fj = s * n, fk = t * s * n;
+	uint32_t j = (uint32_t)fminf(floorf(fj), (float)(n - 1));
+	uint32_t k = (uint32_t)fminf(floorf(fk), (float)j);
+	float u = fj - j, v = fk - k;
+	float3 p00 = spheregen_face_vertex(a, b, c, j, k, n);
+	float3 p11 = spheregen_face_vertex(a, b, c, j + 1, k + 1, n);
+	if (u >= v) {
+		float3 p10 = spheregen_face_vertex(a, b, c, j + 1, k, n);
+		return float3add(float3add(float3mul(p00, 1.0f - u), float3mul(p10, u - v)), float3mul(p11, v));
+	} else {
+		float3 p01 = spheregen_face_vertex(a, b, c, j, k + 1, n);
+		return float3add(float3add(float3mul(p00, 1.0f - v), float3mul(p01, v - u)), float3mul(p11, u));
+	}
+}
+
+static inline void spheregen_set_morph_target(
+	planet_vertex *v,
+	const planet_vertex *a,
+	const planet_vertex *b,
+	const planet_vertex *c,
+	float s,
+	float t,
+	size_t parent_n
+) {
+	float3 p = spheregen_face_point(
+		float3vs(a->position), float3vs(b->position), float3vs(c->position),
+		s, t, parent_n
+	);
+	v->morph_target[0] = p.x;
+	v->morph_target[1] = p.y;
+	v->morph_target[2] = p.z;
+}
+
+/// `parent_n` is the subdivision count of the next coarser LOD, used
+/// for the geomorph targets. If it's equal to `n`, the targets are the vertices themselves.
+void generate_sphere_mesh(size_t n, size_t parent_n, struct pshine_mesh_data *m) {
 	// octahedron -> subdiv tris (each edge). instead of lerp, use slerp
 	m->index_count = n * n * 3 * 8; // subdiv tri = n^2 tris, 3 idx/tri, 8 tri/faces
 	m->indices = calloc(m->index_count, sizeof(uint32_t));
@@ -63,6 +110,7 @@ void generate_sphere_mesh(size_t n, struct pshine_mesh_data *m) {
 			float2 nor_oct = float32x3_to_oct(float3vs(vtxs[i].position));
 			vtxs[i].normal_oct[0] = nor_oct.x;
 			vtxs[i].normal_oct[1] = nor_oct.y;
+			memcpy(vtxs[i].morph_target, vtxs[i].position, sizeof(vtxs[i].position));
 			// vtxs[i].tangent_dia = encode_tangent(float3vs(vtxs[i].position), float3 tangent);
 		}
 
@@ -106,6 +154,7 @@ void generate_sphere_mesh(size_t n, struct pshine_mesh_data *m) {
 		for (uint32_t j = 1; j < n; ++j) {
 			PSHINE_CHECK(nvtx < m->vertex_count, "out of range vtx");
 			vertices[nvtx] = spheregen_vtxlerp(va, vb, dt * j);
+			spheregen_set_morph_target(&vertices[nvtx], &vertices[4], va, vb, 1.0f, dt * j, parent_n);
 			++nvtx;
 		}
 	}
@@ -123,6 +172,7 @@ void generate_sphere_mesh(size_t n, struct pshine_mesh_data *m) {
 			for (uint32_t j = 1; j < n; ++j) {
 				PSHINE_CHECK(nvtx < m->vertex_count, "out of range vtx");
 				vertices[nvtx] = spheregen_vtxlerp(va, vb, dt * j);
+				spheregen_set_morph_target(&vertices[nvtx], va, vb, &vertices[(b + 1) % 4], dt * j, 0.0f, parent_n);
 				strips[face][j].l = nvtx;
 				strips[face][j].r = nvtx0 + ((b + 1) % 4) * (n - 1) + (j - 1);
 				nvtx += 1;
@@ -142,6 +192,12 @@ void generate_sphere_mesh(size_t n, struct pshine_mesh_data *m) {
 				for (uint32_t k = 1; k < j; ++k) {
 					PSHINE_CHECK(nvtx < m->vertex_count, "out of range vtx");
 					vertices[nvtx] = spheregen_vtxlerp(vl, vr, dt * k);
+					spheregen_set_morph_target(
+						&vertices[nvtx],
+						&vertices[4 + i], &vertices[b], &vertices[(b + 1) % 4],
+						(float)j / n, dt * k,
+						parent_n
+					);
 					++nvtx;
 				}
 			}
@@ -176,7 +232,10 @@ void pshine_generate_planet_mesh(
 ) {
 	// const size_t lods[5] = { 96, 32, 24, 16, 8 };
 	const size_t lods[5] = { 256, 128, 96, 64, 16 };
-	generate_sphere_mesh(lod >= 5 ? 8 : lods[lod], out_mesh);
+	size_t n = lod >= 5 ? 8 : lods[lod];
+	// the coarsest mesh morphs to itself.
+	size_t parent_n = lod + 1 >= 5 ? n : lods[lod + 1];
+	generate_sphere_mesh(n, parent_n, out_mesh);
 	// pshine_renderer_run_compute(renderer, &(struct pshine_renderer_compute){
 	// 	.compute_shader_path = "build/pshine/data/shaders/planet_mesh_disp.comp.spv",
 	// 	.input_buffer_size = out_mesh->vertex_count * sizeof(planet_vertex),
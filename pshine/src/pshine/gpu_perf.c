@@ -0,0 +1,198 @@
+#include "gpu_perf.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+const VkQueryPipelineStatisticFlags pshine_gpu_statistic_flags
+	= VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT
+	| VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT
+	| VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT
+	| VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+
+const char *const pshine_gpu_statistic_names[PSHINE_GPU_STATISTIC_COUNT_] = {
+	[PSHINE_GPU_STATISTIC_VERTEX_INVOCATIONS] = "Vertices",
+	[PSHINE_GPU_STATISTIC_CLIPPING_PRIMITIVES] = "Primitives",
+	[PSHINE_GPU_STATISTIC_FRAGMENT_INVOCATIONS] = "Fragments",
+	[PSHINE_GPU_STATISTIC_COMPUTE_INVOCATIONS] = "Compute",
+};
+
+void pshine_gpu_perf_init(
+	struct pshine_gpu_perf *perf,
+	VkDevice device,
+	const struct rg_graph *graph,
+	uint32_t frame_count,
+	float timestamp_period,
+	uint32_t timestamp_valid_bits,
+	bool statistics
+) {
+	*perf = (struct pshine_gpu_perf){
+		.device = device,
+		.timestamp_period = timestamp_period,
+		.timestamp_mask = timestamp_valid_bits >= 64 ? UINT64_MAX : (1ull << timestamp_valid_bits) - 1,
+		.statistics = statistics,
+		.frame_count = frame_count,
+		.query_count = graph->pass_count,
+	};
+	perf->timestamp_pools_own = calloc(frame_count, sizeof(*perf->timestamp_pools_own));
+	perf->statistics_pools_own = calloc(frame_count, sizeof(*perf->statistics_pools_own));
+	perf->recorded_own = calloc(frame_count, sizeof(*perf->recorded_own));
+	for (uint32_t i = 0; i < frame_count; ++i) {
+		PSHINE_CHECK(vkCreateQueryPool(device, &(VkQueryPoolCreateInfo){
+			.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+			.queryType = VK_QUERY_TYPE_TIMESTAMP,
+			.queryCount = 2 * perf->query_count,
+		}, nullptr, &perf->timestamp_pools_own[i]) == VK_SUCCESS, "failed to create the timestamp query pool");
+		if (!statistics) continue;
+		PSHINE_CHECK(vkCreateQueryPool(device, &(VkQueryPoolCreateInfo){
+			.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+			.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+			.queryCount = perf->query_count,
+			.pipelineStatistics = pshine_gpu_statistic_flags,
+		}, nullptr, &perf->statistics_pools_own[i]) == VK_SUCCESS, "failed to create the statistics query pool");
+	}
+
+	// one timing for each rendering, see `rg_graph_set_query_pools`.
+	perf->timings_own = calloc(graph->pass_count + 1, sizeof(*perf->timings_own));
+	for (uint32_t i = 0; i < graph->pass_count; ++i) {
+		const struct rg_pass *pass = &graph->passes_own[i];
+		if (pass->merged_with_prev) {
+			struct pshine_gpu_pass_timing *timing = &perf->timings_own[perf->timing_count - 1];
+			char *name = pshine_format_string("%s + %s", timing->name_own, pass->name);
+			free(timing->name_own);
+			timing->name_own = name;
+			continue;
+		}
+		perf->timings_own[perf->timing_count++] = (struct pshine_gpu_pass_timing){
+			.name_own = pshine_strdup(pass->name),
+			.position = i,
+			.queue = pass->queue,
+		};
+	}
+}
+
+void pshine_gpu_perf_deinit(struct pshine_gpu_perf *perf) {
+	for (uint32_t i = 0; i < perf->frame_count; ++i) {
+		vkDestroyQueryPool(perf->device, perf->timestamp_pools_own[i], nullptr);
+		if (perf->statistics_pools_own[i] != VK_NULL_HANDLE)
+			vkDestroyQueryPool(perf->device, perf->statistics_pools_own[i], nullptr);
+	}
+	for (uint32_t i = 0; i < perf->timing_count; ++i) free(perf->timings_own[i].name_own);
+	free(perf->timings_own);
+	free(perf->recorded_own);
+	free(perf->statistics_pools_own);
+	free(perf->timestamp_pools_own);
+	*perf = (struct pshine_gpu_perf){};
+}
+
+/// Add a sample to the timing's ring, and update its averages.
+static void add_sample(struct pshine_gpu_pass_timing *timing, double time, const uint64_t *statistics) {
+	timing->times[timing->next_sample] = time;
+	if (statistics != nullptr)
+		memcpy(timing->statistics[timing->next_sample], statistics, sizeof(timing->statistics[0]));
+	timing->next_sample = (timing->next_sample + 1) % PSHINE_GPU_PERF_WINDOW;
+	if (timing->sample_count < PSHINE_GPU_PERF_WINDOW) ++timing->sample_count;
+
+	timing->average_time = 0.0;
+	timing->min_time = INFINITY;
+	timing->max_time = 0.0;
+	memset(timing->average_statistics, 0, sizeof(timing->average_statistics));
+	for (uint32_t i = 0; i < timing->sample_count; ++i) {
+		double t = timing->times[i];
+		timing->average_time += t;
+		if (t < timing->min_time) timing->min_time = t;
+		if (t > timing->max_time) timing->max_time = t;
+		for (uint32_t j = 0; j < PSHINE_GPU_STATISTIC_COUNT_; ++j)
+			timing->average_statistics[j] += (double)timing->statistics[i][j];
+	}
+	timing->average_time /= timing->sample_count;
+	for (uint32_t j = 0; j < PSHINE_GPU_STATISTIC_COUNT_; ++j)
+		timing->average_statistics[j] /= timing->sample_count;
+}
+
+/// Read the frame's queries that are available, without waiting for the rest.
+static void read_frame(struct pshine_gpu_perf *perf, uint32_t frame) {
+	// each query's value is followed by its availability.
+	uint64_t *timestamps = calloc(4 * perf->query_count + 1, sizeof(*timestamps));
+	uint64_t *statistics = calloc((PSHINE_GPU_STATISTIC_COUNT_ + 1) * perf->query_count + 1, sizeof(*statistics));
+	VkResult result = vkGetQueryPoolResults(perf->device, perf->timestamp_pools_own[frame], 0, 2 * perf->query_count,
+		4 * perf->query_count * sizeof(*timestamps), timestamps, 2 * sizeof(*timestamps),
+		VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+	// `VK_NOT_READY` only means some of them aren't available.
+	if (result != VK_SUCCESS && result != VK_NOT_READY) goto done;
+	bool counted = perf->statistics;
+	if (counted) {
+		result = vkGetQueryPoolResults(perf->device, perf->statistics_pools_own[frame], 0, perf->query_count,
+			(PSHINE_GPU_STATISTIC_COUNT_ + 1) * perf->query_count * sizeof(*statistics), statistics,
+			(PSHINE_GPU_STATISTIC_COUNT_ + 1) * sizeof(*statistics),
+			VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+		counted = result == VK_SUCCESS || result == VK_NOT_READY;
+	}
+
+	perf->average_frame_time = 0.0;
+	double frame_time = 0.0;
+	bool complete = true;
+	for (uint32_t i = 0; i < perf->timing_count; ++i) {
+		struct pshine_gpu_pass_timing *timing = &perf->timings_own[i];
+		const uint64_t *begin = &timestamps[4 * timing->position], *end = begin + 2;
+		if (begin[1] != 0 && end[1] != 0) {
+			const uint64_t *counts = &statistics[(PSHINE_GPU_STATISTIC_COUNT_ + 1) * timing->position];
+			// the passes on the async compute queue aren't counted.
+			bool has_counts = counted && counts[PSHINE_GPU_STATISTIC_COUNT_] != 0;
+			double time = (double)((end[0] - begin[0]) & perf->timestamp_mask) * perf->timestamp_period * 1e-9;
+			add_sample(timing, time, has_counts ? counts : (const uint64_t[PSHINE_GPU_STATISTIC_COUNT_]){});
+			if (timing->queue != RG_QUEUE_ASYNC_COMPUTE) frame_time += time;
+		} else {
+			complete = false;
+		}
+		perf->average_frame_time += timing->average_time;
+	}
+	if (complete) {
+		perf->last_frame_time = frame_time;
+		++perf->complete_frame_count;
+	}
+
+done:
+	free(statistics);
+	free(timestamps);
+}
+
+void pshine_gpu_perf_begin_frame(
+	struct pshine_gpu_perf *perf,
+	struct rg_graph *graph,
+	uint32_t frame,
+	VkCommandBuffer command_buffer
+) {
+	PSHINE_CHECK(frame < perf->frame_count, "invalid frame");
+	if (perf->recorded_own[frame]) read_frame(perf, frame);
+	vkCmdResetQueryPool(command_buffer, perf->timestamp_pools_own[frame], 0, 2 * perf->query_count);
+	if (perf->statistics) vkCmdResetQueryPool(command_buffer, perf->statistics_pools_own[frame], 0, perf->query_count);
+	rg_graph_set_query_pools(graph, perf->timestamp_pools_own[frame], perf->statistics_pools_own[frame]);
+	perf->recorded_own[frame] = true;
+}
+
+bool pshine_gpu_perf_write_csv(const struct pshine_gpu_perf *perf, const char *path) {
+	FILE *fout = fopen(path, "wb");
+	if (fout == nullptr) {
+		PSHINE_ERROR("failed to write the GPU timings to %s", path);
+		return false;
+	}
+	fprintf(fout, "pass,queue,samples,average_ms,min_ms,max_ms");
+	if (perf->statistics)
+		for (uint32_t j = 0; j < PSHINE_GPU_STATISTIC_COUNT_; ++j) fprintf(fout, ",%s", pshine_gpu_statistic_names[j]);
+	fprintf(fout, "\n");
+	for (uint32_t i = 0; i < perf->timing_count; ++i) {
+		const struct pshine_gpu_pass_timing *timing = &perf->timings_own[i];
+		if (timing->sample_count == 0) continue;
+		fprintf(fout, "\"%s\",%s,%u,%.4f,%.4f,%.4f", timing->name_own,
+			timing->queue == RG_QUEUE_ASYNC_COMPUTE ? "compute" : "main", timing->sample_count,
+			timing->average_time * 1000.0, timing->min_time * 1000.0, timing->max_time * 1000.0);
+		if (perf->statistics)
+			for (uint32_t j = 0; j < PSHINE_GPU_STATISTIC_COUNT_; ++j)
+				fprintf(fout, ",%.0f", timing->average_statistics[j]);
+		fprintf(fout, "\n");
+	}
+	fclose(fout);
+	PSHINE_INFO("wrote the GPU timings to %s", path);
+	return true;
+}
@@ -1,5 +0,0 @@
-#include <tracy/public/tracy/TracyVulkan.hpp>
-
-void pshine_perf_gpu_init() {
-	
-}
@@ -0,0 +1,101 @@
+#ifndef PSHINE_GPU_PERF_H_
+#define PSHINE_GPU_PERF_H_
+#include <pshine/util.h>
+#define VK_NO_PROTOTYPES
+#include <volk.h>
+#include "vk_rgraph.h"
+
+// GPU times (and pipeline statistics) of the render graph's passes, from the queries the graph
+// writes around them (see `rg_graph_set_query_pools`). Each frame in flight has its own pools,
+// which are read when the frame is recorded again, so the results never have to be waited for.
+
+enum : uint32_t {
+	/// How many frames the averages are over.
+	PSHINE_GPU_PERF_WINDOW = 64,
+};
+
+/// The pipeline statistics counted for each pass, in the order of their `VkQueryPipelineStatisticFlagBits`.
+enum pshine_gpu_statistic : uint32_t {
+	PSHINE_GPU_STATISTIC_VERTEX_INVOCATIONS,
+	PSHINE_GPU_STATISTIC_CLIPPING_PRIMITIVES,
+	PSHINE_GPU_STATISTIC_FRAGMENT_INVOCATIONS,
+	PSHINE_GPU_STATISTIC_COMPUTE_INVOCATIONS,
+	PSHINE_GPU_STATISTIC_COUNT_,
+};
+
+/// What `pshine_gpu_perf::statistics` counts, `VK_QUERY_PIPELINE_STATISTIC_*` for each `pshine_gpu_statistic`.
+extern const VkQueryPipelineStatisticFlags pshine_gpu_statistic_flags;
+extern const char *const pshine_gpu_statistic_names[PSHINE_GPU_STATISTIC_COUNT_];
+
+/// A rendering of the graph (the passes merged into it are measured together), or a compute pass.
+struct pshine_gpu_pass_timing {
+	/// The names of the passes, joined with " + ".
+	char *name_own;
+	/// Position of the first pass in `rg_graph::passes_own`.
+	uint32_t position;
+	enum rg_queue queue;
+	/// The last `sample_count` (at most `PSHINE_GPU_PERF_WINDOW`) times in seconds, and the statistics
+	/// (if counted), in a ring ending before `next_sample`.
+	uint32_t sample_count;
+	uint32_t next_sample;
+	double times[PSHINE_GPU_PERF_WINDOW];
+	uint64_t statistics[PSHINE_GPU_PERF_WINDOW][PSHINE_GPU_STATISTIC_COUNT_];
+	/// Over the samples, updated as they're read.
+	double average_time, min_time, max_time;
+	double average_statistics[PSHINE_GPU_STATISTIC_COUNT_];
+};
+
+struct pshine_gpu_perf {
+	VkDevice device;
+	/// Nanoseconds per timestamp tick.
+	double timestamp_period;
+	/// The valid bits of the timestamps (of both queues).
+	uint64_t timestamp_mask;
+	/// Whether the passes on the main queue are counted (`pshine_gpu_statistic_flags`).
+	bool statistics;
+	uint32_t frame_count;
+	/// A pool of `2 * query_count` timestamps for each frame in flight, and of
+	/// `query_count` pipeline statistics if `statistics`.
+	RG_COUNTED_BY(frame_count) VkQueryPool *timestamp_pools_own;
+	RG_COUNTED_BY(frame_count) VkQueryPool *statistics_pools_own;
+	/// Whether the frame's pools were written since they were last read.
+	RG_COUNTED_BY(frame_count) bool *recorded_own;
+	uint32_t query_count;
+	uint32_t timing_count;
+	RG_COUNTED_BY(timing_count) struct pshine_gpu_pass_timing *timings_own;
+	/// The sum of the timings' averages.
+	double average_frame_time;
+	/// The time of the passes on the main queue in the last frame that was read completely,
+	/// and the number of such frames, so that new ones can be told apart.
+	double last_frame_time;
+	uint64_t complete_frame_count;
+};
+
+/// Create the query pools for the passes of `graph` (once it's built), `frame_count` of each.
+/// `timestamp_valid_bits` is the least of the queues' `VkQueueFamilyProperties::timestampValidBits`.
+void pshine_gpu_perf_init(
+	struct pshine_gpu_perf *perf,
+	VkDevice device,
+	const struct rg_graph *graph,
+	uint32_t frame_count,
+	float timestamp_period,
+	uint32_t timestamp_valid_bits,
+	bool statistics
+);
+void pshine_gpu_perf_deinit(struct pshine_gpu_perf *perf);
+
+/// Add the results of the last time `frame` was recorded, if they're available (the frame's fence has
+/// been waited for, so they should be), then reset the frame's pools in `command_buffer` (before the
+/// graph's commands) and have the graph write to them.
+void pshine_gpu_perf_begin_frame(
+	struct pshine_gpu_perf *perf,
+	struct rg_graph *graph,
+	uint32_t frame,
+	VkCommandBuffer command_buffer
+);
+
+/// Write each timing's averages (and the statistics, if counted) as a CSV file.
+/// Logs and returns false if the file can't be written.
+bool pshine_gpu_perf_write_csv(const struct pshine_gpu_perf *perf, const char *path);
+
+#endif // PSHINE_GPU_PERF_H_
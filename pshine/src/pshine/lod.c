@@ -0,0 +1,107 @@
+#include "lod.h"
+#include <math.h>
+#include "psmath.h"
+
+/// The morph factor of `lod` at the apparent size `a`, see `pshine_select_lod_with_hysteresis`.
+static float lod_morph(
+	const double thresholds[static PSHINE_LOD_THRESHOLD_COUNT],
+	double hysteresis,
+	double morph_range,
+	size_t lod,
+	double a
+) {
+	if (lod >= PSHINE_LOD_THRESHOLD_COUNT) return 0.0f;
+	double band_top = thresholds[lod] * (1.0 + hysteresis);
+	double morph_width = thresholds[lod] * morph_range;
+	return morph_width <= 0.0
+		? (a <= band_top ? 1.0f : 0.0f)
+		: (float)clampd((band_top + morph_width - a) / morph_width, 0.0, 1.0);
+}
+
+size_t pshine_select_lod_with_hysteresis(
+	const double thresholds[static PSHINE_LOD_THRESHOLD_COUNT],
+	double hysteresis,
+	double morph_range,
+	size_t lod,
+	double a,
+	float *out_morph
+) {
+	while (lod < PSHINE_LOD_THRESHOLD_COUNT && a <= thresholds[lod] * (1.0 - hysteresis)) ++lod;
+	while (lod > 0 && a > thresholds[lod - 1] * (1.0 + hysteresis)) --lod;
+	*out_morph = lod_morph(thresholds, hysteresis, morph_range, lod, a);
+	return lod;
+}
+
+struct lod_replay_stats {
+	size_t switch_count;
+	/// Switches where the meshes drawn before and after differ, see the check in `replay_lod`.
+	size_t popping_switch_count;
+};
+
+/// Moves a camera towards and away from a body of radius 1, oscillating around the distance
+/// where its apparent size is `thresholds[threshold]`, with a bit of jitter on top.
+static struct lod_replay_stats replay_lod(
+	const double thresholds[static PSHINE_LOD_THRESHOLD_COUNT],
+	size_t threshold,
+	double hysteresis,
+	double morph_range,
+	double amplitude,
+	size_t frame_count,
+	size_t period
+) {
+	struct pshine_pcg64_state rng;
+	pshine_pcg64_init(&rng, 0x853c49e6748fea9b, 0xda3e39cb94b95bdb);
+	// the apparent size is `radius / (distance - radius)`.
+	double crossing = 1.0 + 1.0 / thresholds[threshold];
+	struct lod_replay_stats stats = {};
+	size_t lod = 0;
+	for (size_t f = 0; f < frame_count; ++f) {
+		double jitter = 0.002 * (2.0 * pshine_pcg64_random_double(&rng) - 1.0);
+		double distance = crossing * (1.0 + amplitude * sin(2.0 * π * (double)f / (double)period) + jitter);
+		double a = 1.0 / fabs(distance - 1.0);
+		float morph;
+		size_t new_lod = pshine_select_lod_with_hysteresis(thresholds, hysteresis, morph_range, lod, a, &morph);
+		// the first frame only finds the LOD to start from.
+		if (f != 0 && new_lod != lod) {
+			++stats.switch_count;
+			// a LOD at morph 1 is its coarser neighbour at morph 0, so the switch doesn't pop if both
+			// draw the same mesh at the edge of the band, where the old LOD was still in use.
+			double t = thresholds[lod < new_lod ? lod : new_lod];
+			double edge = clampd(a, t * (1.0 - hysteresis), t * (1.0 + hysteresis));
+			double before = (double)lod + lod_morph(thresholds, hysteresis, morph_range, lod, edge);
+			double after = (double)new_lod + lod_morph(thresholds, hysteresis, morph_range, new_lod, edge);
+			if (fabs(before - after) > 1e-6) ++stats.popping_switch_count;
+		}
+		lod = new_lod;
+	}
+	return stats;
+}
+
+bool pshine_test_lod_hysteresis() {
+	// apparent sizes, spaced like the default `lod_ranges`.
+	const double thresholds[PSHINE_LOD_THRESHOLD_COUNT] = { 0.5, 0.05, 0.004, 0.0008 };
+	const double hysteresis = 0.1, morph_range = 0.25;
+	enum : size_t { FRAME_COUNT = 2'400, PERIOD = 120 };
+
+	bool ok = true;
+	for (size_t i = 0; i < PSHINE_LOD_THRESHOLD_COUNT; ++i) {
+		// hovering at the threshold, within the hysteresis band.
+		struct lod_replay_stats hover = replay_lod(thresholds, i, hysteresis, morph_range, 0.02, FRAME_COUNT, PERIOD);
+		// the same without hysteresis switches on every crossing, so the camera does cross.
+		struct lod_replay_stats hover_hard = replay_lod(thresholds, i, 0.0, 0.0, 0.02, FRAME_COUNT, PERIOD);
+		// sweeping well past the band on both sides: two switches per period.
+		struct lod_replay_stats sweep = replay_lod(thresholds, i, hysteresis, morph_range, 0.5, FRAME_COUNT, PERIOD);
+		bool threshold_ok = hover.switch_count == 0
+			&& hover_hard.switch_count >= 2 * (FRAME_COUNT / PERIOD)
+			&& sweep.switch_count > 0 && sweep.switch_count <= 2 * (FRAME_COUNT / PERIOD) + 1
+			&& hover.popping_switch_count == 0 && sweep.popping_switch_count == 0;
+		PSHINE_INFO(
+			"lod hysteresis: threshold %zu: hovering %zu switches (%zu without hysteresis), "
+			"sweeping %zu switches, %zu popping%s",
+			i, hover.switch_count, hover_hard.switch_count, sweep.switch_count,
+			hover.popping_switch_count + sweep.popping_switch_count, threshold_ok ? "" : " FAILED"
+		);
+		ok = ok && threshold_ok;
+	}
+	return ok;
+}
@@ -0,0 +1,30 @@
+#ifndef PSHINE_LOD_H_
+#define PSHINE_LOD_H_
+#include <pshine/util.h>
+
+// Planet mesh LOD selection with hysteresis, and the geomorph factor towards the next coarser LOD.
+
+enum : size_t {
+	/// The thresholds between the LODs, there's one more LOD than thresholds.
+	PSHINE_LOD_THRESHOLD_COUNT = 4,
+};
+
+/// Selects the LOD for the apparent size `a` starting from `lod`. `thresholds` are decreasing,
+/// LOD `i` is used for `thresholds[i] < a <= thresholds[i - 1]`, but the LOD only changes once `a`
+/// leaves the `hysteresis` band around the threshold. The morph factor reaches 1 (coarser LOD)
+/// before the band and stays there within it, so switching either way doesn't pop.
+size_t pshine_select_lod_with_hysteresis(
+	const double thresholds[static PSHINE_LOD_THRESHOLD_COUNT],
+	double hysteresis,
+	double morph_range,
+	size_t lod,
+	double a,
+	float *out_morph
+);
+
+/// Replay a camera oscillating across each threshold, with and without hysteresis, and check
+/// that the LOD switches a bounded number of times and that the morph hides every switch.
+/// Logs the results and returns false on failure.
+bool pshine_test_lod_hysteresis();
+
+#endif // PSHINE_LOD_H_
@@ -1,5 +1,13 @@
 #include <pshine/util.h>
 #include <pshine/game.h>
+#include "mesh.h"
+#include "culling.h"
+#include "lod.h"
+#include "shadows.h"
+#include "atmosphere.h"
+#include "rgraph_test.h"
+#include "game/noise.h"
+#include "game/heightfield.h"
 
 int pshine_argc;
 const char **pshine_argv;
@@ -21,6 +29,40 @@ int main(int argc, char **argv) {
 
 	PSHINE_INFO("started");
 
+	// The tests are headless, they don't create the renderer.
+	bool test_mesh_lods = pshine_check_has_option("--test-mesh-lods");
+	bool test_mesh_tangents = pshine_check_has_option("--test-mesh-tangents");
+	bool test_culling = pshine_check_has_option("--test-culling");
+	bool test_lod_hysteresis = pshine_check_has_option("--test-lod-hysteresis");
+	bool test_atmosphere = pshine_check_has_option("--test-atmosphere");
+	bool test_atmosphere_half_res = pshine_check_has_option("--test-atmosphere-half-res");
+	bool test_shadows = pshine_check_has_option("--test-shadows");
+	bool test_rgraph = pshine_check_has_option("--test-rgraph");
+	bool bench_rgraph = pshine_check_has_option("--bench-rgraph");
+	bool test_terrain = pshine_check_has_option("--test-terrain");
+	bool bench_terrain = pshine_check_has_option("--bench-terrain");
+	bool test_height_pyramid = pshine_check_has_option("--test-height-pyramid");
+	if (
+		test_mesh_lods || test_mesh_tangents || test_culling || test_lod_hysteresis || test_atmosphere || test_atmosphere_half_res || test_shadows ||
+		test_rgraph || bench_rgraph || test_terrain || bench_terrain || test_height_pyramid
+	) {
+		bool ok = true;
+		if (test_rgraph) ok = pshine_test_rgraph("data/tests/render_graph_plan.txt") && ok;
+		if (bench_rgraph) ok = pshine_bench_rgraph(1000) && ok;
+		if (test_terrain) ok = pshine_test_terrain("data/tests/terrain_kj621.txt", "data/tests/terrain_open_simplex.txt") && ok;
+		if (bench_terrain) ok = pshine_bench_terrain(0) && ok;
+		if (test_height_pyramid) ok = pshine_check_height_pyramid(1024, 500) && ok;
+		if (test_culling) ok = pshine_test_culling() && ok;
+		if (test_lod_hysteresis) ok = pshine_test_lod_hysteresis() && ok;
+		if (test_shadows) ok = pshine_test_shadows() && ok;
+		if (test_atmosphere) ok = pshine_test_atmosphere() && ok;
+		if (test_atmosphere_half_res) ok = pshine_test_atmosphere_half_res() && ok;
+		if (test_mesh_tangents) ok = pshine_test_mesh_tangents("data/tests/mesh_tangents_mikktspace.txt") && ok;
+		if (test_mesh_lods) ok = pshine_test_mesh_lods("data/models/kerem_kavalci.glb", &PSHINE_DEFAULT_MESH_LOD_PARAMS) && ok;
+		fclose(log_fout);
+		return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
 	struct pshine_game game = {};
 	PSHINE_INFO("creating renderer");
 	struct pshine_renderer *renderer = pshine_create_renderer();
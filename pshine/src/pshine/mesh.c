@@ -0,0 +1,1416 @@
+#include "mesh.h"
+#include <math.h>
+#include <stdatomic.h>
+#include <cgltf.h>
+#include "psmath.h"
+#include "vertex_util.h"
+
+static inline double3 mesh_position(const float *positions, size_t stride, uint32_t i) {
+	const float *p = (const float *)(const void *)((const uint8_t *)positions + stride * i);
+	return double3xyz(p[0], p[1], p[2]);
+}
+
+static inline uint64_t mesh_hash(uint64_t x) {
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ULL;
+	x ^= x >> 33;
+	return x;
+}
+
+static size_t hash_capacity(size_t count) {
+	size_t capacity = 16;
+	while (capacity < count * 2) capacity *= 2;
+	return capacity;
+}
+
+void pshine_free_mesh_attributes(struct pshine_mesh_attributes *mesh) {
+	free(mesh->positions_own);
+	free(mesh->normals_own);
+	free(mesh->tangents_own);
+	free(mesh->texcoords_own);
+	free(mesh->indices_own);
+	*mesh = (struct pshine_mesh_attributes){};
+}
+
+static inline double3 triangle_normal(double3 a, double3 b, double3 c) {
+	return double3cross(double3sub(b, a), double3sub(c, a));
+}
+
+void pshine_generate_flat_normals(struct pshine_mesh_attributes *mesh) {
+	uint32_t count = mesh->index_count;
+	float (*positions)[3] = malloc(count * sizeof(*positions));
+	float (*normals)[3] = malloc(count * sizeof(*normals));
+	float (*texcoords)[2] = malloc(count * sizeof(*texcoords));
+	float (*tangents)[4] = mesh->tangents_own != nullptr ? malloc(count * sizeof(*tangents)) : nullptr;
+	for (uint32_t i = 0; i < count; i += 3) {
+		double3 p[3];
+		for (uint32_t k = 0; k < 3; ++k) p[k] = double3_float3(float3vs(mesh->positions_own[mesh->indices_own[i + k]]));
+		double3 n = triangle_normal(p[0], p[1], p[2]);
+		double n_len = double3mag(n);
+		n = n_len > 0.0 ? double3div(n, n_len) : double3xyz(0.0, 0.0, 1.0);
+		for (uint32_t k = 0; k < 3; ++k) {
+			uint32_t v = mesh->indices_own[i + k];
+			memcpy(positions[i + k], mesh->positions_own[v], sizeof(positions[i + k]));
+			memcpy(texcoords[i + k], mesh->texcoords_own[v], sizeof(texcoords[i + k]));
+			if (tangents != nullptr) memcpy(tangents[i + k], mesh->tangents_own[v], sizeof(tangents[i + k]));
+			*(float3 *)normals[i + k] = float3_double3(n);
+			mesh->indices_own[i + k] = i + k;
+		}
+	}
+	free(mesh->positions_own);
+	free(mesh->normals_own);
+	free(mesh->texcoords_own);
+	free(mesh->tangents_own);
+	mesh->positions_own = positions;
+	mesh->normals_own = normals;
+	mesh->texcoords_own = texcoords;
+	mesh->tangents_own = tangents;
+	mesh->vertex_count = count;
+}
+
+/// Like MikkTSpace, vertices with the same position, normal and texture coordinate are one vertex.
+/// `identity[i]` is the first vertex that's the same as `i`.
+static void weld_tangent_space_vertices(const struct pshine_mesh_attributes *mesh, uint32_t *identity) {
+	size_t capacity = hash_capacity(mesh->vertex_count);
+	uint32_t *table = malloc(capacity * sizeof(*table));
+	memset(table, 0xff, capacity * sizeof(*table));
+	for (uint32_t i = 0; i < mesh->vertex_count; ++i) {
+		uint32_t key[8];
+		memcpy(key + 0, mesh->positions_own[i], sizeof(float[3]));
+		memcpy(key + 3, mesh->normals_own[i], sizeof(float[3]));
+		memcpy(key + 6, mesh->texcoords_own[i], sizeof(float[2]));
+		uint64_t h = 0;
+		for (size_t k = 0; k < 8; ++k) h = mesh_hash(h ^ key[k]);
+		identity[i] = i;
+		for (size_t slot = h & (capacity - 1);; slot = (slot + 1) & (capacity - 1)) {
+			if (table[slot] == UINT32_MAX) {
+				table[slot] = i;
+				break;
+			}
+			uint32_t j = table[slot], other[8];
+			memcpy(other + 0, mesh->positions_own[j], sizeof(float[3]));
+			memcpy(other + 3, mesh->normals_own[j], sizeof(float[3]));
+			memcpy(other + 6, mesh->texcoords_own[j], sizeof(float[2]));
+			if (memcmp(key, other, sizeof(key)) == 0) {
+				identity[i] = j;
+				break;
+			}
+		}
+	}
+	free(table);
+}
+
+/// `v` projected onto the plane with the normal `n` and normalized, or zero.
+static inline double3 project_onto_plane(double3 v, double3 n) {
+	double3 p = double3sub(v, double3mul(n, double3dot(n, v)));
+	double len = double3mag(p);
+	return len > 0.0 ? double3div(p, len) : double3v0();
+}
+
+/// Some unit vector perpendicular to `n`, for when the texture coordinates don't define a tangent.
+static inline double3 any_tangent(double3 n) {
+	double3 t = fabs(n.y) > fabs(n.z) ? double3xyz(n.y, -n.x, 0.0) : double3xyz(n.z, 0.0, -n.x);
+	double len = double3mag(t);
+	return len > 0.0 ? double3div(t, len) : double3xyz(1.0, 0.0, 0.0);
+}
+
+void pshine_generate_tangents(struct pshine_mesh_attributes *mesh) {
+	uint32_t vertex_count = mesh->vertex_count;
+	uint32_t *identity = malloc(vertex_count * sizeof(uint32_t));
+	weld_tangent_space_vertices(mesh, identity);
+
+	// Accumulated tangents per (vertex identity, orientation). Orientation 0 is
+	// counter-clockwise in texture space (a positive bitangent sign), 1 is mirrored.
+	double3 *sums = calloc(vertex_count * 2, sizeof(double3));
+	/// Per corner: the orientation, or -1 if the triangle has no tangent space.
+	int8_t *corner_orientation = malloc(mesh->index_count * sizeof(int8_t));
+	/// Per vertex: bit `o` is set if a corner with orientation `o` uses the vertex.
+	uint8_t *used_orientations = calloc(vertex_count, sizeof(uint8_t));
+
+	for (uint32_t i = 0; i < mesh->index_count; i += 3) {
+		const uint32_t *tri = &mesh->indices_own[i];
+		double3 p[3];
+		double2 t[3];
+		for (uint32_t k = 0; k < 3; ++k) {
+			p[k] = double3_float3(float3vs(mesh->positions_own[tri[k]]));
+			t[k] = double2xy(mesh->texcoords_own[tri[k]][0], mesh->texcoords_own[tri[k]][1]);
+		}
+		double3 d1 = double3sub(p[1], p[0]), d2 = double3sub(p[2], p[0]);
+		double2 t21 = double2sub(t[1], t[0]), t31 = double2sub(t[2], t[0]);
+		double signed_area = t21.x * t31.y - t21.y * t31.x;
+		int8_t orientation = signed_area > 0.0 ? 0 : 1;
+		// the direction of increasing u, as in MikkTSpace's `InitTriInfo`.
+		double3 os = double3mul(double3sub(double3mul(d1, t31.y), double3mul(d2, t21.y)), orientation == 0 ? 1.0 : -1.0);
+		bool degenerate = signed_area == 0.0 || double3mag2(os) == 0.0;
+		for (uint32_t k = 0; k < 3; ++k) {
+			corner_orientation[i + k] = degenerate ? -1 : orientation;
+			if (degenerate) continue;
+			used_orientations[tri[k]] |= 1 << orientation;
+			double3 n = double3_float3(float3vs(mesh->normals_own[tri[k]]));
+			double3 tangent = project_onto_plane(os, n);
+			// weighted by the corner's angle, measured in the tangent plane.
+			double3 e1 = project_onto_plane(double3sub(p[(k + 1) % 3], p[k]), n);
+			double3 e2 = project_onto_plane(double3sub(p[(k + 2) % 3], p[k]), n);
+			double angle = acos(clampd(double3dot(e1, e2), -1.0, 1.0));
+			double3 *sum = &sums[identity[tri[k]] * 2 + orientation];
+			*sum = double3add(*sum, double3mul(tangent, angle));
+		}
+	}
+
+	// Corners of triangles without a tangent space take one of the vertex's orientations.
+	for (uint32_t i = 0; i < mesh->index_count; ++i) {
+		if (corner_orientation[i] >= 0) continue;
+		uint32_t v = mesh->indices_own[i];
+		corner_orientation[i] = (used_orientations[v] & 1) || used_orientations[v] == 0 ? 0 : 1;
+		used_orientations[v] |= 1 << corner_orientation[i];
+	}
+
+	// A vertex used with both orientations (mirrored texture coordinates) is split in two.
+	uint32_t *new_vertex = malloc(vertex_count * 2 * sizeof(uint32_t));
+	uint32_t new_vertex_count = 0;
+	for (uint32_t v = 0; v < vertex_count; ++v) {
+		for (uint32_t o = 0; o < 2; ++o) {
+			new_vertex[v * 2 + o] = used_orientations[v] & (1 << o) ? new_vertex_count++ : UINT32_MAX;
+		}
+	}
+
+	float (*positions)[3] = malloc(new_vertex_count * sizeof(*positions));
+	float (*normals)[3] = malloc(new_vertex_count * sizeof(*normals));
+	float (*texcoords)[2] = malloc(new_vertex_count * sizeof(*texcoords));
+	float (*tangents)[4] = malloc(new_vertex_count * sizeof(*tangents));
+	for (uint32_t v = 0; v < vertex_count; ++v) {
+		for (uint32_t o = 0; o < 2; ++o) {
+			uint32_t nv = new_vertex[v * 2 + o];
+			if (nv == UINT32_MAX) continue;
+			memcpy(positions[nv], mesh->positions_own[v], sizeof(positions[nv]));
+			memcpy(normals[nv], mesh->normals_own[v], sizeof(normals[nv]));
+			memcpy(texcoords[nv], mesh->texcoords_own[v], sizeof(texcoords[nv]));
+			double3 n = double3_float3(float3vs(mesh->normals_own[v]));
+			double3 tangent = project_onto_plane(sums[identity[v] * 2 + o], n);
+			if (double3mag2(tangent) == 0.0) tangent = any_tangent(n);
+			*(float3 *)tangents[nv] = float3_double3(tangent);
+			tangents[nv][3] = o == 0 ? 1.0f : -1.0f;
+		}
+	}
+	for (uint32_t i = 0; i < mesh->index_count; ++i) {
+		mesh->indices_own[i] = new_vertex[mesh->indices_own[i] * 2 + corner_orientation[i]];
+	}
+
+	free(mesh->positions_own);
+	free(mesh->normals_own);
+	free(mesh->texcoords_own);
+	free(mesh->tangents_own);
+	mesh->positions_own = positions;
+	mesh->normals_own = normals;
+	mesh->texcoords_own = texcoords;
+	mesh->tangents_own = tangents;
+	mesh->vertex_count = new_vertex_count;
+
+	free(new_vertex);
+	free(used_orientations);
+	free(corner_orientation);
+	free(sums);
+	free(identity);
+}
+
+static const cgltf_accessor *find_gltf_attribute(const cgltf_primitive *prim, cgltf_attribute_type type) {
+	for (size_t k = 0; k < prim->attributes_count; ++k) {
+		if (prim->attributes[k].type == type && prim->attributes[k].index == 0) return prim->attributes[k].data;
+	}
+	return nullptr;
+}
+
+/// Unpack an attribute (converting normalized integers) into `components` floats per vertex.
+/// Missing components are filled from `defaults`. Returns null if there's no such attribute.
+static void *unpack_gltf_attribute(
+	const cgltf_accessor *acc,
+	const char *name,
+	size_t vertex_count,
+	size_t components,
+	const float *defaults
+) {
+	if (acc == nullptr) return nullptr;
+	if (acc->count != vertex_count) {
+		PSHINE_WARN("glTF %s attribute has %zu elements, expected %zu, ignoring it", name, acc->count, vertex_count);
+		return nullptr;
+	}
+	size_t acc_components = cgltf_num_components(acc->type);
+	float *packed = malloc(vertex_count * acc_components * sizeof(float));
+	cgltf_accessor_unpack_floats(acc, packed, vertex_count * acc_components);
+	float *out = malloc(vertex_count * components * sizeof(float));
+	for (size_t i = 0; i < vertex_count; ++i) {
+		for (size_t k = 0; k < components; ++k) {
+			out[i * components + k] = k < acc_components ? packed[i * acc_components + k] : defaults[k];
+		}
+	}
+	free(packed);
+	return out;
+}
+
+/// Read the attributes and convert the primitive to a triangle list.
+/// Returns false if the primitive has no triangles.
+static bool read_gltf_attributes(const cgltf_primitive *prim, struct pshine_mesh_attributes *out) {
+	*out = (struct pshine_mesh_attributes){};
+	const cgltf_accessor *position_acc = find_gltf_attribute(prim, cgltf_attribute_type_position);
+	if (position_acc == nullptr) {
+		PSHINE_WARN("glTF primitive without positions, skipping it");
+		return false;
+	}
+	if (
+		prim->type != cgltf_primitive_type_triangles &&
+		prim->type != cgltf_primitive_type_triangle_strip &&
+		prim->type != cgltf_primitive_type_triangle_fan
+	) {
+		PSHINE_WARN("glTF primitive of type %u isn't made of triangles, skipping it", prim->type);
+		return false;
+	}
+	size_t vertex_count = position_acc->count;
+	out->vertex_count = vertex_count;
+	out->positions_own = unpack_gltf_attribute(position_acc, "position", vertex_count, 3, (float[]){ 0, 0, 0 });
+	out->normals_own = unpack_gltf_attribute(
+		find_gltf_attribute(prim, cgltf_attribute_type_normal), "normal", vertex_count, 3, (float[]){ 0, 0, 1 });
+	out->tangents_own = unpack_gltf_attribute(
+		find_gltf_attribute(prim, cgltf_attribute_type_tangent), "tangent", vertex_count, 4, (float[]){ 1, 0, 0, 1 });
+	out->texcoords_own = unpack_gltf_attribute(
+		find_gltf_attribute(prim, cgltf_attribute_type_texcoord), "texcoord", vertex_count, 2, (float[]){ 0, 0 });
+	if (out->texcoords_own == nullptr) out->texcoords_own = calloc(vertex_count, sizeof(*out->texcoords_own));
+
+	size_t index_count = prim->indices != nullptr ? prim->indices->count : vertex_count;
+	uint32_t *indices = malloc(index_count * sizeof(uint32_t));
+	for (size_t i = 0; i < index_count; ++i) {
+		indices[i] = prim->indices != nullptr ? (uint32_t)cgltf_accessor_read_index(prim->indices, i) : (uint32_t)i;
+		if (indices[i] >= vertex_count) {
+			PSHINE_WARN("glTF index %u out of range (%zu vertices), skipping the primitive", indices[i], vertex_count);
+			free(indices);
+			pshine_free_mesh_attributes(out);
+			return false;
+		}
+	}
+
+	switch (prim->type) {
+	case cgltf_primitive_type_triangle_strip:
+	case cgltf_primitive_type_triangle_fan: {
+		size_t triangle_count = index_count >= 3 ? index_count - 2 : 0;
+		out->indices_own = malloc(triangle_count * 3 * sizeof(uint32_t));
+		for (size_t i = 0; i < triangle_count; ++i) {
+			uint32_t *tri = &out->indices_own[i * 3];
+			if (prim->type == cgltf_primitive_type_triangle_fan) {
+				tri[0] = indices[i + 1];
+				tri[1] = indices[i + 2];
+				tri[2] = indices[0];
+			} else if (i % 2 == 0) {
+				tri[0] = indices[i];
+				tri[1] = indices[i + 1];
+				tri[2] = indices[i + 2];
+			} else {
+				tri[0] = indices[i + 1];
+				tri[1] = indices[i];
+				tri[2] = indices[i + 2];
+			}
+		}
+		out->index_count = triangle_count * 3;
+		free(indices);
+	} break;
+	default:
+		out->indices_own = indices;
+		out->index_count = index_count - index_count % 3;
+		break;
+	}
+	if (out->index_count == 0) {
+		pshine_free_mesh_attributes(out);
+		return false;
+	}
+	return true;
+}
+
+struct pshine_static_mesh_vertex pshine_encode_static_mesh_vertex(const struct pshine_mesh_attributes *mesh, uint32_t i) {
+	struct pshine_static_mesh_vertex vertex;
+	float2 normal_oct = float32x3_to_oct(float3norm(float3vs(mesh->normals_own[i])));
+	// the tangent's basis depends on the normal, so use the one the shader decodes.
+	float3 normal = oct_to_float32x3(normal_oct);
+	memcpy(vertex.position, mesh->positions_own[i], sizeof(vertex.position));
+	vertex.tangent_dia = encode_signed_tangent(normal, float3vs(mesh->tangents_own[i]), mesh->tangents_own[i][3]);
+	*(float2*)vertex.normal_oct = normal_oct;
+	memcpy(vertex.texcoord, mesh->texcoords_own[i], sizeof(vertex.texcoord));
+	return vertex;
+}
+
+void pshine_read_gltf_primitive(const struct cgltf_primitive *prim, struct pshine_mesh_data *out) {
+	*out = (struct pshine_mesh_data){ .vertex_type = PSHINE_VERTEX_STATIC_MESH };
+	struct pshine_mesh_attributes mesh;
+	if (!read_gltf_attributes(prim, &mesh)) return;
+	// glTF says to use flat normals if there are none, and MikkTSpace tangents if there are none.
+	if (mesh.normals_own == nullptr) pshine_generate_flat_normals(&mesh);
+	if (mesh.tangents_own == nullptr) pshine_generate_tangents(&mesh);
+
+	struct pshine_static_mesh_vertex *vertices = calloc(mesh.vertex_count, sizeof(*vertices));
+	for (uint32_t i = 0; i < mesh.vertex_count; ++i) vertices[i] = pshine_encode_static_mesh_vertex(&mesh, i);
+	*out = (struct pshine_mesh_data){
+		.vertex_type = PSHINE_VERTEX_STATIC_MESH,
+		.vertex_count = mesh.vertex_count,
+		.vertices = vertices,
+		.index_count = mesh.index_count,
+		.indices = mesh.indices_own,
+	};
+	mesh.indices_own = nullptr;
+	pshine_free_mesh_attributes(&mesh);
+}
+
+void pshine_free_mesh_data(struct pshine_mesh_data *mesh) {
+	free(mesh->vertices);
+	free(mesh->indices);
+	*mesh = (struct pshine_mesh_data){};
+}
+
+float pshine_mesh_extent(const float *positions, size_t stride, uint32_t vertex_count) {
+	if (vertex_count == 0) return 0.0f;
+	double3 lo = mesh_position(positions, stride, 0), hi = lo;
+	for (uint32_t i = 1; i < vertex_count; ++i) {
+		double3 p = mesh_position(positions, stride, i);
+		lo = double3min(lo, p);
+		hi = double3max(hi, p);
+	}
+	return (float)double3mag(double3sub(hi, lo));
+}
+
+/// An open-addressing set of directed edges.
+struct edge_set {
+	size_t mask;
+	uint64_t *keys_own;
+};
+
+static constexpr uint64_t EDGE_SET_EMPTY = UINT64_MAX;
+
+static void init_edge_set(struct edge_set *set, size_t count) {
+	size_t capacity = hash_capacity(count);
+	set->mask = capacity - 1;
+	set->keys_own = malloc(capacity * sizeof(*set->keys_own));
+	memset(set->keys_own, 0xff, capacity * sizeof(*set->keys_own));
+}
+
+static void edge_set_insert(struct edge_set *set, uint32_t a, uint32_t b) {
+	uint64_t key = (uint64_t)a << 32 | b;
+	for (size_t i = mesh_hash(key) & set->mask;; i = (i + 1) & set->mask) {
+		if (set->keys_own[i] == key) return;
+		if (set->keys_own[i] == EDGE_SET_EMPTY) {
+			set->keys_own[i] = key;
+			return;
+		}
+	}
+}
+
+static bool edge_set_has(const struct edge_set *set, uint32_t a, uint32_t b) {
+	uint64_t key = (uint64_t)a << 32 | b;
+	for (size_t i = mesh_hash(key) & set->mask;; i = (i + 1) & set->mask) {
+		if (set->keys_own[i] == key) return true;
+		if (set->keys_own[i] == EDGE_SET_EMPTY) return false;
+	}
+}
+
+/// Find the vertices with bit-identical positions. `root[i]` is the first vertex with the
+/// same position as `i`, and `wedge_next` links each group of such vertices into a cycle.
+static void weld_positions(
+	const float *positions,
+	size_t stride,
+	uint32_t vertex_count,
+	uint32_t *root,
+	uint32_t *wedge_next
+) {
+	size_t capacity = hash_capacity(vertex_count);
+	uint32_t *table = malloc(capacity * sizeof(*table));
+	memset(table, 0xff, capacity * sizeof(*table));
+	for (uint32_t i = 0; i < vertex_count; ++i) {
+		const uint32_t *p = (const uint32_t *)(const void *)((const uint8_t *)positions + stride * i);
+		uint64_t h = mesh_hash(((uint64_t)p[0] << 32 | p[1]) ^ mesh_hash(p[2]));
+		size_t slot = h & (capacity - 1);
+		root[i] = i;
+		wedge_next[i] = i;
+		for (;; slot = (slot + 1) & (capacity - 1)) {
+			if (table[slot] == UINT32_MAX) {
+				table[slot] = i;
+				break;
+			}
+			const uint32_t *q = (const uint32_t *)(const void *)((const uint8_t *)positions + stride * table[slot]);
+			if (p[0] == q[0] && p[1] == q[1] && p[2] == q[2]) {
+				uint32_t r = table[slot];
+				root[i] = r;
+				wedge_next[i] = wedge_next[r];
+				wedge_next[r] = i;
+				break;
+			}
+		}
+	}
+	free(table);
+}
+
+/// The sum of squared distances to a set of weighted planes.
+struct quadric {
+	double a00, a11, a22, a01, a02, a12;
+	double b0, b1, b2;
+	double c;
+	double weight;
+};
+
+/// Add the plane `dot(n, p) + d = 0` (`n` normalized).
+static void quadric_add_plane(struct quadric *q, double3 n, double d, double w) {
+	q->a00 += w * n.x * n.x;
+	q->a11 += w * n.y * n.y;
+	q->a22 += w * n.z * n.z;
+	q->a01 += w * n.x * n.y;
+	q->a02 += w * n.x * n.z;
+	q->a12 += w * n.y * n.z;
+	q->b0 += w * n.x * d;
+	q->b1 += w * n.y * d;
+	q->b2 += w * n.z * d;
+	q->c += w * d * d;
+	q->weight += w;
+}
+
+static void quadric_add(struct quadric *q, const struct quadric *r) {
+	q->a00 += r->a00; q->a11 += r->a11; q->a22 += r->a22;
+	q->a01 += r->a01; q->a02 += r->a02; q->a12 += r->a12;
+	q->b0 += r->b0; q->b1 += r->b1; q->b2 += r->b2;
+	q->c += r->c;
+	q->weight += r->weight;
+}
+
+/// The (weighted RMS) distance from `p` to the quadric's planes.
+static double quadric_error(const struct quadric *q, double3 p) {
+	if (q->weight <= 0.0) return 0.0;
+	double e = q->a00 * p.x * p.x + q->a11 * p.y * p.y + q->a22 * p.z * p.z
+		+ 2.0 * (q->a01 * p.x * p.y + q->a02 * p.x * p.z + q->a12 * p.y * p.z)
+		+ 2.0 * (q->b0 * p.x + q->b1 * p.y + q->b2 * p.z)
+		+ q->c;
+	return sqrt(fabs(e) / q->weight);
+}
+
+/// How a (welded) vertex may move, see `pshine_simplify_mesh`.
+enum vertex_kind : uint8_t {
+	VERTEX_MANIFOLD,
+	VERTEX_BORDER,
+	VERTEX_SEAM,
+	VERTEX_LOCKED,
+};
+
+/// Border edges are kept in place by planes perpendicular to their triangle, this is their weight.
+static constexpr double BORDER_PLANE_WEIGHT = 10.0;
+
+/// A collapse can't turn a triangle's normal more than this (the cosine of the angle).
+static constexpr double MAX_FLIP_COSINE = 0.25;
+
+struct edge_collapse {
+	uint32_t from, to;
+	double error;
+};
+
+static int compare_edge_collapses(const void *a, const void *b) {
+	double ea = ((const struct edge_collapse *)a)->error;
+	double eb = ((const struct edge_collapse *)b)->error;
+	return (ea > eb) - (ea < eb);
+}
+
+struct simplifier {
+	const float *positions;
+	size_t stride;
+	uint32_t vertex_count;
+	uint32_t *root;
+	uint32_t *wedge_next;
+	enum vertex_kind *kinds;
+	struct quadric *quadrics;
+	/// Per-pass: welded and unwelded edges of the current triangles.
+	struct edge_set root_edges, edges;
+	/// Per-pass: the triangles around each welded vertex.
+	uint32_t *adjacency_offsets;
+	uint32_t *adjacency;
+};
+
+static void build_edge_sets(struct simplifier *s, const uint32_t *indices, uint32_t index_count) {
+	init_edge_set(&s->root_edges, index_count);
+	init_edge_set(&s->edges, index_count);
+	for (uint32_t i = 0; i < index_count; i += 3) {
+		for (uint32_t k = 0; k < 3; ++k) {
+			uint32_t a = indices[i + k], b = indices[i + (k + 1) % 3];
+			edge_set_insert(&s->edges, a, b);
+			edge_set_insert(&s->root_edges, s->root[a], s->root[b]);
+		}
+	}
+}
+
+static void free_edge_sets(struct simplifier *s) {
+	free(s->root_edges.keys_own);
+	free(s->edges.keys_own);
+}
+
+static void build_adjacency(struct simplifier *s, const uint32_t *indices, uint32_t index_count) {
+	memset(s->adjacency_offsets, 0, (s->vertex_count + 1) * sizeof(uint32_t));
+	for (uint32_t i = 0; i < index_count; ++i) ++s->adjacency_offsets[s->root[indices[i]] + 1];
+	for (uint32_t v = 0; v < s->vertex_count; ++v) s->adjacency_offsets[v + 1] += s->adjacency_offsets[v];
+	for (uint32_t i = 0; i < index_count; ++i) {
+		// uses the start offsets as cursors, shifted back below.
+		s->adjacency[s->adjacency_offsets[s->root[indices[i]]]++] = i / 3;
+	}
+	for (uint32_t v = s->vertex_count; v > 0; --v) s->adjacency_offsets[v] = s->adjacency_offsets[v - 1];
+	s->adjacency_offsets[0] = 0;
+}
+
+static void init_quadrics_and_kinds(struct simplifier *s, const uint32_t *indices, uint32_t index_count) {
+	uint32_t *open_count = calloc(s->vertex_count, sizeof(uint32_t));
+	uint32_t *seam_count = calloc(s->vertex_count, sizeof(uint32_t));
+	for (uint32_t i = 0; i < index_count; i += 3) {
+		double3 p[3];
+		for (uint32_t k = 0; k < 3; ++k) p[k] = mesh_position(s->positions, s->stride, indices[i + k]);
+		double3 n = double3cross(double3sub(p[1], p[0]), double3sub(p[2], p[0]));
+		double area2 = double3mag(n);
+		if (area2 > 0.0) {
+			n = double3div(n, area2);
+			double d = -double3dot(n, p[0]);
+			for (uint32_t k = 0; k < 3; ++k) quadric_add_plane(&s->quadrics[s->root[indices[i + k]]], n, d, area2 * 0.5);
+		}
+		for (uint32_t k = 0; k < 3; ++k) {
+			uint32_t a = indices[i + k], b = indices[i + (k + 1) % 3];
+			uint32_t ra = s->root[a], rb = s->root[b];
+			if (ra == rb) continue;
+			if (!edge_set_has(&s->root_edges, rb, ra)) {
+				++open_count[ra];
+				++open_count[rb];
+				if (area2 <= 0.0) continue;
+				double3 e = double3sub(p[(k + 1) % 3], p[k]);
+				double3 m = double3cross(e, n);
+				double m_len = double3mag(m);
+				if (m_len <= 0.0) continue;
+				m = double3div(m, m_len);
+				double w = double3mag2(e) * BORDER_PLANE_WEIGHT;
+				quadric_add_plane(&s->quadrics[ra], m, -double3dot(m, p[k]), w);
+				quadric_add_plane(&s->quadrics[rb], m, -double3dot(m, p[k]), w);
+			} else if (!edge_set_has(&s->edges, b, a)) {
+				++seam_count[ra];
+				++seam_count[rb];
+			}
+		}
+	}
+	for (uint32_t v = 0; v < s->vertex_count; ++v) {
+		if (s->root[v] != v) continue;
+		bool has_wedges = s->wedge_next[v] != v;
+		if (!has_wedges) {
+			s->kinds[v] = open_count[v] == 0 ? VERTEX_MANIFOLD : open_count[v] == 2 ? VERTEX_BORDER : VERTEX_LOCKED;
+		} else {
+			// a seam going through the vertex has two edges, with two half-edges each.
+			s->kinds[v] = open_count[v] == 0 && seam_count[v] == 4 ? VERTEX_SEAM : VERTEX_LOCKED;
+		}
+	}
+	free(open_count);
+	free(seam_count);
+}
+
+static bool is_seam_edge(const struct simplifier *s, uint32_t u, uint32_t v) {
+	uint32_t a = u;
+	do {
+		uint32_t b = v;
+		do {
+			if (edge_set_has(&s->edges, a, b) && !edge_set_has(&s->edges, b, a)) return true;
+			b = s->wedge_next[b];
+		} while (b != v);
+		a = s->wedge_next[a];
+	} while (a != u);
+	return false;
+}
+
+/// Whether the kinds of `u` and `v` allow moving `u` to `v`.
+static bool can_collapse(const struct simplifier *s, uint32_t u, uint32_t v) {
+	switch (s->kinds[u]) {
+	case VERTEX_MANIFOLD: return true;
+	case VERTEX_BORDER:
+		return (s->kinds[v] == VERTEX_BORDER || s->kinds[v] == VERTEX_LOCKED)
+			&& (!edge_set_has(&s->root_edges, u, v) || !edge_set_has(&s->root_edges, v, u));
+	case VERTEX_SEAM:
+		return (s->kinds[v] == VERTEX_SEAM || s->kinds[v] == VERTEX_LOCKED) && is_seam_edge(s, u, v);
+	case VERTEX_LOCKED: return false;
+	}
+	return false;
+}
+
+static bool triangle_flips(double3 a, double3 b, double3 c, double3 new_a) {
+	double3 n0 = double3cross(double3sub(b, a), double3sub(c, a));
+	double3 n1 = double3cross(double3sub(b, new_a), double3sub(c, new_a));
+	return double3dot(n0, n1) <= MAX_FLIP_COSINE * double3mag(n0) * double3mag(n1);
+}
+
+/// Check that `u` can be moved to `v` and find the vertex each of `u`'s wedges becomes.
+/// Writes the pairs into `remap` and returns the number of wedges (0 if the collapse isn't possible).
+static uint32_t plan_collapse(
+	const struct simplifier *s,
+	const uint32_t *indices,
+	uint32_t u,
+	uint32_t v,
+	uint32_t remap[][2],
+	uint32_t max_wedges
+) {
+	uint32_t wedge_count = 0;
+	uint32_t a = u;
+	do {
+		if (wedge_count == max_wedges) return 0;
+		uint32_t target = UINT32_MAX;
+		for (uint32_t j = s->adjacency_offsets[u]; j < s->adjacency_offsets[u + 1]; ++j) {
+			const uint32_t *tri = &indices[s->adjacency[j] * 3];
+			if (tri[0] != a && tri[1] != a && tri[2] != a) continue;
+			for (uint32_t k = 0; k < 3; ++k) {
+				if (s->root[tri[k]] != v) continue;
+				if (target != UINT32_MAX && target != tri[k]) return 0;
+				target = tri[k];
+			}
+		}
+		// a wedge that isn't next to `v` would be left without a vertex to move to.
+		if (target == UINT32_MAX) return 0;
+		remap[wedge_count][0] = a;
+		remap[wedge_count][1] = target;
+		++wedge_count;
+		a = s->wedge_next[a];
+	} while (a != u);
+
+	double3 pv = mesh_position(s->positions, s->stride, v);
+	for (uint32_t j = s->adjacency_offsets[u]; j < s->adjacency_offsets[u + 1]; ++j) {
+		const uint32_t *tri = &indices[s->adjacency[j] * 3];
+		uint32_t k = 0;
+		bool has_v = false;
+		for (uint32_t l = 0; l < 3; ++l) {
+			if (s->root[tri[l]] == u) k = l;
+			if (s->root[tri[l]] == v) has_v = true;
+		}
+		if (has_v) continue;
+		if (triangle_flips(
+			mesh_position(s->positions, s->stride, tri[k]),
+			mesh_position(s->positions, s->stride, tri[(k + 1) % 3]),
+			mesh_position(s->positions, s->stride, tri[(k + 2) % 3]),
+			pv
+		)) return 0;
+	}
+	return wedge_count;
+}
+
+uint32_t pshine_simplify_mesh(
+	const float *positions,
+	size_t stride,
+	uint32_t vertex_count,
+	const uint32_t *indices,
+	uint32_t index_count,
+	uint32_t target_index_count,
+	float max_error,
+	uint32_t *out_indices,
+	float *out_error
+) {
+	PSHINE_CHECK(index_count % 3 == 0, "index count must be a multiple of 3");
+	memmove(out_indices, indices, index_count * sizeof(uint32_t));
+	*out_error = 0.0f;
+	if (index_count <= target_index_count) return index_count;
+
+	struct simplifier s = {
+		.positions = positions,
+		.stride = stride,
+		.vertex_count = vertex_count,
+		.root = malloc(vertex_count * sizeof(uint32_t)),
+		.wedge_next = malloc(vertex_count * sizeof(uint32_t)),
+		.kinds = calloc(vertex_count, sizeof(enum vertex_kind)),
+		.quadrics = calloc(vertex_count, sizeof(struct quadric)),
+		.adjacency_offsets = malloc((vertex_count + 1) * sizeof(uint32_t)),
+		.adjacency = malloc(index_count * sizeof(uint32_t)),
+	};
+	weld_positions(positions, stride, vertex_count, s.root, s.wedge_next);
+	build_edge_sets(&s, out_indices, index_count);
+	init_quadrics_and_kinds(&s, out_indices, index_count);
+	free_edge_sets(&s);
+
+	uint32_t *remap = malloc(vertex_count * sizeof(uint32_t));
+	for (uint32_t i = 0; i < vertex_count; ++i) remap[i] = i;
+	bool *locked = malloc(vertex_count * sizeof(bool));
+	struct edge_collapse *collapses = malloc(index_count * sizeof(*collapses));
+	double result_error = 0.0;
+
+	while (index_count > target_index_count) {
+		build_edge_sets(&s, out_indices, index_count);
+		build_adjacency(&s, out_indices, index_count);
+
+		size_t collapse_count = 0;
+		for (uint32_t i = 0; i < index_count; i += 3) {
+			for (uint32_t k = 0; k < 3; ++k) {
+				uint32_t a = s.root[out_indices[i + k]], b = s.root[out_indices[i + (k + 1) % 3]];
+				if (a == b) continue;
+				// an interior edge is seen from both of its triangles, only keep one of them.
+				if (a > b && edge_set_has(&s.root_edges, b, a)) continue;
+				double ab = can_collapse(&s, a, b)
+					? quadric_error(&s.quadrics[a], mesh_position(positions, stride, b)) : INFINITY;
+				double ba = can_collapse(&s, b, a)
+					? quadric_error(&s.quadrics[b], mesh_position(positions, stride, a)) : INFINITY;
+				if (isinf(ab) && isinf(ba)) continue;
+				collapses[collapse_count++] = ab <= ba
+					? (struct edge_collapse){ .from = a, .to = b, .error = ab }
+					: (struct edge_collapse){ .from = b, .to = a, .error = ba };
+			}
+		}
+		qsort(collapses, collapse_count, sizeof(*collapses), compare_edge_collapses);
+
+		memset(locked, 0, vertex_count * sizeof(bool));
+		uint32_t goal = (index_count - target_index_count) / 3;
+		uint32_t removed = 0;
+		size_t applied = 0;
+		enum : uint32_t { MAX_WEDGES = 8 };
+		for (size_t i = 0; i < collapse_count && removed < goal; ++i) {
+			struct edge_collapse c = collapses[i];
+			if (c.error > max_error) break;
+			if (locked[c.from] || locked[c.to]) continue;
+			uint32_t wedge_remap[MAX_WEDGES][2];
+			uint32_t wedge_count = plan_collapse(&s, out_indices, c.from, c.to, wedge_remap, MAX_WEDGES);
+			if (wedge_count == 0) continue;
+			for (uint32_t w = 0; w < wedge_count; ++w) remap[wedge_remap[w][0]] = wedge_remap[w][1];
+			quadric_add(&s.quadrics[c.to], &s.quadrics[c.from]);
+			// the triangles around `from` change, so nothing else may touch them in this pass.
+			for (uint32_t j = s.adjacency_offsets[c.from]; j < s.adjacency_offsets[c.from + 1]; ++j) {
+				const uint32_t *tri = &out_indices[s.adjacency[j] * 3];
+				bool has_to = false;
+				for (uint32_t k = 0; k < 3; ++k) {
+					locked[s.root[tri[k]]] = true;
+					if (s.root[tri[k]] == c.to) has_to = true;
+				}
+				if (has_to) ++removed;
+			}
+			locked[c.from] = locked[c.to] = true;
+			if (c.error > result_error) result_error = c.error;
+			++applied;
+		}
+		free_edge_sets(&s);
+		if (applied == 0) break;
+
+		uint32_t new_index_count = 0;
+		for (uint32_t i = 0; i < index_count; i += 3) {
+			uint32_t a = remap[out_indices[i + 0]];
+			uint32_t b = remap[out_indices[i + 1]];
+			uint32_t c = remap[out_indices[i + 2]];
+			if (s.root[a] == s.root[b] || s.root[b] == s.root[c] || s.root[a] == s.root[c]) continue;
+			out_indices[new_index_count++] = a;
+			out_indices[new_index_count++] = b;
+			out_indices[new_index_count++] = c;
+		}
+		for (uint32_t i = 0; i < vertex_count; ++i) remap[i] = i;
+		index_count = new_index_count;
+	}
+
+	free(collapses);
+	free(locked);
+	free(remap);
+	free(s.root);
+	free(s.wedge_next);
+	free(s.kinds);
+	free(s.quadrics);
+	free(s.adjacency_offsets);
+	free(s.adjacency);
+	*out_error = (float)result_error;
+	return index_count;
+}
+
+void pshine_build_mesh_lods(
+	const struct pshine_mesh_data *mesh,
+	const struct pshine_mesh_lod_params *params,
+	struct pshine_mesh_lod_chain *out
+) {
+	PSHINE_CHECK(mesh->vertex_type == PSHINE_VERTEX_STATIC_MESH, "only static meshes have LODs");
+	const float *positions = ((const struct pshine_static_mesh_vertex *)mesh->vertices)->position;
+	size_t stride = sizeof(struct pshine_static_mesh_vertex);
+	float max_error = params->max_error * pshine_mesh_extent(positions, stride, mesh->vertex_count);
+
+	*out = (struct pshine_mesh_lod_chain){
+		.lod_count = 1,
+		.lods[0] = { .first_index = 0, .index_count = mesh->index_count, .error = 0.0f },
+		.index_count = mesh->index_count,
+		.indices_own = malloc((size_t)mesh->index_count * PSHINE_MESH_MAX_LODS * sizeof(uint32_t)),
+	};
+	memcpy(out->indices_own, mesh->indices, mesh->index_count * sizeof(uint32_t));
+
+	// every LOD is simplified from LOD 0, so that its error is measured against the original mesh.
+	double target = mesh->index_count / 3;
+	for (uint32_t l = 1; l < PSHINE_MESH_MAX_LODS; ++l) {
+		const struct pshine_mesh_lod *prev = &out->lods[l - 1];
+		target *= params->reduction;
+		float error;
+		uint32_t index_count = pshine_simplify_mesh(
+			positions, stride, mesh->vertex_count,
+			mesh->indices, mesh->index_count,
+			(uint32_t)target * 3, max_error,
+			out->indices_own + out->index_count, &error
+		);
+		if (index_count > prev->index_count * (1.0f - params->min_reduction)) break;
+		out->lods[l] = (struct pshine_mesh_lod){
+			.first_index = out->index_count,
+			.index_count = index_count,
+			.error = fmaxf(error, prev->error),
+		};
+		out->index_count += index_count;
+		++out->lod_count;
+	}
+	out->indices_own = realloc(out->indices_own, out->index_count * sizeof(uint32_t));
+}
+
+void pshine_free_mesh_lods(struct pshine_mesh_lod_chain *chain) {
+	free(chain->indices_own);
+	*chain = (struct pshine_mesh_lod_chain){};
+}
+
+struct mesh_part_work {
+	const cgltf_primitive **primitives;
+	size_t part_count;
+	const struct pshine_mesh_lod_params *params;
+	struct pshine_mesh_part *parts;
+	atomic_size_t next_part;
+};
+
+static void mesh_part_worker(void *user) {
+	struct mesh_part_work *work = user;
+	for (;;) {
+		size_t i = atomic_fetch_add(&work->next_part, 1);
+		if (i >= work->part_count) break;
+		struct pshine_mesh_part *part = &work->parts[i];
+		pshine_read_gltf_primitive(work->primitives[i], &part->mesh);
+		if (part->mesh.index_count == 0) part->lods = (struct pshine_mesh_lod_chain){};
+		else pshine_build_mesh_lods(&part->mesh, work->params, &part->lods);
+	}
+}
+
+size_t pshine_load_gltf_mesh_parts(
+	const struct cgltf_data *data,
+	const struct pshine_mesh_lod_params *params,
+	size_t thread_count,
+	struct pshine_mesh_part **out_parts
+) {
+	size_t part_count = 0;
+	for (size_t i = 0; i < data->meshes_count; ++i) part_count += data->meshes[i].primitives_count;
+	struct mesh_part_work work = {
+		.primitives = calloc(part_count, sizeof(cgltf_primitive *)),
+		.part_count = part_count,
+		.params = params,
+		.parts = calloc(part_count, sizeof(struct pshine_mesh_part)),
+	};
+	for (size_t i = 0, part = 0; i < data->meshes_count; ++i) {
+		for (size_t j = 0; j < data->meshes[i].primitives_count; ++j, ++part) {
+			work.primitives[part] = &data->meshes[i].primitives[j];
+		}
+	}
+	atomic_init(&work.next_part, 0);
+
+	if (thread_count == 0) thread_count = pshine_get_cpu_count();
+	if (thread_count > part_count) thread_count = part_count;
+	if (thread_count <= 1) {
+		mesh_part_worker(&work);
+	} else {
+		pshine_thread *threads = calloc(thread_count, sizeof(pshine_thread));
+		for (size_t i = 0; i < thread_count; ++i)
+			threads[i] = pshine_thread_start(&mesh_part_worker, &work);
+		for (size_t i = 0; i < thread_count; ++i)
+			pshine_thread_join(threads[i]);
+		free(threads);
+	}
+	free(work.primitives);
+	*out_parts = work.parts;
+	return part_count;
+}
+
+void pshine_free_mesh_parts(size_t part_count, struct pshine_mesh_part *parts) {
+	for (size_t i = 0; i < part_count; ++i) {
+		pshine_free_mesh_lods(&parts[i].lods);
+		pshine_free_mesh_data(&parts[i].mesh);
+	}
+	free(parts);
+}
+
+/// The squared distance from `p` to the triangle `abc`, from Ericson's "Real-Time Collision Detection".
+static double point_triangle_distance2(double3 p, double3 a, double3 b, double3 c) {
+	double3 ab = double3sub(b, a), ac = double3sub(c, a), ap = double3sub(p, a);
+	double d1 = double3dot(ab, ap), d2 = double3dot(ac, ap);
+	if (d1 <= 0.0 && d2 <= 0.0) return double3mag2(ap);
+	double3 bp = double3sub(p, b);
+	double d3 = double3dot(ab, bp), d4 = double3dot(ac, bp);
+	if (d3 >= 0.0 && d4 <= d3) return double3mag2(bp);
+	double vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0) {
+		double v = d1 / (d1 - d3);
+		return double3mag2(double3sub(ap, double3mul(ab, v)));
+	}
+	double3 cp = double3sub(p, c);
+	double d5 = double3dot(ab, cp), d6 = double3dot(ac, cp);
+	if (d6 >= 0.0 && d5 <= d6) return double3mag2(cp);
+	double vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0) {
+		double w = d2 / (d2 - d6);
+		return double3mag2(double3sub(ap, double3mul(ac, w)));
+	}
+	double va = d3 * d6 - d5 * d4;
+	if (va <= 0.0 && (d4 - d3) >= 0.0 && (d5 - d6) >= 0.0) {
+		double w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+		return double3mag2(double3sub(bp, double3mul(double3sub(c, b), w)));
+	}
+	double denom = 1.0 / (va + vb + vc);
+	double v = vb * denom, w = vc * denom;
+	return double3mag2(double3sub(ap, double3add(double3mul(ab, v), double3mul(ac, w))));
+}
+
+/// A uniform grid of triangles for closest point queries.
+struct triangle_grid {
+	const float *positions;
+	size_t stride;
+	const uint32_t *indices;
+	double3 min;
+	double cell_size;
+	int32_t dims[3];
+	uint32_t *cell_offsets_own;
+	uint32_t *triangles_own;
+};
+
+static void triangle_cell_range(const struct triangle_grid *g, uint32_t t, int32_t lo[3], int32_t hi[3]) {
+	double3 a = mesh_position(g->positions, g->stride, g->indices[t * 3 + 0]);
+	double3 b = mesh_position(g->positions, g->stride, g->indices[t * 3 + 1]);
+	double3 c = mesh_position(g->positions, g->stride, g->indices[t * 3 + 2]);
+	double3 tmin = double3min(a, double3min(b, c)), tmax = double3max(a, double3max(b, c));
+	for (int k = 0; k < 3; ++k) {
+		lo[k] = (int32_t)floor((tmin.vs[k] - g->min.vs[k]) / g->cell_size);
+		hi[k] = (int32_t)floor((tmax.vs[k] - g->min.vs[k]) / g->cell_size);
+		lo[k] = lo[k] < 0 ? 0 : lo[k] >= g->dims[k] ? g->dims[k] - 1 : lo[k];
+		hi[k] = hi[k] < 0 ? 0 : hi[k] >= g->dims[k] ? g->dims[k] - 1 : hi[k];
+	}
+}
+
+static void build_triangle_grid(
+	struct triangle_grid *g,
+	const float *positions,
+	size_t stride,
+	const uint32_t *indices,
+	uint32_t index_count
+) {
+	uint32_t triangle_count = index_count / 3;
+	*g = (struct triangle_grid){ .positions = positions, .stride = stride, .indices = indices };
+	double3 lo = double3v(INFINITY), hi = double3v(-INFINITY);
+	for (uint32_t i = 0; i < index_count; ++i) {
+		double3 p = mesh_position(positions, stride, indices[i]);
+		lo = double3min(lo, p);
+		hi = double3max(hi, p);
+	}
+	double3 size = double3sub(hi, lo);
+	double max_size = fmax(size.x, fmax(size.y, size.z));
+	// the triangles lie on a surface, so most cells are empty: about one triangle per occupied cell.
+	double cells_per_side = fmin(128.0, fmax(1.0, ceil(sqrt((double)triangle_count))));
+	g->min = lo;
+	g->cell_size = max_size > 0.0 ? max_size / cells_per_side : 1.0;
+	size_t cell_count = 1;
+	for (int k = 0; k < 3; ++k) {
+		g->dims[k] = (int32_t)fmax(1.0, ceil(size.vs[k] / g->cell_size));
+		cell_count *= (size_t)g->dims[k];
+	}
+	g->cell_offsets_own = calloc(cell_count + 1, sizeof(uint32_t));
+	for (int pass = 0; pass < 2; ++pass) {
+		for (uint32_t t = 0; t < triangle_count; ++t) {
+			int32_t clo[3], chi[3];
+			triangle_cell_range(g, t, clo, chi);
+			for (int32_t z = clo[2]; z <= chi[2]; ++z)
+			for (int32_t y = clo[1]; y <= chi[1]; ++y)
+			for (int32_t x = clo[0]; x <= chi[0]; ++x) {
+				size_t cell = ((size_t)z * g->dims[1] + y) * g->dims[0] + x;
+				if (pass == 0) ++g->cell_offsets_own[cell + 1];
+				else g->triangles_own[g->cell_offsets_own[cell]++] = t;
+			}
+		}
+		if (pass == 0) {
+			for (size_t c = 0; c < cell_count; ++c) g->cell_offsets_own[c + 1] += g->cell_offsets_own[c];
+			g->triangles_own = malloc((g->cell_offsets_own[cell_count] + 1) * sizeof(uint32_t));
+		} else {
+			for (size_t c = cell_count; c > 0; --c) g->cell_offsets_own[c] = g->cell_offsets_own[c - 1];
+			g->cell_offsets_own[0] = 0;
+		}
+	}
+}
+
+static void free_triangle_grid(struct triangle_grid *g) {
+	free(g->cell_offsets_own);
+	free(g->triangles_own);
+}
+
+static double triangle_grid_distance(const struct triangle_grid *g, double3 p) {
+	int32_t c[3];
+	for (int k = 0; k < 3; ++k) {
+		c[k] = (int32_t)floor((p.vs[k] - g->min.vs[k]) / g->cell_size);
+		c[k] = c[k] < 0 ? 0 : c[k] >= g->dims[k] ? g->dims[k] - 1 : c[k];
+	}
+	int32_t max_ring = g->dims[0];
+	if (g->dims[1] > max_ring) max_ring = g->dims[1];
+	if (g->dims[2] > max_ring) max_ring = g->dims[2];
+	double best = INFINITY;
+	for (int32_t ring = 0; ring <= max_ring; ++ring) {
+		for (int32_t z = c[2] - ring; z <= c[2] + ring; ++z)
+		for (int32_t y = c[1] - ring; y <= c[1] + ring; ++y)
+		for (int32_t x = c[0] - ring; x <= c[0] + ring; ++x) {
+			if (x < 0 || y < 0 || z < 0 || x >= g->dims[0] || y >= g->dims[1] || z >= g->dims[2]) continue;
+			// only the shell of the cube.
+			if (abs(x - c[0]) != ring && abs(y - c[1]) != ring && abs(z - c[2]) != ring) continue;
+			size_t cell = ((size_t)z * g->dims[1] + y) * g->dims[0] + x;
+			for (uint32_t j = g->cell_offsets_own[cell]; j < g->cell_offsets_own[cell + 1]; ++j) {
+				const uint32_t *tri = &g->indices[g->triangles_own[j] * 3];
+				double d = point_triangle_distance2(
+					p,
+					mesh_position(g->positions, g->stride, tri[0]),
+					mesh_position(g->positions, g->stride, tri[1]),
+					mesh_position(g->positions, g->stride, tri[2])
+				);
+				if (d < best) best = d;
+			}
+		}
+		// every cell of the next rings is at least `ring` cells away.
+		double reach = ring * g->cell_size;
+		if (best <= reach * reach) break;
+	}
+	return sqrt(best);
+}
+
+/// The largest distance from the vertices and triangle centers of `a` to the surface of `b`.
+static double one_sided_hausdorff_distance(
+	const float *positions,
+	size_t stride,
+	uint32_t vertex_count,
+	const uint32_t *indices_a,
+	uint32_t index_count_a,
+	const struct triangle_grid *b
+) {
+	bool *visited = calloc(vertex_count, sizeof(bool));
+	double result = 0.0;
+	for (uint32_t i = 0; i < index_count_a; i += 3) {
+		double3 p[3];
+		for (uint32_t k = 0; k < 3; ++k) {
+			p[k] = mesh_position(positions, stride, indices_a[i + k]);
+			if (visited[indices_a[i + k]]) continue;
+			visited[indices_a[i + k]] = true;
+			result = fmax(result, triangle_grid_distance(b, p[k]));
+		}
+		double3 center = double3div(double3add(p[0], double3add(p[1], p[2])), 3.0);
+		result = fmax(result, triangle_grid_distance(b, center));
+	}
+	free(visited);
+	return result;
+}
+
+double pshine_mesh_hausdorff_distance(
+	const float *positions,
+	size_t stride,
+	uint32_t vertex_count,
+	const uint32_t *indices_a,
+	uint32_t index_count_a,
+	const uint32_t *indices_b,
+	uint32_t index_count_b
+) {
+	if (index_count_a == 0 || index_count_b == 0) return index_count_a == index_count_b ? 0.0 : INFINITY;
+	struct triangle_grid grid_a, grid_b;
+	build_triangle_grid(&grid_a, positions, stride, indices_a, index_count_a);
+	build_triangle_grid(&grid_b, positions, stride, indices_b, index_count_b);
+	double ab = one_sided_hausdorff_distance(positions, stride, vertex_count, indices_a, index_count_a, &grid_b);
+	double ba = one_sided_hausdorff_distance(positions, stride, vertex_count, indices_b, index_count_b, &grid_a);
+	free_triangle_grid(&grid_a);
+	free_triangle_grid(&grid_b);
+	return fmax(ab, ba);
+}
+
+bool pshine_test_mesh_lods(const char *path, const struct pshine_mesh_lod_params *params) {
+	struct cgltf_data *data = nullptr;
+	cgltf_result res = cgltf_parse_file(&(cgltf_options){ .type = cgltf_file_type_glb }, path, &data);
+	if (res != cgltf_result_success) {
+		PSHINE_ERROR("mesh lods: failed to load '%s' (%u)", path, res);
+		return false;
+	}
+	res = cgltf_load_buffers(&(cgltf_options){ .type = cgltf_file_type_glb }, data, path);
+	if (res != cgltf_result_success) {
+		PSHINE_ERROR("mesh lods: failed to load the buffers of '%s' (%u)", path, res);
+		cgltf_free(data);
+		return false;
+	}
+
+	// the error is a weighted average distance to the original planes, not a strict bound,
+	// so the Hausdorff distance gets some slack on top of the allowed error.
+	double tolerance = 2.0 * params->max_error;
+	bool ok = true;
+	uint32_t total_triangles[PSHINE_MESH_MAX_LODS] = {};
+	struct pshine_mesh_part *parts;
+	size_t part_count = pshine_load_gltf_mesh_parts(data, params, 0, &parts);
+	for (size_t part = 0; part < part_count; ++part) {
+		const struct pshine_mesh_data mesh = parts[part].mesh;
+		const struct pshine_mesh_lod_chain chain = parts[part].lods;
+		if (mesh.index_count == 0) continue;
+		const float *positions = ((const struct pshine_static_mesh_vertex *)mesh.vertices)->position;
+		size_t stride = sizeof(struct pshine_static_mesh_vertex);
+		double extent = pshine_mesh_extent(positions, stride, mesh.vertex_count);
+		for (uint32_t l = 0; l < chain.lod_count; ++l) {
+			const struct pshine_mesh_lod *lod = &chain.lods[l];
+			const uint32_t *indices = chain.indices_own + lod->first_index;
+			total_triangles[l] += lod->index_count / 3;
+			double distance = pshine_mesh_hausdorff_distance(
+				positions, stride, mesh.vertex_count,
+				chain.indices_own, chain.lods[0].index_count,
+				indices, lod->index_count
+			);
+			double relative = extent > 0.0 ? distance / extent : 0.0;
+			bool lod_ok = lod->index_count % 3 == 0 && relative <= tolerance;
+			if (l > 0) lod_ok = lod_ok && lod->index_count < chain.lods[l - 1].index_count;
+			for (uint32_t k = 0; k < lod->index_count; ++k) lod_ok = lod_ok && indices[k] < mesh.vertex_count;
+			PSHINE_INFO(
+				"mesh lods: part %zu lod %u: %u triangles, error %.5f, hausdorff %.5f (of extent %.3f)%s",
+				part, l, lod->index_count / 3, extent > 0.0 ? lod->error / extent : 0.0,
+				relative, extent, lod_ok ? "" : " FAILED"
+			);
+			ok = ok && lod_ok;
+		}
+	}
+	pshine_free_mesh_parts(part_count, parts);
+	for (uint32_t l = 0; l < PSHINE_MESH_MAX_LODS; ++l) {
+		PSHINE_INFO("mesh lods: lod %u: %u triangles in total", l, total_triangles[l]);
+	}
+	cgltf_free(data);
+	return ok;
+}
+
+/// Fills in the vertex `(s, t)`, `0 ≤ s, t ≤ 1`, of a test grid.
+typedef void test_grid_vertex_fn(double s, double t, float position[3], float normal[3], float texcoord[2]);
+
+/// A `n × n` quad grid, wound counter-clockwise when looking at it from the side `normal` points to.
+static struct pshine_mesh_attributes make_test_grid(uint32_t n, test_grid_vertex_fn *fn) {
+	struct pshine_mesh_attributes mesh = {
+		.vertex_count = (n + 1) * (n + 1),
+		.index_count = n * n * 6,
+	};
+	mesh.positions_own = malloc(mesh.vertex_count * sizeof(*mesh.positions_own));
+	mesh.normals_own = malloc(mesh.vertex_count * sizeof(*mesh.normals_own));
+	mesh.texcoords_own = malloc(mesh.vertex_count * sizeof(*mesh.texcoords_own));
+	mesh.indices_own = malloc(mesh.index_count * sizeof(*mesh.indices_own));
+	for (uint32_t j = 0; j <= n; ++j) {
+		for (uint32_t i = 0; i <= n; ++i) {
+			uint32_t v = j * (n + 1) + i;
+			fn((double)i / n, (double)j / n, mesh.positions_own[v], mesh.normals_own[v], mesh.texcoords_own[v]);
+		}
+	}
+	for (uint32_t j = 0, k = 0; j < n; ++j) {
+		for (uint32_t i = 0; i < n; ++i) {
+			uint32_t v = j * (n + 1) + i, w = n + 1;
+			uint32_t quad[6] = { v, v + 1, v + w + 1, v, v + w + 1, v + w };
+			memcpy(&mesh.indices_own[k], quad, sizeof(quad));
+			k += 6;
+		}
+	}
+	return mesh;
+}
+
+static void test_plane_vertex(double s, double t, float position[3], float normal[3], float texcoord[2]) {
+	// texture coordinates rotated by 30° and scaled, so the tangent is (cos 30°, -sin 30°, 0).
+	double x = 2.0 * s - 1.0, y = 2.0 * t - 1.0, a = π / 6.0;
+	memcpy(position, (float[3]){ x, y, 0.0f }, sizeof(float[3]));
+	memcpy(normal, (float[3]){ 0.0f, 0.0f, 1.0f }, sizeof(float[3]));
+	memcpy(texcoord, (float[2]){ 3.0 * (cos(a) * x - sin(a) * y), 3.0 * (sin(a) * x + cos(a) * y) }, sizeof(float[2]));
+}
+
+static void test_mirrored_plane_vertex(double s, double t, float position[3], float normal[3], float texcoord[2]) {
+	// the left half's texture is mirrored: u = |x|.
+	double x = 2.0 * s - 1.0, y = 2.0 * t - 1.0;
+	memcpy(position, (float[3]){ x, y, 0.0f }, sizeof(float[3]));
+	memcpy(normal, (float[3]){ 0.0f, 0.0f, 1.0f }, sizeof(float[3]));
+	memcpy(texcoord, (float[2]){ fabs(x), y }, sizeof(float[2]));
+}
+
+static void test_sphere_vertex(double s, double t, float position[3], float normal[3], float texcoord[2]) {
+	// u goes around the Y axis, v from the south to the north pole.
+	double phi = 2.0 * π * s, theta = π * (1.0 - t);
+	double3 p = double3xyz(sin(theta) * cos(phi), cos(theta), -sin(theta) * sin(phi));
+	*(float3 *)position = float3_double3(p);
+	*(float3 *)normal = float3_double3(p);
+	memcpy(texcoord, (float[2]){ s, t }, sizeof(float[2]));
+}
+
+static void test_zero_uv_sphere_vertex(double s, double t, float position[3], float normal[3], float texcoord[2]) {
+	test_sphere_vertex(s, t, position, normal, texcoord);
+	texcoord[0] = texcoord[1] = 0.0f;
+}
+
+/// The expected tangent and bitangent (the directions of increasing u and v) at vertex `v`,
+/// false if there's no reference there.
+typedef bool test_tangent_reference_fn(const struct pshine_mesh_attributes *mesh, uint32_t v, double3 *tangent, double3 *bitangent);
+
+static bool test_plane_reference(const struct pshine_mesh_attributes *, uint32_t, double3 *tangent, double3 *bitangent) {
+	*tangent = double3xyz(cos(π / 6.0), -sin(π / 6.0), 0.0);
+	*bitangent = double3xyz(sin(π / 6.0), cos(π / 6.0), 0.0);
+	return true;
+}
+
+static bool test_mirrored_plane_reference(const struct pshine_mesh_attributes *mesh, uint32_t v, double3 *tangent, double3 *bitangent) {
+	// vertices on the mirror line are split, which half they belong to is only known from the w.
+	float x = mesh->positions_own[v][0];
+	bool left = x < 0.0f || (x == 0.0f && mesh->tangents_own[v][3] < 0.0f);
+	*tangent = double3xyz(left ? -1.0 : 1.0, 0.0, 0.0);
+	*bitangent = double3xyz(0.0, 1.0, 0.0);
+	return true;
+}
+
+static bool test_sphere_reference(const struct pshine_mesh_attributes *mesh, uint32_t v, double3 *tangent, double3 *bitangent) {
+	const float *p = mesh->positions_own[v];
+	// near the poles the tangent is an average over very different directions, and vertices
+	// on the texture seam only see the (skewed) triangles on one side.
+	float u = mesh->texcoords_own[v][0];
+	if (fabsf(p[1]) > 0.95f || u == 0.0f || u == 1.0f) return false;
+	*tangent = double3norm(double3xyz(p[2], 0.0, -p[0]));
+	double r = hypot(p[0], p[2]);
+	*bitangent = double3xyz(-p[1] * p[0] / r, r, -p[1] * p[2] / r);
+	return true;
+}
+
+/// The bitangent `std_mesh.vert` gets from vertex `v` packed by `pshine_encode_static_mesh_vertex`.
+static double3 decode_test_bitangent(const struct pshine_mesh_attributes *mesh, uint32_t v) {
+	struct pshine_static_mesh_vertex packed = pshine_encode_static_mesh_vertex(mesh, v);
+	float3 n = oct_to_float32x3(float2xy(packed.normal_oct[0], packed.normal_oct[1]));
+	float sign;
+	float3 t = decode_signed_tangent(n, packed.tangent_dia, &sign);
+	return double3norm(double3_float3(float3mul(float3cross(n, t), sign)));
+}
+
+static double test_vector_angle(double3 a, double3 b) {
+	return acos(clampd(double3dot(double3norm(a), double3norm(b)), -1.0, 1.0));
+}
+
+/// Generate the tangents of `mesh` (and the normals if it has none), and check them against the reference,
+/// if any, also after packing them into vertices. All tangents must be unit length and perpendicular
+/// to the normals. Frees the mesh.
+static bool check_test_tangents(
+	const char *name,
+	struct pshine_mesh_attributes mesh,
+	test_tangent_reference_fn *reference,
+	uint32_t expected_vertex_count
+) {
+	uint32_t index_count = mesh.index_count;
+	if (mesh.normals_own == nullptr) pshine_generate_flat_normals(&mesh);
+	pshine_generate_tangents(&mesh);
+	bool ok = mesh.index_count == index_count
+		&& (expected_vertex_count == 0 || mesh.vertex_count == expected_vertex_count);
+	for (uint32_t i = 0; i < mesh.index_count; ++i) ok = ok && mesh.indices_own[i] < mesh.vertex_count;
+	double max_length_error = 0.0, max_normal_dot = 0.0, max_angle = 0.0, max_bitangent_angle = 0.0;
+	size_t sign_failures = 0;
+	for (uint32_t v = 0; v < mesh.vertex_count; ++v) {
+		double3 n = double3norm(double3xyz(mesh.normals_own[v][0], mesh.normals_own[v][1], mesh.normals_own[v][2]));
+		double3 t = double3xyz(mesh.tangents_own[v][0], mesh.tangents_own[v][1], mesh.tangents_own[v][2]);
+		max_length_error = fmax(max_length_error, fabs(double3mag(t) - 1.0));
+		max_normal_dot = fmax(max_normal_dot, fabs(double3dot(t, n)));
+		if (fabsf(mesh.tangents_own[v][3]) != 1.0f) ++sign_failures;
+		double3 decoded_bitangent = decode_test_bitangent(&mesh, v);
+		double3 bitangent = double3mul(double3cross(n, t), mesh.tangents_own[v][3]);
+		max_bitangent_angle = fmax(max_bitangent_angle, test_vector_angle(decoded_bitangent, bitangent));
+		double3 expected, expected_bitangent;
+		if (reference == nullptr || !reference(&mesh, v, &expected, &expected_bitangent)) continue;
+		max_angle = fmax(max_angle, test_vector_angle(t, expected));
+		float expected_sign = double3dot(double3cross(n, expected), expected_bitangent) < 0.0 ? -1.0f : 1.0f;
+		if (mesh.tangents_own[v][3] != expected_sign) ++sign_failures;
+		max_bitangent_angle = fmax(max_bitangent_angle, test_vector_angle(decoded_bitangent, expected_bitangent));
+	}
+	// one degree, the references are exact but the sphere's tangents are averaged over flat triangles.
+	ok = ok && max_length_error < 1e-4 && max_normal_dot < 1e-4 && max_angle < π / 180.0
+		&& max_bitangent_angle < π / 180.0 && sign_failures == 0;
+	PSHINE_INFO(
+		"mesh tangents: %s: %u vertices, length error %.2e, normal dot %.2e, angle error %.3f°, "
+		"decoded bitangent angle error %.3f°, %zu sign failures%s",
+		name, mesh.vertex_count, max_length_error, max_normal_dot, max_angle * 180.0 / π,
+		max_bitangent_angle * 180.0 / π, sign_failures, ok ? "" : " FAILED"
+	);
+	pshine_free_mesh_attributes(&mesh);
+	return ok;
+}
+
+/// Generate the tangents of the mesh in `path` and check them against the MikkTSpace tangents
+/// it has for every triangle corner, also after packing them into vertices.
+static bool check_mikktspace_tangents(const char *path) {
+	FILE *fin = fopen(path, "r");
+	if (fin == nullptr) {
+		PSHINE_ERROR("mesh tangents: could not open '%s'", path);
+		return false;
+	}
+	enum : uint32_t { MAX_CORNER_COUNT = 3 * 256 };
+	float corners[MAX_CORNER_COUNT][12];
+	uint32_t corner_count = 0;
+	bool ok = true;
+	char line[512];
+	while (fgets(line, sizeof line, fin) != nullptr) {
+		if (line[0] == '#' || line[0] == '\n') continue;
+		float *c = corners[corner_count];
+		if (corner_count == MAX_CORNER_COUNT || sscanf(line, "%f %f %f %f %f %f %f %f %f %f %f %f",
+			&c[0], &c[1], &c[2], &c[3], &c[4], &c[5], &c[6], &c[7], &c[8], &c[9], &c[10], &c[11]) != 12) {
+			PSHINE_ERROR("mesh tangents: bad line %u in '%s'", corner_count, path);
+			ok = false;
+			break;
+		}
+		++corner_count;
+	}
+	fclose(fin);
+	if (!ok || corner_count == 0 || corner_count % 3 != 0) return false;
+
+	// corners with the same position, normal and texture coordinate are one vertex.
+	struct pshine_mesh_attributes mesh = {
+		.positions_own = malloc(corner_count * sizeof(float[3])),
+		.normals_own = malloc(corner_count * sizeof(float[3])),
+		.texcoords_own = malloc(corner_count * sizeof(float[2])),
+		.index_count = corner_count,
+		.indices_own = malloc(corner_count * sizeof(uint32_t)),
+	};
+	for (uint32_t k = 0; k < corner_count; ++k) {
+		uint32_t v = 0;
+		while (v < mesh.vertex_count && (memcmp(mesh.positions_own[v], &corners[k][0], sizeof(float[3])) != 0
+			|| memcmp(mesh.normals_own[v], &corners[k][3], sizeof(float[3])) != 0
+			|| memcmp(mesh.texcoords_own[v], &corners[k][6], sizeof(float[2])) != 0)) ++v;
+		if (v == mesh.vertex_count) {
+			memcpy(mesh.positions_own[v], &corners[k][0], sizeof(float[3]));
+			memcpy(mesh.normals_own[v], &corners[k][3], sizeof(float[3]));
+			memcpy(mesh.texcoords_own[v], &corners[k][6], sizeof(float[2]));
+			++mesh.vertex_count;
+		}
+		mesh.indices_own[k] = v;
+	}
+	uint32_t welded_count = mesh.vertex_count;
+	pshine_generate_tangents(&mesh);
+
+	double max_angle = 0.0, max_bitangent_angle = 0.0;
+	size_t sign_failures = 0;
+	for (uint32_t k = 0; k < corner_count; ++k) {
+		uint32_t v = mesh.indices_own[k];
+		double3 n = double3_float3(float3vs(&corners[k][3]));
+		double3 expected = double3_float3(float3vs(&corners[k][8]));
+		double3 t = double3xyz(mesh.tangents_own[v][0], mesh.tangents_own[v][1], mesh.tangents_own[v][2]);
+		max_angle = fmax(max_angle, test_vector_angle(t, expected));
+		if (mesh.tangents_own[v][3] != corners[k][11]) ++sign_failures;
+		double3 expected_bitangent = double3mul(double3cross(n, expected), corners[k][11]);
+		max_bitangent_angle = fmax(max_bitangent_angle, test_vector_angle(decode_test_bitangent(&mesh, v), expected_bitangent));
+	}
+	// the faces are flat, so MikkTSpace's tangents are exact: only allow for rounding.
+	ok = mesh.index_count == corner_count && max_angle < 1e-3 && max_bitangent_angle < 1e-3 && sign_failures == 0;
+	PSHINE_INFO(
+		"mesh tangents: MikkTSpace reference: %u corners, %u vertices (%u welded), angle error %.2e°, "
+		"decoded bitangent angle error %.2e°, %zu sign failures%s",
+		corner_count, mesh.vertex_count, welded_count, max_angle * 180.0 / π,
+		max_bitangent_angle * 180.0 / π, sign_failures, ok ? "" : " FAILED"
+	);
+	pshine_free_mesh_attributes(&mesh);
+	return ok;
+}
+
+bool pshine_test_mesh_tangents(const char *mikktspace_path) {
+	enum : uint32_t { N = 16 };
+	bool ok = true;
+	ok = check_test_tangents("plane", make_test_grid(N, &test_plane_vertex), &test_plane_reference, (N + 1) * (N + 1));
+	// the mirror line's vertices (the middle column) are split in two.
+	ok = check_test_tangents("mirrored plane", make_test_grid(N, &test_mirrored_plane_vertex),
+		&test_mirrored_plane_reference, (N + 1) * (N + 2)) && ok;
+	ok = check_test_tangents("sphere", make_test_grid(N * 2, &test_sphere_vertex), &test_sphere_reference, 0) && ok;
+
+	struct pshine_mesh_attributes flat = make_test_grid(N * 2, &test_sphere_vertex);
+	free(flat.normals_own);
+	flat.normals_own = nullptr;
+	ok = check_test_tangents("flat sphere", flat, nullptr, flat.index_count) && ok;
+
+	ok = check_test_tangents("sphere without texture coordinates", make_test_grid(N * 2, &test_zero_uv_sphere_vertex),
+		nullptr, 0) && ok;
+	ok = check_mikktspace_tangents(mikktspace_path) && ok;
+	return ok;
+}
@@ -0,0 +1,149 @@
+#ifndef PSHINE_MESH_H_
+#define PSHINE_MESH_H_
+#include <pshine/util.h>
+#include <pshine/game.h>
+
+// Imported mesh processing: glTF primitives, generated normals and tangents, and LOD chains.
+
+struct cgltf_primitive;
+struct cgltf_data;
+
+/// An unpacked triangle list, one array per attribute (all allocated with `malloc`).
+struct pshine_mesh_attributes {
+	uint32_t vertex_count;
+	float (*positions_own)[3];
+	float (*normals_own)[3];
+	/// The w is the bitangent sign: `bitangent = cross(normal, tangent.xyz) * w`.
+	float (*tangents_own)[4];
+	float (*texcoords_own)[2];
+	uint32_t index_count;
+	uint32_t *indices_own;
+};
+
+void pshine_free_mesh_attributes(struct pshine_mesh_attributes *mesh);
+
+/// Replace the normals with the face normals. Every corner becomes its own vertex.
+void pshine_generate_flat_normals(struct pshine_mesh_attributes *mesh);
+
+/// Replace the tangents with MikkTSpace tangents: per-triangle texture space directions projected
+/// onto the vertex normals and summed weighted by corner angle, over all vertices with the same
+/// position, normal and texture coordinate. Vertices with mirrored texture coordinates on their
+/// sides are split in two. Where the texture coordinates are degenerate, the tangent is some
+/// direction perpendicular to the normal.
+void pshine_generate_tangents(struct pshine_mesh_attributes *mesh);
+
+/// Read a glTF primitive into a `PSHINE_VERTEX_STATIC_MESH` mesh. Missing normals are flat,
+/// missing tangents are generated and missing texture coordinates are zero. Strips and fans become
+/// lists. Primitives that aren't triangles or have no positions give an empty mesh (with a warning).
+/// The vertices and indices are allocated with `malloc`, free them with `pshine_free_mesh_data`.
+void pshine_read_gltf_primitive(const struct cgltf_primitive *prim, struct pshine_mesh_data *out);
+
+/// Pack vertex `i` of a mesh with normals and tangents the way `std_mesh.vert` reads it.
+struct pshine_static_mesh_vertex pshine_encode_static_mesh_vertex(const struct pshine_mesh_attributes *mesh, uint32_t i);
+
+void pshine_free_mesh_data(struct pshine_mesh_data *mesh);
+
+enum : size_t { PSHINE_MESH_MAX_LODS = 4 };
+
+/// A range in `pshine_mesh_lod_chain::indices_own`.
+struct pshine_mesh_lod {
+	uint32_t first_index;
+	uint32_t index_count;
+	/// The simplification error, in mesh units (0 for LOD 0).
+	float error;
+};
+
+/// All LODs share the mesh's vertices, only the indices differ.
+struct pshine_mesh_lod_chain {
+	uint32_t lod_count;
+	struct pshine_mesh_lod lods[PSHINE_MESH_MAX_LODS];
+	/// The indices of all LODs, LOD 0 (the original mesh) first.
+	uint32_t index_count;
+	uint32_t *indices_own;
+};
+
+struct pshine_mesh_lod_params {
+	/// The triangle count of each LOD relative to the previous one.
+	float reduction;
+	/// The largest error a LOD may have, relative to the mesh's extent.
+	float max_error;
+	/// LODs that remove less than this fraction of the previous LOD's triangles aren't kept.
+	float min_reduction;
+};
+
+static constexpr struct pshine_mesh_lod_params PSHINE_DEFAULT_MESH_LOD_PARAMS = {
+	.reduction = 0.5f,
+	.max_error = 0.02f,
+	.min_reduction = 0.1f,
+};
+
+/// Simplify a triangle mesh by collapsing edges in order of increasing quadric error,
+/// until it has at most `target_index_count` indices or the next collapse would exceed
+/// `max_error` (in mesh units). Only the indices change, vertices are never moved. Vertices
+/// on open borders only move along the border, vertices on attribute seams only along the seam.
+/// `positions` points to the first vertex's position (3 floats), vertices are `stride` bytes apart.
+/// `out_indices` must have room for `index_count` indices. Returns the new index count,
+/// the largest error of the collapses made is stored in `*out_error`.
+uint32_t pshine_simplify_mesh(
+	const float *positions,
+	size_t stride,
+	uint32_t vertex_count,
+	const uint32_t *indices,
+	uint32_t index_count,
+	uint32_t target_index_count,
+	float max_error,
+	uint32_t *out_indices,
+	float *out_error
+);
+
+/// Build the LOD chain of a static mesh.
+void pshine_build_mesh_lods(
+	const struct pshine_mesh_data *mesh,
+	const struct pshine_mesh_lod_params *params,
+	struct pshine_mesh_lod_chain *out
+);
+
+void pshine_free_mesh_lods(struct pshine_mesh_lod_chain *chain);
+
+struct pshine_mesh_part {
+	struct pshine_mesh_data mesh;
+	/// Empty (`lod_count` 0) if the mesh is.
+	struct pshine_mesh_lod_chain lods;
+};
+
+/// Read every primitive of every mesh (in order) and build its LOD chain, on `thread_count`
+/// threads (0 for one per CPU). Returns the number of parts, free them with `pshine_free_mesh_parts`.
+size_t pshine_load_gltf_mesh_parts(
+	const struct cgltf_data *data,
+	const struct pshine_mesh_lod_params *params,
+	size_t thread_count,
+	struct pshine_mesh_part **out_parts
+);
+
+void pshine_free_mesh_parts(size_t part_count, struct pshine_mesh_part *parts);
+
+/// The diagonal of the mesh's bounding box.
+float pshine_mesh_extent(const float *positions, size_t stride, uint32_t vertex_count);
+
+/// The symmetric Hausdorff distance between two triangle meshes over the same vertices,
+/// measured from every vertex and triangle center of one mesh to the surface of the other.
+double pshine_mesh_hausdorff_distance(
+	const float *positions,
+	size_t stride,
+	uint32_t vertex_count,
+	const uint32_t *indices_a,
+	uint32_t index_count_a,
+	const uint32_t *indices_b,
+	uint32_t index_count_b
+);
+
+/// Build the LOD chain of every primitive of a glTF model and check the triangle counts and
+/// the Hausdorff error of every LOD against LOD 0. Logs a table and returns false on failure.
+bool pshine_test_mesh_lods(const char *path, const struct pshine_mesh_lod_params *params);
+
+/// Check the generated tangents of meshes with known tangents (a plane, a mirrored plane, a sphere
+/// and the MikkTSpace tangents in `mikktspace_path`), also as the vertex shader decodes them,
+/// and that meshes without normals or texture coordinates still get valid ones. Logs them and returns false on failure.
+bool pshine_test_mesh_tangents(const char *mikktspace_path);
+
+#endif // PSHINE_MESH_H_
@@ -0,0 +1,275 @@
+#include "renderer_graph.h"
+
+// Each drawn atmosphere's sky-view and aerial perspective LUTs, in its slot of the frame's.
+static const struct rg_image_ref_spec atmosphere_luts_refs[] = {
+	{ RPIMG_ATMO_SKY_VIEW,
+		.usage = RG_IMAGE_USE_OTHER,
+		.access = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+		.stage = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.layout = VK_IMAGE_LAYOUT_GENERAL,
+		.final_layout = VK_IMAGE_LAYOUT_GENERAL },
+	{ RPIMG_ATMO_AERIAL,
+		.usage = RG_IMAGE_USE_OTHER,
+		.access = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+		.stage = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.layout = VK_IMAGE_LAYOUT_GENERAL,
+		.final_layout = VK_IMAGE_LAYOUT_GENERAL },
+};
+
+static const struct rg_image_ref_spec shadow_refs[] = {
+	// only the cascades rendered again are cleared, see `record_shadow_pass` in vk.c.
+	{ RPIMG_SHADOW0, RG_IMAGE_USE_DEPTH_ATTACHMENT_BIT },
+	{ RPIMG_SHADOWC, RG_IMAGE_USE_COLOR_ATTACHMENT_BIT },
+};
+
+static const struct rg_image_ref_spec hdr_geometry_refs[] = {
+	{ RPIMG_COLOR0, RG_IMAGE_USE_COLOR_ATTACHMENT_BIT | RG_IMAGE_USE_CLEARED_BIT },
+	{ RPIMG_DEPTH0, RG_IMAGE_USE_DEPTH_ATTACHMENT_BIT | RG_IMAGE_USE_CLEARED_BIT },
+	{ RPIMG_GBUFFER0, RG_IMAGE_USE_COLOR_ATTACHMENT_BIT | RG_IMAGE_USE_CLEARED_BIT },
+	{ RPIMG_GBUFFER1, RG_IMAGE_USE_COLOR_ATTACHMENT_BIT | RG_IMAGE_USE_CLEARED_BIT },
+	{ RPIMG_GBUFFER2, RG_IMAGE_USE_COLOR_ATTACHMENT_BIT | RG_IMAGE_USE_CLEARED_BIT },
+	{ RPIMG_SHADOW0, RG_IMAGE_USE_SAMPLED_BIT },
+};
+
+// The resolve reads last frame's layer of the histories and writes this frame's.
+static const struct rg_image_ref_spec atmosphere_half_res_refs[] = {
+	{ RPIMG_DEPTH0,
+		.usage = RG_IMAGE_USE_SAMPLED_BIT,
+		.stage = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT },
+	{ RPIMG_ATMO_SKY_VIEW,
+		.usage = RG_IMAGE_USE_SAMPLED_BIT,
+		.stage = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT },
+	{ RPIMG_ATMO_AERIAL,
+		.usage = RG_IMAGE_USE_SAMPLED_BIT,
+		.stage = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT },
+	{ RPIMG_ATMO_LIGHT,
+		.usage = RG_IMAGE_USE_OTHER,
+		.access = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+		.stage = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.layout = VK_IMAGE_LAYOUT_GENERAL,
+		.final_layout = VK_IMAGE_LAYOUT_GENERAL },
+	{ RPIMG_ATMO_HISTORY,
+		.usage = RG_IMAGE_USE_OTHER,
+		.access = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+		.stage = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.layout = VK_IMAGE_LAYOUT_GENERAL,
+		.final_layout = VK_IMAGE_LAYOUT_GENERAL },
+	{ RPIMG_ATMO_HISTORY_DEPTH,
+		.usage = RG_IMAGE_USE_OTHER,
+		.access = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+		.stage = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.layout = VK_IMAGE_LAYOUT_GENERAL,
+		.final_layout = VK_IMAGE_LAYOUT_GENERAL },
+};
+
+static const struct rg_image_ref_spec hdr_atmosphere_refs[] = {
+	{ RPIMG_COLOR0,
+		.usage = RG_IMAGE_USE_COLOR_INPUT_ATTACHMENT_BIT,
+		.input_attachment_index = 0 },
+	{ RPIMG_DEPTH0,
+		.usage = RG_IMAGE_USE_DEPTH_INPUT_ATTACHMENT_BIT,
+		.input_attachment_index = 1 },
+	{ RPIMG_GBUFFER0,
+		.usage = RG_IMAGE_USE_COLOR_INPUT_ATTACHMENT_BIT,
+		.input_attachment_index = 2 },
+	{ RPIMG_GBUFFER1,
+		.usage = RG_IMAGE_USE_COLOR_INPUT_ATTACHMENT_BIT,
+		.input_attachment_index = 3 },
+	{ RPIMG_GBUFFER2,
+		.usage = RG_IMAGE_USE_COLOR_INPUT_ATTACHMENT_BIT,
+		.input_attachment_index = 4 },
+	// the LUTs without the half-res atmosphere, its history with it.
+	{ RPIMG_ATMO_SKY_VIEW, RG_IMAGE_USE_SAMPLED_BIT },
+	{ RPIMG_ATMO_AERIAL, RG_IMAGE_USE_SAMPLED_BIT },
+	{ RPIMG_ATMO_HISTORY,
+		.usage = RG_IMAGE_USE_OTHER,
+		.access = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+		.stage = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+		.layout = VK_IMAGE_LAYOUT_GENERAL,
+		.final_layout = VK_IMAGE_LAYOUT_GENERAL },
+	{ RPIMG_ATMO_HISTORY_DEPTH,
+		.usage = RG_IMAGE_USE_OTHER,
+		.access = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+		.stage = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+		.layout = VK_IMAGE_LAYOUT_GENERAL,
+		.final_layout = VK_IMAGE_LAYOUT_GENERAL },
+};
+
+static const struct rg_image_ref_spec hdr_lighting_refs[] = {
+	{ RPIMG_COLOR0,
+		.usage = RG_IMAGE_USE_COLOR_INPUT_ATTACHMENT_BIT,
+		.input_attachment_index = 0 },
+	{ RPIMG_DEPTH0,
+		.usage = RG_IMAGE_USE_DEPTH_INPUT_ATTACHMENT_BIT,
+		.input_attachment_index = 1 },
+	{ RPIMG_GBUFFER0,
+		.usage = RG_IMAGE_USE_COLOR_INPUT_ATTACHMENT_BIT,
+		.input_attachment_index = 2 },
+	{ RPIMG_GBUFFER1,
+		.usage = RG_IMAGE_USE_COLOR_INPUT_ATTACHMENT_BIT,
+		.input_attachment_index = 3 },
+	{ RPIMG_GBUFFER2,
+		.usage = RG_IMAGE_USE_COLOR_INPUT_ATTACHMENT_BIT,
+		.input_attachment_index = 4 },
+};
+
+static const struct rg_image_ref_spec bloom_refs[] = {
+	{
+		.image_id = RPIMG_COLOR0,
+		.usage = RG_IMAGE_USE_OTHER | RG_IMAGE_USE_SAMPLED_BIT,
+		// the last upsample adds into it.
+		.access = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT
+			| VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+		.stage = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.layout = VK_IMAGE_LAYOUT_GENERAL,
+		.final_layout = VK_IMAGE_LAYOUT_GENERAL,
+	},
+	// all the mips, only used here so it can take the GBuffers' memory (without async compute).
+	{
+		.image_id = RPIMG_BLOOM,
+		.usage = RG_IMAGE_USE_OTHER | RG_IMAGE_USE_SAMPLED_BIT,
+		.access = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT
+			| VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+		.stage = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		.layout = VK_IMAGE_LAYOUT_GENERAL,
+		.final_layout = VK_IMAGE_LAYOUT_GENERAL,
+	},
+};
+
+static const struct rg_image_ref_spec sdr_tonemap_refs[] = {
+	{ RG_IMAGE_SWAPCHAIN, RG_IMAGE_USE_COLOR_ATTACHMENT_BIT | RG_IMAGE_USE_NO_READ_BIT },
+	{ RPIMG_COLOR0, RG_IMAGE_USE_SAMPLED_BIT },
+	{ RPIMG_DEPTH0, RG_IMAGE_USE_SAMPLED_BIT },
+};
+
+static const struct rg_image_ref_spec sdr_gui_refs[] = {
+	{ RG_IMAGE_SWAPCHAIN, RG_IMAGE_USE_COLOR_ATTACHMENT_BIT },
+	// { RPIMG_COLOR0, RG_IMAGE_USE_SAMPLED_BIT },
+	// { RPIMG_DEPTH0, RG_IMAGE_USE_SAMPLED_BIT },
+	{ RPIMG_SHADOWC, RG_IMAGE_USE_SAMPLED_BIT },
+};
+
+#define REFS(refs) .image_ref_count = sizeof(refs) / sizeof(*refs), .image_refs = refs
+
+struct rg_graph_spec pshine_make_renderer_graph_spec(
+	const struct pshine_renderer_graph_info *info,
+	struct pshine_renderer_graph_storage *storage
+) {
+	storage->passes[RPASS_ATMOSPHERE_LUTS] = (struct rg_pass_spec){
+		.name = "Atmosphere LUTs",
+		REFS(atmosphere_luts_refs),
+		.compute = true,
+		.secondary = true,
+	};
+	storage->passes[RPASS_SHADOW] = (struct rg_pass_spec){
+		.name = "Shadow",
+		.secondary = true,
+		REFS(shadow_refs),
+		.render_area = (VkRect2D){ .extent = info->shadow_extent },
+	};
+	storage->passes[RPASS_HDR_GEOMETRY] = (struct rg_pass_spec){
+		.name = "HDR Geometry",
+		.secondary = true,
+		// at `vulkan_renderer::render_scale`, the tonemap upscales it.
+		.scaled = true,
+		REFS(hdr_geometry_refs),
+	};
+	storage->passes[RPASS_ATMOSPHERE_HALF_RES] = (struct rg_pass_spec){
+		.name = "Half-Res Atmosphere",
+		REFS(atmosphere_half_res_refs),
+		.compute = true,
+		.secondary = true,
+	};
+	storage->passes[RPASS_HDR_ATMOSPHERE] = (struct rg_pass_spec){
+		.name = "HDR Atmosphere",
+		.secondary = true,
+		.scaled = true,
+		REFS(hdr_atmosphere_refs),
+	};
+	storage->passes[RPASS_HDR_LIGHTING] = (struct rg_pass_spec){
+		.name = "HDR Lighting",
+		.secondary = true,
+		.scaled = true,
+		REFS(hdr_lighting_refs),
+	};
+	storage->passes[RPASS_BLOOM] = (struct rg_pass_spec){
+		.name = "Bloom",
+		REFS(bloom_refs),
+		.compute = true,
+		.secondary = true,
+		.async_compute = true,
+	};
+	storage->passes[RPASS_SDR_TONEMAP] = (struct rg_pass_spec){
+		.name = "SDR Tonemap",
+		.secondary = true,
+		REFS(sdr_tonemap_refs),
+	};
+	storage->passes[RPASS_SDR_GUI] = (struct rg_pass_spec){
+		.name = "SDR GUI",
+		.secondary = true,
+		REFS(sdr_gui_refs),
+	};
+
+	static const struct {
+		const char *name;
+		VkImageAspectFlags aspect;
+		bool persistent;
+	} images[RPIMG_COUNT_] = {
+		[RPIMG_COLOR0] = { "Color 0", VK_IMAGE_ASPECT_COLOR_BIT },
+		[RPIMG_DEPTH0] = { "Depth 0", VK_IMAGE_ASPECT_DEPTH_BIT },
+		[RPIMG_GBUFFER0] = { "GBuffer 0", VK_IMAGE_ASPECT_COLOR_BIT },
+		[RPIMG_GBUFFER1] = { "GBuffer 1", VK_IMAGE_ASPECT_COLOR_BIT },
+		[RPIMG_GBUFFER2] = { "GBuffer 2", VK_IMAGE_ASPECT_COLOR_BIT },
+		// only used through the mip views, by the bloom pass.
+		[RPIMG_BLOOM] = { "Bloom", VK_IMAGE_ASPECT_COLOR_BIT },
+		[RPIMG_SHADOW0] = { "Shadow 0", VK_IMAGE_ASPECT_DEPTH_BIT, .persistent = true }, // the cached cascades
+		[RPIMG_SHADOWC] = { "Shadow Color", VK_IMAGE_ASPECT_COLOR_BIT, .persistent = true },
+		// every frame's, in slots of `vulkan_renderer::atmo_sky_view_luts` and `atmo_aerial_luts`.
+		[RPIMG_ATMO_SKY_VIEW] = { "Atmosphere Sky-View", VK_IMAGE_ASPECT_COLOR_BIT },
+		[RPIMG_ATMO_AERIAL] = { "Atmosphere Aerial", VK_IMAGE_ASPECT_COLOR_BIT },
+		[RPIMG_ATMO_LIGHT] = { "Atmosphere Light", VK_IMAGE_ASPECT_COLOR_BIT },
+		// both layers, used through the per-layer views.
+		[RPIMG_ATMO_HISTORY] = { "Atmosphere History", VK_IMAGE_ASPECT_COLOR_BIT, .persistent = true },
+		[RPIMG_ATMO_HISTORY_DEPTH] = { "Atmosphere History Depth", VK_IMAGE_ASPECT_COLOR_BIT, .persistent = true },
+	};
+	const VkFormat formats[RPIMG_COUNT_] = {
+		[RPIMG_COLOR0] = VK_FORMAT_R16G16B16A16_SFLOAT,
+		[RPIMG_DEPTH0] = info->depth_format,
+		[RPIMG_GBUFFER0] = info->gbuffer_formats[0],
+		[RPIMG_GBUFFER1] = info->gbuffer_formats[1],
+		[RPIMG_GBUFFER2] = info->gbuffer_formats[2],
+		[RPIMG_BLOOM] = VK_FORMAT_R16G16B16A16_SFLOAT,
+		[RPIMG_SHADOW0] = info->shadow_depth_format,
+		[RPIMG_SHADOWC] = VK_FORMAT_R8G8B8A8_SRGB,
+		[RPIMG_ATMO_SKY_VIEW] = info->atmo_view_lut_format,
+		[RPIMG_ATMO_AERIAL] = info->atmo_view_lut_format,
+		[RPIMG_ATMO_LIGHT] = VK_FORMAT_R16G16B16A16_SFLOAT,
+		[RPIMG_ATMO_HISTORY] = VK_FORMAT_R16G16B16A16_SFLOAT,
+		[RPIMG_ATMO_HISTORY_DEPTH] = VK_FORMAT_R32_SFLOAT,
+	};
+	for (uint32_t i = 0; i < RPIMG_COUNT_; ++i) {
+		storage->images[i] = (struct rg_graph_image_spec){
+			images[i].name,
+			info->images[i],
+			info->views[i],
+			formats[i],
+			images[i].aspect,
+			.memory_requirements = info->memory_requirements[i],
+			.persistent = images[i].persistent,
+		};
+	}
+
+	return (struct rg_graph_spec){
+		.swapchain_format = info->swapchain_format,
+		.has_async_compute_queue = info->has_async_compute_queue,
+		.async_compute_queue_family_index = info->async_compute_queue_family_index,
+		.image_count = RPIMG_COUNT_,
+		.images = storage->images,
+		.pass_count = RPASS_COUNT_,
+		.passes = storage->passes,
+		.cull_passes = true,
+		.reorder_passes = true,
+	};
+}
+
+#undef REFS
@@ -0,0 +1,71 @@
+#ifndef PSHINE_RENDERER_GRAPH_H_
+#define PSHINE_RENDERER_GRAPH_H_
+#include <pshine/util.h>
+#define VK_NO_PROTOTYPES
+#include <volk.h>
+#include "vk_rgraph.h"
+
+// The spec of the renderer's render graph, built by `init_rendergraph` (vk.c) and by the headless
+// checks (rgraph_test.c) from the same tables.
+
+enum : uint32_t {
+	RPIMG_COLOR0,
+	RPIMG_DEPTH0,
+	RPIMG_GBUFFER0,
+	RPIMG_GBUFFER1,
+	RPIMG_GBUFFER2,
+	RPIMG_BLOOM,
+	RPIMG_SHADOW0,
+	RPIMG_SHADOWC,
+	RPIMG_ATMO_SKY_VIEW,
+	RPIMG_ATMO_AERIAL,
+	RPIMG_ATMO_LIGHT,
+	RPIMG_ATMO_HISTORY,
+	RPIMG_ATMO_HISTORY_DEPTH,
+	RPIMG_COUNT_
+};
+
+enum : uint32_t {
+	RPASS_ATMOSPHERE_LUTS,
+	RPASS_SHADOW,
+	RPASS_HDR_GEOMETRY,
+	RPASS_ATMOSPHERE_HALF_RES,
+	RPASS_HDR_ATMOSPHERE,
+	RPASS_HDR_LIGHTING,
+	RPASS_BLOOM,
+	RPASS_SDR_TONEMAP,
+	RPASS_SDR_GUI,
+	RPASS_COUNT_,
+};
+
+/// What the renderer's graph depends on: the device's formats and queues, and the images.
+struct pshine_renderer_graph_info {
+	VkFormat swapchain_format;
+	VkFormat depth_format;
+	VkFormat shadow_depth_format;
+	VkFormat gbuffer_formats[3];
+	VkFormat atmo_view_lut_format;
+	/// The render area of the shadow pass, the whole atlas.
+	VkExtent2D shadow_extent;
+	bool has_async_compute_queue;
+	uint32_t async_compute_queue_family_index;
+	VkImage images[RPIMG_COUNT_];
+	/// `VK_NULL_HANDLE` for the placed images, whose views are made after they are bound.
+	VkImageView views[RPIMG_COUNT_];
+	/// Zero for the images with their own memory.
+	VkMemoryRequirements memory_requirements[RPIMG_COUNT_];
+};
+
+/// The arrays `pshine_make_renderer_graph_spec` points the spec to.
+struct pshine_renderer_graph_storage {
+	struct rg_pass_spec passes[RPASS_COUNT_];
+	struct rg_graph_image_spec images[RPIMG_COUNT_];
+};
+
+/// The renderer's graph, culled and reordered. The spec points into `storage`.
+struct rg_graph_spec pshine_make_renderer_graph_spec(
+	const struct pshine_renderer_graph_info *info,
+	struct pshine_renderer_graph_storage *storage
+);
+
+#endif // PSHINE_RENDERER_GRAPH_H_
@@ -0,0 +1,1127 @@
+#include "rgraph_test.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#define VK_NO_PROTOTYPES
+#include <volk.h>
+#include "vk_rgraph.h"
+#include "renderer_graph.h"
+
+// the queue families the tests give the graph.
+enum : uint32_t { TEST_MAIN_FAMILY = 0, TEST_ASYNC_FAMILY = 1 };
+// the query pools the tests give the graph.
+enum : uintptr_t { TEST_TIMESTAMP_POOL = 1, TEST_STATISTICS_POOL = 2 };
+// where the swapchain image is before the semaphore of its acquire, see `test_image_state::access_queue`.
+enum : uint32_t { TEST_PRESENT = RG_QUEUE_COUNT_ + 1 };
+// how many errors of each check are logged.
+enum : uint32_t { TEST_LOGGED_ERRORS = 8 };
+
+// images and command buffers are made up handles: the images are their index + 1, the swapchain images
+// come after `TEST_SWAPCHAIN_IMAGE`, and the command buffers encode the frame and the segment.
+enum : uintptr_t { TEST_SWAPCHAIN_IMAGE = 0x10'0000 };
+
+static VkImage test_image(uint32_t index) { return (VkImage)(uintptr_t)(index + 1); }
+static VkImage test_swapchain_image(uint32_t frame) { return (VkImage)(TEST_SWAPCHAIN_IMAGE + frame % 3); }
+static VkCommandBuffer test_command_buffer(uint32_t frame, uint32_t segment) {
+	return (VkCommandBuffer)(((uintptr_t)frame << 16 | segment) + 1);
+}
+static uint32_t test_frame_of(VkCommandBuffer command_buffer) { return ((uintptr_t)command_buffer - 1) >> 16; }
+
+// the frames render in 1920x1080, and the scaled passes in a part of it that changes every frame.
+static VkRect2D test_scaled_render_area(uint32_t frame) {
+	if (frame % 3 == 0) return (VkRect2D){};
+	return (VkRect2D){ .extent = { 1920 * (frame % 3) / 3, 1080 * (frame % 3) / 3 } };
+}
+
+/// The area `pass` should render in, in `frame`.
+static VkRect2D test_render_area(const struct rg_pass *pass, uint32_t frame) {
+	if (pass->render_area.extent.width != 0) return pass->render_area;
+	if (pass->scaled && test_scaled_render_area(frame).extent.width != 0) return test_scaled_render_area(frame);
+	return (VkRect2D){ .extent = { 1920, 1080 } };
+}
+
+static VkAccessFlags2 test_writes(VkAccessFlags2 access) {
+	return access & (VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
+		| VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT
+		| VK_ACCESS_2_HOST_WRITE_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT);
+}
+
+static VkPipelineStageFlags2 test_attachment_stages() {
+	return VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT
+		| VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT;
+}
+
+static bool test_stages_cover(VkPipelineStageFlags2 scope, VkPipelineStageFlags2 stages) {
+	if (scope & VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT) return true;
+	if (scope & VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT) scope |= test_attachment_stages()
+		| VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT
+		| VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+	return (stages & ~scope) == 0;
+}
+
+static bool test_access_covers(VkAccessFlags2 scope, VkAccessFlags2 access) {
+	VkAccessFlags2 writes = test_writes(~(VkAccessFlags2)0);
+	if (scope & VK_ACCESS_2_MEMORY_READ_BIT) scope |= ~writes;
+	if (scope & VK_ACCESS_2_MEMORY_WRITE_BIT) scope |= writes;
+	if (scope & VK_ACCESS_2_SHADER_READ_BIT)
+		scope |= VK_ACCESS_2_SHADER_SAMPLED_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
+	if (scope & VK_ACCESS_2_SHADER_WRITE_BIT) scope |= VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+	return (access & ~scope) == 0;
+}
+
+/// Whether the use needs the image's contents: any shader or input attachment read,
+/// and attachments that are loaded. Storage images that are written may only read what
+/// the pass writes (they are ordered against the other uses either way).
+static bool test_consumes(const struct rg_image_ref *ref) {
+	if (ref->access_flags & VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT) return false;
+	if (ref->access_flags & (VK_ACCESS_2_INPUT_ATTACHMENT_READ_BIT | VK_ACCESS_2_SHADER_SAMPLED_READ_BIT
+		| VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_READ_BIT)) return true;
+	if (ref->stage_flags & ~test_attachment_stages()) return true;
+	return ref->load_op == VK_ATTACHMENT_LOAD_OP_LOAD;
+}
+
+#define TEST_ERROR(check, fmt, ...) do { \
+	if ((check)->error_count++ < TEST_LOGGED_ERRORS && !(check)->quiet) \
+		PSHINE_ERROR("rgraph: %s: " fmt, (check)->name __VA_OPT__(,) __VA_ARGS__); \
+} while (0)
+
+struct test_check {
+	const char *name;
+	bool quiet;
+	uint32_t error_count;
+};
+
+/// What the checks know about an image while playing back a recording.
+struct test_image_state {
+	VkImageLayout layout;
+	/// `RG_QUEUE_COUNT_` if not used yet this frame (the contents from the last frame are discarded
+	/// or only used on the main queue, so there is nothing to transfer).
+	enum rg_queue owner;
+	/// Released by `owner`, not acquired yet. The acquire must have the same layouts as the release.
+	bool released;
+	VkImageLayout release_old_layout, release_new_layout;
+	/// Between the set and the wait of an event.
+	bool pending;
+	/// Not discarded since the last write.
+	bool contents;
+	/// Spec index of the last pass that wrote the image this frame, `UINT32_MAX` if none did.
+	uint32_t writer;
+	/// The uses since the last barrier (or semaphore).
+	VkPipelineStageFlags2 use_stages;
+	VkAccessFlags2 use_writes;
+	/// The rendering the uses since the last barrier were in, `UINT32_MAX` if outside one.
+	uint32_t use_rendering;
+	/// What the last barrier made the image visible to.
+	VkPipelineStageFlags2 visible_stages;
+	VkAccessFlags2 visible_access;
+	/// Positions of the first and last passes that used the image this frame.
+	uint32_t first_pass, last_pass;
+	/// Where the image was last used or had a barrier, `RG_QUEUE_COUNT_` if nowhere yet, or
+	/// `TEST_PRESENT`. Until a segment's semaphore waits for it, the other queues can't touch it.
+	uint32_t access_queue, access_frame, access_segment;
+	/// The stages of the other queue's semaphore waits for the last access, until it touches the image.
+	VkPipelineStageFlags2 semaphore_stages;
+};
+
+/// The passes of the spec that use an image, in spec order.
+struct test_image_user {
+	uint32_t spec_index;
+	const struct rg_image_ref *ref;
+};
+
+struct test_playback {
+	struct test_check *check;
+	struct rg_graph *graph;
+	const struct rg_graph_spec *spec;
+	uint32_t image_count; // with the swapchain (the last one)
+	struct test_image_state *images;
+	uint32_t *user_first; // image_count + 1
+	struct test_image_user *users;
+	bool *executed; // by spec index, this frame
+	bool *begun, *ended; // by position, this frame
+	const struct rg_recorded_command **sets; // by event
+	bool *timestamps; // by query, this frame
+	uint32_t active_query; // `UINT32_MAX` if none
+	uint32_t frame;
+	uint32_t segment;
+	uint32_t rendering;
+	VkRect2D render_area; // of the current rendering
+	bool in_rendering;
+};
+
+static const char *test_image_name(const struct test_playback *p, uint32_t index) {
+	return index < p->graph->image_count ? p->graph->images_own[index].name : "the swapchain";
+}
+
+/// The image is touched on `queue`. If it was last touched elsewhere, a semaphore must have waited for that,
+/// which made all of it visible to the stages of the wait. Returns false if none did.
+static bool test_wait_other_queue(struct test_image_state *image, uint32_t queue) {
+	if (image->access_queue == RG_QUEUE_COUNT_ || image->access_queue == queue) return true;
+	if (image->semaphore_stages == VK_PIPELINE_STAGE_2_NONE) return false;
+	image->use_stages = 0;
+	image->use_writes = 0;
+	image->visible_stages = image->semaphore_stages;
+	image->visible_access = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+	return true;
+}
+
+static void test_barrier(struct test_playback *p, enum rg_queue queue, const struct rg_recorded_barrier *rb) {
+	uint32_t index = rb->image_index == UINT32_MAX ? p->image_count - 1 : rb->image_index;
+	struct test_image_state *image = &p->images[index];
+	const VkImageMemoryBarrier2 *b = &rb->barrier;
+	const char *name = test_image_name(p, index);
+	bool other_queue = image->access_queue != RG_QUEUE_COUNT_ && image->access_queue != queue;
+	if (!test_wait_other_queue(image, queue))
+		TEST_ERROR(p->check, "%s: barrier before the semaphore wait for the other queue", name);
+	// the barrier has to start after the semaphore wait for it to have waited for anything.
+	else if (other_queue && !(b->srcStageMask & VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT)
+		&& !test_stages_cover(image->semaphore_stages, b->srcStageMask))
+		TEST_ERROR(p->check, "%s: barrier doesn't wait for the semaphore", name);
+	image->semaphore_stages = VK_PIPELINE_STAGE_2_NONE;
+	image->access_queue = queue;
+	image->access_frame = p->frame;
+	image->access_segment = p->segment;
+	bool transfer = b->srcQueueFamilyIndex != b->dstQueueFamilyIndex;
+	bool acquire = transfer && p->graph->current.queue_family_indices[queue] == b->dstQueueFamilyIndex;
+	if (acquire) {
+		if (!image->released) TEST_ERROR(p->check, "%s is acquired without being released", name);
+		else if (b->oldLayout != image->release_old_layout || b->newLayout != image->release_new_layout)
+			TEST_ERROR(p->check, "%s is acquired with other layouts than it was released with", name);
+		image->released = false;
+		image->owner = queue;
+		image->layout = b->newLayout;
+		image->visible_stages = b->dstStageMask;
+		image->visible_access = b->dstAccessMask;
+		return;
+	}
+	if (image->released) TEST_ERROR(p->check, "%s is used by a barrier while released", name);
+	bool discard = b->oldLayout == VK_IMAGE_LAYOUT_UNDEFINED;
+	if (!discard) {
+		if (b->oldLayout != image->layout)
+			TEST_ERROR(p->check, "%s: barrier from layout %d, but it is in %d", name, b->oldLayout, image->layout);
+		if (!test_stages_cover(b->srcStageMask, image->use_stages))
+			TEST_ERROR(p->check, "%s: barrier doesn't wait for the last uses", name);
+		if (!test_access_covers(b->srcAccessMask, image->use_writes))
+			TEST_ERROR(p->check, "%s: barrier doesn't make the last writes available", name);
+	}
+	if (transfer) {
+		image->released = true;
+		image->release_old_layout = b->oldLayout;
+		image->release_new_layout = b->newLayout;
+		image->use_stages = 0;
+		image->use_writes = 0;
+		return;
+	}
+	if (discard) image->contents = false;
+	if (image->use_writes != 0 || discard || b->oldLayout != b->newLayout) {
+		image->visible_stages = b->dstStageMask;
+		image->visible_access = b->dstAccessMask;
+	} else {
+		image->visible_stages |= b->dstStageMask;
+		image->visible_access |= b->dstAccessMask;
+	}
+	image->layout = b->newLayout;
+	image->use_stages = 0;
+	image->use_writes = 0;
+}
+
+/// `specified` is false for the refs a merged pass gets from the passes it's merged with:
+/// those are synchronized like the others, but aren't the pass's own reads and writes.
+static void test_use(
+	struct test_playback *p,
+	const struct rg_pass *pass,
+	uint32_t position,
+	const struct rg_image_ref *ref,
+	bool specified
+) {
+	uint32_t index = ref->image_index == UINT32_MAX ? p->image_count - 1 : ref->image_index;
+	struct test_image_state *image = &p->images[index];
+	const char *name = test_image_name(p, index);
+	if (image->released || image->pending) TEST_ERROR(p->check, "%s uses %s before its barrier is done", pass->name, name);
+	if (!test_wait_other_queue(image, pass->queue))
+		TEST_ERROR(p->check, "%s uses %s before waiting for the other queue", pass->name, name);
+	if (image->owner != RG_QUEUE_COUNT_ && image->owner != pass->queue)
+		TEST_ERROR(p->check, "%s uses %s, which another queue owns", pass->name, name);
+	if (image->layout != ref->initial_layout)
+		TEST_ERROR(p->check, "%s uses %s in layout %d, but it is in %d", pass->name, name, ref->initial_layout, image->layout);
+
+	bool used = image->use_stages != 0;
+	bool same_rendering = used && p->in_rendering && image->use_rendering == p->rendering;
+	bool writes = test_writes(ref->access_flags) != 0;
+	if (used && (image->use_writes != 0 || writes)) {
+		// only attachment writes in the same rendering are ordered without a barrier.
+		bool attachments_only = ((image->use_stages | ref->stage_flags) & ~test_attachment_stages()) == 0;
+		if (!same_rendering || !attachments_only)
+			TEST_ERROR(p->check, "%s uses %s without a barrier after the last write", pass->name, name);
+	}
+	if (!same_rendering && (!test_stages_cover(image->visible_stages, ref->stage_flags)
+		|| !test_access_covers(image->visible_access, ref->access_flags)))
+		TEST_ERROR(p->check, "%s uses %s, but the last writes aren't visible to it", pass->name, name);
+
+	// the order of the uses must be the specified one, and reads must see the specified writer.
+	uint32_t expected_writer = UINT32_MAX;
+	for (uint32_t u = p->user_first[index]; specified && u < p->user_first[index + 1]; ++u) {
+		const struct test_image_user *user = &p->users[u];
+		if (user->spec_index == pass->spec_index) continue;
+		bool other_writes = test_writes(user->ref->access_flags) != 0;
+		if (user->spec_index < pass->spec_index && other_writes) expected_writer = user->spec_index;
+		if (!other_writes && !writes) continue;
+		if (rg_graph_get_pass(p->graph, user->spec_index)->culled) continue;
+		bool before = user->spec_index < pass->spec_index;
+		if (before != p->executed[user->spec_index])
+			TEST_ERROR(p->check, "%s uses %s %s %s", pass->name, name, before ? "before" : "after",
+				rg_graph_get_pass(p->graph, user->spec_index)->name);
+	}
+	if (specified && test_consumes(ref)) {
+		if (!image->contents) TEST_ERROR(p->check, "%s reads %s after its contents were discarded", pass->name, name);
+		if (expected_writer != UINT32_MAX && rg_graph_get_pass(p->graph, expected_writer)->culled)
+			TEST_ERROR(p->check, "%s reads %s from %s, which was culled",
+				pass->name, name, rg_graph_get_pass(p->graph, expected_writer)->name);
+		else if (image->writer != expected_writer)
+			TEST_ERROR(p->check, "%s reads %s written by the wrong pass", pass->name, name);
+	}
+
+	image->owner = pass->queue;
+	image->access_queue = pass->queue;
+	image->access_frame = p->frame;
+	image->access_segment = p->segment;
+	image->semaphore_stages = VK_PIPELINE_STAGE_2_NONE;
+	image->use_stages |= ref->stage_flags;
+	image->use_writes |= test_writes(ref->access_flags);
+	image->use_rendering = p->in_rendering ? p->rendering : UINT32_MAX;
+	if (writes && specified) {
+		image->writer = pass->spec_index;
+		image->contents = true;
+		image->visible_stages = 0;
+		image->visible_access = 0;
+	}
+	if (image->first_pass == UINT32_MAX) image->first_pass = position;
+	image->last_pass = position;
+}
+
+static bool test_same_barrier(const struct rg_recorded_barrier *a, const struct rg_recorded_barrier *b) {
+	return a->image_index == b->image_index
+		&& a->barrier.image == b->barrier.image
+		&& a->barrier.oldLayout == b->barrier.oldLayout
+		&& a->barrier.newLayout == b->barrier.newLayout
+		&& a->barrier.srcStageMask == b->barrier.srcStageMask
+		&& a->barrier.srcAccessMask == b->barrier.srcAccessMask
+		&& a->barrier.dstStageMask == b->barrier.dstStageMask
+		&& a->barrier.dstAccessMask == b->barrier.dstAccessMask
+		&& a->barrier.srcQueueFamilyIndex == b->barrier.srcQueueFamilyIndex
+		&& a->barrier.dstQueueFamilyIndex == b->barrier.dstQueueFamilyIndex;
+}
+
+static void test_begin_frame(struct test_playback *p, uint32_t frame) {
+	p->frame = frame;
+	for (uint32_t i = 0; i < p->image_count; ++i) {
+		p->images[i].owner = RG_QUEUE_COUNT_;
+		p->images[i].writer = UINT32_MAX;
+		p->images[i].first_pass = UINT32_MAX;
+		p->images[i].last_pass = UINT32_MAX;
+	}
+	// the next swapchain image is acquired.
+	p->images[p->image_count - 1].access_queue = TEST_PRESENT;
+	memset(p->executed, 0, p->graph->spec_pass_count * sizeof(*p->executed));
+	memset(p->begun, 0, p->graph->pass_count * sizeof(*p->begun));
+	memset(p->ended, 0, p->graph->pass_count * sizeof(*p->ended));
+	memset(p->timestamps, 0, 2 * p->graph->pass_count * sizeof(*p->timestamps));
+}
+
+/// The semaphore waits of a segment's submission, see `rg_segment::wait_segment`. Each queue's timeline
+/// only goes up, so waiting for a segment waits for all the ones before it on that queue too.
+static void test_begin_segment(struct test_playback *p, uint32_t index) {
+	const struct rg_segment *segment = &p->graph->segments_own[index];
+	p->segment = index;
+	for (uint32_t i = 0; i < p->image_count; ++i) {
+		struct test_image_state *image = &p->images[i];
+		bool waited;
+		VkPipelineStageFlags2 stages = segment->wait_stage_flags | segment->frame_wait_stage_flags;
+		if (image->access_queue == TEST_PRESENT) {
+			waited = segment->swapchain_stage_flags != VK_PIPELINE_STAGE_2_NONE;
+			stages = segment->swapchain_stage_flags;
+		} else if (image->access_queue == RG_QUEUE_COUNT_ || image->access_queue == segment->queue) {
+			continue;
+		} else if (image->access_frame != p->frame) {
+			// the last frame's segments are waited for by any wait, see `render_end` in vk.c.
+			waited = segment->wait_segment != UINT32_MAX || segment->frame_wait_stage_flags != VK_PIPELINE_STAGE_2_NONE;
+		} else {
+			waited = segment->wait_segment != UINT32_MAX && image->access_segment <= segment->wait_segment;
+		}
+		// the later waits on this queue are for the same access, it can be touched after any of them.
+		if (waited) image->semaphore_stages |= stages;
+	}
+}
+
+static void test_end_frame(struct test_playback *p) {
+	struct rg_graph *graph = p->graph;
+	if (p->in_rendering) TEST_ERROR(p->check, "frame %u ends in a rendering", p->frame);
+	for (uint32_t i = 0; i < graph->pass_count; ++i)
+		if (!p->begun[i] || !p->ended[i]) TEST_ERROR(p->check, "%s isn't recorded in frame %u", graph->passes_own[i].name, p->frame);
+	for (uint32_t i = 0; i < graph->pass_count; ++i)
+		if (!graph->passes_own[i].merged_with_prev && (!p->timestamps[2 * i] || !p->timestamps[2 * i + 1]))
+			TEST_ERROR(p->check, "%s isn't timed in frame %u", graph->passes_own[i].name, p->frame);
+	if (p->active_query != UINT32_MAX) TEST_ERROR(p->check, "frame %u ends with a query active", p->frame);
+	for (uint32_t e = 0; e < graph->event_count; ++e)
+		if (p->sets[e] != nullptr) TEST_ERROR(p->check, "event %u is set but never waited for", e);
+	for (uint32_t i = 0; i < p->image_count; ++i)
+		if (p->images[i].released) TEST_ERROR(p->check, "%s is released but never acquired", test_image_name(p, i));
+	// placed images that share memory are used in turns.
+	for (uint32_t i = 0; i < graph->image_count; ++i) {
+		const struct rg_graph_image *a = &graph->images_own[i];
+		if (a->memory_heap == UINT32_MAX || p->images[i].first_pass == UINT32_MAX) continue;
+		for (uint32_t j = i + 1; j < graph->image_count; ++j) {
+			const struct rg_graph_image *b = &graph->images_own[j];
+			if (b->memory_heap != a->memory_heap || p->images[j].first_pass == UINT32_MAX) continue;
+			if (a->memory_offset >= b->memory_offset + b->memory_size || b->memory_offset >= a->memory_offset + a->memory_size) continue;
+			if (p->images[i].last_pass >= p->images[j].first_pass && p->images[j].last_pass >= p->images[i].first_pass)
+				TEST_ERROR(p->check, "%s and %s share memory but are used at the same time", a->name, b->name);
+		}
+	}
+}
+
+/// Play back the frames in `recording`, recorded from `graph` in order, and check them.
+/// Returns the number of errors.
+static uint32_t test_check_recording(
+	struct test_check *check,
+	struct rg_graph *graph,
+	const struct rg_graph_spec *spec,
+	const struct rg_recording *recording
+) {
+	struct test_playback p = {
+		.check = check,
+		.graph = graph,
+		.spec = spec,
+		.image_count = graph->image_count + 1,
+		.active_query = UINT32_MAX,
+		.frame = UINT32_MAX,
+	};
+	p.images = calloc(p.image_count, sizeof(*p.images));
+	for (uint32_t i = 0; i < p.image_count; ++i) {
+		const struct rg_graph_image *image = i < graph->image_count ? &graph->images_own[i] : &graph->current.swapchain_image;
+		p.images[i].layout = image->last_use_ref.final_layout;
+		p.images[i].contents = i < graph->image_count && image->persistent;
+		p.images[i].visible_stages = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+		p.images[i].visible_access = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+		p.images[i].access_queue = RG_QUEUE_COUNT_;
+	}
+
+	uint32_t ref_count = 0;
+	for (uint32_t s = 0; s < spec->pass_count; ++s) ref_count += spec->passes[s].image_ref_count;
+	p.user_first = calloc(p.image_count + 1, sizeof(*p.user_first));
+	p.users = calloc(ref_count + 1, sizeof(*p.users));
+	for (uint32_t s = 0; s < graph->spec_pass_count; ++s) {
+		const struct rg_pass *pass = rg_graph_get_pass(graph, s);
+		for (uint32_t r = 0; r < spec->passes[s].image_ref_count; ++r) {
+			uint32_t index = pass->image_refs_own[r].image_index;
+			++p.user_first[(index == UINT32_MAX ? p.image_count - 1 : index) + 1];
+		}
+	}
+	for (uint32_t i = 1; i <= p.image_count; ++i) p.user_first[i] += p.user_first[i - 1];
+	uint32_t *user_next = calloc(p.image_count + 1, sizeof(*user_next));
+	memcpy(user_next, p.user_first, p.image_count * sizeof(*user_next));
+	for (uint32_t s = 0; s < graph->spec_pass_count; ++s) {
+		const struct rg_pass *pass = rg_graph_get_pass(graph, s);
+		for (uint32_t r = 0; r < spec->passes[s].image_ref_count; ++r) {
+			uint32_t index = pass->image_refs_own[r].image_index;
+			p.users[user_next[index == UINT32_MAX ? p.image_count - 1 : index]++] = (struct test_image_user){
+				.spec_index = s,
+				.ref = &pass->image_refs_own[r],
+			};
+		}
+	}
+	free(user_next);
+
+	for (uint32_t s = 0; s < graph->spec_pass_count; ++s) {
+		const struct rg_pass *pass = rg_graph_get_pass(graph, s);
+		if (!pass->culled) continue;
+		for (uint32_t r = 0; r < spec->passes[s].image_ref_count; ++r) {
+			const struct rg_image_ref *ref = &pass->image_refs_own[r];
+			if (test_writes(ref->access_flags) == 0) continue;
+			if (ref->image_index == UINT32_MAX || graph->images_own[ref->image_index].persistent)
+				TEST_ERROR(check, "%s is culled, but writes %s", pass->name, test_image_name(&p, ref->image_index));
+		}
+	}
+
+	p.executed = calloc(graph->spec_pass_count + 1, sizeof(*p.executed));
+	p.begun = calloc(graph->pass_count + 1, sizeof(*p.begun));
+	p.ended = calloc(graph->pass_count + 1, sizeof(*p.ended));
+	p.sets = calloc(graph->event_count + 1, sizeof(*p.sets));
+	p.timestamps = calloc(2 * graph->pass_count + 1, sizeof(*p.timestamps));
+	VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+	enum rg_queue queue = RG_QUEUE_MAIN;
+	for (uint32_t c = 0; c < recording->command_count; ++c) {
+		const struct rg_recorded_command *command = &recording->commands_own[c];
+		uint32_t frame = test_frame_of(command->command_buffer);
+		if (frame != p.frame) {
+			if (p.frame != UINT32_MAX) test_end_frame(&p);
+			test_begin_frame(&p, frame);
+		}
+		if (command->pass_index >= graph->pass_count) {
+			TEST_ERROR(check, "a command is recorded outside of the passes");
+			continue;
+		}
+		struct rg_pass *pass = &graph->passes_own[command->pass_index];
+		if (command->command_buffer != command_buffer) {
+			if (p.in_rendering) TEST_ERROR(check, "a rendering continues in another command buffer");
+			test_begin_segment(&p, pass->segment);
+			command_buffer = command->command_buffer;
+			queue = pass->queue;
+		}
+		const struct rg_recorded_barrier *barriers = &recording->barriers_own[command->first_barrier];
+		uint32_t event = (uint32_t)((uintptr_t)command->event - 1);
+		switch (command->kind) {
+		case RG_RECORDED_BEGIN_PASS:
+			if (p.begun[command->pass_index]) TEST_ERROR(check, "%s is recorded twice", pass->name);
+			p.begun[command->pass_index] = true;
+			VkRect2D area = test_render_area(pass, p.frame);
+			if (!pass->compute && memcmp(&area, &p.render_area, sizeof(area)) != 0)
+				TEST_ERROR(check, "%s is in a rendering of another area", pass->name);
+			for (uint32_t r = 0; r < pass->image_ref_count; ++r)
+				test_use(&p, pass, command->pass_index, &pass->image_refs_own[r],
+					r < spec->passes[pass->spec_index].image_ref_count);
+			p.executed[pass->spec_index] = true;
+			break;
+		case RG_RECORDED_END_PASS:
+			if (!p.begun[command->pass_index]) TEST_ERROR(check, "%s ends before it begins", pass->name);
+			p.ended[command->pass_index] = true;
+			break;
+		case RG_RECORDED_BEGIN_RENDERING:
+			if (p.in_rendering) TEST_ERROR(check, "%s begins a rendering in a rendering", pass->name);
+			p.in_rendering = true;
+			p.render_area = command->render_area;
+			++p.rendering;
+			break;
+		case RG_RECORDED_END_RENDERING:
+			if (!p.in_rendering) TEST_ERROR(check, "%s ends a rendering outside of one", pass->name);
+			p.in_rendering = false;
+			break;
+		case RG_RECORDED_BARRIER:
+			for (uint32_t b = 0; b < command->barrier_count; ++b) {
+				const VkImageMemoryBarrier2 *barrier = &barriers[b].barrier;
+				if (p.in_rendering && (!(command->dependency_flags & VK_DEPENDENCY_BY_REGION_BIT)
+					|| barrier->oldLayout != barrier->newLayout))
+					TEST_ERROR(check, "%s has a barrier in a rendering that isn't by region", pass->name);
+				uint32_t index = barriers[b].image_index == UINT32_MAX ? p.image_count - 1 : barriers[b].image_index;
+				if (p.images[index].pending)
+					TEST_ERROR(check, "%s has a barrier on %s, which is waiting for an event", pass->name, test_image_name(&p, index));
+				test_barrier(&p, queue, &barriers[b]);
+			}
+			break;
+		case RG_RECORDED_SET_EVENT:
+			if (p.in_rendering) TEST_ERROR(check, "%s sets an event in a rendering", pass->name);
+			if (event >= graph->event_count || p.sets[event] != nullptr) {
+				TEST_ERROR(check, "%s sets an event that is unknown or already set", pass->name);
+				break;
+			}
+			p.sets[event] = command;
+			for (uint32_t b = 0; b < command->barrier_count; ++b) {
+				uint32_t index = barriers[b].image_index == UINT32_MAX ? p.image_count - 1 : barriers[b].image_index;
+				p.images[index].pending = true;
+			}
+			break;
+		case RG_RECORDED_WAIT_EVENT: {
+			if (p.in_rendering) TEST_ERROR(check, "%s waits for an event in a rendering", pass->name);
+			const struct rg_recorded_command *set = event < graph->event_count ? p.sets[event] : nullptr;
+			if (set == nullptr) {
+				TEST_ERROR(check, "%s waits for an event that isn't set", pass->name);
+				break;
+			}
+			p.sets[event] = nullptr;
+			if (set->command_buffer != command->command_buffer)
+				TEST_ERROR(check, "%s waits for an event set in another command buffer", pass->name);
+			bool same = set->barrier_count == command->barrier_count;
+			for (uint32_t b = 0; same && b < command->barrier_count; ++b)
+				same = test_same_barrier(&recording->barriers_own[set->first_barrier + b], &barriers[b]);
+			if (!same) TEST_ERROR(check, "%s waits for an event with other barriers than it was set with", pass->name);
+			for (uint32_t b = 0; b < command->barrier_count; ++b) {
+				uint32_t index = barriers[b].image_index == UINT32_MAX ? p.image_count - 1 : barriers[b].image_index;
+				p.images[index].pending = false;
+				test_barrier(&p, queue, &barriers[b]);
+			}
+		} break;
+		// each rendering (or compute pass) is measured outside of it, see `rg_graph_set_query_pools`.
+		case RG_RECORDED_WRITE_TIMESTAMP: {
+			uint32_t first = command->pass_index;
+			while (graph->passes_own[first].merged_with_prev) --first;
+			if (p.in_rendering) TEST_ERROR(check, "%s writes a timestamp in a rendering", pass->name);
+			if (command->query_pool != (VkQueryPool)TEST_TIMESTAMP_POOL || command->query / 2 != first || p.timestamps[command->query])
+				TEST_ERROR(check, "%s writes timestamp %u", pass->name, command->query);
+			else if (command->query % 2 == 0 ? p.begun[first] : !p.ended[command->pass_index])
+				TEST_ERROR(check, "timestamp %u isn't around %s", command->query, pass->name);
+			if (command->query < 2 * graph->pass_count) p.timestamps[command->query] = true;
+		} break;
+		case RG_RECORDED_BEGIN_QUERY:
+			if (p.in_rendering || p.active_query != UINT32_MAX || command->query_pool != (VkQueryPool)TEST_STATISTICS_POOL)
+				TEST_ERROR(check, "%s begins a query in a rendering or another query", pass->name);
+			if (pass->queue != RG_QUEUE_MAIN) TEST_ERROR(check, "%s is counted on the async compute queue", pass->name);
+			p.active_query = command->query;
+			break;
+		case RG_RECORDED_END_QUERY:
+			if (p.in_rendering || p.active_query != command->query)
+				TEST_ERROR(check, "%s ends a query in a rendering, or one that isn't active", pass->name);
+			p.active_query = UINT32_MAX;
+			break;
+		}
+	}
+	if (p.frame != UINT32_MAX) test_end_frame(&p);
+
+	free(p.timestamps);
+	free(p.sets);
+	free(p.ended);
+	free(p.begun);
+	free(p.executed);
+	free(p.users);
+	free(p.user_first);
+	free(p.images);
+	return check->error_count;
+}
+
+static void test_record_frames(struct rg_graph *graph, uint32_t first_frame, uint32_t frame_count, const VkEvent *events) {
+	for (uint32_t frame = first_frame; frame < first_frame + frame_count; ++frame) {
+		if (events != nullptr) rg_graph_set_events(graph, events);
+		rg_graph_set_query_pools(graph, (VkQueryPool)TEST_TIMESTAMP_POOL, (VkQueryPool)TEST_STATISTICS_POOL);
+		rg_graph_set_scaled_render_area(graph, test_scaled_render_area(frame));
+		rg_graph_begin_frame(graph, (VkRect2D){ .extent = { 1920, 1080 } }, TEST_MAIN_FAMILY,
+			test_swapchain_image(frame), VK_NULL_HANDLE, test_command_buffer(frame, 0));
+		for (uint32_t i = 0; i < graph->pass_count; ++i) {
+			uint32_t next = graph->current.segment_index + 1;
+			if (next < graph->segment_count && graph->segments_own[next].first_pass == i)
+				rg_graph_begin_segment(graph, test_command_buffer(frame, next));
+			rg_graph_begin_pass(graph);
+			rg_graph_end_pass(graph);
+		}
+		rg_graph_end_frame(graph);
+	}
+}
+
+/// Makes up the events for a graph.
+static VkEvent *test_make_events(const struct rg_graph *graph) {
+	VkEvent *events = calloc(graph->event_count + 1, sizeof(*events));
+	for (uint32_t i = 0; i < graph->event_count; ++i) events[i] = (VkEvent)(uintptr_t)(i + 1);
+	return events;
+}
+
+struct test_graph_options {
+	bool async;
+	bool events;
+	bool cull;
+	bool reorder;
+};
+
+struct test_stats {
+	uint32_t graph_count;
+	uint32_t frame_count;
+	uint32_t pass_count;
+	uint32_t culled_pass_count;
+	uint32_t merged_pass_count;
+	uint32_t segment_count;
+	uint32_t barrier_count;
+	uint32_t split_barrier_count;
+	uint32_t error_count;
+};
+
+/// Build the graph with the options, record `frame_count` frames and check them.
+static void test_graph(
+	const char *name,
+	struct rg_graph_spec spec,
+	struct test_graph_options options,
+	uint32_t frame_count,
+	struct test_stats *stats
+) {
+	struct rg_recording recording = {};
+	struct rg_graph_commands commands = rg_recording_commands(&recording);
+	spec.has_async_compute_queue = options.async;
+	spec.async_compute_queue_family_index = TEST_ASYNC_FAMILY;
+	spec.cull_passes = options.cull;
+	spec.reorder_passes = options.reorder;
+	spec.commands = &commands;
+	struct rg_graph graph = {};
+	rg_build_graph(&spec, &graph);
+	VkEvent *events = options.events ? test_make_events(&graph) : nullptr;
+	test_record_frames(&graph, 0, frame_count, events);
+
+	struct test_check check = { .name = name };
+	stats->error_count += test_check_recording(&check, &graph, &spec, &recording);
+	++stats->graph_count;
+	stats->frame_count += frame_count;
+	stats->pass_count += graph.spec_pass_count;
+	stats->culled_pass_count += graph.culled_pass_count;
+	stats->segment_count += graph.segment_count;
+	for (uint32_t i = 0; i < graph.pass_count; ++i) stats->merged_pass_count += graph.passes_own[i].merged_with_prev;
+	for (uint32_t c = 0; c < recording.command_count; ++c) {
+		const struct rg_recorded_command *command = &recording.commands_own[c];
+		if (command->kind == RG_RECORDED_BARRIER) stats->barrier_count += command->barrier_count;
+		if (command->kind == RG_RECORDED_SET_EVENT) stats->split_barrier_count += command->barrier_count;
+	}
+
+	free(events);
+	rg_free_recording(&recording);
+	rg_free_graph(&graph);
+}
+
+/// The renderer's graph (see `renderer_graph.h`), with made up images and memory requirements.
+static struct rg_graph_spec test_renderer_spec(struct pshine_renderer_graph_storage *storage) {
+	enum : VkDeviceSize { PIXELS = 1920 * 1080, ALIGNMENT = 65'536 };
+	struct pshine_renderer_graph_info info = {
+		.swapchain_format = VK_FORMAT_B8G8R8A8_SRGB,
+		.depth_format = VK_FORMAT_D32_SFLOAT,
+		.shadow_depth_format = VK_FORMAT_D16_UNORM,
+		.gbuffer_formats = { VK_FORMAT_R8G8B8A8_SRGB, VK_FORMAT_R8G8B8A8_SNORM, VK_FORMAT_R8G8B8A8_UNORM },
+		.atmo_view_lut_format = VK_FORMAT_R16G16B16A16_SFLOAT,
+		.shadow_extent = { 2048, 2048 },
+		.async_compute_queue_family_index = TEST_ASYNC_FAMILY,
+		.memory_requirements = {
+			[RPIMG_COLOR0] = { PIXELS * 8, ALIGNMENT, 0b11 },
+			[RPIMG_DEPTH0] = { PIXELS * 4, ALIGNMENT, 0b11 },
+			[RPIMG_GBUFFER0] = { PIXELS * 4, ALIGNMENT, 0b11 },
+			[RPIMG_GBUFFER1] = { PIXELS * 4, ALIGNMENT, 0b11 },
+			[RPIMG_GBUFFER2] = { PIXELS * 4, ALIGNMENT, 0b11 },
+			[RPIMG_BLOOM] = { PIXELS * 3, ALIGNMENT, 0b10 },
+			[RPIMG_ATMO_LIGHT] = { PIXELS * 2, ALIGNMENT, 0b11 },
+		},
+	};
+	for (uint32_t i = 0; i < RPIMG_COUNT_; ++i) info.images[i] = test_image(i);
+	return pshine_make_renderer_graph_spec(&info, storage);
+}
+
+enum : uint32_t { TEST_MAX_REFS = 8 };
+
+/// A random graph spec and the memory it points to.
+struct test_random_spec {
+	struct rg_graph_spec spec;
+	struct rg_pass_spec *passes_own;
+	struct rg_image_ref_spec *refs_own; // `TEST_MAX_REFS` per pass
+	struct rg_graph_image_spec *images_own;
+	char (*names_own)[24]; // passes, then images
+};
+
+static uint32_t test_random_below(struct pshine_pcg64_state *rng, uint32_t n) {
+	return (uint32_t)(pshine_pcg64_random_uint64(rng) % n);
+}
+
+static bool test_refs_image(const struct rg_image_ref_spec *refs, uint32_t ref_count, rg_image_id image) {
+	for (uint32_t r = 0; r < ref_count; ++r) if (refs[r].image_id == image) return true;
+	return false;
+}
+
+/// Pick an image that the pass doesn't use yet: a depth image or not, and one with contents if `written` is set.
+/// Returns `RG_IMAGE_SWAPCHAIN` if there's none after a few tries.
+static rg_image_id test_pick_image(
+	struct pshine_pcg64_state *rng,
+	const struct test_random_spec *r,
+	const bool *written,
+	const struct rg_image_ref_spec *refs,
+	uint32_t ref_count,
+	bool depth,
+	bool need_contents,
+	bool allow_persistent
+) {
+	for (uint32_t attempt = 0; attempt < 16; ++attempt) {
+		rg_image_id image = test_random_below(rng, r->spec.image_count);
+		const struct rg_graph_image_spec *spec = &r->images_own[image];
+		if ((spec->aspect == VK_IMAGE_ASPECT_DEPTH_BIT) != depth) continue;
+		if (spec->persistent && !allow_persistent) continue;
+		if (need_contents && !written[image] && !spec->persistent) continue;
+		if (test_refs_image(refs, ref_count, image)) continue;
+		return image;
+	}
+	return RG_IMAGE_SWAPCHAIN;
+}
+
+/// Make up a graph of `pass_count` passes. Every read of an image is of contents written earlier in the frame
+/// (or in an earlier frame, for the persistent images), and the persistent images are only used on the main queue.
+static void test_make_random_spec(struct pshine_pcg64_state *rng, uint32_t pass_count, struct test_random_spec *r) {
+	uint32_t image_count = pass_count / 4 + 4;
+	*r = (struct test_random_spec){
+		.passes_own = calloc(pass_count, sizeof(*r->passes_own)),
+		.refs_own = calloc(pass_count * TEST_MAX_REFS, sizeof(*r->refs_own)),
+		.images_own = calloc(image_count, sizeof(*r->images_own)),
+		.names_own = calloc(pass_count + image_count, sizeof(*r->names_own)),
+	};
+	r->spec = (struct rg_graph_spec){
+		.pass_count = pass_count,
+		.image_count = image_count,
+		.swapchain_format = VK_FORMAT_B8G8R8A8_SRGB,
+		.passes = r->passes_own,
+		.images = r->images_own,
+	};
+	for (uint32_t i = 0; i < image_count; ++i) {
+		char *name = r->names_own[pass_count + i];
+		bool depth = i % 4 == 3;
+		bool persistent = pshine_pcg64_random_double(rng) < 0.15;
+		bool placed = !persistent && pshine_pcg64_random_double(rng) < 0.5;
+		snprintf(name, sizeof(*r->names_own), "%s %u", depth ? "Depth" : "Color", i);
+		r->images_own[i] = (struct rg_graph_image_spec){
+			.name = name,
+			.image = test_image(i),
+			.format = depth ? VK_FORMAT_D32_SFLOAT : VK_FORMAT_R8G8B8A8_UNORM,
+			.aspect = depth ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT,
+			.persistent = persistent,
+			.memory_requirements = placed ? (VkMemoryRequirements){
+				.size = (VkDeviceSize)(1 + test_random_below(rng, 4)) << 20,
+				.alignment = 65'536,
+				.memoryTypeBits = 0b11,
+			} : (VkMemoryRequirements){},
+		};
+	}
+
+	bool *written = calloc(image_count, sizeof(*written));
+	uint32_t prev_graphics = UINT32_MAX;
+	for (uint32_t i = 0; i < pass_count; ++i) {
+		struct rg_image_ref_spec *refs = &r->refs_own[i * TEST_MAX_REFS];
+		uint32_t ref_count = 0;
+		bool last = i == pass_count - 1;
+		bool compute = !last && pshine_pcg64_random_double(rng) < 0.25;
+		bool async = compute && pshine_pcg64_random_double(rng) < 0.5;
+		bool scaled = !last && !compute && pshine_pcg64_random_double(rng) < 0.5;
+		if (!last && !compute && i > 0 && prev_graphics == i - 1 && pshine_pcg64_random_double(rng) < 0.3) {
+			// reads what the last pass drew, in the same rendering if the graph merges them (which it
+			// can't if only one of them is scaled).
+			const struct rg_pass_spec *prev = &r->passes_own[prev_graphics];
+			if (pshine_pcg64_random_double(rng) < 0.8) scaled = prev->scaled;
+			uint32_t input_index = 0;
+			for (uint32_t k = 0; k < prev->image_ref_count; ++k) {
+				const struct rg_image_ref_spec *ref = &prev->image_refs[k];
+				if (ref->image_id == RG_IMAGE_SWAPCHAIN) continue;
+				rg_image_ref_use_flags usage;
+				if (ref->usage & RG_IMAGE_USE_COLOR_ATTACHMENT_BIT) usage = RG_IMAGE_USE_COLOR_INPUT_ATTACHMENT_BIT;
+				else if (ref->usage & RG_IMAGE_USE_DEPTH_ATTACHMENT_BIT) usage = RG_IMAGE_USE_DEPTH_INPUT_ATTACHMENT_BIT;
+				else break;
+				refs[ref_count++] = (struct rg_image_ref_spec){
+					.image_id = ref->image_id,
+					.usage = usage,
+					.input_attachment_index = input_index++,
+				};
+			}
+		} else if (!compute) {
+			if (last) refs[ref_count++] = (struct rg_image_ref_spec){
+				RG_IMAGE_SWAPCHAIN,
+				RG_IMAGE_USE_COLOR_ATTACHMENT_BIT | RG_IMAGE_USE_CLEARED_BIT,
+			};
+			uint32_t color_count = 1 + test_random_below(rng, last ? 2 : 3);
+			for (uint32_t k = 0; k < color_count; ++k) {
+				rg_image_id image = test_pick_image(rng, r, written, refs, ref_count, false, false, true);
+				if (image == RG_IMAGE_SWAPCHAIN) continue;
+				bool clear = !written[image] && !r->images_own[image].persistent;
+				refs[ref_count++] = (struct rg_image_ref_spec){ image, RG_IMAGE_USE_COLOR_ATTACHMENT_BIT
+					| (clear || pshine_pcg64_random_double(rng) < 0.5 ? RG_IMAGE_USE_CLEARED_BIT : 0) };
+			}
+			if (pshine_pcg64_random_double(rng) < 0.5) {
+				rg_image_id image = test_pick_image(rng, r, written, refs, ref_count, true, false, true);
+				if (image != RG_IMAGE_SWAPCHAIN) {
+					bool clear = !written[image] && !r->images_own[image].persistent;
+					refs[ref_count++] = (struct rg_image_ref_spec){ image, RG_IMAGE_USE_DEPTH_ATTACHMENT_BIT
+						| (clear || pshine_pcg64_random_double(rng) < 0.5 ? RG_IMAGE_USE_CLEARED_BIT : 0) };
+				}
+			}
+			uint32_t sampled_count = test_random_below(rng, 3);
+			for (uint32_t k = 0; k < sampled_count; ++k) {
+				rg_image_id image = test_pick_image(rng, r, written, refs, ref_count, k % 2 == 1, true, true);
+				if (image != RG_IMAGE_SWAPCHAIN) refs[ref_count++] = (struct rg_image_ref_spec){ image, RG_IMAGE_USE_SAMPLED_BIT };
+			}
+			prev_graphics = i;
+		} else {
+			uint32_t sampled_count = test_random_below(rng, 3);
+			for (uint32_t k = 0; k < sampled_count; ++k) {
+				rg_image_id image = test_pick_image(rng, r, written, refs, ref_count, k % 2 == 1, true, !async);
+				if (image != RG_IMAGE_SWAPCHAIN) refs[ref_count++] = (struct rg_image_ref_spec){
+					image, RG_IMAGE_USE_SAMPLED_BIT, .stage = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+				};
+			}
+			if (pshine_pcg64_random_double(rng) < 0.7) {
+				rg_image_id image = test_pick_image(rng, r, written, refs, ref_count, false, true, !async);
+				if (image != RG_IMAGE_SWAPCHAIN) refs[ref_count++] = (struct rg_image_ref_spec){
+					image, RG_IMAGE_USE_SAMPLED_BIT, VK_IMAGE_LAYOUT_GENERAL,
+					.stage = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+					.access = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+				};
+			}
+		}
+		for (uint32_t k = 0; k < ref_count; ++k) {
+			const struct rg_image_ref_spec *ref = &refs[k];
+			if (ref->image_id == RG_IMAGE_SWAPCHAIN) continue;
+			bool writes = (ref->usage & (RG_IMAGE_USE_COLOR_ATTACHMENT_BIT | RG_IMAGE_USE_DEPTH_ATTACHMENT_BIT))
+				|| (ref->access & VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+			if (writes) written[ref->image_id] = true;
+		}
+		snprintf(r->names_own[i], sizeof(*r->names_own), "%s %u", compute ? "Compute" : "Draw", i);
+		r->passes_own[i] = (struct rg_pass_spec){
+			.name = r->names_own[i],
+			.image_refs = refs,
+			.image_ref_count = ref_count,
+			.compute = compute,
+			.async_compute = async,
+			.side_effects = pshine_pcg64_random_double(rng) < 0.1,
+			.scaled = scaled,
+		};
+	}
+	free(written);
+}
+
+static void test_free_random_spec(struct test_random_spec *r) {
+	free(r->names_own);
+	free(r->images_own);
+	free(r->refs_own);
+	free(r->passes_own);
+}
+
+/// Break a recording of the renderer's graph in `how`, and check that the checks notice.
+static bool test_catches_broken_recording(uint32_t how) {
+	struct rg_recording recording = {};
+	struct rg_graph_commands commands = rg_recording_commands(&recording);
+	struct pshine_renderer_graph_storage storage;
+	struct rg_graph_spec spec = test_renderer_spec(&storage);
+	spec.commands = &commands;
+	spec.cull_passes = true;
+	spec.reorder_passes = true;
+	spec.has_async_compute_queue = how == 4;
+	spec.async_compute_queue_family_index = TEST_ASYNC_FAMILY;
+	struct rg_graph graph = {};
+	rg_build_graph(&spec, &graph);
+	test_record_frames(&graph, 0, 2, nullptr);
+
+	bool broken = false;
+	for (uint32_t c = 0; c < recording.command_count && !broken; ++c) {
+		struct rg_recorded_command *command = &recording.commands_own[c];
+		if (command->kind != RG_RECORDED_BARRIER || command->barrier_count == 0) continue;
+		if (test_frame_of(command->command_buffer) != 1) continue;
+		VkImageMemoryBarrier2 *barrier = &recording.barriers_own[command->first_barrier].barrier;
+		switch (how) {
+		case 0: command->barrier_count = 0; broken = true; break; // a missing barrier
+		case 1: // nothing is made visible
+			barrier->dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+			barrier->dstAccessMask = VK_ACCESS_2_NONE;
+			broken = true;
+			break;
+		case 2: // the last writes aren't waited for
+			if (barrier->srcAccessMask == VK_ACCESS_2_NONE || barrier->oldLayout == VK_IMAGE_LAYOUT_UNDEFINED) break;
+			barrier->srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+			barrier->srcAccessMask = VK_ACCESS_2_NONE;
+			broken = true;
+			break;
+		case 4: // a segment doesn't wait for the other queue
+			for (uint32_t s = 0; s < graph.segment_count && !broken; ++s) {
+				if (graph.segments_own[s].wait_segment == UINT32_MAX) continue;
+				graph.segments_own[s].wait_segment = UINT32_MAX;
+				graph.segments_own[s].frame_wait_stage_flags = VK_PIPELINE_STAGE_2_NONE;
+				broken = true;
+			}
+			break;
+		default: break;
+		}
+	}
+	// passes out of order.
+	if (how == 3) {
+		for (uint32_t c = 0; c + 1 < recording.command_count && !broken; ++c) {
+			struct rg_recorded_command *command = &recording.commands_own[c];
+			if (command->kind != RG_RECORDED_BEGIN_PASS || test_frame_of(command->command_buffer) != 1) continue;
+			if (strcmp(graph.passes_own[command->pass_index].name, "HDR Geometry") != 0) continue;
+			for (uint32_t d = c + 1; d < recording.command_count; ++d) {
+				struct rg_recorded_command *other = &recording.commands_own[d];
+				if (other->kind != RG_RECORDED_BEGIN_PASS) continue;
+				if (strcmp(graph.passes_own[other->pass_index].name, "SDR Tonemap") != 0) continue;
+				uint32_t pass_index = command->pass_index;
+				command->pass_index = other->pass_index;
+				other->pass_index = pass_index;
+				broken = true;
+				break;
+			}
+		}
+	}
+
+	struct test_check check = { .name = "broken", .quiet = true };
+	bool caught = broken && test_check_recording(&check, &graph, &spec, &recording) > 0;
+	rg_free_recording(&recording);
+	rg_free_graph(&graph);
+	return caught;
+}
+
+/// Print the barrier plans of the renderer's graph, culled and reordered, without and with the async compute queue.
+static void test_print_renderer_plans(FILE *fout) {
+	for (uint32_t async = 0; async < 2; ++async) {
+		struct pshine_renderer_graph_storage storage;
+		struct rg_graph_spec spec = test_renderer_spec(&storage);
+		spec.cull_passes = true;
+		spec.reorder_passes = true;
+		spec.has_async_compute_queue = async;
+		spec.async_compute_queue_family_index = TEST_ASYNC_FAMILY;
+		struct rg_graph graph = {};
+		rg_build_graph(&spec, &graph);
+		fprintf(fout, "# %s the async compute queue\n", async ? "with" : "without");
+		rg_graph_print_barrier_plan(&graph, fout);
+		rg_free_graph(&graph);
+	}
+}
+
+/// Compare the renderer's barrier plans with the ones in `plan_fpath`. On a difference, logs the first
+/// differing line and writes the new plans next to the file, to `<plan_fpath>.new`.
+static bool test_renderer_plans(const char *plan_fpath) {
+	FILE *fexpected = fopen(plan_fpath, "r");
+	if (fexpected == nullptr) {
+		PSHINE_ERROR("rgraph: could not open '%s'", plan_fpath);
+		return false;
+	}
+	FILE *factual = tmpfile();
+	test_print_renderer_plans(factual);
+	rewind(factual);
+
+	char expected[512], actual[512];
+	uint32_t line = 0;
+	bool same = true;
+	while (same) {
+		++line;
+		bool has_expected = fgets(expected, sizeof(expected), fexpected) != nullptr;
+		bool has_actual = fgets(actual, sizeof(actual), factual) != nullptr;
+		if (!has_expected && !has_actual) break;
+		same = has_expected && has_actual && strcmp(expected, actual) == 0;
+		if (!same) {
+			expected[strcspn(expected, "\n")] = '\0';
+			actual[strcspn(actual, "\n")] = '\0';
+			PSHINE_ERROR("rgraph: line %u of '%s' is '%s', the renderer's plan has '%s'", line, plan_fpath,
+				has_expected ? expected : "(end)", has_actual ? actual : "(end)");
+		}
+	}
+	fclose(fexpected);
+	fclose(factual);
+
+	if (!same) {
+		char new_fpath[512];
+		snprintf(new_fpath, sizeof(new_fpath), "%s.new", plan_fpath);
+		FILE *fnew = fopen(new_fpath, "w");
+		if (fnew != nullptr) {
+			test_print_renderer_plans(fnew);
+			fclose(fnew);
+			PSHINE_INFO("rgraph: wrote the renderer's barrier plans to '%s'", new_fpath);
+		}
+	}
+	PSHINE_INFO("rgraph: the renderer's barrier plans %s '%s'%s", same ? "match" : "differ from",
+		plan_fpath, same ? "" : " FAILED");
+	return same;
+}
+
+bool pshine_test_rgraph(const char *plan_fpath) {
+	bool ok = test_renderer_plans(plan_fpath);
+
+	{
+		struct test_stats stats = {};
+		struct pshine_renderer_graph_storage storage;
+		for (uint32_t variant = 0; variant < 16; ++variant) {
+			struct test_graph_options options = {
+				.async = variant & 1,
+				.events = variant & 2,
+				.cull = variant & 4,
+				.reorder = variant & 8,
+			};
+			test_graph("renderer", test_renderer_spec(&storage), options, 3, &stats);
+		}
+		bool renderer_ok = stats.error_count == 0;
+		PSHINE_INFO("rgraph: renderer graph, %u variants: %u frames, %u barriers (%u split), %u errors%s",
+			stats.graph_count, stats.frame_count, stats.barrier_count, stats.split_barrier_count,
+			stats.error_count, renderer_ok ? "" : " FAILED");
+		ok = ok && renderer_ok;
+	}
+
+	{
+		struct pshine_pcg64_state rng;
+		pshine_pcg64_init(&rng, 0x2545f4914f6cdd1d, 0x9e3779b97f4a7c15);
+		enum : uint32_t { GRAPH_COUNT = 400 };
+		struct test_stats stats = {};
+		for (uint32_t g = 0; g < GRAPH_COUNT; ++g) {
+			struct test_random_spec r;
+			test_make_random_spec(&rng, 2 + test_random_below(&rng, 40), &r);
+			struct test_graph_options options = {
+				.async = pshine_pcg64_random_double(&rng) < 0.5,
+				.events = pshine_pcg64_random_double(&rng) < 0.5,
+				.cull = pshine_pcg64_random_double(&rng) < 0.75,
+				.reorder = pshine_pcg64_random_double(&rng) < 0.75,
+			};
+			char name[32];
+			snprintf(name, sizeof(name), "random graph %u", g);
+			uint32_t errors = stats.error_count;
+			test_graph(name, r.spec, options, 3, &stats);
+			if (stats.error_count != errors) PSHINE_ERROR("rgraph: %s has %u passes, async %d, events %d, cull %d, reorder %d",
+				name, r.spec.pass_count, options.async, options.events, options.cull, options.reorder);
+			test_free_random_spec(&r);
+		}
+		bool random_ok = stats.error_count == 0;
+		PSHINE_INFO("rgraph: %u random graphs: %u passes (%u culled, %u merged), %u segments, %u barriers (%u split), %u errors%s",
+			stats.graph_count, stats.pass_count, stats.culled_pass_count, stats.merged_pass_count, stats.segment_count,
+			stats.barrier_count, stats.split_barrier_count, stats.error_count, random_ok ? "" : " FAILED");
+		ok = ok && random_ok;
+	}
+
+	{
+		static const char *const breakages[] = {
+			"a missing barrier", "a barrier that makes nothing visible", "a barrier that waits for nothing",
+			"passes out of order", "a segment that doesn't wait for the other queue",
+		};
+		uint32_t caught = 0, count = sizeof(breakages) / sizeof(*breakages);
+		for (uint32_t how = 0; how < count; ++how) {
+			if (test_catches_broken_recording(how)) ++caught;
+			else PSHINE_ERROR("rgraph: the checks miss %s", breakages[how]);
+		}
+		PSHINE_INFO("rgraph: the checks catch %u of %u broken recordings%s", caught, count, caught == count ? "" : " FAILED");
+		ok = ok && caught == count;
+	}
+
+	return ok;
+}
+
+static double test_ms_since(struct pshine_timeval start) {
+	struct pshine_timeval delta = pshine_timeval_delta(start, pshine_timeval_now());
+	return delta.sec * 1e3 + delta.nsec * 1e-6;
+}
+
+bool pshine_bench_rgraph(uint32_t pass_count) {
+	struct pshine_pcg64_state rng;
+	pshine_pcg64_init(&rng, 0x853c49e6748fea9b, 0xda3e39cb94b95bdb);
+	struct test_random_spec r;
+	test_make_random_spec(&rng, pass_count, &r);
+	enum : uint32_t { REPEAT_COUNT = 5 };
+
+	// the graph's build is timed without and with culling and reordering, each the best of a few runs.
+	struct rg_recording recording = {};
+	struct rg_graph_commands commands = rg_recording_commands(&recording);
+	r.spec.commands = &commands;
+	r.spec.has_async_compute_queue = true;
+	r.spec.async_compute_queue_family_index = TEST_ASYNC_FAMILY;
+	double build_ms[2] = { 1e30, 1e30 }, record_ms = 1e30;
+	struct rg_graph graph = {};
+	bool built = false;
+	for (uint32_t optimize = 0; optimize < 2; ++optimize) {
+		r.spec.cull_passes = optimize;
+		r.spec.reorder_passes = optimize;
+		for (uint32_t k = 0; k < REPEAT_COUNT; ++k) {
+			if (built) rg_free_graph(&graph);
+			graph = (struct rg_graph){};
+			struct pshine_timeval start = pshine_timeval_now();
+			rg_build_graph(&r.spec, &graph);
+			build_ms[optimize] = fmin(build_ms[optimize], test_ms_since(start));
+			built = true;
+		}
+	}
+
+	VkEvent *events = test_make_events(&graph);
+	for (uint32_t k = 0; k < REPEAT_COUNT; ++k) {
+		rg_clear_recording(&recording);
+		struct pshine_timeval start = pshine_timeval_now();
+		test_record_frames(&graph, 0, 1, events);
+		record_ms = fmin(record_ms, test_ms_since(start));
+	}
+	rg_clear_recording(&recording);
+	test_record_frames(&graph, 0, 2, events);
+	struct test_check check = { .name = "bench" };
+	bool ok = test_check_recording(&check, &graph, &r.spec, &recording) == 0;
+
+	PSHINE_INFO("rgraph: %u passes, %u images: build %.3fms, with culling and reordering %.3fms (%u culled, %u segments, %u events), record %.3fms%s",
+		pass_count, r.spec.image_count, build_ms[0], build_ms[1], graph.culled_pass_count, graph.segment_count,
+		graph.event_count, record_ms, ok ? "" : " FAILED");
+
+	free(events);
+	rg_free_recording(&recording);
+	rg_free_graph(&graph);
+	test_free_random_spec(&r);
+	return ok;
+}
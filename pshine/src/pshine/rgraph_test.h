@@ -0,0 +1,25 @@
+#ifndef PSHINE_RGRAPH_TEST_H_
+#define PSHINE_RGRAPH_TEST_H_
+#include <pshine/util.h>
+
+// Headless checks of the render graph (`vk_rgraph.h`): the graphs are built without a device and
+// recorded with `rg_recording_commands`, then the recorded commands are checked by playing them back
+// on a model of the images (their layouts, owners, contents, and which writes are visible where).
+
+/// Check the barrier plans of the renderer's graph, culled and reordered with and without the async compute
+/// queue, against the ones in `plan_fpath` (see `rg_graph_print_barrier_plan`).
+/// Build the renderer's graph and random ones (with and without the async compute queue, split barriers,
+/// culling and reordering), record a few frames of each, and check the recorded commands: each pass finds
+/// its images in the layouts it uses them in, owned by its queue, with the last writes to them waited for
+/// and visible, and written by the same passes as in the specified order. Culled passes must not be needed,
+/// and placed images that share memory must not be used at the same time. Each rendering (and compute pass)
+/// must be timed once, outside of renderings, with its statistics query on the main queue. Also checks that
+/// the checks catch a broken recording.
+/// Logs the results and returns false on failure.
+bool pshine_test_rgraph(const char *plan_fpath);
+
+/// Build and record a random graph of `pass_count` passes a few times, and log how long it takes.
+/// Returns false if the recorded commands fail the checks of `pshine_test_rgraph`.
+bool pshine_bench_rgraph(uint32_t pass_count);
+
+#endif // PSHINE_RGRAPH_TEST_H_
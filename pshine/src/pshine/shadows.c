@@ -0,0 +1,431 @@
+#include "shadows.h"
+#include <math.h>
+#include "psmath.h"
+
+void pshine_make_shadow_light(struct pshine_shadow_light *light, const double dir[static 3]) {
+	double3 d = double3norm(double3vs(dir));
+	// any fixed axis not too close to `dir` works, it only has to be the same every frame.
+	double3 reference = fabs(d.y) < 0.99 ? double3xyz(0, 1, 0) : double3xyz(1, 0, 0);
+	double3 right = double3norm(double3cross(reference, d));
+	double3 up = double3cross(d, right);
+	memcpy(light->right, right.vs, sizeof(light->right));
+	memcpy(light->up, up.vs, sizeof(light->up));
+	memcpy(light->dir, d.vs, sizeof(light->dir));
+}
+
+void pshine_shadow_splits(size_t count, double near, double far, double lambda, double *splits) {
+	splits[0] = near;
+	for (size_t i = 1; i < count; ++i) {
+		double t = i / (double)count;
+		double log_split = near * pow(far / near, t);
+		double uniform_split = near + (far - near) * t;
+		splits[i] = lambda * log_split + (1.0 - lambda) * uniform_split;
+	}
+	splits[count] = far;
+}
+
+static void fit_shadow_cascade(
+	const struct pshine_shadow_camera *camera,
+	const struct pshine_shadow_light *light,
+	double caster_range,
+	double margin,
+	uint32_t resolution,
+	struct pshine_shadow_cascade *cascade
+) {
+	double near = cascade->near, far = cascade->far;
+	// the slice's corners at depth `d` are `k * d` from the view axis. The sphere through all of them
+	// is centered on the axis, or at the far plane if the far corners are the farthest apart.
+	double k2 = camera->tan_x * camera->tan_x + camera->tan_y * camera->tan_y;
+	double c = fmin(far, 0.5 * (near + far) * (1.0 + k2));
+	double bounds_radius = sqrt(fmax((far - c) * (far - c) + k2 * far * far, (near - c) * (near - c) + k2 * near * near));
+	// snapping moves the square by up to half a texel, which must not uncover the sphere.
+	double radius = bounds_radius * (1.0 + margin) * resolution / (resolution - 1.0);
+	double texel_size = 2.0 * radius / resolution;
+
+	double3 center = double3add(double3vs(camera->position), double3mul(double3vs(camera->forward), c));
+	double x = double3dot(double3vs(light->right), center);
+	double y = double3dot(double3vs(light->up), center);
+	double z = double3dot(double3vs(light->dir), center);
+	cascade->center[0] = round(x / texel_size) * texel_size;
+	cascade->center[1] = round(y / texel_size) * texel_size;
+	cascade->radius = radius;
+	cascade->texel_size = texel_size;
+	cascade->depth_min = z - radius;
+	cascade->depth_max = z + radius + caster_range;
+	cascade->bounds_center[0] = x;
+	cascade->bounds_center[1] = y;
+	cascade->bounds_center[2] = z;
+	cascade->bounds_radius = bounds_radius;
+}
+
+void pshine_fit_shadow_cascades(
+	const struct pshine_shadow_camera *camera,
+	const struct pshine_shadow_light *light,
+	double near,
+	double far,
+	double lambda,
+	double margin,
+	uint32_t resolution,
+	size_t count,
+	struct pshine_shadow_cascade *cascades
+) {
+	double splits[count + 1];
+	pshine_shadow_splits(count, near, far, lambda, splits);
+	for (size_t i = 0; i < count; ++i) {
+		cascades[i] = (struct pshine_shadow_cascade){ .near = splits[i], .far = splits[i + 1] };
+		fit_shadow_cascade(camera, light, far, margin, resolution, &cascades[i]);
+	}
+}
+
+size_t pshine_cull_shadow_casters(
+	const struct pshine_shadow_light *light,
+	struct pshine_shadow_cascade *cascade,
+	size_t sphere_count,
+	const struct pshine_cull_sphere *spheres,
+	bool *casts
+) {
+	size_t cast_count = 0;
+	double receivers_max = cascade->depth_min + 2.0 * cascade->radius;
+	double casters_max = receivers_max;
+	for (size_t i = 0; i < sphere_count; ++i) {
+		double3 center = double3vs(spheres[i].center);
+		double r = spheres[i].radius;
+		double x = double3dot(double3vs(light->right), center) - cascade->center[0];
+		double y = double3dot(double3vs(light->up), center) - cascade->center[1];
+		double z = double3dot(double3vs(light->dir), center);
+		casts[i] = fabs(x) <= cascade->radius + r && fabs(y) <= cascade->radius + r
+			&& z + r >= cascade->depth_min && z - r <= cascade->depth_max;
+		if (!casts[i]) continue;
+		++cast_count;
+		casters_max = fmax(casters_max, z + r);
+	}
+	cascade->depth_max = fmin(cascade->depth_max, casters_max);
+	return cast_count;
+}
+
+bool pshine_shadow_cascade_covers(const struct pshine_shadow_cascade *cached, const struct pshine_shadow_cascade *fitted) {
+	// the same parameters give the same slices and sizes exactly.
+	if (cached->near != fitted->near || cached->far != fitted->far || cached->radius != fitted->radius) return false;
+	double r = fitted->bounds_radius;
+	// the receivers' depths, see `pshine_cull_shadow_casters`. The casters above them are culled
+	// against the cached cascade anyway.
+	return fabs(fitted->bounds_center[0] - cached->center[0]) + r <= cached->radius
+		&& fabs(fitted->bounds_center[1] - cached->center[1]) + r <= cached->radius
+		&& fitted->bounds_center[2] - r >= cached->depth_min
+		&& fitted->bounds_center[2] + r <= cached->depth_min + 2.0 * cached->radius;
+}
+
+bool pshine_shadow_caster_moved(const struct pshine_shadow_caster *a, const struct pshine_shadow_caster *b, double tolerance) {
+	double3 offset = double3sub(double3vs(b->bounds.center), double3vs(a->bounds.center));
+	double cos_half_angle = fabs(double4dot(double4vs(a->orientation), double4vs(b->orientation)));
+	double angle = 2.0 * acos(fmin(cos_half_angle, 1.0));
+	// a point on the sphere moves with the center, then along an arc of the turn.
+	double distance = double3mag(offset) + angle * fmax(a->bounds.radius, b->bounds.radius)
+		+ fabs(b->bounds.radius - a->bounds.radius);
+	return distance > tolerance;
+}
+
+void pshine_shadow_cascade_matrix(
+	const struct pshine_shadow_light *light,
+	const struct pshine_shadow_cascade *cascade,
+	const double origin[static 3],
+	float matrix[static 16]
+) {
+	double3 o = double3vs(origin);
+	double depth_scale = 1.0 / (cascade->depth_max - cascade->depth_min);
+	double3 rows[3] = {
+		double3div(double3vs(light->right), cascade->radius),
+		double3div(double3vs(light->up), cascade->radius),
+		double3mul(double3vs(light->dir), depth_scale),
+	};
+	double offsets[3] = {
+		(double3dot(double3vs(light->right), o) - cascade->center[0]) / cascade->radius,
+		(double3dot(double3vs(light->up), o) - cascade->center[1]) / cascade->radius,
+		(double3dot(double3vs(light->dir), o) - cascade->depth_min) * depth_scale,
+	};
+	memset(matrix, 0, 16 * sizeof(float));
+	for (size_t row = 0; row < 3; ++row) {
+		for (size_t col = 0; col < 3; ++col) matrix[col * 4 + row] = (float)rows[row].vs[col];
+		matrix[3 * 4 + row] = (float)offsets[row];
+	}
+	matrix[15] = 1.0f;
+}
+
+static double3 test_random_unit(struct pshine_pcg64_state *rng) {
+	for (;;) {
+		double3 v = double3xyz(
+			pshine_pcg64_random_double(rng) * 2.0 - 1.0,
+			pshine_pcg64_random_double(rng) * 2.0 - 1.0,
+			pshine_pcg64_random_double(rng) * 2.0 - 1.0
+		);
+		double m = double3mag2(v);
+		if (m > 1e-6 && m <= 1.0) return double3div(v, sqrt(m));
+	}
+}
+
+/// `p` in the cascade's clip space, through the single precision matrix like the shaders do.
+static double3 test_project(const float matrix[static 16], double3 origin, double3 p) {
+	float3 q = float3_double3(double3sub(p, origin));
+	float r[3];
+	for (size_t row = 0; row < 3; ++row)
+		r[row] = matrix[row] * q.x + matrix[4 + row] * q.y + matrix[8 + row] * q.z + matrix[12 + row];
+	return double3xyz(r[0], r[1], r[2]);
+}
+
+static void test_random_camera(struct pshine_pcg64_state *rng, struct pshine_shadow_camera *camera) {
+	double3 position = double3mul(test_random_unit(rng), 1'000.0 * pshine_pcg64_random_double(rng));
+	double3 forward = test_random_unit(rng);
+	double3 right = double3norm(double3cross(test_random_unit(rng), forward));
+	double3 up = double3cross(forward, right);
+	memcpy(camera->position, position.vs, sizeof(camera->position));
+	memcpy(camera->right, right.vs, sizeof(camera->right));
+	memcpy(camera->up, up.vs, sizeof(camera->up));
+	memcpy(camera->forward, forward.vs, sizeof(camera->forward));
+	camera->tan_y = tan((20.0 + 30.0 * pshine_pcg64_random_double(rng)) * π / 180.0);
+	camera->tan_x = camera->tan_y * (1.0 + pshine_pcg64_random_double(rng));
+}
+
+/// A point of the camera's frustum at view depth `depth`, `u` and `v` in [-1, 1] across it.
+static double3 test_frustum_point(const struct pshine_shadow_camera *camera, double depth, double u, double v) {
+	double3 p = double3add(double3vs(camera->position), double3mul(double3vs(camera->forward), depth));
+	p = double3add(p, double3mul(double3vs(camera->right), u * camera->tan_x * depth));
+	return double3add(p, double3mul(double3vs(camera->up), v * camera->tan_y * depth));
+}
+
+static bool test_in_cascade(double3 clip, double eps) {
+	return fabs(clip.x) <= 1.0 + eps && fabs(clip.y) <= 1.0 + eps && clip.z >= -eps && clip.z <= 1.0 + eps;
+}
+
+/// `v` rotated by the unit quaternion `q` (scalar first).
+static double3 test_rotate(double4 q, double3 v) {
+	double3 u = double3xyz(q.vs[1], q.vs[2], q.vs[3]);
+	double3 t = double3mul(double3cross(u, v), 2.0);
+	return double3add(double3add(v, double3mul(t, q.vs[0])), double3cross(u, t));
+}
+
+static double4 test_random_rotor(struct pshine_pcg64_state *rng) {
+	double4 q = double4xyzw(
+		pshine_pcg64_random_double(rng) * 2.0 - 1.0,
+		pshine_pcg64_random_double(rng) * 2.0 - 1.0,
+		pshine_pcg64_random_double(rng) * 2.0 - 1.0,
+		pshine_pcg64_random_double(rng) * 2.0 - 1.0
+	);
+	return double4div(q, double4mag(q));
+}
+
+bool pshine_test_shadows() {
+	bool ok = true;
+
+	// the same camera range as the renderer's, in SCS: from the near plane out to a couple of kilometers.
+	const double near = 0.0001, far = 0.25, lambda = 0.75;
+	const uint32_t resolution = PSHINE_SHADOW_CASCADE_SIZE;
+	enum : size_t { COUNT = PSHINE_SHADOW_CASCADE_COUNT };
+	{
+		double uniform[COUNT + 1], logarithmic[COUNT + 1], blended[COUNT + 1];
+		pshine_shadow_splits(COUNT, near, far, 0.0, uniform);
+		pshine_shadow_splits(COUNT, near, far, 1.0, logarithmic);
+		pshine_shadow_splits(COUNT, near, far, lambda, blended);
+		bool splits_ok = true;
+		for (size_t i = 0; i <= COUNT; ++i) {
+			splits_ok = splits_ok && fabs(uniform[i] - (near + (far - near) * i / COUNT)) <= 1e-12;
+			if (i > 0) {
+				splits_ok = splits_ok && fabs(logarithmic[i] / logarithmic[i - 1] - pow(far / near, 1.0 / COUNT)) <= 1e-9;
+				splits_ok = splits_ok && blended[i] > blended[i - 1];
+			}
+		}
+		splits_ok = splits_ok && blended[0] == near && blended[COUNT] == far;
+		if (!splits_ok) PSHINE_ERROR("shadows: the cascade splits are wrong");
+		ok = ok && splits_ok;
+	}
+
+	struct pshine_pcg64_state rng;
+	pshine_pcg64_init(&rng, 0x9e3779b97f4a7c15, 0xbf58476d1ce4e5b9);
+	enum : size_t { POSE_COUNT = 200, POINT_COUNT = 64, CASTER_COUNT = 64, CASTER_SAMPLES = 64 };
+	size_t points_tested = 0, points_uncovered = 0, grid_jumps = 0, size_changes = 0;
+	size_t casters_tested = 0, casters_culled = 0, wrongly_culled = 0, wrongly_clipped = 0;
+	double tightness = 0.0;
+	for (size_t pose = 0; pose < POSE_COUNT; ++pose) {
+		struct pshine_shadow_camera camera;
+		test_random_camera(&rng, &camera);
+		double3 position = double3vs(camera.position);
+		struct pshine_shadow_light light;
+		pshine_make_shadow_light(&light, test_random_unit(&rng).vs);
+		struct pshine_shadow_cascade cascades[COUNT];
+		pshine_fit_shadow_cascades(&camera, &light, near, far, lambda, 0.0, resolution, COUNT, cascades);
+
+		// the camera moves a few texels and turns a little: the squares keep their size and move by whole texels.
+		struct pshine_shadow_camera moved = camera;
+		double3 step = double3mul(test_random_unit(&rng), cascades[0].texel_size * 5.0 * pshine_pcg64_random_double(&rng));
+		memcpy(moved.position, double3add(position, step).vs, sizeof(moved.position));
+		double3 turned = double3norm(double3add(double3vs(camera.forward), double3mul(test_random_unit(&rng), 0.05)));
+		double3 turned_right = double3norm(double3cross(double3vs(camera.up), turned));
+		memcpy(moved.forward, turned.vs, sizeof(moved.forward));
+		memcpy(moved.right, turned_right.vs, sizeof(moved.right));
+		memcpy(moved.up, double3cross(turned, turned_right).vs, sizeof(moved.up));
+		struct pshine_shadow_cascade moved_cascades[COUNT];
+		pshine_fit_shadow_cascades(&moved, &light, near, far, lambda, 0.0, resolution, COUNT, moved_cascades);
+
+		struct pshine_cull_sphere casters[CASTER_COUNT];
+		for (size_t i = 0; i < CASTER_COUNT; ++i) {
+			double3 center = double3add(position, double3mul(test_random_unit(&rng), far * 1.5 * pshine_pcg64_random_double(&rng)));
+			casters[i] = (struct pshine_cull_sphere){
+				.center = { center.x, center.y, center.z },
+				.radius = far * 0.05 * pshine_pcg64_random_double(&rng),
+			};
+		}
+
+		for (size_t c = 0; c < COUNT; ++c) {
+			const struct pshine_shadow_cascade *cascade = &cascades[c];
+			if (moved_cascades[c].radius != cascade->radius) ++size_changes;
+			for (size_t k = 0; k < 2; ++k) {
+				double texels = (moved_cascades[c].center[k] - cascade->center[k]) / cascade->texel_size;
+				if (fabs(texels - round(texels)) > 1e-3) ++grid_jumps;
+			}
+
+			float matrix[16];
+			pshine_shadow_cascade_matrix(&light, cascade, position.vs, matrix);
+			// the slice's corners, then random points inside it.
+			double2 bounds_min = double2v(INFINITY), bounds_max = double2v(-INFINITY);
+			for (size_t i = 0; i < 8 + POINT_COUNT; ++i) {
+				double3 p = i < 8
+					? test_frustum_point(&camera, (i & 1) ? cascade->far : cascade->near, (i & 2) ? 1 : -1, (i & 4) ? 1 : -1)
+					: test_frustum_point(
+						&camera,
+						cascade->near + (cascade->far - cascade->near) * pshine_pcg64_random_double(&rng),
+						pshine_pcg64_random_double(&rng) * 2.0 - 1.0,
+						pshine_pcg64_random_double(&rng) * 2.0 - 1.0
+					);
+				double3 clip = test_project(matrix, position, p);
+				++points_tested;
+				if (!test_in_cascade(clip, 1e-4)) ++points_uncovered;
+				if (i < 8) {
+					bounds_min = double2xy(fmin(bounds_min.x, clip.x), fmin(bounds_min.y, clip.y));
+					bounds_max = double2xy(fmax(bounds_max.x, clip.x), fmax(bounds_max.y, clip.y));
+				}
+			}
+			tightness += 2.0 / fmax(bounds_max.x - bounds_min.x, bounds_max.y - bounds_min.y);
+
+			// a culled caster has no point over the square between the receivers and the caster range,
+			// and the lowered depth range still has all of the casters' points that are.
+			struct pshine_shadow_cascade culled = *cascade;
+			bool casts[CASTER_COUNT];
+			casters_tested += CASTER_COUNT;
+			casters_culled += CASTER_COUNT - pshine_cull_shadow_casters(&light, &culled, CASTER_COUNT, casters, casts);
+			float culled_matrix[16];
+			pshine_shadow_cascade_matrix(&light, &culled, position.vs, culled_matrix);
+			for (size_t i = 0; i < CASTER_COUNT; ++i) {
+				for (size_t k = 0; k < CASTER_SAMPLES; ++k) {
+					double3 p = double3add(double3vs(casters[i].center), double3mul(test_random_unit(&rng),
+						casters[i].radius * (k % 2 == 0 ? 1.0 : pshine_pcg64_random_double(&rng))));
+					if (!test_in_cascade(test_project(matrix, position, p), -1e-4)) continue;
+					if (!casts[i]) {
+						++wrongly_culled;
+						break;
+					}
+					if (!test_in_cascade(test_project(culled_matrix, position, p), 1e-4)) {
+						++wrongly_clipped;
+						break;
+					}
+				}
+			}
+		}
+	}
+	tightness /= POSE_COUNT * COUNT;
+	bool fit_ok = points_uncovered == 0 && grid_jumps == 0 && size_changes == 0 && wrongly_culled == 0 && wrongly_clipped == 0;
+	PSHINE_INFO(
+		"shadows: %zu camera poses, %zu cascades: %zu of %zu points uncovered, %zu moves off the texel grid, "
+		"%zu size changes, squares %.2fx the slices' bounds, %zu of %zu casters culled, %zu wrongly culled, "
+		"%zu clipped%s",
+		(size_t)POSE_COUNT, (size_t)COUNT, points_uncovered, points_tested, grid_jumps, size_changes, tightness,
+		casters_culled, casters_tested, wrongly_culled, wrongly_clipped, fit_ok ? "" : " FAILED"
+	);
+	ok = ok && fit_ok;
+
+	// the camera wanders about, and each cascade is only fitted again when the cached one stops covering
+	// the view. Whatever a reused cascade is asked to cover must be in it.
+	enum : size_t { WALK_COUNT = 50, STEP_COUNT = 100, STEP_POINT_COUNT = 16 };
+	const double margin = 0.2;
+	size_t walk_points_tested = 0, walk_points_uncovered = 0, refits[COUNT] = {};
+	for (size_t walk = 0; walk < WALK_COUNT; ++walk) {
+		struct pshine_shadow_camera camera;
+		test_random_camera(&rng, &camera);
+		struct pshine_shadow_light light;
+		pshine_make_shadow_light(&light, test_random_unit(&rng).vs);
+		struct pshine_shadow_cascade cached[COUNT];
+		pshine_fit_shadow_cascades(&camera, &light, near, far, lambda, margin, resolution, COUNT, cached);
+		double step_size = cached[1].texel_size * 16.0;
+		for (size_t step = 0; step < STEP_COUNT; ++step) {
+			double3 position = double3add(double3vs(camera.position), double3mul(test_random_unit(&rng), step_size));
+			double3 forward = double3norm(double3add(double3vs(camera.forward), double3mul(test_random_unit(&rng), 0.002)));
+			double3 right = double3norm(double3cross(double3vs(camera.up), forward));
+			memcpy(camera.position, position.vs, sizeof(camera.position));
+			memcpy(camera.forward, forward.vs, sizeof(camera.forward));
+			memcpy(camera.right, right.vs, sizeof(camera.right));
+			memcpy(camera.up, double3cross(forward, right).vs, sizeof(camera.up));
+			struct pshine_shadow_cascade fitted[COUNT];
+			pshine_fit_shadow_cascades(&camera, &light, near, far, lambda, margin, resolution, COUNT, fitted);
+			for (size_t c = 0; c < COUNT; ++c) {
+				if (!pshine_shadow_cascade_covers(&cached[c], &fitted[c])) {
+					cached[c] = fitted[c];
+					++refits[c];
+				}
+				float matrix[16];
+				pshine_shadow_cascade_matrix(&light, &cached[c], position.vs, matrix);
+				for (size_t i = 0; i < 8 + STEP_POINT_COUNT; ++i) {
+					double3 p = i < 8
+						? test_frustum_point(&camera, (i & 1) ? fitted[c].far : fitted[c].near, (i & 2) ? 1 : -1, (i & 4) ? 1 : -1)
+						: test_frustum_point(
+							&camera,
+							fitted[c].near + (fitted[c].far - fitted[c].near) * pshine_pcg64_random_double(&rng),
+							pshine_pcg64_random_double(&rng) * 2.0 - 1.0,
+							pshine_pcg64_random_double(&rng) * 2.0 - 1.0
+						);
+					++walk_points_tested;
+					if (!test_in_cascade(test_project(matrix, position, p), 1e-4)) ++walk_points_uncovered;
+				}
+			}
+		}
+	}
+
+	// a caster that hasn't moved by the tolerance has no point that moved more than it.
+	enum : size_t { CASTER_PAIR_COUNT = 10'000, CASTER_PAIR_SAMPLES = 32 };
+	const double tolerance = 1e-3;
+	size_t casters_still = 0, casters_moved_too_far = 0;
+	for (size_t i = 0; i < CASTER_PAIR_COUNT; ++i) {
+		double3 center = test_random_unit(&rng);
+		double4 orientation = test_random_rotor(&rng);
+		struct pshine_shadow_caster a = { .bounds = { .center = { center.x, center.y, center.z }, .radius = 1.0 } };
+		memcpy(a.orientation, orientation.vs, sizeof(a.orientation));
+		// some move and turn by about the tolerance, some well below it.
+		double scale = tolerance * (i % 2 == 0 ? 2.0 : 0.2) * pshine_pcg64_random_double(&rng);
+		double3 moved_center = double3add(center, double3mul(test_random_unit(&rng), scale));
+		double4 moved_orientation = double4add(orientation, double4mul(test_random_rotor(&rng), scale * 0.5));
+		moved_orientation = double4div(moved_orientation, double4mag(moved_orientation));
+		struct pshine_shadow_caster b = a;
+		memcpy(b.bounds.center, moved_center.vs, sizeof(b.bounds.center));
+		memcpy(b.orientation, moved_orientation.vs, sizeof(b.orientation));
+		if (pshine_shadow_caster_moved(&a, &b, tolerance)) continue;
+		++casters_still;
+		for (size_t k = 0; k < CASTER_PAIR_SAMPLES; ++k) {
+			double3 local = test_random_unit(&rng);
+			double3 p = double3add(center, test_rotate(orientation, local));
+			double3 q = double3add(moved_center, test_rotate(moved_orientation, local));
+			if (double3mag(double3sub(q, p)) > tolerance * (1.0 + 1e-9)) {
+				++casters_moved_too_far;
+				break;
+			}
+		}
+	}
+
+	size_t refit_count = 0;
+	for (size_t c = 0; c < COUNT; ++c) refit_count += refits[c];
+	bool cache_ok = walk_points_uncovered == 0 && casters_moved_too_far == 0 && refit_count < WALK_COUNT * STEP_COUNT * COUNT;
+	PSHINE_INFO(
+		"shadows: %zu walks of %zu steps, %.0f%% margin: cascades fitted again %zu, %zu, %zu, %zu times, "
+		"%zu of %zu points uncovered; %zu of %zu casters still, %zu moved too far%s",
+		(size_t)WALK_COUNT, (size_t)STEP_COUNT, margin * 100.0, refits[0], refits[1], refits[2], refits[3],
+		walk_points_uncovered, walk_points_tested, casters_still, (size_t)CASTER_PAIR_COUNT, casters_moved_too_far,
+		cache_ok ? "" : " FAILED"
+	);
+	return ok && cache_ok;
+}
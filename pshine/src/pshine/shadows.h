@@ -0,0 +1,115 @@
+#ifndef PSHINE_SHADOWS_H_
+#define PSHINE_SHADOWS_H_
+#include <pshine/util.h>
+#include "culling.h"
+
+// Cascade splits, light-space fitting and caster selection for the cascaded shadow map.
+
+enum : uint32_t {
+	/// The cascades, side by side in a 2x2 atlas (`SHADOW_CASCADE_COUNT` in `common.glsl`).
+	PSHINE_SHADOW_CASCADE_COUNT = 4,
+	/// The width and height of a cascade in the atlas, in texels.
+	PSHINE_SHADOW_CASCADE_SIZE = 1024,
+};
+
+/// A perspective camera: `right`, `up` and `forward` are its (orthonormal) axes, as for
+/// `pshine_make_cull_frustum`, and `tan_x` and `tan_y` the tangents of its half fields of view.
+struct pshine_shadow_camera {
+	double position[3];
+	double right[3], up[3], forward[3];
+	double tan_x, tan_y;
+};
+
+/// The axes of light space: `right` and `up` span the shadow map, `dir` points towards the light.
+struct pshine_shadow_light {
+	double right[3], up[3], dir[3];
+};
+
+struct pshine_shadow_cascade {
+	/// The view depths (along the camera's `forward`) of the slice of the frustum the cascade covers.
+	double near, far;
+	/// The light-space center of the cascade's square, a whole number of texels from the origin.
+	double center[2];
+	/// Half the width of the square. Only depends on the slice and the field of view, so it
+	/// doesn't change when the camera turns.
+	double radius;
+	/// The light-space depths (along `dir`) mapped to 0 and 1. Receivers are above `depth_min`,
+	/// casters are up to `depth_max`.
+	double depth_min, depth_max;
+	/// The width of a texel, `2 * radius / resolution`.
+	double texel_size;
+	/// The light-space bounding sphere of the slice the square was fitted to (not snapped),
+	/// see `pshine_shadow_cascade_covers`.
+	double bounds_center[3];
+	double bounds_radius;
+};
+
+/// A caster as it was drawn into a cascade, to tell if it has moved since.
+struct pshine_shadow_caster {
+	struct pshine_cull_sphere bounds;
+	/// A unit rotor (or quaternion), only compared by the dot product.
+	double orientation[4];
+};
+
+/// The axes of the light shining from `dir` (towards the light). `right` and `up` only depend on
+/// `dir`, so the texel grid stays put while the light doesn't move.
+void pshine_make_shadow_light(struct pshine_shadow_light *light, const double dir[static 3]);
+
+/// The view depths the cascades start and end at: `splits[0]` is `near`, `splits[count]` is `far`,
+/// and the ones between are the logarithmic split scheme blended with the uniform one by `lambda`
+/// (1 is logarithmic).
+void pshine_shadow_splits(size_t count, double near, double far, double lambda, double *splits);
+
+/// Fit `count` cascades to the camera's frustum between `near` and `far`, split by `pshine_shadow_splits`.
+/// Each cascade's square encloses the bounding sphere of its slice, with its center snapped to the
+/// texels of a `resolution` squared map, so moving and turning the camera doesn't shimmer. The
+/// squares are `1 + margin` times wider than needed, so a cached cascade stays usable for a bit
+/// (see `pshine_shadow_cascade_covers`). The casters are up to `far` towards the light from the slice.
+void pshine_fit_shadow_cascades(
+	const struct pshine_shadow_camera *camera,
+	const struct pshine_shadow_light *light,
+	double near,
+	double far,
+	double lambda,
+	double margin,
+	uint32_t resolution,
+	size_t count,
+	struct pshine_shadow_cascade *cascades
+);
+
+/// Set `casts[i]` for every sphere that can shadow the cascade's receivers: it overlaps the square
+/// and the depth range. Then lower the cascade's `depth_max` to the highest caster, for the depth
+/// precision. Returns how many spheres cast.
+size_t pshine_cull_shadow_casters(
+	const struct pshine_shadow_light *light,
+	struct pshine_shadow_cascade *cascade,
+	size_t sphere_count,
+	const struct pshine_cull_sphere *spheres,
+	bool *casts
+);
+
+/// The cascade's projection (column-major), from positions relative to `origin` to its clip space:
+/// x and y in [-1, 1] across the square, z in [0, 1] from `depth_min` to `depth_max`.
+void pshine_shadow_cascade_matrix(
+	const struct pshine_shadow_light *light,
+	const struct pshine_shadow_cascade *cascade,
+	const double origin[static 3],
+	float matrix[static 16]
+);
+
+/// Whether the `cached` cascade, fitted earlier with the same light, can stand in for the `fitted`
+/// one: they're for the same slice and size, and the cached square and depth range still have
+/// the fitted slice's receivers.
+bool pshine_shadow_cascade_covers(const struct pshine_shadow_cascade *cached, const struct pshine_shadow_cascade *fitted);
+
+/// Whether any point of the caster could have moved by more than `tolerance` from `a` to `b`.
+bool pshine_shadow_caster_moved(const struct pshine_shadow_caster *a, const struct pshine_shadow_caster *b, double tolerance);
+
+/// Check the splits, and the cascades fitted for random camera poses: that they cover their slices,
+/// stay on the texel grid as the camera moves, and that no culled caster could have cast a shadow.
+/// Then that the cascades reused as the camera moves still cover the view, and that the casters
+/// that didn't move by the tolerance really didn't.
+/// Logs the results and returns false on failure.
+bool pshine_test_shadows();
+
+#endif // PSHINE_SHADOWS_H_
@@ -7,6 +7,7 @@
 #endif
 #include <fcntl.h>
 #include <unistd.h>
+#include <pthread.h>
 
 #ifdef __MACH__
 #include <mach-o/dyld.h>
@@ -73,6 +74,73 @@ size_t pshine_get_mem_usage() {
 #endif // helix
 }
 
+size_t pshine_get_cpu_count() {
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n < 1 ? 1 : (size_t)n;
+}
+
+struct pshine_thread_ {
+	pthread_t handle;
+	void (*fn)(void *user);
+	void *user;
+};
+
+static void *pshine_thread_entry_(void *arg) {
+	struct pshine_thread_ *t = arg;
+	t->fn(t->user);
+	return nullptr;
+}
+
+pshine_thread pshine_thread_start(void (*fn)(void *user), void *user) {
+	struct pshine_thread_ *t = calloc(1, sizeof(*t));
+	t->fn = fn;
+	t->user = user;
+	int err = pthread_create(&t->handle, nullptr, &pshine_thread_entry_, t);
+	if (err != 0) PSHINE_PANIC("Could not create thread: %s", strerror(err));
+	return t;
+}
+
+void pshine_thread_join(pshine_thread thread) {
+	pthread_join(thread->handle, nullptr);
+	free(thread);
+}
+
+// not `sem_t`, macOS doesn't have unnamed semaphores.
+struct pshine_semaphore_ {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	uint32_t count;
+};
+
+pshine_semaphore pshine_semaphore_create(uint32_t count) {
+	struct pshine_semaphore_ *sem = calloc(1, sizeof(*sem));
+	pthread_mutex_init(&sem->mutex, nullptr);
+	pthread_cond_init(&sem->cond, nullptr);
+	sem->count = count;
+	return sem;
+}
+
+void pshine_semaphore_destroy(pshine_semaphore sem) {
+	pthread_cond_destroy(&sem->cond);
+	pthread_mutex_destroy(&sem->mutex);
+	free(sem);
+}
+
+void pshine_semaphore_post(pshine_semaphore sem, uint32_t count) {
+	pthread_mutex_lock(&sem->mutex);
+	sem->count += count;
+	pthread_mutex_unlock(&sem->mutex);
+	if (count == 1) pthread_cond_signal(&sem->cond);
+	else pthread_cond_broadcast(&sem->cond);
+}
+
+void pshine_semaphore_wait(pshine_semaphore sem) {
+	pthread_mutex_lock(&sem->mutex);
+	while (sem->count == 0) pthread_cond_wait(&sem->cond, &sem->mutex);
+	--sem->count;
+	pthread_mutex_unlock(&sem->mutex);
+}
+
 // TODO: PSHINE_USE_CPPTRACE
 // #ifndef PSHINE_USE_CPPTRACE
 // #define PSHINE_USE_CPPTRACE
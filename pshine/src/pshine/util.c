@@ -576,8 +576,12 @@ uint32_t pshine_pcg32_random_uint32(struct pshine_pcg32_state *state) {
 
 [[maybe_unused]]
 uint64_t pshine_pcg64_random_uint64(struct pshine_pcg64_state *state) {
-	return ((uint64_t)pshine_pcg32_random_uint32((void*)state))
-		| ((uint64_t)pshine_pcg32_random_uint32((void*)state) << 32);
+	// a copy, not a cast: the state's aliasing a `pshine_pcg32_state` would let the seed be optimized out.
+	struct pshine_pcg32_state state32 = { state->state[0] };
+	uint64_t lo = pshine_pcg32_random_uint32(&state32);
+	uint64_t hi = pshine_pcg32_random_uint32(&state32);
+	state->state[0] = state32.state;
+	return lo | (hi << 32);
 	// pshine_uint128 x = { state->state[0], state->state[1] };
 	// x = pshine_uint128add(pshine_uint128mul(x, pcg64_multiplier), pcg64_increment);
 	// state->state[0] = x.lo;
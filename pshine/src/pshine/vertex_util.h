@@ -86,5 +86,15 @@ static inline float3 oct_to_float32x3(float2 e) {
 	return float3norm(v);
 }
 
+// The static mesh vertices' tangent also carries the bitangent sign, as `sign * (1 + diamond)`
+// (the 1 keeps the sign of a zero diamond). `std_mesh.vert` decodes it the same way.
+static inline float encode_signed_tangent(float3 normal, float3 tangent, float bitangent_sign) {
+	return copysignf(1.f + encode_tangent(normal, tangent), bitangent_sign);
+}
+
+static inline float3 decode_signed_tangent(float3 normal, float signed_tangent, float *bitangent_sign) {
+	*bitangent_sign = sign_not_zero(signed_tangent);
+	return decode_tangent(normal, fabsf(signed_tangent) - 1.f);
+}
 
 #endif // PSHINE_VERTEX_UTIL_H_
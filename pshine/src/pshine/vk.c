@@ -22,16 +22,25 @@
 #include "psmath.h"
 #include "vertex_util.h"
 #include "vk_rgraph.h"
+#include "renderer_graph.h"
+#include "mesh.h"
+#include "culling.h"
+#include "lod.h"
+#include "atmosphere.h"
+#include "shadows.h"
+#include "gpu_perf.h"
+#include "game/heightfield.h"
 
 #define SHADERS_PATH "build/pshine/data/shaders"
 // #define SHADERS_PATH "data/shaders"
+/// Where computed data is kept between runs, see `compute_atmo_lut`.
+#define CACHE_PATH "build/pshine"
 
 #define SCSd3_WCSd3(wcs) (double3mul((wcs), PSHINE_SCS_FACTOR))
 #define SCSd3_WCSp3(wcs) SCSd3_WCSd3(double3vs((wcs).values))
 #define SCSd_WCSd(wcs) ((wcs) * PSHINE_SCS_FACTOR)
 
 #define BLOOM_STAGE_COUNT 8
-#define SHADOW_CASCADE_COUNT 4
 
 struct vulkan_renderer;
 enum queue_family {
@@ -41,7 +50,17 @@ enum queue_family {
 	QUEUE_FAMILY_COUNT_
 };
 
-#define FRAMES_IN_FLIGHT 2
+/// Indexed by `enum pshine_present_mode`.
+static const VkPresentModeKHR vk_present_modes[PSHINE_PRESENT_MODE_COUNT_] = {
+	[PSHINE_PRESENT_MODE_FIFO] = VK_PRESENT_MODE_FIFO_KHR,
+	[PSHINE_PRESENT_MODE_MAILBOX] = VK_PRESENT_MODE_MAILBOX_KHR,
+	[PSHINE_PRESENT_MODE_IMMEDIATE] = VK_PRESENT_MODE_IMMEDIATE_KHR,
+};
+static const char *const present_mode_names[PSHINE_PRESENT_MODE_COUNT_] = {
+	[PSHINE_PRESENT_MODE_FIFO] = "FIFO",
+	[PSHINE_PRESENT_MODE_MAILBOX] = "Mailbox",
+	[PSHINE_PRESENT_MODE_IMMEDIATE] = "Immediate",
+};
 
 struct global_uniform_data {
 	float4 sun;
@@ -51,21 +70,61 @@ struct global_uniform_data {
 	float4x4 inv_view;
 	float4x4 inv_proj;
 	float4x4 local_view;
+	/// From positions relative to the render origin to each shadow cascade's clip space.
+	float4x4 shadow_proj[PSHINE_SHADOW_CASCADE_COUNT];
+	float4 shadow_splits; // the view depth each cascade ends at
+	float4 shadow_biases; // each cascade's texel in its depth units
 };
 
+static_assert(PSHINE_SHADOW_CASCADE_COUNT == 4, "the shadow cascades' splits and biases are packed in a float4");
+
 struct atmo_uniform_data {
 	float4 planet; // xyz, w=radius
 	float4 coefs_ray; // xyz=k_ray, w=falloff_ray
 	float4 coefs_mie; // x=k_mie, y=k_mie_ext, z=g, w=falloff_mie
-	float4 camera; // xyz, w=_
+	float4 camera; // xyz, w=the index of the planet's LUTs in the atmosphere pass's arrays
+	float4 aerial_rect; // the screen rect (xy=min, zw=size, in uv) of the aerial perspective volume
 	float radius;
-	unsigned int optical_depth_samples;
-	unsigned int scatter_point_samples;
+	unsigned int sky_view_samples;
+	unsigned int aerial_samples; // per slice
 	float intensity;
 	float3 sun;
 	float scale_factor;
 };
 
+static_assert(sizeof(struct atmo_uniform_data) % 16 == 0, "the std430 array stride of `AtmosphereUniforms`");
+
+/// `ATMOSPHERE_BATCH`, every visible atmosphere.
+struct atmo_batch_data {
+	uint32_t count;
+	uint32_t _pad[3];
+	struct atmo_uniform_data atmos[PSHINE_ATMO_MAX_BATCH];
+};
+
+/// `AtmosphereHalfResUniforms`
+struct atmo_half_res_uniform_data {
+	float4 prev_camera; // xyz=the last frame's camera, relative to this one's, w=1 if there is a history
+	float4 prev_camera_right;
+	float4 prev_camera_up;
+	uint32_t jitter[2];
+	uint32_t divisor;
+	float blend;
+	uint32_t extent[2]; // the pixels rendered, see `do_frame_stuff::render_extent`
+	uint32_t _pad[2];
+};
+
+/// `_BloomConsts`
+struct bloom_push_constants {
+	struct pshine_graphics_settings settings;
+	int32_t extent[2]; // the rendered part of the color image
+};
+
+/// `_TonemapConsts`
+struct tonemap_push_constants {
+	struct pshine_graphics_settings settings;
+	float uv_scale[2]; // the rendered part of the color image
+};
+
 struct planet_material_uniform_data {
 	float4 color;
 	float3 view_dir;
@@ -81,6 +140,8 @@ struct planet_mesh_uniform_data {
 	float4x4 model_view;
 	float4x4 model;
 	float4 sun;
+	/// 0 is the mesh's own vertices, 1 is the morph targets (coarser LOD).
+	float lod_morph;
 };
 
 struct std_mesh_uniform_data {
@@ -88,8 +149,6 @@ struct std_mesh_uniform_data {
 	float4x4 model_view;
 	float4x4 model;
 	float4x4 unscaled_model;
-	float4x4 shadow_model_view;
-	float4x4 shadow_proj;
 	float4 sun;
 	float4 rel_cam_pos;
 };
@@ -105,6 +164,8 @@ struct rings_uniform_data {
 };
 
 struct atmo_lut_push_const_data {
+	float4 coefs_ray; // xyz=k_ray
+	float4 coefs_mie; // x=k_mie, y=k_mie_ext
 	float planet_radius;
 	float atmo_height;
 	float2 falloffs;
@@ -129,9 +190,16 @@ struct vulkan_mesh {
 	enum pshine_vertex_type vertex_type;
 };
 
+/// Per-body LOD selection state, kept between frames for the hysteresis.
+struct celestial_body_lod_state {
+	size_t lod;
+	float morph;
+};
+
 struct pshine_star_graphics_data {
-	struct vulkan_buffer uniform_buffer;
-	struct vulkan_buffer rings_uniform_buffer;
+	struct celestial_body_lod_state lod;
+	/// This frame's offsets in the uniform ring.
+	uint32_t uniform_offset, rings_uniform_offset;
 	// struct vulkan_image atmo_lut;
 	// struct vulkan_image surface_albedo;
 	// struct vulkan_image surface_lights;
@@ -145,12 +213,35 @@ struct pshine_star_graphics_data {
 
 struct pshine_planet_graphics_data {
 	// struct vulkan_mesh *mesh_ref;
-	struct vulkan_buffer uniform_buffer;
-	struct vulkan_buffer atmo_uniform_buffer;
-	struct vulkan_buffer material_uniform_buffer;
-	/// Note: Can be uninitialized if there are no rings.
-	struct vulkan_buffer rings_uniform_buffer;
-	struct vulkan_image atmo_lut;
+	struct celestial_body_lod_state lod;
+	/// This frame's offsets in the uniform ring.
+	uint32_t uniform_offset, atmo_uniform_offset, material_uniform_offset, rings_uniform_offset;
+	/// The transmittance and multiple scattering LUTs, twice: the frames read `[atmo_lut_current]`
+	/// while `compute_atmo_lut` writes the others, and they're swapped once those are done.
+	struct vulkan_image atmo_lut[2];
+	struct vulkan_image atmo_multiscatter_lut[2];
+	uint32_t atmo_lut_current;
+	/// The graphics queue's timeline value (see `vulkan_renderer::queue_timelines`) of the last frame
+	/// that can read the LUTs that aren't `atmo_lut_current`.
+	uint64_t atmo_lut_retire_value;
+	/// Whether `compute_atmo_lut` was called while the other LUTs were still in use, so `update_atmo_luts`
+	/// calls it again once they aren't, and with which `use_cache`.
+	bool atmo_lut_queued, atmo_lut_queued_use_cache;
+	/// Signaled when the LUTs are computed or uploaded, see `compute_atmo_lut`.
+	VkFence atmo_lut_fence;
+	/// Between the compute queue and the graphics queue's acquire, with `vulkan_renderer::async_compute`.
+	VkSemaphore atmo_lut_semaphore;
+	/// The acquire of the LUTs, freed once they're done. VK_NULL_HANDLE without async compute.
+	VkCommandBuffer atmo_lut_acquire_cmdbuf;
+	/// The LUTs' texels, uploaded from or read back for the disk cache while `atmo_lut_pending`.
+	struct vulkan_buffer atmo_lut_staging;
+	void *atmo_lut_staging_mapped;
+	/// The hash of the LUTs' parameters, naming their cache file.
+	uint64_t atmo_lut_hash;
+	/// Whether the LUTs are being computed or uploaded, and whether they're then written to the cache.
+	bool atmo_lut_pending, atmo_lut_save;
+	/// Whether the LUTs are done, so the atmosphere can be drawn.
+	bool atmo_lut_ready;
 	struct vulkan_image surface_albedo;
 	struct vulkan_image surface_lights;
 	struct vulkan_image surface_specular;
@@ -159,8 +250,12 @@ struct pshine_planet_graphics_data {
 	VkDescriptorSet descriptor_set;
 	VkCommandBuffer compute_cmdbuf;
 	bool should_submit_compute;
-	VkDescriptorSet atmo_descriptor_set;
-	VkDescriptorSet atmo_lut_descriptor_set;
+	/// Whether the atmosphere is drawn this frame: visible, and at least `vulkan_renderer::atmo_min_pixels` across.
+	bool atmo_drawn;
+	/// `[i]` writes `atmo_lut[i]` and `atmo_multiscatter_lut[i]`.
+	VkDescriptorSet atmo_lut_descriptor_sets[2];
+	/// `[i]` reads `atmo_lut[i]` and `atmo_multiscatter_lut[i]`.
+	VkDescriptorSet atmo_view_lut_descriptor_sets[2];
 	VkDescriptorSet material_descriptor_set;
 	/// Note: Can be VK_NULL_HANDLE if there are no rings.
 	VkDescriptorSet rings_descriptor_set;
@@ -177,17 +272,23 @@ struct vulkan_std_material_images {
 struct vulkan_std_material {
 	struct vulkan_std_material_images images;
 	VkDescriptorSet descriptor_set;
-	struct vulkan_buffer uniform_buffer;
 };
 
 struct vulkan_mesh_model {
 	size_t part_count;
 	struct vulkan_mesh_model_part {
 		size_t material_index;
-		struct vulkan_mesh mesh;
+		/// Where the part's vertices start in the mesh arena.
+		int32_t vertex_offset;
+		/// Where the part's indices (of all LODs) start in the mesh arena, `lods` are relative to it.
+		uint32_t first_index;
+		uint32_t lod_count;
+		struct pshine_mesh_lod lods[PSHINE_MESH_MAX_LODS];
 	} *parts_own;
 	size_t material_count;
 	double4x4 transform;
+	/// The largest distance of a vertex from the origin, before `transform`.
+	double bounding_radius;
 	struct vulkan_std_material *materials_own;
 };
 
@@ -199,8 +300,58 @@ static void load_mesh_model_from_gltf(
 
 struct pshine_ship_graphics_data {
 	struct vulkan_mesh_model model;
-	struct vulkan_buffer uniform_buffer;
-	VkDescriptorSet descriptor_set;
+	/// How many pixels one unit of the model covers on screen this frame, for selecting the LODs.
+	float lod_pixels_per_unit;
+	/// Whether the ship is in view (and not behind a planet) this frame.
+	bool visible;
+	/// The shadow cascades the ship is drawn into this frame, a bit per cascade (only the ones
+	/// rendered again, see `fit_shadow_cascades`).
+	uint32_t shadow_cascade_mask;
+};
+
+/// A cascade in the shadow atlas as it was last rendered.
+struct shadow_cascade_cache {
+	bool valid;
+	/// As fitted to the view, and with the depth range lowered to the casters.
+	struct pshine_shadow_cascade fitted, culled;
+	/// The ships drawn into it (indices into `pshine_game::ships`), and where they were.
+	size_t caster_count, caster_capacity;
+	size_t *caster_ships_own;
+	struct pshine_shadow_caster *casters_own;
+};
+
+/// One persistently mapped uniform buffer for all per-frame uniform data, with a region per
+/// frame in flight. Each frame's data is sub-allocated linearly from its region (see
+/// `push_uniform_data`) and bound with dynamic offsets, so the descriptor sets never change.
+struct vulkan_uniform_ring {
+	struct vulkan_buffer buffer;
+	char *mapped;
+	VkDeviceSize region_size;
+	/// Where the current frame's region starts.
+	VkDeviceSize region_offset;
+	/// How much of the current frame's region is used.
+	VkDeviceSize used;
+};
+
+/// The vertices and indices of all static meshes, in one buffer each, so that any of them
+/// can be drawn from the same indirect draw list without rebinding buffers.
+struct vulkan_mesh_arena {
+	struct vulkan_buffer vertex_buffer, index_buffer;
+	uint32_t vertex_count, vertex_capacity;
+	uint32_t index_count, index_capacity;
+};
+
+/// A range of this frame's std mesh draws that use the same material.
+struct std_mesh_draw_group {
+	VkDescriptorSet material_descriptor_set;
+	uint32_t first_draw;
+	uint32_t draw_count;
+};
+
+/// A part of a ship, in `vulkan_renderer::std_mesh_part_order_own`.
+struct std_mesh_part_ref {
+	VkDescriptorSet material_descriptor_set;
+	uint32_t ship, part;
 };
 
 struct swapchain_image_sync_data {
@@ -209,9 +360,74 @@ struct swapchain_image_sync_data {
 	VkFence in_flight_fence;
 };
 
+enum : size_t { RECORD_THREAD_COUNT_MAX = 8 };
+
+enum : uint32_t {
+	/// At most this many presents wait for their input latency, the older ones are dropped.
+	PRESENT_LATENCY_RING = 16,
+	/// The input latency is averaged over this many presents.
+	INPUT_LATENCY_WINDOW = 64,
+};
+
+/// The parts of a frame recorded into their own secondary command buffers, in execution order.
+enum record_job {
+	RECORD_JOB_ATMOSPHERE_LUTS,
+	RECORD_JOB_SHADOW,
+	RECORD_JOB_BODIES,
+	RECORD_JOB_SHIPS,
+	RECORD_JOB_ATMOSPHERE_HALF_RES,
+	RECORD_JOB_ATMOSPHERE,
+	RECORD_JOB_LIGHTING,
+	RECORD_JOB_BLOOM,
+	RECORD_JOB_TONEMAP,
+	RECORD_JOB_GUI,
+	RECORD_JOB_COUNT_,
+};
+
+enum : size_t {
+	/// The bodies and ships jobs are split into up to this many command buffers, see `record_jobs`.
+	RECORD_CHUNK_COUNT_MAX = 4,
+	RECORD_TASK_COUNT_MAX = RECORD_JOB_COUNT_ * RECORD_CHUNK_COUNT_MAX,
+	/// Roughly how many bodies and ship draw groups each chunk gets.
+	RECORD_BODIES_PER_CHUNK = 8,
+	RECORD_SHIP_GROUPS_PER_CHUNK = 8,
+};
+
+enum : size_t {
+	/// At most this many render graph segments, see `rg_graph::segments_own`.
+	FRAME_SEGMENT_COUNT_MAX = 4,
+};
+
+/// A command buffer `render_end` submits, and what it waits for (see `rg_segment::wait_segment`).
+struct frame_submit {
+	enum rg_queue queue;
+	VkCommandBuffer command_buffer;
+	/// The submission on the other queue to wait for at `wait_stage_flags`, `UINT32_MAX` if none.
+	uint32_t wait_submit;
+	VkPipelineStageFlags2 wait_stage_flags;
+	/// If not `NONE`, wait for the other queue's earlier frames at these stages.
+	VkPipelineStageFlags2 frame_wait_stage_flags;
+	/// If not `NONE`, wait for the swapchain image at these stages.
+	VkPipelineStageFlags2 swapchain_stage_flags;
+};
+
 struct per_frame_data {
 	struct swapchain_image_sync_data sync;
+	/// The first segment's, same as `segment_command_buffers[RG_QUEUE_MAIN][0]`.
 	VkCommandBuffer command_buffer;
+	/// A primary command buffer for each render graph segment on each queue. The async compute
+	/// ones are from `async_pool`, and only exist with `vulkan_renderer::async_compute`.
+	VkCommandBuffer segment_command_buffers[RG_QUEUE_COUNT_][FRAME_SEGMENT_COUNT_MAX];
+	VkCommandPool async_pool;
+	/// What `render_end` submits this frame, in order.
+	uint32_t submit_count;
+	struct frame_submit submits[FRAME_SEGMENT_COUNT_MAX];
+	/// One pool per queue and recording thread, reset every frame, with a secondary command buffer for every
+	/// chunk of every job. A job records into the pools of its pass's queue.
+	VkCommandPool record_pools[RG_QUEUE_COUNT_][RECORD_THREAD_COUNT_MAX];
+	VkCommandBuffer record_command_buffers[RG_QUEUE_COUNT_][RECORD_THREAD_COUNT_MAX][RECORD_TASK_COUNT_MAX];
+	/// The command buffer each chunk of each job was recorded into this frame, null past the job's chunks.
+	VkCommandBuffer recorded[RECORD_JOB_COUNT_][RECORD_CHUNK_COUNT_MAX];
 	// Usually set each frame to the current swapchain image.
 	VkImage swapchain_image;
 	// Usually set each frame to the current swapchain image view.
@@ -237,9 +453,20 @@ struct gbuffer_image {
 struct render_pass_transients {
 	struct gbuffer_image gbuffer[GBUFFER_IMAGE_COUNT_];
 	struct vulkan_image color_0;
-	struct vulkan_image bloom[BLOOM_STAGE_COUNT];
-	struct vulkan_image shadow[SHADOW_CASCADE_COUNT];
+	/// `BLOOM_STAGE_COUNT` mips, the first half the size of the swapchain. Has no view of the whole chain.
+	struct vulkan_image bloom;
+	VkImageView bloom_mip_views[BLOOM_STAGE_COUNT];
+	/// The number of bloom downsample workgroups done, see `bloom_downsample.comp`. Zeroed before each dispatch.
+	struct vulkan_buffer bloom_counter;
+	/// The shadow cascades, a 2x2 atlas of `PSHINE_SHADOW_CASCADE_SIZE` squared tiles.
+	struct vulkan_image shadow;
 	struct vulkan_image color_s;
+	/// The half-resolution atmosphere's samples this frame, see `atmo_half.comp`. Placed by the render graph.
+	struct vulkan_image atmo_light;
+	/// The accumulated half-resolution atmosphere and its block depths, see `atmo_resolve.comp`. Two layers,
+	/// viewed separately: `[vulkan_renderer::atmo_history_index]` is this frame's, the other the last frame's.
+	struct vulkan_image atmo_history, atmo_history_depth;
+	VkImageView atmo_history_views[2], atmo_history_depth_views[2];
 };
 
 struct model_store_entry {
@@ -263,28 +490,6 @@ struct render_pass_info {
 	VkFormat stencil_attachment_format;
 };
 
-enum : uint32_t {
-	RPIMG_COLOR0,
-	RPIMG_DEPTH0,
-	RPIMG_GBUFFER0,
-	RPIMG_GBUFFER1,
-	RPIMG_GBUFFER2,
-	RPIMG_SHADOW0,
-	RPIMG_SHADOWC,
-	RPIMG_COUNT_
-};
-
-enum : uint32_t {
-	RPASS_SHADOW,
-	RPASS_HDR_GEOMETRY,
-	RPASS_HDR_ATMOSPHERE,
-	RPASS_HDR_LIGHTING,
-	RPASS_BLOOM,
-	RPASS_SDR_TONEMAP,
-	RPASS_SDR_GUI,
-	RPASS_COUNT_,
-};
-
 struct vulkan_renderer {
 	struct pshine_renderer as_base;
 	struct pshine_game *game;
@@ -297,6 +502,12 @@ struct vulkan_renderer {
 	VkDevice device;
 	uint32_t queue_families[QUEUE_FAMILY_COUNT_];
 	VkQueue queues[QUEUE_FAMILY_COUNT_];
+	/// Whether `QUEUE_COMPUTE` is a different family from `QUEUE_GRAPHICS`. If so, the render
+	/// graph's async compute passes run on it (see `--single-queue`).
+	bool async_compute;
+	/// Signalled by every submission on each `rg_queue`, with increasing values, for the other one to wait for.
+	VkSemaphore queue_timelines[RG_QUEUE_COUNT_];
+	uint64_t queue_timeline_values[RG_QUEUE_COUNT_];
 	VkSwapchainKHR swapchain;
 	VkSurfaceCapabilitiesKHR surface_capabilities;
 	VkExtent2D swapchain_extent;
@@ -329,6 +540,8 @@ struct vulkan_renderer {
 		VkPipeline planet_color_mesh_pipeline;
 		VkPipelineLayout atmo_layout;
 		VkPipeline atmo_pipeline;
+		VkPipelineLayout atmo_upsample_layout;
+		VkPipeline atmo_upsample_pipeline;
 		VkPipelineLayout line_gizmo_layout;
 		VkPipeline line_gizmo_pipeline;
 		VkPipelineLayout blit_layout;
@@ -349,11 +562,17 @@ struct vulkan_renderer {
 		// compute pipelines
 		VkPipelineLayout atmo_lut_layout;
 		VkPipeline atmo_lut_pipeline;
+		VkPipeline atmo_multiscatter_pipeline;
+		VkPipelineLayout atmo_view_lut_layout;
+		VkPipeline atmo_sky_view_pipeline;
+		VkPipeline atmo_aerial_pipeline;
+		VkPipelineLayout atmo_half_res_layout;
+		VkPipeline atmo_half_pipeline;
+		VkPipeline atmo_resolve_pipeline;
 		VkPipelineLayout upsample_bloom_layout;
 		VkPipeline upsample_bloom_pipeline;
 		VkPipelineLayout downsample_bloom_layout;
 		VkPipeline downsample_bloom_pipeline;
-		VkPipeline first_downsample_bloom_pipeline;
 	} pipelines;
 
 	// struct {
@@ -365,6 +584,10 @@ struct vulkan_renderer {
 	// } render_passes;
 
 	struct rg_graph rgraph;
+	/// The memory of the render graph's placed images, see `bind_graph_images`.
+	VmaAllocation *rgraph_heaps_own;
+	/// The render graph's split barrier events, `rgraph.event_count` for each frame in flight.
+	VkEvent *rgraph_events_own;
 
 	VkCommandPool command_pool_graphics;
 	VkCommandPool command_pool_transfer;
@@ -378,6 +601,9 @@ struct vulkan_renderer {
 		VkDescriptorSetLayout planet_mesh_layout;
 		VkDescriptorSetLayout atmo_layout;
 		VkDescriptorSetLayout atmo_lut_layout;
+		VkDescriptorSetLayout atmo_view_lut_layout;
+		VkDescriptorSetLayout atmo_half_res_layout;
+		VkDescriptorSetLayout atmo_upsample_layout;
 		VkDescriptorSetLayout blit_layout;
 		VkDescriptorSetLayout light_layout;
 		VkDescriptorSetLayout rings_layout;
@@ -389,23 +615,91 @@ struct vulkan_renderer {
 	} descriptors;
 
 	struct {
-		struct vulkan_buffer global_uniform_buffer;
+		struct vulkan_uniform_ring uniform_ring;
 		VkDescriptorSet global_descriptor_set;
 		VkDescriptorSet blit_descriptor_set;
 		VkDescriptorSet light_descriptor_set;
-		/// `[i]` reads from `i` and writes to `i - 1`.
+		/// `[i]` reads from mip `i` and writes to mip `i - 1` (`[0]` to `color_0`).
 		VkDescriptorSet upsample_bloom_descriptor_sets[BLOOM_STAGE_COUNT];
-		/// `[i]` reads from `i` and writes to `i + 1`.
-		VkDescriptorSet downsample_bloom_descriptor_sets[BLOOM_STAGE_COUNT];
+		/// Reads from `color_0` and writes to every mip.
+		VkDescriptorSet downsample_bloom_descriptor_set;
+		/// `[i]` writes layer `i` of `atmo_history` and reads the other one.
+		VkDescriptorSet atmo_half_res_descriptor_sets[2];
+		/// `[i]` reads layer `i` of `atmo_history`.
+		VkDescriptorSet atmo_upsample_descriptor_sets[2];
+		/// `PSHINE_MAX_FRAMES_IN_FLIGHT` tables of `struct atmo_batch_data`. Stays mapped.
+		struct vulkan_buffer atmo_batch_buffer;
+		char *atmo_batch_mapped;
+		/// One per frame in flight: the atmosphere batch, and `vulkan_renderer::atmo_sky_view_luts`
+		/// and `vulkan_renderer::atmo_aerial_luts`.
+		VkDescriptorSet atmo_descriptor_sets[PSHINE_MAX_FRAMES_IN_FLIGHT];
 		VkDescriptorSet skybox_descriptor_set;
+		/// `PSHINE_MAX_FRAMES_IN_FLIGHT` tables of `std_mesh_instance_capacity` instances (one per ship),
+		/// indexed by the ship's index. Stays mapped.
+		struct vulkan_buffer std_mesh_instance_buffer;
+		char *std_mesh_instances_mapped;
+		size_t std_mesh_instance_capacity;
+		VkDescriptorSet std_mesh_descriptor_set;
+		/// `PSHINE_MAX_FRAMES_IN_FLIGHT` draw lists, each `std_mesh_draw_capacity` commands followed by the
+		/// counts: the total, then one per group. Stays mapped.
+		struct vulkan_buffer std_mesh_draw_buffer;
+		char *std_mesh_draws_mapped;
+		size_t std_mesh_draw_capacity;
 	} data;
 
-	struct per_frame_data frames[FRAMES_IN_FLIGHT];
+	/// The first `frames_in_flight` are used, the last one is `pshine_take_screenshot`'s.
+	struct per_frame_data frames[PSHINE_MAX_FRAMES_IN_FLIGHT + 1];
+	/// `pshine_render_settings::frames_in_flight` when it was last applied, see `apply_frame_settings`.
+	uint32_t frames_in_flight;
 
 	VmaAllocator allocator;
 
 	size_t sphere_mesh_count;
 	struct vulkan_mesh *own_sphere_meshes;
+	struct vulkan_mesh_arena mesh_arena;
+
+	/// How many threads record the frame's command buffers, at most `RECORD_THREAD_COUNT_MAX`.
+	size_t record_thread_count;
+	/// How long the last frame's recording took, in seconds.
+	double record_time;
+	/// The threads that record along with the main one. Started with the renderer, they wait on
+	/// `record_start` and post `record_done` once per frame, see `record_game_frame_passes`.
+	pshine_thread record_threads[RECORD_THREAD_COUNT_MAX - 1];
+	pshine_semaphore record_start, record_done;
+	/// The frame being recorded, only set while the threads are awake.
+	struct record_work *record_work;
+	bool record_threads_quit;
+	/// Whether the device can count the shader invocations of the passes (`pipelineStatisticsQuery`,
+	/// and `inheritedQueries` since the passes are recorded in secondary command buffers).
+	bool pipeline_statistics;
+	/// The least `timestampValidBits` of the graphics and compute queue families.
+	uint32_t timestamp_valid_bits;
+	/// The GPU times of the render graph's passes, rebuilt with the graph.
+	struct pshine_gpu_perf gpu_perf;
+	/// The present modes the surface supports, a bit per `enum pshine_present_mode`, the one the
+	/// swapchain was created for (`pshine_render_settings::present_mode`), and the one it uses.
+	uint32_t present_modes_supported;
+	enum pshine_present_mode requested_present_mode, present_mode;
+	/// Whether the device has `VK_KHR_present_id` and `VK_KHR_present_wait`, for
+	/// `pshine_render_settings::low_latency` and for measuring the input latency.
+	bool present_wait;
+	/// The last present's id, and the last one that is known to be on screen (or dropped).
+	uint64_t present_id, present_id_done;
+	/// When the current frame's input was read (`glfwGetTime`), and each pending present's, by id.
+	double frame_input_time;
+	double present_input_times[PRESENT_LATENCY_RING];
+	/// The time from reading the input to being on screen, of the last presents, see `update_input_latency`.
+	double input_latencies[INPUT_LATENCY_WINDOW];
+	uint32_t input_latency_count, next_input_latency;
+
+	/// This frame's ship draws, see `build_std_mesh_draws`.
+	size_t std_mesh_draw_count;
+	size_t std_mesh_draw_group_count;
+	struct std_mesh_draw_group *std_mesh_draw_groups_own;
+	/// Every part of the first `std_mesh_part_order_ship_count` ships, grouped by material,
+	/// see `update_std_mesh_part_order`.
+	size_t std_mesh_part_count, std_mesh_part_order_ship_count;
+	struct std_mesh_part_ref *std_mesh_part_order_own;
 
 	VkSampler direct_sampler;
 	VkSampler atmo_lut_sampler;
@@ -417,6 +711,76 @@ struct vulkan_renderer {
 	// PSHINE_DYNA_(struct mesh) meshes;
 
 	double lod_ranges[4];
+	/// Relative width of the band around each LOD range where the LOD is kept as is.
+	double lod_hysteresis;
+	/// Relative width of the range (above the hysteresis band) over which the mesh morphs to the coarser LOD.
+	double lod_morph_range;
+	/// Total number of LOD switches, for debugging the hysteresis.
+	size_t lod_switch_count;
+	/// Ship parts use the coarsest LOD whose simplification error is at most this many pixels on screen.
+	float mesh_lod_pixel_error;
+	struct pshine_mesh_lod_params mesh_lod_params;
+
+	/// Skip bodies and ships that are outside the view or behind a planet or star.
+	bool culling_enabled;
+	/// Render the atmospheres at `1 / PSHINE_ATMO_RESOLUTION_DIVISOR` resolution, accumulated over frames.
+	bool atmo_half_res;
+	/// The 3D passes render at this fraction of the swapchain's size (see `rg_pass_spec::scaled`), and
+	/// the tonemap upscales them. With `dynamic_resolution`, it's picked from the GPU time, see `update_render_scale`.
+	float render_scale;
+	bool dynamic_resolution;
+	/// The GPU time of a frame that `dynamic_resolution` aims for, in seconds, and the smallest scale it picks.
+	float target_gpu_time;
+	float min_render_scale;
+	/// The smoothed GPU time since the scale last changed, how many frames were measured since then,
+	/// and the last `pshine_gpu_perf::complete_frame_count` that was seen.
+	double render_gpu_time;
+	uint32_t render_gpu_time_samples;
+	uint64_t render_scale_seen_frames;
+	/// The drawn atmospheres' sky-view LUTs (a layer each) and aerial perspective volumes (a tile each),
+	/// at their index in the frame's batch (see `atmo_aerial_tile` in `atmo_common.glsl`).
+	/// Recomputed every frame, see `record_atmosphere_luts_pass`.
+	struct vulkan_image atmo_sky_view_luts, atmo_aerial_luts;
+	/// Atmospheres whose screen rectangle is smaller than this many pixels across aren't drawn.
+	float atmo_min_pixels;
+	/// Whether `render_pass_transients::atmo_history` has the last frame's atmosphere.
+	bool atmo_history_valid;
+	/// Which of `render_pass_transients::atmo_history` is this frame's.
+	uint32_t atmo_history_index;
+	/// The last frame's planet that the half-res atmosphere is reprojected relative to (the nearest
+	/// visible atmosphere's), the camera's position relative to it in SCS, and the camera's axes.
+	const struct pshine_celestial_body *atmo_prev_reference;
+	double3 atmo_prev_camera;
+	float4 atmo_prev_camera_right, atmo_prev_camera_up;
+	/// The last frame's `do_frame_stuff::render_extent`, the history is dropped when it changes.
+	VkExtent2D atmo_prev_extent;
+	/// This frame's culling counts.
+	struct pshine_cull_stats cull_stats;
+	/// The shadow cascades cover the view out to this many meters.
+	float shadow_distance;
+	/// Blends the cascades' splits from uniform (0) to logarithmic (1), see `pshine_shadow_splits`.
+	float shadow_split_lambda;
+	/// This frame's shadow caster draws in each cascade, see `build_std_mesh_draws`.
+	size_t shadow_draw_counts[PSHINE_SHADOW_CASCADE_COUNT];
+	/// The bounds of the ships (their indices in `shadow_caster_ships_own`), for culling them per cascade.
+	size_t shadow_caster_capacity;
+	struct pshine_cull_sphere *shadow_casters_own;
+	size_t *shadow_caster_ships_own;
+	bool *shadow_casts_own;
+	/// The cascades are rendered again once the light turns by this many degrees.
+	float shadow_light_threshold;
+	/// How much wider than needed the cascades are, so that they can be reused while the camera moves.
+	float shadow_cache_margin;
+	/// The light the cascades in the atlas were rendered with, and the cascades.
+	struct pshine_shadow_light shadow_cached_light;
+	struct shadow_cascade_cache shadow_caches[PSHINE_SHADOW_CASCADE_COUNT];
+	/// How many cascades were rendered this frame, the others were reused.
+	uint32_t shadow_cascades_rendered;
+	/// Scratch space for the visibility of the current system's bodies.
+	size_t body_visibility_capacity;
+	bool *body_visibility_own;
+	struct pshine_cull_sphere *cull_spheres_own;
+	struct pshine_cull_sphere *cull_occluders_own;
 
 	uint8_t *key_states;
 	uint8_t mouse_states[8];
@@ -461,6 +825,7 @@ static void init_swapchain(struct vulkan_renderer *r); static void deinit_swapch
 // static void init_rpasses(struct vulkan_renderer *r); static void deinit_rpasses(struct vulkan_renderer *r);
 static void add_pipelines_jobs(struct vulkan_renderer *r); static void deinit_pipelines(struct vulkan_renderer *r);
 static void init_transients(struct vulkan_renderer *r); static void deinit_transients(struct vulkan_renderer *r);
+static void init_atmo_view_luts(struct vulkan_renderer *r); static void deinit_atmo_view_luts(struct vulkan_renderer *r);
 static void init_rendergraph(struct vulkan_renderer *r); static void deinit_rendergraph(struct vulkan_renderer *r);
 // static void init_fbufs(struct vulkan_renderer *r); static void deinit_fbufs(struct vulkan_renderer *r);
 static void init_cmdbufs(struct vulkan_renderer *r); static void deinit_cmdbufs(struct vulkan_renderer *r);
@@ -469,9 +834,11 @@ static void init_descriptors(struct vulkan_renderer *r); static void deinit_desc
 static void init_frames(struct vulkan_renderer *r); static void deinit_frames(struct vulkan_renderer *r);
 static void init_game_data(struct vulkan_renderer *r); static void deinit_game_data(struct vulkan_renderer *r);
 static void init_imgui(struct vulkan_renderer *r); static void deinit_imgui(struct vulkan_renderer *r);
+static void init_record_threads(struct vulkan_renderer *r); static void deinit_record_threads(struct vulkan_renderer *r);
 
 static void init_atmo_lut_compute(struct vulkan_renderer *r, struct pshine_planet *planet);
-static void compute_atmo_lut(struct vulkan_renderer *r, struct pshine_planet *planet, bool first_time);
+static void compute_atmo_lut(struct vulkan_renderer *r, struct pshine_planet *planet, bool use_cache);
+static void finish_atmo_lut(struct vulkan_renderer *r, struct pshine_planet *planet);
 static void load_planet_texture(struct vulkan_renderer *r, struct pshine_planet *planet);
 
 static void deallocate_buffer(
@@ -490,6 +857,9 @@ struct vulkan_image_alloc_info {
 	VmaAllocationInfo *out_allocation_info;
 	VkImageViewCreateInfo *view_info;
 	VkSamplerCreateInfo *sampler_info; // optional
+	/// Only create the image, without memory or a view: the render graph places it in memory
+	/// shared with other images (see `bind_graph_images`).
+	bool placed;
 };
 
 static struct vulkan_image allocate_image(
@@ -498,6 +868,12 @@ static struct vulkan_image allocate_image(
 ) {
 	struct vulkan_image img = {};
 	info->image_info->sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	img.width = info->image_info->extent.width;
+	img.height = info->image_info->extent.height;
+	if (info->placed) {
+		CHECKVK(vkCreateImage(r->device, info->image_info, nullptr, &img.image));
+		return img;
+	}
 	CHECKVK(vmaCreateImage(
 		r->allocator,
 		info->image_info,
@@ -519,8 +895,6 @@ static struct vulkan_image allocate_image(
 	if (info->sampler_info != nullptr) {
 		info->sampler_info->sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
 	}
-	img.width = info->image_info->extent.width;
-	img.height = info->image_info->extent.height;
 	return img;
 }
 
@@ -585,6 +959,43 @@ static VkDeviceSize get_padded_uniform_buffer_size(struct vulkan_renderer *r, Vk
 	return align > 0 ? (original_size + align - 1) & ~(align - 1) : original_size;
 }
 
+/// The size of each frame's region of the uniform ring: everything `write_game_frame_data` pushes
+/// for the star system with the most bodies, which is the per-frame data plus each body's mesh,
+/// rings, atmosphere and material data.
+static VkDeviceSize get_uniform_ring_region_size(struct vulkan_renderer *r) {
+	size_t max_body_count = 0;
+	for (size_t i = 0; i < r->game->star_system_count; ++i)
+		if (r->game->star_systems_own[i].body_count > max_body_count)
+			max_body_count = r->game->star_systems_own[i].body_count;
+	VkDeviceSize frame_size = get_padded_uniform_buffer_size(r, sizeof(struct global_uniform_data))
+		+ get_padded_uniform_buffer_size(r, sizeof(struct std_material_uniform_data))
+		+ get_padded_uniform_buffer_size(r, sizeof(struct atmo_half_res_uniform_data));
+	VkDeviceSize body_size = get_padded_uniform_buffer_size(r, sizeof(struct planet_mesh_uniform_data))
+		+ get_padded_uniform_buffer_size(r, sizeof(struct rings_uniform_data))
+		+ get_padded_uniform_buffer_size(r, sizeof(struct atmo_uniform_data))
+		+ get_padded_uniform_buffer_size(r, sizeof(struct planet_material_uniform_data));
+	return frame_size + body_size * max_body_count;
+}
+
+/// Start sub-allocating from the region of frame `f`, whose previous contents the GPU is done with.
+static void begin_uniform_ring_frame(struct vulkan_renderer *r, const struct per_frame_data *f) {
+	r->data.uniform_ring.region_offset = r->data.uniform_ring.region_size * f->index;
+	r->data.uniform_ring.used = 0;
+}
+
+/// Copy `size` bytes into the current frame's region of the uniform ring, and return the
+/// dynamic offset to bind them with.
+static uint32_t push_uniform_data(struct vulkan_renderer *r, const void *data, size_t size) {
+	struct vulkan_uniform_ring *ring = &r->data.uniform_ring;
+	VkDeviceSize padded_size = get_padded_uniform_buffer_size(r, size);
+	PSHINE_CHECK(ring->used + padded_size <= ring->region_size, "uniform ring region is full (%zu bytes)",
+		(size_t)ring->region_size);
+	VkDeviceSize offset = ring->region_offset + ring->used;
+	memcpy(ring->mapped + offset, data, size);
+	ring->used += padded_size;
+	return (uint32_t)offset;
+}
+
 static void write_to_buffer_staged(
 	struct vulkan_renderer *r,
 	struct vulkan_buffer *buffer,
@@ -787,6 +1198,91 @@ static void destroy_mesh(struct vulkan_renderer *r, struct vulkan_mesh *mesh) {
 	//free(mesh);
 }
 
+/// Replace `buffer` with a `new_size` one, keeping its first `old_size` bytes.
+static void grow_device_buffer(
+	struct vulkan_renderer *r,
+	struct vulkan_buffer *buffer,
+	VkDeviceSize old_size,
+	VkDeviceSize new_size,
+	VkBufferUsageFlags usage
+) {
+	struct vulkan_buffer new_buffer = allocate_buffer(r, &(struct vulkan_buffer_alloc_info){
+		.size = new_size,
+		.buffer_usage = usage | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		.memory_usage = VMA_MEMORY_USAGE_AUTO,
+	});
+	if (old_size > 0) {
+		// the old buffer may still be used by frames in flight.
+		CHECKVK(vkDeviceWaitIdle(r->device));
+		VkCommandBuffer command_buffer;
+		CHECKVK(vkAllocateCommandBuffers(r->device, &(VkCommandBufferAllocateInfo){
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			.commandBufferCount = 1,
+			.commandPool = r->command_pool_transfer,
+			.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		}, &command_buffer));
+		CHECKVK(vkBeginCommandBuffer(command_buffer, &(VkCommandBufferBeginInfo){
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+			.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+		}));
+		vkCmdCopyBuffer(command_buffer, buffer->buffer, new_buffer.buffer, 1, &(VkBufferCopy){
+			.srcOffset = 0,
+			.dstOffset = 0,
+			.size = old_size,
+		});
+		CHECKVK(vkEndCommandBuffer(command_buffer));
+		vkQueueSubmit(r->queues[QUEUE_GRAPHICS], 1, &(VkSubmitInfo){
+			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+			.commandBufferCount = 1,
+			.pCommandBuffers = &command_buffer
+		}, VK_NULL_HANDLE);
+		vkQueueWaitIdle(r->queues[QUEUE_GRAPHICS]);
+		vkFreeCommandBuffers(r->device, r->command_pool_transfer, 1, &command_buffer);
+		deallocate_buffer(r, *buffer);
+	}
+	*buffer = new_buffer;
+}
+
+/// Append a static mesh to the arena, growing it if needed. Returns where its vertices and
+/// indices start (the indices stay relative to the mesh's first vertex).
+static void add_mesh_to_arena(
+	struct vulkan_renderer *r,
+	const struct pshine_mesh_data *mesh_data,
+	int32_t *out_vertex_offset,
+	uint32_t *out_first_index
+) {
+	struct vulkan_mesh_arena *arena = &r->mesh_arena;
+	PSHINE_CHECK(mesh_data->vertex_type == PSHINE_VERTEX_STATIC_MESH, "only static meshes go in the arena");
+	const size_t vertex_size = sizeof(struct pshine_static_mesh_vertex);
+
+	if (arena->vertex_count + mesh_data->vertex_count > arena->vertex_capacity) {
+		uint32_t new_capacity = arena->vertex_capacity == 0 ? 1 << 16 : arena->vertex_capacity;
+		while (new_capacity < arena->vertex_count + mesh_data->vertex_count) new_capacity *= 2;
+		grow_device_buffer(r, &arena->vertex_buffer, arena->vertex_count * vertex_size,
+			new_capacity * vertex_size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+		NAME_VK_OBJECT(r, arena->vertex_buffer.buffer, VK_OBJECT_TYPE_BUFFER, "mesh arena vertices");
+		arena->vertex_capacity = new_capacity;
+	}
+	if (arena->index_count + mesh_data->index_count > arena->index_capacity) {
+		uint32_t new_capacity = arena->index_capacity == 0 ? 1 << 18 : arena->index_capacity;
+		while (new_capacity < arena->index_count + mesh_data->index_count) new_capacity *= 2;
+		grow_device_buffer(r, &arena->index_buffer, arena->index_count * sizeof(uint32_t),
+			new_capacity * sizeof(uint32_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+		NAME_VK_OBJECT(r, arena->index_buffer.buffer, VK_OBJECT_TYPE_BUFFER, "mesh arena indices");
+		arena->index_capacity = new_capacity;
+	}
+
+	write_to_buffer_staged(r, &arena->vertex_buffer, arena->vertex_count * vertex_size,
+		mesh_data->vertex_count * vertex_size, mesh_data->vertices);
+	write_to_buffer_staged(r, &arena->index_buffer, arena->index_count * sizeof(uint32_t),
+		mesh_data->index_count * sizeof(uint32_t), mesh_data->indices);
+
+	*out_vertex_offset = (int32_t)arena->vertex_count;
+	*out_first_index = arena->index_count;
+	arena->vertex_count += mesh_data->vertex_count;
+	arena->index_count += mesh_data->index_count;
+}
+
 static inline void name_vk_object_impl(
 	struct vulkan_renderer *r,
 	uint64_t o,
@@ -1064,18 +1560,22 @@ static struct vulkan_image create_image(
 	return img;
 }
 
+/// Without a texture (`v` or its texture is null), the image is 1x1 with the bytes of `fallback`
+/// (R in the lowest byte).
 static struct vulkan_image create_image_from_cgltf_texture_view(
 	struct vulkan_renderer *r,
 	cgltf_texture_view *v,
 	int desired_channels,
-	VkFormat format
+	VkFormat format,
+	uint32_t fallback
 ) {
-	if (v == nullptr) {
+	if (v == nullptr || v->texture == nullptr) {
+		uint8_t pixel[4] = { fallback & 0xFF, (fallback >> 8) & 0xFF, (fallback >> 16) & 0xFF, fallback >> 24 };
 		struct vulkan_image img = create_image(r, &(struct vulkan_image_create_info){
-			.name = v->texture->name,
+			.name = "Default texture",
 			.size = (VkExtent2D){ .width = 1, .height = 1 },
 			.format = format,
-			.data = &(uint32_t){ 0 },
+			.data = pixel,
 			.data_size = 1 * desired_channels,
 		});
 		return img;
@@ -1126,166 +1626,84 @@ static void load_mesh_model_from_gltf(
 		.type = cgltf_file_type_glb,
 	}, data, fpath);
 
-	size_t total_primitive_count = 0;
-	for (size_t i = 0; i < data->meshes_count; ++i) {
-		total_primitive_count += data->meshes[i].primitives_count;
-	}
+	// the primitives are read and simplified in parallel, only the uploads happen here.
+	struct pshine_mesh_part *parts;
+	size_t part_count = pshine_load_gltf_mesh_parts(data, &r->mesh_lod_params, 0, &parts);
 
-	out->part_count = total_primitive_count;
-	out->parts_own = calloc(out->part_count, sizeof(*out->parts_own));
+	out->part_count = 0;
+	out->bounding_radius = 0.0;
+	out->parts_own = calloc(part_count, sizeof(*out->parts_own));
+	bool needs_default_material = false;
 	for (size_t i = 0, current_part = 0; i < data->meshes_count; ++i) {
 		cgltf_mesh *mesh = &data->meshes[i];
 		for (size_t j = 0; j < mesh->primitives_count; ++j, ++current_part) {
 			cgltf_primitive *prim = &mesh->primitives[j];
-
-			enum : size_t { bad_attrib = (size_t)-1 };
-			size_t position_attrib = bad_attrib;
-			size_t normal_attrib = bad_attrib;
-			size_t tangent_attrib = bad_attrib;
-			size_t texcoord_attrib = bad_attrib;
-			for (size_t k = 0; k < prim->attributes_count; ++k) {
-				switch (prim->attributes[k].type) {
-				case cgltf_attribute_type_position: position_attrib = k; break;
-				case cgltf_attribute_type_normal: normal_attrib = k; break;
-				case cgltf_attribute_type_tangent: tangent_attrib = k; break;
-				case cgltf_attribute_type_texcoord: texcoord_attrib = k; break;
-				default: break;
-				}
-			}
-			if (
-				position_attrib == bad_attrib ||
-				normal_attrib == bad_attrib ||
-				tangent_attrib == bad_attrib ||
-				texcoord_attrib == bad_attrib
-			) {
-				PSHINE_PANIC(
-					"Missing attributes in model\n"
-					"\tposition: %zu\n"
-					"\tnormal: %zu\n"
-					"\ttangent: %zu\n"
-					"\ttexcoord: %zu\n",
-					position_attrib, normal_attrib,
-					tangent_attrib, texcoord_attrib
-				);
-			}
-			cgltf_accessor *position_acc = prim->attributes[position_attrib].data;
-			PSHINE_CHECK(position_acc->type == cgltf_type_vec3,
-				"Expected position attribute to be of type vec3.");
-			PSHINE_CHECK(position_acc->component_type == cgltf_component_type_r_32f,
-				"Expected position attribute to be of floats.");
-
-			cgltf_accessor *normal_acc = prim->attributes[normal_attrib].data;
-			PSHINE_CHECK(normal_acc->type == cgltf_type_vec3,
-				"Expected normal attribute to be of type vec3.");
-			PSHINE_CHECK(normal_acc->component_type == cgltf_component_type_r_32f,
-				"Expected normal attribute to be of floats.");
-
-			cgltf_accessor *tangent_acc = prim->attributes[tangent_attrib].data;
-			PSHINE_CHECK(tangent_acc->type == cgltf_type_vec3 || tangent_acc->type == cgltf_type_vec4,
-				"Expected tangent attribute to be of type vec3 or vec4.");
-			PSHINE_CHECK(tangent_acc->component_type == cgltf_component_type_r_32f,
-				"Expected tangent attribute to be of floats.");
-
-			cgltf_accessor *texcoord_acc = prim->attributes[texcoord_attrib].data;
-			PSHINE_CHECK(texcoord_acc->type == cgltf_type_vec2,
-				"Expected texcoord attribute to be of type vec2.");
-			PSHINE_CHECK(texcoord_acc->component_type == cgltf_component_type_r_32f,
-				"Expected texcoord attribute to be of floats.");
-
-			size_t vertex_count = position_acc->count;
-			struct pshine_static_mesh_vertex *vertices = calloc(vertex_count, sizeof(*vertices));
-
-			uint8_t *position_data = position_acc->buffer_view->buffer->data;
-			position_data += position_acc->buffer_view->offset;
-			position_data += position_acc->offset;
-
-			uint8_t *normal_data = normal_acc->buffer_view->buffer->data;
-			normal_data += normal_acc->buffer_view->offset;
-			normal_data += normal_acc->offset;
-
-			uint8_t *tangent_data = tangent_acc->buffer_view->buffer->data;
-			tangent_data += tangent_acc->buffer_view->offset;
-			tangent_data += tangent_acc->offset;
-
-			uint8_t *texcoord_data = texcoord_acc->buffer_view->buffer->data;
-			texcoord_data += texcoord_acc->buffer_view->offset;
-			texcoord_data += texcoord_acc->offset;
-
-			for (size_t k = 0; k < vertex_count; ++k) {
-				*(float3*)vertices[k].position = *((float3*)(void*)position_data);
-				vertices[k].tangent_dia = encode_tangent(
-					*((float3*)(void*)normal_data),
-					*((float3*)(void*)tangent_data)
-				);
-				*(float2*)vertices[k].normal_oct = float32x3_to_oct(*((float3*)(void*)normal_data));
-				*(float2*)vertices[k].texcoord = *((float2*)(void*)texcoord_data);
-				position_data += position_acc->stride;
-				normal_data += normal_acc->stride;
-				tangent_data += tangent_acc->stride;
-				texcoord_data += texcoord_acc->stride;
+			const struct pshine_mesh_part *part = &parts[current_part];
+			if (part->mesh.index_count == 0) continue;
+			const struct pshine_mesh_lod_chain *lods = &part->lods;
+			PSHINE_DEBUG("model part %zu: %u LODs, %u -> %u triangles", current_part, lods->lod_count,
+				lods->lods[0].index_count / 3, lods->lods[lods->lod_count - 1].index_count / 3);
+
+			struct vulkan_mesh_model_part *out_part = &out->parts_own[out->part_count++];
+			if (prim->material == nullptr) {
+				// the default material goes after the model's own ones (if it has any).
+				PSHINE_WARN("model part %zu has no material, using the default one", current_part);
+				out_part->material_index = data->materials_count;
+				needs_default_material = true;
+			} else {
+				out_part->material_index = prim->material - data->materials;
 			}
 
-			size_t index_count = prim->indices->count;
-			uint32_t *indices = calloc(index_count, sizeof(*indices));
-
-			uint8_t *index_data = prim->indices->buffer_view->buffer->data;
-			index_data += prim->indices->buffer_view->offset;
-			index_data += prim->indices->offset;
-
-			switch (prim->indices->component_type) {
-				case cgltf_component_type_r_32u:
-					for (size_t k = 0; k < index_count; ++k) {
-						indices[k] = *(uint32_t*)(void*)index_data;
-						index_data += prim->indices->stride;
-					} break;
-				case cgltf_component_type_r_16:
-				case cgltf_component_type_r_16u:
-					for (size_t k = 0; k < index_count; ++k) {
-						indices[k] = (uint32_t)*(uint16_t*)(void*)index_data;
-						index_data += prim->indices->stride;
-					} break;
-				case cgltf_component_type_r_8:
-				case cgltf_component_type_r_8u:
-					for (size_t k = 0; k < index_count; ++k) {
-						indices[k] = (uint32_t)*(uint8_t*)(void*)index_data;
-						index_data += prim->indices->stride;
-					} break;
-				default: PSHINE_PANIC("Bad index accessor component type, expected integers.");
-			}
+			out_part->lod_count = lods->lod_count;
+			memcpy(out_part->lods, lods->lods, sizeof(lods->lods));
 
-			out->parts_own[current_part].material_index = prim->material - data->materials;
+			const struct pshine_static_mesh_vertex *vertices = part->mesh.vertices;
+			for (uint32_t k = 0; k < part->mesh.vertex_count; ++k) {
+				double distance = double3mag(double3_float3(float3vs(vertices[k].position)));
+				out->bounding_radius = fmax(out->bounding_radius, distance);
+			}
 
-			create_mesh(r, &(struct pshine_mesh_data){
+			add_mesh_to_arena(r, &(struct pshine_mesh_data){
 				.vertex_type = PSHINE_VERTEX_STATIC_MESH,
-				.vertex_count = vertex_count,
-				.vertices = vertices,
-				.index_count = index_count,
-				.indices = indices,
-			}, &out->parts_own[current_part].mesh);
+				.vertex_count = part->mesh.vertex_count,
+				.vertices = part->mesh.vertices,
+				.index_count = lods->index_count,
+				.indices = lods->indices_own,
+			}, &out_part->vertex_offset, &out_part->first_index);
 		}
 	}
+	pshine_free_mesh_parts(part_count, parts);
 
 	out->transform = double4x4_float4x4(*(float4x4*)data->nodes[0].matrix);
 
-	out->material_count = data->materials_count;
+	out->material_count = data->materials_count + (needs_default_material ? 1 : 0);
 	out->materials_own = calloc(out->material_count, sizeof(*out->materials_own));
-	for (size_t i = 0; i < data->materials_count; ++i) {
-		out->materials_own[i].images.normal
-			= create_image_from_cgltf_texture_view(r, &data->materials[i].normal_texture, 4, VK_FORMAT_R8G8B8A8_UNORM);
+	for (size_t i = 0; i < out->material_count; ++i) {
+		// the default material (without textures) is white, flat, rough and not metallic.
+		cgltf_material *material = i < data->materials_count ? &data->materials[i] : nullptr;
+		out->materials_own[i].images.normal = create_image_from_cgltf_texture_view(r,
+			material != nullptr ? &material->normal_texture : nullptr, 4, VK_FORMAT_R8G8B8A8_UNORM, 0xFFFF8080);
 		out->materials_own[i].images.emissive
 		// 	= load_texture_from_file(r, "data/textures/1x1_black.png", VK_FORMAT_R8G8B8A8_UNORM, 4, 1, 0);
-			= create_image_from_cgltf_texture_view(r, &data->materials[i].emissive_texture, 4, VK_FORMAT_R8G8B8A8_UNORM);
-		out->materials_own[i].images.diffuse
 			= create_image_from_cgltf_texture_view(r,
-					&data->materials[i].pbr_metallic_roughness.base_color_texture, 4, VK_FORMAT_R8G8B8A8_SRGB);
+				material != nullptr ? &material->emissive_texture : nullptr, 4, VK_FORMAT_R8G8B8A8_UNORM, 0xFF000000);
+		out->materials_own[i].images.diffuse = create_image_from_cgltf_texture_view(r,
+			material != nullptr ? &material->pbr_metallic_roughness.base_color_texture : nullptr,
+			4, VK_FORMAT_R8G8B8A8_SRGB, 0xFFFFFFFF);
 		NAME_VK_OBJECT(r, out->materials_own[i].images.diffuse.image, VK_OBJECT_TYPE_IMAGE, "Diffuse for %s", fpath);
 		NAME_VK_OBJECT(r, out->materials_own[i].images.emissive.image, VK_OBJECT_TYPE_IMAGE, "Emissive for %s", fpath);
 		NAME_VK_OBJECT(r, out->materials_own[i].images.normal.image, VK_OBJECT_TYPE_IMAGE, "Normal for %s", fpath);
 
 		// Combine the occlusion (R) and metallic+roughness (GB) textures into one.
-		{
-			cgltf_texture_view *occlusion = &data->materials[i].occlusion_texture;
-			cgltf_texture_view *metallic_roughness = &data->materials[i].pbr_metallic_roughness.metallic_roughness_texture;
+		if (material == nullptr || material->pbr_metallic_roughness.metallic_roughness_texture.texture == nullptr) {
+			// no occlusion, roughness 0.8, not metallic.
+			out->materials_own[i].images.ao_metallic_roughness
+				= create_image_from_cgltf_texture_view(r, nullptr, 4, VK_FORMAT_R8G8B8A8_UNORM, 0xFF00CCFF);
+			NAME_VK_OBJECT(r, out->materials_own[i].images.ao_metallic_roughness.image, VK_OBJECT_TYPE_IMAGE,
+				"Occlusion+Metallic+Roughness for %s", fpath);
+		} else {
+			cgltf_texture_view *occlusion = &material->occlusion_texture;
+			cgltf_texture_view *metallic_roughness = &material->pbr_metallic_roughness.metallic_roughness_texture;
 			cgltf_buffer_view *buf_gb = metallic_roughness->texture->image->buffer_view;
 			int width, height, channels;
 
@@ -1326,16 +1744,6 @@ static void load_mesh_model_from_gltf(
 			stbi_image_free(data_rgb);
 		}
 
-		out->materials_own[i].uniform_buffer = allocate_buffer(r, &(struct vulkan_buffer_alloc_info){
-			.size = get_padded_uniform_buffer_size(r, sizeof(struct std_mesh_uniform_data)) * FRAMES_IN_FLIGHT,
-			.buffer_usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			.required_memory_property_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-			.allocation_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
-			.memory_usage = VMA_MEMORY_USAGE_AUTO,
-		});
-		NAME_VK_OBJECT(r, out->materials_own[i].uniform_buffer.buffer, VK_OBJECT_TYPE_BUFFER,
-			"Material UB #%zu for %s", i, fpath);
-
 		CHECKVK(vkAllocateDescriptorSets(r->device, &(VkDescriptorSetAllocateInfo){
 			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
 			.descriptorPool = r->descriptors.pool,
@@ -1354,7 +1762,7 @@ static void load_mesh_model_from_gltf(
 				.dstArrayElement = 0,
 				.dstBinding = 0,
 				.pBufferInfo = &(VkDescriptorBufferInfo){
-					.buffer = out->materials_own[i].uniform_buffer.buffer,
+					.buffer = r->data.uniform_ring.buffer.buffer,
 					.offset = 0,
 					.range = sizeof(struct std_material_uniform_data),
 				},
@@ -1420,7 +1828,7 @@ static void load_mesh_model_from_gltf(
 				.dstBinding = 5,
 				.pImageInfo = &(VkDescriptorImageInfo){
 					.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-					.imageView = r->transients.shadow[0].view,
+					.imageView = r->transients.shadow.view,
 					.sampler = r->material_texture_sampler,
 				},
 			},
@@ -1437,37 +1845,6 @@ static void load_mesh_model_from_gltf(
 static void init_ship(struct vulkan_renderer *r, struct pshine_ship *ship) {
 	ship->graphics_data = calloc(1, sizeof(*ship->graphics_data));
 	load_mesh_model_from_gltf(r, ship->model_file_own, &ship->graphics_data->model);
-
-	ship->graphics_data->uniform_buffer = allocate_buffer(r, &(struct vulkan_buffer_alloc_info){
-		.size = get_padded_uniform_buffer_size(r, sizeof(struct std_mesh_uniform_data)) * FRAMES_IN_FLIGHT,
-		.buffer_usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-		.required_memory_property_flags = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		.allocation_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
-		.memory_usage = VMA_MEMORY_USAGE_AUTO,
-	});
-	NAME_VK_OBJECT(r, ship->graphics_data->uniform_buffer.buffer, VK_OBJECT_TYPE_BUFFER, "static mesh ub");
-
-	CHECKVK(vkAllocateDescriptorSets(r->device, &(VkDescriptorSetAllocateInfo){
-		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-		.descriptorPool = r->descriptors.pool,
-		.descriptorSetCount = 1,
-		.pSetLayouts = &r->descriptors.std_mesh_layout,
-	}, &ship->graphics_data->descriptor_set));
-	vkUpdateDescriptorSets(r->device, 1, (VkWriteDescriptorSet[1]){
-		(VkWriteDescriptorSet){
-			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-			.descriptorCount = 1,
-			.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
-			.dstBinding = 0,
-			.dstArrayElement = 0,
-			.dstSet = ship->graphics_data->descriptor_set,
-			.pBufferInfo = &(VkDescriptorBufferInfo){
-				.buffer = ship->graphics_data->uniform_buffer.buffer,
-				.offset = 0,
-				.range = sizeof(struct std_mesh_uniform_data),
-			}
-		},
-	}, 0, nullptr);
 }
 
 static void init_star_system(struct vulkan_renderer *r, struct pshine_star_system *system) {
@@ -1494,21 +1871,27 @@ static void init_star_system(struct vulkan_renderer *r, struct pshine_star_syste
 				.pSetLayouts = &r->descriptors.planet_material_layout,
 			}, &p->graphics_data->material_descriptor_set));
 
-			// Atmosphere descriptors
+			// Atmosphere LUT compute shader descriptors
 			CHECKVK(vkAllocateDescriptorSets(r->device, &(VkDescriptorSetAllocateInfo){
 				.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
 				.descriptorPool = r->descriptors.pool,
-				.descriptorSetCount = 1,
-				.pSetLayouts = &r->descriptors.atmo_layout,
-			}, &p->graphics_data->atmo_descriptor_set));
+				.descriptorSetCount = 2,
+				.pSetLayouts = (VkDescriptorSetLayout[]){
+					r->descriptors.atmo_lut_layout,
+					r->descriptors.atmo_lut_layout,
+				},
+			}, p->graphics_data->atmo_lut_descriptor_sets));
 
-			// Atmosphere LUT compute shader descriptors
+			// Atmosphere sky-view and aerial perspective compute shader descriptors
 			CHECKVK(vkAllocateDescriptorSets(r->device, &(VkDescriptorSetAllocateInfo){
 				.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
 				.descriptorPool = r->descriptors.pool,
-				.descriptorSetCount = 1,
-				.pSetLayouts = &r->descriptors.atmo_lut_layout,
-			}, &p->graphics_data->atmo_lut_descriptor_set));
+				.descriptorSetCount = 2,
+				.pSetLayouts = (VkDescriptorSetLayout[]){
+					r->descriptors.atmo_view_lut_layout,
+					r->descriptors.atmo_view_lut_layout,
+				},
+			}, p->graphics_data->atmo_view_lut_descriptor_sets));
 
 			if (b->rings.has_rings) {
 				// Rings shader descriptors
@@ -1520,40 +1903,12 @@ static void init_star_system(struct vulkan_renderer *r, struct pshine_star_syste
 				}, &p->graphics_data->rings_descriptor_set));
 			}
 
-			struct vulkan_buffer_alloc_info common_alloc_info = {
-				.size = 0,
-				.buffer_usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-				.required_memory_property_flags = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-				.allocation_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
-				.memory_usage = VMA_MEMORY_USAGE_AUTO,
-			};
-
-			common_alloc_info.size = get_padded_uniform_buffer_size(r,
-				sizeof(struct planet_mesh_uniform_data)) * FRAMES_IN_FLIGHT;
-			p->graphics_data->uniform_buffer = allocate_buffer(r, &common_alloc_info);
-			NAME_VK_OBJECT(r, p->graphics_data->uniform_buffer.buffer, VK_OBJECT_TYPE_BUFFER, "planet mesh ub");
-
-			common_alloc_info.size = get_padded_uniform_buffer_size(r, sizeof(struct atmo_uniform_data)) * FRAMES_IN_FLIGHT;
-			p->graphics_data->atmo_uniform_buffer = allocate_buffer(r, &common_alloc_info);
-			NAME_VK_OBJECT(r, p->graphics_data->atmo_uniform_buffer.buffer, VK_OBJECT_TYPE_BUFFER, "atmo ub");
-
-			common_alloc_info.size = get_padded_uniform_buffer_size(r, sizeof(struct planet_material_uniform_data)) * FRAMES_IN_FLIGHT;
-			p->graphics_data->material_uniform_buffer = allocate_buffer(r, &common_alloc_info);
-			NAME_VK_OBJECT(r, p->graphics_data->material_uniform_buffer.buffer, VK_OBJECT_TYPE_BUFFER, "material ub");
-
-			if (b->rings.has_rings) {
-				common_alloc_info.size = get_padded_uniform_buffer_size(r,
-					sizeof(struct rings_uniform_data)) * FRAMES_IN_FLIGHT;
-				p->graphics_data->rings_uniform_buffer = allocate_buffer(r, &common_alloc_info);
-				NAME_VK_OBJECT(r, p->graphics_data->rings_uniform_buffer.buffer, VK_OBJECT_TYPE_BUFFER, "rings ub");
-			}
-
 			load_planet_texture(r, p);
 			init_atmo_lut_compute(r, p);
 
-			// TODO: Storage buffer with all mesh data and another with all atmosphere data.
+			// TODO: Storage buffer with all mesh data.
 
-			vkUpdateDescriptorSets(r->device, 11, (VkWriteDescriptorSet[11]){
+			vkUpdateDescriptorSets(r->device, 6, (VkWriteDescriptorSet[6]){
 				(VkWriteDescriptorSet){
 					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
 					.descriptorCount = 1,
@@ -1562,7 +1917,7 @@ static void init_star_system(struct vulkan_renderer *r, struct pshine_star_syste
 					.dstBinding = 0,
 					.dstArrayElement = 0,
 					.pBufferInfo = &(VkDescriptorBufferInfo){
-						.buffer = p->graphics_data->uniform_buffer.buffer,
+						.buffer = r->data.uniform_ring.buffer.buffer,
 						.offset = 0,
 						.range = sizeof(struct planet_mesh_uniform_data),
 					}
@@ -1580,19 +1935,6 @@ static void init_star_system(struct vulkan_renderer *r, struct pshine_star_syste
 						.sampler = r->material_texture_sampler,
 					},
 				},
-				(VkWriteDescriptorSet){
-					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-					.descriptorCount = 1,
-					.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
-					.dstSet = p->graphics_data->atmo_descriptor_set,
-					.dstBinding = 0,
-					.dstArrayElement = 0,
-					.pBufferInfo = &(VkDescriptorBufferInfo){
-						.buffer = p->graphics_data->atmo_uniform_buffer.buffer,
-						.offset = 0,
-						.range = sizeof(struct atmo_uniform_data),
-					}
-				},
 				(VkWriteDescriptorSet){
 					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
 					.descriptorCount = 1,
@@ -1601,24 +1943,11 @@ static void init_star_system(struct vulkan_renderer *r, struct pshine_star_syste
 					.dstBinding = 0,
 					.dstArrayElement = 0,
 					.pBufferInfo = &(VkDescriptorBufferInfo){
-						.buffer = p->graphics_data->material_uniform_buffer.buffer,
+						.buffer = r->data.uniform_ring.buffer.buffer,
 						.offset = 0,
 						.range = sizeof(struct planet_material_uniform_data),
 					}
 				},
-				(VkWriteDescriptorSet){
-					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-					.descriptorCount = 1,
-					.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-					.dstSet = p->graphics_data->atmo_descriptor_set,
-					.dstBinding = 3,
-					.dstArrayElement = 0,
-					.pImageInfo = &(VkDescriptorImageInfo){
-						.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-						.imageView = p->graphics_data->atmo_lut.view,
-						.sampler = r->atmo_lut_sampler,
-					},
-				},
 				(VkWriteDescriptorSet){
 					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
 					.descriptorCount = 1,
@@ -1658,45 +1987,6 @@ static void init_star_system(struct vulkan_renderer *r, struct pshine_star_syste
 						.sampler = r->material_texture_sampler,
 					},
 				},
-				(VkWriteDescriptorSet){
-					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-					.descriptorCount = 1,
-					.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,
-					.dstSet = p->graphics_data->atmo_descriptor_set,
-					.dstBinding = 1,
-					.dstArrayElement = 0,
-					.pImageInfo = &(VkDescriptorImageInfo){
-						.imageLayout = VK_IMAGE_LAYOUT_RENDERING_LOCAL_READ,
-						.imageView = r->transients.color_0.view,
-						.sampler = VK_NULL_HANDLE,
-					}
-				},
-				(VkWriteDescriptorSet){
-					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-					.descriptorCount = 1,
-					.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,
-					.dstSet = p->graphics_data->atmo_descriptor_set,
-					.dstBinding = 2,
-					.dstArrayElement = 0,
-					.pImageInfo = &(VkDescriptorImageInfo){
-						.imageLayout = VK_IMAGE_LAYOUT_RENDERING_LOCAL_READ,
-						.imageView = r->depth_image.view,
-						.sampler = VK_NULL_HANDLE
-					}
-				},
-				(VkWriteDescriptorSet){
-					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-					.descriptorCount = 1,
-					.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,
-					.dstSet = p->graphics_data->atmo_descriptor_set,
-					.dstBinding = 4,
-					.dstArrayElement = 0,
-					.pImageInfo = &(VkDescriptorImageInfo){
-						.imageLayout = VK_IMAGE_LAYOUT_RENDERING_LOCAL_READ,
-						.imageView = r->transients.gbuffer[GBUFFER_IMAGE_DIFFUSE_O].image.view,
-						.sampler = VK_NULL_HANDLE
-					}
-				},
 			}, 0, nullptr);
 
 			if (b->rings.has_rings) {
@@ -1709,7 +1999,7 @@ static void init_star_system(struct vulkan_renderer *r, struct pshine_star_syste
 						.dstBinding = 0,
 						.dstArrayElement = 0,
 						.pBufferInfo = &(VkDescriptorBufferInfo){
-							.buffer = p->graphics_data->rings_uniform_buffer.buffer,
+							.buffer = r->data.uniform_ring.buffer.buffer,
 							.offset = 0,
 							.range = sizeof(struct rings_uniform_data),
 						}
@@ -1734,16 +2024,6 @@ static void init_star_system(struct vulkan_renderer *r, struct pshine_star_syste
 		} else if (b->type == PSHINE_CELESTIAL_BODY_STAR) {
 			struct pshine_star *p = (void *)b;
 			p->graphics_data = calloc(1, sizeof(struct pshine_star_graphics_data));
-			p->graphics_data->uniform_buffer = allocate_buffer(
-				r,
-				&(struct vulkan_buffer_alloc_info){
-					.size = get_padded_uniform_buffer_size(r, sizeof(struct planet_mesh_uniform_data)) * FRAMES_IN_FLIGHT,
-					.buffer_usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-					.required_memory_property_flags = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-					.allocation_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
-					.memory_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
-				}
-			);
 			CHECKVK(vkAllocateDescriptorSets(r->device, &(VkDescriptorSetAllocateInfo){
 				.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
 				.descriptorPool = r->descriptors.pool,
@@ -1759,7 +2039,7 @@ static void init_star_system(struct vulkan_renderer *r, struct pshine_star_syste
 					.dstBinding = 0,
 					.dstArrayElement = 0,
 					.pBufferInfo = &(VkDescriptorBufferInfo){
-						.buffer = p->graphics_data->uniform_buffer.buffer,
+						.buffer = r->data.uniform_ring.buffer.buffer,
 						.offset = 0,
 						.range = sizeof(struct planet_mesh_uniform_data)
 					}
@@ -1783,6 +2063,7 @@ static void init_star_system(struct vulkan_renderer *r, struct pshine_star_syste
 }
 
 static void init_transients_job(struct pshine_job *job) { init_transients(job->user); }
+static void init_atmo_view_luts_job(struct pshine_job *job) { init_atmo_view_luts(job->user); }
 static void init_rendergraph_job(struct pshine_job *job) { init_rendergraph(job->user); }
 static void init_descriptors_job(struct pshine_job *job) { init_descriptors(job->user); }
 static void init_game_data_job(struct pshine_job *job) { init_game_data(job->user); }
@@ -1792,10 +2073,17 @@ static void init_star_system_job(struct pshine_job *job) {
 	init_star_system(r, &r->game->star_systems_own[job->id]);
 }
 
+/// Ships are initialized in batches, a loading screen frame per ship would take longer than the ships themselves.
+enum : size_t { SHIP_INIT_BATCH_SIZE = 256 };
+
 static void init_ship_job(struct pshine_job *job) {
 	struct vulkan_renderer *r = job->user;
-	if (r->game->ships.ptr[job->id]._alive_marker != (size_t)-1) return;
-	init_ship(r, &r->game->ships.ptr[job->id]);
+	size_t end = job->id + SHIP_INIT_BATCH_SIZE;
+	if (end > r->game->ships.dyna.count) end = r->game->ships.dyna.count;
+	for (size_t i = job->id; i < end; ++i) {
+		if (r->game->ships.ptr[i]._alive_marker != (size_t)-1) continue;
+		init_ship(r, &r->game->ships.ptr[i]);
+	}
 }
 
 static void init_skybox_job(struct pshine_job *job) {
@@ -1862,8 +2150,28 @@ void pshine_init_renderer(struct pshine_renderer *renderer, struct pshine_game *
 	r->lod_ranges[1] = 25'000.0;
 	r->lod_ranges[2] = 1'500.0;
 	r->lod_ranges[3] = 290.0;
+	r->lod_hysteresis = 0.1;
+	r->lod_morph_range = 0.25;
+	r->mesh_lod_pixel_error = 1.0f;
+	r->mesh_lod_params = PSHINE_DEFAULT_MESH_LOD_PARAMS;
+	r->culling_enabled = true;
+	r->atmo_half_res = true;
+	r->atmo_min_pixels = 2.0f;
+	r->render_scale = 1.0f;
+	r->target_gpu_time = 1.0f / 60.0f;
+	r->min_render_scale = 0.5f;
+	r->shadow_distance = 2'000.0f;
+	r->shadow_split_lambda = 0.75f;
+	r->shadow_light_threshold = 0.05f;
+	r->shadow_cache_margin = 0.2f;
+	r->record_thread_count = pshine_get_cpu_count();
+	if (r->record_thread_count > RECORD_THREAD_COUNT_MAX) r->record_thread_count = RECORD_THREAD_COUNT_MAX;
 
 	r->opt_bloom = true;
+	if (r->as_base.settings.frames_in_flight < 1) r->as_base.settings.frames_in_flight = 1;
+	if (r->as_base.settings.frames_in_flight > PSHINE_MAX_FRAMES_IN_FLIGHT)
+		r->as_base.settings.frames_in_flight = PSHINE_MAX_FRAMES_IN_FLIGHT;
+	r->frames_in_flight = r->as_base.settings.frames_in_flight;
 
 	init_glfw(r);
 	init_vulkan(r);
@@ -1877,6 +2185,14 @@ void pshine_init_renderer(struct pshine_renderer *renderer, struct pshine_game *
 			.callback = &init_transients_job,
 		};
 	}
+	{
+		size_t idx = PSHINE_DYNA_ALLOC(r->game->jobs);
+		r->game->jobs.ptr[idx] = (struct pshine_job){
+			.name_own = pshine_strdup("Atmosphere view LUTs"),
+			.user = r,
+			.callback = &init_atmo_view_luts_job,
+		};
+	}
 	{
 		size_t idx = PSHINE_DYNA_ALLOC(r->game->jobs);
 		r->game->jobs.ptr[idx] = (struct pshine_job){
@@ -1905,6 +2221,7 @@ void pshine_init_renderer(struct pshine_renderer *renderer, struct pshine_game *
 	init_sync(r);
 	init_frames(r);
 	init_imgui(r);
+	init_record_threads(r);
 
 	{
 		VkPhysicalDeviceFeatures features = {};
@@ -1937,10 +2254,11 @@ void pshine_init_renderer(struct pshine_renderer *renderer, struct pshine_game *
 		};
 	}
 
-	for (size_t i = 0; i < r->game->ships.dyna.count; ++i) {
+	for (size_t i = 0; i < r->game->ships.dyna.count; i += SHIP_INIT_BATCH_SIZE) {
 		size_t idx = PSHINE_DYNA_ALLOC(r->game->jobs);
 		r->game->jobs.ptr[idx] = (struct pshine_job){
-			.name_own = pshine_format_string("Ship #%zu graphics", i + 1),
+			.name_own = pshine_format_string("Ships #%zu-#%zu graphics", i + 1,
+				i + SHIP_INIT_BATCH_SIZE < r->game->ships.dyna.count ? i + SHIP_INIT_BATCH_SIZE : r->game->ships.dyna.count),
 			.user = r,
 			.id = i,
 			.callback = &init_ship_job,
@@ -1957,66 +2275,34 @@ void pshine_init_renderer(struct pshine_renderer *renderer, struct pshine_game *
 	}
 }
 
-static const VkExtent2D atmo_lut_extent = { 1024, 1024 };
+static const VkExtent2D atmo_lut_extent = { PSHINE_ATMO_TRANSMITTANCE_LUT_SIZE, PSHINE_ATMO_TRANSMITTANCE_LUT_SIZE };
 static const VkFormat atmo_lut_format = VK_FORMAT_R32G32_SFLOAT;
+/// The format of the multiple scattering, sky-view and aerial perspective LUTs.
+static const VkFormat atmo_view_lut_format = VK_FORMAT_R16G16B16A16_SFLOAT;
+
+/// Bumped when the transmittance or multiple scattering shaders change, so the cached LUTs are recomputed.
+enum : uint32_t { ATMO_LUT_CACHE_VERSION = 1 };
+
+/// A cached LUT file is this, then the transmittance and multiple scattering LUTs' texels.
+struct atmo_lut_cache_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t _pad;
+	uint64_t hash;
+};
 
-static void compute_atmo_lut(struct vulkan_renderer *r, struct pshine_planet *planet, bool first_time) {
-	VkCommandBuffer cmdbuf = planet->graphics_data->compute_cmdbuf;
-
-	// We could do better sync here, but there's not much point in doing that since we only compute the LUTs once.
-	CHECKVK(vkQueueWaitIdle(r->queues[QUEUE_GRAPHICS]));
-
-	// handle multiple calls to this function, although we shouldn't get them.
-	CHECKVK(vkQueueWaitIdle(r->queues[QUEUE_COMPUTE]));
-
-	CHECKVK(vkResetCommandBuffer(cmdbuf, 0));
-	CHECKVK(vkBeginCommandBuffer(cmdbuf, &(VkCommandBufferBeginInfo){
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-		.flags = 0,
-	}));
-
-	// if (r->queue_families[QUEUE_COMPUTE] == r->queue_families[QUEUE_GRAPHICS]) {
-	vkCmdPipelineBarrier(
-		cmdbuf,
-		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-		0, 0, nullptr, 0, nullptr, 1, &(VkImageMemoryBarrier){
-			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-			.image = planet->graphics_data->atmo_lut.image,
-			.srcAccessMask = 0, // VK_ACCESS_SHADER_READ_BIT,
-			.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
-			.oldLayout = first_time
-				? VK_IMAGE_LAYOUT_UNDEFINED
-				: VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-			.newLayout = VK_IMAGE_LAYOUT_GENERAL,
-			.srcQueueFamilyIndex = r->queue_families[QUEUE_COMPUTE],
-			.dstQueueFamilyIndex = r->queue_families[QUEUE_COMPUTE],
-			.subresourceRange = {
-				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-				.baseArrayLayer = 0,
-				.baseMipLevel = 0,
-				.layerCount = 1,
-				.levelCount = 1,
-			}
-		}
-	);
-	// }
-
-	vkCmdBindDescriptorSets(
-		cmdbuf,
-		VK_PIPELINE_BIND_POINT_COMPUTE,
-		r->pipelines.atmo_lut_layout,
-		0, 1,
-		&planet->graphics_data->atmo_lut_descriptor_set,
-		0, nullptr
-	);
-	vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE, r->pipelines.atmo_lut_pipeline);
+static const VkDeviceSize atmo_lut_size = (VkDeviceSize)PSHINE_ATMO_TRANSMITTANCE_LUT_SIZE
+	* PSHINE_ATMO_TRANSMITTANCE_LUT_SIZE * sizeof(float[2]);
+static const VkDeviceSize atmo_multiscatter_lut_size = (VkDeviceSize)PSHINE_ATMO_MULTISCATTER_LUT_SIZE
+	* PSHINE_ATMO_MULTISCATTER_LUT_SIZE * sizeof(uint16_t[4]);
 
+static struct atmo_lut_push_const_data get_atmo_lut_push_consts(const struct pshine_planet *planet) {
 	double scs_atmo_h = SCSd_WCSd(planet->atmosphere.height);
 	double scs_body_r = SCSd_WCSd(planet->as_body.radius);
 	double scs_body_r_scaled = scs_body_r / (scs_body_r + scs_atmo_h);
-
-	struct atmo_lut_push_const_data data = {
+	return (struct atmo_lut_push_const_data){
+		.coefs_ray = float4xyz3w(float3vs(planet->atmosphere.rayleigh_coefs), 0.0f),
+		.coefs_mie = float4xyzw(planet->atmosphere.mie_coef, planet->atmosphere.mie_ext_coef, 0.0f, 0.0f),
 		.planet_radius = scs_body_r_scaled,
 		.atmo_height = 1.0f - scs_body_r_scaled,
 		.falloffs = float2xy(
@@ -2025,25 +2311,122 @@ static void compute_atmo_lut(struct vulkan_renderer *r, struct pshine_planet *pl
 		),
 		.samples = 4096,
 	};
+}
+
+/// FNV-1a of everything the LUTs are computed from: the push constants (which have no padding),
+/// the LUTs' sizes and formats, and `ATMO_LUT_CACHE_VERSION`.
+static uint64_t hash_atmo_lut(const struct atmo_lut_push_const_data *data) {
+	uint32_t layout[] = {
+		ATMO_LUT_CACHE_VERSION,
+		PSHINE_ATMO_TRANSMITTANCE_LUT_SIZE, atmo_lut_format,
+		PSHINE_ATMO_MULTISCATTER_LUT_SIZE, atmo_view_lut_format,
+	};
+	uint64_t hash = 0xcbf2'9ce4'8422'2325;
+	for (size_t i = 0; i < sizeof(*data); ++i) hash = (hash ^ ((const uint8_t *)data)[i]) * 0x100'0000'01b3;
+	for (size_t i = 0; i < sizeof(layout); ++i) hash = (hash ^ ((const uint8_t *)layout)[i]) * 0x100'0000'01b3;
+	return hash;
+}
 
-	vkCmdPushConstants(cmdbuf, r->pipelines.atmo_lut_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
-		sizeof(struct atmo_lut_push_const_data), &data);
+static void get_atmo_lut_cache_path(uint64_t hash, char path[static 64]) {
+	snprintf(path, 64, CACHE_PATH "/atmo_lut_%016llx.bin", (unsigned long long)hash);
+}
 
-	vkCmdDispatch(cmdbuf, atmo_lut_extent.width / 16, atmo_lut_extent.height / 16, 1);
+/// Read the cached LUTs with `hash` into `texels`. False if there are none, or they're from another version.
+static bool read_atmo_lut_cache(uint64_t hash, void *texels) {
+	char path[64];
+	get_atmo_lut_cache_path(hash, path);
+	FILE *fin = fopen(path, "rb");
+	if (fin == nullptr) return false;
+	struct atmo_lut_cache_header header;
+	bool ok = fread(&header, sizeof(header), 1, fin) == 1
+		&& memcmp(header.magic, "PSATMLUT", 8) == 0
+		&& header.version == ATMO_LUT_CACHE_VERSION
+		&& header.hash == hash
+		&& fread(texels, atmo_lut_size + atmo_multiscatter_lut_size, 1, fin) == 1;
+	fclose(fin);
+	if (!ok) PSHINE_WARN("ignoring the invalid atmosphere LUT cache '%s'", path);
+	return ok;
+}
 
-	vkCmdPipelineBarrier(
-		cmdbuf,
-		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-		VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-		0, 0, nullptr, 0, nullptr, 1, &(VkImageMemoryBarrier){
+static void write_atmo_lut_cache(uint64_t hash, const void *texels) {
+	char path[64];
+	get_atmo_lut_cache_path(hash, path);
+	FILE *fout = fopen(path, "wb");
+	if (fout == nullptr) {
+		PSHINE_WARN("could not write the atmosphere LUT cache '%s'", path);
+		return;
+	}
+	struct atmo_lut_cache_header header = { .version = ATMO_LUT_CACHE_VERSION, .hash = hash };
+	memcpy(header.magic, "PSATMLUT", 8);
+	bool ok = fwrite(&header, sizeof(header), 1, fout) == 1
+		&& fwrite(texels, atmo_lut_size + atmo_multiscatter_lut_size, 1, fout) == 1;
+	if (fclose(fout) != 0 || !ok) {
+		PSHINE_WARN("could not write the atmosphere LUT cache '%s'", path);
+		remove(path);
+	}
+}
+
+/// Whether no frame in flight reads the planet's LUTs that aren't `atmo_lut_current` anymore.
+static bool atmo_lut_back_free(struct vulkan_renderer *r, const struct pshine_planet_graphics_data *g) {
+	uint64_t value;
+	CHECKVK(vkGetSemaphoreCounterValue(r->device, r->queue_timelines[RG_QUEUE_MAIN], &value));
+	return value >= g->atmo_lut_retire_value;
+}
+
+/// Compute the atmosphere's transmittance and multiple scattering LUTs on the compute queue, or upload
+/// them from the disk cache if `use_cache` and they're there, into the LUTs that aren't `atmo_lut_current`.
+/// Doesn't wait: the frames keep reading the current LUTs until `finish_atmo_lut` sees `atmo_lut_fence`
+/// signaled and swaps them. If the others are still being computed, or read by frames in flight, it's done
+/// later by `update_atmo_luts`. With `r->async_compute`, the LUTs are then released to the graphics queue,
+/// which acquires them after waiting for the compute queue.
+static void compute_atmo_lut(struct vulkan_renderer *r, struct pshine_planet *planet, bool use_cache) {
+	struct pshine_planet_graphics_data *g = planet->graphics_data;
+	VkCommandBuffer cmdbuf = g->compute_cmdbuf;
+
+	if (g->atmo_lut_pending || !atmo_lut_back_free(r, g)) {
+		g->atmo_lut_queued = true;
+		g->atmo_lut_queued_use_cache = use_cache;
+		return;
+	}
+	g->atmo_lut_queued = false;
+	uint32_t back = 1 - g->atmo_lut_current;
+
+	struct atmo_lut_push_const_data data = get_atmo_lut_push_consts(planet);
+	g->atmo_lut_hash = hash_atmo_lut(&data);
+
+	// the cached texels to upload, or the computed ones to cache.
+	VmaAllocationInfo staging_alloc_info = {};
+	g->atmo_lut_staging = allocate_buffer(r, &(struct vulkan_buffer_alloc_info){
+		.size = atmo_lut_size + atmo_multiscatter_lut_size,
+		.buffer_usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		.allocation_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+		.memory_usage = VMA_MEMORY_USAGE_AUTO,
+		.out_allocation_info = &staging_alloc_info,
+	});
+	g->atmo_lut_staging_mapped = staging_alloc_info.pMappedData;
+	bool cached = use_cache && read_atmo_lut_cache(g->atmo_lut_hash, g->atmo_lut_staging_mapped);
+	if (cached) CHECKVK(vmaFlushAllocation(r->allocator, g->atmo_lut_staging.allocation, 0, VK_WHOLE_SIZE));
+	g->atmo_lut_save = !cached;
+	PSHINE_INFO("%s the atmosphere LUTs of %s (%016llx)", cached ? "loading" : "computing",
+		planet->as_body.name_own, (unsigned long long)g->atmo_lut_hash);
+
+	CHECKVK(vkResetCommandBuffer(cmdbuf, 0));
+	CHECKVK(vkBeginCommandBuffer(cmdbuf, &(VkCommandBufferBeginInfo){
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = 0,
+	}));
+
+	// Also the release to the graphics queue, if it's another family.
+	VkImageMemoryBarrier lut_barriers[2] = {
+		{
 			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-			.image = planet->graphics_data->atmo_lut.image,
-			.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+			.image = g->atmo_lut[back].image,
+			.srcAccessMask = cached ? VK_ACCESS_TRANSFER_WRITE_BIT : VK_ACCESS_NONE,
 			.dstAccessMask = VK_ACCESS_NONE,
-			.oldLayout = VK_IMAGE_LAYOUT_GENERAL,
+			.oldLayout = cached ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
 			.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
 			.srcQueueFamilyIndex = r->queue_families[QUEUE_COMPUTE],
-			.dstQueueFamilyIndex = r->queue_families[QUEUE_COMPUTE],
+			.dstQueueFamilyIndex = r->queue_families[QUEUE_GRAPHICS],
 			.subresourceRange = {
 				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
 				.baseArrayLayer = 0,
@@ -2051,17 +2434,219 @@ static void compute_atmo_lut(struct vulkan_renderer *r, struct pshine_planet *pl
 				.layerCount = 1,
 				.levelCount = 1,
 			},
-		}
-	);
-	CHECKVK(vkEndCommandBuffer(cmdbuf));
-
-	vkQueueSubmit(r->queues[QUEUE_COMPUTE], 1, &(VkSubmitInfo){
-		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		},
+	};
+	lut_barriers[1] = lut_barriers[0];
+	lut_barriers[1].image = g->atmo_multiscatter_lut[back].image;
+
+	// The whole LUTs are rewritten, so the old contents (and which queue owned them) don't matter.
+	VkImageMemoryBarrier init_barriers[2];
+	for (size_t i = 0; i < 2; ++i) {
+		init_barriers[i] = lut_barriers[i];
+		init_barriers[i].srcAccessMask = 0;
+		init_barriers[i].dstAccessMask = cached ? VK_ACCESS_TRANSFER_WRITE_BIT : VK_ACCESS_SHADER_WRITE_BIT;
+		init_barriers[i].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		init_barriers[i].newLayout = cached ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+		init_barriers[i].dstQueueFamilyIndex = r->queue_families[QUEUE_COMPUTE];
+	}
+	vkCmdPipelineBarrier(
+		cmdbuf,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		cached ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 0, nullptr, 0, nullptr, 2, init_barriers
+	);
+
+	// the transmittance LUT, then the multiple scattering one, tightly packed in the staging buffer.
+	VkBufferImageCopy copies[2] = {
+		{
+			.bufferOffset = 0,
+			.imageSubresource = { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .layerCount = 1 },
+			.imageExtent = { atmo_lut_extent.width, atmo_lut_extent.height, 1 },
+		},
+		{
+			.bufferOffset = atmo_lut_size,
+			.imageSubresource = { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .layerCount = 1 },
+			.imageExtent = { PSHINE_ATMO_MULTISCATTER_LUT_SIZE, PSHINE_ATMO_MULTISCATTER_LUT_SIZE, 1 },
+		},
+	};
+
+	if (cached) {
+		vkCmdCopyBufferToImage(cmdbuf, g->atmo_lut_staging.buffer, g->atmo_lut[back].image,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copies[0]);
+		vkCmdCopyBufferToImage(cmdbuf, g->atmo_lut_staging.buffer, g->atmo_multiscatter_lut[back].image,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copies[1]);
+	} else {
+		vkCmdBindDescriptorSets(
+			cmdbuf,
+			VK_PIPELINE_BIND_POINT_COMPUTE,
+			r->pipelines.atmo_lut_layout,
+			0, 1,
+			&g->atmo_lut_descriptor_sets[back],
+			0, nullptr
+		);
+		vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE, r->pipelines.atmo_lut_pipeline);
+
+		vkCmdPushConstants(cmdbuf, r->pipelines.atmo_lut_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+			sizeof(struct atmo_lut_push_const_data), &data);
+
+		vkCmdDispatch(cmdbuf, atmo_lut_extent.width / 16, atmo_lut_extent.height / 16, 1);
+
+		// The multiple scattering LUT samples the transmittance LUT.
+		vkCmdPipelineBarrier(
+			cmdbuf,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 1, &(VkMemoryBarrier){
+				.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+				.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+				.dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+			}, 0, nullptr, 0, nullptr
+		);
+
+		vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE, r->pipelines.atmo_multiscatter_pipeline);
+		vkCmdDispatch(cmdbuf, PSHINE_ATMO_MULTISCATTER_LUT_SIZE / 8, PSHINE_ATMO_MULTISCATTER_LUT_SIZE / 8, 1);
+
+		// Read back for the cache.
+		VkImageMemoryBarrier readback_barriers[2];
+		for (size_t i = 0; i < 2; ++i) {
+			readback_barriers[i] = init_barriers[i];
+			readback_barriers[i].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			readback_barriers[i].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			readback_barriers[i].oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+			readback_barriers[i].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			readback_barriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			readback_barriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		}
+		vkCmdPipelineBarrier(
+			cmdbuf,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 0, nullptr, 0, nullptr, 2, readback_barriers
+		);
+		vkCmdCopyImageToBuffer(cmdbuf, g->atmo_lut[back].image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			g->atmo_lut_staging.buffer, 1, &copies[0]);
+		vkCmdCopyImageToBuffer(cmdbuf, g->atmo_multiscatter_lut[back].image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			g->atmo_lut_staging.buffer, 1, &copies[1]);
+		vkCmdPipelineBarrier(
+			cmdbuf,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_HOST_BIT,
+			0, 1, &(VkMemoryBarrier){
+				.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+				.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+				.dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+			}, 0, nullptr, 0, nullptr
+		);
+	}
+
+	vkCmdPipelineBarrier(
+		cmdbuf,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+		0, 0, nullptr, 0, nullptr, 2, lut_barriers
+	);
+	CHECKVK(vkEndCommandBuffer(cmdbuf));
+
+	CHECKVK(vkResetFences(r->device, 1, &g->atmo_lut_fence));
+	g->atmo_lut_pending = true;
+	if (!r->async_compute) {
+		CHECKVK(vkQueueSubmit(r->queues[QUEUE_COMPUTE], 1, &(VkSubmitInfo){
+			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+			.commandBufferCount = 1,
+			.pCommandBuffers = &cmdbuf
+		}, g->atmo_lut_fence));
+		return;
+	}
+
+	CHECKVK(vkQueueSubmit2(r->queues[QUEUE_COMPUTE], 1, &(VkSubmitInfo2){
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+		.commandBufferInfoCount = 1,
+		.pCommandBufferInfos = &(VkCommandBufferSubmitInfo){
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
+			.commandBuffer = cmdbuf,
+		},
+		.signalSemaphoreInfoCount = 1,
+		.pSignalSemaphoreInfos = &(VkSemaphoreSubmitInfo){
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+			.semaphore = g->atmo_lut_semaphore,
+			.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+		},
+	}, VK_NULL_HANDLE));
+
+	// The acquire, with the same layouts as the release. Freed by `finish_atmo_lut`.
+	CHECKVK(vkAllocateCommandBuffers(r->device, &(VkCommandBufferAllocateInfo){
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
 		.commandBufferCount = 1,
-		.pCommandBuffers = &cmdbuf
-	}, VK_NULL_HANDLE);
+		.commandPool = r->command_pool_transfer,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+	}, &g->atmo_lut_acquire_cmdbuf));
+	CHECKVK(vkBeginCommandBuffer(g->atmo_lut_acquire_cmdbuf, &(VkCommandBufferBeginInfo){
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+	}));
+	for (size_t i = 0; i < 2; ++i) {
+		lut_barriers[i].srcAccessMask = VK_ACCESS_NONE;
+		lut_barriers[i].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	}
+	// Read by the sky-view and aerial perspective passes.
+	vkCmdPipelineBarrier(
+		g->atmo_lut_acquire_cmdbuf,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 0, nullptr, 0, nullptr, 2, lut_barriers
+	);
+	CHECKVK(vkEndCommandBuffer(g->atmo_lut_acquire_cmdbuf));
+	CHECKVK(vkQueueSubmit2(r->queues[QUEUE_GRAPHICS], 1, &(VkSubmitInfo2){
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+		.waitSemaphoreInfoCount = 1,
+		.pWaitSemaphoreInfos = &(VkSemaphoreSubmitInfo){
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+			.semaphore = g->atmo_lut_semaphore,
+			.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+		},
+		.commandBufferInfoCount = 1,
+		.pCommandBufferInfos = &(VkCommandBufferSubmitInfo){
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
+			.commandBuffer = g->atmo_lut_acquire_cmdbuf,
+		},
+	}, g->atmo_lut_fence));
+}
+
+/// If the planet's LUTs from `compute_atmo_lut` are done, cache them if they were computed and make
+/// them the current ones, so the atmosphere is drawn with them. Doesn't wait. Called before a frame
+/// is recorded, the frames already submitted may still read the old ones.
+static void finish_atmo_lut(struct vulkan_renderer *r, struct pshine_planet *planet) {
+	struct pshine_planet_graphics_data *g = planet->graphics_data;
+	if (!g->atmo_lut_pending || vkGetFenceStatus(r->device, g->atmo_lut_fence) != VK_SUCCESS) return;
+	g->atmo_lut_pending = false;
+	if (g->atmo_lut_save) {
+		CHECKVK(vmaInvalidateAllocation(r->allocator, g->atmo_lut_staging.allocation, 0, VK_WHOLE_SIZE));
+		write_atmo_lut_cache(g->atmo_lut_hash, g->atmo_lut_staging_mapped);
+	}
+	deallocate_buffer(r, g->atmo_lut_staging);
+	g->atmo_lut_staging_mapped = nullptr;
+	if (g->atmo_lut_acquire_cmdbuf != VK_NULL_HANDLE) {
+		vkFreeCommandBuffers(r->device, r->command_pool_transfer, 1, &g->atmo_lut_acquire_cmdbuf);
+		g->atmo_lut_acquire_cmdbuf = VK_NULL_HANDLE;
+	}
+	g->atmo_lut_current = 1 - g->atmo_lut_current;
+	g->atmo_lut_retire_value = r->queue_timeline_values[RG_QUEUE_MAIN];
+	g->atmo_lut_ready = true;
+}
 
-	vkQueueWaitIdle(r->queues[QUEUE_COMPUTE]);
+/// `finish_atmo_lut` for every planet, and the `compute_atmo_lut` calls that had to wait.
+static void update_atmo_luts(struct vulkan_renderer *r) {
+	for (size_t i = 0; i < r->game->star_system_count; ++i) {
+		struct pshine_star_system *system = &r->game->star_systems_own[i];
+		for (size_t j = 0; j < system->body_count; ++j) {
+			struct pshine_celestial_body *b = system->bodies_own[j];
+			if (b->type != PSHINE_CELESTIAL_BODY_PLANET) continue;
+			struct pshine_planet *p = (void *)b;
+			if (p->graphics_data == nullptr) continue;
+			finish_atmo_lut(r, p);
+			if (p->graphics_data->atmo_lut_queued) compute_atmo_lut(r, p, p->graphics_data->atmo_lut_queued_use_cache);
+		}
+	}
 }
 
 static void load_planet_texture(struct vulkan_renderer *r, struct pshine_planet *planet) {
@@ -2091,7 +2676,14 @@ static void load_planet_texture(struct vulkan_renderer *r, struct pshine_planet
 	}
 }
 
-static void init_atmo_lut_compute(struct vulkan_renderer *r, struct pshine_planet *planet) {
+static struct vulkan_image allocate_atmo_lut_image(
+	struct vulkan_renderer *r,
+	VkImageType type,
+	VkExtent3D extent,
+	uint32_t layer_count,
+	VkFormat format,
+	const char *name
+) {
 	struct vulkan_image img = allocate_image(r, &(struct vulkan_image_alloc_info){
 		.allocation_flags = 0,
 		.memory_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
@@ -2099,45 +2691,119 @@ static void init_atmo_lut_compute(struct vulkan_renderer *r, struct pshine_plane
 		.required_memory_property_flags = 0,
 		.out_allocation_info = nullptr,
 		.image_info = &(VkImageCreateInfo){
-			.imageType = VK_IMAGE_TYPE_2D,
-			.arrayLayers = 1,
+			.imageType = type,
+			.arrayLayers = layer_count,
 			.mipLevels = 1,
 			.samples = VK_SAMPLE_COUNT_1_BIT,
 			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
 			.tiling = VK_IMAGE_TILING_OPTIMAL,
-			.extent = (VkExtent3D){ .width = atmo_lut_extent.width, .height = atmo_lut_extent.height, .depth = 1 },
-			.format = atmo_lut_format,
+			.extent = extent,
+			.format = format,
 			.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
 		},
 		.view_info = &(VkImageViewCreateInfo){
-			.viewType = VK_IMAGE_VIEW_TYPE_2D,
-			.format = atmo_lut_format,
+			.viewType = type == VK_IMAGE_TYPE_3D ? VK_IMAGE_VIEW_TYPE_3D
+				: layer_count > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D,
+			.format = format,
 			.subresourceRange = {
 				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
 				.baseArrayLayer = 0,
 				.baseMipLevel = 0,
-				.layerCount = 1,
+				.layerCount = layer_count,
 				.levelCount = 1,
 			}
 		},
 	});
-	NAME_VK_OBJECT(r, img.image, VK_OBJECT_TYPE_IMAGE, "atmo lut image");
-	NAME_VK_OBJECT(r, img.view, VK_OBJECT_TYPE_IMAGE_VIEW, "atmo lut image view");
-	planet->graphics_data->atmo_lut = img;
-
-	vkUpdateDescriptorSets(r->device, 1, &(VkWriteDescriptorSet){
-		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-		.descriptorCount = 1,
-		.dstArrayElement = 0,
-		.dstBinding = 0,
-		.dstSet = planet->graphics_data->atmo_lut_descriptor_set, // TODO: cpu-side sync (thread-safety)
-		.pImageInfo = &(VkDescriptorImageInfo){
-			.imageLayout = VK_IMAGE_LAYOUT_GENERAL,
-			.imageView = img.view,
-			.sampler = VK_NULL_HANDLE
-		}
-	}, 0, nullptr);
+	NAME_VK_OBJECT(r, img.image, VK_OBJECT_TYPE_IMAGE, "%s image", name);
+	NAME_VK_OBJECT(r, img.view, VK_OBJECT_TYPE_IMAGE_VIEW, "%s image view", name);
+	return img;
+}
+
+static void init_atmo_view_luts(struct vulkan_renderer *r) {
+	r->atmo_sky_view_luts = allocate_atmo_lut_image(r, VK_IMAGE_TYPE_2D,
+		(VkExtent3D){ .width = PSHINE_ATMO_SKY_VIEW_LUT_WIDTH, .height = PSHINE_ATMO_SKY_VIEW_LUT_HEIGHT, .depth = 1 },
+		PSHINE_ATMO_MAX_BATCH, atmo_view_lut_format, "atmo sky-view luts");
+	r->atmo_aerial_luts = allocate_atmo_lut_image(r, VK_IMAGE_TYPE_3D,
+		(VkExtent3D){
+			.width = PSHINE_ATMO_AERIAL_LUT_SIZE * PSHINE_ATMO_AERIAL_TILES,
+			.height = PSHINE_ATMO_AERIAL_LUT_SIZE * PSHINE_ATMO_AERIAL_TILES,
+			.depth = PSHINE_ATMO_AERIAL_LUT_SIZE,
+		},
+		1, atmo_view_lut_format, "atmo aerial perspective luts");
+}
+
+static void deinit_atmo_view_luts(struct vulkan_renderer *r) {
+	deallocate_image(r, r->atmo_sky_view_luts);
+	deallocate_image(r, r->atmo_aerial_luts);
+}
+
+static void init_atmo_lut_compute(struct vulkan_renderer *r, struct pshine_planet *planet) {
+	struct pshine_planet_graphics_data *g = planet->graphics_data;
+	for (size_t i = 0; i < 2; ++i) {
+		g->atmo_lut[i] = allocate_atmo_lut_image(r, VK_IMAGE_TYPE_2D,
+			(VkExtent3D){ .width = atmo_lut_extent.width, .height = atmo_lut_extent.height, .depth = 1 },
+			1, atmo_lut_format, i == 0 ? "atmo lut #0" : "atmo lut #1");
+		g->atmo_multiscatter_lut[i] = allocate_atmo_lut_image(r, VK_IMAGE_TYPE_2D,
+			(VkExtent3D){ .width = PSHINE_ATMO_MULTISCATTER_LUT_SIZE, .height = PSHINE_ATMO_MULTISCATTER_LUT_SIZE, .depth = 1 },
+			1, atmo_view_lut_format, i == 0 ? "atmo multiscatter lut #0" : "atmo multiscatter lut #1");
+	}
+
+	// TODO: cpu-side sync (thread-safety)
+	#define STORAGE_IMAGE_WRITE(SET, BINDING, VIEW) (VkWriteDescriptorSet){ \
+		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, \
+		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, \
+		.descriptorCount = 1, \
+		.dstArrayElement = 0, \
+		.dstBinding = BINDING, \
+		.dstSet = SET, \
+		.pImageInfo = &(VkDescriptorImageInfo){ \
+			.imageLayout = VK_IMAGE_LAYOUT_GENERAL, \
+			.imageView = VIEW, \
+			.sampler = VK_NULL_HANDLE \
+		} \
+	}
+	#define SAMPLED_IMAGE_WRITE(SET, BINDING, VIEW, LAYOUT) (VkWriteDescriptorSet){ \
+		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, \
+		.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, \
+		.descriptorCount = 1, \
+		.dstArrayElement = 0, \
+		.dstBinding = BINDING, \
+		.dstSet = SET, \
+		.pImageInfo = &(VkDescriptorImageInfo){ \
+			.imageLayout = LAYOUT, \
+			.imageView = VIEW, \
+			.sampler = r->atmo_lut_sampler \
+		} \
+	}
+	for (size_t i = 0; i < 2; ++i) {
+		vkUpdateDescriptorSets(r->device, 8, (VkWriteDescriptorSet[8]){
+			STORAGE_IMAGE_WRITE(g->atmo_lut_descriptor_sets[i], 0, g->atmo_lut[i].view),
+			STORAGE_IMAGE_WRITE(g->atmo_lut_descriptor_sets[i], 1, g->atmo_multiscatter_lut[i].view),
+			// read while the multiple scattering LUT is computed, before the transition.
+			SAMPLED_IMAGE_WRITE(g->atmo_lut_descriptor_sets[i], 2, g->atmo_lut[i].view, VK_IMAGE_LAYOUT_GENERAL),
+			(VkWriteDescriptorSet){
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+				.descriptorCount = 1,
+				.dstArrayElement = 0,
+				.dstBinding = 0,
+				.dstSet = g->atmo_view_lut_descriptor_sets[i],
+				.pBufferInfo = &(VkDescriptorBufferInfo){
+					.buffer = r->data.uniform_ring.buffer.buffer,
+					.offset = 0,
+					.range = sizeof(struct atmo_uniform_data),
+				}
+			},
+			SAMPLED_IMAGE_WRITE(g->atmo_view_lut_descriptor_sets[i], 1, g->atmo_lut[i].view,
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+			SAMPLED_IMAGE_WRITE(g->atmo_view_lut_descriptor_sets[i], 2, g->atmo_multiscatter_lut[i].view,
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+			STORAGE_IMAGE_WRITE(g->atmo_view_lut_descriptor_sets[i], 3, r->atmo_sky_view_luts.view),
+			STORAGE_IMAGE_WRITE(g->atmo_view_lut_descriptor_sets[i], 4, r->atmo_aerial_luts.view),
+		}, 0, nullptr);
+	}
+	#undef STORAGE_IMAGE_WRITE
+	#undef SAMPLED_IMAGE_WRITE
 
 	CHECKVK(vkAllocateCommandBuffers(r->device, &(VkCommandBufferAllocateInfo){
 		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
@@ -2145,6 +2811,15 @@ static void init_atmo_lut_compute(struct vulkan_renderer *r, struct pshine_plane
 		.commandPool = r->command_pool_compute,
 		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
 	}, &planet->graphics_data->compute_cmdbuf));
+	CHECKVK(vkCreateFence(r->device, &(VkFenceCreateInfo){
+		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+	}, nullptr, &g->atmo_lut_fence));
+	NAME_VK_OBJECT(r, g->atmo_lut_fence, VK_OBJECT_TYPE_FENCE, "atmo lut fence for %s", planet->as_body.name_own);
+	CHECKVK(vkCreateSemaphore(r->device, &(VkSemaphoreCreateInfo){
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+	}, nullptr, &g->atmo_lut_semaphore));
+	NAME_VK_OBJECT(r, g->atmo_lut_semaphore, VK_OBJECT_TYPE_SEMAPHORE, "atmo lut semaphore for %s",
+		planet->as_body.name_own);
 }
 
 // Vulkan and GLFW
@@ -2339,10 +3014,6 @@ static void init_vulkan(struct vulkan_renderer *r) {
 			if ((properties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) && (properties[i].queueFlags & VK_QUEUE_COMPUTE_BIT)) {
 				r->queue_families[QUEUE_GRAPHICS] = i;
 			}
-			// TODO: prefer this queue to be separate from the graphics queue.
-			if (properties[i].queueFlags & VK_QUEUE_COMPUTE_BIT) {
-				r->queue_families[QUEUE_COMPUTE] = i;
-			}
 			VkBool32 is_surface_supported = VK_FALSE;
 			CHECKVK(vkGetPhysicalDeviceSurfaceSupportKHR(r->physical_device, i, r->surface, &is_surface_supported));
 			if (is_surface_supported) {
@@ -2350,6 +3021,29 @@ static void init_vulkan(struct vulkan_renderer *r) {
 			}
 		}
 
+		// The compute queue is a separate family if there is one (preferably without graphics),
+		// for async compute. It needs timestamps for the GPU profiler, see `init_rendergraph`.
+		r->queue_families[QUEUE_COMPUTE] = r->queue_families[QUEUE_GRAPHICS];
+		if (!pshine_check_has_option("--single-queue")) {
+			for (uint32_t i = 0; i < property_count; ++i) {
+				if (i == r->queue_families[QUEUE_GRAPHICS]) continue;
+				if (!(properties[i].queueFlags & VK_QUEUE_COMPUTE_BIT) || properties[i].timestampValidBits == 0) continue;
+				uint32_t current = r->queue_families[QUEUE_COMPUTE];
+				if (
+					current == r->queue_families[QUEUE_GRAPHICS] ||
+					((properties[current].queueFlags & VK_QUEUE_GRAPHICS_BIT) && !(properties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT))
+				) {
+					r->queue_families[QUEUE_COMPUTE] = i;
+				}
+			}
+		}
+		r->async_compute = r->queue_families[QUEUE_COMPUTE] != r->queue_families[QUEUE_GRAPHICS];
+		r->timestamp_valid_bits = properties[r->queue_families[QUEUE_GRAPHICS]].timestampValidBits;
+		if (properties[r->queue_families[QUEUE_COMPUTE]].timestampValidBits < r->timestamp_valid_bits)
+			r->timestamp_valid_bits = properties[r->queue_families[QUEUE_COMPUTE]].timestampValidBits;
+		PSHINE_INFO("Async compute: %s (graphics family %u, compute family %u)", r->async_compute ? "yes" : "no",
+			r->queue_families[QUEUE_GRAPHICS], r->queue_families[QUEUE_COMPUTE]);
+
 		r->physical_device_properties_own = calloc(1, sizeof(*r->physical_device_properties_own));
 		r->physical_device_properties_own->sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
 		VkPhysicalDeviceMaintenance3Properties *p3 = calloc(1, sizeof(*p3));
@@ -2407,20 +3101,53 @@ static void init_vulkan(struct vulkan_renderer *r) {
 			};
 		}
 
-		bool have_portability_ext = false;
+		bool have_portability_ext = false, have_present_id_ext = false, have_present_wait_ext = false;
 		{
 			uint32_t count = 0;
 			CHECKVK(vkEnumerateDeviceExtensionProperties(r->physical_device, nullptr, &count, nullptr));
 			VkExtensionProperties properties[count];
 			CHECKVK(vkEnumerateDeviceExtensionProperties(r->physical_device, nullptr, &count, properties));
 			for (uint32_t i = 0; i < count; ++i) {
-				if (strcmp(properties[i].extensionName, "VK_KHR_portability_subset") == 0) {
+				if (strcmp(properties[i].extensionName, "VK_KHR_portability_subset") == 0)
 					have_portability_ext = true;
-					break;
-				}
+				else if (strcmp(properties[i].extensionName, VK_KHR_PRESENT_ID_EXTENSION_NAME) == 0)
+					have_present_id_ext = true;
+				else if (strcmp(properties[i].extensionName, VK_KHR_PRESENT_WAIT_EXTENSION_NAME) == 0)
+					have_present_wait_ext = true;
 			}
 		}
 
+		// for `pshine_render_settings::low_latency`, and for measuring the input latency.
+		VkPhysicalDevicePresentWaitFeaturesKHR present_wait_features = {
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR,
+		};
+		VkPhysicalDevicePresentIdFeaturesKHR present_id_features = {
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR,
+			.pNext = &present_wait_features,
+		};
+		if (have_present_id_ext && have_present_wait_ext) {
+			vkGetPhysicalDeviceFeatures2(r->physical_device, &(VkPhysicalDeviceFeatures2){
+				.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+				.pNext = &present_id_features,
+			});
+		}
+		r->present_wait = present_id_features.presentId && present_wait_features.presentWait;
+		if (!r->present_wait) PSHINE_INFO("no VK_KHR_present_wait, the input latency isn't measured");
+
+		uint32_t extension_count = 0;
+		const char *extensions[5];
+		extensions[extension_count++] = VK_KHR_SWAPCHAIN_EXTENSION_NAME;
+		extensions[extension_count++] = VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME;
+		if (have_portability_ext) extensions[extension_count++] = "VK_KHR_portability_subset";
+		if (r->present_wait) {
+			extensions[extension_count++] = VK_KHR_PRESENT_ID_EXTENSION_NAME;
+			extensions[extension_count++] = VK_KHR_PRESENT_WAIT_EXTENSION_NAME;
+		}
+
+		VkPhysicalDeviceFeatures supported_features;
+		vkGetPhysicalDeviceFeatures(r->physical_device, &supported_features);
+		r->pipeline_statistics = supported_features.pipelineStatisticsQuery && supported_features.inheritedQueries;
+
 		CHECKVK(vkCreateDevice(r->physical_device, &(VkDeviceCreateInfo){
 			.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
 			.pNext = &(VkPhysicalDeviceVulkan13Features){
@@ -2431,18 +3158,31 @@ static void init_vulkan(struct vulkan_renderer *r) {
 				.pNext = &(VkPhysicalDeviceVulkan14Features){
 					.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_4_FEATURES,
 					.dynamicRenderingLocalRead = true,
+					.pNext = &(VkPhysicalDeviceVulkan12Features){
+						.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+						.drawIndirectCount = true,
+						// for the waits between the graphics and compute queues, see `render_end`.
+						.timelineSemaphore = true,
+						.pNext = r->present_wait ? &present_id_features : nullptr,
+					},
 				},
 			},
 			.queueCreateInfoCount = queue_create_info_count,
 			.pQueueCreateInfos = queue_create_infos,
-			.enabledExtensionCount = 2 + have_portability_ext,
-			.ppEnabledExtensionNames = (const char *[]){
-				VK_KHR_SWAPCHAIN_EXTENSION_NAME,
-				VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME,
-				"VK_KHR_portability_subset",
-				// VK_EXT_DEBUG_MARKER_EXTENSION_NAME,
+			.enabledExtensionCount = extension_count,
+			.ppEnabledExtensionNames = extensions,
+			.pEnabledFeatures = &(VkPhysicalDeviceFeatures){
+				// ships are drawn from indirect draw lists, see `build_std_mesh_draws`.
+				.multiDrawIndirect = true,
+				.drawIndirectFirstInstance = true,
+				// the bloom downsampler picks the mip to write at runtime.
+				.shaderStorageImageArrayDynamicIndexing = true,
+				// the atmosphere pass picks each atmosphere's LUTs at runtime.
+				.shaderSampledImageArrayDynamicIndexing = true,
+				// for counting the shader invocations of the passes, if there is support, see `pshine_gpu_perf`.
+				.pipelineStatisticsQuery = r->pipeline_statistics,
+				.inheritedQueries = r->pipeline_statistics,
 			},
-			.pEnabledFeatures = &(VkPhysicalDeviceFeatures){},
 		}, nullptr, &r->device));
 	}
 
@@ -2561,10 +3301,21 @@ static void reinit_swapchain(struct vulkan_renderer *r) {
 	r->swapchain_extent.width = width / xscale;
 	r->swapchain_extent.height = height / yscale;
 	PSHINE_INFO("swapchain extent: %ux%u", r->swapchain_extent.width, r->swapchain_extent.height);
+	r->requested_present_mode = r->as_base.settings.present_mode;
+	r->present_mode = r->requested_present_mode;
+	if ((r->present_modes_supported & (1u << r->present_mode)) == 0) {
+		PSHINE_WARN("present mode %s isn't supported, using FIFO", present_mode_names[r->present_mode]);
+		r->present_mode = PSHINE_PRESENT_MODE_FIFO;
+	}
+	// an image for each frame in flight, and mailbox needs one more to replace.
+	uint32_t min_image_count = r->surface_capabilities.minImageCount + (r->present_mode == PSHINE_PRESENT_MODE_MAILBOX);
+	if (min_image_count < r->frames_in_flight) min_image_count = r->frames_in_flight;
+	if (r->surface_capabilities.maxImageCount != 0 && min_image_count > r->surface_capabilities.maxImageCount)
+		min_image_count = r->surface_capabilities.maxImageCount;
 	CHECKVK(vkCreateSwapchainKHR(r->device, &(VkSwapchainCreateInfoKHR){
 		.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
 		.surface = r->surface,
-		.minImageCount = r->surface_capabilities.minImageCount,
+		.minImageCount = min_image_count,
 		.imageFormat = r->surface_format.format,
 		.imageArrayLayers = 1,
 		.imageColorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR,
@@ -2576,9 +3327,11 @@ static void reinit_swapchain(struct vulkan_renderer *r) {
 		.pQueueFamilyIndices = (uint32_t[]) { r->queue_families[QUEUE_GRAPHICS], r->queue_families[QUEUE_PRESENT] },
 		.preTransform = r->surface_capabilities.currentTransform,
 		.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
-		.presentMode = VK_PRESENT_MODE_FIFO_KHR,
+		.presentMode = vk_present_modes[r->present_mode],
 		.oldSwapchain = VK_NULL_HANDLE,
 	}, nullptr, &r->swapchain));
+	// the presents to the old swapchain can't be waited for.
+	r->present_id_done = r->present_id;
 
 	r->swapchain_image_count = 0;
 	CHECKVK(vkGetSwapchainImagesKHR(r->device, r->swapchain, &r->swapchain_image_count, nullptr));
@@ -2614,6 +3367,16 @@ static void init_swapchain(struct vulkan_renderer *r) {
 	r->shadow_depth_format = find_optimal_format(r, 1, (VkFormat[]){
 		VK_FORMAT_D16_UNORM, VK_FORMAT_D24_UNORM_S8_UINT
 	}, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_TILING_OPTIMAL);
+	{
+		uint32_t count = 0;
+		CHECKVK(vkGetPhysicalDeviceSurfacePresentModesKHR(r->physical_device, r->surface, &count, nullptr));
+		VkPresentModeKHR modes[count];
+		CHECKVK(vkGetPhysicalDeviceSurfacePresentModesKHR(r->physical_device, r->surface, &count, modes));
+		r->present_modes_supported = 0;
+		for (uint32_t i = 0; i < count; ++i)
+			for (uint32_t m = 0; m < PSHINE_PRESENT_MODE_COUNT_; ++m)
+				if (modes[i] == vk_present_modes[m]) r->present_modes_supported |= 1u << m;
+	}
 	reinit_swapchain(r);
 	// {
 	// 	uint32_t surface_format_count = 0;
@@ -2662,70 +3425,118 @@ static void pipeline_barrier_now(struct vulkan_renderer *r, const VkDependencyIn
 	vkFreeCommandBuffers(r->device, r->command_pool_transfer, 1, &command_buffer);
 }
 
-static void init_transients(struct vulkan_renderer *r) {
-	r->depth_image = allocate_image(r, &(struct vulkan_image_alloc_info){
+/// Mip 0 is half the size of `extent`, the swapchain's or the rendered part of it.
+static VkExtent2D bloom_mip_extent(VkExtent2D extent, size_t mip) {
+	uint32_t width = extent.width / 2 >> mip, height = extent.height / 2 >> mip;
+	return (VkExtent2D){ width > 0 ? width : 1, height > 0 ? height : 1 };
+}
+
+/// The half-resolution atmosphere's images have one texel per `PSHINE_ATMO_RESOLUTION_DIVISOR`² pixels.
+static VkExtent3D atmo_half_res_extent(const struct vulkan_renderer *r) {
+	return (VkExtent3D){
+		.width = (r->swapchain_extent.width + PSHINE_ATMO_RESOLUTION_DIVISOR - 1) / PSHINE_ATMO_RESOLUTION_DIVISOR,
+		.height = (r->swapchain_extent.height + PSHINE_ATMO_RESOLUTION_DIVISOR - 1) / PSHINE_ATMO_RESOLUTION_DIVISOR,
+		.depth = 1,
+	};
+}
+
+/// A storage image of the half-resolution atmosphere's history, with a view of each of its two layers
+/// in `views`, in `VK_IMAGE_LAYOUT_GENERAL`.
+static struct vulkan_image allocate_atmo_history_image(
+	struct vulkan_renderer *r,
+	VkFormat format,
+	const char *name,
+	VkImageView views[static 2]
+) {
+	struct vulkan_image img = allocate_image(r, &(struct vulkan_image_alloc_info){
 		.memory_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
-		.preferred_memory_property_flags = VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT,
-		// .allocation_flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT,
 		.image_info = &(VkImageCreateInfo){
 			.imageType = VK_IMAGE_TYPE_2D,
-			.arrayLayers = 1,
-			.extent = {
-				.width = r->swapchain_extent.width,
-				.height = r->swapchain_extent.height,
-				.depth = 1,
-			},
-			.format = r->depth_format,
+			.arrayLayers = 2,
+			.extent = atmo_half_res_extent(r),
+			.format = format,
 			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
 			.samples = VK_SAMPLE_COUNT_1_BIT,
 			.mipLevels = 1,
 			.tiling = VK_IMAGE_TILING_OPTIMAL,
 			.usage
-				= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT // the the geometry rendering
-				| VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT // for the atmosphere rendering
-				| VK_IMAGE_USAGE_TRANSFER_SRC_BIT // for the downsampling blit
-				| VK_IMAGE_USAGE_SAMPLED_BIT,
+				= VK_IMAGE_USAGE_STORAGE_BIT // written by the resolve
+				| VK_IMAGE_USAGE_SAMPLED_BIT, // for the reprojection and the upsample
 		},
-		.view_info = &(VkImageViewCreateInfo){
+	});
+	NAME_VK_OBJECT(r, img.image, VK_OBJECT_TYPE_IMAGE, "transient %s image", name);
+	for (uint32_t i = 0; i < 2; ++i) {
+		CHECKVK(vkCreateImageView(r->device, &(VkImageViewCreateInfo){
+			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+			.image = img.image,
 			.viewType = VK_IMAGE_VIEW_TYPE_2D,
-			.format = r->depth_format,
+			.format = format,
 			.subresourceRange = (VkImageSubresourceRange){
-				.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
-				.baseArrayLayer = 0,
+				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+				.baseArrayLayer = i,
 				.layerCount = 1,
 				.baseMipLevel = 0,
 				.levelCount = 1,
-			}
-		}
-	});
+			},
+		}, nullptr, &views[i]));
+		NAME_VK_OBJECT(r, views[i], VK_OBJECT_TYPE_IMAGE_VIEW, "transient %s #%u image view", name, i);
+	}
+	// persistent in the render graph, which expects it in the layout the frames leave it in.
 	pipeline_barrier_now(r, &(VkDependencyInfo){
 		.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
 		.imageMemoryBarrierCount = 1,
 		.pImageMemoryBarriers = &(VkImageMemoryBarrier2){
 			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
-			.image = r->depth_image.image,
+			.image = img.image,
 			.srcStageMask = VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT,
 			.dstStageMask = VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT,
 			.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-			.newLayout = VK_IMAGE_LAYOUT_RENDERING_LOCAL_READ,
-			.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
-			.subresourceRange.layerCount = 1,
+			.newLayout = VK_IMAGE_LAYOUT_GENERAL,
+			.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.subresourceRange.layerCount = 2,
 			.subresourceRange.levelCount = 1,
 			.srcQueueFamilyIndex = r->queue_families[QUEUE_GRAPHICS],
 			.dstQueueFamilyIndex = r->queue_families[QUEUE_GRAPHICS],
 		},
 	});
+	return img;
+}
+
+static void init_transients(struct vulkan_renderer *r) {
+	// the images used during only a part of the frame share their memory, see `bind_graph_images`.
+	r->depth_image = allocate_image(r, &(struct vulkan_image_alloc_info){
+		.placed = true,
+		.image_info = &(VkImageCreateInfo){
+			.imageType = VK_IMAGE_TYPE_2D,
+			.arrayLayers = 1,
+			.extent = {
+				.width = r->swapchain_extent.width,
+				.height = r->swapchain_extent.height,
+				.depth = 1,
+			},
+			.format = r->depth_format,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.mipLevels = 1,
+			.tiling = VK_IMAGE_TILING_OPTIMAL,
+			.usage
+				= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT // the the geometry rendering
+				| VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT // for the atmosphere rendering
+				| VK_IMAGE_USAGE_TRANSFER_SRC_BIT // for the downsampling blit
+				| VK_IMAGE_USAGE_SAMPLED_BIT,
+		},
+	});
 
-	r->transients.shadow[0] = allocate_image(r, &(struct vulkan_image_alloc_info){
+	// the shadow atlas is kept between frames, see `fit_shadow_cascades`.
+	r->transients.shadow = allocate_image(r, &(struct vulkan_image_alloc_info){
 		.memory_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
-		.preferred_memory_property_flags = VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT,
 		// .allocation_flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT,
 		.image_info = &(VkImageCreateInfo){
 			.imageType = VK_IMAGE_TYPE_2D,
 			.arrayLayers = 1,
 			.extent = {
-				.width = 2048,
-				.height = 2048,
+				.width = 2 * PSHINE_SHADOW_CASCADE_SIZE,
+				.height = 2 * PSHINE_SHADOW_CASCADE_SIZE,
 				.depth = 1,
 			},
 			.format = r->shadow_depth_format,
@@ -2752,14 +3563,13 @@ static void init_transients(struct vulkan_renderer *r) {
 
 	r->transients.color_s = allocate_image(r, &(struct vulkan_image_alloc_info){
 		.memory_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
-		.preferred_memory_property_flags = VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT,
 		// .allocation_flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT,
 		.image_info = &(VkImageCreateInfo){
 			.imageType = VK_IMAGE_TYPE_2D,
 			.arrayLayers = 1,
 			.extent = {
-				.width = r->transients.shadow[0].width,
-				.height = r->transients.shadow[0].height,
+				.width = r->transients.shadow.width,
+				.height = r->transients.shadow.height,
 				.depth = 1,
 			},
 			.format = VK_FORMAT_R8G8B8A8_SRGB,
@@ -2783,6 +3593,41 @@ static void init_transients(struct vulkan_renderer *r) {
 			}
 		}
 	});
+	// the render graph starts each frame from their layouts at the end of the last one (both are
+	// sampled last, see `rg_graph_image_spec::persistent`), and nothing is cached in them yet.
+	pipeline_barrier_now(r, &(VkDependencyInfo){
+		.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+		.imageMemoryBarrierCount = 2,
+		.pImageMemoryBarriers = (VkImageMemoryBarrier2[]){
+			{
+				.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+				.image = r->transients.shadow.image,
+				.srcStageMask = VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT,
+				.dstStageMask = VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT,
+				.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+				.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+				.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
+				.subresourceRange.layerCount = 1,
+				.subresourceRange.levelCount = 1,
+				.srcQueueFamilyIndex = r->queue_families[QUEUE_GRAPHICS],
+				.dstQueueFamilyIndex = r->queue_families[QUEUE_GRAPHICS],
+			},
+			{
+				.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+				.image = r->transients.color_s.image,
+				.srcStageMask = VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT,
+				.dstStageMask = VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT,
+				.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+				.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+				.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+				.subresourceRange.layerCount = 1,
+				.subresourceRange.levelCount = 1,
+				.srcQueueFamilyIndex = r->queue_families[QUEUE_GRAPHICS],
+				.dstQueueFamilyIndex = r->queue_families[QUEUE_GRAPHICS],
+			},
+		},
+	});
+	for (uint32_t c = 0; c < PSHINE_SHADOW_CASCADE_COUNT; ++c) r->shadow_caches[c].valid = false;
 	r->transients.gbuffer[GBUFFER_IMAGE_DIFFUSE_O] = (struct gbuffer_image){
 		.name = "Diffuse+AO",
 		.format = VK_FORMAT_R8G8B8A8_SRGB,
@@ -2801,8 +3646,7 @@ static void init_transients(struct vulkan_renderer *r) {
 
 	for (size_t i = 0; i < GBUFFER_IMAGE_COUNT_; ++i) {
 		r->transients.gbuffer[i].image = allocate_image(r, &(struct vulkan_image_alloc_info){
-			.memory_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
-			.preferred_memory_property_flags = VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT,
+			.placed = true,
 			.image_info = &(VkImageCreateInfo){
 				.imageType = VK_IMAGE_TYPE_2D,
 				.arrayLayers = 1,
@@ -2820,45 +3664,13 @@ static void init_transients(struct vulkan_renderer *r) {
 					= VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT // for atmosphere rendering and for the tonemap
 					| VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT // for the geometry rendering
 			},
-			.view_info = &(VkImageViewCreateInfo){
-				.viewType = VK_IMAGE_VIEW_TYPE_2D,
-				.format = r->transients.gbuffer[i].format,
-				.subresourceRange = (VkImageSubresourceRange){
-					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-					.baseArrayLayer = 0,
-					.layerCount = 1,
-					.baseMipLevel = 0,
-					.levelCount = 1,
-				},
-			},
 		});
 		NAME_VK_OBJECT(r, r->transients.gbuffer[i].image.image, VK_OBJECT_TYPE_IMAGE, "GBuffer %s image",
 			r->transients.gbuffer[i].name);
-		NAME_VK_OBJECT(r, r->transients.gbuffer[i].image.view, VK_OBJECT_TYPE_IMAGE_VIEW, "GBuffer %s image view",
-			r->transients.gbuffer[i].name);
-			pipeline_barrier_now(r, &(VkDependencyInfo){
-			.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
-			.imageMemoryBarrierCount = 1,
-			.pImageMemoryBarriers = &(VkImageMemoryBarrier2){
-				.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
-				.image = r->transients.gbuffer[i].image.image,
-				.srcStageMask = VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT,
-				.dstStageMask = VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT,
-				.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-				.newLayout = VK_IMAGE_LAYOUT_RENDERING_LOCAL_READ,
-				.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-				.subresourceRange.layerCount = 1,
-				.subresourceRange.levelCount = 1,
-				.srcQueueFamilyIndex = r->queue_families[QUEUE_GRAPHICS],
-				.dstQueueFamilyIndex = r->queue_families[QUEUE_GRAPHICS],
-			},
-		});
 	}
 
 	r->transients.color_0 = allocate_image(r, &(struct vulkan_image_alloc_info){
-		.memory_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
-		.preferred_memory_property_flags = VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT,
-		// .allocation_flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT,
+		.placed = true,
 		.image_info = &(VkImageCreateInfo){
 			.imageType = VK_IMAGE_TYPE_2D,
 			.arrayLayers = 1,
@@ -2879,82 +3691,59 @@ static void init_transients(struct vulkan_renderer *r) {
 				| VK_IMAGE_USAGE_STORAGE_BIT // for the bloom/upsample&composite bloom shader
 				| VK_IMAGE_USAGE_SAMPLED_BIT, // for the downsample compute
 		},
-		.view_info = &(VkImageViewCreateInfo){
-			.viewType = VK_IMAGE_VIEW_TYPE_2D,
-			.format = VK_FORMAT_R16G16B16A16_SFLOAT,
-			.subresourceRange = (VkImageSubresourceRange){
-				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-				.baseArrayLayer = 0,
-				.layerCount = 1,
-				.baseMipLevel = 0,
-				.levelCount = 1,
-			},
-		},
 	});
-	pipeline_barrier_now(r, &(VkDependencyInfo){
-		.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
-		.imageMemoryBarrierCount = 1,
-		.pImageMemoryBarriers = &(VkImageMemoryBarrier2){
-			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
-			.image = r->transients.color_0.image,
-			.srcStageMask = VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT,
-			.dstStageMask = VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT,
-			.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-			.newLayout = VK_IMAGE_LAYOUT_RENDERING_LOCAL_READ,
-			.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-			.subresourceRange.layerCount = 1,
-			.subresourceRange.levelCount = 1,
-			.srcQueueFamilyIndex = r->queue_families[QUEUE_GRAPHICS],
-			.dstQueueFamilyIndex = r->queue_families[QUEUE_GRAPHICS],
+	VkExtent2D bloom_extent = bloom_mip_extent(r->swapchain_extent, 0);
+	r->transients.bloom = allocate_image(r, &(struct vulkan_image_alloc_info){
+		.placed = true,
+		.image_info = &(VkImageCreateInfo){
+			.imageType = VK_IMAGE_TYPE_2D,
+			.arrayLayers = 1,
+			.extent = {
+				.width = bloom_extent.width,
+				.height = bloom_extent.height,
+				.depth = 1,
+			},
+			.format = VK_FORMAT_R16G16B16A16_SFLOAT,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.mipLevels = BLOOM_STAGE_COUNT,
+			.tiling = VK_IMAGE_TILING_OPTIMAL,
+			.usage
+				= VK_IMAGE_USAGE_STORAGE_BIT // for the downsample and upsample compute shaders
+				| VK_IMAGE_USAGE_SAMPLED_BIT, // for the upsample compute shader
 		},
 	});
-	VkExtent2D bloom_stage_extent = r->swapchain_extent;
-	for (size_t i = 0; i < BLOOM_STAGE_COUNT; ++i) {
-		bloom_stage_extent.width /= 2;
-		bloom_stage_extent.height /= 2;
-		r->transients.bloom[i] = allocate_image(r, &(struct vulkan_image_alloc_info){
-			.memory_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
-			// .preferred_memory_property_flags = VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT,
-			// .allocation_flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT,
-			.image_info = &(VkImageCreateInfo){
-				.imageType = VK_IMAGE_TYPE_2D,
-				.arrayLayers = 1,
-				.extent = {
-					.width = bloom_stage_extent.width,
-					.height = bloom_stage_extent.height,
-					.depth = 1,
-				},
-				.format = VK_FORMAT_R16G16B16A16_SFLOAT,
-				.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-				.samples = VK_SAMPLE_COUNT_1_BIT,
-				.mipLevels = 1,
-				.tiling = VK_IMAGE_TILING_OPTIMAL,
-				.usage
-					= VK_IMAGE_USAGE_STORAGE_BIT // for the upsample&bloom compute shader
-					| VK_IMAGE_USAGE_TRANSFER_SRC_BIT // for the downsample op
-					| VK_IMAGE_USAGE_TRANSFER_DST_BIT // for the downsample op
-					| VK_IMAGE_USAGE_SAMPLED_BIT // for the upsample&bloom compute shader,
-			},
-			.view_info = &(VkImageViewCreateInfo){
-				.viewType = VK_IMAGE_VIEW_TYPE_2D,
-				.format = VK_FORMAT_R16G16B16A16_SFLOAT,
-				.subresourceRange = (VkImageSubresourceRange){
-					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-					.baseArrayLayer = 0,
-					.layerCount = 1,
-					.baseMipLevel = 0,
-					.levelCount = 1,
-				}
-			},
-		});
-		NAME_VK_OBJECT(r, r->transients.bloom[i].image, VK_OBJECT_TYPE_IMAGE, "transient bloom #%zu image", i);
-		NAME_VK_OBJECT(r, r->transients.bloom[i].view, VK_OBJECT_TYPE_IMAGE_VIEW, "transient bloom #%zu image view", i);
-	}
+	NAME_VK_OBJECT(r, r->transients.bloom.image, VK_OBJECT_TYPE_IMAGE, "transient bloom image");
+	r->transients.bloom_counter = allocate_buffer(r, &(struct vulkan_buffer_alloc_info){
+		.size = sizeof(uint32_t),
+		.buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		.memory_usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+	});
+	NAME_VK_OBJECT(r, r->transients.bloom_counter.buffer, VK_OBJECT_TYPE_BUFFER, "transient bloom counter buffer");
+	r->transients.atmo_light = allocate_image(r, &(struct vulkan_image_alloc_info){
+		.placed = true,
+		.image_info = &(VkImageCreateInfo){
+			.imageType = VK_IMAGE_TYPE_2D,
+			.arrayLayers = 1,
+			.extent = atmo_half_res_extent(r),
+			.format = VK_FORMAT_R16G16B16A16_SFLOAT,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.mipLevels = 1,
+			.tiling = VK_IMAGE_TILING_OPTIMAL,
+			.usage = VK_IMAGE_USAGE_STORAGE_BIT, // written and read by the half-res atmosphere compute shaders
+		},
+	});
+	NAME_VK_OBJECT(r, r->transients.atmo_light.image, VK_OBJECT_TYPE_IMAGE, "transient half-res atmo light image");
+	r->transients.atmo_history = allocate_atmo_history_image(r, VK_FORMAT_R16G16B16A16_SFLOAT,
+		"half-res atmo history", r->transients.atmo_history_views);
+	r->transients.atmo_history_depth = allocate_atmo_history_image(r, VK_FORMAT_R32_SFLOAT,
+		"half-res atmo history depth", r->transients.atmo_history_depth_views);
+	// the old history is of another size.
+	r->atmo_history_valid = false;
 	// PSHINE_DEBUG("initializting transients");
 	NAME_VK_OBJECT(r, r->transients.color_0.image, VK_OBJECT_TYPE_IMAGE, "transient color0 image");
-	NAME_VK_OBJECT(r, r->transients.color_0.view, VK_OBJECT_TYPE_IMAGE_VIEW, "transient color0 image view");
 	NAME_VK_OBJECT(r, r->depth_image.image, VK_OBJECT_TYPE_IMAGE, "transient depth0 image");
-	NAME_VK_OBJECT(r, r->depth_image.view, VK_OBJECT_TYPE_IMAGE_VIEW, "transient depth0 image view");
 	// PSHINE_DEBUG("initiadsadsalizting transients");
 }
 
@@ -2962,173 +3751,177 @@ static void deinit_transients(struct vulkan_renderer *r) {
 	for (size_t i = 0; i < GBUFFER_IMAGE_COUNT_; ++i)
 		deallocate_image(r, r->transients.gbuffer[i].image);
 	deallocate_image(r, r->depth_image);
-	deallocate_image(r, r->transients.shadow[0]);
+	deallocate_image(r, r->transients.shadow);
 	deallocate_image(r, r->transients.color_0);
 	deallocate_image(r, r->transients.color_s);
 	for (size_t i = 0; i < BLOOM_STAGE_COUNT; ++i)
-		deallocate_image(r, r->transients.bloom[i]);
+		vkDestroyImageView(r->device, r->transients.bloom_mip_views[i], nullptr);
+	deallocate_image(r, r->transients.bloom);
+	deallocate_buffer(r, r->transients.bloom_counter);
+	deallocate_image(r, r->transients.atmo_light);
+	for (size_t i = 0; i < 2; ++i) {
+		vkDestroyImageView(r->device, r->transients.atmo_history_views[i], nullptr);
+		vkDestroyImageView(r->device, r->transients.atmo_history_depth_views[i], nullptr);
+	}
+	deallocate_image(r, r->transients.atmo_history);
+	deallocate_image(r, r->transients.atmo_history_depth);
 }
 
 
-static void init_rendergraph(struct vulkan_renderer *r) {
-	struct rg_pass_spec rpasses[RPASS_COUNT_] = {
-		[RPASS_SHADOW] = (struct rg_pass_spec){
-			.name = "Shadow",
-			.image_ref_count = 2,
-			.image_refs = (struct rg_image_ref_spec[2]){
-				{ RPIMG_SHADOW0, RG_IMAGE_USE_DEPTH_ATTACHMENT_BIT | RG_IMAGE_USE_CLEARED_BIT },
-				{ RPIMG_SHADOWC, RG_IMAGE_USE_COLOR_ATTACHMENT_BIT | RG_IMAGE_USE_CLEARED_BIT },
-			},
-			.render_area = (VkRect2D){ .extent = { r->transients.shadow[0].width, r->transients.shadow[0].height } },
-		},
-		[RPASS_HDR_GEOMETRY] = (struct rg_pass_spec){
-			.name = "HDR Geometry",
-			.image_ref_count = 6,
-			.image_refs = (struct rg_image_ref_spec[6]){
-				{ RPIMG_COLOR0, RG_IMAGE_USE_COLOR_ATTACHMENT_BIT | RG_IMAGE_USE_CLEARED_BIT },
-				{ RPIMG_DEPTH0, RG_IMAGE_USE_DEPTH_ATTACHMENT_BIT | RG_IMAGE_USE_CLEARED_BIT },
-				{ RPIMG_GBUFFER0, RG_IMAGE_USE_COLOR_ATTACHMENT_BIT | RG_IMAGE_USE_CLEARED_BIT },
-				{ RPIMG_GBUFFER1, RG_IMAGE_USE_COLOR_ATTACHMENT_BIT | RG_IMAGE_USE_CLEARED_BIT },
-				{ RPIMG_GBUFFER2, RG_IMAGE_USE_COLOR_ATTACHMENT_BIT | RG_IMAGE_USE_CLEARED_BIT },
-				{ RPIMG_SHADOW0, RG_IMAGE_USE_SAMPLED_BIT },
-			},
-		},
-		[RPASS_HDR_ATMOSPHERE] = (struct rg_pass_spec){
-			.name = "HDR Atmosphere",
-			.image_ref_count = 5,
-			.image_refs = (struct rg_image_ref_spec[5]){
-				(struct rg_image_ref_spec){ RPIMG_COLOR0,
-					.usage = RG_IMAGE_USE_COLOR_INPUT_ATTACHMENT_BIT,
-					.input_attachment_index = 0 },
-				(struct rg_image_ref_spec){ RPIMG_DEPTH0,
-					.usage = RG_IMAGE_USE_DEPTH_INPUT_ATTACHMENT_BIT,
-					.input_attachment_index = 1 },
-				(struct rg_image_ref_spec){ RPIMG_GBUFFER0,
-					.usage = RG_IMAGE_USE_COLOR_INPUT_ATTACHMENT_BIT,
-					.input_attachment_index = 2 },
-				(struct rg_image_ref_spec){ RPIMG_GBUFFER1,
-					.usage = RG_IMAGE_USE_COLOR_INPUT_ATTACHMENT_BIT,
-					.input_attachment_index = 3 },
-				(struct rg_image_ref_spec){ RPIMG_GBUFFER2,
-					.usage = RG_IMAGE_USE_COLOR_INPUT_ATTACHMENT_BIT,
-					.input_attachment_index = 4 },
-			},
-		},
-		[RPASS_HDR_LIGHTING] = (struct rg_pass_spec){
-			.name = "HDR Lighting",
-			.image_ref_count = 5,
-			.image_refs = (struct rg_image_ref_spec[5]){
-				(struct rg_image_ref_spec){ RPIMG_COLOR0,
-					.usage = RG_IMAGE_USE_COLOR_INPUT_ATTACHMENT_BIT,
-					.input_attachment_index = 0 },
-				(struct rg_image_ref_spec){ RPIMG_DEPTH0,
-					.usage = RG_IMAGE_USE_DEPTH_INPUT_ATTACHMENT_BIT,
-					.input_attachment_index = 1 },
-				(struct rg_image_ref_spec){ RPIMG_GBUFFER0,
-					.usage = RG_IMAGE_USE_COLOR_INPUT_ATTACHMENT_BIT,
-					.input_attachment_index = 2 },
-				(struct rg_image_ref_spec){ RPIMG_GBUFFER1,
-					.usage = RG_IMAGE_USE_COLOR_INPUT_ATTACHMENT_BIT,
-					.input_attachment_index = 3 },
-				(struct rg_image_ref_spec){ RPIMG_GBUFFER2,
-					.usage = RG_IMAGE_USE_COLOR_INPUT_ATTACHMENT_BIT,
-					.input_attachment_index = 4 },
-			},
+static VkMemoryRequirements image_memory_requirements(struct vulkan_renderer *r, VkImage image) {
+	VkMemoryRequirements requirements = {};
+	vkGetImageMemoryRequirements(r->device, image, &requirements);
+	return requirements;
+}
+
+/// A 2D view of one mip of `image`.
+static VkImageView create_image_view(
+	struct vulkan_renderer *r,
+	VkImage image,
+	VkFormat format,
+	VkImageAspectFlags aspect,
+	uint32_t mip
+) {
+	VkImageView view = VK_NULL_HANDLE;
+	CHECKVK(vkCreateImageView(r->device, &(VkImageViewCreateInfo){
+		.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+		.image = image,
+		.viewType = VK_IMAGE_VIEW_TYPE_2D,
+		.format = format,
+		.subresourceRange = (VkImageSubresourceRange){
+			.aspectMask = aspect,
+			.baseArrayLayer = 0,
+			.layerCount = 1,
+			.baseMipLevel = mip,
+			.levelCount = 1,
 		},
-		[RPASS_BLOOM] = (struct rg_pass_spec){
-			.name = "Bloom",
-			.image_ref_count = 1,
-			.image_refs = (struct rg_image_ref_spec[1]){
-				(struct rg_image_ref_spec){
-					.image_id = RPIMG_COLOR0,
-					.usage = RG_IMAGE_USE_OTHER | RG_IMAGE_USE_SAMPLED_BIT,
-					.access = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
-					.stage = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
-					.layout = VK_IMAGE_LAYOUT_GENERAL,
-					.final_layout = VK_IMAGE_LAYOUT_GENERAL,
-				},
-			},
-			.compute = true,
+	}, nullptr, &view));
+	return view;
+}
+
+/// Allocate the heaps the render graph placed the transients in, bind them there, and create their views.
+/// The graph discards the images when they take over the memory, so they don't need a layout yet.
+static void bind_graph_images(struct vulkan_renderer *r) {
+	r->rgraph_heaps_own = calloc(r->rgraph.memory_heap_count, sizeof(*r->rgraph_heaps_own));
+	for (uint32_t i = 0; i < r->rgraph.memory_heap_count; ++i) {
+		const struct rg_memory_heap *heap = &r->rgraph.memory_heaps_own[i];
+		CHECKVK(vmaAllocateMemory(r->allocator, &(VkMemoryRequirements){
+			.size = heap->size,
+			.alignment = heap->alignment,
+			.memoryTypeBits = heap->memory_type_bits,
+		}, &(VmaAllocationCreateInfo){
+			.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT,
+			.preferredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		}, &r->rgraph_heaps_own[i], nullptr));
+	}
+	for (uint32_t i = 0; i < r->rgraph.image_count; ++i) {
+		const struct rg_graph_image *image = &r->rgraph.images_own[i];
+		if (image->memory_heap == UINT32_MAX) continue;
+		CHECKVK(vmaBindImageMemory2(r->allocator, r->rgraph_heaps_own[image->memory_heap],
+			image->memory_offset, image->image, nullptr));
+	}
+
+	r->depth_image.view = create_image_view(r, r->depth_image.image, r->depth_format, VK_IMAGE_ASPECT_DEPTH_BIT, 0);
+	NAME_VK_OBJECT(r, r->depth_image.view, VK_OBJECT_TYPE_IMAGE_VIEW, "transient depth0 image view");
+	rg_graph_set_image_view(&r->rgraph, RPIMG_DEPTH0, r->depth_image.view);
+	r->transients.color_0.view = create_image_view(r, r->transients.color_0.image,
+		VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, 0);
+	NAME_VK_OBJECT(r, r->transients.color_0.view, VK_OBJECT_TYPE_IMAGE_VIEW, "transient color0 image view");
+	rg_graph_set_image_view(&r->rgraph, RPIMG_COLOR0, r->transients.color_0.view);
+	for (size_t i = 0; i < GBUFFER_IMAGE_COUNT_; ++i) {
+		r->transients.gbuffer[i].image.view = create_image_view(r, r->transients.gbuffer[i].image.image,
+			r->transients.gbuffer[i].format, VK_IMAGE_ASPECT_COLOR_BIT, 0);
+		NAME_VK_OBJECT(r, r->transients.gbuffer[i].image.view, VK_OBJECT_TYPE_IMAGE_VIEW, "GBuffer %s image view",
+			r->transients.gbuffer[i].name);
+		rg_graph_set_image_view(&r->rgraph, RPIMG_GBUFFER0 + i, r->transients.gbuffer[i].image.view);
+	}
+	for (size_t i = 0; i < BLOOM_STAGE_COUNT; ++i) {
+		r->transients.bloom_mip_views[i] = create_image_view(r, r->transients.bloom.image,
+			VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, i);
+		NAME_VK_OBJECT(r, r->transients.bloom_mip_views[i], VK_OBJECT_TYPE_IMAGE_VIEW,
+			"transient bloom mip #%zu image view", i);
+	}
+	r->transients.atmo_light.view = create_image_view(r, r->transients.atmo_light.image,
+		VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, 0);
+	NAME_VK_OBJECT(r, r->transients.atmo_light.view, VK_OBJECT_TYPE_IMAGE_VIEW, "transient half-res atmo light image view");
+	rg_graph_set_image_view(&r->rgraph, RPIMG_ATMO_LIGHT, r->transients.atmo_light.view);
+}
+
+static void init_rendergraph(struct vulkan_renderer *r) {
+	struct pshine_renderer_graph_info info = {
+		.swapchain_format = r->surface_format.format,
+		.depth_format = r->depth_format,
+		.shadow_depth_format = r->shadow_depth_format,
+		.gbuffer_formats = {
+			r->transients.gbuffer[0].format,
+			r->transients.gbuffer[1].format,
+			r->transients.gbuffer[2].format,
 		},
-		[RPASS_SDR_TONEMAP] = (struct rg_pass_spec){
-			.name = "SDR Tonemap",
-			.image_ref_count = 3,
-			.image_refs = (struct rg_image_ref_spec[3]){
-				{ RG_IMAGE_SWAPCHAIN, RG_IMAGE_USE_COLOR_ATTACHMENT_BIT | RG_IMAGE_USE_NO_READ_BIT },
-				{ RPIMG_COLOR0, RG_IMAGE_USE_SAMPLED_BIT },
-				{ RPIMG_DEPTH0, RG_IMAGE_USE_SAMPLED_BIT },
-			},
+		.atmo_view_lut_format = atmo_view_lut_format,
+		.shadow_extent = { r->transients.shadow.width, r->transients.shadow.height },
+		.has_async_compute_queue = r->async_compute,
+		.async_compute_queue_family_index = r->queue_families[QUEUE_COMPUTE],
+		.images = {
+			[RPIMG_COLOR0] = r->transients.color_0.image,
+			[RPIMG_DEPTH0] = r->depth_image.image,
+			[RPIMG_GBUFFER0] = r->transients.gbuffer[0].image.image,
+			[RPIMG_GBUFFER1] = r->transients.gbuffer[1].image.image,
+			[RPIMG_GBUFFER2] = r->transients.gbuffer[2].image.image,
+			[RPIMG_BLOOM] = r->transients.bloom.image,
+			[RPIMG_SHADOW0] = r->transients.shadow.image,
+			[RPIMG_SHADOWC] = r->transients.color_s.image,
+			[RPIMG_ATMO_SKY_VIEW] = r->atmo_sky_view_luts.image,
+			[RPIMG_ATMO_AERIAL] = r->atmo_aerial_luts.image,
+			[RPIMG_ATMO_LIGHT] = r->transients.atmo_light.image,
+			[RPIMG_ATMO_HISTORY] = r->transients.atmo_history.image,
+			[RPIMG_ATMO_HISTORY_DEPTH] = r->transients.atmo_history_depth.image,
 		},
-		[RPASS_SDR_GUI] = (struct rg_pass_spec){
-			.name = "SDR GUI",
-			.image_ref_count = 2,
-			.image_refs = (struct rg_image_ref_spec[2]){
-				{ RG_IMAGE_SWAPCHAIN, RG_IMAGE_USE_COLOR_ATTACHMENT_BIT },
-				// { RPIMG_COLOR0, RG_IMAGE_USE_SAMPLED_BIT },
-				// { RPIMG_DEPTH0, RG_IMAGE_USE_SAMPLED_BIT },
-				{ RPIMG_SHADOWC, RG_IMAGE_USE_SAMPLED_BIT },
-			},
+		// the views of the placed images are set by `bind_graph_images`.
+		.views = {
+			[RPIMG_SHADOW0] = r->transients.shadow.view,
+			[RPIMG_SHADOWC] = r->transients.color_s.view,
+			[RPIMG_ATMO_SKY_VIEW] = r->atmo_sky_view_luts.view,
+			[RPIMG_ATMO_AERIAL] = r->atmo_aerial_luts.view,
+			[RPIMG_ATMO_HISTORY] = r->transients.atmo_history_views[0],
+			[RPIMG_ATMO_HISTORY_DEPTH] = r->transients.atmo_history_depth_views[0],
 		},
 	};
-	rg_build_graph(&(struct rg_graph_spec){
-		.image_count = RPIMG_COUNT_,
-		.images = (struct rg_graph_image_spec[RPIMG_COUNT_]){
-			[RPIMG_COLOR0] = {
-				"Color 0",
-				r->transients.color_0.image,
-				r->transients.color_0.view,
-				VK_FORMAT_R16G16B16A16_SFLOAT,
-				VK_IMAGE_ASPECT_COLOR_BIT
-			},
-			[RPIMG_DEPTH0] = {
-				"Depth 0",
-				r->depth_image.image,
-				r->depth_image.view,
-				r->depth_format,
-				VK_IMAGE_ASPECT_DEPTH_BIT
-			},
-			[RPIMG_GBUFFER0] = {
-				"GBuffer 0",
-				r->transients.gbuffer[0].image.image,
-				r->transients.gbuffer[0].image.view,
-				r->transients.gbuffer[0].format,
-				VK_IMAGE_ASPECT_COLOR_BIT,
-			},
-			[RPIMG_GBUFFER1] = {
-				"GBuffer 1",
-				r->transients.gbuffer[1].image.image,
-				r->transients.gbuffer[1].image.view,
-				r->transients.gbuffer[1].format,
-				VK_IMAGE_ASPECT_COLOR_BIT,
-			},
-			[RPIMG_GBUFFER2] = {
-				"GBuffer 2",
-				r->transients.gbuffer[2].image.image,
-				r->transients.gbuffer[2].image.view,
-				r->transients.gbuffer[2].format,
-				VK_IMAGE_ASPECT_COLOR_BIT,
-			},
-			[RPIMG_SHADOW0] = {
-				"Shadow 0",
-				r->transients.shadow[0].image,
-				r->transients.shadow[0].view,
-				r->shadow_depth_format,
-				VK_IMAGE_ASPECT_DEPTH_BIT,
-			},
-			[RPIMG_SHADOWC] = {
-				"Shadow Color",
-				r->transients.color_s.image,
-				r->transients.color_s.view,
-				VK_FORMAT_R8G8B8A8_SRGB,
-				VK_IMAGE_ASPECT_COLOR_BIT,
-			},
-		},
-		.pass_count = sizeof(rpasses) / sizeof(*rpasses),
-		.passes = rpasses,
-	}, &r->rgraph);
+	for (uint32_t i = 0; i < RPIMG_COUNT_; ++i)
+		if (info.views[i] == VK_NULL_HANDLE) info.memory_requirements[i] = image_memory_requirements(r, info.images[i]);
+	struct pshine_renderer_graph_storage storage;
+	struct rg_graph_spec spec = pshine_make_renderer_graph_spec(&info, &storage);
+	rg_build_graph(&spec, &r->rgraph);
+	// `render_game_frame` records the first segment into `per_frame_data::command_buffer`.
+	PSHINE_CHECK(r->rgraph.segment_count <= FRAME_SEGMENT_COUNT_MAX, "too many render graph segments");
+	PSHINE_CHECK(r->rgraph.segments_own[0].queue == RG_QUEUE_MAIN, "the first render graph segment must be graphics");
+	bind_graph_images(r);
+	// reset on the host by `render_begin`, so not device-only.
+	r->rgraph_events_own = calloc(PSHINE_MAX_FRAMES_IN_FLIGHT * r->rgraph.event_count + 1, sizeof(*r->rgraph_events_own));
+	for (uint32_t i = 0; i < PSHINE_MAX_FRAMES_IN_FLIGHT * r->rgraph.event_count; ++i)
+		CHECKVK(vkCreateEvent(r->device, &(VkEventCreateInfo){
+			.sType = VK_STRUCTURE_TYPE_EVENT_CREATE_INFO,
+		}, nullptr, &r->rgraph_events_own[i]));
+	// without timestamps on both queues there is nothing to profile, and `render_game_frame` skips it.
+	if (r->timestamp_valid_bits != 0)
+		pshine_gpu_perf_init(&r->gpu_perf, r->device, &r->rgraph, PSHINE_MAX_FRAMES_IN_FLIGHT,
+			r->physical_device_properties_own->properties.limits.timestampPeriod,
+			r->timestamp_valid_bits, r->pipeline_statistics);
+	PSHINE_INFO("render graph: %u passes (%u culled), %u split barriers",
+		r->rgraph.pass_count, r->rgraph.culled_pass_count, r->rgraph.event_count);
+	PSHINE_INFO("render graph transient memory: %.2f MiB, %.2f MiB without aliasing",
+		r->rgraph.aliased_memory_size / (1024.0 * 1024.0), r->rgraph.unaliased_memory_size / (1024.0 * 1024.0));
 }
 
 static void deinit_rendergraph(struct vulkan_renderer *r) {
+	for (uint32_t i = 0; i < r->rgraph.memory_heap_count; ++i)
+		vmaFreeMemory(r->allocator, r->rgraph_heaps_own[i]);
+	free(r->rgraph_heaps_own);
+	r->rgraph_heaps_own = nullptr;
+	for (uint32_t i = 0; i < PSHINE_MAX_FRAMES_IN_FLIGHT * r->rgraph.event_count; ++i)
+		vkDestroyEvent(r->device, r->rgraph_events_own[i], nullptr);
+	free(r->rgraph_events_own);
+	r->rgraph_events_own = nullptr;
+	if (r->gpu_perf.frame_count != 0) pshine_gpu_perf_deinit(&r->gpu_perf);
 	rg_free_graph(&r->rgraph);
 }
 
@@ -3137,62 +3930,32 @@ static void init_view_dep_data(struct vulkan_renderer *r, bool resize);
 static void handle_swapchain_resize(struct vulkan_renderer *r) {
 	vkDeviceWaitIdle(r->device);
 	// deinit_fbufs(r);
+	// the graph has the images, and places them in memory for their new size.
+	deinit_rendergraph(r);
 	deinit_transients(r);
 	deinit_swapchain(r);
 	reinit_swapchain(r);
 	init_transients(r);
+	init_rendergraph(r);
 	// init_fbufs(r);
 	init_view_dep_data(r, true);
-	for (size_t i = 0; i < r->game->star_system_count; ++i) {
-		struct pshine_star_system *system = &r->game->star_systems_own[i];
-		for (size_t j = 0; j < system->body_count; ++j) {
-			struct pshine_celestial_body *body = system->bodies_own[j];
-			if (body->type == PSHINE_CELESTIAL_BODY_PLANET) {
-				struct pshine_planet *p = (void*)body;
-				vkUpdateDescriptorSets(r->device, 3, (VkWriteDescriptorSet[3]){
-					(VkWriteDescriptorSet){
-						.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-						.descriptorCount = 1,
-						.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,
-						.dstSet = p->graphics_data->atmo_descriptor_set,
-						.dstBinding = 1,
-						.dstArrayElement = 0,
-						.pImageInfo = &(VkDescriptorImageInfo){
-							.imageLayout = VK_IMAGE_LAYOUT_RENDERING_LOCAL_READ,
-							.imageView = r->transients.color_0.view,
-							.sampler = VK_NULL_HANDLE,
-						}
-					},
-					(VkWriteDescriptorSet){
-						.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-						.descriptorCount = 1,
-						.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,
-						.dstSet = p->graphics_data->atmo_descriptor_set,
-						.dstBinding = 2,
-						.dstArrayElement = 0,
-						.pImageInfo = &(VkDescriptorImageInfo){
-							.imageLayout = VK_IMAGE_LAYOUT_RENDERING_LOCAL_READ,
-							.imageView = r->depth_image.view,
-							.sampler = VK_NULL_HANDLE
-						}
-					},
-					(VkWriteDescriptorSet){
-						.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-						.descriptorCount = 1,
-						.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,
-						.dstSet = p->graphics_data->atmo_descriptor_set,
-						.dstBinding = 4,
-						.dstArrayElement = 0,
-						.pImageInfo = &(VkDescriptorImageInfo){
-							.imageLayout = VK_IMAGE_LAYOUT_RENDERING_LOCAL_READ,
-							.imageView = r->transients.gbuffer[GBUFFER_IMAGE_DIFFUSE_O].image.view,
-							.sampler = VK_NULL_HANDLE
-						}
-					},
-				}, 0, nullptr);
-			}
-		}
-	}
+}
+
+/// Apply changes to `pshine_render_settings::frames_in_flight` and `present_mode`. The per-frame data
+/// exists for every frame count, so this only waits for the GPU and recreates the swapchain.
+static void apply_frame_settings(struct vulkan_renderer *r, uint32_t *current_frame) {
+	struct pshine_render_settings *settings = &r->as_base.settings;
+	if (settings->frames_in_flight < 1) settings->frames_in_flight = 1;
+	if (settings->frames_in_flight > PSHINE_MAX_FRAMES_IN_FLIGHT) settings->frames_in_flight = PSHINE_MAX_FRAMES_IN_FLIGHT;
+	if (settings->frames_in_flight == r->frames_in_flight && settings->present_mode == r->requested_present_mode)
+		return;
+	vkDeviceWaitIdle(r->device);
+	r->frames_in_flight = settings->frames_in_flight;
+	deinit_swapchain(r);
+	reinit_swapchain(r);
+	// every frame is done, so any can be next.
+	*current_frame = 0;
+	PSHINE_INFO("%u frames in flight, present mode %s", r->frames_in_flight, present_mode_names[r->present_mode]);
 }
 
 // Pipelines
@@ -3265,7 +4028,7 @@ static const VkPipelineVertexInputStateCreateInfo vulkan_planet_vertex_input_sta
 		.inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
 		.stride = sizeof(struct pshine_planet_vertex)
 	},
-	.vertexAttributeDescriptionCount = 3,
+	.vertexAttributeDescriptionCount = 4,
 	.pVertexAttributeDescriptions = (VkVertexInputAttributeDescription[]){
 		(VkVertexInputAttributeDescription){
 			.binding = 0,
@@ -3285,6 +4048,12 @@ static const VkPipelineVertexInputStateCreateInfo vulkan_planet_vertex_input_sta
 			.location = 2,
 			.offset = offsetof(struct pshine_planet_vertex, tangent_dia)
 		},
+		(VkVertexInputAttributeDescription){
+			.binding = 0,
+			.format = VK_FORMAT_R32G32B32_SFLOAT,
+			.location = 3,
+			.offset = offsetof(struct pshine_planet_vertex, morph_target)
+		},
 	},
 };
 
@@ -3371,7 +4140,7 @@ static struct vulkan_pipeline create_graphics_pipeline(
 	default: PSHINE_PANIC("vertex kind %d not implemented.", info->vertex_kind);
 	}
 
-	struct rg_pass *pass = &r->rgraph.passes_own[info->render_pass];
+	struct rg_pass *pass = rg_graph_get_pass(&r->rgraph, info->render_pass);
 	uint32_t color_attachment_count = pass->color_attachment_count;
 	VkFormat color_attachment_formats[8] = {};
 	VkPipelineColorBlendAttachmentState color_blend_states[8] = {};
@@ -3598,7 +4367,14 @@ INIT_PIPELINE_JOB_FN(std_mesh_shadow, {
 	.vert_fname = SHADERS_PATH "/std_mesh.shadow.vert.spv",
 	.frag_fname = SHADERS_PATH "/std_mesh.shadow.frag.spv",
 	.render_pass = RPASS_SHADOW,
-	.push_constant_range_count = 0,
+	.push_constant_range_count = 1,
+	.push_constant_ranges = (VkPushConstantRange[]){
+		(VkPushConstantRange){
+			.offset = 0,
+			.size = sizeof(float4x4),
+			.stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+		}
+	},
 	.set_layout_count = 1,
 	.set_layouts = (VkDescriptorSetLayout[]){
 		r->descriptors.std_mesh_layout,
@@ -3672,6 +4448,22 @@ INIT_PIPELINE_JOB_FN(atmo, {
 	.layout_name = "atmosphere pipeline layout",
 	.pipeline_name = "atmosphere pipeline",
 });
+INIT_PIPELINE_JOB_FN(atmo_upsample, {
+	.vert_fname = SHADERS_PATH "/atmo.vert.spv",
+	.frag_fname = SHADERS_PATH "/atmo_upsample.frag.spv",
+	.render_pass = RPASS_HDR_ATMOSPHERE,
+	.push_constant_range_count = 0,
+	.set_layout_count = 1,
+	.set_layouts = (VkDescriptorSetLayout[]){
+		r->descriptors.atmo_upsample_layout,
+	},
+	.blend = false,
+	.depth = GRAPHICS_PIPELINE_DEPTH_NONE,
+	.vertex_kind = false,
+	.output_kind = GRAPHICS_PIPELINE_OUTPUT_COLOR,
+	.layout_name = "atmosphere upsample pipeline layout",
+	.pipeline_name = "atmosphere upsample pipeline",
+});
 INIT_PIPELINE_JOB_FN(blit, {
 	.vert_fname = SHADERS_PATH "/blit.vert.spv",
 	.frag_fname = SHADERS_PATH "/blit.frag.spv",
@@ -3680,7 +4472,7 @@ INIT_PIPELINE_JOB_FN(blit, {
 	.push_constant_ranges = (VkPushConstantRange[]) {
 		(VkPushConstantRange){
 			.offset = 0,
-			.size = sizeof(struct pshine_graphics_settings),
+			.size = sizeof(struct tonemap_push_constants),
 			.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
 		},
 	},
@@ -3695,8 +4487,32 @@ INIT_PIPELINE_JOB_FN(blit, {
 	.layout_name = "blit pipeline layout",
 	.pipeline_name = "blit pipeline",
 });
-static void init_pipelines_job_bloom(struct pshine_job *job) { \
-	struct vulkan_renderer *r = job->user; \
+static VkPipeline create_compute_pipeline(
+	struct vulkan_renderer *r,
+	VkPipelineLayout layout,
+	const char *fname,
+	const char *name
+) {
+	VkPipeline pipeline;
+	VkShaderModule comp_shader_module = create_shader_module_file(r, fname);
+	vkCreateComputePipelines(r->device, VK_NULL_HANDLE, 1, &(VkComputePipelineCreateInfo){
+		.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+		.layout = layout,
+		.stage = (VkPipelineShaderStageCreateInfo){
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			.pSpecializationInfo = nullptr,
+			.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+			.module = comp_shader_module,
+			.pName = "main",
+		},
+	}, nullptr, &pipeline);
+	NAME_VK_OBJECT(r, pipeline, VK_OBJECT_TYPE_PIPELINE, name);
+	vkDestroyShaderModule(r->device, comp_shader_module, nullptr);
+	return pipeline;
+}
+
+static void init_pipelines_job_atmo_luts(struct pshine_job *job) {
+	struct vulkan_renderer *r = job->user;
 	vkCreatePipelineLayout(r->device, &(VkPipelineLayoutCreateInfo){
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
 		.setLayoutCount = 1,
@@ -3708,22 +4524,49 @@ static void init_pipelines_job_bloom(struct pshine_job *job) { \
 			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
 		}
 	}, nullptr, &r->pipelines.atmo_lut_layout);
+	NAME_VK_OBJECT(r, r->pipelines.atmo_lut_layout, VK_OBJECT_TYPE_PIPELINE_LAYOUT, "atmo lut pipeline layout");
+	r->pipelines.atmo_lut_pipeline = create_compute_pipeline(r, r->pipelines.atmo_lut_layout,
+		SHADERS_PATH "/atmo_lut.comp.spv", "atmo lut pipeline");
+	r->pipelines.atmo_multiscatter_pipeline = create_compute_pipeline(r, r->pipelines.atmo_lut_layout,
+		SHADERS_PATH "/atmo_multiscatter.comp.spv", "atmo multiscatter pipeline");
+
+	vkCreatePipelineLayout(r->device, &(VkPipelineLayoutCreateInfo){
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.setLayoutCount = 2,
+		.pSetLayouts = (VkDescriptorSetLayout[]){
+			r->descriptors.global_layout,
+			r->descriptors.atmo_view_lut_layout,
+		},
+		.pushConstantRangeCount = 0,
+	}, nullptr, &r->pipelines.atmo_view_lut_layout);
+	NAME_VK_OBJECT(r, r->pipelines.atmo_view_lut_layout, VK_OBJECT_TYPE_PIPELINE_LAYOUT,
+		"atmo view lut pipeline layout");
+	r->pipelines.atmo_sky_view_pipeline = create_compute_pipeline(r, r->pipelines.atmo_view_lut_layout,
+		SHADERS_PATH "/atmo_sky_view.comp.spv", "atmo sky-view pipeline");
+	r->pipelines.atmo_aerial_pipeline = create_compute_pipeline(r, r->pipelines.atmo_view_lut_layout,
+		SHADERS_PATH "/atmo_aerial.comp.spv", "atmo aerial perspective pipeline");
+
+	vkCreatePipelineLayout(r->device, &(VkPipelineLayoutCreateInfo){
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.setLayoutCount = 3,
+		.pSetLayouts = (VkDescriptorSetLayout[]){
+			r->descriptors.global_layout,
+			r->descriptors.atmo_layout,
+			r->descriptors.atmo_half_res_layout,
+		},
+		.pushConstantRangeCount = 0,
+	}, nullptr, &r->pipelines.atmo_half_res_layout);
+	NAME_VK_OBJECT(r, r->pipelines.atmo_half_res_layout, VK_OBJECT_TYPE_PIPELINE_LAYOUT,
+		"half-res atmo pipeline layout");
+	r->pipelines.atmo_half_pipeline = create_compute_pipeline(r, r->pipelines.atmo_half_res_layout,
+		SHADERS_PATH "/atmo_half.comp.spv", "half-res atmo pipeline");
+	r->pipelines.atmo_resolve_pipeline = create_compute_pipeline(r, r->pipelines.atmo_half_res_layout,
+		SHADERS_PATH "/atmo_resolve.comp.spv", "half-res atmo resolve pipeline");
+}
 
+static void init_pipelines_job_bloom(struct pshine_job *job) { \
+	struct vulkan_renderer *r = job->user; \
 	{
-		VkShaderModule comp_shader_module = create_shader_module_file(r, SHADERS_PATH "/atmo_lut.comp.spv");
-		vkCreateComputePipelines(r->device, VK_NULL_HANDLE, 1, &(VkComputePipelineCreateInfo){
-			.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
-			.layout = r->pipelines.atmo_lut_layout,
-			.stage = (VkPipelineShaderStageCreateInfo){
-				.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-				.pSpecializationInfo = nullptr,
-				.stage = VK_SHADER_STAGE_COMPUTE_BIT,
-				.module = comp_shader_module,
-				.pName = "main",
-			},
-		}, nullptr, &r->pipelines.atmo_lut_pipeline);
-		NAME_VK_OBJECT(r, r->pipelines.atmo_lut_pipeline, VK_OBJECT_TYPE_PIPELINE, "atmo lut pipeline");
-		vkDestroyShaderModule(r->device, comp_shader_module, nullptr);
 		vkCreatePipelineLayout(r->device, &(VkPipelineLayoutCreateInfo){
 			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
 			.setLayoutCount = 1,
@@ -3732,7 +4575,7 @@ static void init_pipelines_job_bloom(struct pshine_job *job) { \
 			.pPushConstantRanges = (VkPushConstantRange[]){
 				(VkPushConstantRange){
 					.offset = 0,
-					.size = sizeof(struct pshine_graphics_settings),
+					.size = sizeof(struct bloom_push_constants),
 					.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
 				},
 			},
@@ -3765,7 +4608,7 @@ static void init_pipelines_job_bloom(struct pshine_job *job) { \
 			.pPushConstantRanges = (VkPushConstantRange[]){
 				(VkPushConstantRange){
 					.offset = 0,
-					.size = sizeof(struct pshine_graphics_settings),
+					.size = sizeof(struct bloom_push_constants),
 					.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
 				},
 			},
@@ -3788,28 +4631,7 @@ static void init_pipelines_job_bloom(struct pshine_job *job) { \
 						(VkSpecializationMapEntry){ .constantID = 0, .offset = 0, .size = sizeof(uint32_t) },
 					},
 					.dataSize = sizeof(uint32_t),
-					.pData = &(int){ 1 },
-				},
-				.stage = VK_SHADER_STAGE_COMPUTE_BIT,
-				.module = comp_shader_module,
-				.pName = "main",
-			},
-		}, nullptr, &r->pipelines.first_downsample_bloom_pipeline);
-		NAME_VK_OBJECT(r, r->pipelines.first_downsample_bloom_pipeline, VK_OBJECT_TYPE_PIPELINE,
-			"first-downsample&bloom pipeline");
-
-		vkCreateComputePipelines(r->device, VK_NULL_HANDLE, 1, &(VkComputePipelineCreateInfo){
-			.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
-			.layout = r->pipelines.downsample_bloom_layout,
-			.stage = (VkPipelineShaderStageCreateInfo){
-				.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-				.pSpecializationInfo = &(VkSpecializationInfo){
-					.mapEntryCount = 1,
-					.pMapEntries = (VkSpecializationMapEntry[]){
-						(VkSpecializationMapEntry){ .constantID = 0, .offset = 0, .size = sizeof(uint32_t) },
-					},
-					.dataSize = sizeof(uint32_t),
-					.pData = &(int){ 0 },
+					.pData = &(uint32_t){ BLOOM_STAGE_COUNT },
 				},
 				.stage = VK_SHADER_STAGE_COMPUTE_BIT,
 				.module = comp_shader_module,
@@ -3837,6 +4659,8 @@ static void add_pipelines_jobs(struct vulkan_renderer *r) {
 	ADD_JOB(init_pipelines_job_light, "Deferred Lighting Shaders");
 	ADD_JOB(init_pipelines_job_skybox, "Skybox Shaders");
 	ADD_JOB(init_pipelines_job_atmo, "Atmosphere Shaders");
+	ADD_JOB(init_pipelines_job_atmo_upsample, "Atmosphere Upsample Shaders");
+	ADD_JOB(init_pipelines_job_atmo_luts, "Atmosphere LUT Shaders");
 	ADD_JOB(init_pipelines_job_blit, "Blit Shaders");
 	ADD_JOB(init_pipelines_job_bloom, "Bloom Shaders");
 }
@@ -3848,8 +4672,17 @@ static void deinit_pipelines(struct vulkan_renderer *r) {
 	vkDestroyPipelineLayout(r->device, r->pipelines.planet_color_mesh_layout, nullptr);
 	vkDestroyPipeline(r->device, r->pipelines.atmo_pipeline, nullptr);
 	vkDestroyPipelineLayout(r->device, r->pipelines.atmo_layout, nullptr);
+	vkDestroyPipeline(r->device, r->pipelines.atmo_upsample_pipeline, nullptr);
+	vkDestroyPipelineLayout(r->device, r->pipelines.atmo_upsample_layout, nullptr);
 	vkDestroyPipeline(r->device, r->pipelines.atmo_lut_pipeline, nullptr);
+	vkDestroyPipeline(r->device, r->pipelines.atmo_multiscatter_pipeline, nullptr);
 	vkDestroyPipelineLayout(r->device, r->pipelines.atmo_lut_layout, nullptr);
+	vkDestroyPipeline(r->device, r->pipelines.atmo_sky_view_pipeline, nullptr);
+	vkDestroyPipeline(r->device, r->pipelines.atmo_aerial_pipeline, nullptr);
+	vkDestroyPipelineLayout(r->device, r->pipelines.atmo_view_lut_layout, nullptr);
+	vkDestroyPipeline(r->device, r->pipelines.atmo_half_pipeline, nullptr);
+	vkDestroyPipeline(r->device, r->pipelines.atmo_resolve_pipeline, nullptr);
+	vkDestroyPipelineLayout(r->device, r->pipelines.atmo_half_res_layout, nullptr);
 	vkDestroyPipeline(r->device, r->pipelines.blit_pipeline, nullptr);
 	vkDestroyPipelineLayout(r->device, r->pipelines.blit_layout, nullptr);
 	vkDestroyPipeline(r->device, r->pipelines.light_pipeline, nullptr);
@@ -3866,7 +4699,6 @@ static void deinit_pipelines(struct vulkan_renderer *r) {
 	vkDestroyPipelineLayout(r->device, r->pipelines.std_mesh_shadow_layout, nullptr);
 	vkDestroyPipeline(r->device, r->pipelines.upsample_bloom_pipeline, nullptr);
 	vkDestroyPipelineLayout(r->device, r->pipelines.upsample_bloom_layout, nullptr);
-	vkDestroyPipeline(r->device, r->pipelines.first_downsample_bloom_pipeline, nullptr);
 	vkDestroyPipeline(r->device, r->pipelines.downsample_bloom_pipeline, nullptr);
 	vkDestroyPipelineLayout(r->device, r->pipelines.downsample_bloom_layout, nullptr);
 }
@@ -3904,11 +4736,23 @@ static void deinit_cmdbufs(struct vulkan_renderer *r) {
 // Synchronization
 
 static void init_sync(struct vulkan_renderer *r) {
-	(void)r;
+	for (uint32_t i = 0; i < RG_QUEUE_COUNT_; ++i) {
+		CHECKVK(vkCreateSemaphore(r->device, &(VkSemaphoreCreateInfo){
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+			.pNext = &(VkSemaphoreTypeCreateInfo){
+				.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+				.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+				.initialValue = 0,
+			},
+		}, nullptr, &r->queue_timelines[i]));
+		NAME_VK_OBJECT(r, r->queue_timelines[i], VK_OBJECT_TYPE_SEMAPHORE, "%s queue timeline semaphore",
+			i == RG_QUEUE_MAIN ? "main" : "async compute");
+		r->queue_timeline_values[i] = 0;
+	}
 }
 
 static void deinit_sync(struct vulkan_renderer *r) {
-	(void)r;
+	for (uint32_t i = 0; i < RG_QUEUE_COUNT_; ++i) vkDestroySemaphore(r->device, r->queue_timelines[i], nullptr);
 }
 
 
@@ -3918,13 +4762,25 @@ static void init_descriptors(struct vulkan_renderer *r) {
 	vkCreateDescriptorPool(r->device, &(VkDescriptorPoolCreateInfo){
 		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
 		.maxSets = 1024,
-		.poolSizeCount = 5,
+		.poolSizeCount = 7,
 		.pPoolSizes = (VkDescriptorPoolSize[]){
 			(VkDescriptorPoolSize){ .descriptorCount = 128, .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER },
-			(VkDescriptorPoolSize){ .descriptorCount = 128, .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC },
-			(VkDescriptorPoolSize){ .descriptorCount = 64, .type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT },
-			(VkDescriptorPoolSize){ .descriptorCount = 128, .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER },
-			(VkDescriptorPoolSize){ .descriptorCount = 64, .type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE },
+			// each planet has two of each atmosphere LUT set, and the per-frame atmosphere sets come on top.
+			(VkDescriptorPoolSize){ .descriptorCount = 160, .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC },
+			(VkDescriptorPoolSize){
+				.descriptorCount = 64 + 3 * PSHINE_MAX_FRAMES_IN_FLIGHT,
+				.type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,
+			},
+			(VkDescriptorPoolSize){
+				.descriptorCount = 320 + 2 * PSHINE_MAX_FRAMES_IN_FLIGHT,
+				.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+			},
+			(VkDescriptorPoolSize){ .descriptorCount = 192, .type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE },
+			(VkDescriptorPoolSize){
+				.descriptorCount = 16 + PSHINE_MAX_FRAMES_IN_FLIGHT,
+				.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+			},
+			(VkDescriptorPoolSize){ .descriptorCount = 4, .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER },
 		}
 	}, nullptr, &r->descriptors.pool);
 	NAME_VK_OBJECT(r, r->descriptors.pool, VK_OBJECT_TYPE_DESCRIPTOR_POOL, "descriptor pool 1");
@@ -3936,7 +4792,7 @@ static void init_descriptors(struct vulkan_renderer *r) {
 			.binding = 0,
 			.descriptorCount = 1,
 			.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
-			.stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS
+			.stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS | VK_SHADER_STAGE_COMPUTE_BIT
 		}
 	}, nullptr, &r->descriptors.global_layout);
 	NAME_VK_OBJECT(r, r->descriptors.global_layout, VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT, "global descriptor set layout");
@@ -3997,13 +4853,13 @@ static void init_descriptors(struct vulkan_renderer *r) {
 
 	vkCreateDescriptorSetLayout(r->device, &(VkDescriptorSetLayoutCreateInfo){
 		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-		.bindingCount = 5,
-		.pBindings = (VkDescriptorSetLayoutBinding[5]){
-			(VkDescriptorSetLayoutBinding){
+		.bindingCount = 6,
+		.pBindings = (VkDescriptorSetLayoutBinding[6]){
+			(VkDescriptorSetLayoutBinding){ // the atmosphere batch
 				.binding = 0,
 				.descriptorCount = 1,
-				.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
-				.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+				.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT,
 			},
 			(VkDescriptorSetLayoutBinding){
 				.binding = 1,
@@ -4017,11 +4873,11 @@ static void init_descriptors(struct vulkan_renderer *r) {
 				.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,
 				.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
 			},
-			(VkDescriptorSetLayoutBinding){
+			(VkDescriptorSetLayoutBinding){ // sky-view LUTs
 				.binding = 3,
 				.descriptorCount = 1,
 				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-				.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+				.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT,
 			},
 			(VkDescriptorSetLayoutBinding){
 				.binding = 4,
@@ -4029,6 +4885,12 @@ static void init_descriptors(struct vulkan_renderer *r) {
 				.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,
 				.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
 			},
+			(VkDescriptorSetLayoutBinding){ // aerial perspective volumes
+				.binding = 5,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT,
+			},
 		}
 	}, nullptr, &r->descriptors.atmo_layout);
 	NAME_VK_OBJECT(r, r->descriptors.atmo_layout, VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT,
@@ -4036,14 +4898,26 @@ static void init_descriptors(struct vulkan_renderer *r) {
 
 	vkCreateDescriptorSetLayout(r->device, &(VkDescriptorSetLayoutCreateInfo){
 		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-		.bindingCount = 1,
+		.bindingCount = 3,
 		.pBindings = (VkDescriptorSetLayoutBinding[]){
-			(VkDescriptorSetLayoutBinding){
+			(VkDescriptorSetLayoutBinding){ // transmittance LUT
 				.binding = 0,
 				.descriptorCount = 1,
 				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
 				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
 			},
+			(VkDescriptorSetLayoutBinding){ // multiple scattering LUT
+				.binding = 1,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			},
+			(VkDescriptorSetLayoutBinding){ // transmittance LUT, for the multiple scattering one
+				.binding = 2,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			},
 		}
 	}, nullptr, &r->descriptors.atmo_lut_layout);
 	NAME_VK_OBJECT(r, r->descriptors.atmo_lut_layout, VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT,
@@ -4051,26 +4925,65 @@ static void init_descriptors(struct vulkan_renderer *r) {
 
 	vkCreateDescriptorSetLayout(r->device, &(VkDescriptorSetLayoutCreateInfo){
 		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-		.bindingCount = 3,
-		.pBindings = (VkDescriptorSetLayoutBinding[3]){
-			(VkDescriptorSetLayoutBinding){ // color0
+		.bindingCount = 5,
+		.pBindings = (VkDescriptorSetLayoutBinding[]){
+			(VkDescriptorSetLayoutBinding){
 				.binding = 0,
 				.descriptorCount = 1,
-				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-				.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+				.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
 			},
-			(VkDescriptorSetLayoutBinding){ // depth0
+			(VkDescriptorSetLayoutBinding){ // transmittance LUT
 				.binding = 1,
 				.descriptorCount = 1,
 				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-				.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
 			},
-			(VkDescriptorSetLayoutBinding){ // global_uniforms
+			(VkDescriptorSetLayoutBinding){ // multiple scattering LUT
 				.binding = 2,
 				.descriptorCount = 1,
-				.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
-				.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
-			},
+				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			},
+			(VkDescriptorSetLayoutBinding){ // sky-view LUT
+				.binding = 3,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			},
+			(VkDescriptorSetLayoutBinding){ // aerial perspective volume
+				.binding = 4,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			},
+		}
+	}, nullptr, &r->descriptors.atmo_view_lut_layout);
+	NAME_VK_OBJECT(r, r->descriptors.atmo_view_lut_layout, VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT,
+		"atmosphere view lut descriptor set layout");
+
+	vkCreateDescriptorSetLayout(r->device, &(VkDescriptorSetLayoutCreateInfo){
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.bindingCount = 3,
+		.pBindings = (VkDescriptorSetLayoutBinding[3]){
+			(VkDescriptorSetLayoutBinding){ // color0
+				.binding = 0,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+			},
+			(VkDescriptorSetLayoutBinding){ // depth0
+				.binding = 1,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+			},
+			(VkDescriptorSetLayoutBinding){ // global_uniforms
+				.binding = 2,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+				.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+			},
 		}
 	}, nullptr, &r->descriptors.blit_layout);
 	NAME_VK_OBJECT(r, r->descriptors.blit_layout, VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT, "blit descriptor set layout");
@@ -4182,7 +5095,7 @@ static void init_descriptors(struct vulkan_renderer *r) {
 
 	vkCreateDescriptorSetLayout(r->device, &(VkDescriptorSetLayoutCreateInfo){
 		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-		.bindingCount = 2,
+		.bindingCount = 3,
 		.pBindings = (VkDescriptorSetLayoutBinding[]){
 			(VkDescriptorSetLayoutBinding){
 				.binding = 0,
@@ -4192,15 +5105,117 @@ static void init_descriptors(struct vulkan_renderer *r) {
 			},
 			(VkDescriptorSetLayoutBinding){
 				.binding = 1,
-				.descriptorCount = 1,
+				.descriptorCount = BLOOM_STAGE_COUNT,
 				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
 				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
 			},
+			(VkDescriptorSetLayoutBinding){
+				.binding = 2,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			},
 		}
 	}, nullptr, &r->descriptors.downsample_bloom_layout);
 	NAME_VK_OBJECT(r, r->descriptors.downsample_bloom_layout, VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT,
 		"downsample&bloom descriptor set layout");
 
+	vkCreateDescriptorSetLayout(r->device, &(VkDescriptorSetLayoutCreateInfo){
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.bindingCount = 7,
+		.pBindings = (VkDescriptorSetLayoutBinding[]){
+			(VkDescriptorSetLayoutBinding){
+				.binding = 0,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			},
+			(VkDescriptorSetLayoutBinding){ // depth
+				.binding = 1,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			},
+			(VkDescriptorSetLayoutBinding){ // this frame's light
+				.binding = 2,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			},
+			(VkDescriptorSetLayoutBinding){ // the last frame's history
+				.binding = 3,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			},
+			(VkDescriptorSetLayoutBinding){
+				.binding = 4,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			},
+			(VkDescriptorSetLayoutBinding){ // this frame's history
+				.binding = 5,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			},
+			(VkDescriptorSetLayoutBinding){
+				.binding = 6,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			},
+		}
+	}, nullptr, &r->descriptors.atmo_half_res_layout);
+	NAME_VK_OBJECT(r, r->descriptors.atmo_half_res_layout, VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT,
+		"half-res atmosphere descriptor set layout");
+
+	vkCreateDescriptorSetLayout(r->device, &(VkDescriptorSetLayoutCreateInfo){
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.bindingCount = 6,
+		.pBindings = (VkDescriptorSetLayoutBinding[]){
+			(VkDescriptorSetLayoutBinding){
+				.binding = 0,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+				.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+			},
+			(VkDescriptorSetLayoutBinding){ // history
+				.binding = 1,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+			},
+			(VkDescriptorSetLayoutBinding){
+				.binding = 2,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+			},
+			(VkDescriptorSetLayoutBinding){
+				.binding = 3,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,
+				.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+			},
+			(VkDescriptorSetLayoutBinding){
+				.binding = 4,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,
+				.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+			},
+			(VkDescriptorSetLayoutBinding){
+				.binding = 5,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,
+				.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+			},
+		}
+	}, nullptr, &r->descriptors.atmo_upsample_layout);
+	NAME_VK_OBJECT(r, r->descriptors.atmo_upsample_layout, VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT,
+		"atmosphere upsample descriptor set layout");
+
 	vkCreateDescriptorSetLayout(r->device, &(VkDescriptorSetLayoutCreateInfo){
 		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
 		.bindingCount = 6,
@@ -4257,7 +5272,7 @@ static void init_descriptors(struct vulkan_renderer *r) {
 		.pBindings = &(VkDescriptorSetLayoutBinding){
 			.binding = 0,
 			.descriptorCount = 1,
-			.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
 			.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
 		}
 	}, nullptr, &r->descriptors.std_mesh_layout);
@@ -4272,6 +5287,9 @@ static void deinit_descriptors(struct vulkan_renderer *r) {
 	vkDestroyDescriptorSetLayout(r->device, r->descriptors.planet_mesh_layout, nullptr);
 	vkDestroyDescriptorSetLayout(r->device, r->descriptors.atmo_layout, nullptr);
 	vkDestroyDescriptorSetLayout(r->device, r->descriptors.atmo_lut_layout, nullptr);
+	vkDestroyDescriptorSetLayout(r->device, r->descriptors.atmo_view_lut_layout, nullptr);
+	vkDestroyDescriptorSetLayout(r->device, r->descriptors.atmo_half_res_layout, nullptr);
+	vkDestroyDescriptorSetLayout(r->device, r->descriptors.atmo_upsample_layout, nullptr);
 	vkDestroyDescriptorSetLayout(r->device, r->descriptors.blit_layout, nullptr);
 	vkDestroyDescriptorSetLayout(r->device, r->descriptors.rings_layout, nullptr);
 	vkDestroyDescriptorSetLayout(r->device, r->descriptors.skybox_layout, nullptr);
@@ -4296,7 +5314,8 @@ static void init_view_dep_data(struct vulkan_renderer *r, bool resize) {
 			.pImageInfo = &(VkDescriptorImageInfo){
 				.imageView = r->transients.color_0.view,
 				.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-				.sampler = r->direct_sampler,
+				// bilinear and clamped, for upscaling the rendered part, see `vulkan_renderer::render_scale`.
+				.sampler = r->bloom_mipmap_sampler,
 			},
 		},
 		(VkWriteDescriptorSet){
@@ -4320,7 +5339,7 @@ static void init_view_dep_data(struct vulkan_renderer *r, bool resize) {
 			.dstBinding = 2,
 			.dstArrayElement = 0,
 			.pBufferInfo = &(VkDescriptorBufferInfo){
-				.buffer = r->data.global_uniform_buffer.buffer,
+				.buffer = r->data.uniform_ring.buffer.buffer,
 				.offset = 0,
 				.range = sizeof(struct global_uniform_data),
 			},
@@ -4401,7 +5420,7 @@ static void init_view_dep_data(struct vulkan_renderer *r, bool resize) {
 			.dstBinding = 5,
 			.dstArrayElement = 0,
 			.pBufferInfo = &(VkDescriptorBufferInfo){
-				.buffer = r->data.global_uniform_buffer.buffer,
+				.buffer = r->data.uniform_ring.buffer.buffer,
 				.offset = 0,
 				.range = sizeof(struct global_uniform_data),
 			},
@@ -4426,11 +5445,6 @@ static void init_view_dep_data(struct vulkan_renderer *r, bool resize) {
 		upsample_bloom_layout_copies[i] = r->descriptors.upsample_bloom_layout;
 	}
 
-	VkDescriptorSetLayout downsample_bloom_layout_copies[BLOOM_STAGE_COUNT];
-	for (size_t i = 0; i < BLOOM_STAGE_COUNT; ++i) {
-		downsample_bloom_layout_copies[i] = r->descriptors.downsample_bloom_layout;
-	}
-
 	if (!resize) {
 		CHECKVK(vkAllocateDescriptorSets(r->device, &(VkDescriptorSetAllocateInfo){
 			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
@@ -4446,18 +5460,15 @@ static void init_view_dep_data(struct vulkan_renderer *r, bool resize) {
 		CHECKVK(vkAllocateDescriptorSets(r->device, &(VkDescriptorSetAllocateInfo){
 			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
 			.descriptorPool = r->descriptors.pool,
-			.descriptorSetCount = BLOOM_STAGE_COUNT,
-			.pSetLayouts = downsample_bloom_layout_copies,
-		}, r->data.downsample_bloom_descriptor_sets));
-
-		for (size_t i = 0; i < BLOOM_STAGE_COUNT; ++i)
-			NAME_VK_OBJECT(r, r->data.downsample_bloom_descriptor_sets[i], VK_OBJECT_TYPE_DESCRIPTOR_SET,
-				"downsample&bloom #%zu ds", i);
+			.descriptorSetCount = 1,
+			.pSetLayouts = &r->descriptors.downsample_bloom_layout,
+		}, &r->data.downsample_bloom_descriptor_set));
+		NAME_VK_OBJECT(r, r->data.downsample_bloom_descriptor_set, VK_OBJECT_TYPE_DESCRIPTOR_SET,
+			"downsample&bloom ds");
 	}
 
 	{
 		// ds[i] reads from i and writes to i-1
-		// VkDescriptorImageInfo
 		VkWriteDescriptorSet bloom_ds_writes[BLOOM_STAGE_COUNT * 2] = {};
 		VkDescriptorImageInfo bloom_ds_images[BLOOM_STAGE_COUNT * 2] = {};
 		for (size_t i = 0; i < BLOOM_STAGE_COUNT; ++i) {
@@ -4469,7 +5480,7 @@ static void init_view_dep_data(struct vulkan_renderer *r, bool resize) {
 				.dstBinding = 0,
 				.dstArrayElement = 0,
 				.pImageInfo = (bloom_ds_images[2 * i + 0] = (VkDescriptorImageInfo){
-					.imageView = r->transients.bloom[i].view,
+					.imageView = r->transients.bloom_mip_views[i],
 					.imageLayout = VK_IMAGE_LAYOUT_GENERAL,
 					.sampler = r->bloom_mipmap_sampler,
 				}, &bloom_ds_images[2 * i + 0]),
@@ -4482,58 +5493,256 @@ static void init_view_dep_data(struct vulkan_renderer *r, bool resize) {
 				.dstBinding = 1,
 				.dstArrayElement = 0,
 				.pImageInfo = (bloom_ds_images[2 * i + 1] = (VkDescriptorImageInfo){
-					.imageView = i == 0 ? r->transients.color_0.view : r->transients.bloom[i - 1].view,
+					.imageView = i == 0 ? r->transients.color_0.view : r->transients.bloom_mip_views[i - 1],
 					.imageLayout = VK_IMAGE_LAYOUT_GENERAL,
 					.sampler = VK_NULL_HANDLE,
 				}, &bloom_ds_images[2 * i + 1]),
 			};
-			// PSHINE_DEBUG("ds write: #%zu<-%p %zu<-%p", 2*i+0, r->transients.bloom[i].view,
-			// 2*i+1,i==0?r->transients.color_0.view: r->transients.bloom[i-1].view);
 		}
 		vkUpdateDescriptorSets(r->device, BLOOM_STAGE_COUNT * 2, bloom_ds_writes, 0, nullptr);
 	}
 
 	{
-		// ds[i] reads from i and writes to i+1
-		VkWriteDescriptorSet bloom_ds_writes[BLOOM_STAGE_COUNT * 2] = {};
-		VkDescriptorImageInfo bloom_ds_images[BLOOM_STAGE_COUNT * 2] = {};
+		VkDescriptorImageInfo mip_images[BLOOM_STAGE_COUNT];
 		for (size_t i = 0; i < BLOOM_STAGE_COUNT; ++i) {
-			bloom_ds_writes[2 * i + 0] = (VkWriteDescriptorSet){
+			mip_images[i] = (VkDescriptorImageInfo){
+				.imageView = r->transients.bloom_mip_views[i],
+				.imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+				.sampler = VK_NULL_HANDLE,
+			};
+		}
+		vkUpdateDescriptorSets(r->device, 3, (VkWriteDescriptorSet[]){
+			(VkWriteDescriptorSet){
 				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
 				.descriptorCount = 1,
 				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-				.dstSet = r->data.downsample_bloom_descriptor_sets[i],
+				.dstSet = r->data.downsample_bloom_descriptor_set,
 				.dstBinding = 0,
 				.dstArrayElement = 0,
-				.pImageInfo = (bloom_ds_images[2 * i + 0] = (VkDescriptorImageInfo){
-					.imageView = i == 0 ? r->transients.color_0.view : r->transients.bloom[i - 1].view,
+				.pImageInfo = &(VkDescriptorImageInfo){
+					.imageView = r->transients.color_0.view,
 					.imageLayout = VK_IMAGE_LAYOUT_GENERAL,
 					.sampler = r->bloom_mipmap_sampler,
-				}, &bloom_ds_images[2 * i + 0]),
-			};
-			bloom_ds_writes[2 * i + 1] = (VkWriteDescriptorSet){
+				},
+			},
+			(VkWriteDescriptorSet){
 				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-				.descriptorCount = 1,
+				.descriptorCount = BLOOM_STAGE_COUNT,
 				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-				.dstSet = r->data.downsample_bloom_descriptor_sets[i],
+				.dstSet = r->data.downsample_bloom_descriptor_set,
 				.dstBinding = 1,
 				.dstArrayElement = 0,
-				.pImageInfo = (bloom_ds_images[2 * i + 1] = (VkDescriptorImageInfo){
-					.imageView = r->transients.bloom[i].view,
-					.imageLayout = VK_IMAGE_LAYOUT_GENERAL,
-					.sampler = VK_NULL_HANDLE,
-				}, &bloom_ds_images[2 * i + 1]),
-			};
-			// PSHINE_DEBUG("ds write: #%zu<-%p %zu<-%p", 2*i+0, r->transients.bloom[i].view,
-			// 2*i+1,i==0?r->transients.color_0.view: r->transients.bloom[i-1].view);
+				.pImageInfo = mip_images,
+			},
+			(VkWriteDescriptorSet){
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.dstSet = r->data.downsample_bloom_descriptor_set,
+				.dstBinding = 2,
+				.dstArrayElement = 0,
+				.pBufferInfo = &(VkDescriptorBufferInfo){
+					.buffer = r->transients.bloom_counter.buffer,
+					.offset = 0,
+					.range = sizeof(uint32_t),
+				},
+			},
+		}, 0, nullptr);
+	}
+
+	if (!resize) {
+		CHECKVK(vkAllocateDescriptorSets(r->device, &(VkDescriptorSetAllocateInfo){
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+			.descriptorPool = r->descriptors.pool,
+			.descriptorSetCount = 2,
+			.pSetLayouts = (VkDescriptorSetLayout[]){
+				r->descriptors.atmo_half_res_layout,
+				r->descriptors.atmo_half_res_layout,
+			},
+		}, r->data.atmo_half_res_descriptor_sets));
+		CHECKVK(vkAllocateDescriptorSets(r->device, &(VkDescriptorSetAllocateInfo){
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+			.descriptorPool = r->descriptors.pool,
+			.descriptorSetCount = 2,
+			.pSetLayouts = (VkDescriptorSetLayout[]){
+				r->descriptors.atmo_upsample_layout,
+				r->descriptors.atmo_upsample_layout,
+			},
+		}, r->data.atmo_upsample_descriptor_sets));
+		for (size_t i = 0; i < 2; ++i) {
+			NAME_VK_OBJECT(r, r->data.atmo_half_res_descriptor_sets[i], VK_OBJECT_TYPE_DESCRIPTOR_SET,
+				"half-res atmo #%zu ds", i);
+			NAME_VK_OBJECT(r, r->data.atmo_upsample_descriptor_sets[i], VK_OBJECT_TYPE_DESCRIPTOR_SET,
+				"atmo upsample #%zu ds", i);
 		}
+	}
 
-		vkUpdateDescriptorSets(r->device, BLOOM_STAGE_COUNT * 2, bloom_ds_writes, 0, nullptr);
+	#define IMAGE_WRITE(SET, BINDING, TYPE, VIEW, LAYOUT, SAMPLER) (VkWriteDescriptorSet){ \
+		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, \
+		.descriptorType = TYPE, \
+		.descriptorCount = 1, \
+		.dstArrayElement = 0, \
+		.dstBinding = BINDING, \
+		.dstSet = SET, \
+		.pImageInfo = &(VkDescriptorImageInfo){ \
+			.imageLayout = LAYOUT, \
+			.imageView = VIEW, \
+			.sampler = SAMPLER, \
+		}, \
+	}
+	#define UNIFORM_WRITE(SET) (VkWriteDescriptorSet){ \
+		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, \
+		.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, \
+		.descriptorCount = 1, \
+		.dstArrayElement = 0, \
+		.dstBinding = 0, \
+		.dstSet = SET, \
+		.pBufferInfo = &(VkDescriptorBufferInfo){ \
+			.buffer = r->data.uniform_ring.buffer.buffer, \
+			.offset = 0, \
+			.range = sizeof(struct atmo_half_res_uniform_data), \
+		}, \
 	}
+	for (size_t i = 0; i < 2; ++i) {
+		VkDescriptorSet half_res_set = r->data.atmo_half_res_descriptor_sets[i];
+		VkDescriptorSet upsample_set = r->data.atmo_upsample_descriptor_sets[i];
+		vkUpdateDescriptorSets(r->device, 13, (VkWriteDescriptorSet[13]){
+			UNIFORM_WRITE(half_res_set),
+			IMAGE_WRITE(half_res_set, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, r->depth_image.view,
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, r->direct_sampler),
+			IMAGE_WRITE(half_res_set, 2, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, r->transients.atmo_light.view,
+				VK_IMAGE_LAYOUT_GENERAL, VK_NULL_HANDLE),
+			IMAGE_WRITE(half_res_set, 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, r->transients.atmo_history_views[1 - i],
+				VK_IMAGE_LAYOUT_GENERAL, r->atmo_lut_sampler),
+			IMAGE_WRITE(half_res_set, 4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				r->transients.atmo_history_depth_views[1 - i], VK_IMAGE_LAYOUT_GENERAL, r->direct_sampler),
+			IMAGE_WRITE(half_res_set, 5, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, r->transients.atmo_history_views[i],
+				VK_IMAGE_LAYOUT_GENERAL, VK_NULL_HANDLE),
+			IMAGE_WRITE(half_res_set, 6, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, r->transients.atmo_history_depth_views[i],
+				VK_IMAGE_LAYOUT_GENERAL, VK_NULL_HANDLE),
+			UNIFORM_WRITE(upsample_set),
+			IMAGE_WRITE(upsample_set, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, r->transients.atmo_history_views[i],
+				VK_IMAGE_LAYOUT_GENERAL, r->direct_sampler),
+			IMAGE_WRITE(upsample_set, 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				r->transients.atmo_history_depth_views[i], VK_IMAGE_LAYOUT_GENERAL, r->direct_sampler),
+			IMAGE_WRITE(upsample_set, 3, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, r->transients.color_0.view,
+				VK_IMAGE_LAYOUT_RENDERING_LOCAL_READ, VK_NULL_HANDLE),
+			IMAGE_WRITE(upsample_set, 4, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, r->depth_image.view,
+				VK_IMAGE_LAYOUT_RENDERING_LOCAL_READ, VK_NULL_HANDLE),
+			IMAGE_WRITE(upsample_set, 5, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,
+				r->transients.gbuffer[GBUFFER_IMAGE_DIFFUSE_O].image.view,
+				VK_IMAGE_LAYOUT_RENDERING_LOCAL_READ, VK_NULL_HANDLE),
+		}, 0, nullptr);
+	}
+	for (size_t i = 0; i < PSHINE_MAX_FRAMES_IN_FLIGHT; ++i) {
+		VkDescriptorSet atmo_set = r->data.atmo_descriptor_sets[i];
+		vkUpdateDescriptorSets(r->device, 3, (VkWriteDescriptorSet[3]){
+			IMAGE_WRITE(atmo_set, 1, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, r->transients.color_0.view,
+				VK_IMAGE_LAYOUT_RENDERING_LOCAL_READ, VK_NULL_HANDLE),
+			IMAGE_WRITE(atmo_set, 2, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, r->depth_image.view,
+				VK_IMAGE_LAYOUT_RENDERING_LOCAL_READ, VK_NULL_HANDLE),
+			IMAGE_WRITE(atmo_set, 4, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,
+				r->transients.gbuffer[GBUFFER_IMAGE_DIFFUSE_O].image.view,
+				VK_IMAGE_LAYOUT_RENDERING_LOCAL_READ, VK_NULL_HANDLE),
+		}, 0, nullptr);
+	}
+	#undef IMAGE_WRITE
+	#undef UNIFORM_WRITE
 }
 
 // Game data
 
+static VkDeviceSize get_std_mesh_instance_table_size(struct vulkan_renderer *r) {
+	VkDeviceSize align = r->physical_device_properties_own->properties.limits.minStorageBufferOffsetAlignment;
+	VkDeviceSize size = r->data.std_mesh_instance_capacity * sizeof(struct std_mesh_uniform_data);
+	return align > 0 ? (size + align - 1) & ~(align - 1) : size;
+}
+
+static VkDeviceSize get_atmo_batch_table_size(struct vulkan_renderer *r) {
+	VkDeviceSize align = r->physical_device_properties_own->properties.limits.minStorageBufferOffsetAlignment;
+	VkDeviceSize size = sizeof(struct atmo_batch_data);
+	return align > 0 ? (size + align - 1) & ~(align - 1) : size;
+}
+
+/// The offset of a shadow cascade's commands (followed by their count) in a draw list.
+static VkDeviceSize get_shadow_draw_list_offset(struct vulkan_renderer *r, uint32_t cascade) {
+	return r->data.std_mesh_draw_capacity * (sizeof(VkDrawIndexedIndirectCommand) + sizeof(uint32_t))
+		+ sizeof(uint32_t)
+		+ cascade * (r->data.std_mesh_draw_capacity * sizeof(VkDrawIndexedIndirectCommand) + sizeof(uint32_t));
+}
+
+/// The commands, then the total count and one count per group (at most one group per draw),
+/// then each shadow cascade's commands followed by their count.
+static VkDeviceSize get_std_mesh_draw_list_size(struct vulkan_renderer *r) {
+	return get_shadow_draw_list_offset(r, PSHINE_SHADOW_CASCADE_COUNT);
+}
+
+/// Make room for at least `count` instances per frame. Waits for the device if the table has to grow.
+static void reserve_std_mesh_instances(struct vulkan_renderer *r, size_t count) {
+	if (count <= r->data.std_mesh_instance_capacity) return;
+	if (r->data.std_mesh_instance_capacity > 0) {
+		CHECKVK(vkDeviceWaitIdle(r->device));
+		deallocate_buffer(r, r->data.std_mesh_instance_buffer);
+	}
+	size_t capacity = r->data.std_mesh_instance_capacity == 0 ? 1 : r->data.std_mesh_instance_capacity;
+	while (capacity < count) capacity *= 2;
+	r->data.std_mesh_instance_capacity = capacity;
+
+	VmaAllocationInfo alloc_info = {};
+	r->data.std_mesh_instance_buffer = allocate_buffer(r, &(struct vulkan_buffer_alloc_info){
+		.size = get_std_mesh_instance_table_size(r) * PSHINE_MAX_FRAMES_IN_FLIGHT,
+		.buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		.required_memory_property_flags = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		.allocation_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+		.memory_usage = VMA_MEMORY_USAGE_AUTO,
+		.out_allocation_info = &alloc_info,
+	});
+	r->data.std_mesh_instances_mapped = alloc_info.pMappedData;
+	NAME_VK_OBJECT(r, r->data.std_mesh_instance_buffer.buffer, VK_OBJECT_TYPE_BUFFER, "std mesh instances sb");
+
+	vkUpdateDescriptorSets(r->device, 1, (VkWriteDescriptorSet[1]){
+		(VkWriteDescriptorSet){
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.descriptorCount = 1,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+			.dstSet = r->data.std_mesh_descriptor_set,
+			.dstBinding = 0,
+			.dstArrayElement = 0,
+			.pBufferInfo = &(VkDescriptorBufferInfo){
+				.buffer = r->data.std_mesh_instance_buffer.buffer,
+				.offset = 0,
+				.range = capacity * sizeof(struct std_mesh_uniform_data),
+			}
+		}
+	}, 0, nullptr);
+}
+
+/// Make room for at least `count` draws per frame. Waits for the device if the lists have to grow.
+static void reserve_std_mesh_draws(struct vulkan_renderer *r, size_t count) {
+	if (count <= r->data.std_mesh_draw_capacity) return;
+	if (r->data.std_mesh_draw_capacity > 0) {
+		CHECKVK(vkDeviceWaitIdle(r->device));
+		deallocate_buffer(r, r->data.std_mesh_draw_buffer);
+	}
+	size_t capacity = r->data.std_mesh_draw_capacity == 0 ? 1 : r->data.std_mesh_draw_capacity;
+	while (capacity < count) capacity *= 2;
+	r->data.std_mesh_draw_capacity = capacity;
+
+	VmaAllocationInfo alloc_info = {};
+	r->data.std_mesh_draw_buffer = allocate_buffer(r, &(struct vulkan_buffer_alloc_info){
+		.size = get_std_mesh_draw_list_size(r) * PSHINE_MAX_FRAMES_IN_FLIGHT,
+		.buffer_usage = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+		.required_memory_property_flags = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		.allocation_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+		.memory_usage = VMA_MEMORY_USAGE_AUTO,
+		.out_allocation_info = &alloc_info,
+	});
+	r->data.std_mesh_draws_mapped = alloc_info.pMappedData;
+	NAME_VK_OBJECT(r, r->data.std_mesh_draw_buffer.buffer, VK_OBJECT_TYPE_BUFFER, "std mesh draws ib");
+
+	r->std_mesh_draw_groups_own = realloc(r->std_mesh_draw_groups_own, capacity * sizeof(*r->std_mesh_draw_groups_own));
+}
+
 static void init_game_data(struct vulkan_renderer *r) {
 	vkCreateSampler(r->device, &(VkSamplerCreateInfo){
 		.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
@@ -4620,17 +5829,21 @@ static void init_game_data(struct vulkan_renderer *r) {
 	}, nullptr, &r->bloom_mipmap_sampler);
 	NAME_VK_OBJECT(r, r->atmo_lut_sampler, VK_OBJECT_TYPE_SAMPLER, "bloom mipmap sampler");
 
-	struct vulkan_buffer_alloc_info common_alloc_info = {
-		.size = 0,
-		.buffer_usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-		.required_memory_property_flags = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		.allocation_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
-		.memory_usage = VMA_MEMORY_USAGE_AUTO, // _PREFER_DEVICE
-	};
-
-	common_alloc_info.size = get_padded_uniform_buffer_size(r, sizeof(struct global_uniform_data)) * FRAMES_IN_FLIGHT;
-	r->data.global_uniform_buffer = allocate_buffer(r, &common_alloc_info);
-	NAME_VK_OBJECT(r, r->data.global_uniform_buffer.buffer, VK_OBJECT_TYPE_BUFFER, "global ub");
+	{
+		VmaAllocationInfo alloc_info = {};
+		// the star systems are loaded before the renderer, so this is enough for any frame.
+		r->data.uniform_ring.region_size = get_uniform_ring_region_size(r);
+		r->data.uniform_ring.buffer = allocate_buffer(r, &(struct vulkan_buffer_alloc_info){
+			.size = r->data.uniform_ring.region_size * PSHINE_MAX_FRAMES_IN_FLIGHT,
+			.buffer_usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+			.required_memory_property_flags = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			.allocation_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+			.memory_usage = VMA_MEMORY_USAGE_AUTO,
+			.out_allocation_info = &alloc_info,
+		});
+		r->data.uniform_ring.mapped = alloc_info.pMappedData;
+		NAME_VK_OBJECT(r, r->data.uniform_ring.buffer.buffer, VK_OBJECT_TYPE_BUFFER, "uniform ring");
+	}
 
 	CHECKVK(vkAllocateDescriptorSets(r->device, &(VkDescriptorSetAllocateInfo){
 		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
@@ -4649,7 +5862,7 @@ static void init_game_data(struct vulkan_renderer *r) {
 			.dstBinding = 0,
 			.dstArrayElement = 0,
 			.pBufferInfo = &(VkDescriptorBufferInfo){
-				.buffer = r->data.global_uniform_buffer.buffer,
+				.buffer = r->data.uniform_ring.buffer.buffer,
 				.offset = 0,
 				.range = sizeof(struct global_uniform_data)
 			}
@@ -4673,32 +5886,152 @@ static void init_game_data(struct vulkan_renderer *r) {
 	}, &r->data.light_descriptor_set));
 	NAME_VK_OBJECT(r, r->data.light_descriptor_set, VK_OBJECT_TYPE_DESCRIPTOR_SET, "blit ds");
 
-	init_view_dep_data(r, false);
-}
-
-static void deinit_game_data(struct vulkan_renderer *r) {
-	deallocate_buffer(r, r->data.global_uniform_buffer);
+	CHECKVK(vkAllocateDescriptorSets(r->device, &(VkDescriptorSetAllocateInfo){
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		.descriptorPool = r->descriptors.pool,
+		.descriptorSetCount = 1,
+		.pSetLayouts = &r->descriptors.std_mesh_layout
+	}, &r->data.std_mesh_descriptor_set));
+	NAME_VK_OBJECT(r, r->data.std_mesh_descriptor_set, VK_OBJECT_TYPE_DESCRIPTOR_SET, "std mesh instances ds");
+	reserve_std_mesh_instances(r, 64);
+	reserve_std_mesh_draws(r, 256);
 
-	vkDestroySampler(r->device, r->direct_sampler, nullptr);
-	vkDestroySampler(r->device, r->skybox_sampler, nullptr);
-	vkDestroySampler(r->device, r->atmo_lut_sampler, nullptr);
-	vkDestroySampler(r->device, r->material_texture_sampler, nullptr);
-	vkDestroySampler(r->device, r->bloom_mipmap_sampler, nullptr);
-}
+	{
+		VmaAllocationInfo alloc_info = {};
+		r->data.atmo_batch_buffer = allocate_buffer(r, &(struct vulkan_buffer_alloc_info){
+			.size = get_atmo_batch_table_size(r) * PSHINE_MAX_FRAMES_IN_FLIGHT,
+			.buffer_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			.required_memory_property_flags = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			.allocation_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+			.memory_usage = VMA_MEMORY_USAGE_AUTO,
+			.out_allocation_info = &alloc_info,
+		});
+		r->data.atmo_batch_mapped = alloc_info.pMappedData;
+		NAME_VK_OBJECT(r, r->data.atmo_batch_buffer.buffer, VK_OBJECT_TYPE_BUFFER, "atmo batch sb");
+	}
 
-static void init_frame(
-	struct vulkan_renderer *r,
-	uint32_t frame_index,
-	struct per_frame_data *f
-) {
-	CHECKVK(vkAllocateCommandBuffers(r->device, &(VkCommandBufferAllocateInfo){
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+	for (size_t i = 0; i < PSHINE_MAX_FRAMES_IN_FLIGHT; ++i) {
+		CHECKVK(vkAllocateDescriptorSets(r->device, &(VkDescriptorSetAllocateInfo){
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+			.descriptorPool = r->descriptors.pool,
+			.descriptorSetCount = 1,
+			.pSetLayouts = &r->descriptors.atmo_layout
+		}, &r->data.atmo_descriptor_sets[i]));
+		NAME_VK_OBJECT(r, r->data.atmo_descriptor_sets[i], VK_OBJECT_TYPE_DESCRIPTOR_SET, "atmo #%zu ds", i);
+		vkUpdateDescriptorSets(r->device, 3, (VkWriteDescriptorSet[3]){
+			(VkWriteDescriptorSet){
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+				.dstSet = r->data.atmo_descriptor_sets[i],
+				.dstBinding = 0,
+				.dstArrayElement = 0,
+				.pBufferInfo = &(VkDescriptorBufferInfo){
+					.buffer = r->data.atmo_batch_buffer.buffer,
+					.offset = 0,
+					.range = sizeof(struct atmo_batch_data),
+				}
+			},
+			(VkWriteDescriptorSet){
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				.dstSet = r->data.atmo_descriptor_sets[i],
+				.dstBinding = 3,
+				.dstArrayElement = 0,
+				.pImageInfo = &(VkDescriptorImageInfo){
+					.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+					.imageView = r->atmo_sky_view_luts.view,
+					.sampler = r->atmo_lut_sampler,
+				}
+			},
+			(VkWriteDescriptorSet){
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				.dstSet = r->data.atmo_descriptor_sets[i],
+				.dstBinding = 5,
+				.dstArrayElement = 0,
+				.pImageInfo = &(VkDescriptorImageInfo){
+					.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+					.imageView = r->atmo_aerial_luts.view,
+					.sampler = r->atmo_lut_sampler,
+				}
+			},
+		}, 0, nullptr);
+	}
+
+	init_view_dep_data(r, false);
+}
+
+static void deinit_game_data(struct vulkan_renderer *r) {
+	deallocate_buffer(r, r->data.uniform_ring.buffer);
+	deallocate_buffer(r, r->data.std_mesh_instance_buffer);
+	deallocate_buffer(r, r->data.std_mesh_draw_buffer);
+	deallocate_buffer(r, r->data.atmo_batch_buffer);
+	free(r->std_mesh_draw_groups_own);
+	free(r->std_mesh_part_order_own);
+
+	vkDestroySampler(r->device, r->direct_sampler, nullptr);
+	vkDestroySampler(r->device, r->skybox_sampler, nullptr);
+	vkDestroySampler(r->device, r->atmo_lut_sampler, nullptr);
+	vkDestroySampler(r->device, r->material_texture_sampler, nullptr);
+	vkDestroySampler(r->device, r->bloom_mipmap_sampler, nullptr);
+}
+
+/// The render graph queues the frames have command buffers for.
+static size_t frame_queue_count(const struct vulkan_renderer *r) {
+	return r->async_compute ? RG_QUEUE_COUNT_ : 1;
+}
+
+static void init_frame(
+	struct vulkan_renderer *r,
+	uint32_t frame_index,
+	struct per_frame_data *f
+) {
+	CHECKVK(vkAllocateCommandBuffers(r->device, &(VkCommandBufferAllocateInfo){
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
 		.commandPool = r->command_pool_graphics,
-		.commandBufferCount = 1,
+		.commandBufferCount = FRAME_SEGMENT_COUNT_MAX,
 		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY
-	}, &f->command_buffer));
+	}, f->segment_command_buffers[RG_QUEUE_MAIN]));
+	f->command_buffer = f->segment_command_buffers[RG_QUEUE_MAIN][0];
 	NAME_VK_OBJECT(r, f->command_buffer, VK_OBJECT_TYPE_COMMAND_BUFFER, "cmdbuf for frame %u", frame_index);
 
+	f->async_pool = VK_NULL_HANDLE;
+	if (r->async_compute) {
+		CHECKVK(vkCreateCommandPool(r->device, &(VkCommandPoolCreateInfo){
+			.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+			.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+			.queueFamilyIndex = r->queue_families[QUEUE_COMPUTE],
+		}, nullptr, &f->async_pool));
+		NAME_VK_OBJECT(r, f->async_pool, VK_OBJECT_TYPE_COMMAND_POOL, "async compute pool for frame %u", frame_index);
+		CHECKVK(vkAllocateCommandBuffers(r->device, &(VkCommandBufferAllocateInfo){
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			.commandPool = f->async_pool,
+			.commandBufferCount = FRAME_SEGMENT_COUNT_MAX,
+			.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY
+		}, f->segment_command_buffers[RG_QUEUE_ASYNC_COMPUTE]));
+	}
+
+	for (size_t q = 0; q < frame_queue_count(r); ++q) {
+		for (size_t i = 0; i < RECORD_THREAD_COUNT_MAX; ++i) {
+			CHECKVK(vkCreateCommandPool(r->device, &(VkCommandPoolCreateInfo){
+				.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+				.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+				.queueFamilyIndex = r->queue_families[q == RG_QUEUE_ASYNC_COMPUTE ? QUEUE_COMPUTE : QUEUE_GRAPHICS],
+			}, nullptr, &f->record_pools[q][i]));
+			NAME_VK_OBJECT(r, f->record_pools[q][i], VK_OBJECT_TYPE_COMMAND_POOL, "record pool #%zu.%zu for frame %u",
+				q, i, frame_index);
+			CHECKVK(vkAllocateCommandBuffers(r->device, &(VkCommandBufferAllocateInfo){
+				.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+				.commandPool = f->record_pools[q][i],
+				.commandBufferCount = RECORD_TASK_COUNT_MAX,
+				.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+			}, f->record_command_buffers[q][i]));
+		}
+	}
+
 	CHECKVK(vkCreateSemaphore(r->device, &(VkSemaphoreCreateInfo){
 		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
 	}, nullptr, &f->sync.image_avail_semaphore));
@@ -4718,24 +6051,29 @@ static void init_frame(
 	NAME_VK_OBJECT(r, f->sync.in_flight_fence, VK_OBJECT_TYPE_FENCE, "in flight fence for frame %u", frame_index);
 
 	f->index = frame_index;
+	f->submit_count = 0;
 	f->swapchain_image = VK_NULL_HANDLE;
 	f->swapchain_image_view = VK_NULL_HANDLE;
 }
 
 void deinit_frame(struct vulkan_renderer *r, struct per_frame_data *f) {
+	for (size_t q = 0; q < frame_queue_count(r); ++q)
+		for (size_t i = 0; i < RECORD_THREAD_COUNT_MAX; ++i)
+			vkDestroyCommandPool(r->device, f->record_pools[q][i], nullptr);
+	if (f->async_pool != VK_NULL_HANDLE) vkDestroyCommandPool(r->device, f->async_pool, nullptr);
 	vkDestroyFence(r->device, f->sync.in_flight_fence, nullptr);
 	vkDestroySemaphore(r->device, f->sync.render_finish_semaphore, nullptr);
 	vkDestroySemaphore(r->device, f->sync.image_avail_semaphore, nullptr);
 }
 
 static void init_frames(struct vulkan_renderer *r) {
-	for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; ++i) {
+	for (uint32_t i = 0; i < PSHINE_MAX_FRAMES_IN_FLIGHT; ++i) {
 		init_frame(r, i, &r->frames[i]);
 	}
 }
 
 static void deinit_frames(struct vulkan_renderer *r) {
-	for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; ++i) {
+	for (uint32_t i = 0; i < PSHINE_MAX_FRAMES_IN_FLIGHT; ++i) {
 		deinit_frame(r, &r->frames[i]);
 	}
 }
@@ -4807,8 +6145,9 @@ static void init_imgui(struct vulkan_renderer *r) {
 		.queue = r->queues[QUEUE_GRAPHICS],
 		.pipeline_cache = VK_NULL_HANDLE,
 		.descriptor_pool = r->descriptors.pool_imgui,
-		.min_image_count = FRAMES_IN_FLIGHT,
-		.image_count = FRAMES_IN_FLIGHT,
+		.min_image_count = 2,
+		// its buffers are reused after this many frames.
+		.image_count = PSHINE_MAX_FRAMES_IN_FLIGHT,
 		.allocator = nullptr,
 		.check_vk_result_fn = &check_vk_result_imgui,
 		.msaa_samples = VK_SAMPLE_COUNT_1_BIT,
@@ -4845,16 +6184,21 @@ static void deinit_star_system(struct vulkan_renderer *r, struct pshine_star_sys
 		struct pshine_celestial_body *b = system->bodies_own[i];
 		if (b->type == PSHINE_CELESTIAL_BODY_PLANET) {
 			struct pshine_planet *p = (void *)b;
-			deallocate_buffer(r, p->graphics_data->uniform_buffer);
-			deallocate_buffer(r, p->graphics_data->atmo_uniform_buffer);
-			deallocate_buffer(r, p->graphics_data->material_uniform_buffer);
-			deallocate_image(r, p->graphics_data->atmo_lut);
-			if (b->rings.has_rings) deallocate_buffer(r, p->graphics_data->rings_uniform_buffer);
+			// still computing, which is probably worth caching.
+			if (p->graphics_data->atmo_lut_pending) {
+				CHECKVK(vkWaitForFences(r->device, 1, &p->graphics_data->atmo_lut_fence, VK_TRUE, UINT64_MAX));
+				finish_atmo_lut(r, p);
+			}
+			vkDestroyFence(r->device, p->graphics_data->atmo_lut_fence, nullptr);
+			vkDestroySemaphore(r->device, p->graphics_data->atmo_lut_semaphore, nullptr);
+			for (size_t j = 0; j < 2; ++j) {
+				deallocate_image(r, p->graphics_data->atmo_lut[j]);
+				deallocate_image(r, p->graphics_data->atmo_multiscatter_lut[j]);
+			}
 			vkFreeCommandBuffers(r->device, r->command_pool_compute, 1, &p->graphics_data->compute_cmdbuf);
 			free(p->graphics_data);
 		} else if (b->type == PSHINE_CELESTIAL_BODY_STAR) {
 			struct pshine_star *p = (void *)b;
-			deallocate_buffer(r, p->graphics_data->uniform_buffer);
 			free(p->graphics_data);
 		}
 	}
@@ -4864,6 +6208,7 @@ void pshine_deinit_renderer(struct pshine_renderer *renderer) {
 	struct vulkan_renderer *r = (void*)renderer;
 
 	vkDeviceWaitIdle(r->device);
+	deinit_record_threads(r);
 
 	for (size_t i = 0; i < r->game->star_system_count; ++i) {
 		deinit_star_system(r, &r->game->star_systems_own[i]);
@@ -4871,7 +6216,7 @@ void pshine_deinit_renderer(struct pshine_renderer *renderer) {
 
 	for (size_t i = 0; i < r->game->ships.dyna.count; ++i) {
 		if (r->game->ships.ptr[i]._alive_marker != (size_t)-1) continue;
-		deallocate_buffer(r, r->game->ships.ptr[i].graphics_data->uniform_buffer);
+		free(r->game->ships.ptr[i].graphics_data);
 	}
 
 	deinit_game_data(r);
@@ -4880,15 +6225,14 @@ void pshine_deinit_renderer(struct pshine_renderer *renderer) {
 		destroy_mesh(r, &r->own_sphere_meshes[i]);
 	free(r->own_sphere_meshes);
 
+	if (r->mesh_arena.vertex_capacity > 0) deallocate_buffer(r, r->mesh_arena.vertex_buffer);
+	if (r->mesh_arena.index_capacity > 0) deallocate_buffer(r, r->mesh_arena.index_buffer);
+
 	for (size_t i = 0; i < r->model_store.dyna.count; ++i) {
 		if (r->model_store.ptr[i]._alive_marker != (size_t)-1) continue;
 		struct vulkan_mesh_model *model = &r->model_store.ptr[i].model;
-		for (size_t j = 0; j < model->part_count; ++j) {
-			destroy_mesh(r, &model->parts_own[j].mesh);
-		}
 		free(model->parts_own);
 		for (size_t j = 0; j < model->material_count; ++j) {
-			deallocate_buffer(r, model->materials_own[j].uniform_buffer);
 			deallocate_image(r, model->materials_own[j].images.ao_metallic_roughness);
 			deallocate_image(r, model->materials_own[j].images.diffuse);
 			deallocate_image(r, model->materials_own[j].images.emissive);
@@ -4915,6 +6259,7 @@ void pshine_deinit_renderer(struct pshine_renderer *renderer) {
 	// deinit_fbufs(r);
 	deinit_rendergraph(r);
 	deinit_transients(r);
+	deinit_atmo_view_luts(r);
 	deinit_pipelines(r);
 	deinit_descriptors(r);
 	// deinit_rpasses(r);
@@ -4923,6 +6268,16 @@ void pshine_deinit_renderer(struct pshine_renderer *renderer) {
 	deinit_glfw(r);
 
 	free(r->key_states);
+	free(r->body_visibility_own);
+	free(r->cull_spheres_own);
+	free(r->cull_occluders_own);
+	free(r->shadow_casters_own);
+	free(r->shadow_caster_ships_own);
+	free(r->shadow_casts_own);
+	for (uint32_t c = 0; c < PSHINE_SHADOW_CASCADE_COUNT; ++c) {
+		free(r->shadow_caches[c].caster_ships_own);
+		free(r->shadow_caches[c].casters_own);
+	}
 }
 
 
@@ -4940,6 +6295,24 @@ MATH_FN_ void setdouble4x4scale(double4x4 *m, double3 s) {
 	m->vs[3][3] = 1.0;
 }
 
+static struct celestial_body_lod_state *get_celestial_body_lod_state(struct pshine_celestial_body *b) {
+	if (b->type == PSHINE_CELESTIAL_BODY_PLANET) return &((struct pshine_planet *)b)->graphics_data->lod;
+	if (b->type == PSHINE_CELESTIAL_BODY_STAR) return &((struct pshine_star *)b)->graphics_data->lod;
+	PSHINE_PANIC("Unknown body type: %d", b->type);
+}
+
+/// The coarsest LOD of the part whose simplification error covers at most `r->mesh_lod_pixel_error` pixels.
+static inline const struct pshine_mesh_lod *select_mesh_lod(
+	const struct vulkan_renderer *r,
+	const struct vulkan_mesh_model_part *part,
+	float pixels_per_unit
+) {
+	uint32_t lod = 0;
+	while (lod + 1 < part->lod_count && part->lods[lod + 1].error * pixels_per_unit <= r->mesh_lod_pixel_error) ++lod;
+	return &part->lods[lod];
+}
+
+/// Updates the body's LOD state, should be called once per frame.
 static inline size_t select_celestial_body_lod(
 	struct vulkan_renderer *r,
 	struct pshine_celestial_body *b,
@@ -4949,11 +6322,16 @@ static inline size_t select_celestial_body_lod(
 	double radius = SCSd_WCSd(b->radius);
 	double d = double3mag(double3sub(body_pos, cam_pos));
 	double a = radius / fabs(d - radius);
-	if (a <= SCSd_WCSd(r->lod_ranges[3])) return 4;
-	if (a <= SCSd_WCSd(r->lod_ranges[2])) return 3;
-	if (a <= SCSd_WCSd(r->lod_ranges[1])) return 2;
-	if (a <= SCSd_WCSd(r->lod_ranges[0])) return 1;
-	return 0;
+	double thresholds[PSHINE_LOD_THRESHOLD_COUNT];
+	for (size_t i = 0; i < PSHINE_LOD_THRESHOLD_COUNT; ++i) thresholds[i] = SCSd_WCSd(r->lod_ranges[i]);
+	struct celestial_body_lod_state *state = get_celestial_body_lod_state(b);
+	size_t lod = pshine_select_lod_with_hysteresis(
+		thresholds, r->lod_hysteresis, r->lod_morph_range,
+		state->lod, a, &state->morph
+	);
+	if (lod != state->lod) ++r->lod_switch_count;
+	state->lod = lod;
+	return lod;
 }
 
 // static void render_celestial_body(
@@ -4967,15 +6345,402 @@ static inline size_t select_celestial_body_lod(
 // ) {
 // }
 
-static float shadow_proj_height = 10.0f;
-
 struct do_frame_stuff {
+	/// The size of the 3D passes' renderings this frame, in their top left, see `vulkan_renderer::render_scale`.
+	VkExtent2D render_extent;
 	float4x4 proj_mat32;
 	float4x4 view_mat32;
 	double3 camera_pos_scs;
 	struct pshine_star_system *current_system;
+	/// Indexed like `current_system->bodies_own`.
+	const bool *body_visible;
+	/// How many atmospheres are drawn this frame, the count of the frame's atmosphere batch.
+	uint32_t atmo_count;
+	/// The pixels the atmosphere pass draws, the batch's screen rects merged, see `pshine_atmo_pixel_rects`.
+	uint32_t atmo_rect_count;
+	uint32_t atmo_rects[PSHINE_ATMO_MAX_BATCH][4];
+	/// Whether the atmospheres are rendered at half resolution this frame (if there are any visible).
+	bool atmo_half_res;
+	/// See `vulkan_renderer::atmo_history_index`.
+	uint32_t atmo_history_index;
+	/// This frame's shadow cascades, and their projections from positions relative to the render origin.
+	struct pshine_shadow_light shadow_light;
+	struct pshine_shadow_cascade shadow_cascades[PSHINE_SHADOW_CASCADE_COUNT];
+	float4x4 shadow_proj_mat32[PSHINE_SHADOW_CASCADE_COUNT];
+	/// The cascades rendered this frame, a bit per cascade. The others are kept in the atlas.
+	uint32_t shadow_render_mask;
+	/// Offsets in the uniform ring.
+	uint32_t global_uniform_offset;
+	uint32_t std_material_uniform_offset;
+	uint32_t atmo_half_res_uniform_offset;
 };
 
+/// The bounding sphere of a body, including its atmosphere and rings, in SCS.
+static struct pshine_cull_sphere get_celestial_body_bounds(const struct pshine_celestial_body *b) {
+	double radius = b->radius;
+	if (b->type == PSHINE_CELESTIAL_BODY_PLANET) {
+		const struct pshine_planet *p = (const void *)b;
+		if (p->has_atmosphere) radius = fmax(radius, b->radius + p->atmosphere.height);
+	}
+	if (b->rings.has_rings) radius = fmax(radius, b->rings.outer_radius);
+	double3 center = SCSd3_WCSp3(b->position);
+	return (struct pshine_cull_sphere){ .center = { center.x, center.y, center.z }, .radius = SCSd_WCSd(radius) };
+}
+
+/// The bounding sphere of a ship, in SCS.
+static struct pshine_cull_sphere get_ship_bounds(const struct pshine_ship *ship) {
+	const struct vulkan_mesh_model *model = &ship->graphics_data->model;
+	double transform_scale = 0.0;
+	for (size_t k = 0; k < 3; ++k)
+		transform_scale = fmax(transform_scale, double3mag(double3vs(model->transform.vs[k])));
+	double3 transform_offset = double3vs(model->transform.vs[3]);
+	double3 center = SCSd3_WCSp3(ship->position);
+	return (struct pshine_cull_sphere){
+		.center = { center.x, center.y, center.z },
+		.radius = (model->bounding_radius * transform_scale + double3mag(transform_offset)) * SCSd_WCSd(ship->scale),
+	};
+}
+
+/// Decide which bodies and ships are drawn this frame: the ones whose bounding spheres are
+/// in the view frustum and not hidden behind a body's surface.
+static void cull_game_frame(struct vulkan_renderer *r, struct do_frame_stuff *stuff) {
+	PSHINE_PERF_FUNC();
+	struct pshine_star_system *system = stuff->current_system;
+	if (r->body_visibility_capacity < system->body_count) {
+		r->body_visibility_capacity = system->body_count;
+		r->body_visibility_own = realloc(r->body_visibility_own, system->body_count * sizeof(bool));
+		r->cull_spheres_own = realloc(r->cull_spheres_own, system->body_count * sizeof(struct pshine_cull_sphere));
+		r->cull_occluders_own = realloc(r->cull_occluders_own, system->body_count * sizeof(struct pshine_cull_sphere));
+	}
+	stuff->body_visible = r->body_visibility_own;
+	r->cull_stats = (struct pshine_cull_stats){};
+
+	if (!r->culling_enabled) {
+		for (size_t i = 0; i < system->body_count; ++i) r->body_visibility_own[i] = true;
+		for (size_t i = 0; i < r->game->ships.dyna.count; ++i) {
+			if (r->game->ships.ptr[i]._alive_marker != (size_t)-1) continue;
+			r->game->ships.ptr[i].graphics_data->visible = true;
+		}
+		return;
+	}
+
+	floatR camera_orientation = floatRvs(r->game->camera_orientation.values);
+	double3 right = double3_float3(floatRapply(camera_orientation, float3xyz(1, 0, 0)));
+	double3 up = double3_float3(floatRapply(camera_orientation, float3xyz(0, 1, 0)));
+	double3 forward = double3_float3(floatRapply(camera_orientation, float3xyz(0, 0, 1)));
+	struct pshine_cull_frustum frustum;
+	pshine_make_cull_frustum(
+		&frustum, stuff->camera_pos_scs.vs, right.vs, up.vs, forward.vs, r->game->actual_camera_fov,
+		r->swapchain_extent.width /(double) r->swapchain_extent.height, 0.0001
+	);
+
+	for (size_t i = 0; i < system->body_count; ++i) {
+		const struct pshine_celestial_body *b = system->bodies_own[i];
+		r->cull_spheres_own[i] = get_celestial_body_bounds(b);
+		r->cull_occluders_own[i] = r->cull_spheres_own[i];
+		r->cull_occluders_own[i].radius = SCSd_WCSd(b->radius);
+	}
+	pshine_cull_spheres(
+		&frustum, stuff->camera_pos_scs.vs,
+		system->body_count, r->cull_occluders_own,
+		system->body_count, r->cull_spheres_own,
+		r->body_visibility_own, &r->cull_stats
+	);
+
+	for (size_t i = 0; i < r->game->ships.dyna.count; ++i) {
+		if (r->game->ships.ptr[i]._alive_marker != (size_t)-1) continue;
+		struct pshine_ship *ship = &r->game->ships.ptr[i];
+		struct pshine_cull_sphere bounds = get_ship_bounds(ship);
+		pshine_cull_spheres(
+			&frustum, stuff->camera_pos_scs.vs,
+			system->body_count, r->cull_occluders_own,
+			1, &bounds,
+			&ship->graphics_data->visible, &r->cull_stats
+		);
+	}
+}
+
+/// Where the ship (`shadow_caster_ships_own[i]`) is this frame, to tell if it moved in a cached cascade.
+static struct pshine_shadow_caster get_shadow_caster(const struct vulkan_renderer *r, size_t i) {
+	const pshine_rotor *orientation = &r->game->ships.ptr[r->shadow_caster_ships_own[i]].orientation;
+	struct pshine_shadow_caster caster = { .bounds = r->shadow_casters_own[i] };
+	for (size_t k = 0; k < 4; ++k) caster.orientation[k] = orientation->values[k];
+	return caster;
+}
+
+/// Whether a cached cascade's casters are still the ones in `shadow_casts_own`, none of them
+/// having moved by more than `tolerance`.
+static bool shadow_casters_unchanged(
+	const struct vulkan_renderer *r,
+	const struct shadow_cascade_cache *cache,
+	size_t caster_count,
+	double tolerance
+) {
+	size_t k = 0;
+	for (size_t i = 0; i < caster_count; ++i) {
+		if (!r->shadow_casts_own[i]) continue;
+		if (k == cache->caster_count || cache->caster_ships_own[k] != r->shadow_caster_ships_own[i]) return false;
+		struct pshine_shadow_caster caster = get_shadow_caster(r, i);
+		if (pshine_shadow_caster_moved(&cache->casters_own[k++], &caster, tolerance)) return false;
+	}
+	return k == cache->caster_count;
+}
+
+/// Fit the shadow cascades to the view out to `vulkan_renderer::shadow_distance`, and decide which
+/// ships cast into each of them (any ship can, not just the visible ones). A cascade in the atlas
+/// is reused while it still covers the view, the light hasn't turned by `shadow_light_threshold`,
+/// and its casters haven't moved, otherwise it's rendered again.
+static void fit_shadow_cascades(struct vulkan_renderer *r, struct do_frame_stuff *stuff, double aspect_ratio, double3 origin) {
+	PSHINE_PERF_FUNC();
+	floatR camera_orientation = floatRvs(r->game->camera_orientation.values);
+	double3 right = double3_float3(floatRapply(camera_orientation, float3xyz(1, 0, 0)));
+	double3 up = double3_float3(floatRapply(camera_orientation, float3xyz(0, 1, 0)));
+	double3 forward = double3_float3(floatRapply(camera_orientation, float3xyz(0, 0, 1)));
+	struct pshine_shadow_camera camera = {};
+	memcpy(camera.position, stuff->camera_pos_scs.vs, sizeof(camera.position));
+	memcpy(camera.right, right.vs, sizeof(camera.right));
+	memcpy(camera.up, up.vs, sizeof(camera.up));
+	memcpy(camera.forward, forward.vs, sizeof(camera.forward));
+	camera.tan_y = tan(r->game->actual_camera_fov * 0.5 * π / 180.0);
+	camera.tan_x = camera.tan_y * aspect_ratio;
+
+	// the star is at the origin. Until the light turns far enough, the cascades are fitted
+	// with the one they were rendered with, so that they can be compared.
+	struct pshine_shadow_light light;
+	pshine_make_shadow_light(&light, double3neg(stuff->camera_pos_scs).vs);
+	double light_cos = double3dot(double3vs(light.dir), double3vs(r->shadow_cached_light.dir));
+	if (light_cos < cos(r->shadow_light_threshold * π / 180.0)) {
+		r->shadow_cached_light = light;
+		for (uint32_t c = 0; c < PSHINE_SHADOW_CASCADE_COUNT; ++c) r->shadow_caches[c].valid = false;
+	}
+	stuff->shadow_light = r->shadow_cached_light;
+	struct pshine_shadow_cascade fitted[PSHINE_SHADOW_CASCADE_COUNT];
+	pshine_fit_shadow_cascades(
+		&camera, &stuff->shadow_light, 0.0001, SCSd_WCSd(r->shadow_distance), r->shadow_split_lambda,
+		r->shadow_cache_margin, PSHINE_SHADOW_CASCADE_SIZE, PSHINE_SHADOW_CASCADE_COUNT, fitted
+	);
+
+	size_t ship_count = r->game->ships.dyna.count;
+	if (r->shadow_caster_capacity < ship_count) {
+		r->shadow_caster_capacity = ship_count;
+		r->shadow_casters_own = realloc(r->shadow_casters_own, ship_count * sizeof(*r->shadow_casters_own));
+		r->shadow_caster_ships_own = realloc(r->shadow_caster_ships_own, ship_count * sizeof(*r->shadow_caster_ships_own));
+		r->shadow_casts_own = realloc(r->shadow_casts_own, ship_count * sizeof(*r->shadow_casts_own));
+	}
+	size_t caster_count = 0;
+	for (size_t i = 0; i < ship_count; ++i) {
+		if (r->game->ships.ptr[i]._alive_marker != (size_t)-1) continue;
+		r->game->ships.ptr[i].graphics_data->shadow_cascade_mask = 0;
+		r->shadow_casters_own[caster_count] = get_ship_bounds(&r->game->ships.ptr[i]);
+		r->shadow_caster_ships_own[caster_count++] = i;
+	}
+	stuff->shadow_render_mask = 0;
+	r->shadow_cascades_rendered = 0;
+	for (uint32_t c = 0; c < PSHINE_SHADOW_CASCADE_COUNT; ++c) {
+		struct shadow_cascade_cache *cache = &r->shadow_caches[c];
+		// a cached square that still covers the view is kept even if the casters have changed.
+		bool covers = cache->valid && pshine_shadow_cascade_covers(&cache->fitted, &fitted[c]);
+		struct pshine_shadow_cascade square = covers ? cache->fitted : fitted[c];
+		struct pshine_shadow_cascade cascade = square;
+		pshine_cull_shadow_casters(&stuff->shadow_light, &cascade, caster_count, r->shadow_casters_own, r->shadow_casts_own);
+		// a quarter of a texel is less than the filtering smears anyway.
+		bool reuse = covers && shadow_casters_unchanged(r, cache, caster_count, cascade.texel_size * 0.25);
+		if (!reuse) {
+			cache->valid = true;
+			cache->fitted = square;
+			cache->culled = cascade;
+			cache->caster_count = 0;
+			for (size_t i = 0; i < caster_count; ++i) {
+				if (!r->shadow_casts_own[i]) continue;
+				if (cache->caster_count == cache->caster_capacity) {
+					cache->caster_capacity = cache->caster_capacity == 0 ? 8 : cache->caster_capacity * 2;
+					cache->caster_ships_own = realloc(cache->caster_ships_own, cache->caster_capacity * sizeof(*cache->caster_ships_own));
+					cache->casters_own = realloc(cache->casters_own, cache->caster_capacity * sizeof(*cache->casters_own));
+				}
+				cache->caster_ships_own[cache->caster_count] = r->shadow_caster_ships_own[i];
+				cache->casters_own[cache->caster_count++] = get_shadow_caster(r, i);
+				r->game->ships.ptr[r->shadow_caster_ships_own[i]].graphics_data->shadow_cascade_mask |= 1u << c;
+			}
+			stuff->shadow_render_mask |= 1u << c;
+			++r->shadow_cascades_rendered;
+		}
+		// the depth range as it was rendered, lowered to the casters.
+		stuff->shadow_cascades[c] = cache->culled;
+		pshine_shadow_cascade_matrix(&stuff->shadow_light, &cache->culled, origin.vs, stuff->shadow_proj_mat32[c].vvs);
+	}
+}
+
+static int compare_std_mesh_parts(const void *a, const void *b) {
+	const struct std_mesh_part_ref *x = a, *y = b;
+	if (x->material_descriptor_set != y->material_descriptor_set)
+		return x->material_descriptor_set < y->material_descriptor_set ? -1 : 1;
+	if (x->ship != y->ship) return x->ship < y->ship ? -1 : 1;
+	return (x->part > y->part) - (x->part < y->part);
+}
+
+/// Sort the parts of all ships by material. Neither the materials nor the LODs (which only pick
+/// index ranges) change, and ships are never removed, so this only runs again when ships are added.
+static void update_std_mesh_part_order(struct vulkan_renderer *r) {
+	size_t ship_count = r->game->ships.dyna.count;
+	if (r->std_mesh_part_order_own != nullptr && ship_count == r->std_mesh_part_order_ship_count) return;
+	PSHINE_PERF_FUNC();
+	size_t part_count = 0;
+	for (size_t i = 0; i < ship_count; ++i) {
+		if (r->game->ships.ptr[i]._alive_marker != (size_t)-1) continue;
+		part_count += r->game->ships.ptr[i].graphics_data->model.part_count;
+	}
+	r->std_mesh_part_order_own = realloc(r->std_mesh_part_order_own, (part_count + 1) * sizeof(*r->std_mesh_part_order_own));
+	r->std_mesh_part_count = 0;
+	for (size_t i = 0; i < ship_count; ++i) {
+		if (r->game->ships.ptr[i]._alive_marker != (size_t)-1) continue;
+		const struct vulkan_mesh_model *model = &r->game->ships.ptr[i].graphics_data->model;
+		for (size_t j = 0; j < model->part_count; ++j) {
+			r->std_mesh_part_order_own[r->std_mesh_part_count++] = (struct std_mesh_part_ref){
+				.material_descriptor_set = model->materials_own[model->parts_own[j].material_index].descriptor_set,
+				.ship = (uint32_t)i,
+				.part = (uint32_t)j,
+			};
+		}
+	}
+	qsort(r->std_mesh_part_order_own, r->std_mesh_part_count, sizeof(*r->std_mesh_part_order_own), &compare_std_mesh_parts);
+	r->std_mesh_part_order_ship_count = ship_count;
+}
+
+/// Fill this frame's indirect draw list with a draw for every part of every visible ship (at the
+/// LOD selected for it), grouped by material (in the order of `update_std_mesh_part_order`). The counts are written next to the commands, so
+/// that a GPU culling pass could later compact the list in place. Then the same for each shadow
+/// cascade, with the ships that cast into it.
+static void build_std_mesh_draws(struct vulkan_renderer *r, struct per_frame_data *f) {
+	PSHINE_PERF_FUNC();
+	// the shadow casters needn't be visible.
+	size_t max_draw_count = 0;
+	for (size_t i = 0; i < r->game->ships.dyna.count; ++i) {
+		if (r->game->ships.ptr[i]._alive_marker != (size_t)-1) continue;
+		const struct pshine_ship *ship = &r->game->ships.ptr[i];
+		if (ship->graphics_data->visible || ship->graphics_data->shadow_cascade_mask != 0)
+			max_draw_count += ship->graphics_data->model.part_count;
+	}
+	reserve_std_mesh_draws(r, max_draw_count);
+
+	update_std_mesh_part_order(r);
+
+	char *list = r->data.std_mesh_draws_mapped + get_std_mesh_draw_list_size(r) * f->index;
+	VkDrawIndexedIndirectCommand *commands = (void *)list;
+	uint32_t *counts = (void *)(list + r->data.std_mesh_draw_capacity * sizeof(VkDrawIndexedIndirectCommand));
+	struct std_mesh_draw_group *groups = r->std_mesh_draw_groups_own;
+	size_t group_count = 0;
+	r->std_mesh_draw_count = 0;
+	for (size_t k = 0; k < r->std_mesh_part_count; ++k) {
+		const struct std_mesh_part_ref *ref = &r->std_mesh_part_order_own[k];
+		const struct pshine_ship *ship = &r->game->ships.ptr[ref->ship];
+		if (!ship->graphics_data->visible) continue;
+		const struct vulkan_mesh_model_part *part = &ship->graphics_data->model.parts_own[ref->part];
+		const struct pshine_mesh_lod *lod = select_mesh_lod(r, part, ship->graphics_data->lod_pixels_per_unit);
+		if (group_count == 0 || groups[group_count - 1].material_descriptor_set != ref->material_descriptor_set) {
+			groups[group_count++] = (struct std_mesh_draw_group){
+				.material_descriptor_set = ref->material_descriptor_set,
+				.first_draw = (uint32_t)r->std_mesh_draw_count,
+			};
+		}
+		++groups[group_count - 1].draw_count;
+		commands[r->std_mesh_draw_count++] = (VkDrawIndexedIndirectCommand){
+			.indexCount = lod->index_count,
+			.instanceCount = 1,
+			.firstIndex = part->first_index + lod->first_index,
+			.vertexOffset = part->vertex_offset,
+			.firstInstance = ref->ship,
+		};
+	}
+	r->std_mesh_draw_group_count = group_count;
+	counts[0] = (uint32_t)r->std_mesh_draw_count;
+	for (size_t i = 0; i < r->std_mesh_draw_group_count; ++i)
+		counts[1 + i] = r->std_mesh_draw_groups_own[i].draw_count;
+
+	for (uint32_t c = 0; c < PSHINE_SHADOW_CASCADE_COUNT; ++c) {
+		VkDrawIndexedIndirectCommand *shadow_commands = (void *)(list + get_shadow_draw_list_offset(r, c));
+		uint32_t shadow_count = 0;
+		for (size_t i = 0; i < r->game->ships.dyna.count; ++i) {
+			if (r->game->ships.ptr[i]._alive_marker != (size_t)-1) continue;
+			const struct pshine_ship *ship = &r->game->ships.ptr[i];
+			if ((ship->graphics_data->shadow_cascade_mask & (1u << c)) == 0) continue;
+			const struct vulkan_mesh_model *model = &ship->graphics_data->model;
+			for (size_t j = 0; j < model->part_count; ++j) {
+				const struct vulkan_mesh_model_part *part = &model->parts_own[j];
+				const struct pshine_mesh_lod *lod = select_mesh_lod(r, part, ship->graphics_data->lod_pixels_per_unit);
+				shadow_commands[shadow_count++] = (VkDrawIndexedIndirectCommand){
+					.indexCount = lod->index_count,
+					.instanceCount = 1,
+					.firstIndex = part->first_index + lod->first_index,
+					.vertexOffset = part->vertex_offset,
+					.firstInstance = (uint32_t)i,
+				};
+			}
+		}
+		memcpy(shadow_commands + r->data.std_mesh_draw_capacity, &shadow_count, sizeof(shadow_count));
+		r->shadow_draw_counts[c] = shadow_count;
+	}
+}
+
+/// Pick the half-res atmosphere's history for this frame, and push its uniforms. The history is
+/// reprojected relative to the nearest visible atmosphere's planet, so the planet's orbit doesn't
+/// smear it, and is dropped if that planet changes or the last frame didn't render it.
+static void write_atmo_half_res_data(
+	struct vulkan_renderer *r,
+	struct do_frame_stuff *stuff,
+	size_t frame_number,
+	double near_plane_x,
+	double near_plane_y
+) {
+	struct pshine_star_system *current_system = stuff->current_system;
+	const struct pshine_celestial_body *reference = nullptr;
+	double reference_distance = INFINITY;
+	for (size_t i = 0; r->atmo_half_res && i < current_system->body_count; ++i) {
+		const struct pshine_celestial_body *b = current_system->bodies_own[i];
+		if (b->type != PSHINE_CELESTIAL_BODY_PLANET) continue;
+		const struct pshine_planet *p = (const void *)b;
+		if (!p->has_atmosphere || !p->graphics_data->atmo_drawn) continue;
+		double distance = double3mag(double3sub(SCSd3_WCSp3(b->position), stuff->camera_pos_scs));
+		if (distance < reference_distance) {
+			reference = b;
+			reference_distance = distance;
+		}
+	}
+	stuff->atmo_half_res = reference != nullptr;
+	if (!stuff->atmo_half_res) {
+		r->atmo_history_valid = false;
+		return;
+	}
+
+	floatR camera_orientation = floatRvs(r->game->camera_orientation.values);
+	float4 camera_right = float4xyz3w(floatRapply(camera_orientation, float3xyz(1, 0, 0)), near_plane_x);
+	float4 camera_up = float4xyz3w(floatRapply(camera_orientation, float3xyz(0, 1, 0)), near_plane_y);
+	double3 camera = double3sub(stuff->camera_pos_scs, SCSd3_WCSp3(reference->position));
+	bool has_history = r->atmo_history_valid && r->atmo_prev_reference == reference
+		&& memcmp(&r->atmo_prev_extent, &stuff->render_extent, sizeof(VkExtent2D)) == 0;
+
+	struct atmo_half_res_uniform_data new_data = {
+		.prev_camera = has_history
+			? float4xyz3w(float3_double3(double3sub(r->atmo_prev_camera, camera)), 1.0f)
+			: float4v0(),
+		.prev_camera_right = has_history ? r->atmo_prev_camera_right : camera_right,
+		.prev_camera_up = has_history ? r->atmo_prev_camera_up : camera_up,
+		.divisor = PSHINE_ATMO_RESOLUTION_DIVISOR,
+		.blend = 1.0f / PSHINE_ATMO_HISTORY_FRAMES,
+		.extent = { stuff->render_extent.width, stuff->render_extent.height },
+	};
+	pshine_atmo_jitter(frame_number, PSHINE_ATMO_RESOLUTION_DIVISOR, new_data.jitter);
+	stuff->atmo_half_res_uniform_offset = push_uniform_data(r, &new_data, sizeof(new_data));
+
+	r->atmo_history_index ^= 1;
+	stuff->atmo_history_index = r->atmo_history_index;
+	r->atmo_history_valid = true;
+	r->atmo_prev_reference = reference;
+	r->atmo_prev_camera = camera;
+	r->atmo_prev_camera_right = camera_right;
+	r->atmo_prev_camera_up = camera_up;
+	r->atmo_prev_extent = stuff->render_extent;
+}
+
 static void write_game_frame_data(
 	struct vulkan_renderer *r,
 	struct per_frame_data *f,
@@ -4983,6 +6748,7 @@ static void write_game_frame_data(
 	struct do_frame_stuff *stuff
 ) {
 	PSHINE_PERF_FUNC();
+	begin_uniform_ring_frame(r, f);
 	double3 camera_pos_scs = SCSd3_WCSp3(r->game->camera_position);
 	stuff->camera_pos_scs = camera_pos_scs;
 	double3 offset = double3vs(r->game->render_origin.values);
@@ -5039,18 +6805,7 @@ static void write_game_frame_data(
 	float4x4 proj_mat32 = float4x4_double4x4(proj_mat);
 	stuff->proj_mat32 = proj_mat32;
 
-	float4x4 shadow_proj_mat32 = {};
-	{
-		// setfloat4x4persp(&shadow_proj_mat32, r->game->actual_camera_fov, 1., 0.0001);
-		// float znear = near_proj_znear;
-		float height = shadow_proj_height * 10.f * PSHINE_SCS_FACTOR;
-		float width = height * 1;
-		shadow_proj_mat32.vs[0][0] = -2.0f / width;
-		shadow_proj_mat32.vs[1][1] = -2.0f / height;
-		shadow_proj_mat32.vs[2][2] = 1.0f;
-		shadow_proj_mat32.vs[3][3] = 1.0f;
-	}
-	// shadow_proj_mat32 = proj_mat32;
+	fit_shadow_cascades(r, stuff, aspect_ratio, offset);
 
 	float4x4 inv_proj_mat32 = {};
 	float4x4invert(proj_mat32.vvs, inv_proj_mat32.vvs);
@@ -5072,13 +6827,25 @@ static void write_game_frame_data(
 			.inv_view = inv_view_mat32,
 			.local_view = local_view_mat32,
 		};
-		char *data;
-		vmaMapMemory(r->allocator, r->data.global_uniform_buffer.allocation, (void**)&data);
-		data += get_padded_uniform_buffer_size(r, sizeof(struct global_uniform_data)) * f->index;
-		memcpy(data, &new_data, sizeof(new_data));
-		vmaUnmapMemory(r->allocator, r->data.global_uniform_buffer.allocation);
+		for (uint32_t c = 0; c < PSHINE_SHADOW_CASCADE_COUNT; ++c) {
+			const struct pshine_shadow_cascade *cascade = &stuff->shadow_cascades[c];
+			new_data.shadow_proj[c] = stuff->shadow_proj_mat32[c];
+			new_data.shadow_splits.vs[c] = (float)cascade->far;
+			new_data.shadow_biases.vs[c] = (float)(cascade->texel_size / (cascade->depth_max - cascade->depth_min));
+		}
+		stuff->global_uniform_offset = push_uniform_data(r, &new_data, sizeof(new_data));
+	}
+
+	{
+		// the ship materials don't have any data of their own yet, so they all share this.
+		struct std_material_uniform_data new_data = {
+			.view_dir = floatRapply(floatRvs(r->game->camera_orientation.values), float3xyz(0, 0, 1)),
+		};
+		stuff->std_material_uniform_offset = push_uniform_data(r, &new_data, sizeof(new_data));
 	}
 
+	// the ship's index is its instance index.
+	reserve_std_mesh_instances(r, r->game->ships.dyna.count);
 	for (size_t i = 0; i < r->game->ships.dyna.count; ++i) {
 		if (r->game->ships.ptr[i]._alive_marker != (size_t)-1) continue;
 		struct pshine_ship *ship = &r->game->ships.ptr[i];
@@ -5099,7 +6866,6 @@ static void write_game_frame_data(
 		setdouble4x4trans(&model_trans_mat, double3sub(SCSd3_WCSp3(ship->position), offset));
 		double4x4 model_scale_mat;
 		setdouble4x4scale(&model_scale_mat, double3v(ship->scale * PSHINE_SCS_FACTOR));
-		float4x4 model_scale_mat32 = float4x4_double4x4(model_scale_mat);
 
 		double4x4 model_mat = {};
 		setdouble4x4iden(&model_mat);
@@ -5117,37 +6883,40 @@ static void write_game_frame_data(
 		double3 sun_pos_scs = double3v0();
 		float3 sun_dir = float3_double3(double3norm(double3sub(sun_pos_scs, ship_pos_scs)));
 
-		float4x4 shadow_view_mat32 = {};
-		// float3 tmp = float3xyz(0.01f, 0.0f, 0.01f);
-		// float3add(tmp, sun_dir)
-		setfloat4x4lookat(&shadow_view_mat32, float3neg(sun_dir), float3v0(), float3xyz(0.0f, -1.0f, 0.0f));
-
-		float4x4 shadow_model_view_mat32 = unscaled_model_mat32;
-		float4x4mul(&shadow_model_view_mat32, &model_scale_mat32);
-		float4x4mul(&shadow_model_view_mat32, &shadow_view_mat32);
-
-		// shadow_view_mat32 = local_view_mat32;
-
 		new_data.model_view = float4x4_double4x4(model_view_mat);
 		new_data.model = float4x4_double4x4(model_mat);
 		new_data.unscaled_model = unscaled_model_mat32;
 		new_data.proj = near_proj_mat32;
-		new_data.shadow_model_view = shadow_model_view_mat32;
-		new_data.shadow_proj = shadow_proj_mat32;
 
 		new_data.sun = float4xyz3w(sun_dir, 1.0f);
 
 		new_data.rel_cam_pos = float4xyz3w(float3_double3(double3sub(camera_pos_scs, ship_pos_scs)), 0.0);
 
-		vmaCopyMemoryToAllocation(
-			r->allocator, &new_data, ship->graphics_data->uniform_buffer.allocation,
-			get_padded_uniform_buffer_size(r, sizeof(struct std_mesh_uniform_data)) * f->index,
-			sizeof(new_data)
+		{
+			const double4x4 *transform = &ship->graphics_data->model.transform;
+			double transform_scale = 0.0;
+			for (size_t k = 0; k < 3; ++k)
+				transform_scale = fmax(transform_scale, double3mag(double3vs(transform->vs[k])));
+			double distance = double3mag(double3sub(camera_pos_scs, ship_pos_scs));
+			double pixels_per_radian = stuff->render_extent.height
+				/ (2.0 * tan(r->game->actual_camera_fov * 0.5 * π / 180.0));
+			double size = transform_scale * SCSd_WCSd(ship->scale);
+			ship->graphics_data->lod_pixels_per_unit = distance > 0.0
+				? (float)(size / distance * pixels_per_radian)
+				: INFINITY;
+		}
+
+		memcpy(
+			r->data.std_mesh_instances_mapped + get_std_mesh_instance_table_size(r) * f->index
+				+ i * sizeof(struct std_mesh_uniform_data),
+			&new_data, sizeof(new_data)
 		);
 	}
 
 	struct pshine_star_system *current_system = &r->game->star_systems_own[r->game->current_star_system];
 	stuff->current_system = current_system;
+	cull_game_frame(r, stuff);
+	build_std_mesh_draws(r, f);
 
 	for (size_t i = 0; i < current_system->body_count; ++i) {
 		struct pshine_celestial_body *b = current_system->bodies_own[i];
@@ -5160,25 +6929,13 @@ static void write_game_frame_data(
 			double4x4 model_rot_mat = {0};
 
 			{
-				double a = b->rotation, c = cosf(a), s = sinf(a), C = 1 - c;
-				double3 axis = double3norm(double3vs(b->rotation_axis.values));
-
-				model_rot_mat.vs[0][0] = c + C * axis.x * axis.x;
-				model_rot_mat.vs[0][1] = C * axis.x * axis.y + s * axis.z;
-				model_rot_mat.vs[0][2] = C * axis.x * axis.z - s * axis.y;
-				model_rot_mat.vs[0][3] = 0.0f;
-				model_rot_mat.vs[1][0] = C * axis.y * axis.x - s * axis.z;
-				model_rot_mat.vs[1][1] = c + C * axis.y * axis.y;
-				model_rot_mat.vs[1][2] = C * axis.y * axis.z + s * axis.x;
-				model_rot_mat.vs[1][3] = 0.0f;
-				model_rot_mat.vs[2][0] = C * axis.z * axis.x + s * axis.y;
-				model_rot_mat.vs[2][1] = C * axis.z * axis.y - s * axis.x;
-				model_rot_mat.vs[2][2] = c + C * axis.z * axis.z;
-				model_rot_mat.vs[2][3] = 0.0f;
-				model_rot_mat.vs[3][0] = 0.0f;
-				model_rot_mat.vs[3][1] = 0.0f;
-				model_rot_mat.vs[3][2] = 0.0f;
-				model_rot_mat.vs[3][3] = 1.0f;
+				// shared with the ship collisions, which undo it with `pshine_body_local_vector`.
+				double rot[3][3];
+				pshine_body_rotation_matrix(b, rot);
+				setdouble4x4iden(&model_rot_mat);
+				for (size_t c = 0; c < 3; ++c) {
+					for (size_t k = 0; k < 3; ++k) model_rot_mat.vs[c][k] = rot[c][k];
+				}
 				// double4x4mul(&model_mat, &r);
 			}
 
@@ -5219,24 +6976,23 @@ static void write_game_frame_data(
 			double3 body_pos = SCSd3_WCSp3(b->position);
 			new_data.sun = float4xyz3w(float3_double3(double3norm(double3sub(sun_pos, body_pos))), 1.0f);
 
-			struct vulkan_buffer *uniform_buffer = nullptr;
-			struct vulkan_buffer *rings_uniform_buffer = nullptr;
+			select_celestial_body_lod(r, b, camera_pos_scs);
+			new_data.lod_morph = get_celestial_body_lod_state(b)->morph;
+
+			uint32_t *uniform_offset = nullptr;
+			uint32_t *rings_uniform_offset = nullptr;
 			if (b->type == PSHINE_CELESTIAL_BODY_PLANET) {
 				struct pshine_planet *p = (void *)b;
-				uniform_buffer = &p->graphics_data->uniform_buffer;
-				rings_uniform_buffer = &p->graphics_data->rings_uniform_buffer;
+				uniform_offset = &p->graphics_data->uniform_offset;
+				rings_uniform_offset = &p->graphics_data->rings_uniform_offset;
 			} else if (b->type == PSHINE_CELESTIAL_BODY_STAR) {
 				struct pshine_star *p = (void *)b;
-				uniform_buffer = &p->graphics_data->uniform_buffer;
-				rings_uniform_buffer = &p->graphics_data->rings_uniform_buffer;
+				uniform_offset = &p->graphics_data->uniform_offset;
+				rings_uniform_offset = &p->graphics_data->rings_uniform_offset;
 			} else {
-				PSHINE_ERROR("Unknown body type: %d", b->type);
+				PSHINE_PANIC("Unknown body type: %d", b->type);
 			}
-			char *data_raw;
-			vmaMapMemory(r->allocator, uniform_buffer->allocation, (void**)&data_raw);
-			data_raw += get_padded_uniform_buffer_size(r, sizeof(struct planet_mesh_uniform_data)) * f->index;
-			memcpy(data_raw, &new_data, sizeof(new_data));
-			vmaUnmapMemory(r->allocator, uniform_buffer->allocation);
+			*uniform_offset = push_uniform_data(r, &new_data, sizeof(new_data));
 			// Rings
 			if (b->rings.has_rings) {
 				double4x4 model_scale_mat;
@@ -5257,13 +7013,17 @@ static void write_game_frame_data(
 					.sun = new_data.sun,
 					.shadow_smoothing = b->rings.shadow_smoothing,
 				};
-				vmaCopyMemoryToAllocation(r->allocator, &new_data_rings, rings_uniform_buffer->allocation,
-					get_padded_uniform_buffer_size(r, sizeof(struct rings_uniform_data)) * f->index,
-					sizeof(new_data_rings));
+				*rings_uniform_offset = push_uniform_data(r, &new_data_rings, sizeof(new_data_rings));
 			}
 		}
 	}
 
+	struct atmo_batch_data *atmo_batch
+		= (void *)(r->data.atmo_batch_mapped + get_atmo_batch_table_size(r) * f->index);
+	atmo_batch->count = 0;
+	// the batch's planets and how many pixels across they are, the smallest are left out if there are too many.
+	const struct pshine_planet *atmo_planets[PSHINE_ATMO_MAX_BATCH];
+	float atmo_pixels[PSHINE_ATMO_MAX_BATCH];
 	for (size_t i = 0; i < current_system->body_count; ++i) {
 		struct pshine_celestial_body *b = current_system->bodies_own[i];
 		if (b->type == PSHINE_CELESTIAL_BODY_PLANET) {
@@ -5282,6 +7042,18 @@ static void write_game_frame_data(
 
 				double3 cam_rel_pos_scaled = double3div(double3sub(scs_rel_cam, scs_body_rel_pos), scale_fact);
 
+				// the aerial perspective volume only covers the atmosphere's part of the screen.
+				floatR camera_orientation = floatRvs(r->game->camera_orientation.values);
+				double3 cam_right = double3_float3(floatRapply(camera_orientation, float3xyz(1, 0, 0)));
+				double3 cam_up = double3_float3(floatRapply(camera_orientation, float3xyz(0, 1, 0)));
+				double3 cam_forward = double3cross(cam_right, cam_up);
+				float4 aerial_rect;
+				pshine_atmo_screen_rect(
+					cam_rel_pos_scaled.vs, cam_right.vs, cam_up.vs, cam_forward.vs,
+					persp_info.plane.x / persp_info.znear, persp_info.plane.y / persp_info.znear,
+					(const double[3]){ 0.0, 0.0, 0.0 }, 1.0, aerial_rect.vs
+				);
+
 				double3 sun_pos = double3v0();
 				struct atmo_uniform_data new_data = {
 					.planet = float4xyz3w(
@@ -5290,6 +7062,7 @@ static void write_game_frame_data(
 					),
 					.radius = 1.0f,
 					.camera = float4xyz3w(float3_double3(cam_rel_pos_scaled), 0.0f),
+					.aerial_rect = aerial_rect,
 					.coefs_ray = float4xyz3w(
 						float3vs(p->atmosphere.rayleigh_coefs),
 						p->atmosphere.rayleigh_falloff
@@ -5300,19 +7073,39 @@ static void write_game_frame_data(
 						p->atmosphere.mie_g_coef,
 						p->atmosphere.mie_falloff
 					),
-					.optical_depth_samples = 5,
-					.scatter_point_samples = 80,
+					.sky_view_samples = PSHINE_ATMO_SKY_VIEW_SAMPLES,
+					.aerial_samples = PSHINE_ATMO_AERIAL_SAMPLES,
 					.intensity = p->atmosphere.intensity,
 					.sun = float3_double3(double3norm(double3sub(sun_pos, scs_body_pos))),
 					.scale_factor = scale_fact,
 				};
-				vmaCopyMemoryToAllocation(
-					r->allocator,
-					&new_data,
-					p->graphics_data->atmo_uniform_buffer.allocation,
-					get_padded_uniform_buffer_size(r, sizeof(struct atmo_uniform_data)) * f->index,
-					sizeof(new_data)
-				);
+				// too small to see is as good as culled.
+				float pixels = fmaxf(aerial_rect.z * stuff->render_extent.width, aerial_rect.w * stuff->render_extent.height);
+				p->graphics_data->atmo_drawn = stuff->body_visible[i] && pixels >= r->atmo_min_pixels
+					&& p->graphics_data->atmo_lut_ready;
+				if (p->graphics_data->atmo_drawn) {
+					uint32_t slot = atmo_batch->count;
+					if (slot < PSHINE_ATMO_MAX_BATCH) {
+						++atmo_batch->count;
+					} else {
+						slot = 0;
+						for (uint32_t k = 1; k < PSHINE_ATMO_MAX_BATCH; ++k)
+							if (atmo_pixels[k] < atmo_pixels[slot]) slot = k;
+						if (atmo_pixels[slot] < pixels) {
+							atmo_planets[slot]->graphics_data->atmo_drawn = false;
+						} else {
+							p->graphics_data->atmo_drawn = false;
+							slot = UINT32_MAX;
+						}
+					}
+					if (slot != UINT32_MAX) {
+						// the planet's layer and tile of the frame's LUTs, see `atmo_aerial_tile`.
+						new_data.camera.w = (float)slot;
+						atmo_batch->atmos[slot] = new_data;
+						atmo_planets[slot] = p;
+						atmo_pixels[slot] = pixels;
+					}
+				}
 			}
 
 			{
@@ -5321,16 +7114,23 @@ static void write_game_frame_data(
 					.view_dir = floatRapply(floatRvs(r->game->camera_orientation.values), float3xyz(0, 0, 1)),
 					.smoothness = r->game->material_smoothness_,
 				};
-				vmaCopyMemoryToAllocation(
-					r->allocator,
-					&new_data,
-					p->graphics_data->material_uniform_buffer.allocation,
-					get_padded_uniform_buffer_size(r, sizeof(struct planet_material_uniform_data)) * f->index,
-					sizeof(new_data)
-				);
+				p->graphics_data->material_uniform_offset = push_uniform_data(r, &new_data, sizeof(new_data));
 			}
 		}
 	}
+
+	stuff->atmo_count = atmo_batch->count;
+	// pushed once the slots are settled, the LUT pass writes each planet's to its slot.
+	for (uint32_t i = 0; i < atmo_batch->count; ++i)
+		atmo_planets[i]->graphics_data->atmo_uniform_offset
+			= push_uniform_data(r, &atmo_batch->atmos[i], sizeof(atmo_batch->atmos[i]));
+	float atmo_rects[PSHINE_ATMO_MAX_BATCH][4];
+	for (uint32_t i = 0; i < atmo_batch->count; ++i)
+		memcpy(atmo_rects[i], atmo_batch->atmos[i].aerial_rect.vs, sizeof(atmo_rects[i]));
+	stuff->atmo_rect_count = (uint32_t)pshine_atmo_pixel_rects(atmo_batch->count, (const float (*)[4])atmo_rects,
+		stuff->render_extent.width, stuff->render_extent.height, stuff->atmo_rects);
+
+	write_atmo_half_res_data(r, stuff, frame_number, persp_info.plane.x, persp_info.plane.y);
 }
 
 static void render_game_frame(
@@ -5340,6 +7140,36 @@ static void render_game_frame(
 	size_t frame_number
 );
 
+/// How many frames are measured at a render scale before it's changed again.
+enum : uint32_t { RENDER_SCALE_INTERVAL = 15 };
+
+/// Move `vulkan_renderer::render_scale` towards `target_gpu_time`, from the GPU time of the main queue's
+/// passes. The scale is kept while the time is within a band around the target, so that it doesn't
+/// flip between two scales, and it changes by at most a tenth at a time.
+static void update_render_scale(struct vulkan_renderer *r) {
+	const struct pshine_gpu_perf *perf = &r->gpu_perf;
+	if (!r->dynamic_resolution || perf->frame_count == 0) return;
+	if (perf->complete_frame_count == r->render_scale_seen_frames) return;
+	r->render_scale_seen_frames = perf->complete_frame_count;
+	// the frames that were in flight when the scale changed are rendered at the old one.
+	uint32_t settle_frames = r->frames_in_flight + 1;
+	uint32_t sample = r->render_gpu_time_samples++;
+	if (sample < settle_frames) return;
+	r->render_gpu_time = sample == settle_frames
+		? perf->last_frame_time
+		: r->render_gpu_time + 0.2 * (perf->last_frame_time - r->render_gpu_time);
+	if (sample < settle_frames + RENDER_SCALE_INTERVAL || r->render_gpu_time <= 0.0) return;
+
+	double ratio = r->target_gpu_time / r->render_gpu_time;
+	if (ratio > 0.9 && ratio < 1.05) return;
+	// the time is about proportional to the pixels, so to the scale squared.
+	double scale = r->render_scale * fmin(fmax(sqrt(ratio), 0.9), 1.1);
+	scale = fmin(fmax(round(scale * 32.0) / 32.0, r->min_render_scale), 1.0);
+	if ((float)scale == r->render_scale) return;
+	r->render_scale = (float)scale;
+	r->render_gpu_time_samples = 0;
+}
+
 static void do_game_frame(
 	struct vulkan_renderer *r,
 	struct per_frame_data *f,
@@ -5347,6 +7177,12 @@ static void do_game_frame(
 ) {
 	PSHINE_PERF_FUNC();
 	struct do_frame_stuff stuff = {};
+	update_render_scale(r);
+	stuff.render_extent = (VkExtent2D){
+		.width = (uint32_t)fmax(round(r->swapchain_extent.width * (double)r->render_scale), 1.0),
+		.height = (uint32_t)fmax(round(r->swapchain_extent.height * (double)r->render_scale), 1.0),
+	};
+	update_atmo_luts(r);
 	write_game_frame_data(r, f, frame_number, &stuff);
 
 	CHECKVK(vkBeginCommandBuffer(f->command_buffer, &(VkCommandBufferBeginInfo){
@@ -5355,7 +7191,9 @@ static void do_game_frame(
 
 	render_game_frame(r, f, &stuff, frame_number);
 
-	vkCmdPipelineBarrier2(f->command_buffer, &(VkDependencyInfo){
+	// the last segment is still being recorded, and it's the one that writes to the swapchain image.
+	VkCommandBuffer last_command_buffer = f->submits[f->submit_count - 1].command_buffer;
+	vkCmdPipelineBarrier2(last_command_buffer, &(VkDependencyInfo){
 			.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
 			.imageMemoryBarrierCount = 1,
 			.pImageMemoryBarriers = &(VkImageMemoryBarrier2){
@@ -5379,549 +7217,888 @@ static void do_game_frame(
 			},
 		});
 
-	CHECKVK(vkEndCommandBuffer(f->command_buffer));
+	CHECKVK(vkEndCommandBuffer(last_command_buffer));
 }
 
-static void render_game_frame(
+static void record_shadow_pass(
 	struct vulkan_renderer *r,
 	struct per_frame_data *f,
-	struct do_frame_stuff *stuff,
-	size_t frame_number
+	const struct do_frame_stuff *stuff,
+	VkCommandBuffer cmd
 ) {
-	PSHINE_PERF_FUNC();
-	struct pshine_star_system *current_system = stuff->current_system;
-	double3 camera_pos_scs = stuff->camera_pos_scs;
-
-	// Image transitions for the bloom, as early as possible.
-	// transients-color0 is shader-read-only-optimal, which is what we need for the compute shaders already.
-	// so no need to transition that. but we do need to transition the transient bloom images to general for
-	// the compute shader to write to them.
-	{
-		PSHINE_PERF_ZONE("Bloom barriers");
-		VkImageMemoryBarrier2 bloom_image_barriers[BLOOM_STAGE_COUNT];
-		for (size_t i = 0; i < BLOOM_STAGE_COUNT; ++i) {
-			bloom_image_barriers[i] = (VkImageMemoryBarrier2){
-				.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
-				.image = r->transients.bloom[i].image,
-				.srcStageMask = VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT,
-				.srcAccessMask = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT,
-				.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
-				.dstAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT,
-				.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-				.newLayout = VK_IMAGE_LAYOUT_GENERAL,
-				.subresourceRange = (VkImageSubresourceRange){
-					.levelCount = 1,
-					.layerCount = 1,
-					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-					.baseMipLevel = 0,
-					.baseArrayLayer = 0,
-				},
-				.srcQueueFamilyIndex = r->queue_families[QUEUE_GRAPHICS],
-				.dstQueueFamilyIndex = r->queue_families[QUEUE_GRAPHICS],
-			};
-		}
-		vkCmdPipelineBarrier2(f->command_buffer, &(VkDependencyInfo){
-			.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
-			.dependencyFlags = 0,
-			.imageMemoryBarrierCount = BLOOM_STAGE_COUNT,
-			.pImageMemoryBarriers = bloom_image_barriers,
-		});
-	}
-
-	rg_graph_begin_frame(
-		&r->rgraph,
-		(VkRect2D){
-			.offset = (VkOffset2D){ 0, 0 },
-			.extent = r->swapchain_extent,
-		},
-		r->queue_families[QUEUE_GRAPHICS],
-		f->swapchain_image,
-		f->swapchain_image_view,
-		f->command_buffer
+	PSHINE_PERF_ZONE("Pass: Shadow");
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, r->pipelines.std_mesh_shadow_pipeline);
+	vkCmdBindDescriptorSets(
+		cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, r->pipelines.std_mesh_shadow_layout,
+		0, 1, (VkDescriptorSet[]){ r->data.std_mesh_descriptor_set },
+		1, (uint32_t[]){ get_std_mesh_instance_table_size(r) * f->index }
 	);
-
-	rg_graph_begin_pass(&r->rgraph); // Shadow
-	{
-		PSHINE_PERF_ZONE("Pass: Shadow");
-		vkCmdBindPipeline(f->command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, r->pipelines.std_mesh_shadow_pipeline);
-		vkCmdSetViewport(f->command_buffer, 0, 1, &(VkViewport){
-			.x = 0.0f,
-			.y = 0.0f,
-			.width = (float)r->transients.shadow[0].width,
-			.height = (float)r->transients.shadow[0].height,
+	vkCmdBindIndexBuffer(cmd, r->mesh_arena.index_buffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+	vkCmdBindVertexBuffers(cmd, 0, 1, &r->mesh_arena.vertex_buffer.buffer, &(VkDeviceSize){0});
+	// each cascade that's rendered again into its tile of the atlas, with the ships that cast into it.
+	for (uint32_t c = 0; c < PSHINE_SHADOW_CASCADE_COUNT; ++c) {
+		if ((stuff->shadow_render_mask & (1u << c)) == 0) continue;
+		VkRect2D tile = {
+			.offset = { (int32_t)(c % 2 * PSHINE_SHADOW_CASCADE_SIZE), (int32_t)(c / 2 * PSHINE_SHADOW_CASCADE_SIZE) },
+			.extent = { PSHINE_SHADOW_CASCADE_SIZE, PSHINE_SHADOW_CASCADE_SIZE },
+		};
+		vkCmdSetViewport(cmd, 0, 1, &(VkViewport){
+			.x = (float)tile.offset.x,
+			.y = (float)tile.offset.y,
+			.width = (float)tile.extent.width,
+			.height = (float)tile.extent.height,
 			.minDepth = 0.0f,
 			.maxDepth = 1.0f,
 		});
-		vkCmdSetScissor(
-			f->command_buffer, 0, 1,
-			&(VkRect2D){
-				.offset = { 0, 0 },
-				.extent.width = r->transients.shadow[0].width,
-				.extent.height = r->transients.shadow[0].height,
-			}
+		vkCmdSetScissor(cmd, 0, 1, &tile);
+		// the attachments are loaded, so that the other tiles are kept.
+		vkCmdClearAttachments(cmd, 2, (VkClearAttachment[]){
+			{ .aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT, .clearValue.depthStencil = { 0.0f, 0 } },
+			{ .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .colorAttachment = 0 },
+		}, 1, &(VkClearRect){ .rect = tile, .baseArrayLayer = 0, .layerCount = 1 });
+		if (r->shadow_draw_counts[c] == 0) continue;
+		vkCmdPushConstants(
+			cmd, r->pipelines.std_mesh_shadow_layout, VK_SHADER_STAGE_VERTEX_BIT,
+			0, sizeof(float4x4), &stuff->shadow_proj_mat32[c]
 		);
-		for (size_t i = 0; i < r->game->ships.dyna.count; ++i) {
-			/// Technically, accessing this might be UB if this is not a valid marker,
-			/// but no compilers care because most code relies on this being non-UB.
-			if (r->game->ships.ptr[i]._alive_marker != (size_t)-1) {
-				continue;
-			}
-			struct pshine_ship *ship = &r->game->ships.ptr[i];
+		// all materials at once, the shadow pass doesn't use them.
+		VkDeviceSize list_offset = get_std_mesh_draw_list_size(r) * f->index + get_shadow_draw_list_offset(r, c);
+		vkCmdDrawIndexedIndirectCount(
+			cmd,
+			r->data.std_mesh_draw_buffer.buffer, list_offset,
+			r->data.std_mesh_draw_buffer.buffer,
+			list_offset + r->data.std_mesh_draw_capacity * sizeof(VkDrawIndexedIndirectCommand),
+			(uint32_t)r->shadow_draw_counts[c], sizeof(VkDrawIndexedIndirectCommand)
+		);
+	}
+}
+
+/// The viewport and scissor of the passes that render at `do_frame_stuff::render_extent`.
+static void set_render_viewport(VkCommandBuffer cmd, VkExtent2D extent) {
+	vkCmdSetViewport(cmd, 0, 1, &(VkViewport){
+		.x = 0.0f,
+		.y = 0.0f,
+		.width = (float)extent.width,
+		.height = (float)extent.height,
+		.minDepth = 0.0f,
+		.maxDepth = 1.0f,
+	});
+	vkCmdSetScissor(cmd, 0, 1, &(VkRect2D){ .offset = { 0, 0 }, .extent = extent });
+}
+
+static size_t get_body_draws_chunk_count(const struct vulkan_renderer *r, const struct do_frame_stuff *stuff) {
+	(void)r;
+	return (stuff->current_system->body_count + RECORD_BODIES_PER_CHUNK - 1) / RECORD_BODIES_PER_CHUNK;
+}
+
+/// Planets and stars of a chunk of the bodies, and the rings of all of them in the last chunk,
+/// so that they blend over every body.
+static void record_body_draws(
+	struct vulkan_renderer *r,
+	struct per_frame_data *f,
+	const struct do_frame_stuff *stuff,
+	VkCommandBuffer cmd,
+	size_t chunk,
+	size_t chunk_count
+) {
+	PSHINE_PERF_ZONE("Pass: HDR Geometry (bodies)");
+	struct pshine_star_system *current_system = stuff->current_system;
+	double3 camera_pos_scs = stuff->camera_pos_scs;
+	size_t first_body = current_system->body_count * chunk / chunk_count;
+	size_t end_body = current_system->body_count * (chunk + 1) / chunk_count;
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, r->pipelines.planet_mesh_pipeline);
+	set_render_viewport(cmd, stuff->render_extent);
+	for (size_t i = first_body; i < end_body; ++i) {
+		struct pshine_celestial_body *b = current_system->bodies_own[i];
+		if (!stuff->body_visible[i]) continue;
+		if (b->type == PSHINE_CELESTIAL_BODY_PLANET) {
+			struct pshine_planet *p = (void *)b;
 			vkCmdBindDescriptorSets(
-				f->command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, r->pipelines.std_mesh_shadow_layout,
-				0, 1, (VkDescriptorSet[]){ ship->graphics_data->descriptor_set },
-				1, (uint32_t[]){
-					get_padded_uniform_buffer_size(r, sizeof(struct std_mesh_uniform_data)) * f->index
+				cmd,
+				VK_PIPELINE_BIND_POINT_GRAPHICS,
+				r->pipelines.planet_mesh_layout,
+				0,
+				2,
+				(VkDescriptorSet[]){ r->data.global_descriptor_set, p->graphics_data->material_descriptor_set },
+				2, (uint32_t[]){
+					stuff->global_uniform_offset,
+					p->graphics_data->material_uniform_offset,
 				}
 			);
-			for (size_t j = 0; j < ship->graphics_data->model.part_count; ++j) {
-				struct vulkan_mesh *mesh = &ship->graphics_data->model.parts_own[j].mesh;
-				vkCmdBindIndexBuffer(f->command_buffer, mesh->index_buffer.buffer, 0, VK_INDEX_TYPE_UINT32);
-				vkCmdBindVertexBuffers(f->command_buffer, 0, 1, &mesh->vertex_buffer.buffer, &(VkDeviceSize){0});
-				vkCmdDrawIndexed(f->command_buffer, mesh->index_count, 1, 0, 0, 0);
-			}
+
+			size_t lod = get_celestial_body_lod_state(b)->lod;
+			if (lod >= r->sphere_mesh_count) lod = r->sphere_mesh_count - 1;
+			vkCmdBindDescriptorSets(
+				cmd,
+				VK_PIPELINE_BIND_POINT_GRAPHICS,
+				r->pipelines.planet_mesh_layout,
+				2,
+				1,
+				&p->graphics_data->descriptor_set,
+				1, &p->graphics_data->uniform_offset
+			);
+			vkCmdBindVertexBuffers(cmd, 0, 1, &r->own_sphere_meshes[lod].vertex_buffer.buffer,
+				&(VkDeviceSize){0});
+			vkCmdBindIndexBuffer(cmd, r->own_sphere_meshes[lod].index_buffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+			vkCmdDrawIndexed(cmd, r->own_sphere_meshes[lod].index_count, 1, 0, 0, 0);
 		}
 	}
-	rg_graph_end_pass(&r->rgraph);
 
-	rg_graph_begin_pass(&r->rgraph); // HDR Geometry
-	{
-		PSHINE_PERF_ZONE("Pass: HDR Geometry");
-		vkCmdBindPipeline(f->command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, r->pipelines.planet_mesh_pipeline);
-		vkCmdSetViewport(f->command_buffer, 0, 1, &(VkViewport){
-			.x = 0.0f,
-			.y = 0.0f,
-			.width = (float)r->swapchain_extent.width,
-			.height = (float)r->swapchain_extent.height,
-			.minDepth = 0.0f,
-			.maxDepth = 1.0f,
-		});
-		vkCmdSetScissor(f->command_buffer, 0, 1, &(VkRect2D){ .offset = { 0, 0 }, .extent = r->swapchain_extent });
-		for (size_t i = 0; i < current_system->body_count; ++i) {
-			struct pshine_celestial_body *b = current_system->bodies_own[i];
-			if (b->type == PSHINE_CELESTIAL_BODY_PLANET) {
-				struct pshine_planet *p = (void *)b;
-				vkCmdBindDescriptorSets(
-					f->command_buffer,
-					VK_PIPELINE_BIND_POINT_GRAPHICS,
-					r->pipelines.planet_mesh_layout,
-					0,
-					2,
-					(VkDescriptorSet[]){ r->data.global_descriptor_set, p->graphics_data->material_descriptor_set },
-					2, (uint32_t[]){
-						get_padded_uniform_buffer_size(r, sizeof(struct global_uniform_data)) * f->index,
-						get_padded_uniform_buffer_size(r, sizeof(struct planet_material_uniform_data)) * f->index,
-					}
-				);
-
-				size_t lod = select_celestial_body_lod(r, b, camera_pos_scs);
-				if (lod >= r->sphere_mesh_count) lod = r->sphere_mesh_count - 1;
-				vkCmdBindDescriptorSets(
-					f->command_buffer,
-					VK_PIPELINE_BIND_POINT_GRAPHICS,
-					r->pipelines.planet_mesh_layout,
-					2,
-					1,
-					&p->graphics_data->descriptor_set,
-					1, (uint32_t[]){
-						get_padded_uniform_buffer_size(r, sizeof(struct planet_mesh_uniform_data)) * f->index
-					}
-				);
-				vkCmdBindVertexBuffers(f->command_buffer, 0, 1, &r->own_sphere_meshes[lod].vertex_buffer.buffer,
-					&(VkDeviceSize){0});
-				vkCmdBindIndexBuffer(f->command_buffer, r->own_sphere_meshes[lod].index_buffer.buffer, 0, VK_INDEX_TYPE_UINT32);
-				vkCmdDrawIndexed(f->command_buffer, r->own_sphere_meshes[lod].index_count, 1, 0, 0, 0);
-			}
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, r->pipelines.planet_color_mesh_pipeline);
+	set_render_viewport(cmd, stuff->render_extent);
+	vkCmdBindDescriptorSets(
+		cmd,
+		VK_PIPELINE_BIND_POINT_GRAPHICS,
+		r->pipelines.planet_mesh_layout,
+		0,
+		1,
+		(VkDescriptorSet[]){ r->data.global_descriptor_set },
+		1, (uint32_t[]){
+			stuff->global_uniform_offset
 		}
+	);
 
-		vkCmdBindPipeline(f->command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, r->pipelines.planet_color_mesh_pipeline);
-		vkCmdSetViewport(f->command_buffer, 0, 1, &(VkViewport){
-			.x = 0.0f,
-			.y = 0.0f,
-			.width = (float)r->swapchain_extent.width,
-			.height = (float)r->swapchain_extent.height,
-			.minDepth = 0.0f,
-			.maxDepth = 1.0f,
-		});
-		vkCmdSetScissor(f->command_buffer, 0, 1, &(VkRect2D){ .offset = { 0, 0 }, .extent = r->swapchain_extent });
-		vkCmdBindDescriptorSets(
-			f->command_buffer,
-			VK_PIPELINE_BIND_POINT_GRAPHICS,
-			r->pipelines.planet_mesh_layout,
-			0,
-			1,
-			(VkDescriptorSet[]){ r->data.global_descriptor_set },
-			1, (uint32_t[]){
-				get_padded_uniform_buffer_size(r, sizeof(struct global_uniform_data)) * f->index
-			}
-		);
-
-		for (size_t i = 0; i < current_system->body_count; ++i) {
-			struct pshine_celestial_body *b = current_system->bodies_own[i];
-			if (b->type == PSHINE_CELESTIAL_BODY_STAR) {
-				struct pshine_star *p = (void *)b;
-				double3 star_pos_scs = SCSd3_WCSp3(p->as_body.position);
-				double3 to_star = double3sub(star_pos_scs, camera_pos_scs);
-				double cam_distance = hypot(hypot(to_star.x, to_star.y), to_star.z);
-				// 149 598 000
-				double distance_factor = pow(cam_distance / PSHINE_AU_SCS, -2.0);
-				// double3 camera_pos_scs;
-				pshine_color_rgb rgb = pshine_blackbody_temp_to_rgb(p->temperature);
-				float4 color = float4xyz3w(
-					float3add(
-						float3xyz(rgb.rgb.r, rgb.rgb.g, rgb.rgb.b),
-						float3v(0.0f)
-					),
-					p->temperature / 20.0f * (float)distance_factor
-				);
-				vkCmdPushConstants(f->command_buffer, r->pipelines.planet_color_mesh_layout,
-					VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(float4), &color);
-				size_t lod = select_celestial_body_lod(r, b, camera_pos_scs);
-				if (lod >= r->sphere_mesh_count) lod = r->sphere_mesh_count - 1;
-				vkCmdBindDescriptorSets(
-					f->command_buffer,
-					VK_PIPELINE_BIND_POINT_GRAPHICS,
-					r->pipelines.planet_color_mesh_layout,
-					1,
-					1,
-					&p->graphics_data->descriptor_set,
-					1, (uint32_t[]){
-						get_padded_uniform_buffer_size(r, sizeof(struct planet_mesh_uniform_data)) * f->index
-					}
-				);
-				vkCmdBindVertexBuffers(f->command_buffer, 0, 1, &r->own_sphere_meshes[lod].vertex_buffer.buffer, &(VkDeviceSize){0});
-				vkCmdBindIndexBuffer(f->command_buffer, r->own_sphere_meshes[lod].index_buffer.buffer, 0, VK_INDEX_TYPE_UINT32);
-				vkCmdDrawIndexed(f->command_buffer, r->own_sphere_meshes[lod].index_count, 1, 0, 0, 0);
-			}
+	for (size_t i = first_body; i < end_body; ++i) {
+		struct pshine_celestial_body *b = current_system->bodies_own[i];
+		if (!stuff->body_visible[i]) continue;
+		if (b->type == PSHINE_CELESTIAL_BODY_STAR) {
+			struct pshine_star *p = (void *)b;
+			double3 star_pos_scs = SCSd3_WCSp3(p->as_body.position);
+			double3 to_star = double3sub(star_pos_scs, camera_pos_scs);
+			double cam_distance = hypot(hypot(to_star.x, to_star.y), to_star.z);
+			// 149 598 000
+			double distance_factor = pow(cam_distance / PSHINE_AU_SCS, -2.0);
+			// double3 camera_pos_scs;
+			pshine_color_rgb rgb = pshine_blackbody_temp_to_rgb(p->temperature);
+			float4 color = float4xyz3w(
+				float3add(
+					float3xyz(rgb.rgb.r, rgb.rgb.g, rgb.rgb.b),
+					float3v(0.0f)
+				),
+				p->temperature / 20.0f * (float)distance_factor
+			);
+			vkCmdPushConstants(cmd, r->pipelines.planet_color_mesh_layout,
+				VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(float4), &color);
+			size_t lod = get_celestial_body_lod_state(b)->lod;
+			if (lod >= r->sphere_mesh_count) lod = r->sphere_mesh_count - 1;
+			vkCmdBindDescriptorSets(
+				cmd,
+				VK_PIPELINE_BIND_POINT_GRAPHICS,
+				r->pipelines.planet_color_mesh_layout,
+				1,
+				1,
+				&p->graphics_data->descriptor_set,
+				1, &p->graphics_data->uniform_offset
+			);
+			vkCmdBindVertexBuffers(cmd, 0, 1, &r->own_sphere_meshes[lod].vertex_buffer.buffer, &(VkDeviceSize){0});
+			vkCmdBindIndexBuffer(cmd, r->own_sphere_meshes[lod].index_buffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+			vkCmdDrawIndexed(cmd, r->own_sphere_meshes[lod].index_count, 1, 0, 0, 0);
 		}
+	}
 
-		vkCmdBindPipeline(f->command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, r->pipelines.rings_pipeline);
-		vkCmdSetViewport(f->command_buffer, 0, 1, &(VkViewport){
-			.x = 0.0f,
-			.y = 0.0f,
-			.width = (float)r->swapchain_extent.width,
-			.height = (float)r->swapchain_extent.height,
-			.minDepth = 0.0f,
-			.maxDepth = 1.0f,
-		});
-		vkCmdSetScissor(f->command_buffer, 0, 1, &(VkRect2D){ .offset = { 0, 0 }, .extent = r->swapchain_extent });
-		for (size_t i = 0; i < current_system->body_count; ++i) {
-			struct pshine_celestial_body *b = current_system->bodies_own[i];
-			if (!b->rings.has_rings) continue;
-			if (b->type == PSHINE_CELESTIAL_BODY_PLANET) {
-				struct pshine_planet *p = (void *)b;
-				vkCmdBindDescriptorSets(
-					f->command_buffer,
-					VK_PIPELINE_BIND_POINT_GRAPHICS,
-					r->pipelines.rings_layout,
-					1,
-					1,
-					(VkDescriptorSet[]){ p->graphics_data->rings_descriptor_set },
-					1, (uint32_t[]){
-						get_padded_uniform_buffer_size(r, sizeof(struct rings_uniform_data)) * f->index
-					}
-				);
-				vkCmdDraw(f->command_buffer, 6, 1, 0, 0);
-			}
+	if (chunk + 1 != chunk_count) return;
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, r->pipelines.rings_pipeline);
+	set_render_viewport(cmd, stuff->render_extent);
+	for (size_t i = 0; i < current_system->body_count; ++i) {
+		struct pshine_celestial_body *b = current_system->bodies_own[i];
+		if (!b->rings.has_rings || !stuff->body_visible[i]) continue;
+		if (b->type == PSHINE_CELESTIAL_BODY_PLANET) {
+			struct pshine_planet *p = (void *)b;
+			vkCmdBindDescriptorSets(
+				cmd,
+				VK_PIPELINE_BIND_POINT_GRAPHICS,
+				r->pipelines.rings_layout,
+				1,
+				1,
+				(VkDescriptorSet[]){ p->graphics_data->rings_descriptor_set },
+				1, &p->graphics_data->rings_uniform_offset
+			);
+			vkCmdDraw(cmd, 6, 1, 0, 0);
 		}
+	}
+}
 
-		vkCmdBindPipeline(f->command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, r->pipelines.std_mesh_de_pipeline);
-		vkCmdSetViewport(f->command_buffer, 0, 1, &(VkViewport){
-			.x = 0.0f,
-			.y = 0.0f,
-			.width = (float)r->swapchain_extent.width,
-			.height = (float)r->swapchain_extent.height,
-			.minDepth = 0.0f,
-			.maxDepth = 1.0f,
-		});
-		vkCmdSetScissor(f->command_buffer, 0, 1, &(VkRect2D){ .offset = { 0, 0 }, .extent = r->swapchain_extent });
+static size_t get_ship_draws_chunk_count(const struct vulkan_renderer *r, const struct do_frame_stuff *stuff) {
+	(void)stuff;
+	return (r->std_mesh_draw_group_count + RECORD_SHIP_GROUPS_PER_CHUNK - 1) / RECORD_SHIP_GROUPS_PER_CHUNK;
+}
+
+/// The ship draw groups of a chunk, and the skybox in the last one.
+static void record_ship_draws(
+	struct vulkan_renderer *r,
+	struct per_frame_data *f,
+	const struct do_frame_stuff *stuff,
+	VkCommandBuffer cmd,
+	size_t chunk,
+	size_t chunk_count
+) {
+	PSHINE_PERF_ZONE("Pass: HDR Geometry (ships)");
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, r->pipelines.std_mesh_de_pipeline);
+	set_render_viewport(cmd, stuff->render_extent);
+	vkCmdBindDescriptorSets(
+		cmd,
+		VK_PIPELINE_BIND_POINT_GRAPHICS,
+		r->pipelines.std_mesh_de_layout,
+		0,
+		1,
+		(VkDescriptorSet[]){ r->data.global_descriptor_set },
+		1, (uint32_t[]){
+			stuff->global_uniform_offset
+		}
+	);
+	if (r->as_base.settings.render_ships && r->std_mesh_draw_count > 0) {
 		vkCmdBindDescriptorSets(
-			f->command_buffer,
-			VK_PIPELINE_BIND_POINT_GRAPHICS,
-			r->pipelines.std_mesh_de_layout,
-			0,
-			1,
-			(VkDescriptorSet[]){ r->data.global_descriptor_set },
-			1, (uint32_t[]){
-				get_padded_uniform_buffer_size(r, sizeof(struct global_uniform_data)) * f->index
-			}
+			cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, r->pipelines.std_mesh_de_layout,
+			2, 1, (VkDescriptorSet[]){ r->data.std_mesh_descriptor_set },
+			1, (uint32_t[]){ get_std_mesh_instance_table_size(r) * f->index }
 		);
-		for (size_t i = 0; i < r->game->ships.dyna.count; ++i) {
-			if (!r->as_base.settings.render_ships) {
-				continue;
-			}
-			/// Technically, accessing this might be UB if this is not a valid marker,
-			/// but no compilers care because most code relies on this being non-UB.
-			if (r->game->ships.ptr[i]._alive_marker != (size_t)-1) {
-				continue;
-			}
-			struct pshine_ship *ship = &r->game->ships.ptr[i];
+		vkCmdBindIndexBuffer(cmd, r->mesh_arena.index_buffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+		vkCmdBindVertexBuffers(cmd, 0, 1, &r->mesh_arena.vertex_buffer.buffer, &(VkDeviceSize){0});
+		VkDeviceSize list_offset = get_std_mesh_draw_list_size(r) * f->index;
+		VkDeviceSize counts_offset = list_offset + r->data.std_mesh_draw_capacity * sizeof(VkDrawIndexedIndirectCommand);
+		size_t first_group = r->std_mesh_draw_group_count * chunk / chunk_count;
+		size_t end_group = r->std_mesh_draw_group_count * (chunk + 1) / chunk_count;
+		for (size_t i = first_group; i < end_group; ++i) {
+			const struct std_mesh_draw_group *group = &r->std_mesh_draw_groups_own[i];
 			vkCmdBindDescriptorSets(
-				f->command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, r->pipelines.std_mesh_de_layout,
-				2, 1, (VkDescriptorSet[]){ ship->graphics_data->descriptor_set },
-				1, (uint32_t[]){
-					get_padded_uniform_buffer_size(r, sizeof(struct std_mesh_uniform_data)) * f->index
-				}
+				cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, r->pipelines.std_mesh_de_layout,
+				1, 1, (VkDescriptorSet[]){ group->material_descriptor_set },
+				1, &stuff->std_material_uniform_offset
+			);
+			vkCmdDrawIndexedIndirectCount(
+				cmd,
+				r->data.std_mesh_draw_buffer.buffer,
+				list_offset + group->first_draw * sizeof(VkDrawIndexedIndirectCommand),
+				r->data.std_mesh_draw_buffer.buffer,
+				counts_offset + (1 + i) * sizeof(uint32_t),
+				group->draw_count, sizeof(VkDrawIndexedIndirectCommand)
 			);
-			for (size_t j = 0; j < ship->graphics_data->model.material_count; ++j) {
-				vkCmdBindDescriptorSets(
-					f->command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, r->pipelines.std_mesh_de_layout,
-					1, 1, (VkDescriptorSet[]){ ship->graphics_data->model.materials_own[j].descriptor_set },
-					1, (uint32_t[]){
-						get_padded_uniform_buffer_size(r, sizeof(struct std_material_uniform_data)) * f->index
-					}
-				);
-				for (size_t k = 0; k < ship->graphics_data->model.part_count; ++k) {
-					if (ship->graphics_data->model.parts_own[k].material_index != j) continue;
-					struct vulkan_mesh *mesh = &ship->graphics_data->model.parts_own[k].mesh;
-					vkCmdBindIndexBuffer(f->command_buffer, mesh->index_buffer.buffer, 0, VK_INDEX_TYPE_UINT32);
-					vkCmdBindVertexBuffers(f->command_buffer, 0, 1, &mesh->vertex_buffer.buffer, &(VkDeviceSize){0});
-					vkCmdDrawIndexed(f->command_buffer, mesh->index_count, 1, 0, 0, 0);
-				}
-			}
 		}
+	}
 
-		// Skybox
-		{
-			float4x4 data[2] = {
-				stuff->proj_mat32,
-				stuff->view_mat32,
-			};
+	// Skybox
+	if (chunk + 1 == chunk_count) {
+		float4x4 data[2] = {
+			stuff->proj_mat32,
+			stuff->view_mat32,
+		};
 
-			// Remove the translation
-			data[1].v4s[3].x = 0.0f;
-			data[1].v4s[3].y = 0.0f;
-			data[1].v4s[3].z = 0.0f;
-
-			vkCmdBindPipeline(f->command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, r->pipelines.skybox_pipeline);
-			vkCmdSetViewport(f->command_buffer, 0, 1, &(VkViewport){
-				.x = 0.0f,
-				.y = 0.0f,
-				.width = (float)r->swapchain_extent.width,
-				.height = (float)r->swapchain_extent.height,
-				.minDepth = 0.0f,
-				.maxDepth = 1.0f,
-			});
-			vkCmdSetScissor(f->command_buffer, 0, 1, &(VkRect2D){ .offset = { 0, 0 }, .extent = r->swapchain_extent });
-			vkCmdPushConstants(f->command_buffer, r->pipelines.skybox_layout, VK_SHADER_STAGE_VERTEX_BIT, 0,
-				sizeof(float4x4) * 2, &data);
+		// Remove the translation
+		data[1].v4s[3].x = 0.0f;
+		data[1].v4s[3].y = 0.0f;
+		data[1].v4s[3].z = 0.0f;
+
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, r->pipelines.skybox_pipeline);
+		set_render_viewport(cmd, stuff->render_extent);
+		vkCmdPushConstants(cmd, r->pipelines.skybox_layout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+			sizeof(float4x4) * 2, &data);
 
-			vkCmdBindDescriptorSets(f->command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-				r->pipelines.skybox_layout, 0, 1, &r->data.skybox_descriptor_set, 0, nullptr);
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+			r->pipelines.skybox_layout, 0, 1, &r->data.skybox_descriptor_set, 0, nullptr);
 
-			vkCmdDraw(f->command_buffer, 14, 1, 0, 0);
+		vkCmdDraw(cmd, 14, 1, 0, 0);
+	}
+}
+
+/// Compute the sky-view and aerial perspective LUTs of every visible atmosphere, from this frame's camera.
+static void record_atmosphere_luts_pass(
+	struct vulkan_renderer *r,
+	struct per_frame_data *f,
+	const struct do_frame_stuff *stuff,
+	VkCommandBuffer cmd
+) {
+	PSHINE_PERF_ZONE("Pass: Atmosphere LUTs");
+	struct pshine_star_system *current_system = stuff->current_system;
+
+	vkCmdBindDescriptorSets(
+		cmd,
+		VK_PIPELINE_BIND_POINT_COMPUTE,
+		r->pipelines.atmo_view_lut_layout,
+		0,
+		1,
+		(VkDescriptorSet[]){ r->data.global_descriptor_set },
+		1, (uint32_t[]){
+			stuff->global_uniform_offset
 		}
+	);
 
+	for (size_t i = 0; i < current_system->body_count; ++i) {
+		struct pshine_celestial_body *b = current_system->bodies_own[i];
+		if (b->type != PSHINE_CELESTIAL_BODY_PLANET) continue;
+		struct pshine_planet *p = (void *)b;
+		if (!p->has_atmosphere || !p->graphics_data->atmo_drawn) continue;
+		vkCmdBindDescriptorSets(
+			cmd,
+			VK_PIPELINE_BIND_POINT_COMPUTE,
+			r->pipelines.atmo_view_lut_layout,
+			1,
+			1,
+			&p->graphics_data->atmo_view_lut_descriptor_sets[p->graphics_data->atmo_lut_current],
+			1, &p->graphics_data->atmo_uniform_offset
+		);
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, r->pipelines.atmo_sky_view_pipeline);
+		vkCmdDispatch(cmd,
+			(PSHINE_ATMO_SKY_VIEW_LUT_WIDTH + 7) / 8,
+			(PSHINE_ATMO_SKY_VIEW_LUT_HEIGHT + 7) / 8,
+			1);
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, r->pipelines.atmo_aerial_pipeline);
+		vkCmdDispatch(cmd, PSHINE_ATMO_AERIAL_LUT_SIZE / 8, PSHINE_ATMO_AERIAL_LUT_SIZE / 8, 1);
 	}
-	rg_graph_end_pass(&r->rgraph);
-	rg_graph_begin_pass(&r->rgraph); // HDR Atmosphere
-	{
-		PSHINE_PERF_ZONE("Pass: HDR Atmosphere");
-		vkCmdBindPipeline(f->command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, r->pipelines.atmo_pipeline);
-		vkCmdSetViewport(f->command_buffer, 0, 1, &(VkViewport){
-			.x = 0.0f,
-			.y = 0.0f,
-			.width = (float)r->swapchain_extent.width,
-			.height = (float)r->swapchain_extent.height,
-			.minDepth = 0.0f,
-			.maxDepth = 1.0f,
+}
+
+/// A barrier for the half-res atmosphere image `image`, in `VK_IMAGE_LAYOUT_GENERAL`.
+static VkImageMemoryBarrier2 atmo_half_res_barrier(
+	VkImage image,
+	VkPipelineStageFlags2 src_stage,
+	VkAccessFlags2 src_access,
+	VkPipelineStageFlags2 dst_stage,
+	VkAccessFlags2 dst_access
+) {
+	return (VkImageMemoryBarrier2){
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+		.image = image,
+		.srcStageMask = src_stage,
+		.srcAccessMask = src_access,
+		.dstStageMask = dst_stage,
+		.dstAccessMask = dst_access,
+		.oldLayout = VK_IMAGE_LAYOUT_GENERAL,
+		.newLayout = VK_IMAGE_LAYOUT_GENERAL,
+		.subresourceRange = (VkImageSubresourceRange){
+			.levelCount = 1,
+			.layerCount = 1,
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.baseMipLevel = 0,
+			.baseArrayLayer = 0,
+		},
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+	};
+}
+
+/// Render every visible atmosphere into the half-res atmosphere's samples in one dispatch, and
+/// accumulate them into this frame's history (see `atmo_half.comp` and `atmo_resolve.comp`).
+/// The atmosphere pass then upsamples the history.
+static void record_atmosphere_half_res_pass(
+	struct vulkan_renderer *r,
+	struct per_frame_data *f,
+	const struct do_frame_stuff *stuff,
+	VkCommandBuffer cmd
+) {
+	PSHINE_PERF_ZONE("Pass: Half-Res Atmosphere");
+	if (!stuff->atmo_half_res) return;
+	const struct render_pass_transients *t = &r->transients;
+	uint32_t current = stuff->atmo_history_index;
+	// the half-res images are for the whole swapchain, only the rendered part of them is used.
+	VkExtent2D extent = {
+		(stuff->render_extent.width + PSHINE_ATMO_RESOLUTION_DIVISOR - 1) / PSHINE_ATMO_RESOLUTION_DIVISOR,
+		(stuff->render_extent.height + PSHINE_ATMO_RESOLUTION_DIVISOR - 1) / PSHINE_ATMO_RESOLUTION_DIVISOR,
+	};
+
+	// the render graph orders the images against the last frame and the upsample.
+	vkCmdBindDescriptorSets(
+		cmd,
+		VK_PIPELINE_BIND_POINT_COMPUTE,
+		r->pipelines.atmo_half_res_layout,
+		0,
+		1,
+		(VkDescriptorSet[]){ r->data.global_descriptor_set },
+		1, (uint32_t[]){
+			stuff->global_uniform_offset
+		}
+	);
+	vkCmdBindDescriptorSets(
+		cmd,
+		VK_PIPELINE_BIND_POINT_COMPUTE,
+		r->pipelines.atmo_half_res_layout,
+		1,
+		2,
+		(VkDescriptorSet[]){ r->data.atmo_descriptor_sets[f->index], r->data.atmo_half_res_descriptor_sets[current] },
+		2, (uint32_t[]){
+			get_atmo_batch_table_size(r) * f->index,
+			stuff->atmo_half_res_uniform_offset
+		}
+	);
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, r->pipelines.atmo_half_pipeline);
+	vkCmdDispatch(cmd, (extent.width + 7) / 8, (extent.height + 7) / 8, 1);
+	// the graph only orders passes, the resolve reads what the march wrote within this one.
+	VkImageMemoryBarrier2 light_barrier = atmo_half_res_barrier(t->atmo_light.image,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+	vkCmdPipelineBarrier2(cmd, &(VkDependencyInfo){
+		.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+		.imageMemoryBarrierCount = 1,
+		.pImageMemoryBarriers = &light_barrier,
+	});
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, r->pipelines.atmo_resolve_pipeline);
+	vkCmdDispatch(cmd, (extent.width + 7) / 8, (extent.height + 7) / 8, 1);
+}
+
+/// Draw a fullscreen triangle scissored to each of the atmospheres' screen rects, which don't overlap.
+static void draw_atmosphere_rects(const struct do_frame_stuff *stuff, VkCommandBuffer cmd) {
+	for (uint32_t i = 0; i < stuff->atmo_rect_count; ++i) {
+		const uint32_t *rect = stuff->atmo_rects[i];
+		vkCmdSetScissor(cmd, 0, 1, &(VkRect2D){
+			.offset = { (int32_t)rect[0], (int32_t)rect[1] },
+			.extent = { rect[2], rect[3] },
 		});
-		vkCmdSetScissor(f->command_buffer, 0, 1, &(VkRect2D){ .offset = { 0, 0 }, .extent = r->swapchain_extent });
+		vkCmdDraw(cmd, 3, 1, 0, 0);
+	}
+}
 
+static void record_atmosphere_pass(
+	struct vulkan_renderer *r,
+	struct per_frame_data *f,
+	const struct do_frame_stuff *stuff,
+	VkCommandBuffer cmd
+) {
+	PSHINE_PERF_ZONE("Pass: HDR Atmosphere");
+	// the scissors are the atmospheres' rects.
+	set_render_viewport(cmd, stuff->render_extent);
+
+	if (stuff->atmo_half_res) {
+		// every atmosphere is in the half-res history already.
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, r->pipelines.atmo_upsample_pipeline);
 		vkCmdBindDescriptorSets(
-			f->command_buffer,
+			cmd,
+			VK_PIPELINE_BIND_POINT_GRAPHICS,
+			r->pipelines.atmo_upsample_layout,
+			0,
+			1,
+			&r->data.atmo_upsample_descriptor_sets[stuff->atmo_history_index],
+			1, &stuff->atmo_half_res_uniform_offset
+		);
+		draw_atmosphere_rects(stuff, cmd);
+	} else if (stuff->atmo_count > 0) {
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, r->pipelines.atmo_pipeline);
+		vkCmdBindDescriptorSets(
+			cmd,
 			VK_PIPELINE_BIND_POINT_GRAPHICS,
 			r->pipelines.atmo_layout,
 			0,
 			1,
 			(VkDescriptorSet[]){ r->data.global_descriptor_set },
 			1, (uint32_t[]){
-				get_padded_uniform_buffer_size(r, sizeof(struct global_uniform_data)) * f->index
+				stuff->global_uniform_offset
 			}
 		);
+		vkCmdBindDescriptorSets(
+			cmd,
+			VK_PIPELINE_BIND_POINT_GRAPHICS,
+			r->pipelines.atmo_layout,
+			2,
+			1,
+			&r->data.atmo_descriptor_sets[f->index],
+			1, (uint32_t[]){ get_atmo_batch_table_size(r) * f->index }
+		);
+		// every drawn atmosphere at once, see `atmo.frag`.
+		draw_atmosphere_rects(stuff, cmd);
+	}
+}
 
-		for (size_t i = 0; i < current_system->body_count; ++i) {
-			struct pshine_celestial_body *b = current_system->bodies_own[i];
-			if (b->type == PSHINE_CELESTIAL_BODY_PLANET) {
-				struct pshine_planet *p = (void *)b;
-				if (!p->has_atmosphere) continue;
-				vkCmdBindDescriptorSets(
-					f->command_buffer,
-					VK_PIPELINE_BIND_POINT_GRAPHICS,
-					r->pipelines.atmo_layout,
-					2,
-					1,
-					&p->graphics_data->atmo_descriptor_set,
-					1, (uint32_t[]){
-						get_padded_uniform_buffer_size(r, sizeof(struct atmo_uniform_data)) * f->index
-					}
-				);
-				vkCmdDraw(f->command_buffer, 3, 1, 0, 0);
-				// fprintf(stderr, "atmosphere barrier\n");
-				vkCmdPipelineBarrier2(f->command_buffer, &(VkDependencyInfo){
-					.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
-					.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT,
-					.imageMemoryBarrierCount = 1,
-					.pImageMemoryBarriers = (VkImageMemoryBarrier2[]){
-						(VkImageMemoryBarrier2){
-							.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
-							.image = r->transients.gbuffer[GBUFFER_IMAGE_DIFFUSE_O].image.image,
-							.oldLayout = VK_IMAGE_LAYOUT_RENDERING_LOCAL_READ,
-							.newLayout = VK_IMAGE_LAYOUT_RENDERING_LOCAL_READ,
-							.srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
-							.srcAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
-							.dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, // | VK_PIPELINE_STAGE_2_TRANSFER_BIT,
-							.dstAccessMask = VK_ACCESS_2_INPUT_ATTACHMENT_READ_BIT, // | VK_ACCESS_2_MEMORY_READ_BIT,
-							.subresourceRange = (VkImageSubresourceRange){
-								.levelCount = 1,
-								.layerCount = 1,
-								.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-								.baseMipLevel = 0,
-								.baseArrayLayer = 0,
-							},
-							.srcQueueFamilyIndex = r->queue_families[QUEUE_GRAPHICS],
-							.dstQueueFamilyIndex = r->queue_families[QUEUE_GRAPHICS],
-						},
-					},
-				});
-				// fprintf(stderr, "atmosphere barrier done\n");
-			}
+static void record_lighting_pass(
+	struct vulkan_renderer *r,
+	struct per_frame_data *f,
+	const struct do_frame_stuff *stuff,
+	VkCommandBuffer cmd
+) {
+	PSHINE_PERF_ZONE("Pass: HDR Lighting");
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, r->pipelines.light_pipeline);
+	set_render_viewport(cmd, stuff->render_extent);
+
+	vkCmdBindDescriptorSets(
+		cmd,
+		VK_PIPELINE_BIND_POINT_GRAPHICS,
+		r->pipelines.light_layout,
+		0,
+		1,
+		(VkDescriptorSet[]){ r->data.light_descriptor_set },
+		1, (uint32_t[]){
+			stuff->global_uniform_offset
 		}
-	}
-	rg_graph_end_pass(&r->rgraph);
-	rg_graph_begin_pass(&r->rgraph); // HDR Lighting
-	{
-		PSHINE_PERF_ZONE("Pass: HDR Lighting");
-		vkCmdBindPipeline(f->command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, r->pipelines.light_pipeline);
-		vkCmdSetViewport(f->command_buffer, 0, 1, &(VkViewport){
-			.x = 0.0f,
-			.y = 0.0f,
-			.width = (float)r->swapchain_extent.width,
-			.height = (float)r->swapchain_extent.height,
-			.minDepth = 0.0f,
-			.maxDepth = 1.0f,
-		});
-		vkCmdSetScissor(f->command_buffer, 0, 1, &(VkRect2D){ .offset = { 0, 0 }, .extent = r->swapchain_extent });
+	);
+
+	vkCmdDraw(cmd, 3, 1, 0, 0);
+}
+
+/// Makes one bloom dispatch's writes visible to the next.
+static void record_bloom_compute_barrier(VkCommandBuffer cmd) {
+	vkCmdPipelineBarrier2(cmd, &(VkDependencyInfo){
+		.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+		.memoryBarrierCount = 1,
+		.pMemoryBarriers = (VkMemoryBarrier2[]){
+			(VkMemoryBarrier2){
+				.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+				.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+				.srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT,
+				.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+				.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT,
+			},
+		},
+	});
+}
 
+static void record_bloom_pass(
+	struct vulkan_renderer *r,
+	struct per_frame_data *f,
+	const struct do_frame_stuff *stuff,
+	VkCommandBuffer cmd
+) {
+	PSHINE_PERF_ZONE("Pass: Bloom");
+	if (!r->as_base.settings.do_bloom) return;
+
+	// The counter is only used here, so this pass does its barriers itself, on whichever queue it's on.
+	// The last frame's bloom must be done with it before it's zeroed. The mips are discarded by the graph.
+	vkCmdPipelineBarrier2(cmd, &(VkDependencyInfo){
+		.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+		.bufferMemoryBarrierCount = 1,
+		.pBufferMemoryBarriers = &(VkBufferMemoryBarrier2){
+			.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+			.buffer = r->transients.bloom_counter.buffer,
+			.offset = 0,
+			.size = VK_WHOLE_SIZE,
+			.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+			.dstStageMask = VK_PIPELINE_STAGE_2_CLEAR_BIT,
+			.dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		},
+	});
+	vkCmdFillBuffer(cmd, r->transients.bloom_counter.buffer, 0, VK_WHOLE_SIZE, 0);
+	vkCmdPipelineBarrier2(cmd, &(VkDependencyInfo){
+		.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+		.bufferMemoryBarrierCount = 1,
+		.pBufferMemoryBarriers = &(VkBufferMemoryBarrier2){
+			.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+			.buffer = r->transients.bloom_counter.buffer,
+			.offset = 0,
+			.size = VK_WHOLE_SIZE,
+			.srcStageMask = VK_PIPELINE_STAGE_2_CLEAR_BIT,
+			.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+			.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		},
+	});
+
+	// All the mips in one dispatch, see `bloom_downsample.comp`. Only the rendered part is bloomed.
+	struct bloom_push_constants consts = {
+		.settings = r->game->graphics_settings,
+		.extent = { (int32_t)stuff->render_extent.width, (int32_t)stuff->render_extent.height },
+	};
+	VkExtent2D mip0_extent = bloom_mip_extent(stuff->render_extent, 0);
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, r->pipelines.downsample_bloom_pipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, r->pipelines.downsample_bloom_layout,
+		0, 1, &r->data.downsample_bloom_descriptor_set, 0, nullptr
+	);
+	vkCmdPushConstants(cmd, r->pipelines.downsample_bloom_layout, VK_SHADER_STAGE_COMPUTE_BIT,
+		0, sizeof(consts), &consts
+	);
+	vkCmdDispatch(cmd, (mip0_extent.width + 63) / 64, (mip0_extent.height + 63) / 64, 1);
+	record_bloom_compute_barrier(cmd);
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, r->pipelines.upsample_bloom_pipeline);
+	for (size_t i = BLOOM_STAGE_COUNT; i-- > 0;) {
+		VkExtent2D dst_extent = i == 0 ? stuff->render_extent : bloom_mip_extent(stuff->render_extent, i - 1);
+		consts.extent[0] = (int32_t)dst_extent.width;
+		consts.extent[1] = (int32_t)dst_extent.height;
+		vkCmdPushConstants(cmd, r->pipelines.upsample_bloom_layout, VK_SHADER_STAGE_COMPUTE_BIT,
+			0, sizeof(consts), &consts);
 		vkCmdBindDescriptorSets(
-			f->command_buffer,
-			VK_PIPELINE_BIND_POINT_GRAPHICS,
-			r->pipelines.light_layout,
-			0,
-			1,
-			(VkDescriptorSet[]){ r->data.light_descriptor_set },
-			1, (uint32_t[]){
-				get_padded_uniform_buffer_size(r, sizeof(struct global_uniform_data)) * f->index
-			}
+			cmd, VK_PIPELINE_BIND_POINT_COMPUTE, r->pipelines.upsample_bloom_layout, 0,
+			1, &r->data.upsample_bloom_descriptor_sets[i], 0, nullptr
 		);
+		vkCmdDispatch(cmd, (dst_extent.width + 15) / 16, (dst_extent.height + 15) / 16, 1);
+		record_bloom_compute_barrier(cmd);
+	}
+}
 
-		vkCmdDraw(f->command_buffer, 3, 1, 0, 0);
+static void record_tonemap_pass(
+	struct vulkan_renderer *r,
+	struct per_frame_data *f,
+	const struct do_frame_stuff *stuff,
+	VkCommandBuffer cmd
+) {
+	PSHINE_PERF_ZONE("Pass: SDR Tonemap");
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, r->pipelines.blit_pipeline);
+	vkCmdSetViewport(cmd, 0, 1, &(VkViewport){
+		.x = 0.0f,
+		.y = 0.0f,
+		.width = (float)r->swapchain_extent.width,
+		.height = (float)r->swapchain_extent.height,
+		.minDepth = 0.0f,
+		.maxDepth = 1.0f,
+	});
+	vkCmdSetScissor(cmd, 0, 1, &(VkRect2D){ .offset = { 0, 0 }, .extent = r->swapchain_extent });
+	// the 3D passes are upscaled from the top left of the color image.
+	struct tonemap_push_constants consts = {
+		.settings = r->game->graphics_settings,
+		.uv_scale = {
+			stuff->render_extent.width /(float) r->swapchain_extent.width,
+			stuff->render_extent.height /(float) r->swapchain_extent.height,
+		},
+	};
+	vkCmdPushConstants(cmd, r->pipelines.blit_layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(consts), &consts);
+	vkCmdBindDescriptorSets(
+		cmd,
+		VK_PIPELINE_BIND_POINT_GRAPHICS,
+		r->pipelines.blit_layout,
+		0,
+		1,
+		(VkDescriptorSet[]){ r->data.blit_descriptor_set },
+		1, (uint32_t[]){
+			stuff->global_uniform_offset
+		}
+	);
+	vkCmdDraw(cmd, 3, 1, 0, 0);
+}
+
+static void record_gui_pass(
+	struct vulkan_renderer *r,
+	struct per_frame_data *f,
+	const struct do_frame_stuff *stuff,
+	VkCommandBuffer cmd
+) {
+	PSHINE_PERF_ZONE("Pass: SDR GUI");
+	pshine_imgui_backend_render_draw_data(cmd);
+}
+typedef void (*record_job_fn)(
+	struct vulkan_renderer *r,
+	struct per_frame_data *f,
+	const struct do_frame_stuff *stuff,
+	VkCommandBuffer cmd
+);
+
+/// Records one of `chunk_count` parts of a job, in order.
+typedef void (*record_job_chunk_fn)(
+	struct vulkan_renderer *r,
+	struct per_frame_data *f,
+	const struct do_frame_stuff *stuff,
+	VkCommandBuffer cmd,
+	size_t chunk,
+	size_t chunk_count
+);
+
+static const struct {
+	/// The render graph pass the job's command buffer is executed in.
+	uint32_t pass;
+	/// Either `record`, or `record_chunk` with the number of chunks for the frame from
+	/// `get_chunk_count` (clamped to `1..RECORD_CHUNK_COUNT_MAX`).
+	record_job_fn record;
+	record_job_chunk_fn record_chunk;
+	size_t (*get_chunk_count)(const struct vulkan_renderer *r, const struct do_frame_stuff *stuff);
+} record_jobs[RECORD_JOB_COUNT_] = {
+	[RECORD_JOB_ATMOSPHERE_LUTS] = { RPASS_ATMOSPHERE_LUTS, &record_atmosphere_luts_pass },
+	[RECORD_JOB_SHADOW] = { RPASS_SHADOW, &record_shadow_pass },
+	[RECORD_JOB_BODIES] = {
+		RPASS_HDR_GEOMETRY,
+		.record_chunk = &record_body_draws,
+		.get_chunk_count = &get_body_draws_chunk_count,
+	},
+	[RECORD_JOB_SHIPS] = {
+		RPASS_HDR_GEOMETRY,
+		.record_chunk = &record_ship_draws,
+		.get_chunk_count = &get_ship_draws_chunk_count,
+	},
+	[RECORD_JOB_ATMOSPHERE_HALF_RES] = { RPASS_ATMOSPHERE_HALF_RES, &record_atmosphere_half_res_pass },
+	[RECORD_JOB_ATMOSPHERE] = { RPASS_HDR_ATMOSPHERE, &record_atmosphere_pass },
+	[RECORD_JOB_LIGHTING] = { RPASS_HDR_LIGHTING, &record_lighting_pass },
+	[RECORD_JOB_BLOOM] = { RPASS_BLOOM, &record_bloom_pass },
+	[RECORD_JOB_TONEMAP] = { RPASS_SDR_TONEMAP, &record_tonemap_pass },
+	[RECORD_JOB_GUI] = { RPASS_SDR_GUI, &record_gui_pass },
+};
+
+/// A chunk of a job, recorded into its own command buffer.
+struct record_task {
+	size_t job, chunk;
+};
+
+struct record_work {
+	struct vulkan_renderer *r;
+	struct per_frame_data *f;
+	const struct do_frame_stuff *stuff;
+	size_t task_count;
+	struct record_task tasks[RECORD_TASK_COUNT_MAX];
+	size_t chunk_counts[RECORD_JOB_COUNT_];
+	atomic_size_t next_task;
+	atomic_size_t next_thread;
+};
+
+static void record_task(struct record_work *work, size_t thread, size_t task_index) {
+	struct vulkan_renderer *r = work->r;
+	struct per_frame_data *f = work->f;
+	struct record_task task = work->tasks[task_index];
+	struct rg_pass *pass = rg_graph_get_pass(&r->rgraph, record_jobs[task.job].pass);
+	if (pass->culled) return;
+	VkCommandBuffer cmd = f->record_command_buffers[pass->queue][thread][task_index];
+
+	VkRenderingInputAttachmentIndexInfo indices = rg_get_input_attachment_index_info(pass);
+	VkCommandBufferInheritanceRenderingInfo rendering = rg_get_inheritance_rendering_info(pass);
+	rendering.pNext = &indices;
+	CHECKVK(vkBeginCommandBuffer(cmd, &(VkCommandBufferBeginInfo){
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+			| (pass->compute ? 0 : VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT),
+		.pInheritanceInfo = &(VkCommandBufferInheritanceInfo){
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+			.pNext = pass->compute ? nullptr : &rendering,
+			// the graph counts the passes on the main queue, see `pshine_gpu_perf`.
+			.pipelineStatistics = r->gpu_perf.statistics && pass->queue == RG_QUEUE_MAIN
+				? pshine_gpu_statistic_flags : 0,
+		},
+	}));
+	if (record_jobs[task.job].record_chunk != nullptr)
+		record_jobs[task.job].record_chunk(r, f, work->stuff, cmd, task.chunk, work->chunk_counts[task.job]);
+	else
+		record_jobs[task.job].record(r, f, work->stuff, cmd);
+	CHECKVK(vkEndCommandBuffer(cmd));
+	f->recorded[task.job][task.chunk] = cmd;
+}
+
+static void record_worker(struct record_work *work) {
+	size_t thread = atomic_fetch_add(&work->next_thread, 1);
+	for (;;) {
+		size_t task = atomic_fetch_add(&work->next_task, 1);
+		if (task >= work->task_count) break;
+		record_task(work, thread, task);
 	}
-	rg_graph_end_pass(&r->rgraph);
-	rg_graph_begin_pass(&r->rgraph); // Bloom
-	if (r->as_base.settings.do_bloom) {
-		PSHINE_PERF_ZONE("Pass: Bloom");
-		// The downsampling compute.
-		vkCmdBindPipeline(f->command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, r->pipelines.first_downsample_bloom_pipeline);
-		for (size_t i = 0; i < BLOOM_STAGE_COUNT; ++i) {
-			// struct vulkan_image *src_image = i == 0 ? &r->transients.color_0 : &r->transients.bloom[i - 1];
-			// struct vulkan_image *dst_image = &r->transients.bloom[i];
+}
 
-			vkCmdBindDescriptorSets(f->command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, r->pipelines.downsample_bloom_layout,
-				0, 1, &r->data.downsample_bloom_descriptor_sets[i], 0, nullptr
-			);
+static void record_thread_main(void *user) {
+	struct vulkan_renderer *r = user;
+	for (;;) {
+		pshine_semaphore_wait(r->record_start);
+		if (r->record_threads_quit) break;
+		record_worker(r->record_work);
+		pshine_semaphore_post(r->record_done, 1);
+	}
+}
 
-			vkCmdPushConstants(f->command_buffer, r->pipelines.downsample_bloom_layout, VK_SHADER_STAGE_COMPUTE_BIT,
-				0, sizeof(struct pshine_graphics_settings), &r->game->graphics_settings
-			);
+static void init_record_threads(struct vulkan_renderer *r) {
+	r->record_start = pshine_semaphore_create(0);
+	r->record_done = pshine_semaphore_create(0);
+	r->record_threads_quit = false;
+	// all of them, `record_thread_count` can change at runtime.
+	for (size_t i = 0; i < RECORD_THREAD_COUNT_MAX - 1; ++i)
+		r->record_threads[i] = pshine_thread_start(&record_thread_main, r);
+}
 
-			vkCmdDispatch(f->command_buffer, 128, 128, 1);
-
-			// the first downsample bloom pipeline is a bit different from the rest.
-			if (i == 1)
-				vkCmdBindPipeline(f->command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, r->pipelines.downsample_bloom_pipeline);
-
-			vkCmdPipelineBarrier2(f->command_buffer, &(VkDependencyInfo){
-				.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
-				.memoryBarrierCount = 1,
-				.pMemoryBarriers = (VkMemoryBarrier2[]){
-					(VkMemoryBarrier2){
-						.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
-						.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
-						.srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT,
-						.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
-						.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT,
-					},
-				},
-			});
-		}
+static void deinit_record_threads(struct vulkan_renderer *r) {
+	r->record_threads_quit = true;
+	pshine_semaphore_post(r->record_start, RECORD_THREAD_COUNT_MAX - 1);
+	for (size_t i = 0; i < RECORD_THREAD_COUNT_MAX - 1; ++i)
+		pshine_thread_join(r->record_threads[i]);
+	pshine_semaphore_destroy(r->record_start);
+	pshine_semaphore_destroy(r->record_done);
+}
 
-		vkCmdBindPipeline(f->command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, r->pipelines.upsample_bloom_pipeline);
-		for (size_t i = 0; i < BLOOM_STAGE_COUNT; ++i) {
-			// bool is_last = i == BLOOM_STAGE_COUNT - 1;
-			[[maybe_unused]]
-			struct vulkan_image *src_image = &r->transients.bloom[BLOOM_STAGE_COUNT - 1 - i];
-			// struct vulkan_image *dst_image = is_last ? &r->transients.color_0
-			// 	: &r->transients.bloom[BLOOM_STAGE_COUNT - 2 - i];
-			VkDescriptorSet ds = r->data.upsample_bloom_descriptor_sets[BLOOM_STAGE_COUNT - 1 - i];
-			vkCmdBindDescriptorSets(
-				f->command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, r->pipelines.upsample_bloom_layout, 0,
-				1, (VkDescriptorSet[]){ ds }, 0, nullptr
-			);
-			vkCmdPushConstants(f->command_buffer, r->pipelines.upsample_bloom_layout, VK_SHADER_STAGE_COMPUTE_BIT,
-				0, sizeof(struct pshine_graphics_settings), &r->game->graphics_settings);
-			vkCmdDispatch(f->command_buffer, 128, 128, 1);
-			vkCmdPipelineBarrier2(f->command_buffer, &(VkDependencyInfo){
-				.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
-				.memoryBarrierCount = 1,
-				.pMemoryBarriers = (VkMemoryBarrier2[]){
-					(VkMemoryBarrier2){
-						.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
-						.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
-						.srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT,
-						.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
-						.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT,
-					},
-				},
-			});
+/// Record every pass into `f->recorded`, on `r->record_thread_count` threads (including this one).
+/// Each thread records from its own command pool. Every permit of `record_start` runs `record_worker`
+/// once and posts `record_done`, whichever thread takes it, so this waits for all of them.
+static void record_game_frame_passes(
+	struct vulkan_renderer *r,
+	struct per_frame_data *f,
+	const struct do_frame_stuff *stuff
+) {
+	PSHINE_PERF_FUNC();
+	struct pshine_timeval start = pshine_timeval_now();
+	struct record_work work = { .r = r, .f = f, .stuff = stuff };
+	atomic_init(&work.next_task, 0);
+	atomic_init(&work.next_thread, 0);
+	memset(f->recorded, 0, sizeof(f->recorded));
+	for (size_t job = 0; job < RECORD_JOB_COUNT_; ++job) {
+		size_t chunk_count = 1;
+		if (record_jobs[job].get_chunk_count != nullptr) {
+			chunk_count = record_jobs[job].get_chunk_count(r, stuff);
+			if (chunk_count < 1) chunk_count = 1;
+			if (chunk_count > RECORD_CHUNK_COUNT_MAX) chunk_count = RECORD_CHUNK_COUNT_MAX;
 		}
+		work.chunk_counts[job] = chunk_count;
+		for (size_t chunk = 0; chunk < chunk_count; ++chunk)
+			work.tasks[work.task_count++] = (struct record_task){ job, chunk };
 	}
-	rg_graph_end_pass(&r->rgraph);
-	rg_graph_begin_pass(&r->rgraph); // SDR Tonemap
-	{
-		PSHINE_PERF_ZONE("Pass: SDR Tonemap");
-		vkCmdBindPipeline(f->command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, r->pipelines.blit_pipeline);
-		vkCmdSetViewport(f->command_buffer, 0, 1, &(VkViewport){
-			.x = 0.0f,
-			.y = 0.0f,
-			.width = (float)r->swapchain_extent.width,
-			.height = (float)r->swapchain_extent.height,
-			.minDepth = 0.0f,
-			.maxDepth = 1.0f,
-		});
-		vkCmdSetScissor(f->command_buffer, 0, 1, &(VkRect2D){ .offset = { 0, 0 }, .extent = r->swapchain_extent });
-		vkCmdPushConstants(f->command_buffer, r->pipelines.blit_layout, VK_SHADER_STAGE_FRAGMENT_BIT,
-			0, sizeof(struct pshine_graphics_settings), &r->game->graphics_settings);
-		vkCmdBindDescriptorSets(
-			f->command_buffer,
-			VK_PIPELINE_BIND_POINT_GRAPHICS,
-			r->pipelines.blit_layout,
-			0,
-			1,
-			(VkDescriptorSet[]){ r->data.blit_descriptor_set },
-			1, (uint32_t[]){
-				get_padded_uniform_buffer_size(r, sizeof(struct global_uniform_data)) * f->index
-			}
-		);
-		vkCmdDraw(f->command_buffer, 3, 1, 0, 0);
+
+	size_t thread_count = r->record_thread_count;
+	if (thread_count > work.task_count) thread_count = work.task_count;
+	if (thread_count > 1) {
+		r->record_work = &work;
+		pshine_semaphore_post(r->record_start, (uint32_t)(thread_count - 1));
 	}
-	rg_graph_end_pass(&r->rgraph);
-	rg_graph_begin_pass(&r->rgraph); // SDR GUI
-	{
-		PSHINE_PERF_ZONE("Pass: SDR GUI");
-		pshine_imgui_backend_render_draw_data(f->command_buffer);
+	record_worker(&work);
+	for (size_t i = 1; i < thread_count; ++i) pshine_semaphore_wait(r->record_done);
+	r->record_work = nullptr;
+
+	struct pshine_timeval delta = pshine_timeval_delta(start, pshine_timeval_now());
+	r->record_time = (double)delta.sec + (double)delta.nsec * 1e-9;
+}
+
+static void render_game_frame(
+	struct vulkan_renderer *r,
+	struct per_frame_data *f,
+	struct do_frame_stuff *stuff,
+	size_t frame_number
+) {
+	PSHINE_PERF_FUNC();
+	record_game_frame_passes(r, f, stuff);
+
+	// The passes on the compute queue wait for this command buffer anyway.
+	if (r->gpu_perf.frame_count != 0)
+		pshine_gpu_perf_begin_frame(&r->gpu_perf, &r->rgraph, f->index, f->command_buffer);
+
+	rg_graph_set_scaled_render_area(&r->rgraph, (VkRect2D){ .extent = stuff->render_extent });
+
+	rg_graph_begin_frame(
+		&r->rgraph,
+		(VkRect2D){
+			.offset = (VkOffset2D){ 0, 0 },
+			.extent = r->swapchain_extent,
+		},
+		r->queue_families[QUEUE_GRAPHICS],
+		f->swapchain_image,
+		f->swapchain_image_view,
+		f->command_buffer
+	);
+
+	// Every segment but the last is ended here, the first one is begun by the caller.
+	f->submit_count = 0;
+	for (uint32_t segment_index = 0; segment_index < r->rgraph.segment_count; ++segment_index) {
+		const struct rg_segment *segment = &r->rgraph.segments_own[segment_index];
+		VkCommandBuffer cmd = f->segment_command_buffers[segment->queue][segment_index];
+		if (segment_index > 0) {
+			CHECKVK(vkEndCommandBuffer(f->submits[segment_index - 1].command_buffer));
+			CHECKVK(vkBeginCommandBuffer(cmd, &(VkCommandBufferBeginInfo){
+				.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+				.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+			}));
+			rg_graph_begin_segment(&r->rgraph, cmd);
+		}
+		f->submits[f->submit_count++] = (struct frame_submit){
+			.queue = segment->queue,
+			.command_buffer = cmd,
+			.wait_submit = segment->wait_segment,
+			.wait_stage_flags = segment->wait_stage_flags,
+			.frame_wait_stage_flags = segment->frame_wait_stage_flags,
+			.swapchain_stage_flags = segment->swapchain_stage_flags,
+		};
+
+		for (uint32_t pass = segment->first_pass; pass < segment->first_pass + segment->pass_count; ++pass) {
+			// the graph may have reordered the passes, find the jobs by the specified one.
+			uint32_t spec_index = r->rgraph.passes_own[pass].spec_index;
+			uint32_t recorded_count = 0;
+			VkCommandBuffer recorded[RECORD_TASK_COUNT_MAX];
+			for (size_t job = 0; job < RECORD_JOB_COUNT_; ++job) {
+				if (record_jobs[job].pass != spec_index) continue;
+				for (size_t chunk = 0; chunk < RECORD_CHUNK_COUNT_MAX; ++chunk)
+					if (f->recorded[job][chunk] != VK_NULL_HANDLE) recorded[recorded_count++] = f->recorded[job][chunk];
+			}
+			rg_graph_begin_pass(&r->rgraph);
+			if (recorded_count > 0) vkCmdExecuteCommands(cmd, recorded_count, recorded);
+			rg_graph_end_pass(&r->rgraph);
+		}
 	}
-	rg_graph_end_pass(&r->rgraph);
 	rg_graph_end_frame(&r->rgraph);
 }
 
@@ -5956,29 +8133,120 @@ static uint32_t render_begin(struct vulkan_renderer *r, uint32_t current_frame)
 	} else if (acquireImageRes != VK_SUCCESS) {
 		CHECKVK(acquireImageRes);
 	}
-	CHECKVK(vkResetCommandBuffer(f->command_buffer, 0));
+	for (size_t i = 0; i < FRAME_SEGMENT_COUNT_MAX; ++i)
+		CHECKVK(vkResetCommandBuffer(f->segment_command_buffers[RG_QUEUE_MAIN][i], 0));
+	if (f->async_pool != VK_NULL_HANDLE) CHECKVK(vkResetCommandPool(r->device, f->async_pool, 0));
+	for (size_t q = 0; q < frame_queue_count(r); ++q)
+		for (size_t i = 0; i < RECORD_THREAD_COUNT_MAX; ++i)
+			CHECKVK(vkResetCommandPool(r->device, f->record_pools[q][i], 0));
+	// just the one command buffer, unless `render_game_frame` records more.
+	f->submit_count = 1;
+	f->submits[0] = (struct frame_submit){
+		.queue = RG_QUEUE_MAIN,
+		.command_buffer = f->command_buffer,
+		.wait_submit = UINT32_MAX,
+		.swapchain_stage_flags = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+	};
 
 	r->frames[current_frame].swapchain_image = r->swapchain_images_own[image_index];
 	r->frames[current_frame].swapchain_image_view = r->swapchain_image_views_own[image_index];
+
+	// the last frame that used these events is done, see `init_rendergraph`.
+	VkEvent *events = &r->rgraph_events_own[current_frame * r->rgraph.event_count];
+	for (uint32_t i = 0; i < r->rgraph.event_count; ++i) CHECKVK(vkResetEvent(r->device, events[i]));
+	rg_graph_set_events(&r->rgraph, r->rgraph.event_count > 0 ? events : nullptr);
 	return image_index;
 }
 
+/// Submit `f->submits` in order. Each queue signals its own timeline, and a submission only waits for the
+/// other queue at the stages that need it, so the graphics queue isn't stalled on the async compute work
+/// until it reads the results. The last one is on the graphics queue, and writes to the swapchain image.
 static void render_end(struct vulkan_renderer *r, uint32_t current_frame, uint32_t image_index) {
 	struct per_frame_data *f = &r->frames[current_frame];
-	CHECKVK(vkQueueSubmit(r->queues[QUEUE_GRAPHICS], 1, &(VkSubmitInfo){
-		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.commandBufferCount = 1,
-		.pCommandBuffers = &f->command_buffer,
-		.signalSemaphoreCount = 1,
-		.pSignalSemaphores = &f->sync.render_finish_semaphore,
-		.waitSemaphoreCount = 1,
-		.pWaitSemaphores = &f->sync.image_avail_semaphore,
-		.pWaitDstStageMask = &(VkPipelineStageFlags){
-			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT
+	uint64_t frame_start_values[RG_QUEUE_COUNT_], values[FRAME_SEGMENT_COUNT_MAX];
+	memcpy(frame_start_values, r->queue_timeline_values, sizeof(frame_start_values));
+	bool image_waited = false;
+	for (uint32_t i = 0; i < f->submit_count; ++i) {
+		const struct frame_submit *submit = &f->submits[i];
+		enum rg_queue other = submit->queue == RG_QUEUE_MAIN ? RG_QUEUE_ASYNC_COMPUTE : RG_QUEUE_MAIN;
+		bool last = i + 1 == f->submit_count;
+		uint32_t wait_count = 0, signal_count = 0;
+		VkSemaphoreSubmitInfo waits[2], signals[2];
+
+		// the timeline only goes up, a wait for a later submission also waits for the earlier frames.
+		uint64_t other_value = 0;
+		VkPipelineStageFlags2 other_stages = VK_PIPELINE_STAGE_2_NONE;
+		if (submit->wait_submit != UINT32_MAX) {
+			other_value = values[submit->wait_submit];
+			other_stages = submit->wait_stage_flags | submit->frame_wait_stage_flags;
+		} else if (submit->frame_wait_stage_flags != VK_PIPELINE_STAGE_2_NONE) {
+			other_value = frame_start_values[other];
+			other_stages = submit->frame_wait_stage_flags;
+		}
+		// the fence is only signalled by the last one, it has to cover the other queue's work of the frame too.
+		if (last && r->queue_timeline_values[other] > frame_start_values[other]
+			&& r->queue_timeline_values[other] > other_value) {
+			other_value = r->queue_timeline_values[other];
+			other_stages = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+		}
+		if (other_stages != VK_PIPELINE_STAGE_2_NONE) {
+			waits[wait_count++] = (VkSemaphoreSubmitInfo){
+				.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+				.semaphore = r->queue_timelines[other],
+				.value = other_value,
+				.stageMask = other_stages,
+			};
+		}
+		if (submit->swapchain_stage_flags != VK_PIPELINE_STAGE_2_NONE || (last && !image_waited)) {
+			waits[wait_count++] = (VkSemaphoreSubmitInfo){
+				.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+				.semaphore = f->sync.image_avail_semaphore,
+				.stageMask = submit->swapchain_stage_flags != VK_PIPELINE_STAGE_2_NONE
+					? submit->swapchain_stage_flags : VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+			};
+			image_waited = true;
 		}
-	}, f->sync.in_flight_fence));
+
+		values[i] = ++r->queue_timeline_values[submit->queue];
+		signals[signal_count++] = (VkSemaphoreSubmitInfo){
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+			.semaphore = r->queue_timelines[submit->queue],
+			.value = values[i],
+			.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+		};
+		if (last) {
+			signals[signal_count++] = (VkSemaphoreSubmitInfo){
+				.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+				.semaphore = f->sync.render_finish_semaphore,
+				.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+			};
+		}
+		VkQueue queue = r->queues[submit->queue == RG_QUEUE_ASYNC_COMPUTE ? QUEUE_COMPUTE : QUEUE_GRAPHICS];
+		CHECKVK(vkQueueSubmit2(queue, 1, &(VkSubmitInfo2){
+			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+			.waitSemaphoreInfoCount = wait_count,
+			.pWaitSemaphoreInfos = waits,
+			.commandBufferInfoCount = 1,
+			.pCommandBufferInfos = &(VkCommandBufferSubmitInfo){
+				.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
+				.commandBuffer = submit->command_buffer,
+			},
+			.signalSemaphoreInfoCount = signal_count,
+			.pSignalSemaphoreInfos = signals,
+		}, last ? f->sync.in_flight_fence : VK_NULL_HANDLE));
+	}
+	// the presents are waited for by id, see `update_input_latency`.
+	if (r->present_wait) {
+		++r->present_id;
+		r->present_input_times[r->present_id % PRESENT_LATENCY_RING] = r->frame_input_time;
+	}
 	CHECKVK(vkQueuePresentKHR(r->queues[QUEUE_PRESENT], &(VkPresentInfoKHR){
 		.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+		.pNext = r->present_wait ? &(VkPresentIdKHR){
+			.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR,
+			.swapchainCount = 1,
+			.pPresentIds = &r->present_id,
+		} : nullptr,
 		.waitSemaphoreCount = 1,
 		.pWaitSemaphores = &f->sync.render_finish_semaphore,
 		.swapchainCount = 1,
@@ -5988,6 +8256,34 @@ static void render_end(struct vulkan_renderer *r, uint32_t current_frame, uint32
 	}));
 }
 
+/// With `pshine_render_settings::low_latency`, wait for the last frame to be on screen, so that the next
+/// one's input is read as late as it can be. Then add the input latency of the presents that are on
+/// screen by now. Without the wait they're only seen here, so their latency is over by up to a frame.
+static void update_input_latency(struct vulkan_renderer *r) {
+	if (!r->present_wait) return;
+	if (r->present_id - r->present_id_done > PRESENT_LATENCY_RING)
+		r->present_id_done = r->present_id - PRESENT_LATENCY_RING;
+	if (r->as_base.settings.low_latency && r->present_id_done < r->present_id) {
+		PSHINE_PERF_ZONE("Waiting for present");
+		// at most 100ms, the window might not be shown.
+		vkWaitForPresentKHR(r->device, r->swapchain, r->present_id, 100'000'000);
+	}
+	double now = glfwGetTime();
+	while (r->present_id_done < r->present_id) {
+		VkResult result = vkWaitForPresentKHR(r->device, r->swapchain, r->present_id_done + 1, 0);
+		if (result == VK_TIMEOUT) break;
+		uint64_t id = ++r->present_id_done;
+		// the others mean the swapchain is gone, along with the present.
+		if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) continue;
+		// the loading screen's frames have no input.
+		double input_time = r->present_input_times[id % PRESENT_LATENCY_RING];
+		if (input_time == 0.0) continue;
+		r->input_latencies[r->next_input_latency] = now - input_time;
+		r->next_input_latency = (r->next_input_latency + 1) % INPUT_LATENCY_WINDOW;
+		if (r->input_latency_count < INPUT_LATENCY_WINDOW) ++r->input_latency_count;
+	}
+}
+
 static void render_game(struct vulkan_renderer *r, uint32_t current_frame, size_t frame_number) {
 	PSHINE_PERF_FUNC();
 	uint32_t image_index = render_begin(r, current_frame);
@@ -6021,7 +8317,13 @@ static inline ImTextureRef ImTextureRefFromDS(VkDescriptorSet ds) {
 static void show_stats_window(struct vulkan_renderer *r, const struct renderer_stats *stats) {
 	if (r->game->ui_dont_render_windows) return;
 	if (ImGui_Begin("Shadow Debug", nullptr, 0)) {
-		ImGui_SliderFloat("Height", &shadow_proj_height, 0.1f, 30.0f);
+		ImGui_SliderFloat("Distance (m)", &r->shadow_distance, 100.0f, 20'000.0f);
+		ImGui_SliderFloat("Split Lambda", &r->shadow_split_lambda, 0.0f, 1.0f);
+		ImGui_SliderFloat("Light Threshold (deg)", &r->shadow_light_threshold, 0.0f, 1.0f);
+		ImGui_SliderFloat("Cache Margin", &r->shadow_cache_margin, 0.0f, 1.0f);
+		ImGui_Text("Cascades rendered: %u of %u", r->shadow_cascades_rendered, PSHINE_SHADOW_CASCADE_COUNT);
+		ImGui_Text("Caster draws: %zu %zu %zu %zu",
+			r->shadow_draw_counts[0], r->shadow_draw_counts[1], r->shadow_draw_counts[2], r->shadow_draw_counts[3]);
 		ImGui_PushStyleColor(ImGuiCol_Border, 0xFF'FF'FF'FF);
 		ImGui_PushStyleVar(ImGuiStyleVar_FrameBorderSize, 1.0f);
 		ImGui_ImageWithBgEx(ImTextureRefFromDS(imgui_shadowcolor_ds), (ImVec2){ .x = 256.0f, .y = 256.0f },
@@ -6038,6 +8340,80 @@ static void show_stats_window(struct vulkan_renderer *r, const struct renderer_s
 		ImGui_Text("CPU Memory (MiB): %.2f", stats->cpu_memory_used);
 		ImGui_Text("GPU Memory (MiB): %.2f", stats->gpu_memory.total_usage);
 		ImGui_Text("GPU Allocation Count: %zu", stats->gpu_memory.allocation_count);
+		ImGui_Text("Transient Memory (MiB): %.2f, %.2f without aliasing",
+			r->rgraph.aliased_memory_size / (1024.0 * 1024.0), r->rgraph.unaliased_memory_size / (1024.0 * 1024.0));
+		ImGui_Text("Culled: %zu/%zu (frustum %zu, occlusion %zu)",
+			r->cull_stats.frustum_culled + r->cull_stats.occlusion_culled, r->cull_stats.tested,
+			r->cull_stats.frustum_culled, r->cull_stats.occlusion_culled);
+		ImGui_Text("Ship draws: %zu in %zu indirect calls", r->std_mesh_draw_count, r->std_mesh_draw_group_count);
+		ImGui_Text("Recording: %.3fms on %zu threads", r->record_time * 1000.0, r->record_thread_count);
+		if (r->gpu_perf.frame_count != 0)
+			ImGui_Text("GPU time: %.3fms", r->gpu_perf.average_frame_time * 1000.0);
+		ImGui_Text("Render resolution: %ux%u (%.0f%%)",
+			(uint32_t)round(r->swapchain_extent.width * (double)r->render_scale),
+			(uint32_t)round(r->swapchain_extent.height * (double)r->render_scale), r->render_scale * 100.0f);
+		ImGui_Text("Async compute: %s, %u submissions", r->async_compute ? "on" : "off",
+			r->frames[0].submit_count);
+		ImGui_Text("Present: %s, %u frames in flight", present_mode_names[r->present_mode], r->frames_in_flight);
+		if (r->input_latency_count > 0) {
+			double latency_sum = 0.0, latency_max = 0.0;
+			for (uint32_t i = 0; i < r->input_latency_count; ++i) {
+				latency_sum += r->input_latencies[i];
+				latency_max = fmax(latency_max, r->input_latencies[i]);
+			}
+			ImGui_Text("Input to present: %.2fms (max %.2fms)",
+				latency_sum / r->input_latency_count * 1000.0, latency_max * 1000.0);
+			if (!r->as_base.settings.low_latency)
+				ImGui_SetItemTooltip("Seen once per frame, so up to a frame over without Low Latency.");
+		}
+	}
+	ImGui_End();
+}
+
+/// The averages of `vulkan_renderer::gpu_perf`, one row for each rendering of the graph.
+static void show_gpu_profiler_window(struct vulkan_renderer *r) {
+	if (r->game->ui_dont_render_windows) return;
+	const struct pshine_gpu_perf *perf = &r->gpu_perf;
+	if (perf->frame_count == 0) return;
+	if (ImGui_Begin("GPU Profiler", nullptr, 0)) {
+		ImGui_Text("Total: %.3fms, over the last %u frames", perf->average_frame_time * 1000.0, PSHINE_GPU_PERF_WINDOW);
+		if (ImGui_Button("Save GPU Timings"))
+			pshine_gpu_perf_write_csv(perf, CACHE_PATH "/gpu_timings.csv");
+		int column_count = 5 + (perf->statistics ? PSHINE_GPU_STATISTIC_COUNT_ : 0);
+		if (ImGui_BeginTable("_GpuProfilerTable", column_count, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+			ImGui_TableSetupColumn("Pass", 0);
+			ImGui_TableSetupColumn("Queue", 0);
+			ImGui_TableSetupColumn("Avg. (ms)", 0);
+			ImGui_TableSetupColumn("Min (ms)", 0);
+			ImGui_TableSetupColumn("Max (ms)", 0);
+			if (perf->statistics)
+				for (uint32_t j = 0; j < PSHINE_GPU_STATISTIC_COUNT_; ++j)
+					ImGui_TableSetupColumn(pshine_gpu_statistic_names[j], 0);
+			ImGui_TableHeadersRow();
+			for (uint32_t i = 0; i < perf->timing_count; ++i) {
+				const struct pshine_gpu_pass_timing *timing = &perf->timings_own[i];
+				if (timing->sample_count == 0) continue;
+				ImGui_TableNextRow();
+				ImGui_TableSetColumnIndex(0);
+				ImGui_Text("%s", timing->name_own);
+				ImGui_TableSetColumnIndex(1);
+				ImGui_Text("%s", timing->queue == RG_QUEUE_ASYNC_COMPUTE ? "compute" : "main");
+				ImGui_TableSetColumnIndex(2);
+				ImGui_Text("%.3f", timing->average_time * 1000.0);
+				ImGui_TableSetColumnIndex(3);
+				ImGui_Text("%.3f", timing->min_time * 1000.0);
+				ImGui_TableSetColumnIndex(4);
+				ImGui_Text("%.3f", timing->max_time * 1000.0);
+				// the async compute queue's passes aren't counted.
+				if (perf->statistics && timing->queue == RG_QUEUE_MAIN) {
+					for (uint32_t j = 0; j < PSHINE_GPU_STATISTIC_COUNT_; ++j) {
+						ImGui_TableSetColumnIndex(5 + (int)j);
+						ImGui_Text("%.0f", timing->average_statistics[j]);
+					}
+				}
+			}
+			ImGui_EndTable();
+		}
 	}
 	ImGui_End();
 }
@@ -6057,6 +8433,10 @@ static void show_utils_window(struct vulkan_renderer *r) {
 			}
 		}
 		ImGui_EndDisabled();
+		if (ImGui_Button("Save Render Graph")) {
+			rg_graph_create_dot_file(&r->rgraph, CACHE_PATH "/render_graph.dot");
+			rg_graph_write_barrier_plan(&r->rgraph, CACHE_PATH "/render_graph_plan.txt");
+		}
 		ImGui_BeginGroup();
 		double lod_min = 0.0;
 		double lod_max = 1'000'000'000.0;
@@ -6064,10 +8444,48 @@ static void show_utils_window(struct vulkan_renderer *r) {
 		ImGui_SliderScalar("LOD2", ImGuiDataType_Double, &r->lod_ranges[2], &r->lod_ranges[3], &r->lod_ranges[1]);
 		ImGui_SliderScalar("LOD1", ImGuiDataType_Double, &r->lod_ranges[1], &r->lod_ranges[2], &r->lod_ranges[0]);
 		ImGui_SliderScalar("LOD0", ImGuiDataType_Double, &r->lod_ranges[0], &r->lod_ranges[1], &lod_max);
+		double lod_band_min = 0.0, lod_band_max = 1.0;
+		ImGui_SliderScalar("LOD Hysteresis", ImGuiDataType_Double, &r->lod_hysteresis, &lod_band_min, &lod_band_max);
+		ImGui_SliderScalar("LOD Morph Range", ImGuiDataType_Double, &r->lod_morph_range, &lod_band_min, &lod_band_max);
+		ImGui_Text("LOD switches: %zu", r->lod_switch_count);
+		ImGui_SliderFloat("Ship LOD Error", &r->mesh_lod_pixel_error, 0.0f, 16.0f);
+		ImGui_SetItemTooltip("The largest simplification error of ship LODs, in pixels.");
 		ImGui_EndGroup();
 		ImGui_Separator();
 		ImGui_Checkbox("Render Ships", &r->as_base.settings.render_ships);
+		ImGui_Checkbox("Culling", &r->culling_enabled);
+		ImGui_SetItemTooltip("Skip bodies and ships outside the view or behind a planet or star.");
 		ImGui_Checkbox("Enable Bloom", &r->as_base.settings.do_bloom);
+		ImGui_Checkbox("Half-Resolution Atmosphere", &r->atmo_half_res);
+		ImGui_SetItemTooltip("Render the atmospheres at a quarter of the pixels, accumulated over frames.");
+		ImGui_SliderFloat("Atmosphere Min Pixels", &r->atmo_min_pixels, 0.0f, 16.0f);
+		ImGui_SetItemTooltip("Atmospheres smaller than this on screen aren't drawn.");
+		ImGui_BeginDisabled(r->gpu_perf.frame_count == 0);
+		ImGui_Checkbox("Dynamic Resolution", &r->dynamic_resolution);
+		ImGui_EndDisabled();
+		ImGui_SetItemTooltip("Render the scene at a lower resolution when the GPU time is over the target.");
+		if (r->dynamic_resolution) {
+			float target_ms = r->target_gpu_time * 1000.0f;
+			if (ImGui_SliderFloat("Target GPU Time (ms)", &target_ms, 4.0f, 50.0f))
+				r->target_gpu_time = target_ms / 1000.0f;
+			ImGui_SliderFloat("Min Render Scale", &r->min_render_scale, 0.25f, 1.0f);
+		} else {
+			ImGui_SliderFloat("Render Scale", &r->render_scale, 0.25f, 1.0f);
+		}
+		ImGui_Separator();
+		uint32_t frames_min = 1, frames_max = PSHINE_MAX_FRAMES_IN_FLIGHT;
+		ImGui_SliderScalar("Frames in Flight", ImGuiDataType_U32, &r->as_base.settings.frames_in_flight,
+			&frames_min, &frames_max);
+		int present_mode = (int)r->as_base.settings.present_mode;
+		if (ImGui_ComboChar("Present Mode", &present_mode, present_mode_names, PSHINE_PRESENT_MODE_COUNT_))
+			r->as_base.settings.present_mode = (enum pshine_present_mode)present_mode;
+		ImGui_BeginDisabled(!r->present_wait);
+		ImGui_Checkbox("Low Latency", &r->as_base.settings.low_latency);
+		ImGui_EndDisabled();
+		ImGui_SetItemTooltip("Wait for the last frame to be on screen before reading the input.");
+		size_t record_threads_min = 1, record_threads_max = RECORD_THREAD_COUNT_MAX;
+		ImGui_SliderScalar("Recording Threads", ImGuiDataType_U64, &r->record_thread_count,
+			&record_threads_min, &record_threads_max);
 	}
 	ImGui_End();
 }
@@ -6240,7 +8658,7 @@ void pshine_take_screenshot(
 	struct pshine_render_settings old_settings = renderer->settings;
 	if (settings != nullptr) renderer->settings = *settings;
 
-	struct per_frame_data *f = &r->frames[FRAMES_IN_FLIGHT];
+	struct per_frame_data *f = &r->frames[PSHINE_MAX_FRAMES_IN_FLIGHT];
 	CHECKVK(vkAllocateCommandBuffers(r->device, &(VkCommandBufferAllocateInfo){
 		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
 		.commandBufferCount = 1,
@@ -6289,7 +8707,7 @@ void pshine_main_loop(struct pshine_game *game, struct pshine_renderer *renderer
 
 	float last_time = glfwGetTime();
 
-	/// This is mod `FRAMES_IN_FLIGHT`.
+	/// This is mod `vulkan_renderer::frames_in_flight`.
 	uint32_t current_frame = 0;
 	/// This is the total count.
 	size_t frame_number = 0;
@@ -6435,7 +8853,7 @@ void pshine_main_loop(struct pshine_game *game, struct pshine_renderer *renderer
 		struct pshine_job *job = &r->game->jobs.ptr[current_job++];
 		job->callback(job);
 
-		current_frame = (current_frame + 1) % FRAMES_IN_FLIGHT;
+		current_frame = (current_frame + 1) % r->frames_in_flight;
 	}
 
 	while (!glfwWindowShouldClose(r->window)) {
@@ -6443,7 +8861,10 @@ void pshine_main_loop(struct pshine_game *game, struct pshine_renderer *renderer
 		float current_time = glfwGetTime();
 		float delta_time = current_time - last_time;
 		r->scroll_delta = double2v0();
+		apply_frame_settings(r, &current_frame);
+		update_input_latency(r);
 		glfwPollEvents();
+		r->frame_input_time = glfwGetTime();
 
 		int current_width = 0, current_height = 0;
 		glfwGetFramebufferSize(r->window, &current_width, &current_height);
@@ -6474,6 +8895,7 @@ void pshine_main_loop(struct pshine_game *game, struct pshine_renderer *renderer
 			set_gpu_mem_usage(r, &stats);
 			show_stats_window(r, &stats);
 		}
+		show_gpu_profiler_window(r);
 		show_gizmos(r);
 		show_utils_window(r);
 		ImGui_Render();
@@ -6484,7 +8906,7 @@ void pshine_main_loop(struct pshine_game *game, struct pshine_renderer *renderer
 		}
 		delta_time_sum += delta_time;
 		last_time = current_time;
-		current_frame = (current_frame + 1) % FRAMES_IN_FLIGHT;
+		current_frame = (current_frame + 1) % r->frames_in_flight;
 		if (frame_number > 2) rg_enable_debugging(false);
 		PSHINE_PERF_FRAME_MARK();
 	}
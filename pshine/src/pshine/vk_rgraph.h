@@ -4,7 +4,7 @@
 /// License, v. 2.0. If a copy of the MPL was not distributed with this
 /// file, You can obtain one at https://mozilla.org/MPL/2.0/.
 ///
-/// This is vkrgaph version 1.3a.
+/// This is vkrgaph version 1.9a.
 /// 
 /// Vulkan 1.4 dynamic rendering render graph implementation with support
 /// for dynamic_rendering_local_read.
@@ -42,9 +42,58 @@
 ///       rg_graph_begin_pass(&graph)
 ///         {rendering commands}
 ///       rg_graph_end_pass(&graph)
+///     or, for passes with `rg_pass_spec::secondary`:
+///       {record secondary command buffers, with .pInheritanceInfo->pNext = &(
+///         rg_get_inheritance_rendering_info(pass) with .pNext = &rg_get_input_attachment_index_info(pass)
+///       )}
+///       rg_graph_begin_pass(&graph)
+///         vkCmdExecuteCommands(...)
+///       rg_graph_end_pass(&graph)
 ///     rg_graph_end_frame(&graph)
 ///   rg_free_graph(&graph)
 ///
+/// With an async compute queue (`rg_graph_spec::has_async_compute_queue`), the
+/// passes are split into segments that run on one queue each (`rg_graph::segments_own`).
+/// Each segment is recorded into its own command buffer, and submitted in order, with each
+/// submission waiting only for what it needs from the other queue (e.g. on a timeline semaphore
+/// per queue, see `rg_segment::wait_segment`):
+///   rg_graph_begin_frame(&graph, ..., command buffer for segment 0)
+///   {each pass in segment 0}
+///   rg_graph_begin_segment(&graph, command buffer for segment 1)
+///   {each pass in segment 1}
+///   ...
+/// The graph inserts the queue family ownership transfers between the segments.
+///
+/// Images that aren't used during the whole frame can share memory. Create them without
+/// memory and pass their `rg_graph_image_spec::memory_requirements`, then after building:
+///   {allocate each of `graph.memory_heaps_own`}
+///   {bind each placed image at its `memory_offset` in heap `memory_heap`, create the views}
+///   rg_graph_set_image_view(&graph, image, view)
+/// The graph discards an image when it takes over the memory (see `rg_graph_image::aliases_prev`).
+///
+/// With `rg_graph_spec::cull_passes` and `rg_graph_spec::reorder_passes`, the passes are
+/// recorded in a different order than specified (`rg_graph::passes_own` is in the recorded
+/// order), and some might not be recorded at all. Use `rg_graph_get_pass` to find a pass.
+///
+/// The barriers are planned when building the graph, see `rg_graph::barrier_batches_own` and
+/// `rg_graph_write_barrier_plan`. Barriers between passes with other passes in between are
+/// split into a `vkCmdSetEvent2` after the first and a `vkCmdWaitEvents2` before the second,
+/// if the graph is given events each frame:
+///   rg_graph_set_events(&graph, {graph.event_count unsignaled events})
+///
+/// To measure the passes on the GPU, give the graph query pools each frame (reset beforehand):
+///   rg_graph_set_query_pools(&graph, {timestamp pool}, {pipeline statistics pool})
+/// and read query `2 * i`, `2 * i + 1` (and `i`) for each rendering that begins with `passes_own[i]`.
+///
+/// To render some passes at a lower resolution (into the top left of their attachments), mark them
+/// `rg_pass_spec::scaled`, and give the graph their render area whenever it changes:
+///   rg_graph_set_scaled_render_area(&graph, {the scaled area})
+///
+/// The commands go through `rg_graph_spec::commands`, which are the Vulkan ones by default.
+/// To exercise a graph without a device (e.g. in tests), record it with `rg_recording_commands`,
+/// which logs the commands into an `rg_recording` instead. The command buffers are never
+/// used then, any non-null handles will do.
+///
 /// For an example graph specification setup, see the example function at
 /// the end of this file. (If it doesn't work, make an issue in the codeberg
 /// repository, and check out pshine's source code (pshine/src/pshine/vk.c))
@@ -60,6 +109,7 @@
 #ifndef VKRGRAPH_H_
 #define VKRGRAPH_H_
 #include <limits.h>
+#include <stdio.h>
 #include <vulkan/vulkan.h>
 
 #include <pshine/perf.h>
@@ -80,28 +130,74 @@
 #endif
 
 struct rg_graph;
+struct rg_pass;
 
-/// Currently unused, TODO.
+/// Where the graph records its commands, into `graph->current.command_buffer`.
+/// See `rg_vulkan_commands` and `rg_recording_commands`.
 struct rg_graph_commands {
+	/// Passed to the functions as `graph->commands.user`.
+	void *user;
 	/// vkCmdBeginRendering wrapper.
 	void (*begin_rendering)(struct rg_graph *graph, const VkRenderingInfo *info);
 	/// vkCmdEndRendering wrapper.
 	void (*end_rendering)(struct rg_graph *graph);
 	/// vkCmdPipelineBarrier2 wrapper.
 	void (*barrier)(struct rg_graph *graph, const VkDependencyInfo *info);
+	/// vkCmdSetEvent2 wrapper.
+	void (*set_event)(struct rg_graph *graph, VkEvent event, const VkDependencyInfo *info);
+	/// vkCmdWaitEvents2 wrapper, for a single event.
+	void (*wait_event)(struct rg_graph *graph, VkEvent event, const VkDependencyInfo *info);
+	/// vkCmdSetRenderingInputAttachmentIndices wrapper.
+	void (*set_input_attachment_indices)(struct rg_graph *graph, const VkRenderingInputAttachmentIndexInfo *info);
+	/// (optional) Where the pass's own commands begin (after its barriers, in its rendering)
+	/// and end (before its rendering ends and its barriers).
+	void (*begin_pass)(struct rg_graph *graph, struct rg_pass *pass);
+	void (*end_pass)(struct rg_graph *graph, struct rg_pass *pass);
+	/// vkCmdWriteTimestamp2 wrapper, see `rg_graph_set_query_pools`.
+	void (*write_timestamp)(struct rg_graph *graph, VkPipelineStageFlags2 stage, VkQueryPool pool, uint32_t query);
+	/// vkCmdBeginQuery and vkCmdEndQuery wrappers.
+	void (*begin_query)(struct rg_graph *graph, VkQueryPool pool, uint32_t query);
+	void (*end_query)(struct rg_graph *graph, VkQueryPool pool, uint32_t query);
 };
 
+/// Records into Vulkan command buffers.
+extern const struct rg_graph_commands rg_vulkan_commands;
+
 struct rg_graph_image_spec {
 	const char *name;
 	VkImage image;
 	VkImageView image_view;
 	VkFormat format;
 	VkImageAspectFlags aspect;
+	/// Keep the contents between frames: each frame starts from the layout the last one left
+	/// the image in, instead of discarding it. The image must be in that layout before the first frame.
+	bool persistent;
+	/// (optional) If `size` isn't 0, the image has no memory yet, and the graph places it in one of
+	/// `rg_graph::memory_heaps_own`, sharing the memory with the images not used at the same time.
+	/// Bind it at `rg_graph_image::memory_offset`, then set the view with `rg_graph_set_image_view`.
+	/// Can't be persistent.
+	VkMemoryRequirements memory_requirements;
 };
 
 struct rg_graph_spec {
 	uint32_t pass_count;
 	uint32_t image_count;
+	/// (optional) The format of the swapchain images. Only needed for the
+	/// inheritance info of secondary passes that render to the swapchain.
+	VkFormat swapchain_format;
+	/// (optional) Run the passes with `rg_pass_spec::async_compute` on a queue of
+	/// `async_compute_queue_family_index`, which must differ from the main queue's family.
+	bool has_async_compute_queue;
+	uint32_t async_compute_queue_family_index;
+	/// (optional) Leave out the passes whose images aren't used later in the frame. The passes
+	/// that write to the swapchain or a persistent image, or have `rg_pass_spec::side_effects`, stay.
+	bool cull_passes;
+	/// (optional) Reorder the passes to put as many passes as possible between each pass and the
+	/// ones that use its images, so the barriers between them wait less. Passes that can be merged
+	/// stay together.
+	bool reorder_passes;
+	/// (optional) Where the commands are recorded, `rg_vulkan_commands` if `nullptr`.
+	const struct rg_graph_commands *commands;
 	RG_COUNTED_BY(pass_count) const struct rg_pass_spec *passes;
 	RG_COUNTED_BY(image_count) const struct rg_graph_image_spec *images;
 };
@@ -181,6 +277,88 @@ struct rg_pass_spec {
 	uint32_t image_ref_count;
 	VkRect2D render_area;
 	bool compute;
+	/// The pass's commands are recorded in secondary command buffers, so its rendering
+	/// is begun with `VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT`.
+	/// Passes are only merged if they agree on this.
+	bool secondary;
+	/// (compute passes only) Run on the async compute queue, if the graph has one.
+	bool async_compute;
+	/// The pass uses resources the graph doesn't know about (e.g. buffers, or images not in the
+	/// graph), so it's never culled, and the other passes aren't moved across it.
+	bool side_effects;
+	/// (graphics passes without a `render_area` only) The pass renders in the area given to
+	/// `rg_graph_set_scaled_render_area` instead of the frame's. Passes are only merged if they agree on this.
+	bool scaled;
+};
+
+enum rg_queue : uint32_t {
+	/// The queue of `rg_graph_begin_frame`, graphics-capable.
+	RG_QUEUE_MAIN,
+	/// See `rg_graph_spec::has_async_compute_queue`.
+	RG_QUEUE_ASYNC_COMPUTE,
+	RG_QUEUE_COUNT_,
+};
+
+/// A range of `rg_graph::barrier_batches_own`.
+struct rg_barrier_batch_range {
+	uint32_t first;
+	uint32_t count;
+};
+
+/// A run of consecutive passes on the same queue.
+struct rg_segment {
+	enum rg_queue queue;
+	uint32_t first_pass;
+	uint32_t pass_count;
+	/// Recorded when the segment begins, for the images first used in it.
+	struct rg_barrier_batch_range start_batches;
+	/// The last segment on the other queue that this one acquires images from, `UINT32_MAX` if none.
+	/// The submission waits for it at `wait_stage_flags`, the stages of the acquires.
+	uint32_t wait_segment;
+	VkPipelineStageFlags2 wait_stage_flags;
+	/// If not `NONE`, an image is first used here but was last used on the other queue: the submission
+	/// also waits for the other queue's work of the last frame at these stages.
+	VkPipelineStageFlags2 frame_wait_stage_flags;
+	/// If not `NONE`, the swapchain image is first used here, the submission waits for it at these stages.
+	VkPipelineStageFlags2 swapchain_stage_flags;
+};
+
+/// How a batch of barriers is recorded.
+enum rg_barrier_batch_kind : uint32_t {
+	/// `vkCmdPipelineBarrier2`.
+	RG_BARRIER_BATCH_PIPELINE,
+	/// `vkCmdPipelineBarrier2` with `VK_DEPENDENCY_BY_REGION_BIT`, between merged passes.
+	RG_BARRIER_BATCH_BY_REGION,
+	/// The first half of a split barrier, `vkCmdSetEvent2`.
+	/// Recorded as `vkCmdPipelineBarrier2` if the graph has no events.
+	RG_BARRIER_BATCH_SET_EVENT,
+	/// The second half of a split barrier, `vkCmdWaitEvents2`, with the same barriers as the set.
+	RG_BARRIER_BATCH_WAIT_EVENT,
+};
+
+/// An image barrier in the plan, recorded with the image and the queue family indices of the frame.
+struct rg_barrier {
+	/// Index in `rg_graph::images_own`, `UINT32_MAX` for the swapchain.
+	uint32_t image_index;
+	VkImageLayout old_layout;
+	VkImageLayout new_layout;
+	VkPipelineStageFlags2 src_stage_flags;
+	VkAccessFlags2 src_access_flags;
+	VkPipelineStageFlags2 dst_stage_flags;
+	VkAccessFlags2 dst_access_flags;
+	/// A queue family ownership transfer if they aren't the same.
+	enum rg_queue src_queue;
+	enum rg_queue dst_queue;
+};
+
+/// Barriers recorded with one command.
+struct rg_barrier_batch {
+	enum rg_barrier_batch_kind kind;
+	/// For the split barriers, the index in the `rg_graph_set_events` array.
+	uint32_t event;
+	/// A range of `rg_graph::barriers_own`.
+	uint32_t first_barrier;
+	uint32_t barrier_count;
 };
 
 struct rg_graph_image_use {
@@ -197,6 +375,8 @@ struct rg_image_ref {
 	VkAttachmentLoadOp load_op;
 	VkAttachmentStoreOp store_op;
 	VkClearValue clear;
+	/// The previous use of the image in the frame, `pass_index` is `UINT32_MAX` if none.
+	struct rg_graph_image_use prev_use;
 };
 
 struct rg_graph_image {
@@ -209,48 +389,177 @@ struct rg_graph_image {
 	struct rg_graph_image_use *pass_use_map_own;
 	struct rg_image_ref last_use_ref;
 	VkImageAspectFlags aspect;
+	bool persistent;
+	/// The first and the last pass the image is used in, widened to the merged passes around them.
+	uint32_t first_pass, last_pass;
+	/// The queues the image is used on, a bit for each `rg_queue`.
+	uint32_t queue_mask;
+	/// Index in `rg_graph::memory_heaps_own`, `UINT32_MAX` if the image has its own memory.
+	uint32_t memory_heap;
+	VkDeviceSize memory_offset;
+	VkDeviceSize memory_size;
+	/// Another image is in the same memory earlier in the frame, so instead of the frame start, the
+	/// image is discarded at `first_pass`, after the stages and accesses below.
+	bool aliases_prev;
+	VkPipelineStageFlags2 alias_src_stage_flags;
+	VkAccessFlags2 alias_src_access_flags;
+};
+
+/// Memory shared by the placed images (see `rg_graph_image_spec::memory_requirements`),
+/// to be allocated by the user.
+struct rg_memory_heap {
+	VkDeviceSize size;
+	VkDeviceSize alignment;
+	/// The memory types all the images in the heap can use.
+	uint32_t memory_type_bits;
 };
 
 struct rg_pass {
 	const char *name;
+	/// Index in `rg_graph_spec::passes`.
+	uint32_t spec_index;
 	uint32_t image_ref_count;
 	uint32_t color_attachment_count;
 	uint32_t depth_attachment;
 	uint32_t color_attachments[8];
 	uint32_t color_input_attachment_indices[8];
 	uint32_t depth_input_attachment_index;
+	VkFormat color_attachment_formats[8];
+	VkFormat depth_attachment_format;
 	RG_COUNTED_BY(image_ref_count) struct rg_image_ref *image_refs_own;
 	VkRect2D render_area;
+	enum rg_queue queue;
+	/// Index in `rg_graph::segments_own`.
+	uint32_t segment;
+	/// Recorded before the rendering begins, and after it ends (or in it, if merged with the next pass).
+	struct rg_barrier_batch_range begin_batches;
+	struct rg_barrier_batch_range end_batches;
 	bool has_depth_attachment;
 	bool compute;
+	bool secondary;
 	bool merged_with_next;
 	bool merged_with_prev;
 	bool has_depth_input_attachment;
+	/// See `rg_pass_spec::scaled`.
+	bool scaled;
+	/// Left out by `rg_graph_spec::cull_passes`, in `rg_graph::culled_passes_own`.
+	bool culled;
 };
 
 struct rg_graph_impl {
 	uint32_t pass_index;
+	uint32_t segment_index;
 	VkRect2D render_area;
+	/// See `rg_graph_set_scaled_render_area`.
+	VkRect2D scaled_render_area;
 	struct rg_graph_image swapchain_image;
+	/// The command buffer of the current segment.
 	VkCommandBuffer command_buffer;
-	uint32_t queue_family_index;
+	uint32_t queue_family_indices[RG_QUEUE_COUNT_];
+	/// See `rg_graph_set_events`.
+	const VkEvent *events;
+	/// See `rg_graph_set_query_pools`.
+	VkQueryPool timestamp_pool;
+	VkQueryPool statistics_pool;
+	/// `rg_graph::barriers_own` for this frame's swapchain image and queue families.
+	VkImageMemoryBarrier2 *vk_barriers_own;
 };
 
 struct rg_graph {
 	uint32_t image_count;
 	uint32_t pass_count;
+	uint32_t segment_count;
 	RG_COUNTED_BY(image_count) struct rg_graph_image *images_own;
+	/// The passes that are recorded, in the order they're recorded in.
 	RG_COUNTED_BY(pass_count) struct rg_pass *passes_own;
+	uint32_t culled_pass_count;
+	RG_COUNTED_BY(culled_pass_count) struct rg_pass *culled_passes_own;
+	uint32_t spec_pass_count;
+	/// The pass made from each of `rg_graph_spec::passes`, see `rg_graph_get_pass`.
+	RG_COUNTED_BY(spec_pass_count) struct rg_pass **spec_passes_own;
+	/// A single segment on the main queue if there's no async compute queue.
+	RG_COUNTED_BY(segment_count) struct rg_segment *segments_own;
+	uint32_t memory_heap_count;
+	RG_COUNTED_BY(memory_heap_count) struct rg_memory_heap *memory_heaps_own;
+	/// The memory of the placed images if each had its own, and the memory of the heaps they share.
+	VkDeviceSize unaliased_memory_size;
+	VkDeviceSize aliased_memory_size;
+	/// The barrier plan, the same every frame. The batches are in the order they're recorded in,
+	/// see `rg_segment::start_batches`, `rg_pass::begin_batches` and `rg_pass::end_batches`.
+	uint32_t barrier_count;
+	uint32_t barrier_batch_count;
+	RG_COUNTED_BY(barrier_count) struct rg_barrier *barriers_own;
+	RG_COUNTED_BY(barrier_batch_count) struct rg_barrier_batch *barrier_batches_own;
+	/// The number of split barriers, each needs an event, see `rg_graph_set_events`.
+	uint32_t event_count;
+	struct rg_graph_commands commands;
 	struct rg_graph_impl current;
 };
 
+enum rg_recorded_kind : uint32_t {
+	RG_RECORDED_BEGIN_PASS,
+	RG_RECORDED_END_PASS,
+	RG_RECORDED_BEGIN_RENDERING,
+	RG_RECORDED_END_RENDERING,
+	RG_RECORDED_BARRIER,
+	RG_RECORDED_SET_EVENT,
+	RG_RECORDED_WAIT_EVENT,
+	RG_RECORDED_WRITE_TIMESTAMP,
+	RG_RECORDED_BEGIN_QUERY,
+	RG_RECORDED_END_QUERY,
+};
+
+/// A command logged by `rg_recording_commands`.
+struct rg_recorded_command {
+	enum rg_recorded_kind kind;
+	VkCommandBuffer command_buffer;
+	/// The position (in `rg_graph::passes_own`) of the pass being recorded,
+	/// or the segment's first pass for the barriers at its start.
+	uint32_t pass_index;
+	/// (barriers and events) `VK_DEPENDENCY_BY_REGION_BIT` or 0.
+	VkDependencyFlags dependency_flags;
+	/// (events only)
+	VkEvent event;
+	/// (barriers and events) A range of `rg_recording::barriers_own`.
+	uint32_t first_barrier;
+	uint32_t barrier_count;
+	/// (timestamps and queries only)
+	VkQueryPool query_pool;
+	uint32_t query;
+	/// (renderings only)
+	VkRect2D render_area;
+};
+
+struct rg_recorded_barrier {
+	/// Index in `rg_graph::images_own`, `UINT32_MAX` for the swapchain.
+	uint32_t image_index;
+	VkImageMemoryBarrier2 barrier;
+};
+
+/// The commands of a graph, as structured data. Zero-initialize it.
+struct rg_recording {
+	uint32_t command_count;
+	uint32_t command_capacity;
+	RG_COUNTED_BY(command_count) struct rg_recorded_command *commands_own;
+	uint32_t barrier_count;
+	uint32_t barrier_capacity;
+	RG_COUNTED_BY(barrier_count) struct rg_recorded_barrier *barriers_own;
+};
+
+/// Logs the commands into `recording` instead of recording them.
+/// Use it as `rg_graph_spec::commands`, for as long as the graph is recorded.
+struct rg_graph_commands rg_recording_commands(struct rg_recording *recording);
+/// Forget the logged commands, keeping the memory for the next ones.
+void rg_clear_recording(struct rg_recording *recording);
+void rg_free_recording(struct rg_recording *recording);
+
 /// Can be called at any point.
 void rg_enable_debugging(bool enabled);
 /// Initialize a render graph based on the specification.
 void rg_build_graph(const struct rg_graph_spec *spec, struct rg_graph *graph);
 /// Free the dynamically allocated memory used by the graph.
 void rg_free_graph(struct rg_graph *graph);
-/// Begin frame and set per-frame data.
+/// Begin frame and set per-frame data. `command_buffer` is for the first segment.
 void rg_graph_begin_frame(
 	struct rg_graph *graph,
 	VkRect2D render_area,
@@ -259,6 +568,9 @@ void rg_graph_begin_frame(
 	VkImageView swapchain_image_view,
 	VkCommandBuffer command_buffer
 );
+/// Record the next segment into `command_buffer`, before its first pass.
+/// Inserts the frame start barriers of the images first used in it.
+void rg_graph_begin_segment(struct rg_graph *graph, VkCommandBuffer command_buffer);
 /// Does not submit commands or do anything at all really.
 void rg_graph_end_frame(struct rg_graph *graph);
 /// Begin current pass. Inserts the necessary pipeline barriers.
@@ -266,6 +578,42 @@ void rg_graph_begin_pass(struct rg_graph *graph);
 /// End current pass. Inserts the necessary pipeline barriers.
 void rg_graph_end_pass(struct rg_graph *graph);
 
+/// Set the view of a placed image, once it's bound to its memory.
+void rg_graph_set_image_view(struct rg_graph *graph, rg_image_id image, VkImageView image_view);
+
+/// The pass made from `rg_graph_spec::passes[spec_index]`. Might be culled (see `rg_pass::culled`).
+struct rg_pass *rg_graph_get_pass(struct rg_graph *graph, uint32_t spec_index);
+
+/// Record the split barriers with `events` (`rg_graph::event_count` of them) from now on, or
+/// as pipeline barriers if `nullptr`. The events must be unsignaled when a frame begins (e.g. reset
+/// on the host after the last frame that used them is done), so each frame in flight needs its own.
+void rg_graph_set_events(struct rg_graph *graph, const VkEvent *events);
+
+/// Time the passes with `timestamps` (`2 * rg_graph::pass_count` timestamp queries), and count
+/// what they do with `statistics` (`rg_graph::pass_count` pipeline statistics queries), from now on.
+/// Either can be `VK_NULL_HANDLE`. The passes merged into one rendering are measured together: for
+/// the rendering that begins with the pass at position `i` in `rg_graph::passes_own`, the timestamps
+/// are queries `2 * i` (before it) and `2 * i + 1` (after it), and the statistics are query `i`.
+/// The other queries stay unavailable. The queries are outside of the renderings, so the secondary
+/// command buffers of the passes must inherit the statistics. Only the passes on the main queue are
+/// counted. The queries must be reset before a frame begins, so each frame in flight needs its own pools.
+void rg_graph_set_query_pools(struct rg_graph *graph, VkQueryPool timestamps, VkQueryPool statistics);
+
+/// Render the `rg_pass_spec::scaled` passes in `render_area` from the next rendering on, e.g. the top
+/// left of their attachments, for a resolution that changes without recreating them. An empty area
+/// (the default) is the frame's render area.
+void rg_graph_set_scaled_render_area(struct rg_graph *graph, VkRect2D render_area);
+
+/// Write the passes and the images they use as a graphviz file, with the memory of the placed images.
+void rg_graph_create_dot_file(struct rg_graph *graph, const char *fpath);
+
+/// Write the order of the passes and the barrier plan as text. There are no handles in it,
+/// so it only changes when the graph does.
+void rg_graph_write_barrier_plan(struct rg_graph *graph, const char *fpath);
+
+/// `rg_graph_write_barrier_plan` to an open file.
+void rg_graph_print_barrier_plan(struct rg_graph *graph, FILE *fout);
+
 /// Not currently implemented.
 void rg_graph_pass_last_use(
 	struct rg_graph *graph,
@@ -277,6 +625,12 @@ VkRenderingInputAttachmentIndexInfo rg_get_input_attachment_index_info(
 	struct rg_pass *pass
 );
 
+/// Get the `VkCommandBufferInheritanceRenderingInfo` for secondary command buffers
+/// executed in a render pass. Chain `rg_get_input_attachment_index_info` after it.
+VkCommandBufferInheritanceRenderingInfo rg_get_inheritance_rendering_info(
+	struct rg_pass *pass
+);
+
 #ifdef __INTELLISENSE__
 #define RG_IMPLEMENTATION
 #define RG_DEBUG 1
@@ -491,11 +845,40 @@ static bool rg_impl_can_merge(
 		return false;
 	}
 
+	if (src_pass->secondary != dst_pass->secondary) {
+		if (log_reason)
+			RG_DEBUG_PRINTF("Did not merge pass %s and %s because only one of them "
+				"is recorded in secondary command buffers.\n", src_pass->name, dst_pass->name);
+		return false;
+	}
+
+	// The rendering has the first pass's render area.
+	if (
+		src_pass->scaled != dst_pass->scaled ||
+		memcmp(&src_pass->render_area, &dst_pass->render_area, sizeof(VkRect2D)) != 0
+	) {
+		if (log_reason)
+			RG_DEBUG_PRINTF("Did not merge pass %s and %s because their render areas "
+				"are different.\n", src_pass->name, dst_pass->name);
+		return false;
+	}
+
 	uint32_t min_image_ref_count = src_pass->image_ref_count > dst_pass->image_ref_count
 		? dst_pass->image_ref_count
 		: src_pass->image_ref_count
 		;
 
+	// The ownership is acquired before the rendering begins, so a merged pass can't.
+	for (uint32_t j = 0; j < dst_pass->image_ref_count; ++j) {
+		struct rg_graph_image_use prev_use = dst_pass->image_refs_own[j].prev_use;
+		if (prev_use.pass_index != UINT32_MAX && graph->passes_own[prev_use.pass_index].queue != dst_pass->queue) {
+			if (log_reason)
+				RG_DEBUG_PRINTF("Did not merge pass %s and %s because %s uses an image from another queue.\n",
+					src_pass->name, dst_pass->name, dst_pass->name);
+			return false;
+		}
+	}
+
 	for (uint32_t j = 0; j < min_image_ref_count; ++j) {
 		struct rg_image_ref *src_ref = &src_pass->image_refs_own[j];
 		struct rg_image_ref *dst_ref = &dst_pass->image_refs_own[j];
@@ -539,6 +922,20 @@ static bool rg_impl_can_merge(
 			return false;
 		}
 
+		if (
+			(src_ref->access_flags & VK_ACCESS_2_SHADER_SAMPLED_READ_BIT) &&
+			(
+				(dst_ref->access_flags & VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT) ||
+				(dst_ref->access_flags & VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT)
+			)
+		) {
+			if (log_reason)
+				RG_DEBUG_PRINTF("Did not merge pass %s and %s because %s has a sampled read from %s, "
+					"which %s uses as an attachment.\n",
+					src_pass->name, dst_pass->name, src_pass->name, image->name, dst_pass->name);
+			return false;
+		}
+
 		// if (dst_ref->load_op == VK_ATTACHMENT_LOAD_OP_CLEAR) {
 		// 	if (log_reason)
 		// 		RG_DEBUG_PRINTF("Did not merge pass %s and %s because %s has a clear on %s, "
@@ -650,37 +1047,749 @@ static void rg_impl_build_merge_passes(struct rg_graph *graph) {
 				big_pass = src_pass;
 			}
 
-			small_pass->image_refs_own = realloc(
-				small_pass->image_refs_own,
-				sizeof(*small_pass->image_refs_own) *
-					big_pass->image_ref_count
-			);
-			for (uint32_t j = small_pass->image_ref_count; j < big_pass->image_ref_count; ++j) {
-				small_pass->image_refs_own[j] = big_pass->image_refs_own[j];
+			// The passes already merged with src_pass have its refs, so they grow with it.
+			for (uint32_t k = small_pass == src_pass ? i - 1 : i;; --k) {
+				struct rg_pass *pass = &graph->passes_own[k];
+				pass->image_refs_own = realloc(
+					pass->image_refs_own,
+					sizeof(*pass->image_refs_own) *
+						big_pass->image_ref_count
+				);
+				for (uint32_t j = pass->image_ref_count; j < big_pass->image_ref_count; ++j) {
+					pass->image_refs_own[j] = big_pass->image_refs_own[j];
+				}
+				pass->image_ref_count = big_pass->image_ref_count;
+				if (small_pass == dst_pass || !pass->merged_with_prev) break;
 			}
-			small_pass->image_ref_count = big_pass->image_ref_count;
+		}
+
+		// The whole group renders with the same attachments.
+		for (uint32_t k = i - 1; graph->passes_own[k].merged_with_prev; --k) {
+			struct rg_pass *pass = &graph->passes_own[k - 1];
+			pass->color_attachment_count = color_attachment_count;
+			memcpy(pass->color_attachments, color_attachments, sizeof(color_attachments));
+			pass->has_depth_attachment = src_pass->has_depth_attachment;
+			pass->depth_attachment = src_pass->depth_attachment;
 		}
 
 		src_pass->merged_with_next = true;
 		dst_pass->merged_with_prev = true;
 
 		// Pass on the local_read layout to the all of the merged passes.
-		for (uint32_t k = i; k >= 0 && graph->passes_own[k].merged_with_prev; --k) {
-			struct rg_pass *a_pass = &graph->passes_own[k];
-			struct rg_pass *b_pass = &graph->passes_own[k - 1];
-			if (!a_pass->merged_with_prev) break;
-			RG_CHECK(a_pass->image_ref_count == b_pass->image_ref_count, "hrmmm");
-		
-			for (uint32_t j = 0; j < a_pass->image_ref_count; ++j) {
-				bool a_is_input = a_pass->image_refs_own[j].access_flags
-					& VK_ACCESS_2_INPUT_ATTACHMENT_READ_BIT;
-				bool b_is_input = b_pass->image_refs_own[j].access_flags
-					& VK_ACCESS_2_INPUT_ATTACHMENT_READ_BIT;
-				if (a_is_input || b_is_input) {
-					a_pass->image_refs_own[j].initial_layout = VK_IMAGE_LAYOUT_RENDERING_LOCAL_READ;
-					a_pass->image_refs_own[j].final_layout = VK_IMAGE_LAYOUT_RENDERING_LOCAL_READ;
-					b_pass->image_refs_own[j].initial_layout = VK_IMAGE_LAYOUT_RENDERING_LOCAL_READ;
-					b_pass->image_refs_own[j].final_layout = VK_IMAGE_LAYOUT_RENDERING_LOCAL_READ;
+		uint32_t first = i;
+		while (graph->passes_own[first].merged_with_prev) --first;
+		for (uint32_t k = first; k < i; ++k)
+			RG_CHECK(graph->passes_own[k].image_ref_count == dst_pass->image_ref_count, "hrmmm");
+		for (uint32_t j = 0; j < dst_pass->image_ref_count; ++j) {
+			bool is_input = false;
+			for (uint32_t k = first; k <= i; ++k)
+				is_input = is_input || (graph->passes_own[k].image_refs_own[j].access_flags
+					& VK_ACCESS_2_INPUT_ATTACHMENT_READ_BIT);
+			if (!is_input) continue;
+			for (uint32_t k = first; k <= i; ++k) {
+				graph->passes_own[k].image_refs_own[j].initial_layout = VK_IMAGE_LAYOUT_RENDERING_LOCAL_READ;
+				graph->passes_own[k].image_refs_own[j].final_layout = VK_IMAGE_LAYOUT_RENDERING_LOCAL_READ;
+			}
+		}
+	}
+}
+
+/// Place the images with `rg_graph_image_spec::memory_requirements` in heaps: the biggest first,
+/// each at the lowest offset where it doesn't overlap the images used at the same time.
+static void rg_impl_build_memory_plan(const struct rg_graph_spec *spec, struct rg_graph *graph) {
+	// The lifetimes. A merged pass renders with the whole group's attachments, so they're widened to the group.
+	for (uint32_t i = 0; i < graph->image_count; ++i) {
+		struct rg_graph_image *image = &graph->images_own[i];
+		image->first_pass = UINT32_MAX;
+		image->last_pass = 0;
+		image->queue_mask = 0;
+		for (uint32_t j = 0; j < graph->pass_count; ++j) {
+			struct rg_pass *pass = &graph->passes_own[j];
+			for (uint32_t k = 0; k < pass->image_ref_count; ++k) {
+				if (pass->image_refs_own[k].image_index != i) continue;
+				if (image->first_pass == UINT32_MAX) image->first_pass = j;
+				image->last_pass = j;
+				image->queue_mask |= 1u << pass->queue;
+				break;
+			}
+		}
+		// an unused image doesn't share its memory with anything.
+		if (image->first_pass == UINT32_MAX) {
+			image->first_pass = 0;
+			image->last_pass = graph->pass_count > 0 ? graph->pass_count - 1 : 0;
+			continue;
+		}
+		while (image->first_pass > 0 && graph->passes_own[image->first_pass].merged_with_prev)
+			image->first_pass -= 1;
+		while (image->last_pass + 1 < graph->pass_count && graph->passes_own[image->last_pass].merged_with_next)
+			image->last_pass += 1;
+	}
+
+	uint32_t placed_count = 0;
+	uint32_t *placed = calloc(graph->image_count + 1, sizeof(*placed));
+	graph->unaliased_memory_size = 0;
+	for (uint32_t i = 0; i < graph->image_count; ++i) {
+		if (spec->images[i].memory_requirements.size == 0) continue;
+		RG_CHECK(!graph->images_own[i].persistent, "a persistent image can't share its memory");
+		graph->unaliased_memory_size += spec->images[i].memory_requirements.size;
+		placed[placed_count++] = i;
+	}
+	for (uint32_t i = 1; i < placed_count; ++i) {
+		for (uint32_t j = i; j > 0 && spec->images[placed[j - 1]].memory_requirements.size
+			< spec->images[placed[j]].memory_requirements.size; --j) {
+			uint32_t t = placed[j]; placed[j] = placed[j - 1]; placed[j - 1] = t;
+		}
+	}
+
+	graph->memory_heap_count = 0;
+	graph->memory_heaps_own = calloc(placed_count + 1, sizeof(*graph->memory_heaps_own));
+	for (uint32_t i = 0; i < placed_count; ++i) {
+		struct rg_graph_image *image = &graph->images_own[placed[i]];
+		const VkMemoryRequirements *req = &spec->images[placed[i]].memory_requirements;
+		// a new heap if none of the existing ones have a memory type the image can use.
+		for (uint32_t h = 0; h <= graph->memory_heap_count; ++h) {
+			if (h == graph->memory_heap_count) {
+				graph->memory_heaps_own[graph->memory_heap_count++] = (struct rg_memory_heap){
+					.alignment = 1,
+					.memory_type_bits = req->memoryTypeBits,
+				};
+			}
+			struct rg_memory_heap *heap = &graph->memory_heaps_own[h];
+			if ((heap->memory_type_bits & req->memoryTypeBits) == 0) continue;
+			// move past the images in the way until none are, the offset only grows so this ends.
+			VkDeviceSize offset = 0;
+			for (bool moved = true; moved;) {
+				moved = false;
+				for (uint32_t j = 0; j < i; ++j) {
+					struct rg_graph_image *other = &graph->images_own[placed[j]];
+					if (other->memory_heap != h) continue;
+					// the next frame could start on one queue while the other is still using the memory.
+					bool one_queue = (image->queue_mask | other->queue_mask) == image->queue_mask
+						&& (image->queue_mask & (image->queue_mask - 1)) == 0;
+					if (one_queue && (other->last_pass < image->first_pass || image->last_pass < other->first_pass))
+						continue;
+					if (other->memory_offset + other->memory_size <= offset) continue;
+					if (offset + req->size <= other->memory_offset) continue;
+					offset = (other->memory_offset + other->memory_size + req->alignment - 1)
+						/ req->alignment * req->alignment;
+					moved = true;
+				}
+			}
+			image->memory_heap = h;
+			image->memory_offset = offset;
+			image->memory_size = req->size;
+			heap->memory_type_bits &= req->memoryTypeBits;
+			if (heap->alignment < req->alignment) heap->alignment = req->alignment;
+			if (heap->size < offset + req->size) heap->size = offset + req->size;
+			break;
+		}
+	}
+	graph->aliased_memory_size = 0;
+	for (uint32_t h = 0; h < graph->memory_heap_count; ++h)
+		graph->aliased_memory_size += graph->memory_heaps_own[h].size;
+
+	// The images in the same memory earlier in the frame must be done with it before it's discarded.
+	// They're on the same queue, see above.
+	for (uint32_t i = 0; i < placed_count; ++i) {
+		struct rg_graph_image *image = &graph->images_own[placed[i]];
+		image->aliases_prev = false;
+		image->alias_src_stage_flags = VK_PIPELINE_STAGE_2_NONE;
+		image->alias_src_access_flags = VK_ACCESS_2_NONE;
+		for (uint32_t j = 0; j < placed_count; ++j) {
+			struct rg_graph_image *other = &graph->images_own[placed[j]];
+			if (j == i || other->memory_heap != image->memory_heap) continue;
+			if (other->last_pass >= image->first_pass) continue;
+			if (other->memory_offset + other->memory_size <= image->memory_offset) continue;
+			if (image->memory_offset + image->memory_size <= other->memory_offset) continue;
+			image->aliases_prev = true;
+			image->alias_src_stage_flags |= other->last_use_ref.stage_flags;
+			image->alias_src_access_flags |= other->last_use_ref.access_flags;
+		}
+	}
+	free(placed);
+}
+
+/// Whether the use changes the contents of the image.
+static bool rg_i_ref_writes(const struct rg_image_ref *ref) {
+	return ref->access_flags & (
+		VK_ACCESS_2_SHADER_WRITE_BIT |
+		VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT |
+		VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT |
+		VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+		VK_ACCESS_2_TRANSFER_WRITE_BIT |
+		VK_ACCESS_2_HOST_WRITE_BIT |
+		VK_ACCESS_2_MEMORY_WRITE_BIT
+	);
+}
+
+static void rg_i_push_edge(
+	uint32_t from,
+	uint32_t to,
+	uint32_t *count,
+	uint32_t *capacity,
+	uint32_t (**edges)[2]
+) {
+	if (from == to) return;
+	if (*count == *capacity) {
+		*capacity = *capacity * 2 + 16;
+		*edges = realloc(*edges, *capacity * sizeof(**edges));
+	}
+	(*edges)[*count][0] = from;
+	(*edges)[*count][1] = to;
+	*count += 1;
+}
+
+/// Order the `alive_count` passes in `alive` (in the specified order) into `order`.
+/// A pass depends on the passes before it that write an image it uses, or use an image it writes.
+/// Out of the passes whose dependencies are already scheduled, the one whose dependencies were
+/// scheduled the earliest goes next, so the passes that use an image go as late as they can.
+static void rg_impl_reorder_passes(
+	const struct rg_graph_spec *spec,
+	struct rg_graph *graph,
+	uint32_t alive_count,
+	const uint32_t *alive,
+	uint32_t *order
+) {
+	// Passes that can be merged are scheduled together, as a unit of consecutive `alive` passes.
+	uint32_t unit_count = 0;
+	uint32_t *unit_of = calloc(alive_count + 1, sizeof(*unit_of));
+	uint32_t *unit_first = calloc(alive_count + 1, sizeof(*unit_first));
+	for (uint32_t k = 0; k < alive_count; ++k) {
+		if (k == 0 || !rg_impl_can_merge(graph, alive[k - 1], alive[k], false))
+			unit_first[unit_count++] = k;
+		unit_of[k] = unit_count - 1;
+	}
+	unit_first[unit_count] = alive_count;
+
+	uint32_t edge_count = 0, edge_capacity = 0;
+	uint32_t (*edges)[2] = nullptr;
+	uint32_t *readers = calloc(alive_count + 1, sizeof(*readers));
+	for (uint32_t i = 0; i < graph->image_count + 1; ++i) {
+		uint32_t image_index = i == graph->image_count ? UINT32_MAX : i;
+		uint32_t writer = UINT32_MAX, reader_count = 0;
+		for (uint32_t k = 0; k < alive_count; ++k) {
+			struct rg_pass *pass = &graph->passes_own[alive[k]];
+			for (uint32_t j = 0; j < pass->image_ref_count; ++j) {
+				struct rg_image_ref *ref = &pass->image_refs_own[j];
+				if (ref->image_index != image_index) continue;
+				if (writer != UINT32_MAX)
+					rg_i_push_edge(writer, unit_of[k], &edge_count, &edge_capacity, &edges);
+				if (rg_i_ref_writes(ref)) {
+					for (uint32_t r = 0; r < reader_count; ++r)
+						rg_i_push_edge(readers[r], unit_of[k], &edge_count, &edge_capacity, &edges);
+					reader_count = 0;
+					writer = unit_of[k];
+				} else {
+					readers[reader_count++] = unit_of[k];
+				}
+				break;
+			}
+		}
+	}
+	// Nothing moves across a pass with side effects: it depends on everything since the previous one,
+	// and everything after depends on it.
+	for (uint32_t k = 0, fence = UINT32_MAX, since = 0; k < alive_count; ++k) {
+		if (spec->passes[graph->passes_own[alive[k]].spec_index].side_effects) {
+			for (uint32_t l = since; l < k; ++l)
+				rg_i_push_edge(unit_of[l], unit_of[k], &edge_count, &edge_capacity, &edges);
+			if (fence != UINT32_MAX)
+				rg_i_push_edge(fence, unit_of[k], &edge_count, &edge_capacity, &edges);
+			fence = unit_of[k];
+			since = k + 1;
+		} else if (fence != UINT32_MAX) {
+			rg_i_push_edge(fence, unit_of[k], &edge_count, &edge_capacity, &edges);
+		}
+	}
+
+	// The dependents of each unit, and how many dependencies are left.
+	uint32_t *dependency_count = calloc(unit_count + 1, sizeof(*dependency_count));
+	uint32_t *dependents_first = calloc(unit_count + 2, sizeof(*dependents_first));
+	uint32_t *dependents = calloc(edge_count + 1, sizeof(*dependents));
+	for (uint32_t e = 0; e < edge_count; ++e) {
+		dependency_count[edges[e][1]] += 1;
+		dependents_first[edges[e][0] + 2] += 1;
+	}
+	for (uint32_t u = 2; u < unit_count + 2; ++u) dependents_first[u] += dependents_first[u - 1];
+	for (uint32_t e = 0; e < edge_count; ++e)
+		dependents[dependents_first[edges[e][0] + 1]++] = edges[e][1];
+
+	// The position after the last scheduled dependency.
+	uint32_t *ready_after = calloc(unit_count + 1, sizeof(*ready_after));
+	uint32_t *ready = calloc(unit_count + 1, sizeof(*ready));
+	uint32_t ready_count = 0;
+	for (uint32_t u = 0; u < unit_count; ++u)
+		if (dependency_count[u] == 0) ready[ready_count++] = u;
+	uint32_t position = 0;
+	while (ready_count > 0) {
+		uint32_t best = 0;
+		for (uint32_t r = 1; r < ready_count; ++r) {
+			// the ties go in the specified order.
+			if (ready_after[ready[r]] < ready_after[ready[best]]
+				|| (ready_after[ready[r]] == ready_after[ready[best]] && ready[r] < ready[best]))
+				best = r;
+		}
+		uint32_t u = ready[best];
+		ready[best] = ready[--ready_count];
+		for (uint32_t k = unit_first[u]; k < unit_first[u + 1]; ++k) order[position++] = alive[k];
+		for (uint32_t e = dependents_first[u]; e < dependents_first[u + 1]; ++e) {
+			uint32_t v = dependents[e];
+			if (ready_after[v] < position) ready_after[v] = position;
+			if (--dependency_count[v] == 0) ready[ready_count++] = v;
+		}
+	}
+	RG_CHECK(position == alive_count, "the passes depend on each other in a cycle");
+
+	free(ready);
+	free(ready_after);
+	free(dependents);
+	free(dependents_first);
+	free(dependency_count);
+	free(readers);
+	free(edges);
+	free(unit_first);
+	free(unit_of);
+}
+
+/// Cull the passes nothing needs (`rg_graph_spec::cull_passes`) and order the rest
+/// (`rg_graph_spec::reorder_passes`), then move them to their places in `rg_graph::passes_own`
+/// and `rg_graph::culled_passes_own`.
+static void rg_impl_schedule_passes(const struct rg_graph_spec *spec, struct rg_graph *graph) {
+	uint32_t pass_count = graph->pass_count;
+	bool *culled = calloc(pass_count + 1, sizeof(*culled));
+	// Whether a pass after the current one reads what's in the image (the last one is the swapchain).
+	bool *needed = calloc(graph->image_count + 1, sizeof(*needed));
+	uint32_t alive_count = 0;
+	for (uint32_t i = pass_count; i --> 0;) {
+		struct rg_pass *pass = &graph->passes_own[i];
+		bool keep = !spec->cull_passes || spec->passes[i].side_effects;
+		for (uint32_t j = 0; j < pass->image_ref_count && !keep; ++j) {
+			struct rg_image_ref *ref = &pass->image_refs_own[j];
+			if (!rg_i_ref_writes(ref)) continue;
+			keep = ref->image_index == UINT32_MAX
+				|| graph->images_own[ref->image_index].persistent
+				|| needed[ref->image_index];
+		}
+		if (!keep) {
+			RG_DEBUG_PRINTF("Culled pass %s, nothing uses what it writes.\n", pass->name);
+			culled[i] = true;
+			continue;
+		}
+		alive_count += 1;
+		// A clear doesn't need what the passes before it wrote.
+		for (uint32_t j = 0; j < pass->image_ref_count; ++j) {
+			struct rg_image_ref *ref = &pass->image_refs_own[j];
+			uint32_t image = ref->image_index == UINT32_MAX ? graph->image_count : ref->image_index;
+			needed[image] = ref->load_op == VK_ATTACHMENT_LOAD_OP_LOAD;
+		}
+	}
+
+	uint32_t *alive = calloc(alive_count + 1, sizeof(*alive));
+	for (uint32_t i = 0, k = 0; i < pass_count; ++i)
+		if (!culled[i]) alive[k++] = i;
+	uint32_t *order = calloc(alive_count + 1, sizeof(*order));
+	if (spec->reorder_passes) {
+		rg_impl_reorder_passes(spec, graph, alive_count, alive, order);
+	} else {
+		memcpy(order, alive, alive_count * sizeof(*order));
+	}
+
+	struct rg_pass *passes = calloc(alive_count + 1, sizeof(*passes));
+	graph->culled_pass_count = pass_count - alive_count;
+	graph->culled_passes_own = calloc(graph->culled_pass_count + 1, sizeof(*graph->culled_passes_own));
+	graph->spec_pass_count = pass_count;
+	graph->spec_passes_own = calloc(pass_count + 1, sizeof(*graph->spec_passes_own));
+	for (uint32_t k = 0; k < alive_count; ++k) {
+		if (order[k] != alive[k])
+			RG_DEBUG_PRINTF("Moved pass %s to %u.\n", graph->passes_own[order[k]].name, k);
+		passes[k] = graph->passes_own[order[k]];
+		graph->spec_passes_own[order[k]] = &passes[k];
+	}
+	for (uint32_t i = 0, k = 0; i < pass_count; ++i) {
+		if (!culled[i]) continue;
+		graph->culled_passes_own[k] = graph->passes_own[i];
+		graph->culled_passes_own[k].culled = true;
+		graph->spec_passes_own[i] = &graph->culled_passes_own[k++];
+	}
+	free(graph->passes_own);
+	graph->passes_own = passes;
+	graph->pass_count = alive_count;
+
+	free(order);
+	free(alive);
+	free(needed);
+	free(culled);
+}
+
+/// The barrier from a use of an image (`ref`, in pass `pass - 1`, or the image's last use if `pass` is 0,
+/// for the frame start) to its next use, which is put in `next_use`. If the next use is on another
+/// queue, this is the release half of the ownership transfer, the acquire is before the next use.
+/// The last pass the image is used in, `UINT32_MAX` if it isn't.
+static uint32_t rg_i_last_use_pass(const struct rg_graph_image *image) {
+	uint32_t last = UINT32_MAX;
+	for (uint32_t use = image->pass_use_map_own[0].pass_index; use != UINT32_MAX;
+		use = image->pass_use_map_own[use + 1].pass_index) last = use;
+	return last;
+}
+
+static bool rg_i_next_use_barrier(
+	struct rg_graph *graph,
+	uint32_t pass,
+	const struct rg_image_ref *ref,
+	struct rg_barrier *barrier,
+	struct rg_graph_image_use *next_use
+) {
+	struct rg_graph_image *image = ref->image_index == UINT32_MAX
+		? &graph->current.swapchain_image
+		: &graph->images_own[ref->image_index];
+
+	*next_use = image->pass_use_map_own[pass];
+	if (next_use->pass_index == UINT32_MAX) return false;
+
+	struct rg_pass *dst_pass = &graph->passes_own[next_use->pass_index];
+	struct rg_image_ref *dst_ref = &dst_pass->image_refs_own[next_use->ref_index];
+
+	RG_CHECK(dst_ref->image_index == ref->image_index, "invalid image pass use data");
+
+	// discarded at its first pass instead, see `rg_impl_build_barrier_plan`.
+	if (pass == 0 && image->aliases_prev) return false;
+	enum rg_queue src_queue = pass == 0 ? dst_pass->queue : graph->passes_own[pass - 1].queue;
+	bool release = src_queue != dst_pass->queue;
+
+	*barrier = (struct rg_barrier){
+		.image_index = ref->image_index,
+		.old_layout = ref->final_layout,
+		.new_layout = dst_ref->initial_layout,
+		.src_stage_flags = ref->stage_flags,
+		.src_access_flags = ref->access_flags,
+		.dst_stage_flags = release ? VK_PIPELINE_STAGE_2_NONE : dst_ref->stage_flags,
+		.dst_access_flags = release ? VK_ACCESS_2_NONE : dst_ref->access_flags,
+		.src_queue = src_queue,
+		.dst_queue = dst_pass->queue,
+	};
+
+	// The last frame's last use of a placed image's memory may have been by another image.
+	if (pass == 0 && image->memory_heap != UINT32_MAX) {
+		barrier->src_stage_flags = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+		barrier->src_access_flags = VK_ACCESS_2_MEMORY_WRITE_BIT;
+	}
+
+	// The last use's stages may be graphics ones, which the compute queue doesn't have.
+	if (pass == 0 && dst_pass->queue != RG_QUEUE_MAIN) {
+		barrier->src_stage_flags = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+		barrier->src_access_flags = VK_ACCESS_2_NONE;
+	}
+
+	// The last frame's last use on the other queue is waited for with a semaphore at the first use's
+	// stages (see `rg_segment::frame_wait_stage_flags`), which also makes its writes visible.
+	if (pass == 0 && graph->passes_own[rg_i_last_use_pass(image)].queue != dst_pass->queue) {
+		barrier->src_stage_flags = dst_ref->stage_flags;
+		barrier->src_access_flags = VK_ACCESS_2_NONE;
+	}
+	return true;
+}
+
+static void rg_i_plan_push_barrier(struct rg_graph *graph, uint32_t *capacity, const struct rg_barrier *barrier) {
+	if (graph->barrier_count == *capacity) {
+		*capacity = *capacity * 2 + 16;
+		graph->barriers_own = realloc(graph->barriers_own, *capacity * sizeof(*graph->barriers_own));
+	}
+	graph->barriers_own[graph->barrier_count++] = *barrier;
+}
+
+/// Add a batch of the barriers from `first_barrier` to the last one, if there are any.
+static void rg_i_plan_push_batch(
+	struct rg_graph *graph,
+	uint32_t *capacity,
+	enum rg_barrier_batch_kind kind,
+	uint32_t event,
+	uint32_t first_barrier,
+	uint32_t barrier_count
+) {
+	if (barrier_count == 0) return;
+	if (graph->barrier_batch_count == *capacity) {
+		*capacity = *capacity * 2 + 16;
+		graph->barrier_batches_own = realloc(graph->barrier_batches_own,
+			*capacity * sizeof(*graph->barrier_batches_own));
+	}
+	graph->barrier_batches_own[graph->barrier_batch_count++] = (struct rg_barrier_batch){
+		.kind = kind,
+		.event = event,
+		.first_barrier = first_barrier,
+		.barrier_count = barrier_count,
+	};
+}
+
+/// Plan the barriers of a frame, see `rg_graph::barrier_batches_own`.
+/// - When a segment begins: the images first used in it, from their last use (or discarded).
+/// - Before a pass: the images acquired from another queue, and the placed images that take over
+///   the memory of another one (see `rg_graph_image::aliases_prev`), then the waits for split barriers.
+/// - After a pass: the images used again in the next passes. Merged passes render together, so
+///   only the input attachments (and the writes after them) need a barrier between them, the rest
+///   wait for the rendering to end.
+///   An image next used a few passes later on the same queue gets a split barrier.
+static void rg_impl_build_barrier_plan(struct rg_graph *graph) {
+	uint32_t barrier_capacity = 0, batch_capacity = 0;
+	graph->barrier_count = 0;
+	graph->barrier_batch_count = 0;
+	graph->barriers_own = nullptr;
+	graph->barrier_batches_own = nullptr;
+	graph->event_count = 0;
+
+	// The pass each event is waited for before, and the batch that sets it.
+	uint32_t event_capacity = 0;
+	struct { uint32_t wait_pass, batch; } *events = nullptr;
+	// The barriers after the passes merged with the next ones, until the rendering ends.
+	uint32_t pending_count = 0, pending_capacity = 1;
+	for (uint32_t p = 0; p < graph->pass_count; ++p) pending_capacity += graph->passes_own[p].image_ref_count;
+	struct { struct rg_barrier barrier; uint32_t next_pass; } *pending = calloc(pending_capacity, sizeof(*pending));
+
+	for (uint32_t p = 0; p < graph->pass_count; ++p) {
+		struct rg_pass *pass = &graph->passes_own[p];
+		struct rg_segment *segment = &graph->segments_own[pass->segment];
+
+		if (segment->first_pass == p) {
+			segment->start_batches.first = graph->barrier_batch_count;
+			uint32_t first_barrier = graph->barrier_count;
+			for (uint32_t i = 0; i < graph->image_count + 1; ++i) {
+				struct rg_graph_image *image = i != graph->image_count
+					? &graph->images_own[i]
+					: &graph->current.swapchain_image;
+				struct rg_barrier barrier;
+				struct rg_graph_image_use next_use;
+				if (!rg_i_next_use_barrier(graph, 0, &image->last_use_ref, &barrier, &next_use)) continue;
+				if (graph->passes_own[next_use.pass_index].segment != pass->segment) continue;
+				rg_i_plan_push_barrier(graph, &barrier_capacity, &barrier);
+			}
+			rg_i_plan_push_batch(graph, &batch_capacity, RG_BARRIER_BATCH_PIPELINE, 0,
+				first_barrier, graph->barrier_count - first_barrier);
+			segment->start_batches.count = graph->barrier_batch_count - segment->start_batches.first;
+		}
+
+		pass->begin_batches.first = graph->barrier_batch_count;
+		if (!pass->merged_with_prev) {
+			uint32_t first_barrier = graph->barrier_count;
+			for (uint32_t i = 0; i < pass->image_ref_count; ++i) {
+				struct rg_image_ref *ref = &pass->image_refs_own[i];
+				struct rg_graph_image_use prev_use = ref->prev_use;
+				if (prev_use.pass_index == UINT32_MAX) continue;
+				struct rg_pass *src_pass = &graph->passes_own[prev_use.pass_index];
+				if (src_pass->queue == pass->queue) continue;
+				struct rg_image_ref *src_ref = &src_pass->image_refs_own[prev_use.ref_index];
+				rg_i_plan_push_barrier(graph, &barrier_capacity, &(struct rg_barrier){
+					.image_index = ref->image_index,
+					// the same layouts as the release.
+					.old_layout = src_ref->final_layout,
+					.new_layout = ref->initial_layout,
+					// after the semaphore wait of this segment's submission.
+					.src_stage_flags = ref->stage_flags,
+					.src_access_flags = VK_ACCESS_2_NONE,
+					.dst_stage_flags = ref->stage_flags,
+					.dst_access_flags = ref->access_flags,
+					.src_queue = src_pass->queue,
+					.dst_queue = pass->queue,
+				});
+			}
+			for (uint32_t i = 0; i < graph->image_count; ++i) {
+				struct rg_graph_image *image = &graph->images_own[i];
+				if (!image->aliases_prev || image->first_pass != p) continue;
+				struct rg_graph_image_use first_use = image->pass_use_map_own[0];
+				struct rg_image_ref *dst_ref = &graph->passes_own[first_use.pass_index].image_refs_own[first_use.ref_index];
+				rg_i_plan_push_barrier(graph, &barrier_capacity, &(struct rg_barrier){
+					.image_index = i,
+					.old_layout = VK_IMAGE_LAYOUT_UNDEFINED,
+					.new_layout = dst_ref->initial_layout,
+					.src_stage_flags = image->alias_src_stage_flags,
+					.src_access_flags = image->alias_src_access_flags,
+					.dst_stage_flags = dst_ref->stage_flags,
+					.dst_access_flags = dst_ref->access_flags,
+					.src_queue = pass->queue,
+					.dst_queue = pass->queue,
+				});
+			}
+			rg_i_plan_push_batch(graph, &batch_capacity, RG_BARRIER_BATCH_PIPELINE, 0,
+				first_barrier, graph->barrier_count - first_barrier);
+			for (uint32_t e = 0; e < graph->event_count; ++e) {
+				if (events[e].wait_pass != p) continue;
+				struct rg_barrier_batch set = graph->barrier_batches_own[events[e].batch];
+				rg_i_plan_push_batch(graph, &batch_capacity, RG_BARRIER_BATCH_WAIT_EVENT, e,
+					set.first_barrier, set.barrier_count);
+			}
+		}
+		pass->begin_batches.count = graph->barrier_batch_count - pass->begin_batches.first;
+
+		pass->end_batches.first = graph->barrier_batch_count;
+		uint32_t group_end = p;
+		while (graph->passes_own[group_end].merged_with_next) group_end += 1;
+		uint32_t first_barrier = graph->barrier_count;
+		for (uint32_t i = 0; i < pass->image_ref_count; ++i) {
+			struct rg_barrier barrier;
+			struct rg_graph_image_use next_use;
+			if (!rg_i_next_use_barrier(graph, p + 1, &pass->image_refs_own[i], &barrier, &next_use)) continue;
+			if (next_use.pass_index <= group_end) {
+				// in the same rendering, the attachments are in order anyway,
+				// but the input attachment reads aren't.
+				if ((barrier.src_access_flags | barrier.dst_access_flags) & VK_ACCESS_2_INPUT_ATTACHMENT_READ_BIT)
+					rg_i_plan_push_barrier(graph, &barrier_capacity, &barrier);
+				continue;
+			}
+			pending[pending_count].barrier = barrier;
+			pending[pending_count++].next_pass = next_use.pass_index;
+		}
+		rg_i_plan_push_batch(graph, &batch_capacity,
+			pass->merged_with_next ? RG_BARRIER_BATCH_BY_REGION : RG_BARRIER_BATCH_PIPELINE, 0,
+			first_barrier, graph->barrier_count - first_barrier);
+
+		if (!pass->merged_with_next) {
+			// The barriers to the next pass, or to another queue, now.
+			first_barrier = graph->barrier_count;
+			for (uint32_t i = 0; i < pending_count; ++i) {
+				struct rg_pass *next_pass = &graph->passes_own[pending[i].next_pass];
+				bool split = pending[i].next_pass > p + 1 && next_pass->segment == pass->segment
+					&& !next_pass->merged_with_prev;
+				if (split) continue;
+				rg_i_plan_push_barrier(graph, &barrier_capacity, &pending[i].barrier);
+				pending[i].next_pass = UINT32_MAX;
+			}
+			rg_i_plan_push_batch(graph, &batch_capacity, RG_BARRIER_BATCH_PIPELINE, 0,
+				first_barrier, graph->barrier_count - first_barrier);
+
+			// The rest are split, with an event for each pass they're waited for before.
+			for (;;) {
+				uint32_t wait_pass = UINT32_MAX;
+				for (uint32_t i = 0; i < pending_count; ++i)
+					if (pending[i].next_pass < wait_pass) wait_pass = pending[i].next_pass;
+				if (wait_pass == UINT32_MAX) break;
+				first_barrier = graph->barrier_count;
+				for (uint32_t i = 0; i < pending_count; ++i) {
+					if (pending[i].next_pass != wait_pass) continue;
+					rg_i_plan_push_barrier(graph, &barrier_capacity, &pending[i].barrier);
+					pending[i].next_pass = UINT32_MAX;
+				}
+				if (graph->event_count == event_capacity) {
+					event_capacity = event_capacity * 2 + 8;
+					events = realloc(events, event_capacity * sizeof(*events));
+				}
+				events[graph->event_count].wait_pass = wait_pass;
+				events[graph->event_count].batch = graph->barrier_batch_count;
+				rg_i_plan_push_batch(graph, &batch_capacity, RG_BARRIER_BATCH_SET_EVENT, graph->event_count++,
+					first_barrier, graph->barrier_count - first_barrier);
+			}
+			pending_count = 0;
+		}
+		pass->end_batches.count = graph->barrier_batch_count - pass->end_batches.first;
+	}
+	free(pending);
+	free(events);
+
+	// Everything but the swapchain image and the queue families, which are set each frame.
+	graph->current.vk_barriers_own = calloc(graph->barrier_count + 1, sizeof(*graph->current.vk_barriers_own));
+	for (uint32_t i = 0; i < graph->barrier_count; ++i) {
+		struct rg_barrier *barrier = &graph->barriers_own[i];
+		struct rg_graph_image *image = barrier->image_index == UINT32_MAX
+			? &graph->current.swapchain_image
+			: &graph->images_own[barrier->image_index];
+		graph->current.vk_barriers_own[i] = (VkImageMemoryBarrier2){
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+			.image = image->image,
+			.oldLayout = barrier->old_layout,
+			.newLayout = barrier->new_layout,
+			.srcStageMask = barrier->src_stage_flags,
+			.srcAccessMask = barrier->src_access_flags,
+			.dstStageMask = barrier->dst_stage_flags,
+			.dstAccessMask = barrier->dst_access_flags,
+			.subresourceRange = {
+				.aspectMask = image->aspect,
+				.baseArrayLayer = 0,
+				// nor the layers.
+				.layerCount = VK_REMAINING_ARRAY_LAYERS,
+				.baseMipLevel = 0,
+				// the graph doesn't track the mips separately.
+				.levelCount = VK_REMAINING_MIP_LEVELS,
+			},
+		};
+	}
+}
+
+/// The semaphore waits of the segments' submissions, see `rg_segment::wait_segment`.
+static void rg_impl_build_segment_waits(struct rg_graph *graph) {
+	for (uint32_t s = 0; s < graph->segment_count; ++s) {
+		struct rg_segment *segment = &graph->segments_own[s];
+		segment->wait_segment = UINT32_MAX;
+		segment->wait_stage_flags = VK_PIPELINE_STAGE_2_NONE;
+		segment->frame_wait_stage_flags = VK_PIPELINE_STAGE_2_NONE;
+		segment->swapchain_stage_flags = VK_PIPELINE_STAGE_2_NONE;
+	}
+
+	// The acquires, the same ones as in `rg_impl_build_barrier_plan`. The timeline only goes up,
+	// so waiting for the last of the segments they're released in waits for all of them.
+	for (uint32_t p = 0; p < graph->pass_count; ++p) {
+		struct rg_pass *pass = &graph->passes_own[p];
+		if (pass->merged_with_prev) continue;
+		struct rg_segment *segment = &graph->segments_own[pass->segment];
+		for (uint32_t i = 0; i < pass->image_ref_count; ++i) {
+			struct rg_image_ref *ref = &pass->image_refs_own[i];
+			if (ref->prev_use.pass_index == UINT32_MAX) continue;
+			struct rg_pass *src_pass = &graph->passes_own[ref->prev_use.pass_index];
+			if (src_pass->queue == pass->queue) continue;
+			if (segment->wait_segment == UINT32_MAX || src_pass->segment > segment->wait_segment)
+				segment->wait_segment = src_pass->segment;
+			segment->wait_stage_flags |= ref->stage_flags;
+		}
+	}
+
+	// The frame start barriers, see `rg_i_next_use_barrier`.
+	for (uint32_t i = 0; i < graph->image_count + 1; ++i) {
+		struct rg_graph_image *image = i != graph->image_count
+			? &graph->images_own[i]
+			: &graph->current.swapchain_image;
+		struct rg_graph_image_use first_use = image->pass_use_map_own[0];
+		if (first_use.pass_index == UINT32_MAX) continue;
+		struct rg_pass *pass = &graph->passes_own[first_use.pass_index];
+		struct rg_image_ref *ref = &pass->image_refs_own[first_use.ref_index];
+		struct rg_segment *segment = &graph->segments_own[pass->segment];
+		if (i == graph->image_count) {
+			// the barrier is after the last use's stages, the semaphore wait has to be before them.
+			segment->swapchain_stage_flags |= ref->stage_flags | image->last_use_ref.stage_flags;
+		} else if (graph->passes_own[rg_i_last_use_pass(image)].queue != pass->queue) {
+			segment->frame_wait_stage_flags |= ref->stage_flags;
+		}
+	}
+}
+
+/// Link each image's uses: `rg_image_ref::prev_use`, `rg_graph_image::pass_use_map_own`
+/// and `rg_graph_image::last_use_ref`. Done again after merging, which adds refs to the passes.
+static void rg_impl_build_use_maps(struct rg_graph *graph) {
+	for (size_t i = 0; i < graph->image_count + 1; ++i) {
+		uint32_t image_index = i == graph->image_count ? UINT32_MAX : i;
+		struct rg_graph_image *image = image_index == UINT32_MAX
+			? &graph->current.swapchain_image
+			: &graph->images_own[i];
+
+		free(image->pass_use_map_own);
+		image->pass_use_map_own = calloc(graph->pass_count + 1, sizeof(*image->pass_use_map_own));
+		memset(image->pass_use_map_own, 0xFF,
+			(graph->pass_count + 1) * sizeof(*image->pass_use_map_own));
+		uint32_t last_pass = 0;
+		struct rg_graph_image_use prev_use = { UINT32_MAX, UINT32_MAX };
+		image->last_use_ref = (struct rg_image_ref){ .image_index = image_index };
+		for (size_t j = 0; j < graph->pass_count; ++j) {
+			struct rg_pass *pass = &graph->passes_own[j];
+			for (size_t k = 0; k < pass->image_ref_count; ++k) {
+				struct rg_image_ref *ref = &pass->image_refs_own[k];
+				if (ref->image_index == image_index) {
+					ref->prev_use = prev_use;
+					prev_use = (struct rg_graph_image_use){ .pass_index = j, .ref_index = k };
+					image->last_use_ref.access_flags |= ref->access_flags;
+					image->last_use_ref.stage_flags |= ref->stage_flags;
+					// the frame start barrier is from the last use, so it discards the contents unless kept.
+					image->last_use_ref.final_layout = image->persistent ? ref->final_layout : VK_IMAGE_LAYOUT_UNDEFINED;
+					image->last_use_ref.initial_layout = image->persistent ? ref->initial_layout : VK_IMAGE_LAYOUT_UNDEFINED;
+					image->pass_use_map_own[last_pass] = (struct rg_graph_image_use){
+						.pass_index = j,
+						.ref_index = k,
+					};
+					last_pass = j + 1;
+					break;
 				}
 			}
 		}
@@ -698,6 +1807,8 @@ void rg_build_graph(const struct rg_graph_spec *spec, struct rg_graph *graph) {
 		graph->images_own[i].name = spec->images[i].name;
 		graph->images_own[i].format = spec->images[i].format;
 		graph->images_own[i].aspect = spec->images[i].aspect;
+		graph->images_own[i].persistent = spec->images[i].persistent;
+		graph->images_own[i].memory_heap = UINT32_MAX; // placed later in this function
 		graph->images_own[i].pass_use_map_own = nullptr; // initialized later in this function
 	}
 
@@ -707,8 +1818,18 @@ void rg_build_graph(const struct rg_graph_spec *spec, struct rg_graph *graph) {
 		const struct rg_pass_spec *pass_spec = &spec->passes[i];
 		struct rg_pass *pass = &graph->passes_own[i];
 		pass->name = pass_spec->name;
+		pass->spec_index = i;
 		pass->compute = pass_spec->compute;
+		pass->secondary = pass_spec->secondary;
+		RG_CHECK(!pass_spec->async_compute || pass_spec->compute,
+			"only compute passes can run on the async compute queue");
+		pass->queue = pass_spec->async_compute && spec->has_async_compute_queue
+			? RG_QUEUE_ASYNC_COMPUTE
+			: RG_QUEUE_MAIN;
 		pass->render_area = pass_spec->render_area;
+		RG_CHECK(!pass_spec->scaled || (!pass_spec->compute && pass_spec->render_area.extent.width == 0),
+			"only graphics passes without a render area can be scaled");
+		pass->scaled = pass_spec->scaled;
 		pass->image_ref_count = pass_spec->image_ref_count;
 		pass->image_refs_own = calloc(pass->image_ref_count, sizeof(*pass->image_refs_own));
 		pass->depth_input_attachment_index = VK_ATTACHMENT_UNUSED;
@@ -801,6 +1922,7 @@ void rg_build_graph(const struct rg_graph_spec *spec, struct rg_graph *graph) {
 					: VK_ATTACHMENT_LOAD_OP_LOAD,
 				.store_op = VK_ATTACHMENT_STORE_OP_STORE,
 				.clear = ref_spec->clear_value,
+				.prev_use = { UINT32_MAX, UINT32_MAX },
 			};
 		}
 		pass->color_attachment_count = color_attachment_count;
@@ -829,43 +1951,23 @@ void rg_build_graph(const struct rg_graph_spec *spec, struct rg_graph *graph) {
 		// }
 	}
 
+	rg_impl_schedule_passes(spec, graph);
+
 	graph->current.swapchain_image.name = "Swapchain";
 	graph->current.swapchain_image.image = VK_NULL_HANDLE;
 	graph->current.swapchain_image.image_view = VK_NULL_HANDLE;
 	graph->current.swapchain_image.aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+	graph->current.swapchain_image.persistent = false;
+	graph->current.swapchain_image.memory_heap = UINT32_MAX;
+	graph->current.swapchain_image.aliases_prev = false;
+	graph->current.swapchain_image.pass_use_map_own = nullptr;
+	graph->current.swapchain_image.format = spec->swapchain_format;
+	graph->current.queue_family_indices[RG_QUEUE_ASYNC_COMPUTE] = spec->has_async_compute_queue
+		? spec->async_compute_queue_family_index
+		: VK_QUEUE_FAMILY_IGNORED;
 
 	// Build image pass usage maps:
-
-	for (size_t i = 0; i < graph->image_count + 1; ++i) {
-		uint32_t image_index = i == graph->image_count ? UINT32_MAX : i;
-		struct rg_graph_image *image = image_index == UINT32_MAX
-			? &graph->current.swapchain_image
-			: &graph->images_own[i];
-
-		image->pass_use_map_own = calloc(graph->pass_count + 1, sizeof(*image->pass_use_map_own));
-		memset(image->pass_use_map_own, 0xFF,
-			(graph->pass_count + 1) * sizeof(*image->pass_use_map_own));
-		uint32_t last_pass = 0;
-		for (size_t j = 0; j < graph->pass_count; ++j) {
-			struct rg_pass *pass = &graph->passes_own[j];
-			for (size_t k = 0; k < pass->image_ref_count; ++k) {
-				struct rg_image_ref *ref = &pass->image_refs_own[k];
-				if (ref->image_index == image_index) {
-					image->last_use_ref.image_index = image_index;
-					image->last_use_ref.access_flags |= ref->access_flags;
-					image->last_use_ref.stage_flags |= ref->stage_flags;
-					image->last_use_ref.final_layout = VK_IMAGE_LAYOUT_UNDEFINED;
-					image->last_use_ref.initial_layout = VK_IMAGE_LAYOUT_UNDEFINED;
-					image->pass_use_map_own[last_pass] = (struct rg_graph_image_use){
-						.pass_index = j,
-						.ref_index = k,
-					};
-					last_pass = j + 1;
-					break;
-				}
-			}
-		}
-	}
+	rg_impl_build_use_maps(graph);
 
 	// Check if input attachments are valid
 	// We do it now because I think we need everyting to be
@@ -876,19 +1978,10 @@ void rg_build_graph(const struct rg_graph_spec *spec, struct rg_graph *graph) {
 		for (uint32_t j = 0; j < pass->image_ref_count; ++j) {
 			struct rg_image_ref *ref = &pass->image_refs_own[j];
 			if (ref->access_flags & VK_ACCESS_2_INPUT_ATTACHMENT_READ_BIT) {
+				// The source doesn't have to be merged with the pass: with local read, an input
+				// attachment can be read in a new rendering after a barrier too.
 				for (uint32_t k = i; k --> 0;) {
-					bool can_merge = rg_impl_can_merge(graph, k + 1, k, false);
 					struct rg_pass *src_pass = &graph->passes_own[k];
-					if (!can_merge) {
-						struct rg_graph_image *img = ref->image_index == UINT32_MAX
-							? &graph->current.swapchain_image : &graph->images_own[ref->image_index];
-						RG_DEBUG_PRINTF("Could not find source for input attachment '%s' of pass '%s'.\n",
-							img->name, pass->name);
-						RG_DEBUG_PRINTF("Can't merge passes '%s' and '%s', and did not find the attachment yet.\n",
-							graph->passes_own[k + 1].name, graph->passes_own[k].name);
-						rg_impl_can_merge(graph, k + 1, k, true); // show why didn't merge.
-						RG_CHECK(false, "Could not find source for input attachment");
-					}
 					for (uint32_t l = 0; l < src_pass->image_ref_count; ++l) {
 						struct rg_image_ref *src_ref = &src_pass->image_refs_own[l];
 						// Any usage in the source pass works.
@@ -897,20 +1990,70 @@ void rg_build_graph(const struct rg_graph_spec *spec, struct rg_graph *graph) {
 						}
 					}
 				}
+				{
+					[[maybe_unused]]
+					struct rg_graph_image *img = ref->image_index == UINT32_MAX
+						? &graph->current.swapchain_image : &graph->images_own[ref->image_index];
+					RG_DEBUG_PRINTF("Could not find source for input attachment '%s' of pass '%s'.\n",
+						img->name, pass->name);
+					RG_CHECK(false, "Could not find source for input attachment");
+				}
 			found_source:
 			}
 		}
 	}
 
 	rg_impl_build_merge_passes(graph);
+
+	// The merged passes use each other's images too, maybe in other layouts (local read).
+	rg_impl_build_use_maps(graph);
+
+	// Split the passes into segments of consecutive passes on the same queue.
+	graph->segment_count = 0;
+	graph->segments_own = calloc(graph->pass_count + 1, sizeof(*graph->segments_own));
+	for (uint32_t i = 0; i < graph->pass_count; ++i) {
+		struct rg_pass *pass = &graph->passes_own[i];
+		if (i == 0 || pass->queue != graph->passes_own[i - 1].queue) {
+			graph->segments_own[graph->segment_count++] = (struct rg_segment){
+				.queue = pass->queue,
+				.first_pass = i,
+			};
+		}
+		pass->segment = graph->segment_count - 1;
+		graph->segments_own[pass->segment].pass_count += 1;
+	}
+
+	// The attachment formats, after merging, for the inheritance info.
+	for (uint32_t i = 0; i < graph->spec_pass_count; ++i) {
+		struct rg_pass *pass = graph->spec_passes_own[i];
+		for (uint32_t j = 0; j < pass->color_attachment_count; ++j) {
+			uint32_t image_index = pass->image_refs_own[pass->color_attachments[j]].image_index;
+			pass->color_attachment_formats[j] = image_index == UINT32_MAX
+				? graph->current.swapchain_image.format
+				: graph->images_own[image_index].format;
+		}
+		pass->depth_attachment_format = pass->has_depth_attachment
+			? graph->images_own[pass->image_refs_own[pass->depth_attachment].image_index].format
+			: VK_FORMAT_UNDEFINED;
+	}
 	
+	rg_impl_build_memory_plan(spec, graph);
+	rg_impl_build_barrier_plan(graph);
+	rg_impl_build_segment_waits(graph);
+
 	graph->current.command_buffer = VK_NULL_HANDLE;
+	graph->current.events = nullptr;
+	graph->current.timestamp_pool = VK_NULL_HANDLE;
+	graph->current.statistics_pool = VK_NULL_HANDLE;
+	graph->current.scaled_render_area = (VkRect2D){};
+	graph->commands = spec->commands != nullptr ? *spec->commands : rg_vulkan_commands;
 
-#define P(...) fprintf(stdout, __VA_ARGS__)
+#define P(...) RG_DEBUG_PRINTF(__VA_ARGS__)
 	for (uint32_t i = 0; i < graph->pass_count; ++i) {
 		struct rg_pass *p = &graph->passes_own[i];
 		P("Render Pass \"%s\":\n", p->name);
 		P("  Compute: %s\n", p->compute ? "Yes" : "No");
+		P("  Queue: %s (segment %u)\n", p->queue == RG_QUEUE_ASYNC_COMPUTE ? "Async Compute" : "Main", p->segment);
 		P("  Merged with previous: %s\n", p->merged_with_prev ? "Yes" : "No");
 		P("  Merged with next:     %s\n", p->merged_with_next ? "Yes" : "No");
 		if (p->has_depth_attachment)
@@ -928,6 +2071,18 @@ void rg_build_graph(const struct rg_graph_spec *spec, struct rg_graph *graph) {
 				r->image_index == UINT32_MAX ? "Swapchain" : graph->images_own[r->image_index].name);
 		}
 	}
+	if (graph->memory_heap_count > 0) {
+		P("Memory: %llu bytes in %u heaps, %llu bytes without aliasing\n",
+			(unsigned long long)graph->aliased_memory_size, graph->memory_heap_count,
+			(unsigned long long)graph->unaliased_memory_size);
+		for (uint32_t i = 0; i < graph->image_count; ++i) {
+			struct rg_graph_image *img = &graph->images_own[i];
+			if (img->memory_heap == UINT32_MAX) continue;
+			P("  - \"%s\": heap %u, bytes %llu to %llu, passes %u to %u%s\n", img->name, img->memory_heap,
+				(unsigned long long)img->memory_offset, (unsigned long long)(img->memory_offset + img->memory_size),
+				img->first_pass, img->last_pass, img->aliases_prev ? " (aliases an earlier image)" : "");
+		}
+	}
 #undef P
 }
 
@@ -938,7 +2093,19 @@ void rg_free_graph(struct rg_graph *graph) {
 	for (size_t i = 0; i < graph->pass_count; ++i) {
 		free(graph->passes_own[i].image_refs_own);
 	}
+	for (size_t i = 0; i < graph->culled_pass_count; ++i) {
+		free(graph->culled_passes_own[i].image_refs_own);
+	}
+	free(graph->current.swapchain_image.pass_use_map_own);
+	free(graph->images_own);
 	free(graph->passes_own);
+	free(graph->culled_passes_own);
+	free(graph->spec_passes_own);
+	free(graph->segments_own);
+	free(graph->memory_heaps_own);
+	free(graph->barriers_own);
+	free(graph->barrier_batches_own);
+	free(graph->current.vk_barriers_own);
 }
 
 static inline void rg_i_debug_vkCmdPipelineBarrier2(
@@ -1002,105 +2169,248 @@ static inline void rg_i_debug_vkCmdPipelineBarrier2(
 	vkCmdPipelineBarrier2(commandBuffer, pDependencyInfo);
 }
 
-/// Increase count and write an appropriate image barrier
-/// Region image barriers are written if the count isnt a nullptr
-/// and if `dst_ref->access_flags & VK_ACCESS_2_INPUT_ATTACHMENT_READ_BIT`.
-static void rg_i_graph_impl_barriers(
+static void rg_i_vulkan_begin_rendering(struct rg_graph *graph, const VkRenderingInfo *info) {
+	vkCmdBeginRendering(graph->current.command_buffer, info);
+}
+
+static void rg_i_vulkan_end_rendering(struct rg_graph *graph) {
+	vkCmdEndRendering(graph->current.command_buffer);
+}
+
+static void rg_i_vulkan_barrier(struct rg_graph *graph, const VkDependencyInfo *info) {
+	rg_i_debug_vkCmdPipelineBarrier2(graph->current.command_buffer, info);
+}
+
+static void rg_i_vulkan_set_event(struct rg_graph *graph, VkEvent event, const VkDependencyInfo *info) {
+	vkCmdSetEvent2(graph->current.command_buffer, event, info);
+}
+
+static void rg_i_vulkan_wait_event(struct rg_graph *graph, VkEvent event, const VkDependencyInfo *info) {
+	vkCmdWaitEvents2(graph->current.command_buffer, 1, &event, info);
+}
+
+static void rg_i_vulkan_set_input_attachment_indices(
 	struct rg_graph *graph,
-	uint32_t pass,
-	struct rg_image_ref *ref,
-	uint32_t *image_barrier_count,
-	VkImageMemoryBarrier2 *image_barriers,
-	uint32_t *region_image_barrier_count,
-	VkImageMemoryBarrier2 *region_image_barriers
+	const VkRenderingInputAttachmentIndexInfo *info
 ) {
+	vkCmdSetRenderingInputAttachmentIndices(graph->current.command_buffer, info);
+}
 
-	struct rg_graph_image *image = ref->image_index == UINT32_MAX
-		? &graph->current.swapchain_image
-		: &graph->images_own[ref->image_index];
+static void rg_i_vulkan_write_timestamp(
+	struct rg_graph *graph,
+	VkPipelineStageFlags2 stage,
+	VkQueryPool pool,
+	uint32_t query
+) {
+	vkCmdWriteTimestamp2(graph->current.command_buffer, stage, pool, query);
+}
 
-	struct rg_graph_image_use next_use = image->pass_use_map_own[pass];
+static void rg_i_vulkan_begin_query(struct rg_graph *graph, VkQueryPool pool, uint32_t query) {
+	vkCmdBeginQuery(graph->current.command_buffer, pool, query, 0);
+}
 
-	if (next_use.pass_index == UINT32_MAX) return;
-	
-	struct rg_pass *dst_pass = &graph->passes_own[next_use.pass_index];
-	struct rg_image_ref *dst_ref = &dst_pass->image_refs_own[next_use.ref_index];
+static void rg_i_vulkan_end_query(struct rg_graph *graph, VkQueryPool pool, uint32_t query) {
+	vkCmdEndQuery(graph->current.command_buffer, pool, query);
+}
 
-	RG_CHECK(dst_ref->image_index == ref->image_index, "invalid image pass use data");
-	
-	[[maybe_unused]]
-	struct rg_graph_image *dst_image = dst_ref->image_index == UINT32_MAX
-		? &graph->current.swapchain_image
-		: &graph->images_own[ref->image_index];
+const struct rg_graph_commands rg_vulkan_commands = {
+	.begin_rendering = rg_i_vulkan_begin_rendering,
+	.end_rendering = rg_i_vulkan_end_rendering,
+	.barrier = rg_i_vulkan_barrier,
+	.set_event = rg_i_vulkan_set_event,
+	.wait_event = rg_i_vulkan_wait_event,
+	.set_input_attachment_indices = rg_i_vulkan_set_input_attachment_indices,
+	.write_timestamp = rg_i_vulkan_write_timestamp,
+	.begin_query = rg_i_vulkan_begin_query,
+	.end_query = rg_i_vulkan_end_query,
+};
 
-	RG_CHECK(dst_image->image == image->image, "invalid image pass use data");
-
-	VkImageMemoryBarrier2 barrier = {
-		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
-		.image = image->image,
-		.oldLayout = ref->final_layout,
-		.srcAccessMask = ref->access_flags,
-		.srcStageMask = ref->stage_flags,
-		.srcQueueFamilyIndex = graph->current.queue_family_index,
-		.newLayout = dst_ref->initial_layout,
-		.dstAccessMask = dst_ref->access_flags,
-		.dstStageMask = dst_ref->stage_flags,
-		.dstQueueFamilyIndex = graph->current.queue_family_index,
-		.subresourceRange = {
-			.aspectMask = image->aspect,
-			.baseArrayLayer = 0,
-			.layerCount = 1,
-			.baseMipLevel = 0,
-			.levelCount = 1,
-		},
+static struct rg_recorded_command *rg_i_record(struct rg_graph *graph, enum rg_recorded_kind kind) {
+	struct rg_recording *recording = graph->commands.user;
+	if (recording->command_count == recording->command_capacity) {
+		recording->command_capacity = recording->command_capacity * 2 + 64;
+		recording->commands_own = realloc(recording->commands_own,
+			recording->command_capacity * sizeof(*recording->commands_own));
+	}
+	struct rg_recorded_command *command = &recording->commands_own[recording->command_count++];
+	*command = (struct rg_recorded_command){
+		.kind = kind,
+		.command_buffer = graph->current.command_buffer,
+		.pass_index = graph->current.pass_index,
 	};
+	return command;
+}
 
-	bool by_region = dst_ref->access_flags & VK_ACCESS_2_INPUT_ATTACHMENT_READ_BIT;
-
-	if (!by_region || region_image_barrier_count == nullptr) {
-		RG_CHECK(*image_barrier_count < 8, "too many image barriers");
-		image_barriers[(*image_barrier_count)++] = barrier;
-	} else if (region_image_barrier_count != nullptr) {
-		RG_CHECK(*region_image_barrier_count < 8, "too many image barriers");
-		region_image_barriers[(*region_image_barrier_count)++] = barrier;
+static void rg_i_record_dependency(
+	struct rg_graph *graph,
+	enum rg_recorded_kind kind,
+	VkEvent event,
+	const VkDependencyInfo *info
+) {
+	struct rg_recording *recording = graph->commands.user;
+	struct rg_recorded_command *command = rg_i_record(graph, kind);
+	command->dependency_flags = info->dependencyFlags;
+	command->event = event;
+	command->first_barrier = recording->barrier_count;
+	command->barrier_count = info->imageMemoryBarrierCount;
+	if (recording->barrier_count + info->imageMemoryBarrierCount > recording->barrier_capacity) {
+		recording->barrier_capacity = (recording->barrier_count + info->imageMemoryBarrierCount) * 2 + 64;
+		recording->barriers_own = realloc(recording->barriers_own,
+			recording->barrier_capacity * sizeof(*recording->barriers_own));
+	}
+	for (uint32_t i = 0; i < info->imageMemoryBarrierCount; ++i) {
+		const VkImageMemoryBarrier2 *barrier = &info->pImageMemoryBarriers[i];
+		uint32_t image_index = UINT32_MAX;
+		for (uint32_t j = 0; j < graph->image_count && image_index == UINT32_MAX; ++j)
+			if (graph->images_own[j].image == barrier->image) image_index = j;
+		RG_CHECK(image_index != UINT32_MAX || barrier->image == graph->current.swapchain_image.image,
+			"barrier of an image not in the graph");
+		recording->barriers_own[recording->barrier_count++] = (struct rg_recorded_barrier){
+			.image_index = image_index,
+			.barrier = *barrier,
+		};
 	}
+}
 
+static void rg_i_recording_begin_rendering(struct rg_graph *graph, const VkRenderingInfo *info) {
+	rg_i_record(graph, RG_RECORDED_BEGIN_RENDERING)->render_area = info->renderArea;
+}
 
-	RG_DEBUG_PRINTF("\t%s (%p)%s: ", image->name, image->image, by_region ? " (by region)" : "");
-	for (unsigned j = 0, cnt = 0; j < 64; ++j) {
-		VkFlags64 bit = ref->stage_flags & (1ull << j);
-		if (!bit) continue;
-		if (cnt != 0) RG_DEBUG_PRINTF("|");
-		RG_DEBUG_PRINTF("%s", rg_i_vk_stage_bit_string(bit));
-		cnt += 1;
-	}
-	RG_DEBUG_PRINTF("(");
-	for (unsigned j = 0, cnt = 0; j < 64; ++j) {
-		VkFlags64 bit = ref->access_flags & (1ull << j);
-		if (!bit) continue;
-		if (cnt != 0) RG_DEBUG_PRINTF("|");
-		RG_DEBUG_PRINTF("%s", rg_i_vk_access_bit_string(bit));
-		cnt += 1;
-	}
-	RG_DEBUG_PRINTF(") -> ");
-	for (unsigned j = 0, cnt = 0; j < 64; ++j) {
-		VkFlags64 bit = dst_ref->stage_flags & (1ull << j);
-		if (!bit) continue;
-		if (cnt != 0) RG_DEBUG_PRINTF("|");
-		RG_DEBUG_PRINTF("%s", rg_i_vk_stage_bit_string(bit));
-		cnt += 1;
+static void rg_i_recording_end_rendering(struct rg_graph *graph) {
+	rg_i_record(graph, RG_RECORDED_END_RENDERING);
+}
+
+static void rg_i_recording_barrier(struct rg_graph *graph, const VkDependencyInfo *info) {
+	rg_i_record_dependency(graph, RG_RECORDED_BARRIER, VK_NULL_HANDLE, info);
+}
+
+static void rg_i_recording_set_event(struct rg_graph *graph, VkEvent event, const VkDependencyInfo *info) {
+	rg_i_record_dependency(graph, RG_RECORDED_SET_EVENT, event, info);
+}
+
+static void rg_i_recording_wait_event(struct rg_graph *graph, VkEvent event, const VkDependencyInfo *info) {
+	rg_i_record_dependency(graph, RG_RECORDED_WAIT_EVENT, event, info);
+}
+
+static void rg_i_recording_set_input_attachment_indices(
+	struct rg_graph *graph,
+	const VkRenderingInputAttachmentIndexInfo *info
+) {
+	(void)graph; (void)info;
+}
+
+static void rg_i_recording_begin_pass(struct rg_graph *graph, struct rg_pass *pass) {
+	(void)pass;
+	rg_i_record(graph, RG_RECORDED_BEGIN_PASS);
+}
+
+static void rg_i_recording_end_pass(struct rg_graph *graph, struct rg_pass *pass) {
+	(void)pass;
+	rg_i_record(graph, RG_RECORDED_END_PASS);
+}
+
+static void rg_i_record_query(struct rg_graph *graph, enum rg_recorded_kind kind, VkQueryPool pool, uint32_t query) {
+	struct rg_recorded_command *command = rg_i_record(graph, kind);
+	command->query_pool = pool;
+	command->query = query;
+}
+
+static void rg_i_recording_write_timestamp(
+	struct rg_graph *graph,
+	VkPipelineStageFlags2 stage,
+	VkQueryPool pool,
+	uint32_t query
+) {
+	(void)stage;
+	rg_i_record_query(graph, RG_RECORDED_WRITE_TIMESTAMP, pool, query);
+}
+
+static void rg_i_recording_begin_query(struct rg_graph *graph, VkQueryPool pool, uint32_t query) {
+	rg_i_record_query(graph, RG_RECORDED_BEGIN_QUERY, pool, query);
+}
+
+static void rg_i_recording_end_query(struct rg_graph *graph, VkQueryPool pool, uint32_t query) {
+	rg_i_record_query(graph, RG_RECORDED_END_QUERY, pool, query);
+}
+
+struct rg_graph_commands rg_recording_commands(struct rg_recording *recording) {
+	return (struct rg_graph_commands){
+		.user = recording,
+		.begin_rendering = rg_i_recording_begin_rendering,
+		.end_rendering = rg_i_recording_end_rendering,
+		.barrier = rg_i_recording_barrier,
+		.set_event = rg_i_recording_set_event,
+		.wait_event = rg_i_recording_wait_event,
+		.set_input_attachment_indices = rg_i_recording_set_input_attachment_indices,
+		.begin_pass = rg_i_recording_begin_pass,
+		.end_pass = rg_i_recording_end_pass,
+		.write_timestamp = rg_i_recording_write_timestamp,
+		.begin_query = rg_i_recording_begin_query,
+		.end_query = rg_i_recording_end_query,
+	};
+}
+
+void rg_clear_recording(struct rg_recording *recording) {
+	recording->command_count = 0;
+	recording->barrier_count = 0;
+}
+
+void rg_free_recording(struct rg_recording *recording) {
+	free(recording->commands_own);
+	free(recording->barriers_own);
+	*recording = (struct rg_recording){};
+}
+
+[[maybe_unused]]
+static const char *rg_i_barrier_batch_kind_string(enum rg_barrier_batch_kind kind) {
+	switch (kind) {
+		case RG_BARRIER_BATCH_PIPELINE: return "pipeline barrier";
+		case RG_BARRIER_BATCH_BY_REGION: return "by region pipeline barrier";
+		case RG_BARRIER_BATCH_SET_EVENT: return "set event";
+		case RG_BARRIER_BATCH_WAIT_EVENT: return "wait event";
+		default: return "?";
 	}
-	RG_DEBUG_PRINTF("(");
-	for (unsigned j = 0, cnt = 0; j < 64; ++j) {
-		VkFlags64 bit = dst_ref->access_flags & (1ull << j);
-		if (!bit) continue;
-		if (cnt != 0) RG_DEBUG_PRINTF("|");
-		RG_DEBUG_PRINTF("%s", rg_i_vk_access_bit_string(bit));
-		cnt += 1;
+}
+
+/// Record the barrier batches in `range`, see `rg_impl_build_barrier_plan`.
+/// Without events (see `rg_graph_set_events`), the split barriers are done when they're set.
+static void rg_i_graph_record_batches(struct rg_graph *graph, struct rg_barrier_batch_range range) {
+	for (uint32_t i = range.first; i < range.first + range.count; ++i) {
+		struct rg_barrier_batch *batch = &graph->barrier_batches_own[i];
+		RG_DEBUG_PRINTF("\t%s %u with %u image memory barriers:\n",
+			rg_i_barrier_batch_kind_string(batch->kind), batch->event, batch->barrier_count);
+		for (uint32_t j = batch->first_barrier; j < batch->first_barrier + batch->barrier_count; ++j) {
+			[[maybe_unused]]
+			struct rg_barrier *barrier = &graph->barriers_own[j];
+			RG_DEBUG_PRINTF("\t    %s: %s -> %s\n", barrier->image_index == UINT32_MAX
+				? graph->current.swapchain_image.name : graph->images_own[barrier->image_index].name,
+				rg_i_vk_layout_string(barrier->old_layout), rg_i_vk_layout_string(barrier->new_layout));
+		}
+		if (!graph->current.command_buffer) continue;
+
+		VkDependencyInfo dependency_info = {
+			.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+			.imageMemoryBarrierCount = batch->barrier_count,
+			.pImageMemoryBarriers = &graph->current.vk_barriers_own[batch->first_barrier],
+			.dependencyFlags = batch->kind == RG_BARRIER_BATCH_BY_REGION ? VK_DEPENDENCY_BY_REGION_BIT : 0,
+		};
+		switch (batch->kind) {
+			case RG_BARRIER_BATCH_PIPELINE:
+			case RG_BARRIER_BATCH_BY_REGION:
+				graph->commands.barrier(graph, &dependency_info);
+				break;
+			case RG_BARRIER_BATCH_SET_EVENT:
+				if (graph->current.events != nullptr)
+					graph->commands.set_event(graph, graph->current.events[batch->event], &dependency_info);
+				else
+					graph->commands.barrier(graph, &dependency_info);
+				break;
+			case RG_BARRIER_BATCH_WAIT_EVENT:
+				if (graph->current.events != nullptr)
+					graph->commands.wait_event(graph, graph->current.events[batch->event], &dependency_info);
+				break;
+		}
 	}
-	RG_DEBUG_PRINTF(")\n");
-	RG_DEBUG_PRINTF("\t    barrier.newLayout = %s\n", rg_i_vk_layout_string(barrier.newLayout));
-	RG_DEBUG_PRINTF("\t    barrier.oldLayout = %s\n", rg_i_vk_layout_string(barrier.oldLayout));
 }
 
 void rg_graph_begin_frame(
@@ -1113,45 +2423,70 @@ void rg_graph_begin_frame(
 ) {
 	PSHINE_PERF_FUNC();
 	graph->current.pass_index = 0;
+	graph->current.segment_index = 0;
 	graph->current.render_area = render_area;
 	graph->current.swapchain_image.image = swapchain_image;
 	graph->current.swapchain_image.image_view = swapchain_image_view;
 	graph->current.command_buffer = command_buffer;
-	graph->current.queue_family_index = queue_family_index;
+	graph->current.queue_family_indices[RG_QUEUE_MAIN] = queue_family_index;
+	for (uint32_t i = 0; i < graph->barrier_count; ++i) {
+		struct rg_barrier *barrier = &graph->barriers_own[i];
+		VkImageMemoryBarrier2 *vk_barrier = &graph->current.vk_barriers_own[i];
+		if (barrier->image_index == UINT32_MAX) vk_barrier->image = swapchain_image;
+		vk_barrier->srcQueueFamilyIndex = graph->current.queue_family_indices[barrier->src_queue];
+		vk_barrier->dstQueueFamilyIndex = graph->current.queue_family_indices[barrier->dst_queue];
+	}
 
 	RG_DEBUG_PRINTF("begin_frame; barriers:\n");
+	rg_i_graph_record_batches(graph, graph->segments_own[0].start_batches);
+}
 
-	uint32_t image_barrier_count = 0;
-	VkImageMemoryBarrier2 image_barriers[8] = {};
-	for (uint32_t i = 0; i < graph->image_count + 1; ++i) {
-		// uint32_t image_index = i != graph->image_count ? i : UINT32_MAX;
-		struct rg_graph_image *image = i != graph->image_count
-			? &graph->images_own[i]
-			: &graph->current.swapchain_image;
-		// struct rg_pass *last_use_pass = &graph->passes_own[image->last_use.pass_index];
-		// struct rg_image_ref last_use_ref = last_use_pass->image_refs_own[image->last_use.ref_index];
-		// RG_CHECK(last_use_ref.image_index == image_index, "invalid image last_use");
-		// last_use_ref.final_layout = VK_IMAGE_LAYOUT_UNDEFINED;
-		// last_use_ref.initial_layout = VK_IMAGE_LAYOUT_UNDEFINED;
-		rg_i_graph_impl_barriers(graph, 0, &image->last_use_ref,
-			&image_barrier_count, image_barriers, nullptr, nullptr);
-	}
-
-	RG_DEBUG_PRINTF("begin_frame: pipeline barrier with %u image memory barriers.\n",
-		image_barrier_count);
-	if (graph->current.command_buffer && image_barrier_count > 0)
-		rg_i_debug_vkCmdPipelineBarrier2(graph->current.command_buffer, &(VkDependencyInfo){
-			.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
-			.imageMemoryBarrierCount = image_barrier_count,
-			.pImageMemoryBarriers = image_barriers,
-			.dependencyFlags = 0,
-		});
+void rg_graph_begin_segment(struct rg_graph *graph, VkCommandBuffer command_buffer) {
+	PSHINE_PERF_FUNC();
+	RG_CHECK(graph->current.segment_index + 1 < graph->segment_count, "no more segments");
+	graph->current.segment_index += 1;
+	RG_CHECK(graph->segments_own[graph->current.segment_index].first_pass == graph->current.pass_index,
+		"a segment must begin before its first pass");
+	graph->current.command_buffer = command_buffer;
+
+	RG_DEBUG_PRINTF("begin_segment %u; barriers:\n", graph->current.segment_index);
+	rg_i_graph_record_batches(graph, graph->segments_own[graph->current.segment_index].start_batches);
 }
 
 void rg_graph_end_frame(struct rg_graph *graph) {
 	graph->current.command_buffer = nullptr;
 }
 
+/// The timestamp and statistics queries before a rendering (or compute pass), see `rg_graph_set_query_pools`.
+static void rg_i_graph_begin_queries(struct rg_graph *graph, struct rg_pass *pass) {
+	if (!graph->current.command_buffer) return;
+	uint32_t position = graph->current.pass_index;
+	if (graph->current.timestamp_pool != VK_NULL_HANDLE)
+		graph->commands.write_timestamp(graph, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+			graph->current.timestamp_pool, 2 * position);
+	if (graph->current.statistics_pool != VK_NULL_HANDLE && pass->queue == RG_QUEUE_MAIN)
+		graph->commands.begin_query(graph, graph->current.statistics_pool, position);
+}
+
+/// The queries after the rendering `pass` is the last pass of.
+static void rg_i_graph_end_queries(struct rg_graph *graph, struct rg_pass *pass) {
+	if (!graph->current.command_buffer) return;
+	uint32_t position = graph->current.pass_index;
+	while (graph->passes_own[position].merged_with_prev) --position;
+	if (graph->current.statistics_pool != VK_NULL_HANDLE && pass->queue == RG_QUEUE_MAIN)
+		graph->commands.end_query(graph, graph->current.statistics_pool, position);
+	if (graph->current.timestamp_pool != VK_NULL_HANDLE)
+		graph->commands.write_timestamp(graph, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+			graph->current.timestamp_pool, 2 * position + 1);
+}
+
+static VkRect2D rg_i_pass_render_area(const struct rg_graph *graph, const struct rg_pass *pass) {
+	if (pass->render_area.extent.width != 0) return pass->render_area;
+	if (pass->scaled && graph->current.scaled_render_area.extent.width != 0)
+		return graph->current.scaled_render_area;
+	return graph->current.render_area;
+}
+
 static VkRenderingAttachmentInfo rg_i_vulkan_from_image_ref(
 	struct rg_image_ref *ref,
 	struct rg_graph *graph
@@ -1179,6 +2514,16 @@ VkRenderingInputAttachmentIndexInfo rg_get_input_attachment_index_info(struct rg
 	};
 }
 
+VkCommandBufferInheritanceRenderingInfo rg_get_inheritance_rendering_info(struct rg_pass *pass) {
+	return (VkCommandBufferInheritanceRenderingInfo){
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO,
+		.colorAttachmentCount = pass->color_attachment_count,
+		.pColorAttachmentFormats = pass->color_attachment_formats,
+		.depthAttachmentFormat = pass->depth_attachment_format,
+		.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+	};
+}
+
 void rg_graph_begin_pass(struct rg_graph *graph) {
 	PSHINE_PERF_FUNC();
 	struct rg_pass *pass = &graph->passes_own[graph->current.pass_index];
@@ -1187,7 +2532,8 @@ void rg_graph_begin_pass(struct rg_graph *graph) {
 	if (pass->merged_with_prev) {
 		if (graph->current.command_buffer) {
 			auto indices = rg_get_input_attachment_index_info(pass);
-			vkCmdSetRenderingInputAttachmentIndices(graph->current.command_buffer, &indices);
+			graph->commands.set_input_attachment_indices(graph, &indices);
+			if (graph->commands.begin_pass) graph->commands.begin_pass(graph, pass);
 		}
 		return;
 	}
@@ -1217,7 +2563,14 @@ void rg_graph_begin_pass(struct rg_graph *graph) {
 		RG_DEBUG_PRINTF(")\n");
 	}
 
-	if (pass->compute) return;
+	// the acquires, the discards of aliasing images and the split barrier waits.
+	rg_i_graph_record_batches(graph, pass->begin_batches);
+	rg_i_graph_begin_queries(graph, pass);
+
+	if (pass->compute) {
+		if (graph->current.command_buffer && graph->commands.begin_pass) graph->commands.begin_pass(graph, pass);
+		return;
+	}
 	VkRenderingAttachmentInfo color_attachments[12]; // pass->color_attachment_count
 	RG_CHECK(pass->color_attachment_count <= 12, "max color attachment count is 12");
 	for (size_t i = 0; i < pass->color_attachment_count; ++i) {
@@ -1234,11 +2587,10 @@ void rg_graph_begin_pass(struct rg_graph *graph) {
 		);
 
 	if (graph->current.command_buffer) {
-		vkCmdBeginRendering(graph->current.command_buffer, &(VkRenderingInfo){
+		graph->commands.begin_rendering(graph, &(VkRenderingInfo){
 			.sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
-			.renderArea = pass->render_area.extent.width != 0
-				? pass->render_area
-				: graph->current.render_area,
+			.flags = pass->secondary ? VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT : 0,
+			.renderArea = rg_i_pass_render_area(graph, pass),
 			.colorAttachmentCount = pass->color_attachment_count,
 			.pColorAttachments = color_attachments,
 			.pDepthAttachment = pass->has_depth_attachment
@@ -1246,62 +2598,52 @@ void rg_graph_begin_pass(struct rg_graph *graph) {
 			.layerCount = 1,
 		});
 		auto indices = rg_get_input_attachment_index_info(pass);
-		vkCmdSetRenderingInputAttachmentIndices(graph->current.command_buffer, &indices);
+		graph->commands.set_input_attachment_indices(graph, &indices);
+		if (graph->commands.begin_pass) graph->commands.begin_pass(graph, pass);
 	}
 }
 
 void rg_graph_end_pass(struct rg_graph *graph) {
 	PSHINE_PERF_FUNC();
 	struct rg_pass *pass = &graph->passes_own[graph->current.pass_index];
+	if (graph->current.command_buffer && graph->commands.end_pass) graph->commands.end_pass(graph, pass);
 	if (!pass->compute && !pass->merged_with_next && graph->current.command_buffer) {
-		vkCmdEndRendering(graph->current.command_buffer);
+		graph->commands.end_rendering(graph);
 	}
+	if (!pass->merged_with_next) rg_i_graph_end_queries(graph, pass);
 
 	RG_DEBUG_PRINTF("end_pass %s%s; barriers:\n",
 		pass->name, pass->merged_with_next ? " (merged->)" : "");
 
-	uint32_t image_barrier_count = 0;
-	VkImageMemoryBarrier2 image_barriers[8] = {};
-	uint32_t region_image_barrier_count = 0;
-	VkImageMemoryBarrier2 region_image_barriers[8] = {};
-	for (uint32_t i = 0; i < pass->image_ref_count; ++i) {
-		struct rg_image_ref *ref = &pass->image_refs_own[i];
-		rg_i_graph_impl_barriers(
-			graph,
-			graph->current.pass_index + 1,
-			ref,
-			&image_barrier_count,
-			image_barriers,
-			pass->merged_with_next ? &region_image_barrier_count : nullptr,
-			region_image_barriers
-		);
-	}
+	rg_i_graph_record_batches(graph, pass->end_batches);
 	RG_DEBUG_PRINTF("\n");
 
-	if (graph->current.command_buffer) {
-		if (!pass->merged_with_next && image_barrier_count > 0) {
-			// TODO: postpone this barrier to last merged
-			rg_i_debug_vkCmdPipelineBarrier2(graph->current.command_buffer, &(VkDependencyInfo){
-				.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
-				.imageMemoryBarrierCount = image_barrier_count,
-				.pImageMemoryBarriers = image_barriers,
-				.dependencyFlags = 0,
-			});
-			
-		}
-		if (region_image_barrier_count > 0) {
-			rg_i_debug_vkCmdPipelineBarrier2(graph->current.command_buffer, &(VkDependencyInfo){
-				.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
-				.imageMemoryBarrierCount = region_image_barrier_count,
-				.pImageMemoryBarriers = region_image_barriers,
-				.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT,
-			});
-		}
-	}
-
 	graph->current.pass_index += 1;
 }
 
+void rg_graph_set_image_view(struct rg_graph *graph, rg_image_id id, VkImageView image_view) {
+	RG_CHECK(id != RG_IMAGE_SWAPCHAIN && id < graph->image_count, "invalid image id");
+	graph->images_own[id].image_view = image_view;
+}
+
+struct rg_pass *rg_graph_get_pass(struct rg_graph *graph, uint32_t spec_index) {
+	RG_CHECK(spec_index < graph->spec_pass_count, "invalid pass index");
+	return graph->spec_passes_own[spec_index];
+}
+
+void rg_graph_set_events(struct rg_graph *graph, const VkEvent *events) {
+	graph->current.events = events;
+}
+
+void rg_graph_set_query_pools(struct rg_graph *graph, VkQueryPool timestamps, VkQueryPool statistics) {
+	graph->current.timestamp_pool = timestamps;
+	graph->current.statistics_pool = statistics;
+}
+
+void rg_graph_set_scaled_render_area(struct rg_graph *graph, VkRect2D render_area) {
+	graph->current.scaled_render_area = render_area;
+}
+
 void rg_graph_pass_last_use(
 	struct rg_graph *graph,
 	rg_image_id id
@@ -1311,15 +2653,33 @@ void rg_graph_pass_last_use(
 
 void rg_graph_create_dot_file(struct rg_graph *graph, const char *fpath) {
 	FILE *fout = fopen(fpath, "w");
+	if (fout == nullptr) return;
 	fprintf(fout, "digraph render_graph {\n");
+	// the peak memory of the placed images, all of it is allocated for the whole run.
+	fprintf(fout, "\tlabel=\"Transient memory: %.2f MiB, %.2f MiB without aliasing\";\n",
+		graph->aliased_memory_size / (1024.0 * 1024.0), graph->unaliased_memory_size / (1024.0 * 1024.0));
 	for (size_t i = 0; i < graph->image_count; ++i) {
-		fprintf(fout, "\timg%zu [label=\"%s\"];\n", i, graph->images_own[i].name);
+		struct rg_graph_image *image = &graph->images_own[i];
+		if (image->memory_heap == UINT32_MAX) {
+			fprintf(fout, "\timg%zu [label=\"%s\"];\n", i, image->name);
+		} else {
+			fprintf(fout, "\timg%zu [label=\"%s\\nheap %u, %.2f to %.2f MiB\"];\n", i, image->name,
+				image->memory_heap, image->memory_offset / (1024.0 * 1024.0),
+				(image->memory_offset + image->memory_size) / (1024.0 * 1024.0));
+		}
 	}
 	fprintf(fout, "\timgswap [label=\"%s\"];\n", "Swapchain");
-	for (size_t i = 0; i < graph->pass_count; ++i) {
-		struct rg_pass *pass = &graph->passes_own[i];
-		fprintf(fout, "\tpass%zu [label=\"%s\",shape=box,style=filled];\n", i, pass->name);
-		if (i != 0) fprintf(fout, "\tpass%zu -> pass%zu [style=bold];\n", i - 1, i);
+	// by the spec index, the culled passes are dashed and not in the recorded order.
+	for (size_t k = 0; k < graph->pass_count + graph->culled_pass_count; ++k) {
+		struct rg_pass *pass = k < graph->pass_count
+			? &graph->passes_own[k]
+			: &graph->culled_passes_own[k - graph->pass_count];
+		size_t i = pass->spec_index;
+		fprintf(fout, "\tpass%zu [label=\"%s\",shape=box,style=\"filled%s\"%s];\n", i, pass->name,
+			pass->culled ? ",dashed" : "",
+			pass->queue == RG_QUEUE_ASYNC_COMPUTE ? ",fillcolor=lightblue" : "");
+		if (k != 0 && k < graph->pass_count)
+			fprintf(fout, "\tpass%u -> pass%zu [style=bold];\n", graph->passes_own[k - 1].spec_index, i);
 		for (size_t j = 0; j < pass->image_ref_count; ++j) {
 			size_t idx = pass->image_refs_own[j].image_index;
 			fprintf(fout, "\tpass%zu -> ", i);
@@ -1335,6 +2695,82 @@ void rg_graph_create_dot_file(struct rg_graph *graph, const char *fpath) {
 	fclose(fout);
 }
 
+static void rg_i_write_flags(FILE *fout, VkFlags64 flags, const char *(*bit_string)(VkFlags64 bit)) {
+	if (flags == 0) fprintf(fout, "NONE");
+	for (unsigned j = 0, cnt = 0; j < 64; ++j) {
+		VkFlags64 bit = flags & (1ull << j);
+		if (!bit) continue;
+		if (cnt != 0) fprintf(fout, "|");
+		fprintf(fout, "%s", bit_string(bit));
+		cnt += 1;
+	}
+}
+
+static void rg_i_write_batches(FILE *fout, struct rg_graph *graph, const char *when, struct rg_barrier_batch_range range) {
+	for (uint32_t i = range.first; i < range.first + range.count; ++i) {
+		struct rg_barrier_batch *batch = &graph->barrier_batches_own[i];
+		fprintf(fout, "\t%s: %s", when, rg_i_barrier_batch_kind_string(batch->kind));
+		if (batch->kind == RG_BARRIER_BATCH_SET_EVENT || batch->kind == RG_BARRIER_BATCH_WAIT_EVENT)
+			fprintf(fout, " %u", batch->event);
+		fprintf(fout, "\n");
+		for (uint32_t j = batch->first_barrier; j < batch->first_barrier + batch->barrier_count; ++j) {
+			struct rg_barrier *barrier = &graph->barriers_own[j];
+			fprintf(fout, "\t\t%s: %s -> %s, ", barrier->image_index == UINT32_MAX
+				? "Swapchain" : graph->images_own[barrier->image_index].name,
+				rg_i_vk_layout_string(barrier->old_layout), rg_i_vk_layout_string(barrier->new_layout));
+			rg_i_write_flags(fout, barrier->src_stage_flags, rg_i_vk_stage_bit_string);
+			fprintf(fout, "(");
+			rg_i_write_flags(fout, barrier->src_access_flags, rg_i_vk_access_bit_string);
+			fprintf(fout, ") -> ");
+			rg_i_write_flags(fout, barrier->dst_stage_flags, rg_i_vk_stage_bit_string);
+			fprintf(fout, "(");
+			rg_i_write_flags(fout, barrier->dst_access_flags, rg_i_vk_access_bit_string);
+			fprintf(fout, ")%s\n", barrier->src_queue != barrier->dst_queue ? " (queue transfer)" : "");
+		}
+	}
+}
+
+void rg_graph_write_barrier_plan(struct rg_graph *graph, const char *fpath) {
+	FILE *fout = fopen(fpath, "w");
+	if (fout == nullptr) return;
+	rg_graph_print_barrier_plan(graph, fout);
+	fclose(fout);
+}
+
+void rg_graph_print_barrier_plan(struct rg_graph *graph, FILE *fout) {
+	fprintf(fout, "%u passes (%u culled), %u barriers in %u batches, %u events\n",
+		graph->pass_count, graph->culled_pass_count, graph->barrier_count,
+		graph->barrier_batch_count, graph->event_count);
+	for (uint32_t p = 0; p < graph->pass_count; ++p) {
+		struct rg_pass *pass = &graph->passes_own[p];
+		struct rg_segment *segment = &graph->segments_own[pass->segment];
+		if (segment->first_pass == p) {
+			fprintf(fout, "segment %u (%s)", pass->segment,
+				segment->queue == RG_QUEUE_MAIN ? "main" : "async compute");
+			if (segment->wait_segment != UINT32_MAX) {
+				fprintf(fout, ", waits for segment %u at ", segment->wait_segment);
+				rg_i_write_flags(fout, segment->wait_stage_flags, rg_i_vk_stage_bit_string);
+			}
+			if (segment->frame_wait_stage_flags != VK_PIPELINE_STAGE_2_NONE) {
+				fprintf(fout, ", waits for the last frame at ");
+				rg_i_write_flags(fout, segment->frame_wait_stage_flags, rg_i_vk_stage_bit_string);
+			}
+			if (segment->swapchain_stage_flags != VK_PIPELINE_STAGE_2_NONE) {
+				fprintf(fout, ", waits for the swapchain at ");
+				rg_i_write_flags(fout, segment->swapchain_stage_flags, rg_i_vk_stage_bit_string);
+			}
+			fprintf(fout, "\n");
+			rg_i_write_batches(fout, graph, "start", segment->start_batches);
+		}
+		fprintf(fout, "pass %u: %s (spec %u)%s%s%s\n", p, pass->name, pass->spec_index, pass->scaled ? " (scaled)" : "",
+			pass->merged_with_prev ? " (<-merged)" : "", pass->merged_with_next ? " (merged->)" : "");
+		rg_i_write_batches(fout, graph, "begin", pass->begin_batches);
+		rg_i_write_batches(fout, graph, "end", pass->end_batches);
+	}
+	for (uint32_t i = 0; i < graph->culled_pass_count; ++i)
+		fprintf(fout, "culled: %s (spec %u)\n", graph->culled_passes_own[i].name, graph->culled_passes_own[i].spec_index);
+}
+
 [[maybe_unused]] static void example_render_graph(struct rg_graph *graph) {
 	struct { VkImageView view; VkImage image; VkFormat format; VkImageAspectFlags aspect; }
 		color0 = { 0, 0, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT },
@@ -44,6 +44,57 @@ size_t pshine_get_mem_usage() {
 	return 0;
 }
 
+size_t pshine_get_cpu_count() {
+	SYSTEM_INFO info = {};
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors < 1 ? 1 : (size_t)info.dwNumberOfProcessors;
+}
+
+struct pshine_thread_ {
+	HANDLE handle;
+	void (*fn)(void *user);
+	void *user;
+};
+
+static DWORD WINAPI pshine_thread_entry_(LPVOID arg) {
+	struct pshine_thread_ *t = arg;
+	t->fn(t->user);
+	return 0;
+}
+
+pshine_thread pshine_thread_start(void (*fn)(void *user), void *user) {
+	struct pshine_thread_ *t = calloc(1, sizeof(*t));
+	t->fn = fn;
+	t->user = user;
+	t->handle = CreateThread(nullptr, 0, &pshine_thread_entry_, t, 0, nullptr);
+	if (t->handle == nullptr) PSHINE_PANIC("Could not create thread: %lu", GetLastError());
+	return t;
+}
+
+void pshine_thread_join(pshine_thread thread) {
+	WaitForSingleObject(thread->handle, INFINITE);
+	CloseHandle(thread->handle);
+	free(thread);
+}
+
+pshine_semaphore pshine_semaphore_create(uint32_t count) {
+	HANDLE handle = CreateSemaphoreA(nullptr, (LONG)count, MAXLONG, nullptr);
+	if (handle == nullptr) PSHINE_PANIC("Could not create semaphore: %lu", GetLastError());
+	return (pshine_semaphore)handle;
+}
+
+void pshine_semaphore_destroy(pshine_semaphore sem) {
+	CloseHandle((HANDLE)sem);
+}
+
+void pshine_semaphore_post(pshine_semaphore sem, uint32_t count) {
+	if (count != 0) ReleaseSemaphore((HANDLE)sem, (LONG)count, nullptr);
+}
+
+void pshine_semaphore_wait(pshine_semaphore sem) {
+	WaitForSingleObject((HANDLE)sem, INFINITE);
+}
+
 void pshine_print_stacktrace(FILE *fout, bool color) {
 	(void)fout;
 	(void)color;
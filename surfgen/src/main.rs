@@ -2,6 +2,8 @@
 #![feature(sync_unsafe_cell)]
 #![allow(unused)]
 
+mod shared;
+
 use core::f64;
 use noise::{utils::NoiseMapBuilder as _, MultiFractal};
 use rand::SeedableRng as _;
@@ -27,47 +29,9 @@ fn lat_lon_to_xyz(lat: f64, lon: f64) -> Vec3f64 {
 	Vec3f64 { x, y, z }
 }
 
-struct Crater {
-	pos: Vec3f64,
-	radius: f64,
-	floor_height: f64,
-	steepness: f64,
-	k1: f64,
-	k2: f64,
-}
-
-fn smin(a: f64, b: f64, k: f64) -> f64 {
-  let h = (0.5 + 0.5*(a-b)/k).clamp(0.0, 1.0);
-  return a * (1.0 - h) + b * h - k*h*(1.0-h);
-}
-
-impl Crater {
-	fn get(&self, d: f64) -> f64 {
-		let bowl = 4.0 * d.powf(self.steepness + 1.0) - 1.0;
-		let edge = (d - 1.0) * (d - 1.0);
-		let floor = self.floor_height;
-		smin(smin(bowl, edge, self.k1), floor, self.k2)
-	}
-}
-
-struct Craters {
-	craters: Vec<Crater>,
-}
-
-impl noise::NoiseFn<f64, 3> for Craters {
+impl noise::NoiseFn<f64, 3> for shared::CraterField {
 	fn get(&self, point: [f64; 3]) -> f64 {
-		let p = Vec3f64::from(point);
-
-		let mut r = 0.0;
-		for crater in &self.craters {
-			let d2 = crater.pos.distance_squared(p);
-			if d2 <= crater.radius * crater.radius {
-				let d = d2.sqrt() / crater.radius;
-				r += crater.get(d);
-			}
-		}
-
-		r
+		self.eval(point)
 	}
 }
 
@@ -166,8 +130,8 @@ fn tom_bombardil(
 			* (1.0 - config.lat_clearance) * π/2.0;
 		let lon = rng.random_range(-π..π);
 		let pos = lat_lon_to_xyz(lat, lon);
-		craters.push(Crater {
-			pos,
+		craters.push(shared::Crater {
+			pos: pos.into_array(),
 			radius: rng.random_range(config.radius_range.clone())
 				.powf(config.radius_bias),
 			floor_height: -rng.random_range(config.depth_range.clone()),
@@ -176,7 +140,7 @@ fn tom_bombardil(
 			k2: -0.3,
 		});
 	}
-	Craters { craters }
+	shared::CraterField::new(craters)
 }
 
 trait Surfgen {
@@ -213,6 +177,16 @@ impl Surfgen for KJ61 {
 
 
 struct KJ62;
+impl KJ62 {
+	fn ridges() -> noise::RidgedMulti<noise::OpenSimplex> {
+		noise::RidgedMulti::<noise::OpenSimplex>::new(382721)
+			.set_frequency(1.2)
+			.set_lacunarity(2.29)
+			.set_persistence(0.5)
+			.set_attenuation(0.54)
+	}
+}
+
 impl Surfgen for KJ62 {
 	fn noise() -> impl noise::NoiseFn<f64, 3> {
 		let mut rng = rand_chacha::ChaCha12Rng::from_seed([87; 32]);
@@ -228,12 +202,7 @@ impl Surfgen for KJ62 {
 								.set_octaves(6)))
 						.set_exponent(3.0)),
 				make_noise_scale(0.0, 0.5, 1.0,
-					make_displacement(482729, 10.0, 0.02,
-						noise::RidgedMulti::<noise::OpenSimplex>::new(382721)
-							.set_frequency(1.2)
-							.set_lacunarity(2.29)
-							.set_persistence(0.5)
-							.set_attenuation(0.54)))
+					make_displacement(482729, 10.0, 0.02, Self::ridges()))
 			),
 			make_noise_scale(0.0, 0.2, 1.0,
 				tom_bombardil(256, &BombardmentConfig {
@@ -329,6 +298,14 @@ impl Surfgen for KJ63 {
 }
 
 struct KJ631;
+impl KJ631 {
+	/// Same as `pshine_init_kj631_ridges`.
+	fn ridges() -> noise::RidgedMulti<noise::OpenSimplex> {
+		noise::RidgedMulti::<noise::OpenSimplex>::new(95834)
+			.set_persistence(1.8)
+	}
+}
+
 impl Surfgen for KJ631 {
 	fn noise() -> impl noise::NoiseFn<f64, 3> {
 		let mut rng = rand_chacha::ChaCha12Rng::from_seed([32; 32]);
@@ -359,9 +336,7 @@ impl Surfgen for KJ631 {
 							radius_range: 0.2..=0.9,
 							..Default::default()
 						}, &mut rng)))),
-			make_noise_scale(0.0, -0.2, 8.0,
-				noise::RidgedMulti::<noise::OpenSimplex>::new(95834)
-					.set_persistence(1.8))
+			make_noise_scale(0.0, -0.2, 8.0, Self::ridges())
 		)
 	}
 
@@ -418,6 +393,79 @@ impl Surfgen for Alpha2 {
 	}
 }
 
+impl noise::NoiseFn<f64, 3> for shared::Surface {
+	fn get(&self, point: [f64; 3]) -> f64 {
+		self.height(point)
+	}
+}
+
+/// Uses the noise shared with the runtime (see `shared.rs`),
+/// must match `pshine_init_kj621_surface` in `pshine/src/pshine/game/noise.c`.
+struct SharedKJ621;
+impl SharedKJ621 {
+	fn surface() -> shared::Surface {
+		use shared::*;
+		let craters = CraterField::generate(1024, &BombardmentConfig {
+			radius_bias: 5.2,
+			radius_min: 0.01,
+			radius_max: 0.9,
+			..Default::default()
+		}, 382);
+		Surface {
+			layers: vec![
+				Layer {
+					warp_seed: 2,
+					warp_strength: 20.0,
+					warp_frequency: 0.01,
+					pre_scale: 0.5,
+					pre_bias: 0.5,
+					exponent: 2.0,
+					..Layer::new(LayerKind::Fbm(FractalParams {
+						seed: 2232,
+						octaves: 10,
+						frequency: 0.9,
+						lacunarity: 1.8,
+						persistence: 0.8,
+						..Default::default()
+					}))
+				},
+				Layer {
+					warp_seed: 4312,
+					warp_strength: 10.0,
+					warp_frequency: 0.02,
+					scale: 0.5,
+					..Layer::new(LayerKind::Ridged(FractalParams {
+						seed: 5442,
+						octaves: 6,
+						frequency: 1.0,
+						lacunarity: 1.49,
+						persistence: 0.5,
+						attenuation: 0.64,
+						..Default::default()
+					}))
+				},
+				Layer {
+					warp_seed: 382,
+					warp_strength: 0.003,
+					warp_frequency: 50.0,
+					scale: 0.3,
+					..Layer::new(LayerKind::Craters(craters))
+				},
+			],
+		}
+	}
+}
+
+impl Surfgen for SharedKJ621 {
+	fn noise() -> impl noise::NoiseFn<f64, 3> {
+		Self::surface()
+	}
+
+	fn gradient() -> noise::utils::ColorGradient {
+		KJ621::gradient()
+	}
+}
+
 pub fn render(
 	gradient: &noise::utils::ColorGradient,
 	noise_map: &(impl noise::NoiseFn<f64, 3> + Send + Sync),
@@ -467,7 +515,58 @@ pub fn render(
 	destination_image.into_inner()
 }
 
+/// Times the crater index against brute force and checks that the results are identical.
+fn bench_craters(width: usize) {
+	let height = width / 2;
+	for crater_count in [1_000, 10_000, 100_000] {
+		let start = std::time::Instant::now();
+		let field = shared::CraterField::generate(crater_count, &shared::BombardmentConfig {
+			radius_bias: 5.2,
+			radius_min: 0.01,
+			radius_max: 0.9,
+			..Default::default()
+		}, 382);
+		let build_time = start.elapsed();
+
+		let points: Vec<[f64; 3]> = (0..width * height).map(|i| {
+			let colat = ((i / width) as f64 + 0.5) / height as f64 * π;
+			let lon = ((i % width) as f64 + 0.5) / width as f64 * 2.0 * π - π;
+			[colat.sin() * lon.cos(), colat.cos(), colat.sin() * lon.sin()]
+		}).collect();
+
+		let start = std::time::Instant::now();
+		let brute: Vec<f64> = points.iter().map(|&p| field.eval_brute_force(p)).collect();
+		let brute_time = start.elapsed();
+		let start = std::time::Instant::now();
+		let indexed: Vec<f64> = points.iter().map(|&p| field.eval(p)).collect();
+		let indexed_time = start.elapsed();
+
+		let mismatches = brute.iter().zip(&indexed).filter(|(a, b)| a.to_bits() != b.to_bits()).count();
+		println!(
+			"{crater_count} craters, {width}x{height}: build {:.3}s, brute force {:.3}s, indexed {:.3}s ({:.1}x), {mismatches} mismatches",
+			build_time.as_secs_f64(),
+			brute_time.as_secs_f64(),
+			indexed_time.as_secs_f64(),
+			brute_time.as_secs_f64() / indexed_time.as_secs_f64(),
+		);
+		assert_eq!(mismatches, 0, "the crater index must match brute force");
+	}
+}
+
 fn main() {
+	if std::env::args().nth(1).as_deref() == Some("--bench-craters") {
+		bench_craters(std::env::args().nth(2).map_or(512, |s| s.parse().unwrap()));
+		return;
+	}
+	if std::env::args().nth(1).as_deref() == Some("--export-terrain-vectors") {
+		export_terrain_vectors(&std::env::args().nth(2).expect("expected an output path"));
+		return;
+	}
+	if std::env::args().nth(1).as_deref() == Some("--export-open-simplex-vectors") {
+		export_open_simplex_vectors(&std::env::args().nth(2).expect("expected an output path"));
+		return;
+	}
+
 	type S = KJ621;
 	let final_noise = S::noise();
 
@@ -496,3 +595,64 @@ fn main() {
 	}
 	buf.write_to(&mut wr, image::ImageFormat::Png).unwrap();
 }
+
+/// Writes the noise functions and the `SharedKJ621` surface at random points, for the runtime's
+/// `--test-terrain` (see `pshine_test_terrain`). Every value is written as the hex bits of the f64.
+fn export_terrain_vectors(path: &str) {
+	use std::io::Write;
+	use shared::*;
+	let surface = SharedKJ621::surface();
+	let fractal = |i: usize| match &surface.layers[i].kind {
+		LayerKind::Fbm(params) | LayerKind::Ridged(params) => params,
+		LayerKind::Craters(_) => unreachable!(),
+	};
+	let LayerKind::Craters(craters) = &surface.layers[2].kind else { unreachable!() };
+
+	let mut out = std::io::BufWriter::new(std::fs::File::create(path).unwrap());
+	writeln!(out, "# surfgen --export-terrain-vectors: SharedKJ621, f64 bits").unwrap();
+	writeln!(out, "# x y z perlin(fbm seed) fbm ridged craters height").unwrap();
+	let mut rng = Pcg32::new(621);
+	const POINT_COUNT: usize = 1024;
+	for i in 0..POINT_COUNT {
+		let mut p = [rng.range(-1.0, 1.0), rng.range(-1.0, 1.0), rng.range(-1.0, 1.0)];
+		// half of the points on the unit sphere (where the surface is used), half off it.
+		if i % 2 == 0 {
+			let len = (p[0] * p[0] + p[1] * p[1] + p[2] * p[2]).sqrt();
+			p = p.map(|c| c / len);
+		}
+		let values = [
+			p[0], p[1], p[2],
+			perlin(fractal(0).seed, p[0], p[1], p[2]),
+			fbm(fractal(0), p),
+			ridged(fractal(1), p),
+			craters.eval(p),
+			surface.height(p),
+		];
+		let line: Vec<String> = values.iter().map(|v| format!("{:016x}", v.to_bits())).collect();
+		writeln!(out, "{}", line.join(" ")).unwrap();
+	}
+	println!("wrote {POINT_COUNT} points to {path}");
+}
+
+/// Writes the `noise` crate's OpenSimplex and the `KJ631` and `KJ62` ridges at random points,
+/// for the runtime's `--test-terrain` (see `pshine_test_terrain`).
+fn export_open_simplex_vectors(path: &str) {
+	use std::io::Write;
+	use noise::NoiseFn as _;
+	let simplex = noise::OpenSimplex::new(95834);
+	let (kj631, kj62) = (KJ631::ridges(), KJ62::ridges());
+
+	let mut out = std::io::BufWriter::new(std::fs::File::create(path).unwrap());
+	writeln!(out, "# surfgen --export-open-simplex-vectors: noise 0.9, f64 bits").unwrap();
+	writeln!(out, "# x y z open_simplex(95834) KJ631 ridges KJ62 ridges").unwrap();
+	let mut rng = shared::Pcg32::new(631);
+	const POINT_COUNT: usize = 1024;
+	for _ in 0..POINT_COUNT {
+		// a few lattice cells in every direction, negative coordinates included.
+		let p = [rng.range(-8.0, 8.0), rng.range(-8.0, 8.0), rng.range(-8.0, 8.0)];
+		let values = [p[0], p[1], p[2], simplex.get(p), kj631.get(p), kj62.get(p)];
+		let line: Vec<String> = values.iter().map(|v| format!("{:016x}", v.to_bits())).collect();
+		writeln!(out, "{}", line.join(" ")).unwrap();
+	}
+	println!("wrote {POINT_COUNT} points to {path}");
+}
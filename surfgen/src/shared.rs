@@ -0,0 +1,492 @@
+//! A port of `pshine/src/pshine/game/noise.c`, the runtime surface noise.
+//! Keep the two in sync: for the same parameters and seeds they must produce
+//! the same values, so that baked textures match runtime-generated terrain.
+//! The operations are done in the same order as in C (which is compiled with
+//! FP contraction off), so the results are bit-identical.
+
+use core::f64::consts::PI as π;
+
+fn hash(seed: u32, x: i32, y: i32, z: i32) -> u32 {
+	let mut h = seed;
+	h ^= (x as u32).wrapping_mul(0x8da6b343);
+	h ^= (y as u32).wrapping_mul(0xd8163841);
+	h ^= (z as u32).wrapping_mul(0xcb1ab31f);
+	h ^= h >> 16;
+	h = h.wrapping_mul(0x7feb352d);
+	h ^= h >> 15;
+	h = h.wrapping_mul(0x846ca68b);
+	h ^= h >> 16;
+	h
+}
+
+fn grad(h: u32, x: f64, y: f64, z: f64) -> f64 {
+	let h = h & 15;
+	let u = if h < 8 { x } else { y };
+	let v = if h < 4 { y } else if h == 12 || h == 14 { x } else { z };
+	(if h & 1 != 0 { -u } else { u }) + (if h & 2 != 0 { -v } else { v })
+}
+
+fn fade(t: f64) -> f64 {
+	t * t * t * (t * (t * 6.0 - 15.0) + 10.0)
+}
+
+fn lerp(a: f64, b: f64, t: f64) -> f64 {
+	a + t * (b - a)
+}
+
+pub fn perlin(seed: u32, x: f64, y: f64, z: f64) -> f64 {
+	let (fx, fy, fz) = (x.floor(), y.floor(), z.floor());
+	let (ix, iy, iz) = (fx as i32, fy as i32, fz as i32);
+	let (x, y, z) = (x - fx, y - fy, z - fz);
+	let (u, v, w) = (fade(x), fade(y), fade(z));
+	let n000 = grad(hash(seed, ix,     iy,     iz    ), x,       y,       z      );
+	let n100 = grad(hash(seed, ix + 1, iy,     iz    ), x - 1.0, y,       z      );
+	let n010 = grad(hash(seed, ix,     iy + 1, iz    ), x,       y - 1.0, z      );
+	let n110 = grad(hash(seed, ix + 1, iy + 1, iz    ), x - 1.0, y - 1.0, z      );
+	let n001 = grad(hash(seed, ix,     iy,     iz + 1), x,       y,       z - 1.0);
+	let n101 = grad(hash(seed, ix + 1, iy,     iz + 1), x - 1.0, y,       z - 1.0);
+	let n011 = grad(hash(seed, ix,     iy + 1, iz + 1), x,       y - 1.0, z - 1.0);
+	let n111 = grad(hash(seed, ix + 1, iy + 1, iz + 1), x - 1.0, y - 1.0, z - 1.0);
+	lerp(
+		lerp(lerp(n000, n100, u), lerp(n010, n110, u), v),
+		lerp(lerp(n001, n101, u), lerp(n011, n111, u), v),
+		w,
+	)
+}
+
+#[derive(Clone, Copy, Debug)]
+pub struct FractalParams {
+	pub seed: u32,
+	pub octaves: u32,
+	pub frequency: f64,
+	pub lacunarity: f64,
+	pub persistence: f64,
+	pub attenuation: f64,
+}
+
+impl Default for FractalParams {
+	fn default() -> Self {
+		Self {
+			seed: 0,
+			octaves: 6,
+			frequency: 1.0,
+			lacunarity: 2.0,
+			persistence: 0.5,
+			attenuation: 2.0,
+		}
+	}
+}
+
+fn amplitude_sum(params: &FractalParams) -> f64 {
+	let mut sum = 0.0;
+	let mut amp = 1.0;
+	for _ in 0..params.octaves {
+		sum += amp;
+		amp *= params.persistence;
+	}
+	sum
+}
+
+pub fn fbm(params: &FractalParams, p: [f64; 3]) -> f64 {
+	let inv_amp_sum = 1.0 / amplitude_sum(params);
+	let [mut x, mut y, mut z] = p.map(|c| c * params.frequency);
+	let mut acc = 0.0;
+	let mut amp = 1.0;
+	for o in 0..params.octaves {
+		acc += perlin(params.seed.wrapping_add(o), x, y, z) * amp;
+		x *= params.lacunarity;
+		y *= params.lacunarity;
+		z *= params.lacunarity;
+		amp *= params.persistence;
+	}
+	acc * inv_amp_sum
+}
+
+pub fn ridged(params: &FractalParams, p: [f64; 3]) -> f64 {
+	let inv_amp_sum = 1.0 / amplitude_sum(params);
+	let [mut x, mut y, mut z] = p.map(|c| c * params.frequency);
+	let mut acc = 0.0;
+	let mut weight = 1.0;
+	let mut amp = 1.0;
+	for o in 0..params.octaves {
+		let mut signal = 1.0 - perlin(params.seed.wrapping_add(o), x, y, z).abs();
+		signal *= signal;
+		signal *= weight;
+		let w = signal / params.attenuation;
+		weight = if w < 0.0 { 0.0 } else if w > 1.0 { 1.0 } else { w };
+		acc += signal * amp;
+		x *= params.lacunarity;
+		y *= params.lacunarity;
+		z *= params.lacunarity;
+		amp *= params.persistence;
+	}
+	acc * inv_amp_sum * 2.0 - 1.0
+}
+
+/// `pshine_pcg32_*` from `pshine/src/pshine/util.c`.
+pub struct Pcg32 {
+	state: u64,
+}
+
+impl Pcg32 {
+	const MULTIPLIER: u64 = 6364136223846793005;
+	const INCREMENT: u64 = 1442695040888963407;
+
+	pub fn new(seed: u64) -> Self {
+		let mut rng = Self { state: seed.wrapping_add(Self::INCREMENT) };
+		rng.next_u32();
+		rng
+	}
+
+	pub fn next_u32(&mut self) -> u32 {
+		self.state = self.state.wrapping_mul(Self::MULTIPLIER).wrapping_add(Self::INCREMENT);
+		let x = self.state;
+		(((x ^ (x >> 18)) >> 27) as u32).rotate_right((x >> 59) as u32)
+	}
+
+	pub fn next_f64(&mut self) -> f64 {
+		let a = self.next_u32() >> 5;
+		let b = self.next_u32() >> 6;
+		(a as f64 * 67108864.0 + b as f64) * (1.0 / 9007199254740992.0)
+	}
+
+	pub fn range(&mut self, min: f64, max: f64) -> f64 {
+		min + (max - min) * self.next_f64()
+	}
+}
+
+#[derive(Clone, Copy, Debug)]
+pub struct Crater {
+	pub pos: [f64; 3],
+	pub radius: f64,
+	pub floor_height: f64,
+	pub steepness: f64,
+	pub k1: f64,
+	pub k2: f64,
+}
+
+fn smin(a: f64, b: f64, k: f64) -> f64 {
+	let h = 0.5 + 0.5 * (a - b) / k;
+	let h = if h < 0.0 { 0.0 } else if h > 1.0 { 1.0 } else { h };
+	a * (1.0 - h) + b * h - k * h * (1.0 - h)
+}
+
+impl Crater {
+	pub fn shape(&self, d: f64) -> f64 {
+		let bowl = 4.0 * d.powf(self.steepness + 1.0) - 1.0;
+		let edge = (d - 1.0) * (d - 1.0);
+		smin(smin(bowl, edge, self.k1), self.floor_height, self.k2)
+	}
+}
+
+#[derive(Clone, Copy, Debug)]
+pub struct BombardmentConfig {
+	pub radius_min: f64,
+	pub radius_max: f64,
+	pub radius_bias: f64,
+	pub lat_bias: f64,
+	pub lat_clearance: f64,
+	pub depth_min: f64,
+	pub depth_max: f64,
+	pub steepness_min: f64,
+	pub steepness_max: f64,
+}
+
+impl Default for BombardmentConfig {
+	fn default() -> Self {
+		Self {
+			radius_min: 0.02,
+			radius_max: 0.95,
+			radius_bias: 2.3,
+			lat_bias: 1.7,
+			lat_clearance: 0.05,
+			depth_min: 0.05,
+			depth_max: 0.8,
+			steepness_min: 0.9,
+			steepness_max: 1.1,
+		}
+	}
+}
+
+/// See `struct pshine_crater_index`.
+pub struct CraterIndex {
+	level_count: u32,
+	cell_offsets: Vec<u32>,
+	crater_indices: Vec<u32>,
+}
+
+pub const CRATER_INDEX_MAX_LEVELS: u32 = 9;
+
+fn index_face_point(face: u32, u: f64, v: f64) -> [f64; 3] {
+	let a = (face / 2) as usize;
+	let mut out = [0.0; 3];
+	out[a] = if face % 2 == 0 { 1.0 } else { -1.0 };
+	out[(a + 1) % 3] = u;
+	out[(a + 2) % 3] = v;
+	let inv_len = 1.0 / (out[0] * out[0] + out[1] * out[1] + out[2] * out[2]).sqrt();
+	out.map(|c| c * inv_len)
+}
+
+fn index_dist(a: [f64; 3], b: [f64; 3]) -> f64 {
+	let (dx, dy, dz) = (a[0] - b[0], a[1] - b[1], a[2] - b[2]);
+	(dx * dx + dy * dy + dz * dz).sqrt()
+}
+
+fn index_level_base(level: u32) -> usize {
+	2 * ((1usize << (2 * level)) - 1)
+}
+
+/// The largest distance between `pos` and the direction of a point that is at most `radius` away from `pos`.
+fn index_reach(radius: f64) -> f64 {
+	if radius >= 1.0 { 2.0 } else { radius / (radius.asin() * 0.5).cos() }
+}
+
+impl CraterIndex {
+	fn build(craters: &[Crater]) -> Self {
+		let mut level_count = 2;
+		while level_count < CRATER_INDEX_MAX_LEVELS && (6usize << (2 * (level_count - 1))) < craters.len() {
+			level_count += 1;
+		}
+		let cell_count = index_level_base(level_count);
+		let mut index = Self {
+			level_count,
+			cell_offsets: vec![0; cell_count + 1],
+			crater_indices: vec![],
+		};
+		let mut cursors = vec![0u32; cell_count];
+		for fill in [false, true] {
+			for (c, crater) in craters.iter().enumerate() {
+				let reach = index_reach(crater.radius);
+				let mut target_level = 0;
+				while target_level + 1 < level_count && reach * (2u32 << target_level) as f64 <= 1.0 {
+					target_level += 1;
+				}
+				for face in 0..6 {
+					index.visit(&mut cursors, fill, target_level, c as u32, crater.pos, reach, face, 0, 0, 0);
+				}
+			}
+			if !fill {
+				for cell in 0..cell_count {
+					index.cell_offsets[cell + 1] = index.cell_offsets[cell] + cursors[cell];
+					cursors[cell] = index.cell_offsets[cell];
+				}
+				index.crater_indices = vec![0; index.cell_offsets[cell_count] as usize];
+			}
+		}
+		index
+	}
+
+	fn visit(
+		&mut self,
+		cursors: &mut [u32],
+		fill: bool,
+		target_level: u32,
+		crater_idx: u32,
+		pos: [f64; 3],
+		reach: f64,
+		face: u32,
+		level: u32,
+		i: u32,
+		j: u32,
+	) {
+		let size = 2.0 / (1u32 << level) as f64;
+		let (u0, v0) = (-1.0 + i as f64 * size, -1.0 + j as f64 * size);
+		let center = index_face_point(face, u0 + size * 0.5, v0 + size * 0.5);
+		let mut radius: f64 = 0.0;
+		for k in 0..4 {
+			let corner = index_face_point(face, u0 + size * (k & 1) as f64, v0 + size * (k >> 1) as f64);
+			radius = radius.max(index_dist(center, corner));
+		}
+		if index_dist(center, pos) > reach + radius + 1e-9 {
+			return;
+		}
+		if level == target_level {
+			let n = 1usize << level;
+			let cell = index_level_base(level) + (face as usize * n + j as usize) * n + i as usize;
+			if fill {
+				self.crater_indices[cursors[cell] as usize] = crater_idx;
+			}
+			cursors[cell] += 1;
+			return;
+		}
+		for k in 0..4 {
+			self.visit(cursors, fill, target_level, crater_idx, pos, reach, face, level + 1, i * 2 + (k & 1), j * 2 + (k >> 1));
+		}
+	}
+
+	/// The crater lists (one per level, the rest empty) that may contain craters overlapping `p`.
+	fn candidates(&self, p: [f64; 3]) -> [&[u32]; CRATER_INDEX_MAX_LEVELS as usize] {
+		let a = if p[0].abs() >= p[1].abs() && p[0].abs() >= p[2].abs() { 0 }
+			else if p[1].abs() >= p[2].abs() { 1 } else { 2 };
+		let inv_major = 1.0 / p[a].abs();
+		let res = 1u32 << (self.level_count - 1);
+		let n = res as f64;
+		let fu = ((p[(a + 1) % 3] * inv_major + 1.0) * 0.5 * n).floor();
+		let fv = ((p[(a + 2) % 3] * inv_major + 1.0) * 0.5 * n).floor();
+		let face = a as u32 * 2 + if p[a] < 0.0 { 1 } else { 0 };
+		let ci = if fu < 0.0 { 0 } else if fu >= n { res - 1 } else { fu as u32 };
+		let cj = if fv < 0.0 { 0 } else if fv >= n { res - 1 } else { fv as u32 };
+		let mut lists: [&[u32]; CRATER_INDEX_MAX_LEVELS as usize] = [&[]; CRATER_INDEX_MAX_LEVELS as usize];
+		for level in 0..self.level_count {
+			let (shift, n) = (self.level_count - 1 - level, 1usize << level);
+			let c = index_level_base(level) + (face as usize * n + (cj >> shift) as usize) * n + (ci >> shift) as usize;
+			let (start, end) = (self.cell_offsets[c] as usize, self.cell_offsets[c + 1] as usize);
+			lists[level as usize] = &self.crater_indices[start..end];
+		}
+		lists
+	}
+}
+
+pub struct CraterField {
+	/// Summed in this order.
+	pub craters: Vec<Crater>,
+	pub index: CraterIndex,
+}
+
+impl CraterField {
+	/// Builds the index, the craters keep their order.
+	pub fn new(craters: Vec<Crater>) -> Self {
+		let index = CraterIndex::build(&craters);
+		Self { craters, index }
+	}
+
+	pub fn generate(crater_count: usize, config: &BombardmentConfig, seed: u64) -> Self {
+		let mut rng = Pcg32::new(seed);
+		let mut craters = Vec::with_capacity(crater_count);
+		for _ in 0..crater_count {
+			let lat = rng.range(-1.0, 1.0);
+			let lat = lat.abs().powf(config.lat_bias) * (if lat < 0.0 { -1.0 } else { 1.0 })
+				* (1.0 - config.lat_clearance) * π / 2.0;
+			let lon = rng.range(-π, π);
+			let radius = rng.range(config.radius_min, config.radius_max).powf(config.radius_bias);
+			let depth = rng.range(config.depth_min, config.depth_max);
+			let steepness = rng.range(config.steepness_min, config.steepness_max);
+			let r = lat.cos();
+			craters.push(Crater {
+				pos: [r * lon.cos(), lat.sin(), r * lon.sin()],
+				radius,
+				floor_height: -depth,
+				steepness,
+				k1: 0.5,
+				k2: -0.3,
+			});
+		}
+		Self::new(craters)
+	}
+
+	fn eval_crater(crater: &Crater, p: [f64; 3], acc: &mut f64) {
+		let r2 = crater.radius * crater.radius;
+		let dx = crater.pos[0] - p[0];
+		let dy = crater.pos[1] - p[1];
+		let dz = crater.pos[2] - p[2];
+		let d2 = dx * dx + dy * dy + dz * dz;
+		if d2 <= r2 {
+			*acc += crater.shape(d2.sqrt() / crater.radius);
+		}
+	}
+
+	/// Evaluates every crater, ignoring the index.
+	pub fn eval_brute_force(&self, p: [f64; 3]) -> f64 {
+		let mut acc = 0.0;
+		for crater in &self.craters {
+			Self::eval_crater(crater, p, &mut acc);
+		}
+		acc
+	}
+
+	/// Same result as `eval_brute_force`: the skipped craters contribute nothing.
+	pub fn eval(&self, p: [f64; 3]) -> f64 {
+		if p == [0.0; 3] {
+			return self.eval_brute_force(p);
+		}
+		// every list is in increasing order, so merging them sums the craters in the brute-force order.
+		let mut lists = self.index.candidates(p);
+		let mut acc = 0.0;
+		while let Some(&c) = lists.iter().filter_map(|list| list.first()).min() {
+			for list in &mut lists {
+				if list.first() == Some(&c) {
+					*list = &list[1..];
+				}
+			}
+			Self::eval_crater(&self.craters[c as usize], p, &mut acc);
+		}
+		acc
+	}
+}
+
+pub enum LayerKind {
+	Fbm(FractalParams),
+	Ridged(FractalParams),
+	Craters(CraterField),
+}
+
+/// See `struct pshine_surface_layer`.
+pub struct Layer {
+	pub kind: LayerKind,
+	pub warp_seed: u32,
+	pub warp_strength: f64,
+	pub warp_frequency: f64,
+	pub point_scale: f64,
+	pub pre_scale: f64,
+	pub pre_bias: f64,
+	pub exponent: f64,
+	pub scale: f64,
+	pub bias: f64,
+}
+
+impl Layer {
+	pub fn new(kind: LayerKind) -> Self {
+		Self {
+			kind,
+			warp_seed: 0,
+			warp_strength: 0.0,
+			warp_frequency: 1.0,
+			point_scale: 1.0,
+			pre_scale: 1.0,
+			pre_bias: 0.0,
+			exponent: 0.0,
+			scale: 1.0,
+			bias: 0.0,
+		}
+	}
+
+	pub fn eval(&self, p: [f64; 3]) -> f64 {
+		let [mut x, mut y, mut z] = p;
+		if self.warp_strength != 0.0 {
+			let (sx, sy, sz) = (
+				self.warp_seed.wrapping_mul(69),
+				self.warp_seed.wrapping_mul(123),
+				self.warp_seed.wrapping_mul(231),
+			);
+			let [wx, wy, wz] = p.map(|c| c * self.warp_frequency);
+			x += perlin(sx, wx, wy, wz) * self.warp_strength;
+			y += perlin(sy, wx, wy, wz) * self.warp_strength;
+			z += perlin(sz, wx, wy, wz) * self.warp_strength;
+		}
+		let q = [x * self.point_scale, y * self.point_scale, z * self.point_scale];
+		let v = match &self.kind {
+			LayerKind::Fbm(params) => fbm(params, q),
+			LayerKind::Ridged(params) => ridged(params, q),
+			LayerKind::Craters(field) => field.eval(q),
+		};
+		let mut v = v * self.pre_scale + self.pre_bias;
+		if self.exponent != 0.0 {
+			v = ((v + 1.0) / 2.0).abs().powf(self.exponent) * 2.0 - 1.0;
+		}
+		v * self.scale + self.bias
+	}
+}
+
+pub struct Surface {
+	pub layers: Vec<Layer>,
+}
+
+impl Surface {
+	pub fn height(&self, p: [f64; 3]) -> f64 {
+		let mut h = 0.0;
+		for layer in &self.layers {
+			h += layer.eval(p);
+		}
+		h
+	}
+}